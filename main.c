@@ -1,13 +1,3053 @@
 #include <stdio.h>
+#include <string.h>
 #include "tl_tower_light.h"
 #include "tl_internal.h"
+#include "tl_probes.h"
 
 #ifdef BUILD_TEST_EXE 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/resource.h>
+#endif
+
+/* -------------------------------------------------------------------------
+ * O (ݭnOA tl_usb_sim.c)
+ */
+
+/* ѮɦLXmípJѼ */
+static int g_test_failures = 0;
+#define TL_TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("[ե] %s:%d %s\n", __FILE__, __LINE__, #cond); \
+            g_test_failures++; \
+        } \
+    } while (0)
+
+/* ˸msաG@ӳ椸OƻPCөROBzɶ */
+#define TL_TEST_FLEET_SIZE        12
+#define TL_TEST_FLEET_LATENCY_US  2000
+
+/* IЮMθsյe */
+typedef struct {
+    TL_GROUP_HANDLE group;
+    TL_TowerFrame frame;
+    volatile unsigned int stop;
+    unsigned int applied;
+} TL_TestApplyLoop;
+
+static void tl_test_apply_loop(void* arg)
+{
+    TL_TestApplyLoop* loop = (TL_TestApplyLoop*)arg;
+
+    while (!tl_atomic_load_u32(&loop->stop)) {
+        TL_GroupApplyFrame(loop->group, &loop->frame, TL_TRUE, NULL, NULL);
+        loop->applied++;
+    }
+}
+
+/*
+ * ˸msաGPɮMλPvx]wAHήMδ˸m
+ */
+static void tl_test_group_fleet(void)
+{
+    TL_DEVICE_HANDLE devices[TL_TEST_FLEET_SIZE];
+    TL_GroupDeviceResult results[TL_TEST_FLEET_SIZE];
+    TL_GroupStats stats;
+    TL_GROUP_HANDLE group = NULL;
+    TL_TowerFrame frame;
+    TL_TestApplyLoop loop;
+    TL_Thread* thread;
+    TL_BYTE state[4];
+    unsigned long long start_us;
+    unsigned long long serial_us;
+    unsigned int i;
+
+    printf("\n--------------- ˸ms (O x%d) ---------------\n", TL_TEST_FLEET_SIZE);
+    TL_TEST_CHECK(tl_usb_sim_enable(TL_TEST_FLEET_SIZE, TL_TEST_FLEET_LATENCY_US) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    for (i = 0; i < TL_TEST_FLEET_SIZE; i++) {
+        TL_TEST_CHECK(TL_OpenDevice(i, TL_FALSE, &devices[i]) == TL_SUCCESS);
+    }
+
+    /* 氱eGĤ@hOPﾹ */
+    memset(&frame, 0, sizeof(frame));
+    frame.layers[TL_LAYER_ONE].red_status = TL_LED_ON;
+    frame.layers[TL_LAYER_ONE].pattern = TL_LED_PATTERN_ON;
+    frame.buzzer.tone = TL_BUZZER_TONE_HIGH;
+    frame.buzzer.volume = TL_BUZZER_VOLUME_BIG;
+    frame.buzzer.pattern = TL_BUZZER_PATTERN_1;
+    frame.target_mask = TL_FRAME_LAYER_ONE | TL_FRAME_BUZZER;
+
+    /* vx]w */
+    start_us = tl_time_now_us();
+    for (i = 0; i < TL_TEST_FLEET_SIZE; i++) {
+        TL_TEST_CHECK(TL_DeviceSetLED(devices[i], TL_LAYER_ONE, &frame.layers[TL_LAYER_ONE]) == TL_SUCCESS);
+        TL_TEST_CHECK(TL_DeviceSetBuzzer(devices[i], &frame.buzzer) == TL_SUCCESS);
+    }
+    serial_us = tl_time_now_us() - start_us;
+
+    /* sզPɮM (̻) */
+    TL_TEST_CHECK(TL_CreateDeviceGroup(devices, TL_TEST_FLEET_SIZE, &group) == TL_SUCCESS);
+    memset(&stats, 0, sizeof(stats));
+    TL_TEST_CHECK(TL_GroupApplyFrame(group, &frame, TL_TRUE, results, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.success_count == TL_TEST_FLEET_SIZE);
+    TL_TEST_CHECK(stats.total_us < serial_us);
+    for (i = 0; i < TL_TEST_FLEET_SIZE; i++) {
+        TL_TEST_CHECK(results[i].result == TL_SUCCESS);
+        tl_usb_sim_get_layer(i, TL_LAYER_ONE, state);
+        TL_TEST_CHECK(state[0] == TL_LED_ON);
+    }
+    printf("vx]w %lluusAsծM %lluusA̤jɶt %lluus\n",
+        serial_us, stats.total_us, stats.max_skew_us);
+
+    /* @xAMΥuӥx^} */
+    TL_TEST_CHECK(TL_CloseDevice(devices[1]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GroupApplyFrame(group, &frame, TL_TRUE, results, &stats) == TL_ERROR_DEVICE_NOT_OPEN);
+    TL_TEST_CHECK(results[1].result == TL_ERROR_DEVICE_NOT_OPEN);
+    TL_TEST_CHECK(results[0].result == TL_SUCCESS);
+    TL_TEST_CHECK(stats.success_count == TL_TEST_FLEET_SIZE - 1);
+
+    /* Mζi椤t@xGݶi椤MεAᤣAsӸ˸m */
+    loop.group = group;
+    loop.frame = frame;
+    loop.stop = 0;
+    loop.applied = 0;
+    thread = tl_thread_create(tl_test_apply_loop, &loop);
+    TL_TEST_CHECK(thread != NULL);
+    tl_delay_ms(20);
+    TL_TEST_CHECK(TL_CloseDevice(devices[2]) == TL_SUCCESS);
+    tl_delay_ms(20);
+    tl_atomic_store_u32(&loop.stop, 1);
+    tl_thread_join(thread);
+    TL_TEST_CHECK(loop.applied > 0);
+    TL_TEST_CHECK(TL_GroupApplyFrame(group, &frame, TL_FALSE, results, &stats) == TL_ERROR_DEVICE_NOT_OPEN);
+    TL_TEST_CHECK(results[2].result == TL_ERROR_DEVICE_NOT_OPEN);
+    TL_TEST_CHECK(stats.success_count == TL_TEST_FLEET_SIZE - 2);
+
+    /* sջPl˸m TL_Finalize @ */
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* Ƶ{GjqƵ{ƻP^Iέp */
+#define TL_TEST_TIMER_BULK  100000
+
+typedef struct {
+    TL_Mutex* lock;
+    unsigned int success;
+    unsigned int not_open;
+    unsigned int other;
+} TL_TestTimerCounts;
+
+static void tl_test_timer_done(TL_TIMER_ID id, TL_ERROR_CODE result, void* user_data)
+{
+    TL_TestTimerCounts* counts = (TL_TestTimerCounts*)user_data;
+
+    (void)id;
+    tl_mutex_lock(counts->lock);
+    if (result == TL_SUCCESS) {
+        counts->success++;
+    } else if (result == TL_ERROR_DEVICE_NOT_OPEN) {
+        counts->not_open++;
+    } else {
+        counts->other++;
+    }
+    tl_mutex_unlock(counts->lock);
+}
+
+/*
+ * Ƶ{G˸mɨƵ{FP@פjqƵ{sWɶ
+ */
+static void tl_test_scheduler_close(void)
+{
+    TL_DEVICE_HANDLE devices[2];
+    TL_TestTimerCounts counts;
+    TL_TowerCommand command;
+    unsigned long long start_us;
+    unsigned long long insert_us;
+    unsigned long long due_ms;
+    unsigned long writes;
+    unsigned int i;
+
+    printf("\n--------------- Ƶ{ (O x2) ---------------\n");
+    memset(&counts, 0, sizeof(counts));
+    counts.lock = tl_mutex_create();
+    TL_TEST_CHECK(counts.lock != NULL);
+    TL_TEST_CHECK(tl_usb_sim_enable(2, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_SET_LED;
+    command.layer = TL_LAYER_TWO;
+    command.led.green_status = TL_LED_ON;
+    command.led.pattern = TL_LED_PATTERN_ON;
+
+    /* ˸m 0 TӱƵ{B˸m 1 @ӱƵ{F˸m 0 ɨƵ{ߧYH}ҧ */
+    due_ms = TL_GetMonotonicTimeMs() + 50;
+    command.device = devices[0];
+    for (i = 0; i < 3; i++) {
+        TL_TEST_CHECK(TL_ScheduleAt(due_ms, &command, tl_test_timer_done, &counts, NULL) == TL_SUCCESS);
+    }
+    command.device = devices[1];
+    TL_TEST_CHECK(TL_ScheduleAt(due_ms, &command, tl_test_timer_done, &counts, NULL) == TL_SUCCESS);
+    writes = tl_usb_sim_write_count(0);
+    TL_TEST_CHECK(TL_CloseDevice(devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(counts.not_open == 3);
+    tl_delay_ms(150);
+    tl_mutex_lock(counts.lock);
+    TL_TEST_CHECK(counts.success == 1);
+    TL_TEST_CHECK(counts.other == 0);
+    tl_mutex_unlock(counts.lock);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) == writes);
+
+    /* P@תjqƵ{G[lݬ O(1)A`ɶPƵ{Ʀ */
+    due_ms = TL_GetMonotonicTimeMs() + 60000;
+    start_us = tl_time_now_us();
+    for (i = 0; i < TL_TEST_TIMER_BULK; i++) {
+        if (TL_ScheduleAt(due_ms, &command, tl_test_timer_done, &counts, NULL) != TL_SUCCESS) {
+            break;
+        }
+    }
+    insert_us = tl_time_now_us() - start_us;
+    TL_TEST_CHECK(i == TL_TEST_TIMER_BULK);
+    printf("P@׷sW %u ӱƵ{ %lluus ( %.3fus)\n",
+        i, insert_us, (double)insert_us / (double)TL_TEST_TIMER_BULK);
+
+    /* ˸m 1 @ҦƵ{ */
+    start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_CloseDevice(devices[1]) == TL_SUCCESS);
+    printf("˸m %u ӱƵ{ %lluus\n", counts.not_open - 3, tl_time_now_us() - start_us);
+    TL_TEST_CHECK(counts.not_open == 3 + TL_TEST_TIMER_BULK);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+    tl_mutex_destroy(counts.lock);
+}
+
+/* Ƶ{GL^OŪOɡBLOƵ{ƻPj (@) */
+#define TL_TEST_TIMER_DEAD_TIMEOUT_MS  100
+#define TL_TEST_TIMER_LIVE_COUNT       6
+#define TL_TEST_TIMER_STEP_MS          10
+
+/* Ƶ{GCӱƵ{GAѦ^IgJ */
+typedef struct {
+    unsigned long long start_us;      /* }lƵ{ɶ (Ƶ{egJ) */
+    volatile unsigned int done;       /* ɬ 1 */
+    volatile unsigned int result;     /* G */
+    volatile unsigned int elapsed_ms; /* ۶}l짹@ */
+} TL_TestTimerResult;
+
+static void tl_test_timer_record(TL_TIMER_ID id, TL_ERROR_CODE result, void* user_data)
+{
+    TL_TestTimerResult* record = (TL_TestTimerResult*)user_data;
+
+    (void)id;
+    tl_atomic_store_u32(&record->result, (unsigned int)result);
+    tl_atomic_store_u32(&record->elapsed_ms, (unsigned int)((tl_time_now_us() - record->start_us) / 1000));
+    tl_atomic_store_u32(&record->done, 1);
+}
+
+static void tl_test_count_event(const TL_Event* event, void* user_data)
+{
+    (void)event;
+    (*(unsigned int*)user_data)++;
+}
+
+/*
+ * Ƶ{GRO浹CAL^O|LOƵ{
+ */
+static void tl_test_scheduler_dead_tower(void)
+{
+    TL_DEVICE_HANDLE devices[3];
+    TL_TestTimerResult records[1 + TL_TEST_TIMER_LIVE_COUNT];
+    TL_TimeoutConfig config;
+    TL_TowerCommand command;
+    TL_QueueStats stats;
+    unsigned long long start_us;
+    unsigned long long due_ms;
+    unsigned int live_ms = 0;
+    unsigned int events = 0;
+    unsigned int processed;
+    unsigned int i;
+
+    printf("\n--------------- Ƶ{PL^O (O x3) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(3, 2000) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    for (i = 0; i < 3; i++) {
+        TL_TEST_CHECK(TL_OpenDevice(i, TL_FALSE, &devices[i]) == TL_SUCCESS);
+    }
+    config.min_timeout_ms = TL_TEST_TIMER_DEAD_TIMEOUT_MS;
+    config.max_timeout_ms = TL_TEST_TIMER_DEAD_TIMEOUT_MS;
+    config.retry_on_timeout = TL_TRUE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_SUCCESS);
+    tl_usb_sim_drop_responses(0, 1000);
+
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_SET_LED;
+    command.layer = TL_LAYER_ONE;
+    command.led.red_status = TL_LED_ON;
+    command.led.pattern = TL_LED_PATTERN_ON;
+
+    /* O 0 ̥AO 1 P 2 Ƶ{bOɴ */
+    memset((void*)records, 0, sizeof(records));
+    start_us = tl_time_now_us();
+    due_ms = TL_GetMonotonicTimeMs() + TL_TEST_TIMER_STEP_MS;
+    for (i = 0; i <= TL_TEST_TIMER_LIVE_COUNT; i++) {
+        records[i].start_us = start_us;
+        command.device = (i == 0) ? devices[0] : devices[1 + i % 2];
+        TL_TEST_CHECK(TL_ScheduleAt(due_ms + i * TL_TEST_TIMER_STEP_MS, &command,
+                                    tl_test_timer_record, &records[i], NULL) == TL_SUCCESS);
+    }
+
+    for (i = 0; i <= TL_TEST_TIMER_LIVE_COUNT; i++) {
+        while (tl_atomic_load_u32(&records[i].done) == 0 && tl_time_now_us() - start_us < 3000000) {
+            tl_delay_ms(1);
+        }
+        TL_TEST_CHECK(tl_atomic_load_u32(&records[i].done) == 1);
+        if (i == 0) {
+            TL_TEST_CHECK(tl_atomic_load_u32(&records[i].result) == (unsigned int)TL_ERROR_TIMEOUT);
+        } else {
+            TL_TEST_CHECK(tl_atomic_load_u32(&records[i].result) == (unsigned int)TL_SUCCESS);
+            if (tl_atomic_load_u32(&records[i].elapsed_ms) > live_ms) {
+                live_ms = tl_atomic_load_u32(&records[i].elapsed_ms);
+            }
+        }
+    }
+    printf("O 0 L^ (%lums ᥢ)ALO̫@ӱƵ{ %ums  (̫ %ums)\n",
+        (unsigned long)tl_atomic_load_u32(&records[0].elapsed_ms), live_ms,
+        (TL_TEST_TIMER_LIVE_COUNT + 1) * TL_TEST_TIMER_STEP_MS);
+    TL_TEST_CHECK(live_ms < (TL_TEST_TIMER_LIVE_COUNT + 1) * TL_TEST_TIMER_STEP_MS + 50);
+    TL_TEST_CHECK(live_ms < tl_atomic_load_u32(&records[0].elapsed_ms));
+
+    /* gѴCͨƥ */
+    TL_TEST_CHECK(TL_ProcessEvents(tl_test_count_event, &events, 0, &processed) == TL_SUCCESS);
+    TL_TEST_CHECK(processed == 0 && events == 0);
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_FALSE) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.submitted == 1 + TL_TEST_TIMER_LIVE_COUNT);
+
+    for (i = 0; i < 3; i++) {
+        TL_TEST_CHECK(TL_CloseDevice(devices[i]) == TL_SUCCESS);
+    }
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ġGIݦĪG */
+typedef struct {
+    TL_DEVICE_HANDLE device;
+    TL_ERROR_CODE result;
+} TL_TestConvergeWait;
+
+static void tl_test_converge_wait(void* arg)
+{
+    TL_TestConvergeWait* wait = (TL_TestConvergeWait*)arg;
+
+    wait->result = TL_WaitForConvergence(wait->device, 5000);
+}
+
+/*
+ * 檬AġGĨ檬AAHεݦĩŪέp
+ */
+static void tl_test_reconcile_stop(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TowerFrame desired;
+    TL_ReconcileStats stats;
+    TL_TestConvergeWait waits[4];
+    TL_Thread* threads[4];
+    TL_BYTE state[4];
+    unsigned long long start_us;
+    unsigned int round;
+    unsigned int i;
+
+    printf("\n--------------- 檬A (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    memset(&desired, 0, sizeof(desired));
+    desired.layers[TL_LAYER_THREE].green_status = TL_LED_ON;
+    desired.layers[TL_LAYER_THREE].pattern = TL_LED_PATTERN_ON;
+    desired.target_mask = TL_FRAME_LAYER_THREE;
+    TL_TEST_CHECK(TL_SetDesiredState(device, &desired) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_WaitForConvergence(device, 2000) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_THREE, state);
+    TL_TEST_CHECK(state[1] == TL_LED_ON);
+    TL_TEST_CHECK(TL_GetReconcileStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.converged);
+
+    /* CөRO 50msAĤGݤݡAľbݪ}~ */
+    tl_usb_sim_set_latency(0, 50000);
+    for (round = 0; round < 3; round++) {
+        desired.layers[TL_LAYER_THREE].red_status = (round % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        TL_TEST_CHECK(TL_SetDesiredState(device, &desired) == TL_SUCCESS);
+        for (i = 0; i < 4; i++) {
+            waits[i].device = device;
+            waits[i].result = TL_ERROR_GENERAL;
+            threads[i] = tl_thread_create(tl_test_converge_wait, &waits[i]);
+            TL_TEST_CHECK(threads[i] != NULL);
+        }
+        tl_delay_ms(10);
+        start_us = tl_time_now_us();
+        TL_TEST_CHECK(TL_StopReconcile(device) == TL_SUCCESS);
+        for (i = 0; i < 4; i++) {
+            if (threads[i] != NULL) {
+                tl_thread_join(threads[i]);
+                TL_TEST_CHECK(waits[i].result == TL_SUCCESS);
+            }
+        }
+        TL_TEST_CHECK(tl_time_now_us() - start_us < 1000000);
+        TL_TEST_CHECK(TL_GetReconcileStats(device, &stats) == TL_SUCCESS);
+        TL_TEST_CHECK(stats.converged);
+    }
+    printf("Ĥ %u Aݪ̬Ҥw\n", round);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* JoiGIаeJJBܧ]wPŪέp */
+typedef struct {
+    TL_DEVICE_HANDLE device;
+    volatile unsigned int stop;
+    unsigned int failures;
+    unsigned int inputs;
+} TL_TestFilterLoop;
+
+static void tl_test_filter_loop(void* arg)
+{
+    TL_TestFilterLoop* loop = (TL_TestFilterLoop*)arg;
+    TL_FilterConfig config;
+    TL_FilterStats stats;
+    TL_LEDStatus status;
+
+    memset(&config, 0, sizeof(config));
+    memset(&status, 0, sizeof(status));
+    status.pattern = TL_LED_PATTERN_ON;
+    while (!tl_atomic_load_u32(&loop->stop)) {
+        config.rise_debounce_ms = loop->inputs % 3;
+        status.green_status = (loop->inputs % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        if (TL_SetFilterConfig(loop->device, TL_FRAME_LAYER_TWO, &config) != TL_SUCCESS ||
+            TL_FilterLED(loop->device, TL_LAYER_TWO, &status) != TL_SUCCESS ||
+            TL_GetFilterStats(loop->device, TL_LAYER_TWO, &stats) != TL_SUCCESS) {
+            loop->failures++;
+        }
+        loop->inputs++;
+    }
+}
+
+/*
+ * JoiGeJJBܧ]wPŪέpаoi
+ */
+static void tl_test_filter_stop(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TestFilterLoop loops[4];
+    TL_Thread* threads[4];
+    unsigned int round;
+    unsigned int inputs = 0;
+    unsigned int i;
+
+    printf("\n--------------- Joi (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    for (i = 0; i < 4; i++) {
+        loops[i].device = device;
+        loops[i].stop = 0;
+        loops[i].failures = 0;
+        loops[i].inputs = 0;
+        threads[i] = tl_thread_create(tl_test_filter_loop, &loops[i]);
+        TL_TEST_CHECK(threads[i] != NULL);
+    }
+
+    /* CoiAU@ӿJAsإ */
+    for (round = 0; round < 200; round++) {
+        tl_delay_ms(1);
+        TL_TEST_CHECK(TL_StopFilter(device) == TL_SUCCESS);
+    }
+
+    for (i = 0; i < 4; i++) {
+        tl_atomic_store_u32(&loops[i].stop, 1);
+    }
+    for (i = 0; i < 4; i++) {
+        if (threads[i] != NULL) {
+            tl_thread_join(threads[i]);
+            TL_TEST_CHECK(loops[i].failures == 0);
+            inputs += loops[i].inputs;
+        }
+    }
+    TL_TEST_CHECK(TL_StopFilter(device) == TL_SUCCESS);
+    printf("oi %u AJ %u \n", round, inputs);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/*
+ * ĦwݪGeXweswe
+ */
+static void tl_test_watchdog_update(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TowerFrame failsafe;
+    TL_WatchdogStats stats;
+    unsigned int round;
+
+    printf("\n--------------- ݪswe (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    /* ߸guROɶAݪĲoAeXЧswe */
+    tl_usb_sim_set_latency(0, 3000);
+    memset(&failsafe, 0, sizeof(failsafe));
+    failsafe.layers[TL_LAYER_ONE].pattern = TL_LED_PATTERN_ON;
+    failsafe.target_mask = TL_FRAME_LAYER_ONE;
+    for (round = 0; round < 200; round++) {
+        failsafe.layers[TL_LAYER_ONE].red_status = (round % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        TL_TEST_CHECK(TL_StartWatchdog(device, 1, &failsafe) == TL_SUCCESS);
+        tl_delay_ms(2);
+    }
+    TL_TEST_CHECK(TL_GetWatchdogStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.trip_count > 0);
+    TL_TEST_CHECK(TL_StopWatchdog(device) == TL_SUCCESS);
+    printf("swe %u AĲo %llu \n", round, stats.trip_count);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* AxGեΪxɮ */
+#define TL_TEST_JOURNAL_PATH "tl_test_journal.bin"
+
+/*
+ * AxGC|ǧܫ̸˸m|٭A٭쪺ؼзӱ`M
+ */
+static void tl_test_journal_path(void)
+{
+    TL_DEVICE_HANDLE devices[2];
+    TL_JournalStats stats;
+    TL_LEDStatus red = { TL_LED_ON, TL_LED_OFF, TL_LED_OFF, TL_LED_PATTERN_ON };
+    TL_LEDStatus green = { TL_LED_OFF, TL_LED_ON, TL_LED_OFF, TL_LED_PATTERN_ON };
+    TL_LEDStatus blue = { TL_LED_OFF, TL_LED_OFF, TL_LED_ON, TL_LED_PATTERN_ON };
+    TL_BYTE state[4];
+
+    printf("\n--------------- Ax̸|٭ (O) ---------------\n");
+    remove(TL_TEST_JOURNAL_PATH);
+    TL_TEST_CHECK(tl_usb_sim_enable(2, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenJournal(TL_TEST_JOURNAL_PATH, 0) == TL_SUCCESS);
+    /* M}ҡAxuO]wؼ */
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_ONE, &red) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[1], TL_LAYER_TWO, &green) == TL_SUCCESS);
+
+    /* x᪺]w|OAs}ҮɶQM */
+    TL_TEST_CHECK(TL_CloseJournal() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[1], TL_LAYER_THREE, &blue) == TL_SUCCESS);
+    TL_Finalize();
+
+    /* yO洫C|ޡG 0 {bOO 1 */
+    tl_usb_sim_replug(0, 1);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenJournal(TL_TEST_JOURNAL_PATH, 0) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_TRUE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetJournalStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.restored && stats.restored_mask == TL_FRAME_LAYER_TWO);
+    tl_usb_sim_get_layer(1, TL_LAYER_TWO, state);
+    TL_TEST_CHECK(state[1] == TL_LED_ON);
+    tl_usb_sim_get_layer(1, TL_LAYER_THREE, state);
+    TL_TEST_CHECK(state[2] == TL_LED_OFF);
+    tl_usb_sim_get_layer(0, TL_LAYER_ONE, state);
+    TL_TEST_CHECK(state[0] == TL_LED_ON);
+
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetJournalStats(devices[1], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.restored && stats.restored_mask == TL_FRAME_LAYER_ONE);
+    printf("洫C|ޫ̸|٭A٭쪺ؼФwM\n");
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+    remove(TL_TEST_JOURNAL_PATH);
+}
+
+/* ʵeǦCGեΪrwqPǦCw */
+#define TL_TEST_SEQ_SOURCE  "tl_test_sequence.txt"
+#define TL_TEST_SEQ_FIRST   "tl_test_sequence_1.tlsq"
+#define TL_TEST_SEQ_SECOND  "tl_test_sequence_2.tlsq"
+
+/*
+ * ʵeǦCGeXBJ］èǦCwAHΰeXѪBJOJvlA
+ */
+static void tl_test_sequence_unload(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_SEQUENCE_LIBRARY first;
+    TL_SEQUENCE_LIBRARY second;
+    TL_SequenceStats stats;
+    TL_TowerState current;
+    TL_TowerState after;
+    unsigned int round;
+    FILE* file;
+
+    printf("\n--------------- ʵeǦC (O) ---------------\n");
+    file = fopen(TL_TEST_SEQ_SOURCE, "w");
+    TL_TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    /* CӨBJ]whAĤGhRObĤ@h𤧫~۬MgŪ */
+    fputs("sequence blink repeat 0\n"
+          "5 100/1 010/1 - -\n"
+          "5 000/0 000/0 - -\n"
+          "sequence once\n"
+          "5 001/1 - - -\n", file);
+    fclose(file);
+    TL_TEST_CHECK(TL_CompileSequenceLibrary(TL_TEST_SEQ_SOURCE, TL_TEST_SEQ_FIRST) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_CompileSequenceLibrary(TL_TEST_SEQ_SOURCE, TL_TEST_SEQ_SECOND) == TL_SUCCESS);
+
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_LoadSequenceLibrary(TL_TEST_SEQ_SECOND, &second) == TL_SUCCESS);
+
+    /* CөRO 20msGĤ@h］t@ӧǦCwè쥻ǦCw */
+    tl_usb_sim_set_latency(0, 20000);
+    for (round = 0; round < 10; round++) {
+        TL_TEST_CHECK(TL_LoadSequenceLibrary(TL_TEST_SEQ_FIRST, &first) == TL_SUCCESS);
+        TL_TEST_CHECK(TL_PlaySequence(device, first, "blink") == TL_SUCCESS);
+        tl_delay_ms(10);
+        TL_TEST_CHECK(TL_PlaySequence(device, second, "blink") == TL_SUCCESS);
+        TL_TEST_CHECK(TL_UnloadSequenceLibrary(first) == TL_SUCCESS);
+        tl_delay_ms(30);
+    }
+    TL_TEST_CHECK(TL_StopSequence(device) == TL_SUCCESS);
+    printf("eX］èǦCw %u \n", round);
+
+    /* eXѪBJOJvlA (Ĥ@h̫ᦨ\eXA) */
+    tl_usb_sim_set_latency(0, 200);
+    TL_TEST_CHECK(TL_GetTowerState(device, &current, NULL) == TL_SUCCESS);
+    tl_usb_sim_drop_responses(0, 2);
+    TL_TEST_CHECK(TL_PlaySequence(device, second, "once") == TL_SUCCESS);
+    do {
+        tl_delay_ms(10);
+        TL_TEST_CHECK(TL_GetSequenceStats(device, &stats) == TL_SUCCESS);
+    } while (stats.playing);
+    TL_TEST_CHECK(stats.step_failures == 1);
+    TL_TEST_CHECK(TL_GetTowerState(device, &after, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK((after & 0xFF) == (current & 0xFF));
+
+    TL_TEST_CHECK(TL_UnloadSequenceLibrary(second) == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+    remove(TL_TEST_SEQ_SOURCE);
+    remove(TL_TEST_SEQ_FIRST);
+    remove(TL_TEST_SEQ_SECOND);
+}
+
+/* ĵNXӪGNXơBdߦƻPvjMdߦ */
+#define TL_TEST_ALARM_CODES    100000
+#define TL_TEST_ALARM_LOOKUPS  1000000
+#define TL_TEST_ALARM_SCANS    1000
+#define TL_TEST_ALARM_PATH     "tl_test_alarm.txt"
+
+/*  i ӥNX (j 7919A[ 1 ᥲwbӪ) */
+#define TL_TEST_ALARM_CODE(i)  ((unsigned int)(i) * 7919u + 13u)
+
+/*
+ * ĵNXӪGJ 100k ӥNXAv@ҨûPvjMd߮ɶ
+ */
+static void tl_test_alarm_map(void)
+{
+    static unsigned int codes[TL_TEST_ALARM_CODES];
+    TL_ALARM_MAP map = NULL;
+    TL_TowerCommand command;
+    unsigned long long start_us;
+    unsigned long long load_us;
+    unsigned long long lookup_us;
+    unsigned long long scan_us;
+    unsigned int random = 12345;
+    unsigned int mismatches = 0;
+    unsigned int false_hits = 0;
+    volatile unsigned int sink = 0;
+    unsigned int code;
+    unsigned int i;
+    unsigned int j;
+    FILE* file;
+
+    printf("\n--------------- ĵNXӪ (%d ӥNX) ---------------\n", TL_TEST_ALARM_CODES);
+    file = fopen(TL_TEST_ALARM_PATH, "w");
+    TL_TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    /* Ĥ@hCѥNXsMwAC 10 ӥNX@Ӭuv */
+    for (i = 0; i < TL_TEST_ALARM_CODES; i++) {
+        codes[i] = TL_TEST_ALARM_CODE(i);
+        fprintf(file, "%u %u%u%u/1 - - - %s\n", codes[i], i & 1, (i >> 1) & 1, (i >> 2) & 1,
+                (i % 10 == 0) ? "emergency" : "normal");
+    }
+    fclose(file);
+
+    start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_LoadAlarmMap(TL_TEST_ALARM_PATH, &map) == TL_SUCCESS);
+    load_us = tl_time_now_us() - start_us;
+    remove(TL_TEST_ALARM_PATH);
+    if (map == NULL) {
+        return;
+    }
+
+    /* CӥNX^ePuv */
+    memset(&command, 0, sizeof(command));
+    for (i = 0; i < TL_TEST_ALARM_CODES; i++) {
+        if (TL_LookupAlarm(map, codes[i], &command) != TL_SUCCESS ||
+            command.type != TL_COMMAND_APPLY_FRAME ||
+            command.frame.target_mask != TL_FRAME_LAYER_ONE ||
+            command.frame.layers[TL_LAYER_ONE].red_status != (TL_LED_STATE)(i & 1) ||
+            command.frame.layers[TL_LAYER_ONE].green_status != (TL_LED_STATE)((i >> 1) & 1) ||
+            command.frame.layers[TL_LAYER_ONE].blue_status != (TL_LED_STATE)((i >> 2) & 1) ||
+            command.priority != ((i % 10 == 0) ? TL_PRIORITY_EMERGENCY : TL_PRIORITY_NORMAL)) {
+            mismatches++;
+        }
+    }
+    TL_TEST_CHECK(mismatches == 0);
+
+    /* bӪNX */
+    for (i = 0; i < TL_TEST_ALARM_CODES; i++) {
+        if (TL_LookupAlarm(map, codes[i] + 1, &command) != TL_ERROR_OUT_OF_RANGE) {
+            false_hits++;
+        }
+    }
+    TL_TEST_CHECK(false_hits == 0);
+
+    /* HǬd */
+    start_us = tl_time_now_us();
+    for (i = 0; i < TL_TEST_ALARM_LOOKUPS; i++) {
+        random = random * 1103515245u + 12345u;
+        TL_LookupAlarm(map, codes[(random >> 8) % TL_TEST_ALARM_CODES], &command);
+        sink += command.frame.layers[TL_LAYER_ONE].red_status;
+    }
+    lookup_us = tl_time_now_us() - start_us;
+
+    /* vjMۦPNX */
+    start_us = tl_time_now_us();
+    for (i = 0; i < TL_TEST_ALARM_SCANS; i++) {
+        random = random * 1103515245u + 12345u;
+        code = codes[(random >> 8) % TL_TEST_ALARM_CODES];
+        for (j = 0; j < TL_TEST_ALARM_CODES && codes[j] != code; j++) {
+        }
+        sink += j;
+    }
+    scan_us = tl_time_now_us() - start_us;
+
+    printf("J %lluusAdߥ %llunsAvjM %llunsA %uA~P %u\n",
+           load_us, lookup_us * 1000 / TL_TEST_ALARM_LOOKUPS, scan_us * 1000 / TL_TEST_ALARM_SCANS,
+           mismatches, false_hits);
+    (void)sink;
+
+    TL_TEST_CHECK(TL_UnloadAlarmMap(map) == TL_SUCCESS);
+}
+
+/*
+ *  TCP ȤݡGeXШDõ expected Ӧ줸ժ^ (̦h 2 )A^쪺줸ռ
+ */
+static size_t tl_test_tcp_exchange(TL_Socket* socket, const TL_BYTE* request, size_t request_length,
+                                   TL_BYTE* response, size_t expected)
+{
+    TL_SocketPoll item;
+    unsigned long long deadline_us = tl_time_now_us() + 2000000;
+    size_t sent = 0;
+    size_t received = 0;
+    long result;
+
+    while (sent < request_length && tl_time_now_us() < deadline_us) {
+        result = tl_socket_send(socket, request + sent, request_length - sent);
+        if (result < 0) {
+            return 0;
+        }
+        sent += (size_t)result;
+    }
+    while (received < expected && tl_time_now_us() < deadline_us) {
+        item.socket = socket;
+        item.events = TL_SOCKET_READABLE;
+        item.revents = 0;
+        tl_socket_poll(&item, 1, 100);
+        result = tl_socket_recv(socket, response + received, expected - received);
+        if (result < 0) {
+            break;
+        }
+        received += (size_t)result;
+    }
+    return received;
+}
+
+/*
+ * ModbusGeX@ӽШD (MBAP Y + pdu)AˬdѧOXP׫^^ PDU 
+ */
+static size_t tl_test_modbus_call(TL_Socket* socket, unsigned int transaction, const TL_BYTE* pdu,
+                                  size_t pdu_length, TL_BYTE* response, size_t response_pdu_length)
+{
+    TL_BYTE request[64];
+    size_t received;
+
+    request[0] = (TL_BYTE)(transaction >> 8);
+    request[1] = (TL_BYTE)transaction;
+    request[2] = 0;
+    request[3] = 0;
+    request[4] = 0;
+    request[5] = (TL_BYTE)(pdu_length + 1);
+    request[6] = 1;
+    memcpy(request + 7, pdu, pdu_length);
+
+    received = tl_test_tcp_exchange(socket, request, 7 + pdu_length, response, 7 + response_pdu_length);
+    if (received != 7 + response_pdu_length || memcmp(response, request, 4) != 0 ||
+        response[5] != response_pdu_length + 1 || response[6] != 1) {
+        return 0;
+    }
+    return response_pdu_length;
+}
+
+/* Modbus PAGбҰʦAAP˸mPɶi */
+typedef struct {
+    TL_BOOL push;
+    volatile unsigned int stop;
+    volatile unsigned int started;
+} TL_TestServerStart;
+
+static void tl_test_server_start_loop(void* arg)
+{
+    TL_TestServerStart* loop = (TL_TestServerStart*)arg;
+    TL_ERROR_CODE result;
+
+    while (!tl_atomic_load_u32(&loop->stop)) {
+        result = loop->push ? TL_StartPushServer(NULL, "127.0.0.1", 0) : TL_StartModbusServer(NULL, "127.0.0.1", 0);
+        if (result == TL_SUCCESS) {
+            tl_atomic_store_u32(&loop->started, loop->started + 1);
+        }
+    }
+}
+
+/*
+ * Modbus TCPGsuŪgȦsBҥ~^AHαҰʦAP˸mPɶi
+ */
+static void tl_test_modbus(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_ModbusStats stats;
+    TL_TowerFrame frame;
+    TL_TowerState state;
+    TL_TestServerStart loop;
+    TL_Thread* thread;
+    TL_Socket* socket = NULL;
+    TL_BYTE response[64];
+    TL_BYTE pdu[16];
+    TL_BYTE green;
+    TL_BYTE red;
+    TL_BYTE sim[4];
+    unsigned int round;
+    unsigned int i;
+
+    printf("\n--------------- Modbus TCP (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    /* M}ҡAPwT{AҬ 0AĪBnuϬMgJؼ */
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_StartModbusServer(device, "127.0.0.1", 0) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetModbusStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_socket_connect("127.0.0.1", stats.port, &socket) == TL_SUCCESS);
+    if (socket == NULL) {
+        TL_Finalize();
+        tl_usb_sim_disable();
+        return;
+    }
+
+    /* ȦsȧY TL_TowerState ӥؼЪ줸 */
+    memset(&frame, 0, sizeof(frame));
+    frame.layers[TL_LAYER_ONE].red_status = TL_LED_ON;
+    frame.layers[TL_LAYER_ONE].pattern = TL_LED_PATTERN_ON;
+    frame.layers[TL_LAYER_TWO].green_status = TL_LED_ON;
+    frame.layers[TL_LAYER_TWO].pattern = TL_LED_PATTERN_ON;
+    frame.target_mask = TL_FRAME_ALL;
+    TL_TEST_CHECK(TL_PackTowerState(&frame, &state) == TL_SUCCESS);
+    red = (TL_BYTE)(state & 0xFF);
+    green = (TL_BYTE)((state >> 8) & 0xFF);
+
+    /* \X 06GĤGhରOA^PШDۦP */
+    pdu[0] = 0x06; pdu[1] = 0; pdu[2] = 1; pdu[3] = 0; pdu[4] = green;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 1, pdu, 5, response, 5) == 5);
+    TL_TEST_CHECK(memcmp(response + 7, pdu, 5) == 0);
+    TL_TEST_CHECK(TL_WaitForConvergence(device, 2000) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_TWO, sim);
+    TL_TEST_CHECK(sim[1] == TL_LED_ON);
+
+    /* \X 03G|ӫOȦs (檬A) */
+    pdu[0] = 0x03; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0; pdu[4] = 4;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 2, pdu, 5, response, 10) == 10);
+    TL_TEST_CHECK(response[7] == 0x03 && response[8] == 8);
+    TL_TEST_CHECK(response[9] == 0 && response[10] == 0);
+    TL_TEST_CHECK(response[11] == 0 && response[12] == green);
+
+    /* \X 04GwT{AP|ĪؼоBn */
+    pdu[0] = 0x04; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0; pdu[4] = 5;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 3, pdu, 5, response, 12) == 12);
+    TL_TEST_CHECK(response[7] == 0x04 && response[8] == 10);
+    TL_TEST_CHECK(response[11] == 0 && response[12] == green);
+    TL_TEST_CHECK(response[17] == 0 && response[18] == 0);
+
+    /* \X 16GĤ@hOBĤGhA^_l}Pƶq */
+    pdu[0] = 0x10; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0; pdu[4] = 2; pdu[5] = 4;
+    pdu[6] = 0; pdu[7] = red; pdu[8] = 0; pdu[9] = 0;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 4, pdu, 10, response, 5) == 5);
+    TL_TEST_CHECK(memcmp(response + 7, pdu, 5) == 0);
+    TL_TEST_CHECK(TL_WaitForConvergence(device, 2000) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_ONE, sim);
+    TL_TEST_CHECK(sim[0] == TL_LED_ON);
+    tl_usb_sim_get_layer(0, TL_LAYER_TWO, sim);
+    TL_TEST_CHECK(sim[1] == TL_LED_OFF);
+
+    /* ҥ~^G䴩\XB}WXdBƶqέȵL */
+    pdu[0] = 0x05; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0xFF; pdu[4] = 0;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 5, pdu, 5, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x85 && response[8] == 0x01);
+    pdu[0] = 0x03; pdu[1] = 0; pdu[2] = 3; pdu[3] = 0; pdu[4] = 2;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 6, pdu, 5, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x83 && response[8] == 0x02);
+    pdu[0] = 0x04; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0; pdu[4] = 0;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 7, pdu, 5, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x84 && response[8] == 0x03);
+    pdu[0] = 0x06; pdu[1] = 0; pdu[2] = 4; pdu[3] = 0; pdu[4] = 0;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 8, pdu, 5, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x86 && response[8] == 0x02);
+    pdu[0] = 0x06; pdu[1] = 0; pdu[2] = 0; pdu[3] = 1; pdu[4] = 0;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 9, pdu, 5, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x86 && response[8] == 0x03);
+    pdu[0] = 0x10; pdu[1] = 0; pdu[2] = 0; pdu[3] = 0; pdu[4] = 2; pdu[5] = 2;
+    pdu[6] = 0; pdu[7] = red;
+    TL_TEST_CHECK(tl_test_modbus_call(socket, 10, pdu, 8, response, 2) == 2);
+    TL_TEST_CHECK(response[7] == 0x90 && response[8] == 0x03);
+
+    TL_TEST_CHECK(TL_GetModbusStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.requests == 10 && stats.reads == 2 && stats.writes == 2 && stats.exceptions == 6);
+    TL_TEST_CHECK(stats.client_count == 1);
+
+    /* ˸mɰAAȤݪsuH */
+    TL_TEST_CHECK(TL_CloseDevice(device) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_test_tcp_exchange(socket, pdu, 0, response, sizeof(response)) == 0);
+    tl_socket_close(socket);
+
+    /* ҰʦAPw]˸mPɶiGᤣ|dUA */
+    for (round = 0; round < 20; round++) {
+        TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+        loop.push = TL_FALSE;
+        loop.stop = 0;
+        loop.started = 0;
+        thread = tl_thread_create(tl_test_server_start_loop, &loop);
+        TL_TEST_CHECK(thread != NULL);
+        for (i = 0; i < 100 && tl_atomic_load_u32(&loop.started) == 0; i++) {
+            tl_delay_ms(1);
+        }
+        TL_TEST_CHECK(TL_CloseConnection() == TL_SUCCESS);
+        tl_atomic_store_u32(&loop.stop, 1);
+        if (thread != NULL) {
+            tl_thread_join(thread);
+        }
+        TL_TEST_CHECK(tl_get_default_device()->modbus_server == NULL);
+    }
+    printf("Modbus ŪgPҥ~^ҥTAҰʦA %u dUA\n", round);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* AGįժq\̼ơBAܦƻPAq\̤W (tl_push.c) */
+#define TL_TEST_PUSH_CLIENTS  1000
+#define TL_TEST_PUSH_ROUNDS   20
+#define TL_TEST_PUSH_LIMIT    1024
+
+/* ATTتסG2 줸ռY + 9 줸դe */
+#define TL_TEST_PUSH_FRAME    11
+
+/* ШDP^ (RFC 6455 dҪ_) */
+static const char g_test_push_request[] =
+    "GET /tower HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+static const char g_test_push_response[] =
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+
+/*
+ * AGѽXATA榡Ůɪ^ TL_FALSE
+ */
+static TL_BOOL tl_test_push_decode(const TL_BYTE* frame, unsigned int* sequence, TL_TowerState* state)
+{
+    if (frame[0] != 0x82 || frame[1] != 9 || frame[2] != 1) {
+        return TL_FALSE;
+    }
+    *sequence = (unsigned int)frame[3] | ((unsigned int)frame[4] << 8) |
+                ((unsigned int)frame[5] << 16) | ((unsigned int)frame[6] << 24);
+    *state = (TL_TowerState)frame[7] | ((TL_TowerState)frame[8] << 8) |
+             ((TL_TowerState)frame[9] << 16) | ((TL_TowerState)frame[10] << 24);
+    return TL_TRUE;
+}
+
+/*
+ * AGsuçAosuɰeXAFѮɪ^ NULL
+ */
+static TL_Socket* tl_test_push_subscribe(unsigned short port, unsigned int* sequence, TL_TowerState* state)
+{
+    TL_BYTE response[sizeof(g_test_push_response) - 1 + TL_TEST_PUSH_FRAME];
+    TL_Socket* socket = NULL;
+
+    if (tl_socket_connect("127.0.0.1", port, &socket) != TL_SUCCESS) {
+        return NULL;
+    }
+    if (tl_test_tcp_exchange(socket, (const TL_BYTE*)g_test_push_request, sizeof(g_test_push_request) - 1,
+                             response, sizeof(response)) != sizeof(response) ||
+        memcmp(response, g_test_push_response, sizeof(g_test_push_response) - 1) != 0 ||
+        !tl_test_push_decode(response + sizeof(g_test_push_response) - 1, sequence, state)) {
+        tl_socket_close(socket);
+        return NULL;
+    }
+    return socket;
+}
+
+/*
+ * AGeXBnT (eWL 4 줸) õ expected Ӧ줸ժ^
+ */
+static size_t tl_test_push_control(TL_Socket* socket, TL_BYTE opcode, const TL_BYTE* payload,
+                                   size_t length, TL_BYTE* response, size_t expected)
+{
+    static const TL_BYTE mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    TL_BYTE frame[10];
+    size_t i;
+
+    frame[0] = (TL_BYTE)(0x80 | opcode);
+    frame[1] = (TL_BYTE)(0x80 | length);
+    memcpy(frame + 2, mask, sizeof(mask));
+    for (i = 0; i < length; i++) {
+        frame[6 + i] = (TL_BYTE)(payload[i] ^ mask[i % 4]);
+    }
+    return tl_test_tcp_exchange(socket, frame, 6 + length, response, expected);
+}
+
+/*
+ * AG}ɮ׼ƤW (APȤݦUe@ӳqT)
+ */
+static TL_BOOL tl_test_push_reserve_sockets(unsigned int count)
+{
+#ifdef _WIN32
+    (void)count;
+    return TL_TRUE;
+#else
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return TL_FALSE;
+    }
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < count) {
+        limit.rlim_cur = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > count) ? count : limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= count) ? TL_TRUE : TL_FALSE;
+#endif
+}
+
+/*
+ * AGݱBzsu
+ */
+static void tl_test_push_wait_clients(TL_DEVICE_HANDLE device, unsigned int count, TL_PushStats* stats)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2000; i++) {
+        TL_GetPushStats(device, stats);
+        if (stats->client_count == count) {
+            return;
+        }
+        tl_delay_ms(1);
+    }
+}
+
+/*
+ * AGҦq\̦U@ӪATA^̫@ӭq\̦ɶ
+ * (latency_us ֥[Cӭq\̦ɶ)FOɪ^ 0
+ */
+static unsigned long long tl_test_push_receive_all(TL_Socket** sockets, unsigned int count,
+                                                   unsigned long long start_us, TL_TowerState expected,
+                                                   unsigned long long* latency_us)
+{
+    static TL_SocketPoll items[TL_TEST_PUSH_CLIENTS];
+    static TL_BYTE frames[TL_TEST_PUSH_CLIENTS][TL_TEST_PUSH_FRAME];
+    static size_t lengths[TL_TEST_PUSH_CLIENTS];
+    unsigned long long deadline_us = start_us + 5000000;
+    unsigned long long now_us = start_us;
+    unsigned int remaining = count;
+    unsigned int sequence;
+    TL_TowerState state;
+    long received;
+    unsigned int i;
+
+    memset(lengths, 0, sizeof(lengths));
+    for (i = 0; i < count; i++) {
+        items[i].socket = sockets[i];
+        items[i].events = TL_SOCKET_READABLE;
+    }
+    while (remaining != 0 && now_us < deadline_us) {
+        if (tl_socket_poll(items, count, 100) <= 0) {
+            now_us = tl_time_now_us();
+            continue;
+        }
+        now_us = tl_time_now_us();
+        for (i = 0; i < count; i++) {
+            if (items[i].socket == NULL || items[i].revents == 0) {
+                continue;
+            }
+            received = tl_socket_recv(sockets[i], frames[i] + lengths[i], TL_TEST_PUSH_FRAME - lengths[i]);
+            if (received < 0) {
+                return 0;
+            }
+            lengths[i] += (size_t)received;
+            if (lengths[i] == TL_TEST_PUSH_FRAME) {
+                if (!tl_test_push_decode(frames[i], &sequence, &state) || state != expected) {
+                    return 0;
+                }
+                *latency_us += now_us - start_us;
+                items[i].socket = NULL;
+                remaining--;
+            }
+        }
+    }
+    return (remaining == 0) ? now_us - start_us : 0;
+}
+
+/*
+ * AGq\BAܪeBping/close PLĴA
+ * 1000 ӭq\̪eɶBq\̤WAHαҰʦAP˸mPɶi
+ */
+static void tl_test_push(void)
+{
+    static TL_Socket* sockets[TL_TEST_PUSH_LIMIT];
+    static const char rejected[] = "HTTP/1.1 400 Bad Request\r\n";
+    static const TL_BYTE ping[2] = { 'h', 'i' };
+    static const TL_BYTE close_code[2] = { 0x03, 0xE8 };
+    TL_DEVICE_HANDLE device;
+    TL_PushStats stats;
+    TL_LEDStatus led;
+    TL_TowerState current;
+    TL_TowerState state;
+    TL_TestServerStart loop;
+    TL_Thread* thread;
+    TL_Socket* socket;
+    TL_Socket* extra = NULL;
+    TL_BYTE response[256];
+    unsigned int sequence;
+    unsigned int first;
+    unsigned long long start_us;
+    unsigned long long command_us = 0;
+    unsigned long long fanout_us = 0;
+    unsigned long long fanout_max_us = 0;
+    unsigned long long latency_us = 0;
+    unsigned long long elapsed_us;
+    unsigned int connected = 0;
+    unsigned int round;
+    unsigned int i;
+
+    printf("\n--------------- A (OA%d ӭq) ---------------\n", TL_TEST_PUSH_CLIENTS);
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_StartPushServer(device, "127.0.0.1", 0) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetPushStats(device, &stats) == TL_SUCCESS);
+
+    /* ⧹ثeA */
+    socket = tl_test_push_subscribe(stats.port, &first, &state);
+    TL_TEST_CHECK(socket != NULL);
+    if (socket == NULL) {
+        TL_Finalize();
+        tl_usb_sim_disable();
+        return;
+    }
+    TL_TEST_CHECK(TL_GetTowerState(device, &current, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(state == current);
+
+    /* Aܫ᦬sAAǸW */
+    memset(&led, 0, sizeof(led));
+    led.red_status = TL_LED_ON;
+    led.pattern = TL_LED_PATTERN_ON;
+    TL_TEST_CHECK(TL_DeviceSetLED(device, TL_LAYER_ONE, &led) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetTowerState(device, &current, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_test_tcp_exchange(socket, NULL, 0, response, TL_TEST_PUSH_FRAME) == TL_TEST_PUSH_FRAME);
+    TL_TEST_CHECK(tl_test_push_decode(response, &sequence, &state));
+    TL_TEST_CHECK(sequence > first && state == current);
+
+    /* ping HۦPe pong ^ */
+    TL_TEST_CHECK(tl_test_push_control(socket, 0x9, ping, sizeof(ping), response, 4) == 4);
+    TL_TEST_CHECK(response[0] == 0x8A && response[1] == 2 && memcmp(response + 2, ping, 2) == 0);
+
+    /* S_ШDH 400 ^su */
+    TL_TEST_CHECK(tl_socket_connect("127.0.0.1", stats.port, &extra) == TL_SUCCESS);
+    if (extra != NULL) {
+        TL_TEST_CHECK(tl_test_tcp_exchange(extra, (const TL_BYTE*)"GET / HTTP/1.1\r\n\r\n", 18,
+                                           response, sizeof(rejected) - 1) == sizeof(rejected) - 1);
+        TL_TEST_CHECK(memcmp(response, rejected, sizeof(rejected) - 1) == 0);
+        tl_test_tcp_exchange(extra, NULL, 0, response, sizeof(response));
+        TL_TEST_CHECK(tl_test_tcp_exchange(extra, NULL, 0, response, sizeof(response)) == 0);
+        tl_socket_close(extra);
+    }
+
+    /* close HۦPAX^su */
+    TL_TEST_CHECK(tl_test_push_control(socket, 0x8, close_code, sizeof(close_code), response, 4) == 4);
+    TL_TEST_CHECK(response[0] == 0x88 && response[1] == 2 && memcmp(response + 2, close_code, 2) == 0);
+    TL_TEST_CHECK(tl_test_tcp_exchange(socket, NULL, 0, response, sizeof(response)) == 0);
+    tl_socket_close(socket);
+
+    tl_test_push_wait_clients(device, 0, &stats);
+    TL_TEST_CHECK(stats.client_count == 0 && stats.subscriber_count == 0);
+    TL_TEST_CHECK(stats.accepted_clients == 2 && stats.handshake_failures == 1);
+    TL_TEST_CHECK(stats.messages_sent == 2 && stats.rejected_clients == 0);
+
+    /* 1000 ӭq\̡GCAܨҦq\̦ɶ */
+    if (!tl_test_push_reserve_sockets(2 * TL_TEST_PUSH_LIMIT + 64)) {
+        printf("}ɮ׼ƤW %dALqW\n", 2 * TL_TEST_PUSH_LIMIT + 64);
+    } else {
+        for (connected = 0; connected < TL_TEST_PUSH_CLIENTS; connected++) {
+            sockets[connected] = tl_test_push_subscribe(stats.port, &sequence, &state);
+            if (sockets[connected] == NULL) {
+                break;
+            }
+        }
+        TL_TEST_CHECK(connected == TL_TEST_PUSH_CLIENTS);
+
+        for (round = 0; round < TL_TEST_PUSH_ROUNDS && connected == TL_TEST_PUSH_CLIENTS; round++) {
+            led.red_status = (round % 2 == 0) ? TL_LED_OFF : TL_LED_ON;
+            start_us = tl_time_now_us();
+            TL_TEST_CHECK(TL_DeviceSetLED(device, TL_LAYER_ONE, &led) == TL_SUCCESS);
+            command_us += tl_time_now_us() - start_us;
+            TL_TEST_CHECK(TL_GetTowerState(device, &current, NULL) == TL_SUCCESS);
+            elapsed_us = tl_test_push_receive_all(sockets, connected, start_us, current, &latency_us);
+            TL_TEST_CHECK(elapsed_us != 0);
+            fanout_us += elapsed_us;
+            if (elapsed_us > fanout_max_us) {
+                fanout_max_us = elapsed_us;
+            }
+        }
+        TL_TEST_CHECK(TL_GetPushStats(device, &stats) == TL_SUCCESS);
+        TL_TEST_CHECK(stats.subscriber_count == TL_TEST_PUSH_CLIENTS);
+        printf("%u ӭqG]wRO %lluusAe %lluus (̪ %lluus)ACӭqᥭ %lluus\n",
+               connected, command_us / TL_TEST_PUSH_ROUNDS, fanout_us / TL_TEST_PUSH_ROUNDS, fanout_max_us,
+               latency_us / ((unsigned long long)TL_TEST_PUSH_ROUNDS * TL_TEST_PUSH_CLIENTS));
+
+        /* ɺW᪺suQڵ */
+        for (; connected < TL_TEST_PUSH_LIMIT; connected++) {
+            sockets[connected] = tl_test_push_subscribe(stats.port, &sequence, &state);
+            if (sockets[connected] == NULL) {
+                break;
+            }
+        }
+        TL_TEST_CHECK(connected == TL_TEST_PUSH_LIMIT);
+        extra = NULL;
+        TL_TEST_CHECK(tl_socket_connect("127.0.0.1", stats.port, &extra) == TL_SUCCESS);
+        if (extra != NULL) {
+            TL_TEST_CHECK(tl_test_tcp_exchange(extra, (const TL_BYTE*)g_test_push_request,
+                                               sizeof(g_test_push_request) - 1, response, sizeof(response)) == 0);
+            tl_socket_close(extra);
+        }
+        TL_TEST_CHECK(TL_GetPushStats(device, &stats) == TL_SUCCESS);
+        TL_TEST_CHECK(stats.subscriber_count == TL_TEST_PUSH_LIMIT && stats.rejected_clients == 1);
+    }
+
+    /* ˸mɰAAҦq\̪suH */
+    TL_TEST_CHECK(TL_CloseDevice(device) == TL_SUCCESS);
+    for (i = 0; i < connected; i++) {
+        if (i == 0 || i == connected - 1) {
+            TL_TEST_CHECK(tl_test_tcp_exchange(sockets[i], NULL, 0, response, sizeof(response)) == 0);
+        }
+        tl_socket_close(sockets[i]);
+    }
+
+    /* ҰʦAPw]˸mPɶiGᤣ|dUA */
+    for (round = 0; round < 20; round++) {
+        TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+        loop.push = TL_TRUE;
+        loop.stop = 0;
+        loop.started = 0;
+        thread = tl_thread_create(tl_test_server_start_loop, &loop);
+        TL_TEST_CHECK(thread != NULL);
+        for (i = 0; i < 100 && tl_atomic_load_u32(&loop.started) == 0; i++) {
+            tl_delay_ms(1);
+        }
+        TL_TEST_CHECK(TL_CloseConnection() == TL_SUCCESS);
+        tl_atomic_store_u32(&loop.stop, 1);
+        if (thread != NULL) {
+            tl_thread_join(thread);
+        }
+        TL_TEST_CHECK(tl_get_default_device()->push_server == NULL);
+    }
+    printf("wPqWҥTAҰʦA %u dUA\n", round);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* TؿG^rɡBsĶ᪺ؿPgYؿ */
+#define TL_TEST_CATALOG_SOURCE  "tl_test_messages_en.txt"
+#define TL_TEST_CATALOG_PATH    "tl_test_messages.tlmc"
+#define TL_TEST_CATALOG_BROKEN  "tl_test_messages_broken.tlmc"
+
+/*
+ * TؿGŪJɮסAg offset B 4 Ӧ줸 (pݧ) gt@ɮ
+ */
+static TL_BOOL tl_test_catalog_patch(size_t offset, unsigned int value)
+{
+    static TL_BYTE image[65536];
+    size_t size;
+    FILE* file;
+
+    file = fopen(TL_TEST_CATALOG_PATH, "rb");
+    if (file == NULL) {
+        return TL_FALSE;
+    }
+    size = fread(image, 1, sizeof(image), file);
+    fclose(file);
+    if (offset + 4 > size) {
+        return TL_FALSE;
+    }
+    image[offset] = (TL_BYTE)value;
+    image[offset + 1] = (TL_BYTE)(value >> 8);
+    image[offset + 2] = (TL_BYTE)(value >> 16);
+    image[offset + 3] = (TL_BYTE)(value >> 24);
+
+    file = fopen(TL_TEST_CATALOG_BROKEN, "wb");
+    if (file == NULL) {
+        return TL_FALSE;
+    }
+    size = (fwrite(image, 1, size, file) == size) ? size : 0;
+    fclose(file);
+    return (size != 0) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * TؿGsĶPJBvyBѪTϥΤؤrAHΩڵlaؿ
+ */
+static void tl_test_message_catalog(void)
+{
+    const char* sources[TL_LANG_JA + 1] = { TL_TEST_CATALOG_SOURCE, NULL };
+    const char* builtin_timeout;
+    const char* builtin_zh;
+    const char* message;
+    size_t length;
+    FILE* file;
+
+    printf("\n--------------- Tؿ ---------------\n");
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_EN) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_ERROR_TIMEOUT, &builtin_timeout, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_ZH_TW) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_SUCCESS, &builtin_zh, NULL) == TL_SUCCESS);
+
+    /* ^uѫeAlTPLyѤؤrɻ */
+    file = fopen(TL_TEST_CATALOG_SOURCE, "wb");
+    TL_TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        TL_Finalize();
+        return;
+    }
+    fputs("\xEF\xBB\xBF" "Catalog OK\r\nCatalog general\n", file);
+    fclose(file);
+    TL_TEST_CHECK(TL_CompileMessageCatalog(sources, 2, TL_TEST_CATALOG_PATH) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_LoadMessageCatalog(TL_TEST_CATALOG_PATH) == TL_SUCCESS);
+
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_EN) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_SUCCESS, &message, &length) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, "Catalog OK") == 0 && length == 10);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_ERROR_GENERAL, &message, &length) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, "Catalog general") == 0 && length == 15);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_ERROR_TIMEOUT, &message, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, builtin_timeout) == 0);
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_ZH_TW) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_SUCCESS, &message, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, builtin_zh) == 0);
+    TL_TEST_CHECK(TL_SetThreadLanguage((TL_LANGUAGE)(TL_LANG_ZH_CN + 1)) == TL_ERROR_INVALID_PARAMETER);
+
+    /* ު첾 4GB (32 줸xWۥ[|)BުWXrϻPꤣųQڵAؿ */
+    TL_TEST_CHECK(tl_test_catalog_patch(12, 0xFFFFFFF8u));
+    TL_TEST_CHECK(TL_LoadMessageCatalog(TL_TEST_CATALOG_BROKEN) == TL_ERROR_FILE_FORMAT);
+    TL_TEST_CHECK(tl_test_catalog_patch(16, 40));
+    TL_TEST_CHECK(TL_LoadMessageCatalog(TL_TEST_CATALOG_BROKEN) == TL_ERROR_FILE_FORMAT);
+    TL_TEST_CHECK(tl_test_catalog_patch(24, 0));
+    TL_TEST_CHECK(TL_LoadMessageCatalog(TL_TEST_CATALOG_BROKEN) == TL_ERROR_FILE_FORMAT);
+    TL_TEST_CHECK(TL_LoadMessageCatalog("tl_test_missing.tlmc") != TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_EN) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_SUCCESS, &message, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, "Catalog OK") == 0);
+
+    /* slƫ٭쬰ذT */
+    TL_Finalize();
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_ERROR_TIMEOUT, &message, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, builtin_timeout) == 0);
+    TL_TEST_CHECK(TL_GetErrorMessageView(TL_SUCCESS, &message, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(strcmp(message, "Catalog OK") != 0);
+    TL_TEST_CHECK(TL_SetThreadLanguage(TL_LANG_ZH_TW) == TL_SUCCESS);
+    TL_Finalize();
+
+    remove(TL_TEST_CATALOG_SOURCE);
+    remove(TL_TEST_CATALOG_PATH);
+    remove(TL_TEST_CATALOG_BROKEN);
+    printf("ؿJByPlaؿˬdҥT\n");
+}
+
+/* ۾AOɡGOBzɶBOɪUPW (@)FUOdƵ{𪺾l */
+#define TL_TEST_RTT_SERVICE_US  2000
+#define TL_TEST_RTT_MIN_MS      20
+#define TL_TEST_RTT_MAX_MS      100
+
+/*
+ * ۾AOɡGɶpB򥢦^᭫աAHΨCx˸mU۪]wPέp
+ */
+static void tl_test_rtt(void)
+{
+    TL_DEVICE_HANDLE devices[2];
+    TL_TimeoutConfig config;
+    TL_TimeoutConfig current;
+    TL_RttStats stats;
+    TL_RttStats other;
+    TL_LEDStatus led;
+    unsigned long long start_us;
+    unsigned long long retry_us;
+    unsigned long long fail_us;
+    unsigned int i;
+
+    printf("\n--------------- ۾AO (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(2, TL_TEST_RTT_SERVICE_US) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+
+    config.min_timeout_ms = TL_TEST_RTT_MIN_MS;
+    config.max_timeout_ms = TL_TEST_RTT_MAX_MS;
+    config.retry_on_timeout = TL_TRUE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetTimeoutConfig(devices[0], &current) == TL_SUCCESS);
+    TL_TEST_CHECK(current.min_timeout_ms == TL_TEST_RTT_MIN_MS && current.max_timeout_ms == TL_TEST_RTT_MAX_MS);
+    config.min_timeout_ms = TL_TEST_RTT_MAX_MS + 1;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_ERROR_INVALID_PARAMETER);
+    config.min_timeout_ms = 0;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_ERROR_INVALID_PARAMETER);
+
+    /* OɥѩɶpAb]wd */
+    memset(&led, 0, sizeof(led));
+    led.pattern = TL_LED_PATTERN_ON;
+    for (i = 0; i < 20; i++) {
+        led.red_status = (i % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_ONE, &led) == TL_SUCCESS);
+    }
+    TL_TEST_CHECK(TL_GetRttStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.sample_count >= 20 && stats.timeout_count == 0);
+    TL_TEST_CHECK(stats.srtt_us >= TL_TEST_RTT_SERVICE_US && stats.srtt_us < TL_TEST_RTT_MAX_MS * 1000UL);
+    TL_TEST_CHECK(stats.timeout_ms >= TL_TEST_RTT_MIN_MS && stats.timeout_ms <= TL_TEST_RTT_MAX_MS);
+
+    /* t@x˸muιw]]wAέpUۿW */
+    TL_TEST_CHECK(TL_GetRttStats(devices[1], &other) == TL_SUCCESS);
+    TL_TEST_CHECK(other.sample_count == 0);
+    TL_TEST_CHECK(TL_GetTimeoutConfig(devices[1], &current) == TL_SUCCESS);
+    TL_TEST_CHECK(current.max_timeout_ms != TL_TEST_RTT_MAX_MS);
+
+    /* 򥢤@Ӧ^GbpOɫ᭫sPBíզ\ */
+    tl_usb_sim_drop_responses(0, 1);
+    start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_ONE, &led) == TL_SUCCESS);
+    retry_us = tl_time_now_us() - start_us;
+    TL_TEST_CHECK(retry_us < (TL_TEST_RTT_MAX_MS + 20) * 1000ULL);
+    TL_TEST_CHECK(TL_GetRttStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.timeout_count == 1 && stats.retry_count == 1 && stats.recovered_count == 1);
+
+    /* ծɥHOɥѡAݤWLW */
+    config.min_timeout_ms = TL_TEST_RTT_MIN_MS;
+    config.retry_on_timeout = TL_FALSE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_SUCCESS);
+    tl_usb_sim_drop_responses(0, 1);
+    start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_ONE, &led) == TL_ERROR_TIMEOUT);
+    fail_us = tl_time_now_us() - start_us;
+    TL_TEST_CHECK(fail_us < (TL_TEST_RTT_MAX_MS + 20) * 1000ULL);
+    TL_TEST_CHECK(TL_GetRttStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.timeout_count == 2 && stats.retry_count == 1);
+    TL_TEST_CHECK(TL_GetRttStats(devices[1], &other) == TL_SUCCESS);
+    TL_TEST_CHECK(other.timeout_count == 0);
+
+    printf("Ʃɶ %luusAO %lumsF򥢦^᭫ %lluusAծɥ %lluus\n",
+           stats.srtt_us, stats.timeout_ms, retry_us, fail_us);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* DPBgJG]wROơBOBzɶPǿ驵 (L) */
+#define TL_TEST_ASYNC_COMMANDS   200
+#define TL_TEST_ASYNC_SERVICE_US 200
+#define TL_TEST_ASYNC_LINK_US    300
+
+/* DPBgJG@P^IƻP̫@~X */
+typedef struct {
+    volatile unsigned int count;
+    volatile unsigned int error;
+} TL_TestMismatch;
+
+static void tl_test_mismatch(const TL_WriteMismatch* mismatch, void* user_data)
+{
+    TL_TestMismatch* seen = (TL_TestMismatch*)user_data;
+
+    if (mismatch->kind == TL_MISMATCH_ACK_ERROR) {
+        tl_atomic_store_u32(&seen->error, (unsigned int)mismatch->error);
+        tl_atomic_store_u32(&seen->count, seen->count + 1);
+    }
+}
+
+/* DPBgJGeX]wROA^gLɶ (L) */
+static unsigned long long tl_test_async_run(TL_DEVICE_HANDLE device, unsigned int count)
+{
+    TL_LEDStatus led;
+    unsigned long long start_us = tl_time_now_us();
+    unsigned int i;
+
+    memset(&led, 0, sizeof(led));
+    led.pattern = TL_LED_PATTERN_ON;
+    for (i = 0; i < count; i++) {
+        led.red_status = (i % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        TL_TEST_CHECK(TL_DeviceSetLED(device, (TL_LAYER)(i % 3), &led) == TL_SUCCESS);
+    }
+    return tl_time_now_us() - start_us;
+}
+
+/*
+ * DPBgJGPPBҦ]RqBTL_FlushWrites ^I~AHγvx˸mҦPέp
+ */
+static void tl_test_write_mode(void)
+{
+    TL_DEVICE_HANDLE devices[2];
+    TL_AsyncStats stats;
+    TL_TestMismatch seen;
+    unsigned long long sync_us;
+    unsigned long long async_us;
+    unsigned long long start_us;
+
+    printf("\n--------------- DPBgJ (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(2, TL_TEST_ASYNC_SERVICE_US) == TL_SUCCESS);
+    tl_usb_sim_set_link_delay(0, TL_TEST_ASYNC_LINK_US);
+    tl_usb_sim_set_link_delay(1, TL_TEST_ASYNC_LINK_US);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+
+    /* O 0 HPBҦ}ҡA}ҫᤣҦAuקҶg */
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetWriteMode(devices[0], TL_WRITE_MODE_FIRE_AND_FORGET, 0) == TL_ERROR_DEVICE_BUSY);
+    TL_TEST_CHECK(TL_GetLastError() == TL_ERROR_DEVICE_BUSY);
+    TL_TEST_CHECK(TL_SetWriteMode(devices[0], TL_WRITE_MODE_SYNC, 0) == TL_SUCCESS);
+
+    /* w]˸m}ҮɥiAO 1 }Үɪu */
+    memset((void*)&seen, 0, sizeof(seen));
+    TL_TEST_CHECK(TL_SetWriteMode(NULL, TL_WRITE_MODE_FIRE_AND_FORGET, 0) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetMismatchCallback(devices[1], tl_test_mismatch, &seen) == TL_SUCCESS);
+
+    sync_us = tl_test_async_run(devices[0], TL_TEST_ASYNC_COMMANDS);
+    TL_TEST_CHECK(TL_FlushWrites(devices[0], 1000) == TL_SUCCESS);
+    start_us = tl_time_now_us();
+    tl_test_async_run(devices[1], TL_TEST_ASYNC_COMMANDS);
+    TL_TEST_CHECK(TL_FlushWrites(devices[1], 2000) == TL_SUCCESS);
+    async_us = tl_time_now_us() - start_us;
+    printf("%d LED]w (Bz %dus + ǿ %dus)GPB %lluusAݦ^ (t TL_FlushWrites) %lluusA%.1f \n",
+           TL_TEST_ASYNC_COMMANDS, TL_TEST_ASYNC_SERVICE_US, TL_TEST_ASYNC_LINK_US, sync_us, async_us,
+           (double)sync_us / (double)async_us);
+    TL_TEST_CHECK(async_us * 2 < sync_us);
+
+    /* έpvx˸m} */
+    TL_TEST_CHECK(TL_GetAsyncStats(devices[1], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.commands_sent == TL_TEST_ASYNC_COMMANDS && stats.acks_ok == TL_TEST_ASYNC_COMMANDS);
+    TL_TEST_CHECK(stats.in_flight == 0 && stats.acks_lost == 0);
+    TL_TEST_CHECK(TL_GetAsyncStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.commands_sent == 0 && stats.in_flight == 0);
+
+    /* 򥢪^ TL_FlushWrites ^@AóqO 1 ^I */
+    tl_usb_sim_drop_responses(1, 1);
+    tl_test_async_run(devices[1], 1);
+    TL_TEST_CHECK(TL_FlushWrites(devices[1], 2000) == TL_ERROR_TIMEOUT);
+    TL_TEST_CHECK(TL_FlushWrites(devices[1], 2000) == TL_SUCCESS);
+    /* ^Ib~Aiߩ TL_FlushWrites ^ */
+    start_us = tl_time_now_us();
+    while (tl_atomic_load_u32(&seen.count) == 0 && tl_time_now_us() - start_us < 1000000) {
+        tl_delay_ms(1);
+    }
+    TL_TEST_CHECK(tl_atomic_load_u32(&seen.count) == 1);
+    TL_TEST_CHECK(tl_atomic_load_u32(&seen.error) == (unsigned int)TL_ERROR_TIMEOUT);
+    TL_TEST_CHECK(TL_GetAsyncStats(devices[1], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.acks_lost == 1);
+
+    TL_TEST_CHECK(TL_CloseDevice(devices[1]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_CloseDevice(devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_SetWriteMode(NULL, TL_WRITE_MODE_SYNC, 0) == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ƥjGOơBCөROBzɶ (L) PL^OŪO (@) */
+#define TL_TEST_LOOP_TOWERS      8
+#define TL_TEST_LOOP_SERVICE_US  20000
+#define TL_TEST_LOOP_TIMEOUT_MS  100
+
+/* ƥjG TL_ProcessEvents ^IG (ubIsݪs) */
+typedef struct {
+    TL_DEVICE_HANDLE dead;              /* L^O */
+    unsigned long long start_us;        /* }l檺ɶ */
+    unsigned long long live_done_us;    /* LO̫@өROɶ */
+    unsigned int completed;             /* \RO */
+    unsigned int timed_out;             /* L^OOɪRO */
+    unsigned int status_events;         /* AŪƥ */
+    TL_TowerFrame status;               /* AŪG */
+} TL_TestEventLoop;
+
+static void tl_test_event_loop_callback(const TL_Event* event, void* user_data)
+{
+    TL_TestEventLoop* loop = (TL_TestEventLoop*)user_data;
+
+    if (event->type == TL_EVENT_STATUS) {
+        TL_TEST_CHECK(event->result == TL_SUCCESS);
+        loop->status = event->status;
+        loop->status_events++;
+    } else if (event->type == TL_EVENT_COMMAND_COMPLETE) {
+        TL_TEST_CHECK(event->request_id != 0);
+        if (event->device == loop->dead) {
+            TL_TEST_CHECK(event->result == TL_ERROR_TIMEOUT);
+            loop->timed_out++;
+        } else {
+            TL_TEST_CHECK(event->result == TL_SUCCESS);
+            loop->completed++;
+            loop->live_done_us = tl_time_now_us();
+        }
+    }
+}
+
+/* ƥjGݳqNXiŪ */
+static TL_BOOL tl_test_poll_fd_wait(TL_POLL_FD fd, unsigned long timeout_ms)
+{
+#ifdef _WIN32
+    return WaitForSingleObject((HANDLE)fd, timeout_ms) == WAIT_OBJECT_0;
+#else
+    struct pollfd item;
+
+    item.fd = fd;
+    item.events = POLLIN;
+    item.revents = 0;
+    return poll(&item, 1, (int)timeout_ms) > 0 && (item.revents & POLLIN) != 0;
+#endif
+}
+
+/*
+ * ƥjG@H TL_GetPollFd / TL_ProcessEvents XʦhxOA
+ * L^O|LO
+ */
+static void tl_test_event_loop(void)
+{
+    TL_DEVICE_HANDLE devices[TL_TEST_LOOP_TOWERS];
+    TL_TimeoutConfig config;
+    TL_TowerCommand command;
+    TL_TestEventLoop loop;
+    TL_QueueStats stats;
+    TL_REQUEST_ID request_id;
+    TL_POLL_FD fd;
+    unsigned long long live_us;
+    unsigned int expected = TL_TEST_LOOP_TOWERS * 2 + 1;
+    unsigned int processed;
+    unsigned int i;
+
+    printf("\n--------------- ƥj (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(TL_TEST_LOOP_TOWERS, TL_TEST_LOOP_SERVICE_US) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    for (i = 0; i < TL_TEST_LOOP_TOWERS; i++) {
+        TL_TEST_CHECK(TL_OpenDevice(i, TL_FALSE, &devices[i]) == TL_SUCCESS);
+    }
+    TL_TEST_CHECK(TL_GetPollFd(&fd) == TL_SUCCESS);
+    TL_TEST_CHECK(!tl_test_poll_fd_wait(fd, 0));
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_TRUE) == TL_SUCCESS);
+
+    /* O 0 ^GOɫ᭫դ@ */
+    config.min_timeout_ms = TL_TEST_LOOP_TIMEOUT_MS;
+    config.max_timeout_ms = TL_TEST_LOOP_TIMEOUT_MS;
+    config.retry_on_timeout = TL_TRUE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(devices[0], &config) == TL_SUCCESS);
+    tl_usb_sim_drop_responses(0, 1000);
+
+    /* CxOөROAO 1 t~ŪA (ƦbRO) */
+    memset(&loop, 0, sizeof(loop));
+    loop.dead = devices[0];
+    loop.start_us = tl_time_now_us();
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_SET_LED;
+    command.led.pattern = TL_LED_PATTERN_ON;
+    for (i = 0; i < TL_TEST_LOOP_TOWERS * 2; i++) {
+        command.device = devices[i % TL_TEST_LOOP_TOWERS];
+        command.layer = (TL_LAYER)(i / TL_TEST_LOOP_TOWERS);
+        command.led.green_status = TL_LED_ON;
+        TL_TEST_CHECK(TL_SubmitCommand(&command, &request_id) == TL_SUCCESS);
+        TL_TEST_CHECK(request_id != 0);
+    }
+    TL_TEST_CHECK(TL_SubmitStatusRequest(devices[1], TL_FRAME_LAYER_ONE | TL_FRAME_LAYER_TWO, &request_id) == TL_SUCCESS);
+
+    /* ƥjGNXiŪɳBzƥ */
+    processed = 0;
+    while (loop.completed + loop.timed_out + loop.status_events < expected &&
+           tl_time_now_us() - loop.start_us < 5000000) {
+        if (tl_test_poll_fd_wait(fd, 1000)) {
+            TL_TEST_CHECK(TL_ProcessEvents(tl_test_event_loop_callback, &loop, 0, &processed) == TL_SUCCESS);
+            TL_TEST_CHECK(processed > 0);
+        }
+    }
+    TL_TEST_CHECK(!tl_test_poll_fd_wait(fd, 0));
+    TL_TEST_CHECK(loop.completed == (TL_TEST_LOOP_TOWERS - 1) * 2);
+    TL_TEST_CHECK(loop.timed_out == 2);
+    TL_TEST_CHECK(loop.status_events == 1);
+    TL_TEST_CHECK(loop.status.layers[TL_LAYER_ONE].green_status == TL_LED_ON);
+    TL_TEST_CHECK(loop.status.layers[TL_LAYER_TWO].green_status == TL_LED_ON);
+
+    /* LOPɶiG@xOөROɶAO 0 OɼvT */
+    live_us = loop.live_done_us - loop.start_us;
+    printf("%d xOUөRO (Bz %dusAO 0 L^)GLO %lluus A %lluus\n",
+           TL_TEST_LOOP_TOWERS, TL_TEST_LOOP_SERVICE_US, live_us, tl_time_now_us() - loop.start_us);
+    TL_TEST_CHECK(live_us < (unsigned long long)TL_TEST_LOOP_SERVICE_US * 2 * 3);
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_FALSE) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.submitted == expected && stats.rejected == 0);
+
+    for (i = 0; i < TL_TEST_LOOP_TOWERS; i++) {
+        TL_TEST_CHECK(TL_CloseDevice(devices[i]) == TL_SUCCESS);
+    }
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ROGIeX@ROơBOBzɶPǿ驵 (L) */
+#define TL_TEST_EMERGENCY_THREADS     4
+#define TL_TEST_EMERGENCY_SERVICE_US  500
+#define TL_TEST_EMERGENCY_LINK_US     10000
+
+/* ROGIаeX@RO (CӰUۭp) */
+typedef struct {
+    TL_DEVICE_HANDLE device;
+    TL_LAYER layer;
+    volatile unsigned int stop;
+    volatile unsigned int completed;
+    volatile unsigned int superseded;
+} TL_TestNormalLoop;
+
+static void tl_test_normal_loop(void* arg)
+{
+    TL_TestNormalLoop* loop = (TL_TestNormalLoop*)arg;
+    TL_LEDStatus led;
+    TL_ERROR_CODE result;
+
+    memset(&led, 0, sizeof(led));
+    led.green_status = TL_LED_ON;
+    led.pattern = TL_LED_PATTERN_ON;
+    while (tl_atomic_load_u32(&loop->stop) == 0) {
+        result = TL_DeviceSetLED(loop->device, loop->layer, &led);
+        if (result == TL_SUCCESS) {
+            tl_atomic_store_u32(&loop->completed, loop->completed + 1);
+        } else if (result == TL_ERROR_SUPERSEDED) {
+            tl_atomic_store_u32(&loop->superseded, loop->superseded + 1);
+        }
+    }
+}
+
+/*
+ * ROGƦb@ROᤴuݶi椤@AҦؼгsgX
+ */
+static void tl_test_emergency_overtake(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TestNormalLoop loops[TL_TEST_EMERGENCY_THREADS];
+    TL_Thread* threads[TL_TEST_EMERGENCY_THREADS];
+    TL_TowerCommand command;
+    TL_PriorityStats stats;
+    unsigned long long start_us;
+    unsigned long long elapsed_us;
+    unsigned long round_trip_us = TL_TEST_EMERGENCY_SERVICE_US + TL_TEST_EMERGENCY_LINK_US;
+    unsigned long writes;
+    unsigned int superseded = 0;
+    unsigned int completed = 0;
+    unsigned int i;
+
+    printf("\n--------------- RO (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, TL_TEST_EMERGENCY_SERVICE_US) == TL_SUCCESS);
+    tl_usb_sim_set_link_delay(0, TL_TEST_EMERGENCY_LINK_US);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    /* @RO˸mAlb io_lock Wƶ */
+    for (i = 0; i < TL_TEST_EMERGENCY_THREADS; i++) {
+        memset((void*)&loops[i], 0, sizeof(loops[i]));
+        loops[i].device = device;
+        loops[i].layer = (TL_LAYER)(i % 3);
+        threads[i] = tl_thread_create(tl_test_normal_loop, &loops[i]);
+        TL_TEST_CHECK(threads[i] != NULL);
+    }
+    tl_delay_ms(50);
+
+    /* MOGi椤@𵲧AﾹPThLED@gX */
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_CLEAR;
+    command.device = device;
+    writes = tl_usb_sim_write_count(0);
+    start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_ExecuteCommand(&command) == TL_SUCCESS);
+    elapsed_us = tl_time_now_us() - start_us;
+    /* MeU̦h@Ӥ@ROgXGаOewoꪺ@ӡA
+       HβM^BŪpƫemgX@ӡFƦbC᭱h|hX| */
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) - writes <= TL_TARGET_COUNT + 2);
+
+    for (i = 0; i < TL_TEST_EMERGENCY_THREADS; i++) {
+        tl_atomic_store_u32(&loops[i].stop, 1);
+    }
+    for (i = 0; i < TL_TEST_EMERGENCY_THREADS; i++) {
+        tl_thread_join(threads[i]);
+        superseded += loops[i].superseded;
+        completed += loops[i].completed;
+    }
+    TL_TEST_CHECK(completed > 0);
+
+    TL_TEST_CHECK(TL_GetPriorityStats(device, &stats) == TL_SUCCESS);
+    printf(" %luusGM %lluus A%lluus gXAN %u Ӥ@RO\n",
+        round_trip_us, elapsed_us, stats.last_wire_us, superseded);
+    TL_TEST_CHECK(stats.emergency_count == 1);
+    TL_TEST_CHECK(stats.superseded_count == superseded && superseded > 0);
+    TL_TEST_CHECK(stats.last_wire_us > 0 && stats.last_wire_us <= elapsed_us);
+    /* v@ݭn 1 + 4 AsgXuݬ 2  */
+    TL_TEST_CHECK(elapsed_us < round_trip_us * 3);
+
+    TL_TEST_CHECK(TL_CloseDevice(device) == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* CGCtOCөROBzɶ (L) PLBLRO */
+#define TL_TEST_EXPIRY_SERVICE_US  20000
+#define TL_TEST_EXPIRY_STALE       5
+#define TL_TEST_EXPIRY_FRESH       2
+
+/* CG̵Gƥ */
+typedef struct {
+    unsigned int success;
+    unsigned int expired;
+    unsigned int superseded;
+    unsigned int other;
+} TL_TestQueueResults;
+
+static void tl_test_queue_result(const TL_Event* event, void* user_data)
+{
+    TL_TestQueueResults* results = (TL_TestQueueResults*)user_data;
+
+    if (event->type != TL_EVENT_COMMAND_COMPLETE) {
+        return;
+    }
+    if (event->result == TL_SUCCESS) {
+        results->success++;
+    } else if (event->result == TL_ERROR_EXPIRED) {
+        results->expired++;
+    } else if (event->result == TL_ERROR_SUPERSEDED) {
+        results->superseded++;
+    } else {
+        results->other++;
+    }
+}
+
+/* CGBzƥ󪽨즬wƶqƥ */
+static void tl_test_queue_drain(TL_POLL_FD fd, TL_TestQueueResults* results, unsigned int count)
+{
+    unsigned long long start_us = tl_time_now_us();
+
+    while (results->success + results->expired + results->superseded + results->other < count &&
+           tl_time_now_us() - start_us < 5000000) {
+        if (tl_test_poll_fd_wait(fd, 1000)) {
+            TL_TEST_CHECK(TL_ProcessEvents(tl_test_queue_result, results, 0, NULL) == TL_SUCCESS);
+        }
+    }
+}
+
+/* CGϪ˥` */
+static unsigned long long tl_test_histogram_total(const unsigned long long* histogram)
+{
+    unsigned long long total = 0;
+    int i;
+
+    for (i = 0; i < TL_HISTOGRAM_BUCKETS; i++) {
+        total += histogram[i];
+    }
+    return total;
+}
+
+/*
+ * CGLROgXåH TL_ERROR_EXPIRED BC`׻PݮɶϡA
+ * HκRONC@ROɪqDέp
+ */
+static void tl_test_queue_expiry(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TowerCommand command;
+    TL_TestQueueResults results;
+    TL_QueueStats stats;
+    TL_PriorityStats priority;
+    TL_POLL_FD fd;
+    unsigned long long now_ms;
+    unsigned long writes;
+    unsigned int total = 1 + TL_TEST_EXPIRY_STALE + TL_TEST_EXPIRY_FRESH;
+    unsigned int i;
+
+    printf("\n--------------- C (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, TL_TEST_EXPIRY_SERVICE_US) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetPollFd(&fd) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_TRUE) == TL_SUCCESS);
+
+    /* Ĥ@өROOA 5ms RObCLARΪROӱ`eX */
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_SET_LED;
+    command.device = device;
+    command.layer = TL_LAYER_ONE;
+    command.led.green_status = TL_LED_ON;
+    command.led.pattern = TL_LED_PATTERN_ON;
+    writes = tl_usb_sim_write_count(0);
+    now_ms = TL_GetMonotonicTimeMs();
+    TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    command.deadline_ms = now_ms + 5;
+    for (i = 0; i < TL_TEST_EXPIRY_STALE; i++) {
+        TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    }
+    command.deadline_ms = now_ms + 10000;
+    for (i = 0; i < TL_TEST_EXPIRY_FRESH; i++) {
+        TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    }
+
+    memset(&results, 0, sizeof(results));
+    tl_test_queue_drain(fd, &results, total);
+    TL_TEST_CHECK(results.success == 1 + TL_TEST_EXPIRY_FRESH);
+    TL_TEST_CHECK(results.expired == TL_TEST_EXPIRY_STALE);
+    TL_TEST_CHECK(results.other == 0);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) - writes == 1 + TL_TEST_EXPIRY_FRESH);
+
+    /* CO@`סAueXROOݮɶ */
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_TRUE) == TL_SUCCESS);
+    printf(" %llu ӡAL %llu ӡA̤j` %u\n", stats.submitted, stats.expired, stats.max_depth);
+    TL_TEST_CHECK(stats.submitted == total && stats.expired == TL_TEST_EXPIRY_STALE && stats.rejected == 0);
+    TL_TEST_CHECK(stats.max_depth >= total - 1);
+    TL_TEST_CHECK(tl_test_histogram_total(stats.depth) == total);
+    TL_TEST_CHECK(tl_test_histogram_total(stats.wait_us) == 1 + TL_TEST_EXPIRY_FRESH);
+    TL_TEST_CHECK(TL_GetQueueStats(&stats, TL_FALSE) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.submitted == 0 && tl_test_histogram_total(stats.depth) == 0);
+
+    /* PBGwLROgX */
+    command.deadline_ms = TL_GetMonotonicTimeMs() - 1;
+    writes = tl_usb_sim_write_count(0);
+    TL_TEST_CHECK(TL_ExecuteCommand(&command) == TL_ERROR_EXPIRED);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) == writes);
+
+    /* MNCP@O@ROApJqDέp */
+    command.deadline_ms = 0;
+    for (i = 0; i < 4; i++) {
+        command.layer = (TL_LAYER)(i % 3);
+        TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    }
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_CLEAR;
+    command.device = device;
+    TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    memset(&results, 0, sizeof(results));
+    tl_test_queue_drain(fd, &results, 5);
+    TL_TEST_CHECK(results.other == 0 && results.expired == 0);
+    TL_TEST_CHECK(results.superseded >= 1 && results.success + results.superseded == 5);
+    TL_TEST_CHECK(TL_GetPriorityStats(device, &priority) == TL_SUCCESS);
+    printf("MN %u ӱƶRO\n", results.superseded);
+    TL_TEST_CHECK(priority.emergency_count == 1);
+    TL_TEST_CHECK(priority.superseded_count == results.superseded);
+
+    TL_TEST_CHECK(TL_CloseDevice(device) == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* OArաGCӥؼЪæs */
+#define TL_TEST_STATE_ROUNDS 20000
+#define TL_TEST_STATE_DEVICE_ROUNDS 40
+
+typedef struct {
+    volatile TL_TowerState* word;
+    TL_DEVICE_HANDLE device;
+    int target;
+    unsigned int lost;
+    TL_ERROR_CODE result;
+} TL_TestStateWriter;
+
+/* HؼнsPզӥؼЦ줸ժ */
+static TL_TowerState tl_test_state_value(int target, unsigned int round)
+{
+    return (TL_TowerState)(((round + (unsigned int)target) & 0x3F) | ((unsigned int)target << 6));
+}
+
+/* ХusۤvؼСAsۤv줸եOgJ */
+static void tl_test_state_merge_writer(void* arg)
+{
+    TL_TestStateWriter* writer = (TL_TestStateWriter*)arg;
+    TL_TowerState value;
+    TL_TowerState merged;
+    unsigned int round;
+
+    for (round = 0; round < TL_TEST_STATE_ROUNDS; round++) {
+        value = tl_test_state_value(writer->target, round);
+        merged = tl_tower_state_merge(writer->word, value << (writer->target * 8), 1u << writer->target);
+        if (((merged >> (writer->target * 8)) & 0xFF) != value) {
+            writer->lost++;
+        }
+    }
+}
+
+/* H round ȶJe@ӥؼ */
+static void tl_test_state_fill(TL_TowerFrame* frame, int target, unsigned int round)
+{
+    if (target == TL_LAYER_THREE + 1) {
+        frame->buzzer.tone = (TL_BUZZER_TONE)(round % 2);
+        frame->buzzer.volume = (TL_BUZZER_VOLUME)(round % 3);
+        frame->buzzer.pattern = (TL_BUZZER_PATTERN)(round % 5);
+    } else {
+        frame->layers[target].red_status = (TL_LED_STATE)(round % 3);
+        frame->layers[target].green_status = (TL_LED_STATE)((round + 1) % 3);
+        frame->layers[target].blue_status = (TL_LED_STATE)((round + 2) % 3);
+        frame->layers[target].pattern = (TL_LED_PATTERN)(round % 4);
+    }
+}
+
+/* zL˸mROг]wۤvؼСA̫@ȧY̲תA */
+static void tl_test_state_device_writer(void* arg)
+{
+    TL_TestStateWriter* writer = (TL_TestStateWriter*)arg;
+    TL_TowerFrame frame;
+    unsigned int round;
+
+    memset(&frame, 0, sizeof(frame));
+    writer->result = TL_SUCCESS;
+    for (round = 0; round < TL_TEST_STATE_DEVICE_ROUNDS && writer->result == TL_SUCCESS; round++) {
+        tl_test_state_fill(&frame, writer->target, round + (unsigned int)writer->target);
+        if (writer->target == TL_LAYER_THREE + 1) {
+            writer->result = TL_DeviceSetBuzzer(writer->device, &frame.buzzer);
+        } else {
+            writer->result = TL_DeviceSetLED(writer->device, (TL_LAYER)writer->target, &frame.layers[writer->target]);
+        }
+    }
+}
+
+/* æ]wUۥؼЪ檬A */
+static void tl_test_state_desired_writer(void* arg)
+{
+    TL_TestStateWriter* writer = (TL_TestStateWriter*)arg;
+    TL_TowerFrame frame;
+    unsigned int round;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.target_mask = 1u << writer->target;
+    writer->result = TL_SUCCESS;
+    for (round = 0; round < TL_TEST_STATE_DEVICE_ROUNDS && writer->result == TL_SUCCESS; round++) {
+        tl_test_state_fill(&frame, writer->target, round + (unsigned int)writer->target);
+        writer->result = TL_SetDesiredState(writer->device, &frame);
+    }
+}
+
+/* OArաGYP٭BtBnAHΦhsPؼЮɤ|򥢧s */
+static void tl_test_tower_state(void)
+{
+    static volatile TL_TowerState word;
+    TL_TestStateWriter writers[4];
+    TL_Thread* threads[4];
+    TL_DEVICE_HANDLE device;
+    TL_TowerFrame frame;
+    TL_TowerFrame unpacked;
+    TL_TowerState state;
+    TL_TowerState expected;
+    TL_TowerState current;
+    TL_TowerState desired;
+    unsigned int lost = 0;
+    int target;
+    int bit;
+
+    printf("\n--------------- OAr (O) ---------------\n");
+
+    /* Y٭쥲oۦPeALĪȤiY */
+    memset(&frame, 0, sizeof(frame));
+    for (target = 0; target < 4; target++) {
+        tl_test_state_fill(&frame, target, 7u + (unsigned int)target);
+    }
+    frame.target_mask = TL_FRAME_ALL;
+    TL_TEST_CHECK(TL_PackTowerState(&frame, &state) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_UnpackTowerState(state, &unpacked) == TL_SUCCESS);
+    TL_TEST_CHECK(unpacked.target_mask == TL_FRAME_ALL);
+    TL_TEST_CHECK(memcmp(unpacked.layers, frame.layers, sizeof(frame.layers)) == 0);
+    TL_TEST_CHECK(memcmp(&unpacked.buzzer, &frame.buzzer, sizeof(frame.buzzer)) == 0);
+    TL_TEST_CHECK(TL_UnpackTowerState(state | (0xC0u << 24), &unpacked) == TL_ERROR_INVALID_PARAMETER);
+    frame.buzzer.pattern = (TL_BUZZER_PATTERN)(TL_BUZZER_PATTERN_4 + 1);
+    TL_TEST_CHECK(TL_PackTowerState(&frame, &state) == TL_ERROR_INVALID_PARAMETER);
+
+    /* @줸Pu|аOݪؼ */
+    TL_TEST_CHECK(TL_DiffTowerState(state, state) == 0);
+    for (target = 0; target < 4; target++) {
+        for (bit = 0; bit < 8; bit++) {
+            TL_TEST_CHECK(TL_DiffTowerState(state, state ^ (1u << (target * 8 + bit))) == (1u << target));
+        }
+    }
+    TL_TEST_CHECK(TL_DiffTowerState(0, 0x80000001u) == (TL_FRAME_LAYER_ONE | TL_FRAME_BUZZER));
+    TL_TEST_CHECK(TL_DiffTowerState(0, 0x00FFFF00u) == (TL_FRAME_LAYER_TWO | TL_FRAME_LAYER_THREE));
+
+    /* |ӰPɥHå洫sP@ӦrժPؼ */
+    word = 0;
+    expected = 0;
+    for (target = 0; target < 4; target++) {
+        writers[target].word = &word;
+        writers[target].target = target;
+        writers[target].lost = 0;
+        threads[target] = tl_thread_create(tl_test_state_merge_writer, &writers[target]);
+        TL_TEST_CHECK(threads[target] != NULL);
+        expected |= tl_test_state_value(target, TL_TEST_STATE_ROUNDS - 1) << (target * 8);
+    }
+    for (target = 0; target < 4; target++) {
+        if (threads[target] != NULL) {
+            tl_thread_join(threads[target]);
+        }
+        lost += writers[target].lost;
+    }
+    TL_TEST_CHECK(lost == 0);
+    TL_TEST_CHECK(tl_atomic_load_u32(&word) == expected);
+    printf("å洫G4 ӥؼЦUs %d A %u \n", TL_TEST_STATE_ROUNDS, lost);
+
+    /* zL˸mROP檬AæsUؼСAArեOUؼг̫@]w */
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 50) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    memset(&frame, 0, sizeof(frame));
+    for (target = 0; target < 4; target++) {
+        tl_test_state_fill(&frame, target, TL_TEST_STATE_DEVICE_ROUNDS - 1 + (unsigned int)target);
+    }
+    frame.target_mask = TL_FRAME_ALL;
+    TL_TEST_CHECK(TL_PackTowerState(&frame, &expected) == TL_SUCCESS);
+
+    for (target = 0; target < 4; target++) {
+        writers[target].device = device;
+        writers[target].target = target;
+        threads[target] = tl_thread_create(tl_test_state_device_writer, &writers[target]);
+        TL_TEST_CHECK(threads[target] != NULL);
+    }
+    for (target = 0; target < 4; target++) {
+        if (threads[target] != NULL) {
+            tl_thread_join(threads[target]);
+            TL_TEST_CHECK(writers[target].result == TL_SUCCESS);
+        }
+    }
+    TL_TEST_CHECK(TL_GetTowerState(device, &current, &desired) == TL_SUCCESS);
+    TL_TEST_CHECK(current == expected);
+    TL_TEST_CHECK(desired == 0);
+
+    for (target = 0; target < 4; target++) {
+        threads[target] = tl_thread_create(tl_test_state_desired_writer, &writers[target]);
+        TL_TEST_CHECK(threads[target] != NULL);
+    }
+    for (target = 0; target < 4; target++) {
+        if (threads[target] != NULL) {
+            tl_thread_join(threads[target]);
+            TL_TEST_CHECK(writers[target].result == TL_SUCCESS);
+        }
+    }
+    TL_TEST_CHECK(TL_GetTowerState(device, NULL, &desired) == TL_SUCCESS);
+    TL_TEST_CHECK(desired == expected);
+    TL_TEST_CHECK(TL_WaitForConvergence(device, 2000) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetTowerState(device, &current, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(current == expected);
+    printf("˸mROP檬AGثe 0x%08XA 0x%08X\n", current, desired);
+
+    TL_TEST_CHECK(TL_StopReconcile(device) == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ]RqշǡGtvW (RO/) Pis򱵨RO */
+#define TL_TEST_CALIBRATE_LIMIT 3000
+#define TL_TEST_CALIBRATE_BURST 3
+
+/* ]RqշǡG`JtvWɥH}tXڵeIASWɧXBzOI */
+static void tl_test_calibrate(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_CalibrationResult result;
+    TL_RateLimitStats stats;
+
+    printf("\n--------------- ]Rqշ (O) ---------------\n");
+
+    /* CөRO 100usB 1.1msGݦ^q̦h 1700 RO/ (` 2)AWh 3000 */
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 100) == TL_SUCCESS);
+    tl_usb_sim_set_link_delay(0, 1000);
+    tl_usb_sim_set_rate_limit(0, TL_TEST_CALIBRATE_LIMIT, TL_TEST_CALIBRATE_BURST);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    TL_TEST_CHECK(TL_CalibrateDevice(device, 0, TL_TRUE, &result) == TL_SUCCESS);
+    TL_TEST_CHECK(result.best_depth >= 1 && result.best_depth <= TL_TEST_CALIBRATE_BURST);
+    TL_TEST_CHECK(result.knee_rate * 10 >= TL_TEST_CALIBRATE_LIMIT * 8);
+    /* CB 40msAis򱵨ROƮe\WeXtv */
+    TL_TEST_CHECK(result.knee_rate <= TL_TEST_CALIBRATE_LIMIT * 21 / 20);
+    TL_TEST_CHECK(result.errors > 0);
+    TL_TEST_CHECK(result.recommended_rate == result.knee_rate * 9 / 10);
+    TL_TEST_CHECK(TL_GetRateLimitStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.rate_per_sec == result.recommended_rate);
+    TL_TEST_CHECK(stats.burst == result.best_depth);
+    printf("W %d RO/GI %lu RO/A̰]Rq %luA` %uAڵ %llu \n",
+           TL_TEST_CALIBRATE_LIMIT, result.knee_rate, result.max_rate, result.best_depth, result.errors);
+
+    /* StvWɡAIOBzO (CөRO 200usA5000 RO/) */
+    TL_TEST_CHECK(TL_SetRateLimit(device, 0, 0) == TL_SUCCESS);
+    tl_usb_sim_set_rate_limit(0, 0, 0);
+    tl_usb_sim_set_latency(0, 200);
+    TL_TEST_CHECK(TL_CalibrateDevice(device, 0, TL_FALSE, &result) == TL_SUCCESS);
+    /* bCB 40ms uWɡAIe\BzO */
+    TL_TEST_CHECK(result.knee_rate >= 4000 && result.knee_rate <= 5000 * 21 / 20);
+    TL_TEST_CHECK(result.knee_latency_us < 2000);
+    TL_TEST_CHECK(result.errors == 0);
+    printf("BzO 5000 RO/GI %lu RO/ ( %luus)A̰]Rq %lu\n",
+           result.knee_rate, result.knee_latency_us, result.max_rate);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* yOַӡG@sŪ|ӥؼСA_qѧַӥPwmAAt~Ū */
+static void tl_test_snapshot(void)
+{
+    TL_TowerSnapshot snapshot;
+    TL_ResetStats stats;
+    TL_LEDStatus status;
+    TL_BuzzerStatus buzzer;
+    TL_BYTE state[4];
+    unsigned long writes;
+
+    printf("\n--------------- yOַ (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+
+    memset(&status, 0, sizeof(status));
+    status.red_status = TL_LED_ON;
+    status.pattern = TL_LED_PATTERN_ON;
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_SUCCESS);
+    status.red_status = TL_LED_OFF;
+    status.blue_status = TL_LED_DUTY;
+    status.pattern = TL_LED_PATTERN_BLINK1;
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_TWO, &status) == TL_SUCCESS);
+    buzzer.tone = TL_BUZZER_TONE_LOW;
+    buzzer.volume = TL_BUZZER_VOLUME_SMALL;
+    buzzer.pattern = TL_BUZZER_PATTERN_2;
+    TL_TEST_CHECK(TL_SetBuzzer(&buzzer) == TL_SUCCESS);
+
+    /* IGɥu|ŪRO */
+    writes = tl_usb_sim_write_count(0);
+    TL_TEST_CHECK(TL_GetTowerSnapshot(&snapshot) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) - writes == 4);
+    TL_TEST_CHECK(snapshot.status.target_mask == TL_FRAME_ALL);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_ONE].red_status == TL_LED_ON);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_TWO].blue_status == TL_LED_DUTY);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_TWO].pattern == TL_LED_PATTERN_BLINK1);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_THREE].pattern == TL_LED_PATTERN_OFF);
+    TL_TEST_CHECK(snapshot.status.buzzer.pattern == TL_BUZZER_PATTERN_2);
+    TL_TEST_CHECK(snapshot.status.buzzer.volume == TL_BUZZER_VOLUME_SMALL);
+
+    /* _qG|Ū[W@٭ (hPﾹ)AAv@T{Uؼ */
+    tl_usb_sim_power_cycle(0);
+    writes = tl_usb_sim_write_count(0);
+    TL_TEST_CHECK(TL_GetTowerSnapshot(&snapshot) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) - writes == 4 + 3);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_ONE].pattern == TL_LED_PATTERN_OFF);
+    TL_TEST_CHECK(TL_GetResetStats(NULL, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.reset_count == 1 && stats.restore_count == 1);
+    tl_usb_sim_get_layer(0, TL_LAYER_TWO, state);
+    TL_TEST_CHECK(state[2] == TL_LED_DUTY && state[3] == TL_LED_PATTERN_BLINK1);
+    printf("_qַ᪺ӰeX %lu өRO (|ŪPT٭)\n", tl_usb_sim_write_count(0) - writes);
+
+    /* ٭AŪGIGAAPwm */
+    writes = tl_usb_sim_write_count(0);
+    TL_TEST_CHECK(TL_GetTowerSnapshot(&snapshot) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) - writes == 4);
+    TL_TEST_CHECK(snapshot.status.layers[TL_LAYER_ONE].red_status == TL_LED_ON);
+    TL_TEST_CHECK(TL_GetResetStats(NULL, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.reset_count == 1);
+
+    TL_TEST_CHECK(TL_CloseConnection() == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ݪG檺ROƻPƵ{ */
+#define TL_TEST_WATCHDOG_SUBMITS 50
+#define TL_TEST_WATCHDOG_TIMER_MS 150
+
+/* pH TL_ERROR_DEVICE_NOT_OPEN ШD */
+static void tl_test_count_cancelled(const TL_Event* event, void* user_data)
+{
+    if (event->type == TL_EVENT_COMMAND_COMPLETE && event->result == TL_ERROR_DEVICE_NOT_OPEN) {
+        (*(unsigned int*)user_data)++;
+    }
+}
+
+/*
+ * ݪĲoGƶШDP|Ƶ{QA|л\we
+ */
+static void tl_test_watchdog_cancel(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_TowerFrame failsafe;
+    TL_TowerCommand command;
+    TL_WatchdogStats stats;
+    TL_TestTimerResult timer;
+    TL_LEDStatus status;
+    TL_BYTE state[4];
+    unsigned long long start_us;
+    unsigned long writes;
+    unsigned int cancelled = 0;
+    unsigned int i;
+
+    printf("\n--------------- ݪƵ{P (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 2000) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+
+    /* CөRO 2msG檺 50 өRO 100msAƵ{ 150ms  */
+    memset(&command, 0, sizeof(command));
+    command.type = TL_COMMAND_SET_LED;
+    command.device = device;
+    command.layer = TL_LAYER_ONE;
+    command.led.green_status = TL_LED_ON;
+    command.led.pattern = TL_LED_PATTERN_ON;
+    for (i = 0; i < TL_TEST_WATCHDOG_SUBMITS; i++) {
+        TL_TEST_CHECK(TL_SubmitCommand(&command, NULL) == TL_SUCCESS);
+    }
+    command.led.green_status = TL_LED_OFF;
+    command.led.blue_status = TL_LED_ON;
+    memset(&timer, 0, sizeof(timer));
+    timer.start_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_ScheduleAfter(TL_TEST_WATCHDOG_TIMER_MS, &command, tl_test_timer_record, &timer, NULL) == TL_SUCCESS);
+
+    /* e߸A20ms Ĳo */
+    memset(&failsafe, 0, sizeof(failsafe));
+    failsafe.layers[TL_LAYER_ONE].red_status = TL_LED_ON;
+    failsafe.layers[TL_LAYER_ONE].pattern = TL_LED_PATTERN_BLINK1;
+    failsafe.target_mask = TL_FRAME_LAYER_ONE;
+    TL_TEST_CHECK(TL_StartWatchdog(device, 20, &failsafe) == TL_SUCCESS);
+
+    start_us = tl_time_now_us();
+    while (tl_atomic_load_u32(&timer.done) == 0 && tl_time_now_us() - start_us < 2000000) {
+        tl_delay_ms(1);
+    }
+    TL_TEST_CHECK(tl_atomic_load_u32(&timer.done) == 1);
+    TL_TEST_CHECK(tl_atomic_load_u32(&timer.result) == (unsigned int)TL_ERROR_DEVICE_NOT_OPEN);
+
+    /* Ƶ{bĲoL{AĲo~sέp */
+    do {
+        tl_delay_ms(1);
+        TL_TEST_CHECK(TL_GetWatchdogStats(device, &stats) == TL_SUCCESS);
+    } while (!stats.tripped && tl_time_now_us() - start_us < 2000000);
+    TL_TEST_CHECK(stats.tripped && stats.trip_count == 1);
+
+    /* Ƶ{ɶLAOܦweA]AgXRO */
+    writes = tl_usb_sim_write_count(0);
+    while (tl_time_now_us() - timer.start_us < (TL_TEST_WATCHDOG_TIMER_MS + 100) * 1000ULL) {
+        tl_delay_ms(5);
+    }
+    TL_TEST_CHECK(tl_usb_sim_write_count(0) == writes);
+    tl_usb_sim_get_layer(0, TL_LAYER_ONE, state);
+    TL_TEST_CHECK(state[0] == TL_LED_ON && state[1] == TL_LED_OFF && state[2] == TL_LED_OFF);
+    TL_TEST_CHECK(state[3] == TL_LED_PATTERN_BLINK1);
+
+    TL_TEST_CHECK(TL_ProcessEvents(tl_test_count_cancelled, &cancelled, 0, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(cancelled > 0);
+    printf("Ĳo %u ӴШDP 1 ӱƵ{Awe\n", cancelled);
+
+    /* vT᪺RO */
+    TL_TEST_CHECK(TL_StopWatchdog(device) == TL_SUCCESS);
+    memset(&status, 0, sizeof(status));
+    status.green_status = TL_LED_ON;
+    status.pattern = TL_LED_PATTERN_ON;
+    TL_TEST_CHECK(TL_DeviceSetLED(device, TL_LAYER_ONE, &status) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_ONE, state);
+    TL_TEST_CHECK(state[1] == TL_LED_ON);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* sudʱG^IOA */
+typedef struct {
+    volatile unsigned int state;        /* ̪@qdA */
+    volatile unsigned int breaches;     /* ̪@qFAȤǶ */
+    volatile unsigned int degraded;     /* ର TL_HEALTH_DEGRADED  */
+    volatile unsigned int dead;         /* ର TL_HEALTH_DEAD  */
+    volatile unsigned int recovered;    /*  TL_HEALTH_DEAD _ */
+} TL_TestHealthAlerts;
+
+static void tl_test_health_record(const TL_HealthEvent* event, void* user_data)
+{
+    TL_TestHealthAlerts* alerts = (TL_TestHealthAlerts*)user_data;
+
+    if (event->stats.state == TL_HEALTH_DEGRADED && event->previous_state != TL_HEALTH_DEGRADED) {
+        tl_atomic_store_u32(&alerts->degraded, tl_atomic_load_u32(&alerts->degraded) + 1);
+    }
+    if (event->stats.state == TL_HEALTH_DEAD && event->previous_state != TL_HEALTH_DEAD) {
+        tl_atomic_store_u32(&alerts->dead, tl_atomic_load_u32(&alerts->dead) + 1);
+    }
+    if (event->previous_state == TL_HEALTH_DEAD && event->stats.state != TL_HEALTH_DEAD) {
+        tl_atomic_store_u32(&alerts->recovered, tl_atomic_load_u32(&alerts->recovered) + 1);
+    }
+    tl_atomic_store_u32(&alerts->breaches, event->stats.breaches);
+    tl_atomic_store_u32(&alerts->state, (unsigned int)event->stats.state);
+}
+
+/* ݦ^IpƹF countAOɪ^ TL_FALSE */
+static TL_BOOL tl_test_health_wait(volatile unsigned int* counter, unsigned int count, unsigned long timeout_ms)
+{
+    unsigned long long start_us = tl_time_now_us();
+
+    while (tl_atomic_load_u32(counter) < count) {
+        if (tl_time_now_us() - start_us > (unsigned long long)timeout_ms * 1000) {
+            return TL_FALSE;
+        }
+        tl_delay_ms(1);
+    }
+    return TL_TRUE;
+}
+
+/*
+ * sudʱGmBɶWLWšBL^P_q
+ */
+static void tl_test_health_monitor(void)
+{
+    TL_DEVICE_HANDLE device;
+    TL_HealthConfig config;
+    TL_HealthStats stats;
+    TL_TimeoutConfig timeouts;
+    TL_TestHealthAlerts alerts;
+    TL_BuzzerStatus buzzer;
+    unsigned int i;
+
+    printf("\n--------------- sudʱ (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &device) == TL_SUCCESS);
+    /* ŪOɪU`JAŮɩRO\ */
+    timeouts.min_timeout_ms = 200;
+    timeouts.max_timeout_ms = 1000;
+    timeouts.retry_on_timeout = TL_TRUE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(device, &timeouts) == TL_SUCCESS);
+
+    memset(&alerts, 0, sizeof(alerts));
+    memset(&config, 0, sizeof(config));
+    config.probe_interval_ms = 20;
+    config.evaluate_interval_ms = 10;
+    /* W󶢸mɶA@CPUWƵ{~|~P */
+    config.p99_slo_us = 15000;
+    config.min_success_permille = 900;
+    config.dead_after_failures = 3;
+    config.callback = tl_test_health_record;
+    config.user_data = &alerts;
+    TL_TEST_CHECK(TL_StartHealthMonitor(device, &config) == TL_SUCCESS);
+    config.min_success_permille = 1001;
+    TL_TEST_CHECK(TL_StartHealthMonitor(device, &config) == TL_ERROR_INVALID_PARAMETER);
+
+    /* mɱAɶCW */
+    tl_delay_ms(150);
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.state == TL_HEALTH_HEALTHY && stats.breaches == 0);
+    TL_TEST_CHECK(stats.probes >= 3 && stats.probe_failures == 0);
+    TL_TEST_CHECK(stats.samples >= 3 && stats.success_permille == 1000);
+    TL_TEST_CHECK(stats.p50_us > 0 && stats.p99_us < config.p99_slo_us);
+    TL_TEST_CHECK(stats.alerts == 0);
+
+    /* CөRO 30msG99ʤƶWLWAŨóq */
+    tl_usb_sim_set_latency(0, 30000);
+    for (i = 0; i < 12; i++) {
+        TL_TEST_CHECK(TL_DeviceGetBuzzerStatus(device, &buzzer) == TL_SUCCESS);
+    }
+    TL_TEST_CHECK(tl_test_health_wait(&alerts.degraded, 1, 1000));
+    TL_TEST_CHECK(tl_atomic_load_u32(&alerts.breaches) & TL_HEALTH_BREACH_P99);
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.state == TL_HEALTH_DEGRADED && stats.p99_us > config.p99_slo_us);
+    printf("šGp50 %lluusAp99 %lluusA˥ %u\n", stats.p50_us, stats.p99_us, stats.samples);
+
+    /* A^GmsOɫPwL^A_^Ѱ */
+    tl_usb_sim_set_latency(0, 200);
+    tl_usb_sim_drop_responses(0, 1000000);
+    TL_TEST_CHECK(tl_test_health_wait(&alerts.dead, 1, 5000));
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.state == TL_HEALTH_DEAD && stats.consecutive_failures >= 3);
+    /* Oɫ᪺դ]pJs򥢱ѡAѪƥi֩e */
+    TL_TEST_CHECK(stats.probe_failures >= 1 && stats.timeouts >= 3);
+    tl_usb_sim_drop_responses(0, 0);
+    TL_TEST_CHECK(tl_test_health_wait(&alerts.recovered, 1, 5000));
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.state != TL_HEALTH_DEAD && stats.consecutive_failures == 0);
+    TL_TEST_CHECK(stats.alerts >= 3);
+    printf("L^G %llu A %llu Aq %llu \n", stats.probes, stats.probe_failures, stats.alerts);
+
+    /* ΫᤣAAέpO */
+    TL_TEST_CHECK(TL_StopHealthMonitor(device) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    i = (unsigned int)stats.round_trips;
+    tl_delay_ms(60);
+    TL_TEST_CHECK(TL_GetHealthStats(device, &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.round_trips == i);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ROlܡGlɡBCӰƥƻP¶e᪺ TL_SetLED Is */
+#define TL_TEST_TRACE_PATH    "tl_test_trace.json"
+#define TL_TEST_TRACE_EVENTS  16
+#define TL_TEST_TRACE_CALLS   40
+#define TL_TEST_TRACE_RECENT  4
+
+/* lɪέpGIsƥơBаOɶƥƻP榡 */
+typedef struct {
+    unsigned int events;      /* Isƥ */
+    unsigned int stale;       /* }lɶаOƥ */
+    unsigned int api_calls;   /* TL_SetLED ƥ */
+    TL_BOOL well_formed;      /* YP */
+} TL_TestTraceFile;
+
+/*
+ * ROlܡGŪ^lɡAέpIs (X TL_SetLED ) ƥ
+ */
+static TL_BOOL tl_test_trace_read(unsigned long long mark_us, TL_TestTraceFile* trace)
+{
+    static char lines[512][256];
+    unsigned int line_count = 0;
+    unsigned int tid = 0;
+    unsigned int index;
+    unsigned long long ts;
+    const char* field;
+    FILE* file;
+
+    memset(trace, 0, sizeof(*trace));
+    file = fopen(TL_TEST_TRACE_PATH, "rb");
+    if (file == NULL) {
+        return TL_FALSE;
+    }
+    while (line_count < 512 && fgets(lines[line_count], sizeof(lines[0]), file) != NULL) {
+        line_count++;
+    }
+    fclose(file);
+    if (line_count < 2) {
+        return TL_FALSE;
+    }
+    trace->well_formed = (strncmp(lines[0], "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0 &&
+                          strcmp(lines[line_count - 1], "]}\n") == 0);
+
+    for (index = 0; index < line_count; index++) {
+        field = strstr(lines[index], "\"name\":\"TL_SetLED\"");
+        if (field != NULL && (field = strstr(lines[index], "\"tid\":")) != NULL) {
+            tid = (unsigned int)strtoul(field + 6, NULL, 10);
+            trace->api_calls++;
+        }
+    }
+    if (tid == 0) {
+        return TL_FALSE;
+    }
+
+    for (index = 0; index < line_count; index++) {
+        if (strstr(lines[index], "\"ph\":\"X\"") == NULL ||
+            (field = strstr(lines[index], "\"tid\":")) == NULL ||
+            (unsigned int)strtoul(field + 6, NULL, 10) != tid) {
+            continue;
+        }
+        trace->events++;
+        field = strstr(lines[index], "\"ts\":");
+        ts = (field != NULL) ? strtoull(field + 5, NULL, 10) : 0;
+        if (ts < mark_us) {
+            trace->stale++;
+        }
+    }
+    return TL_TRUE;
+}
+
+/*
+ * ROlܡGƥƶWLequOd̷sƥAs}lɱ˱eƥ
+ */
+static void tl_test_trace(void)
+{
+    TL_TestTraceFile trace;
+    TL_LEDStatus status;
+    unsigned long long mark_us = 0;
+    unsigned int call;
+
+    printf("\n--------------- ROlwİ (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 100) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_StartTrace(0x7FFFFFFFu) == TL_ERROR_INVALID_PARAMETER);
+    TL_TEST_CHECK(TL_WriteTrace(NULL) == TL_ERROR_INVALID_PARAMETER);
+
+    /* eq2AC TL_SetLED ͼƭӨƥA¶h */
+    TL_TEST_CHECK(TL_StartTrace(TL_TEST_TRACE_EVENTS - 3) == TL_SUCCESS);
+    memset(&status, 0, sizeof(status));
+    status.pattern = TL_LED_PATTERN_ON;
+    for (call = 0; call < TL_TEST_TRACE_CALLS; call++) {
+        if (call == TL_TEST_TRACE_CALLS - TL_TEST_TRACE_RECENT) {
+            mark_us = tl_time_now_us();
+        }
+        status.green_status = (call & 1) ? TL_LED_ON : TL_LED_OFF;
+        TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_SUCCESS);
+    }
+    TL_TEST_CHECK(TL_StopTrace() == TL_SUCCESS);
+
+    /* IsnOdeqӨƥAӦ۳̫XIs */
+    TL_TEST_CHECK(TL_WriteTrace(TL_TEST_TRACE_PATH) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_test_trace_read(mark_us, &trace));
+    TL_TEST_CHECK(trace.well_formed);
+    TL_TEST_CHECK(trace.events == TL_TEST_TRACE_EVENTS);
+    TL_TEST_CHECK(trace.stale == 0);
+    TL_TEST_CHECK(trace.api_calls >= 1 && trace.api_calls <= TL_TEST_TRACE_RECENT);
+    printf("Is %d Od %u ӨƥA䤤 TL_SetLED %u \n",
+           TL_TEST_TRACE_CALLS, trace.events, trace.api_calls);
+
+    /* ᪺IsAO */
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_WriteTrace(TL_TEST_TRACE_PATH) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_test_trace_read(mark_us, &trace));
+    TL_TEST_CHECK(trace.events == TL_TEST_TRACE_EVENTS);
+
+    /* s}l˱eƥAudUs@Is */
+    TL_TEST_CHECK(TL_StartTrace(TL_TEST_TRACE_EVENTS) == TL_SUCCESS);
+    mark_us = tl_time_now_us();
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_StopTrace() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_WriteTrace(TL_TEST_TRACE_PATH) == TL_SUCCESS);
+    TL_TEST_CHECK(tl_test_trace_read(mark_us, &trace));
+    TL_TEST_CHECK(trace.well_formed);
+    TL_TEST_CHECK(trace.api_calls == 1);
+    TL_TEST_CHECK(trace.stale == 0);
+    TL_TEST_CHECK(trace.events >= 2 && trace.events < TL_TEST_TRACE_EVENTS);
+
+    remove(TL_TEST_TRACE_PATH);
+    TL_TEST_CHECK(TL_CloseConnection() == TL_SUCCESS);
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/*
+ * RAlIGOثeUlIĲo
+ */
+static void tl_test_probe_mark(unsigned int counts[TL_PROBE_ID_COUNT])
+{
+    int id;
+
+    for (id = 0; id < TL_PROBE_ID_COUNT; id++) {
+        counts[id] = tl_probes_hit_count((TL_PROBE_ID)id);
+    }
+}
+
+/*
+ * RAlIGo before HӦUlIĲo
+ */
+static void tl_test_probe_delta(const unsigned int before[TL_PROBE_ID_COUNT], unsigned int hits[TL_PROBE_ID_COUNT])
+{
+    int id;
+
+    for (id = 0; id < TL_PROBE_ID_COUNT; id++) {
+        hits[id] = tl_probes_hit_count((TL_PROBE_ID)id) - before[id];
+    }
+}
+
+/*
+ * RAlIGROcءBUSBgJPŪB^ѪRBOɻP~B|Ĳo
+ */
+static void tl_test_probes(void)
+{
+    unsigned int before[TL_PROBE_ID_COUNT];
+    unsigned int hits[TL_PROBE_ID_COUNT];
+    TL_TimeoutConfig config;
+    TL_LEDStatus status;
+
+    printf("\n--------------- RAlI (O) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(1, 100) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+
+    /* @`]wGcءBgJBŪYPƾڡBѪRA}lP */
+    memset(&status, 0, sizeof(status));
+    status.red_status = TL_LED_ON;
+    status.pattern = TL_LED_PATTERN_ON;
+    tl_test_probe_mark(before);
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_SUCCESS);
+    tl_test_probe_delta(before, hits);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_BUILD] >= 1);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_WRITE_START] >= 1 && hits[TL_PROBE_ID_WRITE_END] == hits[TL_PROBE_ID_WRITE_START]);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_READ_START] >= 2 && hits[TL_PROBE_ID_READ_END] == hits[TL_PROBE_ID_READ_START]);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_PARSE] >= 1);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_TIMEOUT] == 0 && hits[TL_PROBE_ID_ERROR] == 0);
+    printf("]w@hGc %uBgJ %uBŪ %uBѪR %u\n", hits[TL_PROBE_ID_BUILD],
+           hits[TL_PROBE_ID_WRITE_START], hits[TL_PROBE_ID_READ_START], hits[TL_PROBE_ID_PARSE]);
+
+    /* 򥢦^BաGOɰlIAOɤ~ */
+    config.min_timeout_ms = 10;
+    config.max_timeout_ms = 20;
+    config.retry_on_timeout = TL_FALSE;
+    TL_TEST_CHECK(TL_SetTimeoutConfig(NULL, &config) == TL_SUCCESS);
+    tl_usb_sim_drop_responses(0, 1);
+    tl_test_probe_mark(before);
+    TL_TEST_CHECK(TL_SetLED(TL_LAYER_ONE, &status) == TL_ERROR_TIMEOUT);
+    tl_test_probe_delta(before, hits);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_TIMEOUT] >= 1);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_ERROR] == 0);
+    printf("򥢦^GO %u \n", hits[TL_PROBE_ID_TIMEOUT]);
+
+    /* sC|ªNXġG~lI */
+    tl_usb_sim_replug(0, 0);
+    tl_test_probe_mark(before);
+    TL_SetLED(TL_LAYER_ONE, &status);
+    tl_test_probe_delta(before, hits);
+    TL_TEST_CHECK(hits[TL_PROBE_ID_ERROR] >= 1);
+    printf("sC|G~ %u \n", hits[TL_PROBE_ID_ERROR]);
+
+    TL_CloseConnection();
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* OAXGOơB@PjPCy^W */
+#define TL_TEST_FLEET_TOWERS     100000
+#define TL_TEST_FLEET_DIRTY_STEP 997
+#define TL_TEST_FLEET_BATCH      64
+#define TL_TEST_FLEET_ROUNDS     20
+
+/*
+ * OAXGjqOXּƤ@P̡APvyɶ
+ */
+static void tl_test_fleet_scan(void)
+{
+    static TL_TowerState states[TL_TEST_FLEET_TOWERS];
+    size_t indices[TL_TEST_FLEET_BATCH];
+    unsigned int masks[TL_TEST_FLEET_BATCH];
+    TL_FLEET_HANDLE fleet = NULL;
+    TL_TowerState desired;
+    TL_TowerState actual;
+    unsigned long long start_us;
+    unsigned long long scan_us;
+    unsigned long long naive_us;
+    size_t expected;
+    size_t dirty;
+    size_t cursor;
+    size_t found;
+    size_t i;
+    unsigned int round;
+
+    printf("\n--------------- OAX (%d y) ---------------\n", TL_TEST_FLEET_TOWERS);
+    TL_TEST_CHECK(TL_CreateFleet(TL_TEST_FLEET_TOWERS, &fleet) == TL_SUCCESS);
+    if (fleet == NULL) {
+        return;
+    }
+
+    /* PڪAۦPAC TL_TEST_FLEET_DIRTY_STEP y@yĤGhP */
+    for (i = 0; i < TL_TEST_FLEET_TOWERS; i++) {
+        states[i] = (TL_TowerState)(i * 2654435761u) & 0x0F0F0F0F;
+    }
+    TL_TEST_CHECK(TL_FleetSetDesired(fleet, 0, states, TL_TEST_FLEET_TOWERS) == TL_SUCCESS);
+    expected = 0;
+    for (i = 0; i < TL_TEST_FLEET_TOWERS; i += TL_TEST_FLEET_DIRTY_STEP) {
+        states[i] ^= 0x00000100;
+        expected++;
+    }
+    TL_TEST_CHECK(TL_FleetSetActual(fleet, 0, states, TL_TEST_FLEET_TOWERS) == TL_SUCCESS);
+
+    /* y@^Ҧ@PO */
+    start_us = tl_time_now_us();
+    for (round = 0; round < TL_TEST_FLEET_ROUNDS; round++) {
+        dirty = 0;
+        cursor = 0;
+        while (cursor < TL_TEST_FLEET_TOWERS) {
+            if (TL_FleetScanDirty(fleet, &cursor, indices, masks, TL_TEST_FLEET_BATCH, &found) != TL_SUCCESS) {
+                break;
+            }
+            for (i = 0; i < found; i++) {
+                TL_TEST_CHECK(indices[i] % TL_TEST_FLEET_DIRTY_STEP == 0);
+                TL_TEST_CHECK(masks[i] == TL_FRAME_LAYER_TWO);
+            }
+            dirty += found;
+        }
+        TL_TEST_CHECK(dirty == expected);
+    }
+    scan_us = (tl_time_now_us() - start_us) / TL_TEST_FLEET_ROUNDS;
+
+    /* vyoA */
+    start_us = tl_time_now_us();
+    for (round = 0; round < TL_TEST_FLEET_ROUNDS; round++) {
+        dirty = 0;
+        for (i = 0; i < TL_TEST_FLEET_TOWERS; i++) {
+            TL_FleetGetState(fleet, i, &desired, &actual);
+            if (desired != actual) {
+                dirty++;
+            }
+        }
+        TL_TEST_CHECK(dirty == expected);
+    }
+    naive_us = (tl_time_now_us() - start_us) / TL_TEST_FLEET_ROUNDS;
+    printf("@P %u yGy@ %lluusAvy %lluus\n", (unsigned int)expected, scan_us, naive_us);
+
+    /* ڪAlWᤣA@PO */
+    TL_TEST_CHECK(TL_FleetSetDesired(fleet, 0, states, TL_TEST_FLEET_TOWERS) == TL_SUCCESS);
+    cursor = 0;
+    TL_TEST_CHECK(TL_FleetScanDirty(fleet, &cursor, indices, masks, TL_TEST_FLEET_BATCH, &found) == TL_SUCCESS);
+    TL_TEST_CHECK(found == 0);
+    TL_TEST_CHECK(cursor == TL_TEST_FLEET_TOWERS);
+
+    TL_TEST_CHECK(TL_DestroyFleet(fleet) == TL_SUCCESS);
+}
+
+/*
+ * ˸mmGsC|̸˸m|^P@xOAuhAɤ~pm٭
+ */
+static void tl_test_reset_reenumerate(void)
+{
+    TL_DEVICE_HANDLE devices[2];
+    TL_ResetStats stats;
+    TL_LEDStatus red;
+    TL_LEDStatus green;
+    TL_LEDStatus blue;
+    TL_TowerState current;
+    TL_BYTE state[4];
+    unsigned long writes;
+
+    printf("\n--------------- ˸mm (O x2) ---------------\n");
+    TL_TEST_CHECK(tl_usb_sim_enable(2, 200) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(0, TL_FALSE, &devices[0]) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_OpenDevice(1, TL_FALSE, &devices[1]) == TL_SUCCESS);
+
+    memset(&red, 0, sizeof(red));
+    red.red_status = TL_LED_ON;
+    red.pattern = TL_LED_PATTERN_ON;
+    green = red;
+    green.red_status = TL_LED_OFF;
+    green.green_status = TL_LED_ON;
+    blue = red;
+    blue.red_status = TL_LED_OFF;
+    blue.blue_status = TL_LED_ON;
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_ONE, &red) == TL_SUCCESS);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[1], TL_LAYER_ONE, &green) == TL_SUCCESS);
+
+    /* O 0 _qC 1Gs}ҪOO 0 ӤOثe 0 O 1 */
+    tl_usb_sim_power_cycle(0);
+    tl_usb_sim_replug(0, 1);
+    writes = tl_usb_sim_write_count(1);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_TWO, &blue) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_ONE, state);
+    TL_TEST_CHECK(state[0] == TL_LED_ON);
+    tl_usb_sim_get_layer(0, TL_LAYER_TWO, state);
+    TL_TEST_CHECK(state[2] == TL_LED_ON);
+    tl_usb_sim_get_layer(1, TL_LAYER_ONE, state);
+    TL_TEST_CHECK(state[0] == TL_LED_OFF && state[1] == TL_LED_ON);
+    TL_TEST_CHECK(tl_usb_sim_write_count(1) == writes);
+    TL_TEST_CHECK(TL_GetResetStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.reset_count == 1);
+    TL_TEST_CHECK(stats.reenumeration_count == 1);
+    TL_TEST_CHECK(stats.restore_count == 1);
+    printf("sC|٭ %lluus\n", stats.last_restore_us);
+
+    /* usC|ӥ_qGqT_OOAApm */
+    tl_usb_sim_replug(0, 0);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[0], TL_LAYER_TWO, &green) == TL_SUCCESS);
+    tl_usb_sim_get_layer(0, TL_LAYER_TWO, state);
+    TL_TEST_CHECK(state[1] == TL_LED_ON);
+    TL_TEST_CHECK(TL_GetResetStats(devices[0], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.reset_count == 1);
+    TL_TEST_CHECK(TL_GetResetStats(devices[1], &stats) == TL_SUCCESS);
+    TL_TEST_CHECK(stats.reset_count == 0);
+
+    /* eXѪ]wOJvlA (ĤTh]w) */
+    tl_usb_sim_drop_responses(1, 2);
+    TL_TEST_CHECK(TL_DeviceSetLED(devices[1], TL_LAYER_THREE, &red) == TL_ERROR_TIMEOUT);
+    TL_TEST_CHECK(TL_GetTowerState(devices[1], &current, NULL) == TL_SUCCESS);
+    TL_TEST_CHECK(((current >> 16) & 0xFF) == 0);
+
+    TL_Finalize();
+    tl_usb_sim_disable();
+}
+
+/* ޽uGOBzɶPǿ驵 (L)BCqROƻPeXRO */
+#define TL_TEST_PIPE_CONFIGS   3
+#define TL_TEST_PIPE_COMMANDS  160
+#define TL_TEST_PIPE_THREADS   16
+
+static const unsigned long g_test_pipe_latency[TL_TEST_PIPE_CONFIGS][2] = {
+    { 250, 1000 }, { 500, 2000 }, { 1000, 3000 }
+};
+
+/* IeXLED]w */
+typedef struct {
+    unsigned int count;
+    unsigned int failures;
+} TL_TestPipeWorker;
+
+static void tl_test_pipe_worker(void* arg)
+{
+    TL_TestPipeWorker* worker = (TL_TestPipeWorker*)arg;
+    TL_LEDStatus status;
+    unsigned int i;
+
+    memset(&status, 0, sizeof(status));
+    status.pattern = TL_LED_PATTERN_ON;
+    for (i = 0; i < worker->count; i++) {
+        status.green_status = (i % 2 == 0) ? TL_LED_ON : TL_LED_OFF;
+        if (TL_SetLED((TL_LAYER)(i % 3), &status) != TL_SUCCESS) {
+            worker->failures++;
+        }
+    }
+}
+
+/* H threads Ӱ@eX TL_TEST_PIPE_COMMANDS LED]wA^gLɶ (L) */
+static unsigned long long tl_test_pipe_run(unsigned int threads, unsigned int* failures)
+{
+    TL_TestPipeWorker workers[TL_TEST_PIPE_THREADS];
+    TL_Thread* handles[TL_TEST_PIPE_THREADS];
+    unsigned long long start_us;
+    unsigned int i;
+
+    *failures = 0;
+    start_us = tl_time_now_us();
+    for (i = 0; i < threads; i++) {
+        workers[i].count = TL_TEST_PIPE_COMMANDS / threads;
+        workers[i].failures = 0;
+        handles[i] = tl_thread_create(tl_test_pipe_worker, &workers[i]);
+        TL_TEST_CHECK(handles[i] != NULL);
+    }
+    for (i = 0; i < threads; i++) {
+        if (handles[i] != NULL) {
+            tl_thread_join(handles[i]);
+            *failures += workers[i].failures;
+        }
+    }
+    return tl_time_now_us() - start_us;
+}
+
+/*
+ * ޽ugJG޽u` 1~8 ]RqAPROb~WAHΦPRO򥢦^_
+ */
+static void tl_test_pipeline(void)
+{
+    TL_AsyncStats stats;
+    double rates[8];
+    unsigned long long elapsed_us;
+    unsigned int failures;
+    unsigned int config;
+    unsigned int depth;
+
+    printf("\n--------------- ޽ugJ (O) ---------------\n");
+    for (config = 0; config < TL_TEST_PIPE_CONFIGS; config++) {
+        TL_TEST_CHECK(tl_usb_sim_enable(1, g_test_pipe_latency[config][0]) == TL_SUCCESS);
+        tl_usb_sim_set_link_delay(0, g_test_pipe_latency[config][1]);
+        TL_TEST_CHECK(TL_Initialize() == TL_SUCCESS);
+        TL_TEST_CHECK(TL_SetWriteMode(NULL, TL_WRITE_MODE_PIPELINED, 0) == TL_SUCCESS);
+        TL_TEST_CHECK(TL_OpenConnection(TL_FALSE) == TL_SUCCESS);
+
+        for (depth = 1; depth <= 8; depth++) {
+            TL_TEST_CHECK(TL_SetPipelineDepth(NULL, depth) == TL_SUCCESS);
+            rates[depth - 1] = TL_TEST_PIPE_COMMANDS * 1000000.0 / (double)tl_test_pipe_run(8, &failures);
+            TL_TEST_CHECK(failures == 0);
+        }
+        printf("Bz %luus + ǿ %luus (RO/):", g_test_pipe_latency[config][0], g_test_pipe_latency[config][1]);
+        for (depth = 1; depth <= 8; depth++) {
+            printf(" N=%u %.0f", depth, rates[depth - 1]);
+        }
+        printf("AN=8  N=1  %.1f \n", rates[7] / rates[0]);
+        TL_TEST_CHECK(rates[7] > rates[0] * 2);
+
+        /* ޽u`פjPWɡAPɦb~LED]wWL TL_ASYNC_MAX_SAME_TYPE */
+        if (config == 0) {
+            TL_TEST_CHECK(TL_SetPipelineDepth(NULL, TL_ASYNC_MAX_IN_FLIGHT) == TL_SUCCESS);
+            tl_usb_sim_take_max_pending(0);
+            tl_test_pipe_run(TL_TEST_PIPE_THREADS, &failures);
+            TL_TEST_CHECK(failures == 0);
+            TL_TEST_CHECK(tl_usb_sim_take_max_pending(0) <= TL_ASYNC_MAX_SAME_TYPE);
+
+            /* sLED]w򥢤@Ӧ^G̫@ӹOɫb~ROաAIsݬҦ\ */
+            TL_TEST_CHECK(TL_SetPipelineDepth(NULL, 8) == TL_SUCCESS);
+            tl_usb_sim_drop_responses(0, 1);
+            elapsed_us = tl_test_pipe_run(8, &failures);
+            TL_TEST_CHECK(failures == 0);
+            TL_TEST_CHECK(TL_GetAsyncStats(NULL, &stats) == TL_SUCCESS);
+            printf("sLED]w򥢤@Ӧ^G%u өRO %lluusA 0Ao{ %llu\n",
+                TL_TEST_PIPE_COMMANDS, elapsed_us, stats.responses_skipped);
+        }
+
+        TL_TEST_CHECK(TL_CloseConnection() == TL_SUCCESS);
+        TL_TEST_CHECK(TL_SetWriteMode(NULL, TL_WRITE_MODE_SYNC, 0) == TL_SUCCESS);
+        TL_Finalize();
+        tl_usb_sim_disable();
+    }
+}
+
+/*
+ * ҦOաA^Ѽ
+ */
+static int tl_test_run_simulated(void)
+{
+    tl_test_message_catalog();
+    tl_test_rtt();
+    tl_test_write_mode();
+    tl_test_event_loop();
+    tl_test_emergency_overtake();
+    tl_test_queue_expiry();
+    tl_test_group_fleet();
+    tl_test_scheduler_close();
+    tl_test_scheduler_dead_tower();
+    tl_test_reconcile_stop();
+    tl_test_filter_stop();
+    tl_test_watchdog_update();
+    tl_test_journal_path();
+    tl_test_sequence_unload();
+    tl_test_modbus();
+    tl_test_push();
+    tl_test_fleet_scan();
+    tl_test_alarm_map();
+    tl_test_reset_reenumerate();
+    tl_test_pipeline();
+    tl_test_tower_state();
+    tl_test_calibrate();
+    tl_test_snapshot();
+    tl_test_watchdog_cancel();
+    tl_test_health_monitor();
+    tl_test_trace();
+    tl_test_probes();
+    return g_test_failures;
+}
 
 int main(void)
 {
     TL_ERROR_CODE ret;
 
+    /* HO椣ݭnw骺 */
+    if (tl_test_run_simulated() != 0) {
+        printf("\nOե %d \n", g_test_failures);
+        return 1;
+    }
+    printf("\nO OK\n");
+
     /* լy{Gl -> }ҳsu -> MLED -> ]wLED ->  ->  */
 
     printf("--------------- }ҳ]Ƴsu ---------------\n");
@@ -0,0 +1,463 @@
+﻿/*
+ * tl_alarm.c
+ *
+ * 塔燈通訊控制函式庫 - 警報代碼對照表實現
+ *
+ * 將警報代碼對應到塔燈畫面 (各層LED、蜂鳴器) 與優先權。載入時以 CHD (hash and
+ * displace) 建立最小完美雜湊：代碼先雜湊到平均約 4 個代碼的桶，每個桶再找一個
+ * 位移值，使桶中的代碼以該位移值雜湊後落在互不衝突的空位；只有一個代碼的桶直接
+ * 記錄空位。n 個代碼恰好占用 n 個位置，查詢固定為兩次雜湊與兩次陣列讀取，不配置記憶體。
+ *
+ * 文字定義每行一項，# 開頭為註解：
+ *   <代碼> <第一層> <第二層> <第三層> <蜂鳴器> [normal|emergency]
+ * 目標字詞的寫法與動畫序列相同 (RGB/P、TV/P、- 表示不包含該目標)。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tl_internal.h"
+
+/* 每個桶平均的代碼數 */
+#define TL_ALARM_BUCKET_LOAD   4
+
+/* 單一桶嘗試的位移值上限，超過時換一個雜湊種子重建 */
+#define TL_ALARM_MAX_DISPLACE  (1u << 20)
+
+/* 重建的次數上限 */
+#define TL_ALARM_MAX_ATTEMPTS  8
+
+/* 文字定義單行的最大長度 */
+#define TL_ALARM_LINE_MAX      256
+
+/* 對照表項目 */
+typedef struct {
+    uint32_t code;                    /* 警報代碼 */
+    TL_TowerState state;              /* 壓縮的塔燈狀態 */
+    uint8_t target_mask;              /* 要套用的目標 (TL_FRAME_*) */
+    uint8_t priority;                 /* 優先權 (TL_PRIORITY) */
+} TL_AlarmEntry;
+
+/* 警報代碼對照表 (即 TL_ALARM_MAP) */
+typedef struct TL_AlarmMap TL_AlarmMap;
+
+struct TL_AlarmMap {
+    TL_AlarmEntry* entries;           /* 依完美雜湊排列的項目，共 entry_count 個 */
+    int32_t* displace;                /* 各桶的位移值；負值 -(slot+1) 表示直接指定位置 */
+    uint32_t entry_count;             /* 項目數 */
+    uint32_t bucket_count;            /* 桶數 */
+    uint32_t seed;                    /* 雜湊種子 */
+};
+
+/*
+ * 代碼的雜湊 (murmur3 的 fmix32)，displace 為 0 時為桶雜湊
+ */
+static uint32_t tl_alarm_hash(uint32_t code, uint32_t seed, uint32_t displace)
+{
+    uint32_t h = (code ^ seed) + displace * 0x9E3779B9u;
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/*
+ * 將雜湊值縮放到 [0, range) (以乘法取代除法)
+ */
+static uint32_t tl_alarm_reduce(uint32_t hash, uint32_t range)
+{
+    return (uint32_t)(((uint64_t)hash * range) >> 32);
+}
+
+/*
+ * 依代碼排序項目
+ */
+static int tl_alarm_compare(const void* a, const void* b)
+{
+    uint32_t x = ((const TL_AlarmEntry*)a)->code;
+    uint32_t y = ((const TL_AlarmEntry*)b)->code;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * 解析單行定義
+ */
+static TL_BOOL tl_alarm_parse_line(char* cursor, TL_AlarmEntry* entry)
+{
+    TL_TowerFrame frame;
+    unsigned int code;
+    const char* token;
+
+    if (!tl_text_parse_u32(tl_text_next_token(&cursor), &code) ||
+        !tl_tower_state_parse(&cursor, &frame) || frame.target_mask == 0 ||
+        TL_PackTowerState(&frame, &entry->state) != TL_SUCCESS) {
+        return TL_FALSE;
+    }
+
+    entry->code = code;
+    entry->target_mask = (uint8_t)frame.target_mask;
+    entry->priority = TL_PRIORITY_NORMAL;
+
+    token = tl_text_next_token(&cursor);
+    if (token != NULL) {
+        if (strcmp(token, "emergency") == 0) {
+            entry->priority = TL_PRIORITY_EMERGENCY;
+        } else if (strcmp(token, "normal") != 0) {
+            return TL_FALSE;
+        }
+    }
+    return (tl_text_next_token(&cursor) == NULL) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 讀取文字定義
+ */
+static TL_ERROR_CODE tl_alarm_parse(const char* filename, TL_AlarmEntry** entries, uint32_t* entry_count)
+{
+    TL_FileMapping mapping;
+    TL_ERROR_CODE result;
+    TL_AlarmEntry* list = NULL;
+    TL_AlarmEntry* grown;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t offset = 0;
+    size_t length;
+    char line[TL_ALARM_LINE_MAX];
+    char* text;
+    int line_number = 0;
+
+    result = tl_file_map_open_read(filename, &mapping);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 略過 UTF-8 BOM */
+    if (mapping.size >= 3 && mapping.data[0] == 0xEF && mapping.data[1] == 0xBB && mapping.data[2] == 0xBF) {
+        offset = 3;
+    }
+
+    while (result == TL_SUCCESS && offset < mapping.size) {
+        const TL_BYTE* start = mapping.data + offset;
+        const TL_BYTE* newline = (const TL_BYTE*)memchr(start, '\n', mapping.size - offset);
+
+        length = (newline != NULL) ? (size_t)(newline - start) : mapping.size - offset;
+        offset += length + 1;
+        line_number++;
+        if (length > 0 && start[length - 1] == '\r') {
+            length--;
+        }
+        if (length >= sizeof(line)) {
+            result = TL_ERROR_FILE_FORMAT;
+            break;
+        }
+        memcpy(line, start, length);
+        line[length] = '\0';
+
+        /* 空行與註解 */
+        text = line;
+        while (*text == ' ' || *text == '\t') {
+            text++;
+        }
+        if (*text == '\0' || *text == '#') {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = (capacity != 0) ? capacity * 2 : 256;
+            grown = (TL_AlarmEntry*)realloc(list, capacity * sizeof(TL_AlarmEntry));
+            if (grown == NULL) {
+                result = TL_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            list = grown;
+        }
+        if (!tl_alarm_parse_line(text, &list[count])) {
+            result = TL_ERROR_FILE_FORMAT;
+            break;
+        }
+        count++;
+    }
+
+#ifdef BUILD_TEST_EXE
+    if (result == TL_ERROR_FILE_FORMAT) {
+        printf("[TL_LoadAlarmMap] %s 第 %d 行無法解析\n", filename, line_number);
+    }
+#endif
+    tl_file_map_close(&mapping);
+
+    if (result == TL_SUCCESS && (count == 0 || count > 0x7FFFFFFFu)) {
+        result = TL_ERROR_FILE_FORMAT;
+    }
+    if (result != TL_SUCCESS) {
+        free(list);
+        return result;
+    }
+
+    *entries = list;
+    *entry_count = (uint32_t)count;
+    return TL_SUCCESS;
+}
+
+/*
+ * 以指定的雜湊種子建立完美雜湊
+ *
+ * 參數：map 對照表，entries、displace 已配置，entry_count、bucket_count、seed 已設定
+ * 參數：source 依代碼排序、不重複的項目
+ * 參數：bucket_of 暫存：各項目所屬的桶
+ * 參數：order 暫存：依桶排列的項目編號
+ * 參數：start 暫存：各桶在 order 中的起點 (bucket_count + 1 個)
+ * 參數：by_size 暫存：依大小遞減排列的桶
+ * 參數：taken 暫存：各位置是否已占用
+ * 返回值：TL_TRUE 表示成功
+ */
+static TL_BOOL tl_alarm_build(TL_AlarmMap* map, const TL_AlarmEntry* source, uint32_t* bucket_of,
+                              uint32_t* order, uint32_t* start, uint32_t* by_size, TL_BYTE* taken)
+{
+    uint32_t n = map->entry_count;
+    uint32_t r = map->bucket_count;
+    uint32_t slots[TL_ALARM_BUCKET_LOAD * 8];
+    uint32_t max_size = 0;
+    uint32_t free_slot = 0;
+    uint32_t i;
+    uint32_t k;
+    uint32_t b;
+    uint32_t d;
+    uint32_t size;
+    uint32_t count;
+    uint32_t* fill;
+
+    /* 以計數排序將項目依桶分組 */
+    memset(start, 0, (r + 1) * sizeof(uint32_t));
+    for (i = 0; i < n; i++) {
+        bucket_of[i] = tl_alarm_reduce(tl_alarm_hash(source[i].code, map->seed, 0), r);
+        start[bucket_of[i] + 1]++;
+    }
+    for (b = 0; b < r; b++) {
+        size = start[b + 1];
+        if (size > max_size) {
+            max_size = size;
+        }
+        start[b + 1] += start[b];
+    }
+    /* 過大的桶代表雜湊種子不佳 */
+    if (max_size > sizeof(slots) / sizeof(slots[0])) {
+        return TL_FALSE;
+    }
+
+    fill = by_size;  /* 暫借 by_size 作為各桶的填入位置 */
+    memcpy(fill, start, r * sizeof(uint32_t));
+    for (i = 0; i < n; i++) {
+        order[fill[bucket_of[i]]++] = i;
+    }
+
+    /* 依大小遞減排列兩個以上代碼的桶 (桶的大小範圍很小，逐一大小掃描) */
+    count = 0;
+    for (size = max_size; size >= 2; size--) {
+        for (b = 0; b < r; b++) {
+            if (start[b + 1] - start[b] == size) {
+                by_size[count++] = b;
+            }
+        }
+    }
+
+    memset(taken, 0, n);
+    memset(map->displace, 0, r * sizeof(int32_t));
+
+    /* 兩個以上代碼的桶：找出讓所有代碼落在不同空位的位移值 */
+    for (i = 0; i < count; i++) {
+        b = by_size[i];
+        size = start[b + 1] - start[b];
+        for (d = 1; d < TL_ALARM_MAX_DISPLACE; d++) {
+            for (k = 0; k < size; k++) {
+                slots[k] = tl_alarm_reduce(tl_alarm_hash(source[order[start[b] + k]].code, map->seed, d), n);
+                if (taken[slots[k]]) {
+                    break;
+                }
+                taken[slots[k]] = 2;  /* 暫時占用，檢查桶內的衝突 */
+            }
+            if (k == size) {
+                break;
+            }
+            while (k > 0) {
+                taken[slots[--k]] = 0;
+            }
+        }
+        if (d == TL_ALARM_MAX_DISPLACE) {
+            return TL_FALSE;
+        }
+        for (k = 0; k < size; k++) {
+            taken[slots[k]] = 1;
+            map->entries[slots[k]] = source[order[start[b] + k]];
+        }
+        map->displace[b] = (int32_t)d;
+    }
+
+    /* 單一代碼的桶：直接放入剩餘的空位 */
+    for (b = 0; b < r; b++) {
+        if (start[b + 1] - start[b] != 1) {
+            continue;
+        }
+        while (taken[free_slot]) {
+            free_slot++;
+        }
+        taken[free_slot] = 1;
+        map->entries[free_slot] = source[order[start[b]]];
+        map->displace[b] = -(int32_t)free_slot - 1;
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 釋放對照表
+ */
+static void tl_alarm_free(TL_AlarmMap* map)
+{
+    free(map->entries);
+    free(map->displace);
+    free(map);
+}
+
+/*
+ * 載入警報代碼對照表
+ */
+TL_ERROR_CODE TL_LoadAlarmMap(const char* filename, TL_ALARM_MAP* map)
+{
+    TL_AlarmMap* loaded;
+    TL_AlarmEntry* source = NULL;
+    TL_ERROR_CODE result;
+    uint32_t* scratch = NULL;
+    TL_BYTE* taken = NULL;
+    uint32_t count = 0;
+    uint32_t i;
+    int attempt;
+
+    if (filename == NULL || map == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *map = NULL;
+
+    result = tl_alarm_parse(filename, &source, &count);
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+        return result;
+    }
+
+    /* 重複的代碼視為格式錯誤 */
+    qsort(source, count, sizeof(TL_AlarmEntry), tl_alarm_compare);
+    for (i = 1; i < count; i++) {
+        if (source[i].code == source[i - 1].code) {
+#ifdef BUILD_TEST_EXE
+            printf("[TL_LoadAlarmMap] 重複的代碼 %u\n", (unsigned int)source[i].code);
+#endif
+            free(source);
+            tl_set_last_error(TL_ERROR_FILE_FORMAT);
+            return TL_ERROR_FILE_FORMAT;
+        }
+    }
+
+    loaded = (TL_AlarmMap*)calloc(1, sizeof(TL_AlarmMap));
+    if (loaded != NULL) {
+        loaded->entry_count = count;
+        loaded->bucket_count = (count + TL_ALARM_BUCKET_LOAD - 1) / TL_ALARM_BUCKET_LOAD;
+        loaded->entries = (TL_AlarmEntry*)malloc(count * sizeof(TL_AlarmEntry));
+        loaded->displace = (int32_t*)malloc(loaded->bucket_count * sizeof(int32_t));
+        /* 暫存：bucket_of、order (各 count 個)，start (bucket_count + 1 個)，by_size (bucket_count 個) */
+        scratch = (uint32_t*)malloc(((size_t)count * 2 + (size_t)loaded->bucket_count * 2 + 1) * sizeof(uint32_t));
+        taken = (TL_BYTE*)malloc(count);
+    }
+    if (loaded == NULL || loaded->entries == NULL || loaded->displace == NULL || scratch == NULL || taken == NULL) {
+        if (loaded != NULL) {
+            tl_alarm_free(loaded);
+        }
+        free(scratch);
+        free(taken);
+        free(source);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    result = TL_ERROR_GENERAL;
+    for (attempt = 0; attempt < TL_ALARM_MAX_ATTEMPTS; attempt++) {
+        loaded->seed = tl_alarm_hash((uint32_t)attempt, 0x2545F491u, 1);
+        if (tl_alarm_build(loaded, source, scratch, scratch + count, scratch + (size_t)count * 2,
+                           scratch + (size_t)count * 2 + loaded->bucket_count + 1, taken)) {
+            result = TL_SUCCESS;
+            break;
+        }
+    }
+
+    free(scratch);
+    free(taken);
+    free(source);
+
+    if (result != TL_SUCCESS) {
+        tl_alarm_free(loaded);
+        tl_set_last_error(result);
+        return result;
+    }
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_LoadAlarmMap] %u 個代碼，%u 個桶，重建 %d 次\n",
+           (unsigned int)count, (unsigned int)loaded->bucket_count, attempt);
+#endif
+    *map = loaded;
+    return TL_SUCCESS;
+}
+
+/*
+ * 釋放警報代碼對照表
+ */
+TL_ERROR_CODE TL_UnloadAlarmMap(TL_ALARM_MAP map)
+{
+    if (map == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    tl_alarm_free(map);
+    return TL_SUCCESS;
+}
+
+/*
+ * 查詢警報代碼
+ */
+TL_ERROR_CODE TL_LookupAlarm(TL_ALARM_MAP map, unsigned int code, TL_TowerCommand* command)
+{
+    const TL_AlarmEntry* entry;
+    int32_t displace;
+    uint32_t slot;
+
+    if (map == NULL || command == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    displace = map->displace[tl_alarm_reduce(tl_alarm_hash(code, map->seed, 0), map->bucket_count)];
+    if (displace < 0) {
+        slot = (uint32_t)(-(displace + 1));
+    } else {
+        slot = tl_alarm_reduce(tl_alarm_hash(code, map->seed, (uint32_t)displace), map->entry_count);
+    }
+
+    /* 完美雜湊只保證已知代碼不衝突，未知代碼必須比對 */
+    entry = &map->entries[slot];
+    if (displace == 0 || entry->code != code) {
+        tl_set_last_error(TL_ERROR_OUT_OF_RANGE);
+        return TL_ERROR_OUT_OF_RANGE;
+    }
+
+    /* 載入時已檢查過狀態可還原 */
+    TL_UnpackTowerState(entry->state, &command->frame);
+    command->frame.target_mask = entry->target_mask;
+    command->type = TL_COMMAND_APPLY_FRAME;
+    command->priority = (TL_PRIORITY)entry->priority;
+    return TL_SUCCESS;
+}
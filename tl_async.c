@@ -0,0 +1,1038 @@
+﻿/*
+ * tl_async.c
+ *
+ * 塔燈通訊控制函式庫 - 非同步寫入實現
+ *
+ * TL_WRITE_MODE_FIRE_AND_FORGET 模式下，設定命令寫出後即返回，不必等待
+ * 每個命令的往返時間。塔燈依序處理命令並依序回應，因此以先進先出佇列
+ * 記錄在途命令，由接收執行緒依序將回應配對給對應的命令並驗證；
+ * 驗證執行緒則定期讀取裝置狀態，與影子狀態比對。
+ * 需要回應內容的命令 (例如狀態讀取) 也經由同一佇列送出，以保持回應順序。
+ *
+ * TL_WRITE_MODE_PIPELINED 模式下，設定命令同樣經由佇列送出，但呼叫端等待
+ * 自己的回應；多個執行緒的命令可同時在途，由裝置的管線深度限制數量。
+ * 協定沒有序號，回應依順序與命令類型 (回應的第 2 個位元組) 配對：
+ * 類型與最前端的命令不符時，表示前面命令的回應已遺失，這些命令以逾時結束，
+ * 其餘在途命令不受影響。
+ * 限制：連續的同類型命令之間回應遺失時無法由類型發現，後面的回應會依序配對到
+ * 前一個命令，直到這一串的最後一個命令逾時，接收執行緒才重新同步並讓在途命令
+ * 以逾時結束 (呼叫端重試)。因此同類型命令同時在途的數量限制為
+ * TL_ASYNC_MAX_SAME_TYPE，被錯誤確認的命令最多為其減一；非同步模式的
+ * 週期性狀態驗證可發現因此而未套用的設定。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 在途命令的寫出狀態 */
+typedef enum {
+    TL_INFLIGHT_WRITING = 0,   /* 正在寫出，接收執行緒須等待 */
+    TL_INFLIGHT_WRITTEN,       /* 已寫出，等待回應 */
+    TL_INFLIGHT_WRITE_FAILED   /* 寫出失敗，不會有回應 */
+} TL_INFLIGHT_STATE;
+
+/* 等待回應內容的呼叫端 */
+typedef struct {
+    TL_BYTE* response;         /* 回應緩衝區 */
+    size_t response_size;      /* 回應緩衝區大小 */
+    size_t response_length;    /* 實際回應長度 */
+    TL_ERROR_CODE result;      /* 結果 */
+    TL_BOOL done;              /* 是否已完成 */
+} TL_AsyncWaiter;
+
+/* 在途命令 */
+typedef struct {
+    TL_INFLIGHT_STATE state;   /* 寫出狀態 */
+    TL_BYTE cmd_type;          /* 命令類型，用於核對回應 */
+    int target;                /* 設定目標，等待回應的命令為 -1 */
+    TL_BOOL rtt_sample;        /* 寫出時佇列中沒有其他命令，可作為往返時間樣本 */
+    unsigned long long sent_us;    /* 寫出時間 */
+    TL_ERROR_CODE write_error;     /* 寫出失敗時的錯誤碼 */
+    TL_AsyncWaiter* waiter;        /* 等待者，NULL 表示不等待回應 */
+} TL_InFlightCommand;
+
+/* 非同步寫入引擎 */
+struct TL_AsyncEngine {
+    TL_DeviceContext* device;  /* 所屬裝置 */
+    TL_Mutex* lock;            /* 保護佇列、等待者與統計 */
+    TL_Cond* changed;          /* 佇列狀態改變 */
+    TL_Mutex* write_lock;      /* 確保寫出順序與入列順序一致 */
+    TL_Thread* reader;         /* 接收執行緒 */
+    TL_Thread* verifier;       /* 驗證執行緒 */
+    TL_BOOL stopping;          /* 正在停止，不再接受新命令 */
+    TL_InFlightCommand queue[TL_ASYNC_MAX_IN_FLIGHT];
+    unsigned int head;         /* 最舊的在途命令 */
+    unsigned int count;        /* 在途命令數 */
+    TL_ERROR_CODE pending_error;   /* 上次 TL_FlushWrites 以來第一個背景錯誤 */
+    unsigned int users;        /* 在 state_lock 外使用引擎的 API 呼叫數 (受 state_lock 保護) */
+    TL_Cond* released;         /* users 歸零 (搭配 state_lock) */
+};
+
+/*
+ * 更新影子狀態
+ */
+void tl_shadow_update(TL_DeviceContext* device, int target,
+                      const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer)
+{
+    if (target < 0 || target >= TL_TARGET_COUNT) {
+        return;
+    }
+
+    tl_mutex_lock(device->state_lock);
+    if (target == TL_TARGET_BUZZER) {
+        if (buzzer != NULL) {
+            device->shadow.buzzer = *buzzer;
+        }
+    } else if (led != NULL) {
+        device->shadow.led[target] = *led;
+    }
+    device->shadow.valid_mask |= 1u << target;
+    device->shadow.sequence[target]++;
+    tl_mutex_unlock(device->state_lock);
+
+    /* 壓縮的目前狀態以原子操作更新，不需持有鎖 */
+    tl_tower_state_note(device, target, led, buzzer);
+}
+
+/*
+ * 通知寫入不一致 (不可在持有引擎鎖時呼叫)
+ */
+static void tl_async_notify(TL_DeviceContext* device, TL_WriteMismatch* mismatch)
+{
+    TL_MismatchCallback callback;
+    void* user_data;
+
+    tl_mutex_lock(device->state_lock);
+    callback = device->mismatch_callback;
+    user_data = device->mismatch_user_data;
+    if (mismatch->target == TL_TARGET_BUZZER) {
+        mismatch->expected_buzzer = device->shadow.buzzer;
+    } else if (mismatch->target >= 0 && mismatch->target < TL_TARGET_BUZZER) {
+        mismatch->expected_led = device->shadow.led[mismatch->target];
+    }
+    tl_mutex_unlock(device->state_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[tl_async] 不一致 kind=%d target=%d error=%d\n",
+        (int)mismatch->kind, mismatch->target, (int)mismatch->error);
+#endif
+
+    if (callback != NULL) {
+        callback(mismatch, user_data);
+    }
+}
+
+/*
+ * 完成佇列最前端的命令 (呼叫端須持有引擎鎖)
+ *
+ * 返回值：TL_TRUE 表示需要在釋放鎖後通知 ACK 錯誤，內容存於 mismatch
+ */
+static TL_BOOL tl_async_complete_head(TL_AsyncEngine* engine, TL_ERROR_CODE result,
+                                      const TL_BYTE* response, size_t response_length,
+                                      TL_WriteMismatch* mismatch)
+{
+    TL_InFlightCommand* entry = &engine->queue[engine->head];
+    TL_AsyncStats* stats = &engine->device->async_stats;
+    TL_AsyncWaiter* waiter = entry->waiter;
+    TL_BOOL notify = TL_FALSE;
+
+    if (waiter != NULL) {
+        /* 等待者自行檢查回應內容 */
+        if (result == TL_SUCCESS) {
+            if (response_length > waiter->response_size) {
+                result = TL_ERROR_INVALID_PARAMETER;
+            } else {
+                memcpy(waiter->response, response, response_length);
+                waiter->response_length = response_length;
+            }
+        }
+        waiter->result = result;
+        waiter->done = TL_TRUE;
+    } else {
+        /* 不等待回應的設定命令在此驗證 */
+        if (result == TL_SUCCESS) {
+            result = tl_cmd_check_response_format(response, response_length);
+            if (result == TL_SUCCESS && response[1] != entry->cmd_type) {
+                result = TL_ERROR_RESPONSE_FORMAT;
+            }
+        }
+
+        if (result == TL_SUCCESS) {
+            stats->acks_ok++;
+        } else {
+            if (result == TL_ERROR_TIMEOUT) {
+                stats->acks_lost++;
+            } else {
+                stats->acks_failed++;
+            }
+            if (engine->pending_error == TL_SUCCESS) {
+                engine->pending_error = result;
+            }
+            memset(mismatch, 0, sizeof(*mismatch));
+            mismatch->kind = TL_MISMATCH_ACK_ERROR;
+            mismatch->target = entry->target;
+            mismatch->error = result;
+            notify = TL_TRUE;
+        }
+    }
+
+    /* 寫出失敗或未收到回應的命令沒有往返時間 */
+    tl_health_record(engine->device, result,
+                     (result == TL_SUCCESS) ? tl_time_now_us() - entry->sent_us : 0);
+
+    engine->head = (engine->head + 1) % TL_ASYNC_MAX_IN_FLIGHT;
+    engine->count--;
+    tl_cond_broadcast(engine->changed);
+    return notify;
+}
+
+/*
+ * 依命令類型找出回應所屬的在途命令 (呼叫端須持有引擎鎖)
+ *
+ * 返回值：所屬命令與佇列最前端的距離，沒有相符的命令時為 -1
+ */
+static int tl_async_match_response(const TL_AsyncEngine* engine,
+                                   const TL_BYTE* response, size_t response_length)
+{
+    const TL_InFlightCommand* entry;
+    unsigned int i;
+
+    /* 無法判斷類型的回應交由最前端的命令驗證 */
+    if (response_length < 2) {
+        return 0;
+    }
+
+    for (i = 0; i < engine->count; i++) {
+        entry = &engine->queue[(engine->head + i) % TL_ASYNC_MAX_IN_FLIGHT];
+        if (entry->state != TL_INFLIGHT_WRITE_FAILED && entry->cmd_type == response[1]) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * 接收執行緒
+ *
+ * 依序等待每個在途命令的回應。逾時表示管道可能已失去同步，
+ * 此時重新同步管道，並讓所有在途命令以逾時結束 (其回應已被清除)。
+ */
+static void tl_async_reader_main(void* arg)
+{
+    TL_AsyncEngine* engine = (TL_AsyncEngine*)arg;
+    TL_DeviceContext* device = engine->device;
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_InFlightCommand entry;
+    TL_WriteMismatch mismatch;
+    TL_WriteMismatch failed[TL_ASYNC_MAX_IN_FLIGHT];
+    unsigned int failed_count;
+    unsigned int i;
+    TL_ERROR_CODE result;
+    unsigned long long start_us;
+    unsigned long long last_done_us = 0;
+    unsigned long long elapsed_us;
+    unsigned long long timeout_us;
+    unsigned long wait_ms;
+    TL_BOOL notify;
+    int skip;
+
+    tl_mutex_lock(engine->lock);
+    for (;;) {
+        /* 等待佇列最前端的命令寫出完成 */
+        while ((engine->count == 0 && !engine->stopping) ||
+               (engine->count > 0 && engine->queue[engine->head].state == TL_INFLIGHT_WRITING)) {
+            tl_cond_wait(engine->changed, engine->lock, TL_WAIT_INFINITE);
+        }
+        if (engine->count == 0) {
+            break;
+        }
+
+        entry = engine->queue[engine->head];
+        if (entry.state == TL_INFLIGHT_WRITE_FAILED) {
+            /* 寫出失敗的命令不會有回應 */
+            notify = tl_async_complete_head(engine, entry.write_error, NULL, 0, &mismatch);
+            if (notify) {
+                tl_mutex_unlock(engine->lock);
+                tl_async_notify(device, &mismatch);
+                tl_mutex_lock(engine->lock);
+            }
+            continue;
+        }
+        tl_mutex_unlock(engine->lock);
+
+        /* 期限從寫出時間或前一個回應到達時間 (取較晚者) 起算，
+         * 塔燈依序處理命令，排在後面的命令須等前面的命令完成 */
+        start_us = (entry.sent_us > last_done_us) ? entry.sent_us : last_done_us;
+        timeout_us = (unsigned long long)tl_rtt_timeout_ms(device) * 1000;
+        elapsed_us = tl_time_now_us() - start_us;
+        wait_ms = (elapsed_us >= timeout_us) ? 1 : (unsigned long)((timeout_us - elapsed_us + 999) / 1000);
+
+        result = tl_cmd_receive_response(device, response, sizeof(response), &response_length, wait_ms);
+
+        if (result == TL_SUCCESS) {
+            tl_mutex_lock(engine->lock);
+            skip = tl_async_match_response(engine, response, response_length);
+            if (skip < 0) {
+                /* 沒有相符的在途命令 (例如已逾時命令的遲到回應)，丟棄後繼續等待 */
+                device->async_stats.responses_discarded++;
+                continue;
+            }
+
+            last_done_us = tl_time_now_us();
+            if (skip == 0 && entry.rtt_sample) {
+                tl_rtt_add_sample(device, last_done_us - entry.sent_us);
+            }
+
+            /* 排在所屬命令之前的命令，其回應已遺失 */
+            failed_count = 0;
+            for (; skip > 0; skip--) {
+                entry = engine->queue[engine->head];
+                if (entry.state != TL_INFLIGHT_WRITE_FAILED) {
+                    device->async_stats.responses_skipped++;
+                }
+                if (tl_async_complete_head(engine,
+                        (entry.state == TL_INFLIGHT_WRITE_FAILED) ? entry.write_error : TL_ERROR_TIMEOUT,
+                        NULL, 0, &failed[failed_count])) {
+                    failed_count++;
+                }
+            }
+            if (tl_async_complete_head(engine, TL_SUCCESS, response, response_length, &failed[failed_count])) {
+                failed_count++;
+            }
+            if (failed_count > 0) {
+                tl_mutex_unlock(engine->lock);
+                for (i = 0; i < failed_count; i++) {
+                    tl_async_notify(device, &failed[i]);
+                }
+                tl_mutex_lock(engine->lock);
+            }
+            continue;
+        }
+        last_done_us = tl_time_now_us();
+
+        /* 逾時或讀取失敗：停止寫出，重新同步後讓所有在途命令失敗 */
+        if (result == TL_ERROR_TIMEOUT) {
+            tl_rtt_on_timeout(device);
+        }
+        tl_mutex_lock(engine->write_lock);
+        tl_usb_resync(device);
+        tl_mutex_lock(engine->lock);
+        failed_count = 0;
+        while (engine->count > 0) {
+            entry = engine->queue[engine->head];
+            if (tl_async_complete_head(engine,
+                    (entry.state == TL_INFLIGHT_WRITE_FAILED) ? entry.write_error : result,
+                    NULL, 0, &failed[failed_count])) {
+                failed_count++;
+            }
+        }
+        tl_mutex_unlock(engine->lock);
+        tl_mutex_unlock(engine->write_lock);
+
+        for (i = 0; i < failed_count; i++) {
+            tl_async_notify(device, &failed[i]);
+        }
+        tl_mutex_lock(engine->lock);
+
+        /* 裝置無法讀取時避免忙碌迴圈 */
+        if (result != TL_ERROR_TIMEOUT) {
+            tl_mutex_unlock(engine->lock);
+            tl_delay_ms(TL_DEVICE_READY_WAIT_MS);
+            tl_mutex_lock(engine->lock);
+        }
+    }
+    tl_mutex_unlock(engine->lock);
+}
+
+/*
+ * 計算指定類型的在途命令數 (呼叫端須持有引擎鎖)
+ */
+static unsigned int tl_async_count_type_locked(const TL_AsyncEngine* engine, TL_BYTE cmd_type)
+{
+    unsigned int same = 0;
+    unsigned int i;
+
+    for (i = 0; i < engine->count; i++) {
+        if (engine->queue[(engine->head + i) % TL_ASYNC_MAX_IN_FLIGHT].cmd_type == cmd_type) {
+            same++;
+        }
+    }
+    return same;
+}
+
+/*
+ * 在途命令是否已達管線深度或同類型命令的上限 (呼叫端須持有引擎鎖)
+ */
+static TL_BOOL tl_async_window_full_locked(const TL_AsyncEngine* engine, TL_BYTE cmd_type)
+{
+    return (engine->count >= engine->device->pipeline_depth ||
+            tl_async_count_type_locked(engine, cmd_type) >= TL_ASYNC_MAX_SAME_TYPE) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 將命令放入佇列並寫出 (呼叫端須持有寫入鎖)
+ *
+ * 返回值：TL_SUCCESS 表示已寫出，其他值表示錯誤碼 (命令不會有回應)
+ */
+static TL_ERROR_CODE tl_async_submit_locked(TL_AsyncEngine* engine, int target, TL_AsyncWaiter* waiter,
+                                            const TL_BYTE* command, size_t command_length)
+{
+    TL_DeviceContext* device = engine->device;
+    TL_InFlightCommand* entry;
+    unsigned int index;
+    TL_ERROR_CODE result;
+
+    for (;;) {
+        tl_mutex_lock(engine->lock);
+        if (engine->stopping) {
+            if (waiter != NULL) {
+                waiter->result = TL_ERROR_DEVICE_NOT_OPEN;
+                waiter->done = TL_TRUE;
+            }
+            tl_mutex_unlock(engine->lock);
+            tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+            return TL_ERROR_DEVICE_NOT_OPEN;
+        }
+        if (!tl_async_window_full_locked(engine, command[1])) {
+            break;
+        }
+
+        /* 已達管線深度或同類型上限：釋放寫入鎖 (接收執行緒重新同步時需要) 後等待空位 */
+        tl_mutex_unlock(engine->write_lock);
+        while (tl_async_window_full_locked(engine, command[1]) && !engine->stopping) {
+            tl_cond_wait(engine->changed, engine->lock, TL_WAIT_INFINITE);
+        }
+        tl_mutex_unlock(engine->lock);
+        tl_mutex_lock(engine->write_lock);
+    }
+
+    index = (engine->head + engine->count) % TL_ASYNC_MAX_IN_FLIGHT;
+    entry = &engine->queue[index];
+    entry->state = TL_INFLIGHT_WRITING;
+    entry->cmd_type = command[1];
+    entry->target = target;
+    entry->rtt_sample = (engine->count == 0) ? TL_TRUE : TL_FALSE;
+    entry->sent_us = tl_time_now_us();
+    entry->write_error = TL_SUCCESS;
+    entry->waiter = waiter;
+    engine->count++;
+    tl_mutex_unlock(engine->lock);
+
+    /* 持有寫入鎖寫出，寫出順序即為入列順序 */
+    result = tl_usb_write_data(device, TL_PIPE_ID, command, command_length, tl_rtt_timeout_ms(device));
+
+    tl_mutex_lock(engine->lock);
+    if (result == TL_SUCCESS) {
+        entry->state = TL_INFLIGHT_WRITTEN;
+        if (waiter == NULL) {
+            device->async_stats.commands_sent++;
+        }
+    } else {
+        entry->state = TL_INFLIGHT_WRITE_FAILED;
+        entry->write_error = result;
+    }
+    tl_cond_broadcast(engine->changed);
+    tl_mutex_unlock(engine->lock);
+
+    return result;
+}
+
+/*
+ * 將命令放入佇列並寫出
+ *
+ * 返回值：TL_SUCCESS 表示已寫出，其他值表示錯誤碼 (命令不會有回應)
+ */
+static TL_ERROR_CODE tl_async_submit(TL_AsyncEngine* engine, int target, TL_AsyncWaiter* waiter,
+                                     const TL_BYTE* command, size_t command_length)
+{
+    TL_ERROR_CODE result;
+
+    tl_mutex_lock(engine->write_lock);
+    result = tl_async_submit_locked(engine, target, waiter, command, command_length);
+    tl_mutex_unlock(engine->write_lock);
+    return result;
+}
+
+/*
+ * 不等待回應送出設定命令
+ */
+TL_ERROR_CODE tl_async_send(TL_AsyncEngine* engine, int target,
+                           const TL_BYTE* command, size_t command_length)
+{
+    return tl_async_submit(engine, target, NULL, command, command_length);
+}
+
+/*
+ * 經由非同步寫入引擎發送命令並等待回應
+ */
+TL_ERROR_CODE tl_async_transact(TL_AsyncEngine* engine,
+                               const TL_BYTE* command, size_t command_length,
+                               TL_BYTE* response, size_t response_size,
+                               size_t* response_length)
+{
+    TL_DeviceContext* device = engine->device;
+    TL_AsyncWaiter waiter;
+    TL_ERROR_CODE result;
+    int attempt;
+
+    for (attempt = 0; ; attempt++) {
+        memset(&waiter, 0, sizeof(waiter));
+        waiter.response = response;
+        waiter.response_size = response_size;
+
+        result = tl_async_submit(engine, -1, &waiter, command, command_length);
+
+        /* 即使寫出失敗，佇列中的項目仍由接收執行緒移除，須等待其完成 */
+        tl_mutex_lock(engine->lock);
+        while (!waiter.done) {
+            tl_cond_wait(engine->changed, engine->lock, TL_WAIT_INFINITE);
+        }
+        tl_mutex_unlock(engine->lock);
+        if (result == TL_SUCCESS) {
+            result = waiter.result;
+        }
+
+        if (result == TL_SUCCESS) {
+            if (attempt > 0) {
+                tl_rtt_on_recovered(device);
+            }
+            *response_length = waiter.response_length;
+            return TL_SUCCESS;
+        }
+
+        /* 逾時時接收執行緒已重新同步管道，重試一次 */
+        if (result != TL_ERROR_TIMEOUT || attempt >= 1 || !tl_rtt_begin_retry(device)) {
+            break;
+        }
+    }
+
+    tl_set_last_error(result);
+    return result;
+}
+
+/*
+ * 經由非同步寫入引擎連續送出多個命令並等待全部的回應
+ */
+TL_ERROR_CODE tl_async_transact_batch(TL_AsyncEngine* engine, size_t count,
+                                     const TL_BYTE* const* commands, const size_t* command_lengths,
+                                     TL_BYTE* const* responses, size_t response_size,
+                                     size_t* response_lengths)
+{
+    TL_DeviceContext* device = engine->device;
+    TL_AsyncWaiter waiters[TL_BATCH_MAX_COMMANDS];
+    TL_ERROR_CODE result;
+    size_t submitted;
+    size_t i;
+    int attempt;
+
+    if (count == 0 || count > TL_BATCH_MAX_COMMANDS) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    for (attempt = 0; ; attempt++) {
+        memset(waiters, 0, sizeof(waiters));
+        for (i = 0; i < count; i++) {
+            waiters[i].response = responses[i];
+            waiters[i].response_size = response_size;
+        }
+
+        /* 持有寫入鎖連續入列，其他執行緒的命令不會穿插其中 (管線深度不足時除外) */
+        result = TL_SUCCESS;
+        tl_mutex_lock(engine->write_lock);
+        for (submitted = 0; submitted < count && result == TL_SUCCESS; submitted++) {
+            result = tl_async_submit_locked(engine, -1, &waiters[submitted],
+                                            commands[submitted], command_lengths[submitted]);
+        }
+        tl_mutex_unlock(engine->write_lock);
+
+        /* 已入列的命令由接收執行緒移除，須等待其完成 */
+        tl_mutex_lock(engine->lock);
+        for (i = 0; i < submitted; i++) {
+            while (!waiters[i].done) {
+                tl_cond_wait(engine->changed, engine->lock, TL_WAIT_INFINITE);
+            }
+            if (result == TL_SUCCESS) {
+                result = waiters[i].result;
+            }
+        }
+        tl_mutex_unlock(engine->lock);
+
+        if (result == TL_SUCCESS) {
+            if (attempt > 0) {
+                tl_rtt_on_recovered(device);
+            }
+            for (i = 0; i < count; i++) {
+                response_lengths[i] = waiters[i].response_length;
+            }
+            return TL_SUCCESS;
+        }
+
+        /* 逾時時接收執行緒已重新同步管道，重試一次 */
+        if (result != TL_ERROR_TIMEOUT || attempt >= 1 || !tl_rtt_begin_retry(device)) {
+            break;
+        }
+    }
+
+    tl_set_last_error(result);
+    return result;
+}
+
+/*
+ * 讀取一個目標的狀態並與影子狀態比對
+ */
+static void tl_async_verify_target(TL_AsyncEngine* engine, int target)
+{
+    TL_DeviceContext* device = engine->device;
+    TL_BYTE command[TL_MAX_BUFFER_SIZE];
+    size_t command_length;
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_LEDStatus expected_led;
+    TL_LEDStatus actual_led;
+    TL_BuzzerStatus expected_buzzer;
+    TL_BuzzerStatus actual_buzzer;
+    TL_WriteMismatch mismatch;
+    unsigned long sequence;
+    TL_BOOL differs;
+
+    memset(&actual_led, 0, sizeof(actual_led));
+    memset(&actual_buzzer, 0, sizeof(actual_buzzer));
+
+    tl_mutex_lock(device->state_lock);
+    if (!(device->shadow.valid_mask & (1u << target))) {
+        tl_mutex_unlock(device->state_lock);
+        return;
+    }
+    expected_led = device->shadow.led[target < TL_TARGET_BUZZER ? target : 0];
+    expected_buzzer = device->shadow.buzzer;
+    sequence = device->shadow.sequence[target];
+    tl_mutex_unlock(device->state_lock);
+
+    /* 狀態讀取排在先前的設定命令之後，讀到的是這些設定套用後的狀態 */
+    command_length = tl_cmd_build_status_read_command((TL_BYTE)target, command, TL_MAX_BUFFER_SIZE);
+    if (command_length == 0 ||
+        tl_async_transact(engine, command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length) != TL_SUCCESS ||
+        tl_cmd_check_response_format(response, response_length) != TL_SUCCESS) {
+        return;
+    }
+
+    if (target == TL_TARGET_BUZZER) {
+        if (tl_cmd_parse_buzzer_status(response, response_length, &actual_buzzer) != TL_SUCCESS) {
+            return;
+        }
+        differs = (actual_buzzer.tone != expected_buzzer.tone ||
+                   actual_buzzer.volume != expected_buzzer.volume ||
+                   actual_buzzer.pattern != expected_buzzer.pattern) ? TL_TRUE : TL_FALSE;
+    } else {
+        if (tl_cmd_parse_led_status(response, response_length, &actual_led) != TL_SUCCESS) {
+            return;
+        }
+        differs = (actual_led.red_status != expected_led.red_status ||
+                   actual_led.green_status != expected_led.green_status ||
+                   actual_led.blue_status != expected_led.blue_status ||
+                   actual_led.pattern != expected_led.pattern) ? TL_TRUE : TL_FALSE;
+    }
+
+    /* 讀取期間有新的設定時，本次比對作廢 */
+    tl_mutex_lock(device->state_lock);
+    if (device->shadow.sequence[target] != sequence) {
+        differs = TL_FALSE;
+    }
+    tl_mutex_unlock(device->state_lock);
+
+    tl_mutex_lock(engine->lock);
+    device->async_stats.verify_reads++;
+    if (differs) {
+        device->async_stats.verify_mismatches++;
+    }
+    tl_mutex_unlock(engine->lock);
+
+    /* 不一致可能是裝置斷電重置造成的 */
+    if (differs) {
+        tl_reset_note_read(device, target, &actual_led, &actual_buzzer);
+    }
+
+    if (differs) {
+        memset(&mismatch, 0, sizeof(mismatch));
+        mismatch.kind = TL_MISMATCH_STATE;
+        mismatch.target = target;
+        mismatch.error = TL_SUCCESS;
+        mismatch.actual_led = actual_led;
+        mismatch.actual_buzzer = actual_buzzer;
+        tl_async_notify(device, &mismatch);
+    }
+}
+
+/*
+ * 驗證執行緒
+ */
+static void tl_async_verifier_main(void* arg)
+{
+    TL_AsyncEngine* engine = (TL_AsyncEngine*)arg;
+    TL_DeviceContext* device = engine->device;
+    unsigned long long next_us;
+    unsigned long long now_us;
+    unsigned long interval_ms;
+    int target;
+
+    tl_mutex_lock(engine->lock);
+    while (!engine->stopping) {
+        interval_ms = device->verify_interval_ms;
+        if (interval_ms == 0) {
+            /* 不做週期驗證，等待設定改變或停止 */
+            tl_cond_wait(engine->changed, engine->lock, TL_WAIT_INFINITE);
+            continue;
+        }
+
+        next_us = tl_time_now_us() + (unsigned long long)interval_ms * 1000;
+        while (!engine->stopping && device->verify_interval_ms == interval_ms) {
+            now_us = tl_time_now_us();
+            if (now_us >= next_us) {
+                break;
+            }
+            tl_cond_wait(engine->changed, engine->lock, (unsigned long)((next_us - now_us + 999) / 1000));
+        }
+        if (engine->stopping || device->verify_interval_ms != interval_ms) {
+            continue;
+        }
+        tl_mutex_unlock(engine->lock);
+
+        for (target = 0; target < TL_TARGET_COUNT; target++) {
+            tl_async_verify_target(engine, target);
+        }
+
+        tl_mutex_lock(engine->lock);
+    }
+    tl_mutex_unlock(engine->lock);
+}
+
+/*
+ * 啟動非同步寫入引擎
+ */
+TL_ERROR_CODE tl_async_start(TL_DeviceContext* device)
+{
+    TL_AsyncEngine* engine;
+
+    if (device->async != NULL) {
+        return TL_SUCCESS;
+    }
+
+    engine = (TL_AsyncEngine*)calloc(1, sizeof(TL_AsyncEngine));
+    if (engine == NULL) {
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    engine->device = device;
+    engine->pending_error = TL_SUCCESS;
+    engine->lock = tl_mutex_create();
+    engine->changed = tl_cond_create();
+    engine->write_lock = tl_mutex_create();
+    engine->released = tl_cond_create();
+    if (engine->lock == NULL || engine->changed == NULL || engine->write_lock == NULL ||
+        engine->released == NULL) {
+        goto fail;
+    }
+
+    engine->reader = tl_thread_create(tl_async_reader_main, engine);
+    if (engine->reader == NULL) {
+        goto fail;
+    }
+    engine->verifier = tl_thread_create(tl_async_verifier_main, engine);
+    if (engine->verifier == NULL) {
+        tl_mutex_lock(engine->lock);
+        engine->stopping = TL_TRUE;
+        tl_cond_broadcast(engine->changed);
+        tl_mutex_unlock(engine->lock);
+        tl_thread_join(engine->reader);
+        goto fail;
+    }
+
+    device->async = engine;
+    return TL_SUCCESS;
+
+fail:
+    tl_cond_destroy(engine->released);
+    tl_mutex_destroy(engine->write_lock);
+    tl_cond_destroy(engine->changed);
+    tl_mutex_destroy(engine->lock);
+    free(engine);
+    return TL_ERROR_MEMORY_ALLOCATION;
+}
+
+/*
+ * 停止非同步寫入引擎
+ */
+void tl_async_stop(TL_DeviceContext* device)
+{
+    TL_AsyncEngine* engine = device->async;
+
+    if (engine == NULL) {
+        return;
+    }
+
+    /* 不再接受新命令；接收執行緒處理完在途命令後結束 */
+    tl_mutex_lock(engine->lock);
+    engine->stopping = TL_TRUE;
+    tl_cond_broadcast(engine->changed);
+    tl_mutex_unlock(engine->lock);
+
+    tl_thread_join(engine->verifier);
+    tl_thread_join(engine->reader);
+
+    /* 等待在 state_lock 外使用引擎的 API 呼叫離開 */
+    tl_mutex_lock(device->state_lock);
+    device->async = NULL;
+    while (engine->users > 0) {
+        tl_cond_wait(engine->released, device->state_lock, TL_WAIT_INFINITE);
+    }
+    tl_mutex_unlock(device->state_lock);
+
+    tl_cond_destroy(engine->released);
+    tl_mutex_destroy(engine->write_lock);
+    tl_cond_destroy(engine->changed);
+    tl_mutex_destroy(engine->lock);
+    free(engine);
+}
+
+/*
+ * 解析目標裝置
+ *
+ * NULL 表示預設裝置，其設定在開啟前即可修改，之後由 TL_OpenDevice 開啟的裝置沿用。
+ */
+static TL_ERROR_CODE tl_async_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    if (device == NULL) {
+        if (!tl_get_internal_state()->is_initialized) {
+            tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+            return TL_ERROR_NOT_INITIALIZED;
+        }
+        *resolved = tl_get_default_device();
+        return TL_SUCCESS;
+    }
+    *resolved = device;
+    return tl_validate_device(device);
+}
+
+/*
+ * 取得裝置的非同步寫入引擎，tl_async_release 之前引擎不會被 tl_async_stop 釋放
+ *
+ * 返回值：引擎，同步模式或裝置未開啟時為 NULL
+ */
+static TL_AsyncEngine* tl_async_acquire(TL_DeviceContext* device)
+{
+    TL_AsyncEngine* engine;
+
+    tl_mutex_lock(device->state_lock);
+    engine = device->async;
+    if (engine != NULL) {
+        engine->users++;
+    }
+    tl_mutex_unlock(device->state_lock);
+    return engine;
+}
+
+/*
+ * 釋放 tl_async_acquire 取得的引擎
+ */
+static void tl_async_release(TL_AsyncEngine* engine)
+{
+    TL_DeviceContext* device = engine->device;
+
+    tl_mutex_lock(device->state_lock);
+    if (--engine->users == 0) {
+        tl_cond_broadcast(engine->released);
+    }
+    tl_mutex_unlock(device->state_lock);
+}
+
+/*
+ * 設定寫入模式
+ */
+TL_ERROR_CODE TL_SetWriteMode(TL_DEVICE_HANDLE device, TL_WRITE_MODE mode, unsigned long verify_interval_ms)
+{
+    TL_DeviceContext* context;
+    TL_AsyncEngine* engine;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (mode != TL_WRITE_MODE_SYNC && mode != TL_WRITE_MODE_FIRE_AND_FORGET &&
+        mode != TL_WRITE_MODE_PIPELINED) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_async_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 命令路徑不加鎖讀取 write_mode 與 async，開啟期間兩者不可改變；
+     * 寫入模式在裝置開啟時套用 */
+    tl_mutex_lock(context->state_lock);
+    if (context->device_handle != NULL && mode != context->write_mode) {
+        tl_mutex_unlock(context->state_lock);
+#ifdef BUILD_TEST_EXE
+        printf("[TL_SetWriteMode] 裝置開啟中無法切換寫入模式 => TL_ERROR_DEVICE_BUSY\n");
+#endif
+        tl_set_last_error(TL_ERROR_DEVICE_BUSY);
+        return TL_ERROR_DEVICE_BUSY;
+    }
+    context->write_mode = mode;
+    tl_mutex_unlock(context->state_lock);
+
+    engine = tl_async_acquire(context);
+    if (engine != NULL) {
+        /* 喚醒驗證執行緒以套用新的週期 */
+        tl_mutex_lock(engine->lock);
+        context->verify_interval_ms = verify_interval_ms;
+        tl_cond_broadcast(engine->changed);
+        tl_mutex_unlock(engine->lock);
+        tl_async_release(engine);
+    } else {
+        tl_mutex_lock(context->state_lock);
+        context->verify_interval_ms = verify_interval_ms;
+        tl_mutex_unlock(context->state_lock);
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 設定寫入不一致回呼
+ */
+TL_ERROR_CODE TL_SetMismatchCallback(TL_DEVICE_HANDLE device, TL_MismatchCallback callback, void* user_data)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_async_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    context->mismatch_callback = callback;
+    context->mismatch_user_data = user_data;
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 等待所有已送出命令的回應
+ */
+TL_ERROR_CODE TL_FlushWrites(TL_DEVICE_HANDLE device, unsigned long timeout_ms)
+{
+    TL_DeviceContext* context;
+    TL_AsyncEngine* engine;
+    TL_ERROR_CODE result;
+    unsigned long long deadline_us;
+    unsigned long long now_us;
+
+    result = tl_async_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 同步模式下沒有在途命令 */
+    engine = tl_async_acquire(context);
+    if (engine == NULL) {
+        return TL_SUCCESS;
+    }
+
+    /* 停止時接收執行緒會先完成所有在途命令，因此不需另外檢查 stopping */
+    deadline_us = tl_time_now_us() + (unsigned long long)timeout_ms * 1000;
+    tl_mutex_lock(engine->lock);
+    while (engine->count > 0) {
+        now_us = tl_time_now_us();
+        if (now_us >= deadline_us) {
+            break;
+        }
+        tl_cond_wait(engine->changed, engine->lock, (unsigned long)((deadline_us - now_us + 999) / 1000));
+    }
+    if (engine->count > 0) {
+        result = TL_ERROR_TIMEOUT;
+    } else {
+        result = engine->pending_error;
+        engine->pending_error = TL_SUCCESS;
+    }
+    tl_mutex_unlock(engine->lock);
+    tl_async_release(engine);
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/*
+ * 取得非同步寫入統計
+ */
+TL_ERROR_CODE TL_GetAsyncStats(TL_DEVICE_HANDLE device, TL_AsyncStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_AsyncEngine* engine;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_async_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    engine = tl_async_acquire(context);
+    if (engine != NULL) {
+        tl_mutex_lock(engine->lock);
+        *stats = context->async_stats;
+        stats->in_flight = engine->count;
+        tl_mutex_unlock(engine->lock);
+        tl_async_release(engine);
+    } else {
+        tl_mutex_lock(context->state_lock);
+        *stats = context->async_stats;
+        tl_mutex_unlock(context->state_lock);
+        stats->in_flight = 0;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 設定管線深度
+ */
+TL_ERROR_CODE TL_SetPipelineDepth(TL_DEVICE_HANDLE device, unsigned int depth)
+{
+    TL_DeviceContext* context = (device != NULL) ? device : tl_get_default_device();
+    TL_AsyncEngine* engine;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (depth == 0 || depth > TL_ASYNC_MAX_IN_FLIGHT) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    engine = context->async;
+    if (engine != NULL) {
+        /* 喚醒等待空位的呼叫端以套用新的深度 */
+        tl_mutex_lock(engine->lock);
+        context->pipeline_depth = depth;
+        tl_cond_broadcast(engine->changed);
+        tl_mutex_unlock(engine->lock);
+    } else {
+        context->pipeline_depth = depth;
+    }
+    return TL_SUCCESS;
+}
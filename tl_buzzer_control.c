@@ -19,14 +19,12 @@
 extern TL_InternalState* tl_get_internal_state(void);
 
 /*
- * 設定蜂鳴器狀態
+ * 設定蜂鳴器狀態 (指定裝置)
  */
-TL_ERROR_CODE TL_SetBuzzer(const TL_BuzzerStatus* status) {
-    TL_InternalState* state;
+static TL_ERROR_CODE tl_buzzer_set(TL_DeviceContext* device, const TL_BuzzerStatus* status) {
     TL_BYTE command[TL_MAX_BUFFER_SIZE];
     size_t command_length;
-    TL_BYTE response[TL_MAX_BUFFER_SIZE];
-    size_t response_length;
+    unsigned long long start_us;
     TL_ERROR_CODE result;
     
     /* 參數驗證 */
@@ -35,30 +33,58 @@ TL_ERROR_CODE TL_SetBuzzer(const TL_BuzzerStatus* status) {
         return TL_ERROR_INVALID_PARAMETER;
     }
     
-    /* 獲取內部狀態 */
-    state = tl_get_internal_state();
+    /* 構建設定命令 */
+    start_us = tl_trace_begin();
+    command_length = tl_cmd_build_buzzer_command(status, command, TL_MAX_BUFFER_SIZE);
+    tl_trace_end(TL_TRACE_BUILD, start_us, (unsigned int)command_length);
+    if (command_length == 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
     
-    /* 檢查函式庫是否已初始化 */
-    if (!state->is_initialized) {
-        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
-        return TL_ERROR_NOT_INITIALIZED;
+    /* 非同步模式先記錄影子狀態，背景驗證才不會把尚未確認的設定誤判為不一致 */
+    if (device->async != NULL) {
+        tl_shadow_update(device, TL_TARGET_BUZZER, NULL, status);
     }
     
-    /* 檢查裝置是否已開啟 */
-    if (!state->is_device_open) {
-        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
-        return TL_ERROR_DEVICE_NOT_OPEN;
+    /* 發送命令 (同步模式下並檢查回應，成功後才記錄影子狀態) */
+    result = tl_cmd_execute_set(device, TL_TARGET_BUZZER, command, command_length);
+    if (result == TL_SUCCESS && device->async == NULL) {
+        tl_shadow_update(device, TL_TARGET_BUZZER, NULL, status);
     }
+    tl_trace_end(TL_TRACE_SET_BUZZER, start_us, 0);
+    return result;
+}
+
+/*
+ * 獲取蜂鳴器狀態 (指定裝置)
+ */
+static TL_ERROR_CODE tl_buzzer_get(TL_DeviceContext* device, TL_BuzzerStatus* status) {
+    TL_BYTE command[TL_MAX_BUFFER_SIZE];
+    size_t command_length;
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    unsigned long long start_us;
+    TL_ERROR_CODE result;
     
-    /* 構建設定命令 */
-    command_length = tl_cmd_build_buzzer_command(status, command, TL_MAX_BUFFER_SIZE);
+    /* 參數驗證 */
+    if (status == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* 構建狀態讀取命令 - 使用固定值3表示讀取蜂鳴器狀態 */
+    start_us = tl_trace_begin();
+    command_length = tl_cmd_build_status_read_command(3, command, TL_MAX_BUFFER_SIZE);
+    tl_trace_end(TL_TRACE_BUILD, start_us, (unsigned int)command_length);
     if (command_length == 0) {
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
     
     /* 發送命令並接收回應 */
-    result = tl_cmd_send_and_receive(command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
+    result = tl_cmd_send_and_receive(device, command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
+    tl_trace_end(TL_TRACE_GET_BUZZER, start_us, 0);
     if (result != TL_SUCCESS) {
         return result;
     }
@@ -69,25 +95,24 @@ TL_ERROR_CODE TL_SetBuzzer(const TL_BuzzerStatus* status) {
         return result;
     }
     
+    /* 解析回應並填充狀態結構 */
+    result = tl_cmd_parse_buzzer_status(response, response_length, status);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 讀回的狀態即為裝置目前的狀態，並檢查裝置是否曾經重置 */
+    tl_tower_state_note(device, TL_TARGET_BUZZER, NULL, status);
+    tl_reset_note_read(device, TL_TARGET_BUZZER, NULL, status);
+    
     return TL_SUCCESS;
 }
 
 /*
- * 獲取蜂鳴器狀態
+ * 設定蜂鳴器狀態
  */
-TL_ERROR_CODE TL_GetBuzzerStatus(TL_BuzzerStatus* status) {
+TL_ERROR_CODE TL_SetBuzzer(const TL_BuzzerStatus* status) {
     TL_InternalState* state;
-    TL_BYTE command[TL_MAX_BUFFER_SIZE];
-    size_t command_length;
-    TL_BYTE response[TL_MAX_BUFFER_SIZE];
-    size_t response_length;
-    TL_ERROR_CODE result;
-    
-    /* 參數驗證 */
-    if (status == NULL) {
-        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
-        return TL_ERROR_INVALID_PARAMETER;
-    }
     
     /* 獲取內部狀態 */
     state = tl_get_internal_state();
@@ -104,45 +129,84 @@ TL_ERROR_CODE TL_GetBuzzerStatus(TL_BuzzerStatus* status) {
         return TL_ERROR_DEVICE_NOT_OPEN;
     }
     
-    /* 構建狀態讀取命令 - 使用固定值3表示讀取蜂鳴器狀態 */
-    command_length = tl_cmd_build_status_read_command(3, command, TL_MAX_BUFFER_SIZE);
-    if (command_length == 0) {
-        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
-        return TL_ERROR_INVALID_PARAMETER;
+    return tl_buzzer_set(&state->device, status);
+}
+
+/*
+ * 獲取蜂鳴器狀態
+ */
+TL_ERROR_CODE TL_GetBuzzerStatus(TL_BuzzerStatus* status) {
+    TL_InternalState* state;
+    
+    /* 獲取內部狀態 */
+    state = tl_get_internal_state();
+    
+    /* 檢查函式庫是否已初始化 */
+    if (!state->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
     }
     
-    /* 發送命令並接收回應 */
-    result = tl_cmd_send_and_receive(command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
-    if (result != TL_SUCCESS) {
-        return result;
+    /* 檢查裝置是否已開啟 */
+    if (!state->is_device_open) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
     }
     
-    /* 檢查回應格式 */
-    result = tl_cmd_check_response_format(response, response_length);
+    return tl_buzzer_get(&state->device, status);
+}
+
+/*
+ * 設定指定塔燈的蜂鳴器狀態
+ */
+TL_ERROR_CODE TL_DeviceSetBuzzer(TL_DEVICE_HANDLE device, const TL_BuzzerStatus* status) {
+    TL_ERROR_CODE result;
+    
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    result = tl_validate_device(device);
     if (result != TL_SUCCESS) {
         return result;
     }
     
-    /* 解析回應並填充狀態結構 */
-    result = tl_cmd_parse_buzzer_status(response, response_length, status);
+    return tl_buzzer_set(device, status);
+}
+
+/*
+ * 獲取指定塔燈的蜂鳴器狀態
+ */
+TL_ERROR_CODE TL_DeviceGetBuzzerStatus(TL_DEVICE_HANDLE device, TL_BuzzerStatus* status) {
+    TL_ERROR_CODE result;
+    
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    result = tl_validate_device(device);
     if (result != TL_SUCCESS) {
         return result;
     }
     
-    return TL_SUCCESS;
+    return tl_buzzer_get(device, status);
 }
 
 /*
  * 停止蜂鳴器
  */
 TL_ERROR_CODE TL_StopBuzzer(void) {
-    TL_BuzzerStatus status;
+    TL_InternalState* state;
+    
+    /* 獲取內部狀態 */
+    state = tl_get_internal_state();
     
-    /* 初始化狀態結構，設定蜂鳴器為關閉 */
-    status.tone = TL_BUZZER_TONE_HIGH;
-    status.volume = TL_BUZZER_VOLUME_MEDIUM;
-    status.pattern = TL_BUZZER_PATTERN_OFF;
+    /* 檢查函式庫是否已初始化 */
+    if (!state->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+    
+    /* 檢查裝置是否已開啟 */
+    if (!state->is_device_open) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
     
-    /* 通過設定命令停止蜂鳴器 */
-    return TL_SetBuzzer(&status);
+    /* 使用預先建構的停止命令，以緊急優先權插隊到其他命令之前 */
+    return tl_cmd_apply_emergency(&state->device, tl_cmd_get_emergency_frame(TL_COMMAND_STOP_BUZZER));
 }
\ No newline at end of file
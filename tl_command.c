@@ -15,9 +15,7 @@
 #include <string.h>
 #include "tl_internal.h"
 #include "tl_messages.h"
-
-/* 獲取內部狀態 - 使用外部聲明的函數 */
-extern TL_InternalState* tl_get_internal_state(void);
+#include "tl_probes.h"
 
 /*
  * 計算校驗和
@@ -105,6 +103,7 @@ size_t tl_cmd_build_led_command(TL_LAYER layer, const TL_LEDStatus* status,
     
     /* 返回總長度 */
     total_length = 11;
+    TL_PROBE_BUILD(buffer[1], total_length);
     return total_length;
 }
 
@@ -162,6 +161,7 @@ size_t tl_cmd_build_buzzer_command(const TL_BuzzerStatus* status,
     
     /* 返回總長度 */
     total_length = 9;
+    TL_PROBE_BUILD(buffer[1], total_length);
     return total_length;
 }
 
@@ -210,13 +210,14 @@ size_t tl_cmd_build_status_read_command(TL_BYTE type, TL_BYTE* buffer, size_t bu
     
     /* 返回總長度 */
     total_length = 7;
+    TL_PROBE_BUILD(buffer[1], total_length);
     return total_length;
 }
 
 /*
- * 檢查回應格式
+ * 驗證回應的起始符、長度、校驗和、結束符與ACK
  */
-TL_ERROR_CODE tl_cmd_check_response_format(const TL_BYTE* response, size_t response_length) {
+static TL_ERROR_CODE tl_cmd_validate_response(const TL_BYTE* response, size_t response_length) {
     TL_BYTE calculated_checksum;
     TL_WORD data_length;
     size_t expected_length;
@@ -269,6 +270,16 @@ TL_ERROR_CODE tl_cmd_check_response_format(const TL_BYTE* response, size_t respo
     return TL_SUCCESS;
 }
 
+/*
+ * 檢查回應格式
+ */
+TL_ERROR_CODE tl_cmd_check_response_format(const TL_BYTE* response, size_t response_length) {
+    TL_ERROR_CODE result = tl_cmd_validate_response(response, response_length);
+    
+    TL_PROBE_PARSE((response != NULL && response_length >= 2) ? response[1] : 0, response_length, result);
+    return result;
+}
+
 /*
  * 解析LED狀態回應
  */
@@ -357,52 +368,58 @@ TL_ERROR_CODE tl_cmd_parse_buzzer_status(const TL_BYTE* response, size_t respons
 }
 
 /*
- * 發送命令並接收回應
+ * 讀取失敗時觸發逾時或錯誤追蹤點
  */
-TL_ERROR_CODE tl_cmd_send_and_receive(const TL_BYTE* command, size_t command_length,
+static void tl_cmd_probe_read_failure(TL_DeviceContext* device, TL_ERROR_CODE result, unsigned long timeout_ms) {
+    /* 追蹤點編譯為空時參數不會被使用 */
+    (void)device;
+    (void)timeout_ms;
+    if (result == TL_ERROR_TIMEOUT) {
+        TL_PROBE_TIMEOUT(device, timeout_ms);
+    } else {
+        TL_PROBE_ERROR(device, result);
+    }
+}
+
+/*
+ * 接收一個完整回應
+ */
+TL_ERROR_CODE tl_cmd_receive_response(TL_DeviceContext* device,
                                      TL_BYTE* response, size_t response_size,
-                                     size_t* response_length) {
-    TL_InternalState* state;
+                                     size_t* response_length, unsigned long timeout_ms) {
     TL_ERROR_CODE result;
-    int timeout_counter = 0;
     size_t received_header_size = 0;
-    size_t received_data_size = 0;
     TL_BYTE header_buffer[4];
     size_t bytes_read;
     size_t total_data_size = 0;
+    unsigned long long deadline_us;
+    unsigned long long now_us;
+    unsigned long long start_us;
+    unsigned long remaining_ms;
     
-    /* 參數驗證 */
-    if (command == NULL || command_length == 0 || response == NULL || 
-        response_size < 6 || response_length == NULL) {
-        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
-        return TL_ERROR_INVALID_PARAMETER;
-    }
-    
-    /* 獲取內部狀態 */
-    state = tl_get_internal_state();
+    deadline_us = tl_time_now_us() + (unsigned long long)timeout_ms * 1000;
     
-    /* 檢查裝置是否已開啟 */
-    if (state->device_handle == NULL || state->interface_handle == NULL) {
-        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
-        return TL_ERROR_DEVICE_NOT_OPEN;
-    }
-    
-    /* 發送命令 */
-    result = tl_usb_write_data(TL_PIPE_ID, command, command_length);
-    if (result != TL_SUCCESS) {
-        return result;
-    }
-    
-    /* 接收回應 */
     /* 首先讀取回應頭部 (4位元組) */
     *response_length = 0;
     
     while (1) {
+        /* 檢查逾時 */
+        now_us = tl_time_now_us();
+        if (now_us >= deadline_us) {
+            TL_PROBE_TIMEOUT(device, timeout_ms);
+            tl_set_last_error(TL_ERROR_TIMEOUT);
+            return TL_ERROR_TIMEOUT;
+        }
+        remaining_ms = (unsigned long)((deadline_us - now_us + 999) / 1000);
+        
         /* 讀取頭部 */
         if (received_header_size < 4) {
-            result = tl_usb_read_data(TL_RESPONSE_PIPE, header_buffer + received_header_size, 
-                                    4 - received_header_size, &bytes_read);
+            start_us = tl_trace_begin();
+            result = tl_usb_read_data(device, TL_RESPONSE_PIPE, header_buffer + received_header_size, 
+                                    4 - received_header_size, &bytes_read, remaining_ms);
+            tl_trace_end(TL_TRACE_READ_HEADER, start_us, (result == TL_SUCCESS) ? (unsigned int)bytes_read : 0);
             if (result != TL_SUCCESS) {
+                tl_cmd_probe_read_failure(device, result, timeout_ms);
                 return result;
             }
             
@@ -425,10 +442,13 @@ TL_ERROR_CODE tl_cmd_send_and_receive(const TL_BYTE* command, size_t command_len
         }
         
         /* 讀取數據部分 */
-        if (received_header_size == 4 && total_data_size > 0) {
-            result = tl_usb_read_data(TL_RESPONSE_PIPE, response + *response_length, 
-                                    total_data_size, &bytes_read);
+        else {
+            start_us = tl_trace_begin();
+            result = tl_usb_read_data(device, TL_RESPONSE_PIPE, response + *response_length, 
+                                    4 + total_data_size - *response_length, &bytes_read, remaining_ms);
+            tl_trace_end(TL_TRACE_READ_BODY, start_us, (result == TL_SUCCESS) ? (unsigned int)bytes_read : 0);
             if (result != TL_SUCCESS) {
+                tl_cmd_probe_read_failure(device, result, timeout_ms);
                 return result;
             }
             
@@ -451,17 +471,799 @@ TL_ERROR_CODE tl_cmd_send_and_receive(const TL_BYTE* command, size_t command_len
             }
         }
         
-        /* 檢查逾時 */
-        timeout_counter++;
-        if (timeout_counter >= TL_READ_TIMEOUT / 10) { /* 10毫秒一次檢查，共檢查TL_READ_TIMEOUT/10次 */
-            tl_set_last_error(TL_ERROR_TIMEOUT);
-            return TL_ERROR_TIMEOUT;
+        /* 沒有收到資料時短暫等待後再次嘗試 */
+        if (bytes_read == 0) {
+            tl_delay_ms(1);
+        }
+    }
+}
+
+/*
+ * 發送命令並接收一個完整回應 (單次嘗試)
+ *
+ * 寫入與讀取共用同一個期限，讀取只等待剩餘時間。
+ */
+static TL_ERROR_CODE tl_cmd_transact_once(TL_DeviceContext* device,
+                                          const TL_BYTE* command, size_t command_length,
+                                          TL_BYTE* response, size_t response_size,
+                                          size_t* response_length, unsigned long timeout_ms) {
+    TL_ERROR_CODE result;
+    unsigned long long deadline_us;
+    unsigned long long now_us;
+    
+    deadline_us = tl_time_now_us() + (unsigned long long)timeout_ms * 1000;
+    
+    /* 發送命令 */
+    result = tl_usb_write_data(device, TL_PIPE_ID, command, command_length, timeout_ms);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 接收回應 */
+    now_us = tl_time_now_us();
+    if (now_us >= deadline_us) {
+        tl_set_last_error(TL_ERROR_TIMEOUT);
+        return TL_ERROR_TIMEOUT;
+    }
+    return tl_cmd_receive_response(device, response, response_size, response_length,
+                                   (unsigned long)((deadline_us - now_us + 999) / 1000));
+}
+
+/*
+ * 在持有 io_lock 時發送命令並接收回應，逾時後重新同步並重試一次
+ */
+static TL_ERROR_CODE tl_cmd_transact_locked(TL_DeviceContext* device,
+                                            const TL_BYTE* command, size_t command_length,
+                                            TL_BYTE* response, size_t response_size,
+                                            size_t* response_length) {
+    TL_ERROR_CODE result;
+    unsigned long long start_us;
+    unsigned long long elapsed_us;
+    TL_BOOL reopened = TL_FALSE;
+    int attempt;
+    
+    for (attempt = 0; ; attempt++) {
+        start_us = tl_time_now_us();
+        result = tl_cmd_transact_once(device, command, command_length, response, response_size,
+                                      response_length, tl_rtt_timeout_ms(device));
+        elapsed_us = tl_time_now_us() - start_us;
+        tl_health_record(device, result, elapsed_us);
+        
+        /* USB傳輸失敗可能是裝置斷電後重新列舉，重新開啟成功時還原狀態並重試一次 */
+        if ((result == TL_ERROR_WRITE_FAILED || result == TL_ERROR_READ_FAILED) && !reopened) {
+            reopened = TL_TRUE;
+            if (tl_reset_on_io_failure(device)) {
+                attempt--;
+                continue;
+            }
+        }
+        
+        if (result == TL_SUCCESS) {
+            /* 重試的樣本無法判斷對應哪一次發送 (Karn 演算法)，不列入估計 */
+            if (attempt == 0) {
+                tl_rtt_add_sample(device, elapsed_us);
+            } else {
+                tl_rtt_on_recovered(device);
+            }
+            return TL_SUCCESS;
+        }
+        
+        if (result != TL_ERROR_TIMEOUT) {
+            return result;
+        }
+        
+        /* 逾時：加倍下一次的逾時，重新同步管道後重試一次 */
+        tl_rtt_on_timeout(device);
+        if (attempt >= 1 || !tl_rtt_begin_retry(device)) {
+            break;
+        }
+        if (tl_usb_resync(device) != TL_SUCCESS) {
+            break;
+        }
+    }
+    
+    tl_set_last_error(TL_ERROR_TIMEOUT);
+    return TL_ERROR_TIMEOUT;
+}
+
+/*
+ * 連續寫出多個命令後依序接收各自的回應 (呼叫端須持有 io_lock)
+ */
+static TL_ERROR_CODE tl_cmd_transact_batch_once(TL_DeviceContext* device, size_t count,
+                                                const TL_BYTE* const* commands, const size_t* command_lengths,
+                                                TL_BYTE* const* responses, size_t response_size,
+                                                size_t* response_lengths, unsigned long timeout_ms) {
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_ERROR_CODE response_result;
+    size_t written;
+    size_t i;
+    
+    for (written = 0; written < count; written++) {
+        result = tl_usb_write_data(device, TL_PIPE_ID, commands[written], command_lengths[written], timeout_ms);
+        if (result != TL_SUCCESS) {
+            break;
+        }
+    }
+    
+    /* 已寫出的命令都會有回應，先收完再回報寫出錯誤 */
+    for (i = 0; i < written; i++) {
+        response_result = tl_cmd_receive_response(device, response, TL_MAX_BUFFER_SIZE, &response_length, timeout_ms);
+        if (response_result == TL_SUCCESS && response_length > response_size) {
+            response_result = TL_ERROR_INVALID_PARAMETER;
+        }
+        if (response_result != TL_SUCCESS) {
+            /* 丟棄其餘的回應，避免下一個命令讀到過期的回應 */
+            tl_usb_resync(device);
+            tl_set_last_error(response_result);
+            return response_result;
+        }
+        memcpy(responses[i], response, response_length);
+        response_lengths[i] = response_length;
+    }
+    
+    return result;
+}
+
+/* 呼叫執行緒的命令送出期限 (微秒)，0 表示不限 */
+static TL_THREAD_LOCAL unsigned long long g_thread_deadline_us = 0;
+
+/*
+ * 設定呼叫執行緒的命令送出期限
+ */
+unsigned long long tl_cmd_set_thread_deadline(unsigned long long deadline_us) {
+    unsigned long long previous = g_thread_deadline_us;
+    
+    g_thread_deadline_us = deadline_us;
+    return previous;
+}
+
+/*
+ * 一般命令進入通道
+ *
+ * 有緊急命令尚未完成時先等待；同步模式下並取得 io_lock。取得 io_lock 後
+ * 若又有緊急命令到達則讓出，使緊急命令只需等待進行中的那一次往返。
+ * target 不為負時，若其在 seq 之後被緊急命令涵蓋則不送出。
+ *
+ * 返回值：TL_SUCCESS 表示可送出，TL_ERROR_SUPERSEDED 表示已被取代
+ */
+static TL_ERROR_CODE tl_cmd_lane_enter(TL_DeviceContext* device, int target, unsigned long seq) {
+    TL_BOOL take_io = (device->async == NULL) ? TL_TRUE : TL_FALSE;
+    
+    for (;;) {
+        tl_mutex_lock(device->lane_lock);
+        while (device->emergency_waiting > 0) {
+            tl_cond_wait(device->lane_changed, device->lane_lock, TL_WAIT_INFINITE);
+        }
+        tl_mutex_unlock(device->lane_lock);
+        
+        if (take_io) {
+            tl_mutex_lock(device->io_lock);
+        }
+        
+        tl_mutex_lock(device->lane_lock);
+        if (device->emergency_waiting == 0) {
+            if (target >= 0 && device->supersede_seq[target] != seq) {
+                device->priority_stats.superseded_count++;
+                tl_mutex_unlock(device->lane_lock);
+                if (take_io) {
+                    tl_mutex_unlock(device->io_lock);
+                }
+                tl_set_last_error(TL_ERROR_SUPERSEDED);
+                return TL_ERROR_SUPERSEDED;
+            }
+            tl_mutex_unlock(device->lane_lock);
+            return TL_SUCCESS;
+        }
+        tl_mutex_unlock(device->lane_lock);
+        
+        if (take_io) {
+            tl_mutex_unlock(device->io_lock);
+        }
+    }
+}
+
+/*
+ * 一般命令離開通道
+ */
+static void tl_cmd_lane_leave(TL_DeviceContext* device) {
+    if (device->async == NULL) {
+        tl_mutex_unlock(device->io_lock);
+    }
+}
+
+/*
+ * 發送命令並接收回應
+ */
+TL_ERROR_CODE tl_cmd_send_and_receive(TL_DeviceContext* device,
+                                     const TL_BYTE* command, size_t command_length,
+                                     TL_BYTE* response, size_t response_size,
+                                     size_t* response_length) {
+    TL_ERROR_CODE result;
+    unsigned long long start_us;
+    
+    /* 參數驗證 */
+    if (device == NULL || command == NULL || command_length == 0 || response == NULL || 
+        response_size < 6 || response_length == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* 檢查裝置是否已開啟 */
+    if (device->device_handle == NULL || device->interface_handle == NULL) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    
+    /* 讀取命令不會被取代，只需讓緊急命令先行 */
+    start_us = tl_trace_begin();
+    tl_rate_acquire(device);
+    tl_cmd_lane_enter(device, -1, 0);
+    tl_trace_end(TL_TRACE_QUEUE, start_us, 0);
+    
+    /* 非同步模式下所有命令都經由引擎的佇列，以保持回應順序 */
+    start_us = tl_trace_begin();
+    if (device->async != NULL) {
+        result = tl_async_transact(device->async, command, command_length,
+                                   response, response_size, response_length);
+        tl_trace_end(TL_TRACE_TRANSACT, start_us, (unsigned int)result);
+        return result;
+    }
+    
+    result = tl_cmd_transact_locked(device, command, command_length,
+                                    response, response_size, response_length);
+    tl_cmd_lane_leave(device);
+    tl_trace_end(TL_TRACE_TRANSACT, start_us, (unsigned int)result);
+    return result;
+}
+
+/*
+ * 連續送出多個命令並接收各自的回應
+ */
+TL_ERROR_CODE tl_cmd_send_and_receive_batch(TL_DeviceContext* device, size_t count,
+                                           const TL_BYTE* const* commands, const size_t* command_lengths,
+                                           TL_BYTE* const* responses, size_t response_size,
+                                           size_t* response_lengths) {
+    TL_ERROR_CODE result;
+    TL_BOOL reopened = TL_FALSE;
+    size_t i;
+    int attempt;
+    
+    /* 參數驗證 */
+    if (device == NULL || commands == NULL || command_lengths == NULL || responses == NULL ||
+        response_lengths == NULL || count == 0 || count > TL_BATCH_MAX_COMMANDS || response_size < 6) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* 檢查裝置是否已開啟 */
+    if (device->device_handle == NULL || device->interface_handle == NULL) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    
+    /* 每個命令各自取得速率限制的權杖 */
+    for (i = 0; i < count; i++) {
+        tl_rate_acquire(device);
+    }
+    tl_cmd_lane_enter(device, -1, 0);
+    
+    if (device->async != NULL) {
+        return tl_async_transact_batch(device->async, count, commands, command_lengths,
+                                       responses, response_size, response_lengths);
+    }
+    
+    /* 整批的往返時間不是單一命令的樣本，不列入估計 */
+    for (attempt = 0; ; attempt++) {
+        result = tl_cmd_transact_batch_once(device, count, commands, command_lengths, responses,
+                                            response_size, response_lengths, tl_rtt_timeout_ms(device));
+        tl_health_record(device, result, 0);
+        
+        /* USB傳輸失敗可能是裝置斷電後重新列舉，重新開啟成功時還原狀態並重試一次 */
+        if ((result == TL_ERROR_WRITE_FAILED || result == TL_ERROR_READ_FAILED) && !reopened) {
+            reopened = TL_TRUE;
+            if (tl_reset_on_io_failure(device)) {
+                attempt--;
+                continue;
+            }
+        }
+        
+        if (result == TL_SUCCESS) {
+            if (attempt > 0) {
+                tl_rtt_on_recovered(device);
+            }
+            break;
+        }
+        
+        if (result != TL_ERROR_TIMEOUT) {
+            break;
+        }
+        
+        /* 逾時：加倍下一次的逾時，管道已重新同步，重試一次 */
+        tl_rtt_on_timeout(device);
+        if (attempt >= 1 || !tl_rtt_begin_retry(device)) {
+            break;
+        }
+    }
+    
+    tl_cmd_lane_leave(device);
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/*
+ * 執行設定命令
+ */
+TL_ERROR_CODE tl_cmd_execute_set(TL_DeviceContext* device, int target,
+                                const TL_BYTE* command, size_t command_length) {
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE result;
+    unsigned long seq;
+    unsigned long long start_us;
+    
+    /* 檢查裝置是否已開啟 */
+    if (device->device_handle == NULL || device->interface_handle == NULL) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    
+    /* 記錄呼叫當時的取代序號，之後到達的緊急命令會使此命令不送出 */
+    tl_mutex_lock(device->lane_lock);
+    seq = device->supersede_seq[target];
+    tl_mutex_unlock(device->lane_lock);
+    
+    /* 等待速率限制的權杖；期間到達的緊急命令仍會取代此命令 */
+    start_us = tl_trace_begin();
+    tl_rate_acquire(device);
+    result = tl_cmd_lane_enter(device, target, seq);
+    tl_trace_end(TL_TRACE_QUEUE, start_us, 0);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 等待裝置期間已超過期限的命令不再送出 */
+    if (g_thread_deadline_us != 0 && tl_time_now_us() > g_thread_deadline_us) {
+        tl_cmd_lane_leave(device);
+        tl_set_last_error(TL_ERROR_EXPIRED);
+        return TL_ERROR_EXPIRED;
+    }
+    
+    /* 管線模式：經由引擎的佇列送出並等待自己的回應，其他執行緒的命令可同時在途 */
+    start_us = tl_trace_begin();
+    if (device->async != NULL && device->write_mode == TL_WRITE_MODE_PIPELINED) {
+        result = tl_async_transact(device->async, command, command_length,
+                                   response, TL_MAX_BUFFER_SIZE, &response_length);
+        tl_trace_end(TL_TRACE_TRANSACT, start_us, (unsigned int)result);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        return tl_cmd_check_response_format(response, response_length);
+    }
+    
+    /* 非同步模式：寫出後即返回，回應由背景執行緒驗證 */
+    if (device->async != NULL) {
+        result = tl_async_send(device->async, target, command, command_length);
+        tl_trace_end(TL_TRACE_ASYNC_SUBMIT, start_us, (unsigned int)result);
+        return result;
+    }
+    
+    /* 發送命令並接收回應 */
+    result = tl_cmd_transact_locked(device, command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
+    tl_cmd_lane_leave(device);
+    tl_trace_end(TL_TRACE_TRANSACT, start_us, (unsigned int)result);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 檢查回應格式 */
+    return tl_cmd_check_response_format(response, response_length);
+}
+
+/*
+ * 預先建構塔燈畫面的設定命令
+ */
+TL_ERROR_CODE tl_cmd_prepare_frame(const TL_TowerFrame* frame, TL_PreparedFrame* prepared) {
+    int target;
+    
+    /* 參數驗證 */
+    if (frame == NULL || prepared == NULL || (frame->target_mask & ~(unsigned int)TL_FRAME_ALL) != 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    memset(prepared, 0, sizeof(*prepared));
+    prepared->frame = *frame;
+    
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(frame->target_mask & (1u << target))) {
+            continue;
+        }
+        
+        if (target == TL_TARGET_BUZZER) {
+            prepared->lengths[target] = tl_cmd_build_buzzer_command(&frame->buzzer,
+                prepared->commands[target], TL_SET_COMMAND_SIZE);
+        } else {
+            prepared->lengths[target] = tl_cmd_build_led_command((TL_LAYER)target, &frame->layers[target],
+                prepared->commands[target], TL_SET_COMMAND_SIZE);
         }
         
-        /* 短暫等待後再次嘗試 */
-        tl_delay_ms(10);
+        if (prepared->lengths[target] == 0) {
+            tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+            return TL_ERROR_INVALID_PARAMETER;
+        }
     }
     
-    /* 理論上不應該執行到這裡 */
-    return TL_ERROR_GENERAL;
+    return TL_SUCCESS;
+}
+
+/*
+ * 以畫面中的目標更新影子狀態
+ */
+static void tl_cmd_note_frame_target(TL_DeviceContext* device, const TL_PreparedFrame* prepared, int target) {
+    if (target == TL_TARGET_BUZZER) {
+        tl_shadow_update(device, target, NULL, &prepared->frame.buzzer);
+    } else {
+        tl_shadow_update(device, target, &prepared->frame.layers[target], NULL);
+    }
+}
+
+/*
+ * 將預先建構的塔燈畫面套用到裝置
+ *
+ * 同步模式下確認送出成功後才更新影子狀態：送出時裝置重新列舉而還原的是
+ * 之前已確認的狀態，送出失敗的設定也不會被當成裝置目前的狀態。
+ * 非同步模式的背景驗證以影子狀態比對讀回的狀態，須在寫出前更新。
+ */
+TL_ERROR_CODE tl_cmd_apply_frame(TL_DeviceContext* device, const TL_PreparedFrame* prepared) {
+    TL_ERROR_CODE result;
+    TL_BOOL note_first = (device->async != NULL) ? TL_TRUE : TL_FALSE;
+    int target;
+    
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (prepared->lengths[target] == 0) {
+            continue;
+        }
+        
+        if (note_first) {
+            tl_cmd_note_frame_target(device, prepared, target);
+        }
+        result = tl_cmd_execute_set(device, target, prepared->commands[target], prepared->lengths[target]);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        if (!note_first) {
+            tl_cmd_note_frame_target(device, prepared, target);
+        }
+    }
+    
+    return TL_SUCCESS;
+}
+
+/*
+ * 在持有 io_lock 時讀取單一目標的狀態
+ */
+TL_ERROR_CODE tl_cmd_read_status_locked(TL_DeviceContext* device, int target,
+                                        TL_LEDStatus* led, TL_BuzzerStatus* buzzer) {
+    TL_BYTE command[TL_MAX_BUFFER_SIZE];
+    size_t command_length;
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE result;
+    
+    command_length = tl_cmd_build_status_read_command((TL_BYTE)target, command, TL_MAX_BUFFER_SIZE);
+    if (command_length == 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    result = tl_cmd_transact_once(device, command, command_length, response, TL_MAX_BUFFER_SIZE,
+                                  &response_length, tl_rtt_timeout_ms(device));
+    if (result == TL_ERROR_TIMEOUT) {
+        /* 丟棄遲到的回應，避免接下來的命令讀到 */
+        tl_usb_resync(device);
+    }
+    if (result == TL_SUCCESS) {
+        result = tl_cmd_check_response_format(response, response_length);
+    }
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    if (target == TL_TARGET_BUZZER) {
+        return tl_cmd_parse_buzzer_status(response, response_length, buzzer);
+    }
+    return tl_cmd_parse_led_status(response, response_length, led);
+}
+
+/*
+ * 以一次連續寫出重新送出塔燈畫面
+ */
+TL_ERROR_CODE tl_cmd_restore_frame(TL_DeviceContext* device, const TL_PreparedFrame* prepared,
+                                   TL_BOOL io_locked) {
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_ERROR_CODE response_result;
+    unsigned long timeout_ms;
+    int written = 0;
+    int target;
+    
+    /* 非同步模式：寫入引擎本身就不等待回應 */
+    if (device->async != NULL) {
+        for (target = 0; target < TL_TARGET_COUNT && result == TL_SUCCESS; target++) {
+            if (prepared->lengths[target] != 0) {
+                result = tl_async_send(device->async, target, prepared->commands[target], prepared->lengths[target]);
+            }
+        }
+        return result;
+    }
+    
+    if (!io_locked) {
+        tl_mutex_lock(device->io_lock);
+    }
+    
+    /* 先寫出所有設定命令，再依序接收各自的回應 */
+    timeout_ms = tl_rtt_timeout_ms(device);
+    for (target = 0; target < TL_TARGET_COUNT && result == TL_SUCCESS; target++) {
+        if (prepared->lengths[target] == 0) {
+            continue;
+        }
+        result = tl_usb_write_data(device, TL_PIPE_ID, prepared->commands[target], prepared->lengths[target], timeout_ms);
+        if (result == TL_SUCCESS) {
+            written++;
+        }
+    }
+    for (; written > 0; written--) {
+        response_result = tl_cmd_receive_response(device, response, TL_MAX_BUFFER_SIZE, &response_length, timeout_ms);
+        if (response_result == TL_SUCCESS) {
+            response_result = tl_cmd_check_response_format(response, response_length);
+        }
+        if (response_result != TL_SUCCESS) {
+            if (result == TL_SUCCESS) {
+                result = response_result;
+            }
+            /* 丟棄其餘的回應，避免下一個命令讀到過期的回應 */
+            tl_usb_resync(device);
+            break;
+        }
+    }
+    
+    tl_health_record(device, result, 0);
+    
+    if (!io_locked) {
+        tl_mutex_unlock(device->io_lock);
+    }
+    
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/* 預先建構的緊急畫面 */
+static TL_PreparedFrame g_tl_clear_frame;
+static TL_PreparedFrame g_tl_stop_buzzer_frame;
+
+/*
+ * 建構緊急命令使用的預先建構畫面
+ */
+TL_ERROR_CODE tl_cmd_init_emergency_frames(void) {
+    TL_TowerFrame frame;
+    TL_ERROR_CODE result;
+    
+    /* 全部關閉的畫面，停止蜂鳴器時只套用蜂鳴器 */
+    memset(&frame, 0, sizeof(frame));
+    frame.buzzer.tone = TL_BUZZER_TONE_HIGH;
+    frame.buzzer.volume = TL_BUZZER_VOLUME_MEDIUM;
+    frame.buzzer.pattern = TL_BUZZER_PATTERN_OFF;
+    
+    frame.target_mask = TL_FRAME_ALL;
+    result = tl_cmd_prepare_frame(&frame, &g_tl_clear_frame);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    frame.target_mask = TL_FRAME_BUZZER;
+    return tl_cmd_prepare_frame(&frame, &g_tl_stop_buzzer_frame);
+}
+
+/*
+ * 取得預先建構的緊急畫面
+ */
+const TL_PreparedFrame* tl_cmd_get_emergency_frame(TL_COMMAND_TYPE type) {
+    switch (type) {
+    case TL_COMMAND_CLEAR:
+        return &g_tl_clear_frame;
+    case TL_COMMAND_STOP_BUZZER:
+        return &g_tl_stop_buzzer_frame;
+    default:
+        return NULL;
+    }
+}
+
+/* 緊急畫面的寫出順序：蜂鳴器最先，再依序三層LED */
+static const int g_tl_emergency_order[TL_TARGET_COUNT] = {
+    TL_TARGET_BUZZER, TL_LAYER_ONE, TL_LAYER_TWO, TL_LAYER_THREE
+};
+
+/*
+ * 連續寫出緊急畫面的所有目標後依序接收回應 (呼叫端須持有 io_lock)
+ *
+ * 確認成功的目標即更新影子狀態。
+ *
+ * 參數：wire_end_us 用於儲存最後一個命令寫出的時間
+ * 返回值：TL_SUCCESS 表示所有目標都已確認，其他值表示錯誤碼
+ */
+static TL_ERROR_CODE tl_cmd_emergency_burst_once(TL_DeviceContext* device, const TL_PreparedFrame* prepared,
+                                                 unsigned long long* wire_end_us) {
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_ERROR_CODE response_result;
+    unsigned long timeout_ms = tl_rtt_timeout_ms(device);
+    int written[TL_TARGET_COUNT];
+    int count = 0;
+    int target;
+    int i;
+    
+    for (i = 0; i < TL_TARGET_COUNT && result == TL_SUCCESS; i++) {
+        target = g_tl_emergency_order[i];
+        if (prepared->lengths[target] == 0) {
+            continue;
+        }
+        result = tl_usb_write_data(device, TL_PIPE_ID, prepared->commands[target], prepared->lengths[target], timeout_ms);
+        if (result == TL_SUCCESS) {
+            written[count++] = target;
+        }
+    }
+    *wire_end_us = tl_time_now_us();
+    
+    /* 已寫出的命令都會有回應，先收完再回報寫出錯誤 */
+    for (i = 0; i < count; i++) {
+        response_result = tl_cmd_receive_response(device, response, TL_MAX_BUFFER_SIZE, &response_length, timeout_ms);
+        if (response_result == TL_SUCCESS) {
+            response_result = tl_cmd_check_response_format(response, response_length);
+        }
+        if (response_result != TL_SUCCESS) {
+            /* 丟棄其餘的回應，避免下一個命令讀到過期的回應 */
+            tl_usb_resync(device);
+            return response_result;
+        }
+        tl_cmd_note_frame_target(device, prepared, written[i]);
+    }
+    return result;
+}
+
+/*
+ * 以緊急優先權套用塔燈畫面
+ *
+ * 暫停一般命令後，蜂鳴器最先、所有目標連續寫出，再收回應 (與 tl_cmd_restore_frame 相同)；
+ * 寫出時間記錄到最後一個命令寫出為止。
+ */
+TL_ERROR_CODE tl_cmd_apply_emergency(TL_DeviceContext* device, const TL_PreparedFrame* prepared) {
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_BOOL reopened = TL_FALSE;
+    unsigned long long start_us;
+    unsigned long long wire_end_us;
+    unsigned long long wire_us;
+    int attempt;
+    int target;
+    int i;
+    
+    /* 檢查裝置是否已開啟 */
+    if (device->device_handle == NULL || device->interface_handle == NULL) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    
+    start_us = tl_time_now_us();
+    
+    /* 暫停一般命令，並使尚未送出的被涵蓋命令失效 */
+    tl_mutex_lock(device->lane_lock);
+    device->emergency_waiting++;
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (prepared->lengths[target] != 0) {
+            device->supersede_seq[target]++;
+        }
+    }
+    tl_mutex_unlock(device->lane_lock);
+    
+    if (device->async != NULL) {
+        /* 非同步模式：寫入引擎本身就不等待回應，背景驗證以影子狀態比對，須在寫出前更新 */
+        for (i = 0; i < TL_TARGET_COUNT && result == TL_SUCCESS; i++) {
+            target = g_tl_emergency_order[i];
+            if (prepared->lengths[target] != 0) {
+                tl_cmd_note_frame_target(device, prepared, target);
+                result = tl_async_send(device->async, target, prepared->commands[target], prepared->lengths[target]);
+            }
+        }
+        wire_end_us = tl_time_now_us();
+    } else {
+        /* 同步模式下只需等待進行中的那一次往返 */
+        tl_mutex_lock(device->io_lock);
+        for (attempt = 0; ; attempt++) {
+            result = tl_cmd_emergency_burst_once(device, prepared, &wire_end_us);
+            tl_health_record(device, result, 0);
+            
+            /* USB傳輸失敗可能是裝置斷電後重新列舉，重新開啟成功時還原狀態並重試一次 */
+            if ((result == TL_ERROR_WRITE_FAILED || result == TL_ERROR_READ_FAILED) && !reopened) {
+                reopened = TL_TRUE;
+                if (tl_reset_on_io_failure(device)) {
+                    attempt--;
+                    continue;
+                }
+            }
+            if (result == TL_SUCCESS) {
+                if (attempt > 0) {
+                    tl_rtt_on_recovered(device);
+                }
+                break;
+            }
+            if (result != TL_ERROR_TIMEOUT) {
+                break;
+            }
+            
+            /* 逾時：加倍下一次的逾時，管道已重新同步，重試一次 */
+            tl_rtt_on_timeout(device);
+            if (attempt >= 1 || !tl_rtt_begin_retry(device)) {
+                break;
+            }
+        }
+        tl_mutex_unlock(device->io_lock);
+    }
+    wire_us = wire_end_us - start_us;
+    
+    /* 恢復一般命令並記錄統計 */
+    tl_mutex_lock(device->lane_lock);
+    device->emergency_waiting--;
+    device->priority_stats.emergency_count++;
+    device->priority_stats.last_wire_us = wire_us;
+    device->priority_stats.total_wire_us += wire_us;
+    if (wire_us > device->priority_stats.max_wire_us) {
+        device->priority_stats.max_wire_us = wire_us;
+    }
+    tl_cond_broadcast(device->lane_changed);
+    tl_mutex_unlock(device->lane_lock);
+    
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/*
+ * 記錄被取代的一般命令數
+ */
+void tl_cmd_note_superseded(TL_DeviceContext* device, unsigned long count) {
+    tl_mutex_lock(device->lane_lock);
+    device->priority_stats.superseded_count += count;
+    tl_mutex_unlock(device->lane_lock);
+}
+
+/*
+ * 取得緊急通道統計
+ */
+TL_ERROR_CODE TL_GetPriorityStats(TL_DEVICE_HANDLE device, TL_PriorityStats* stats) {
+    TL_DeviceContext* context = (device != NULL) ? device : tl_get_default_device();
+    TL_ERROR_CODE result;
+    
+    /* 參數驗證 */
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    tl_mutex_lock(context->lane_lock);
+    *stats = context->priority_stats;
+    tl_mutex_unlock(context->lane_lock);
+    return TL_SUCCESS;
 }
@@ -19,45 +19,29 @@
 #endif
 
 #include "tl_internal.h"
+#include "tl_messages.h"
+#include "tl_probes.h"
+
+/* 錯誤訊息 - 由 tl_error.c 依訊息目錄提供 */
+extern TL_ERROR_CODE tl_get_error_message(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size);
 
  /* 全局狀態變數 */
 static TL_InternalState g_tl_state = {
     TL_FALSE,  /* is_initialized */
     TL_FALSE,  /* is_device_open */
-    NULL,      /* device_handle */
-    NULL,      /* interface_handle */
+    { 0 },     /* device */
+    NULL,      /* devices_lock */
+    NULL,      /* extra_devices */
+    NULL,      /* groups */
     TL_SUCCESS /* last_error */
 };
 
-/*
- * 錯誤訊息表 (若你有自己的 tl_messages.c 系統，也可以不用這裡)
- * 這裡只是示範簡單對應。
- */
-static const char* g_error_messages[] = {
-    "操作成功",                        /* TL_SUCCESS */
-    "一般錯誤",                        /* TL_ERROR_GENERAL */
-    "函式庫未初始化",                  /* TL_ERROR_NOT_INITIALIZED */
-    "函式庫已初始化",                  /* TL_ERROR_ALREADY_INITIALIZED */
-    "找不到塔燈裝置",                  /* TL_ERROR_DEVICE_NOT_FOUND */
-    "無法開啟塔燈裝置",                /* TL_ERROR_DEVICE_OPEN_FAILED */
-    "塔燈裝置未開啟",                  /* TL_ERROR_DEVICE_NOT_OPEN */
-    "寫入操作失敗",                    /* TL_ERROR_WRITE_FAILED */
-    "讀取操作失敗",                    /* TL_ERROR_READ_FAILED */
-    "操作逾時",                        /* TL_ERROR_TIMEOUT */
-    "無效的參數",                      /* TL_ERROR_INVALID_PARAMETER */
-    "記憶體配置錯誤",                  /* TL_ERROR_MEMORY_ALLOCATION */
-    "回應格式錯誤",                    /* TL_ERROR_RESPONSE_FORMAT */
-    "回應校驗和錯誤",                  /* TL_ERROR_RESPONSE_CHECKSUM */
-    "裝置拒絕命令",                    /* TL_ERROR_RESPONSE_NACK */
-    "參數超出範圍"                     /* TL_ERROR_OUT_OF_RANGE */
-};
-
 /*
  * 設定最後一次的錯誤碼
  */
 void tl_set_last_error(TL_ERROR_CODE error_code)
 {
-    g_tl_state.last_error = error_code;
+    tl_atomic_store_u32(&g_tl_state.last_error, (unsigned int)error_code);
 }
 
 /*
@@ -76,6 +60,30 @@ static TL_BOOL tl_is_device_open(void)
     return g_tl_state.is_device_open;
 }
 
+/*
+ * 關閉指定目標 (TL_FRAME_*) 的LED或蜂鳴器，用於開啟裝置時清除未由日誌還原的目標
+ */
+static TL_ERROR_CODE tl_clear_targets(TL_DeviceContext* device, unsigned int target_mask)
+{
+    TL_LEDStatus led_off = { TL_LED_OFF, TL_LED_OFF, TL_LED_OFF, TL_LED_PATTERN_OFF };
+    TL_BuzzerStatus buzzer_off = { TL_BUZZER_TONE_HIGH, TL_BUZZER_VOLUME_MEDIUM, TL_BUZZER_PATTERN_OFF };
+    TL_ERROR_CODE error;
+    int i;
+
+    for (i = TL_LAYER_ONE; i <= TL_LAYER_THREE; i++) {
+        if (target_mask & (1u << i)) {
+            error = TL_DeviceSetLED(device, (TL_LAYER)i, &led_off);
+            if (error != TL_SUCCESS) {
+                return error;
+            }
+        }
+    }
+    if (target_mask & TL_FRAME_BUZZER) {
+        return TL_DeviceSetBuzzer(device, &buzzer_off);
+    }
+    return TL_SUCCESS;
+}
+
 /*
  * 初始化塔燈函式庫
  */
@@ -90,16 +98,54 @@ TL_ERROR_CODE TL_Initialize(void)
         return TL_ERROR_ALREADY_INITIALIZED;
     }
 
-    /* 初始化內部狀態 */
+    /* 初始化內部狀態，失敗時依相反順序釋放已初始化的子系統 */
+    tl_messages_init();
+    g_tl_state.devices_lock = tl_mutex_create();
+    if (g_tl_state.devices_lock == NULL) {
+        goto fail_devices_lock;
+    }
+    if (tl_cmd_init_emergency_frames() != TL_SUCCESS || tl_device_init(&g_tl_state.device) != TL_SUCCESS) {
+        goto fail_device;
+    }
+    if (tl_scheduler_init() != TL_SUCCESS) {
+        goto fail_scheduler;
+    }
+    if (tl_events_init() != TL_SUCCESS) {
+        goto fail_events;
+    }
+    if (tl_trace_init() != TL_SUCCESS) {
+        goto fail_trace;
+    }
+    if (tl_journal_init() != TL_SUCCESS) {
+        goto fail_journal;
+    }
+    tl_probes_register();
     g_tl_state.is_initialized = TL_TRUE;
     g_tl_state.is_device_open = TL_FALSE;
-    g_tl_state.device_handle = NULL;
-    g_tl_state.interface_handle = NULL;
-    g_tl_state.last_error = TL_SUCCESS;
+    tl_set_last_error(TL_SUCCESS);
 #ifdef BUILD_TEST_EXE 
     printf("[TL_Initialize] 成功 => TL_SUCCESS\n");
 #endif
     return TL_SUCCESS;
+
+fail_journal:
+    tl_trace_shutdown();
+fail_trace:
+    tl_events_shutdown();
+fail_events:
+    tl_scheduler_shutdown();
+fail_scheduler:
+    tl_device_cleanup(&g_tl_state.device);
+fail_device:
+    tl_mutex_destroy(g_tl_state.devices_lock);
+    g_tl_state.devices_lock = NULL;
+fail_devices_lock:
+    tl_messages_release();
+#ifdef BUILD_TEST_EXE 
+    printf("[TL_Initialize] 建立同步物件失敗 => TL_ERROR_MEMORY_ALLOCATION\n");
+#endif
+    tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+    return TL_ERROR_MEMORY_ALLOCATION;
 }
 
 /*
@@ -116,6 +162,18 @@ TL_ERROR_CODE TL_Finalize(void)
         return TL_ERROR_NOT_INITIALIZED;
     }
 
+    /* 先停止排程與提交佇列，避免背景命令存取即將關閉的裝置 */
+    tl_scheduler_shutdown();
+    tl_events_shutdown();
+
+    /* 銷毀仍存在的裝置群組，再關閉由 TL_OpenDevice 開啟的其他裝置 */
+    while (g_tl_state.groups != NULL) {
+        TL_DestroyDeviceGroup(g_tl_state.groups);
+    }
+    while (g_tl_state.extra_devices != NULL) {
+        TL_CloseDevice(g_tl_state.extra_devices);
+    }
+
     /* 如果裝置已開啟，先關閉它 */
     if (tl_is_device_open()) {
 #ifdef BUILD_TEST_EXE 
@@ -124,9 +182,18 @@ TL_ERROR_CODE TL_Finalize(void)
         TL_CloseConnection();
     }
 
+    /* 釋放裝置的同步物件、已載入的訊息目錄、追蹤緩衝區與狀態日誌 */
+    tl_device_cleanup(&g_tl_state.device);
+    tl_mutex_destroy(g_tl_state.devices_lock);
+    g_tl_state.devices_lock = NULL;
+    tl_messages_release();
+    tl_trace_shutdown();
+    tl_journal_shutdown();
+    tl_probes_unregister();
+
     /* 重置內部狀態 */
     g_tl_state.is_initialized = TL_FALSE;
-    g_tl_state.last_error = TL_SUCCESS;
+    tl_set_last_error(TL_SUCCESS);
 #ifdef BUILD_TEST_EXE 
     printf("[TL_Finalize] 完成 => TL_SUCCESS\n");
 #endif
@@ -138,6 +205,8 @@ TL_ERROR_CODE TL_Finalize(void)
  */
 TL_ERROR_CODE TL_OpenConnection(TL_BOOL clear_state)
 {
+    unsigned long long start_us = tl_time_now_us();
+    unsigned int restored;
     TL_ERROR_CODE error;
 
     /* 檢查是否已初始化 */
@@ -158,7 +227,7 @@ TL_ERROR_CODE TL_OpenConnection(TL_BOOL clear_state)
     }
 
     /* 開啟USB裝置 */
-    error = tl_usb_open_device();
+    error = tl_usb_open_device(&g_tl_state.device);
     if (error != TL_SUCCESS) {
         /* 失敗就回傳 */
 #ifdef BUILD_TEST_EXE 
@@ -167,18 +236,46 @@ TL_ERROR_CODE TL_OpenConnection(TL_BOOL clear_state)
         return error;
     }
 
+    /* 非同步寫入模式下啟動背景執行緒 */
+    if (g_tl_state.device.write_mode != TL_WRITE_MODE_SYNC) {
+        error = tl_async_start(&g_tl_state.device);
+        if (error != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE 
+            printf("[TL_OpenConnection] tl_async_start失敗 => 回傳=%d\n", error);
+#endif
+            tl_usb_close_device(&g_tl_state.device);
+            tl_set_last_error(error);
+            return error;
+        }
+    }
+
+    /* 前一次連接的往返結果不代表重新開啟的裝置 */
+    tl_health_reset(&g_tl_state.device);
+
+    /* 允許再次啟動伺服器 */
+    tl_mutex_lock(g_tl_state.device.state_lock);
+    g_tl_state.device.closing = TL_FALSE;
+    tl_mutex_unlock(g_tl_state.device.state_lock);
+
     /* 標記裝置已開啟 */
     g_tl_state.is_device_open = TL_TRUE;
 #ifdef BUILD_TEST_EXE 
     printf("[TL_OpenConnection] 裝置開啟成功 => is_device_open=TRUE\n");
 #endif
 
+    /* 狀態日誌中有此裝置的記錄時以一次連續寫出還原，還原的目標不再清除 */
+    restored = tl_journal_restore(&g_tl_state.device, start_us);
+
     /* 如果需要清除狀態 */
-    if (clear_state) {
+    if (clear_state && restored != TL_FRAME_ALL) {
 #ifdef BUILD_TEST_EXE 
-        printf("[TL_OpenConnection] clear_state=TRUE => 呼叫TL_ClearTowerLight\n");
+        printf("[TL_OpenConnection] clear_state=TRUE => 清除未還原的目標 0x%X\n", TL_FRAME_ALL & ~restored);
 #endif
-        error = TL_ClearTowerLight();
+        if (restored == 0) {
+            error = TL_ClearTowerLight();
+        } else {
+            error = tl_clear_targets(&g_tl_state.device, TL_FRAME_ALL & ~restored);
+        }
         if (error != TL_SUCCESS) {
 #ifdef BUILD_TEST_EXE 
             printf("[TL_OpenConnection] 清除塔燈狀態失敗, 但裝置已開啟. err=%d\n", error);
@@ -217,12 +314,28 @@ TL_ERROR_CODE TL_CloseConnection(void)
 #ifdef BUILD_TEST_EXE 
     printf("[TL_CloseConnection] 呼叫 tl_usb_close_device\n");
 #endif
-    tl_usb_close_device();
+    /* 之後同時啟動的伺服器不會再掛到關閉中的裝置上 */
+    tl_mutex_lock(g_tl_state.device.state_lock);
+    g_tl_state.device.closing = TL_TRUE;
+    tl_mutex_unlock(g_tl_state.device.state_lock);
+
+    /* 先停止 Modbus 伺服器、狀態推播、動畫播放、看門狗、輸入濾波與期望狀態收斂並取消排程與提交佇列中的請求，等待在途命令完成並停止背景執行緒 */
+    tl_modbus_stop(&g_tl_state.device);
+    tl_push_stop(&g_tl_state.device);
+    tl_sequence_stop(&g_tl_state.device);
+    tl_health_stop(&g_tl_state.device);
+    tl_watchdog_stop(&g_tl_state.device);
+    tl_filter_stop(&g_tl_state.device);
+    tl_reconcile_stop(&g_tl_state.device);
+    tl_scheduler_cancel_target(&g_tl_state.device);
+    tl_events_cancel_target(&g_tl_state.device);
+    tl_async_stop(&g_tl_state.device);
+    tl_usb_close_device(&g_tl_state.device);
 
     /* 重置裝置狀態 */
     g_tl_state.is_device_open = TL_FALSE;
-    g_tl_state.device_handle = NULL;
-    g_tl_state.interface_handle = NULL;
+    g_tl_state.device.device_handle = NULL;
+    g_tl_state.device.interface_handle = NULL;
 #ifdef BUILD_TEST_EXE 
     printf("[TL_CloseConnection] 完成 => TL_SUCCESS\n");
 #endif
@@ -239,7 +352,10 @@ TL_BOOL TL_IsConnected(void)
         return TL_FALSE;
     }
 
-    /* 這裡我們假設裝置已開啟就是已連接 */
+    /* 裝置已開啟但連續多次逾時或USB傳輸失敗時視為未連接 */
+    if (tl_health_is_dead(&g_tl_state.device)) {
+        return TL_FALSE;
+    }
     return TL_TRUE;
 }
 
@@ -249,65 +365,347 @@ TL_BOOL TL_IsConnected(void)
 TL_ERROR_CODE TL_ClearTowerLight(void)
 {
     TL_ERROR_CODE error;
+
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    if (!tl_is_initialized()) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+    if (!tl_is_device_open()) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+
 #ifdef BUILD_TEST_EXE 
-    printf("[TL_ClearTowerLight] 執行TL_ClearAllLEDs\n");
+    printf("[TL_ClearTowerLight] 以緊急優先權送出預先建構的清除命令\n");
 #endif
-    error = TL_ClearAllLEDs();
+    /* 三層LED與蜂鳴器全部關閉，插隊到其他命令之前 */
+    error = tl_cmd_apply_emergency(&g_tl_state.device, tl_cmd_get_emergency_frame(TL_COMMAND_CLEAR));
     if (error != TL_SUCCESS) {
 #ifdef BUILD_TEST_EXE 
-        printf("[TL_ClearTowerLight] TL_ClearAllLEDs失敗 => err=%d\n", error);
+        printf("[TL_ClearTowerLight] 清除失敗 => err=%d\n", error);
 #endif
         return error;
     }
 #ifdef BUILD_TEST_EXE 
-    printf("[TL_ClearTowerLight] 執行TL_StopBuzzer\n");
+    printf("[TL_ClearTowerLight] 完成 => TL_SUCCESS\n");
 #endif
-    error = TL_StopBuzzer();
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得已連接的塔燈數量
+ */
+TL_ERROR_CODE TL_GetDeviceCount(unsigned int* count)
+{
+    if (count == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    return tl_usb_count_devices(count);
+}
+
+/*
+ * 開啟指定的塔燈
+ */
+TL_ERROR_CODE TL_OpenDevice(unsigned int index, TL_BOOL clear_state, TL_DEVICE_HANDLE* device)
+{
+    unsigned long long start_us = tl_time_now_us();
+    TL_DeviceContext* context;
+    unsigned int restored;
+    TL_ERROR_CODE error;
+
+    if (device == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *device = NULL;
+
+    /* 檢查是否已初始化 */
+    if (!tl_is_initialized()) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    context = (TL_DeviceContext*)malloc(sizeof(TL_DeviceContext));
+    if (context == NULL || tl_device_init(context) != TL_SUCCESS) {
+        free(context);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    context->device_index = index;
+
+    /* 沿用預設裝置的設定 */
+    context->pipeline_depth = g_tl_state.device.pipeline_depth;
+    tl_mutex_lock(g_tl_state.device.state_lock);
+    context->write_mode = g_tl_state.device.write_mode;
+    context->verify_interval_ms = g_tl_state.device.verify_interval_ms;
+    context->rtt.min_timeout_ms = g_tl_state.device.rtt.min_timeout_ms;
+    context->rtt.max_timeout_ms = g_tl_state.device.rtt.max_timeout_ms;
+    context->rtt.retry_on_timeout = g_tl_state.device.rtt.retry_on_timeout;
+    context->mismatch_callback = g_tl_state.device.mismatch_callback;
+    context->mismatch_user_data = g_tl_state.device.mismatch_user_data;
+    tl_mutex_unlock(g_tl_state.device.state_lock);
+
+    /* 開啟USB裝置 */
+    error = tl_usb_open_device(context);
+    if (error == TL_SUCCESS && context->write_mode != TL_WRITE_MODE_SYNC) {
+        error = tl_async_start(context);
+        if (error != TL_SUCCESS) {
+            tl_usb_close_device(context);
+        }
+    }
     if (error != TL_SUCCESS) {
 #ifdef BUILD_TEST_EXE 
-        printf("[TL_ClearTowerLight] TL_StopBuzzer失敗 => err=%d\n", error);
+        printf("[TL_OpenDevice] index=%u 開啟失敗 => 回傳=%d\n", index, error);
 #endif
+        tl_device_cleanup(context);
+        free(context);
+        tl_set_last_error(error);
         return error;
     }
-#ifdef BUILD_TEST_EXE 
-    printf("[TL_ClearTowerLight] 完成 => TL_SUCCESS\n");
-#endif
+
+    /* 加入裝置串列 */
+    tl_mutex_lock(g_tl_state.devices_lock);
+    context->next = g_tl_state.extra_devices;
+    g_tl_state.extra_devices = context;
+    tl_mutex_unlock(g_tl_state.devices_lock);
+    *device = context;
+
+    /* 狀態日誌中有此裝置的記錄時以一次連續寫出還原，還原的目標不再清除 */
+    restored = tl_journal_restore(context, start_us);
+
+    /* 如果需要清除狀態 (失敗只記錄錯誤, 不關裝置) */
+    if (clear_state && restored != TL_FRAME_ALL) {
+        error = tl_clear_targets(context, TL_FRAME_ALL & ~restored);
+        if (error != TL_SUCCESS) {
+            tl_set_last_error(error);
+        }
+    }
+
     return TL_SUCCESS;
 }
 
 /*
- * 獲取最後一次發生的錯誤碼
+ * 關閉由 TL_OpenDevice 開啟的塔燈
  */
-TL_ERROR_CODE TL_GetLastError(void)
+TL_ERROR_CODE TL_CloseDevice(TL_DEVICE_HANDLE device)
 {
-    return g_tl_state.last_error;
+    TL_DeviceContext** link;
+
+    /* 預設裝置由 TL_CloseConnection 管理 */
+    if (device == &g_tl_state.device) {
+        return TL_CloseConnection();
+    }
+
+    if (!tl_is_initialized()) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    /* 從裝置串列中移除 */
+    tl_mutex_lock(g_tl_state.devices_lock);
+    for (link = &g_tl_state.extra_devices; *link != NULL; link = &(*link)->next) {
+        if (*link == device) {
+            break;
+        }
+    }
+    if (device == NULL || *link == NULL) {
+        tl_mutex_unlock(g_tl_state.devices_lock);
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *link = device->next;
+    tl_mutex_unlock(g_tl_state.devices_lock);
+
+    /* 群組成員不再指向此裝置 */
+    tl_group_detach_device(device);
+
+    /* 之後同時啟動的伺服器不會再掛到關閉中的裝置上 */
+    tl_mutex_lock(device->state_lock);
+    device->closing = TL_TRUE;
+    tl_mutex_unlock(device->state_lock);
+
+    tl_modbus_stop(device);
+    tl_push_stop(device);
+    tl_sequence_stop(device);
+    tl_health_stop(device);
+    tl_watchdog_stop(device);
+    tl_filter_stop(device);
+    tl_reconcile_stop(device);
+    tl_scheduler_cancel_target(device);
+    tl_events_cancel_target(device);
+    tl_async_stop(device);
+    tl_usb_close_device(device);
+    tl_device_cleanup(device);
+    free(device);
+    return TL_SUCCESS;
 }
 
 /*
- * 獲取錯誤碼對應的錯誤訊息
+ * 取得預設裝置的控制代碼
  */
-TL_ERROR_CODE TL_GetErrorMessage(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size)
+TL_DEVICE_HANDLE TL_GetDefaultDevice(void)
 {
-    /* 驗證參數 */
-    if (buffer == NULL || buffer_size == 0) {
+    if (!tl_is_initialized() || !tl_is_device_open()) {
+        return NULL;
+    }
+    return &g_tl_state.device;
+}
+
+/*
+ * 檢查裝置是否可用
+ */
+TL_ERROR_CODE tl_validate_device(TL_DeviceContext* device)
+{
+    if (!tl_is_initialized()) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+    if (device == NULL) {
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
+    if (device->device_handle == NULL || device->interface_handle == NULL) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 執行塔燈命令 (期限已由 TL_ExecuteCommand 處理)
+ */
+static TL_ERROR_CODE tl_execute_command(const TL_TowerCommand* command)
+{
+    TL_DeviceContext* device;
+    TL_PreparedFrame prepared;
+    TL_TowerFrame frame;
+    TL_ERROR_CODE error;
+
+    /* 群組命令不指定單一裝置 */
+    if (command->type == TL_COMMAND_GROUP_FRAME) {
+        if (!tl_is_initialized()) {
+            tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+            return TL_ERROR_NOT_INITIALIZED;
+        }
+        return TL_GroupApplyFrame(command->group, &command->frame, TL_TRUE, NULL, NULL);
+    }
 
-    /* 檢查錯誤碼是否在有效範圍內 */
-    size_t count = sizeof(g_error_messages) / sizeof(g_error_messages[0]);
-    if (error_code >= 0 && (size_t)error_code < count) {
-        strncpy(buffer, g_error_messages[error_code], buffer_size);
-        buffer[buffer_size - 1] = '\0'; /* 確保字串結尾 */
+    device = (command->device != NULL) ? command->device : &g_tl_state.device;
+    error = tl_validate_device(device);
+    if (error != TL_SUCCESS) {
+        return error;
     }
-    else {
-        strncpy(buffer, "未知錯誤", buffer_size);
-        buffer[buffer_size - 1] = '\0';
+
+    switch (command->type) {
+    case TL_COMMAND_SET_LED:
+        if (command->priority < TL_PRIORITY_EMERGENCY) {
+            return TL_DeviceSetLED(device, command->layer, &command->led);
+        }
+        if ((int)command->layer < 0 || (int)command->layer > 2) {
+            tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+            return TL_ERROR_INVALID_PARAMETER;
+        }
+        memset(&frame, 0, sizeof(frame));
+        frame.layers[command->layer] = command->led;
+        frame.target_mask = 1u << command->layer;
+        error = tl_cmd_prepare_frame(&frame, &prepared);
+        break;
+
+    case TL_COMMAND_SET_BUZZER:
+        if (command->priority < TL_PRIORITY_EMERGENCY) {
+            return TL_DeviceSetBuzzer(device, &command->buzzer);
+        }
+        memset(&frame, 0, sizeof(frame));
+        frame.buzzer = command->buzzer;
+        frame.target_mask = TL_FRAME_BUZZER;
+        error = tl_cmd_prepare_frame(&frame, &prepared);
+        break;
+
+    case TL_COMMAND_STOP_BUZZER:
+    case TL_COMMAND_CLEAR:
+        /* 使用預先建構的全部關閉畫面，一律以緊急優先權執行 */
+        return tl_cmd_apply_emergency(device, tl_cmd_get_emergency_frame(command->type));
+
+    case TL_COMMAND_APPLY_FRAME:
+        error = tl_cmd_prepare_frame(&command->frame, &prepared);
+        break;
+
+    default:
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
 
-    return TL_SUCCESS;
+    if (error != TL_SUCCESS) {
+        return error;
+    }
+    if (command->priority >= TL_PRIORITY_EMERGENCY) {
+        return tl_cmd_apply_emergency(device, &prepared);
+    }
+    error = tl_cmd_apply_frame(device, &prepared);
+    if (error != TL_SUCCESS) {
+        tl_set_last_error(error);
+    }
+    return error;
+}
+
+/*
+ * 立即執行塔燈命令
+ */
+TL_ERROR_CODE TL_ExecuteCommand(const TL_TowerCommand* command)
+{
+    unsigned long long previous;
+    TL_ERROR_CODE error;
+
+    if (command == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 已超過期限的命令不執行 */
+    if (command->deadline_ms != 0 && TL_GetMonotonicTimeMs() > command->deadline_ms) {
+        tl_set_last_error(TL_ERROR_EXPIRED);
+        return TL_ERROR_EXPIRED;
+    }
+
+    /* 等待裝置期間超過期限時，尚未送出的設定命令也不送出 */
+    previous = tl_cmd_set_thread_deadline((command->deadline_ms != 0) ? (command->deadline_ms + 1) * 1000 : 0);
+    error = tl_execute_command(command);
+    tl_cmd_set_thread_deadline(previous);
+    return error;
+}
+
+/*
+ * 取得函式庫使用的單調時間
+ */
+unsigned long long TL_GetMonotonicTimeMs(void)
+{
+    return tl_time_now_us() / 1000;
+}
+
+/*
+ * 獲取最後一次發生的錯誤碼
+ */
+TL_ERROR_CODE TL_GetLastError(void)
+{
+    return (TL_ERROR_CODE)tl_atomic_load_u32(&g_tl_state.last_error);
+}
+
+/*
+ * 獲取錯誤碼對應的錯誤訊息
+ */
+TL_ERROR_CODE TL_GetErrorMessage(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size)
+{
+    TL_ERROR_CODE result;
+
+    /* 訊息依呼叫執行緒的語言，從已載入的訊息目錄 (或內建訊息) 取得 */
+    result = tl_get_error_message(error_code, buffer, buffer_size);
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+
+    return result;
 }
 
 /*
@@ -318,6 +716,56 @@ TL_InternalState* tl_get_internal_state(void)
     return &g_tl_state;
 }
 
+/*
+ * 取得預設裝置
+ */
+TL_DeviceContext* tl_get_default_device(void)
+{
+    return &g_tl_state.device;
+}
+
+/*
+ * 初始化裝置狀態
+ */
+TL_ERROR_CODE tl_device_init(TL_DeviceContext* device)
+{
+    memset(device, 0, sizeof(*device));
+    tl_rtt_init(&device->rtt);
+    tl_health_init(&device->health);
+    device->write_mode = TL_WRITE_MODE_SYNC;
+    device->verify_interval_ms = TL_VERIFY_DEFAULT_INTERVAL_MS;
+    device->pipeline_depth = TL_ASYNC_MAX_IN_FLIGHT;
+
+    device->io_lock = tl_mutex_create();
+    device->state_lock = tl_mutex_create();
+    device->lane_lock = tl_mutex_create();
+    device->lane_changed = tl_cond_create();
+    device->health_lock = tl_mutex_create();
+    if (device->io_lock == NULL || device->state_lock == NULL ||
+        device->lane_lock == NULL || device->lane_changed == NULL || device->health_lock == NULL) {
+        tl_device_cleanup(device);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 釋放裝置狀態
+ */
+void tl_device_cleanup(TL_DeviceContext* device)
+{
+    tl_mutex_destroy(device->io_lock);
+    tl_mutex_destroy(device->state_lock);
+    tl_mutex_destroy(device->lane_lock);
+    tl_cond_destroy(device->lane_changed);
+    tl_mutex_destroy(device->health_lock);
+    device->io_lock = NULL;
+    device->state_lock = NULL;
+    device->lane_lock = NULL;
+    device->lane_changed = NULL;
+    device->health_lock = NULL;
+}
+
 /*
  * 延遲指定的毫秒數
  */
@@ -30,33 +30,52 @@
 TL_ERROR_CODE tl_get_error_message(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size) {
     const char* message;
     size_t message_length;
+    int msg_id;
     
     /* 參數驗證 */
     if (buffer == NULL || buffer_size == 0) {
         return TL_ERROR_INVALID_PARAMETER;
     }
     
-    /* 確保緩衝區最後一個字元為 NULL */
-    buffer[buffer_size - 1] = '\0';
-    
-    /* 錯誤碼直接對應訊息ID */
-    if (error_code >= 0 && error_code < TL_MSG_ID_COUNT) {
-        message = tl_messages_get(error_code);
-        message_length = strlen(message);
-        
-        /* 複製錯誤訊息到緩衝區 */
-        if (message_length < buffer_size - 1) {
-            strcpy(buffer, message);
-        } else {
-            /* 緩衝區不夠大，只複製部分訊息 */
-            strncpy(buffer, message, buffer_size - 1);
-        }
-    } else {
-        /* 未知錯誤碼 */
-        message = tl_messages_get(TL_MSG_ID_UNKNOWN_ERROR);
-        strncpy(buffer, message, buffer_size - 1);
+    /* 錯誤碼轉換為訊息ID */
+    msg_id = tl_messages_id_for_error(error_code);
+    message = tl_messages_get_view(tl_messages_current_language(), msg_id, &message_length);
+    
+    /* 複製錯誤訊息到緩衝區，緩衝區不夠大時只複製部分訊息 */
+    if (message_length > buffer_size - 1) {
+        message_length = buffer_size - 1;
+    }
+    memcpy(buffer, message, message_length);
+    buffer[message_length] = '\0';
+    
+    /* 未知錯誤碼 */
+    if (msg_id == TL_MSG_ID_UNKNOWN_ERROR) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得錯誤碼對應的錯誤訊息 (零複製)
+ */
+TL_ERROR_CODE TL_GetErrorMessageView(TL_ERROR_CODE error_code, const char** message, size_t* length) {
+    int msg_id;
+    
+    /* 參數驗證 */
+    if (message == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* 直接返回目錄內的字串，不配置記憶體 */
+    msg_id = tl_messages_id_for_error(error_code);
+    *message = tl_messages_get_view(tl_messages_current_language(), msg_id, length);
+    
+    if (msg_id == TL_MSG_ID_UNKNOWN_ERROR) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
     
     return TL_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1050 @@
+﻿/*
+ * tl_events.c
+ *
+ * 塔燈通訊控制函式庫 - 事件迴圈整合實現
+ *
+ * 讓單一事件迴圈執行緒 (epoll / libuv / WaitForMultipleObjects) 驅動多台塔燈：
+ * TL_SubmitCommand / TL_SubmitStatusRequest 只把請求放入提交佇列即返回，
+ * 由工作執行緒執行 (同一裝置依序、不同裝置平行)。傳輸本身是阻塞呼叫，每台
+ * 處理中的塔燈 (或群組) 佔用一個工作執行緒：有可執行的請求而沒有空閒的工作
+ * 執行緒時即增加一個，上限為 TL_EVENT_MAX_WORKERS，建立後保留到關閉。因此
+ * 無回應的塔燈只佔住自己的工作執行緒，其他塔燈照常進行；同時處理中的對象
+ * 超過上限時，其餘請求在佇列中等待。佇列依優先權排序，
+ * 緊急命令排在所有一般命令之前，並取消被其涵蓋的一般命令；第0個工作執行緒
+ * 保留給緊急命令，緊急命令不必等待一般命令釋出工作執行緒。超過期限的命令
+ * 在工作執行緒取出時從佇列移除，不會送到裝置。完成結果、
+ * 狀態讀取結果與熱插拔事件放入事件佇列，並使通知代碼變為可讀；
+ * 呼叫端在代碼可讀時呼叫 TL_ProcessEvents 取得事件。到期的排程命令也經由
+ * 同一佇列執行，但完成時改為在不持有鎖時呼叫排程的完成回呼，不產生事件。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 工作執行緒數量上限，以及開始時建立的數量 (保留的工作執行緒與一個一般工作執行緒) */
+#define TL_EVENT_MAX_WORKERS      64
+#define TL_EVENT_INITIAL_WORKERS  2
+
+/* 只執行緊急命令的工作執行緒 */
+#define TL_EVENT_EMERGENCY_WORKER  0
+
+/* 提交佇列容量 */
+#define TL_EVENT_QUEUE_SIZE  256
+
+/* 事件佇列初始容量 (不足時加倍) */
+#define TL_EVENT_INITIAL_CAPACITY  64
+
+/* 熱插拔檢查週期 (毫秒) */
+#define TL_HOTPLUG_POLL_INTERVAL_MS  1000
+
+/* 空串列 */
+#define TL_REQUEST_NIL  (-1)
+
+/* 提交請求 */
+typedef struct {
+    TL_REQUEST_ID id;                 /* 請求識別碼 */
+    TL_EVENT_TYPE kind;               /* 完成時產生的事件類型 */
+    TL_PRIORITY priority;             /* 有效優先權 */
+    const void* target;               /* 序列化對象 (裝置或群組) */
+    TL_DeviceContext* device;         /* 目標裝置，群組命令為 NULL */
+    TL_TowerCommand command;          /* TL_EVENT_COMMAND_COMPLETE 的命令 */
+    unsigned int target_mask;         /* TL_EVENT_STATUS 要讀取的目標 */
+    unsigned long long submit_us;     /* 提交時間 */
+    TL_BOOL scheduled;                /* 到期的排程命令：完成時呼叫 callback，不產生事件 */
+    TL_ScheduleCallback callback;     /* 排程命令的完成回呼，可為 NULL */
+    void* user_data;                  /* 傳給回呼的使用者資料 */
+    TL_TIMER_ID timer_id;             /* 傳給回呼的排程識別碼 */
+    TL_ERROR_CODE result;             /* 在佇列中結束的排程命令的結果 */
+    int next;                         /* 佇列中的下一個請求 (或閒置串列、待通知串列) */
+} TL_EventRequest;
+
+/* 事件系統狀態 */
+typedef struct {
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 有新請求、請求完成或停止 */
+    TL_BOOL started;                  /* 工作執行緒與通知代碼已建立 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_Thread* workers[TL_EVENT_MAX_WORKERS];          /* 工作執行緒 */
+    const void* busy[TL_EVENT_MAX_WORKERS];            /* 各工作執行緒正在處理的對象 */
+    TL_PRIORITY busy_priority[TL_EVENT_MAX_WORKERS];   /* 正在處理的請求的優先權 */
+    int worker_count;                 /* 已建立的工作執行緒數 */
+    int idle_workers;                 /* 等待中的一般工作執行緒數 (不含保留的工作執行緒) */
+    TL_EventRequest requests[TL_EVENT_QUEUE_SIZE];     /* 請求節點 */
+    int queue_head;                   /* 提交佇列 (依提交順序) */
+    int queue_tail;
+    int free_list;                    /* 閒置節點 */
+    int done_head;                    /* 在佇列中結束、等待呼叫回呼的排程命令 */
+    int done_tail;
+    unsigned int queue_depth;         /* 佇列中的請求數 */
+    TL_QueueStats stats;              /* 提交佇列統計 */
+    TL_REQUEST_ID next_id;            /* 下一個請求識別碼 */
+    TL_Event* events;                 /* 事件環形佇列 */
+    size_t event_capacity;
+    size_t event_head;
+    size_t event_count;
+    TL_PollSignal* signal;            /* 通知代碼 */
+    TL_BOOL signaled;                 /* 通知代碼目前是否可讀 */
+    unsigned int device_count;        /* 上次檢查時的裝置數量 */
+    unsigned long long next_hotplug_us;  /* 下次熱插拔檢查時間 */
+} TL_EventSystem;
+
+static TL_EventSystem g_events;
+
+/*
+ * 放入事件並使通知代碼可讀 (須持有鎖)
+ */
+static void tl_events_post_locked(const TL_Event* event)
+{
+    TL_Event* events;
+    size_t capacity;
+    size_t i;
+
+    if (g_events.event_count == g_events.event_capacity) {
+        capacity = (g_events.event_capacity == 0) ? TL_EVENT_INITIAL_CAPACITY : g_events.event_capacity * 2;
+        events = (TL_Event*)malloc(capacity * sizeof(TL_Event));
+        if (events == NULL) {
+            /* 無法配置時捨棄事件，呼叫端仍會收到先前的事件 */
+            return;
+        }
+        /* 展開環形佇列 */
+        for (i = 0; i < g_events.event_count; i++) {
+            events[i] = g_events.events[(g_events.event_head + i) % g_events.event_capacity];
+        }
+        free(g_events.events);
+        g_events.events = events;
+        g_events.event_capacity = capacity;
+        g_events.event_head = 0;
+    }
+
+    g_events.events[(g_events.event_head + g_events.event_count) % g_events.event_capacity] = *event;
+    g_events.event_count++;
+
+    if (!g_events.signaled) {
+        g_events.signaled = TL_TRUE;
+        tl_poll_signal_set(g_events.signal);
+    }
+}
+
+/*
+ * 將數值計入直方圖
+ */
+static void tl_events_histogram_add(unsigned long long* histogram, unsigned long long value)
+{
+    int bucket = 0;
+
+    while (value > 1 && bucket < TL_HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+/*
+ * 為請求產生完成事件 (須持有鎖)
+ */
+static void tl_events_complete_locked(const TL_EventRequest* request, TL_ERROR_CODE result,
+                                      const TL_TowerFrame* status)
+{
+    TL_Event event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = request->kind;
+    event.request_id = request->id;
+    event.device = request->device;
+    event.result = result;
+    if (request->kind == TL_EVENT_COMMAND_COMPLETE) {
+        event.command_type = request->command.type;
+    } else if (status != NULL) {
+        event.status = *status;
+    }
+    tl_events_post_locked(&event);
+}
+
+/*
+ * 歸還請求節點 (須持有鎖)
+ */
+static void tl_events_free_locked(int index)
+{
+    g_events.requests[index].next = g_events.free_list;
+    g_events.free_list = index;
+}
+
+/*
+ * 結束已從佇列移除、未執行的請求 (須持有鎖)
+ *
+ * 一般請求產生完成事件並歸還節點；排程命令記下結果放入待通知串列，
+ * 由 tl_events_deliver 在不持有鎖時呼叫回呼後歸還
+ */
+static void tl_events_finish_locked(int index, TL_ERROR_CODE result)
+{
+    TL_EventRequest* request = &g_events.requests[index];
+
+    if (!request->scheduled) {
+        tl_events_complete_locked(request, result, NULL);
+        tl_events_free_locked(index);
+        return;
+    }
+    if (request->callback == NULL) {
+        tl_events_free_locked(index);
+        return;
+    }
+
+    request->result = result;
+    request->next = TL_REQUEST_NIL;
+    if (g_events.done_tail == TL_REQUEST_NIL) {
+        g_events.done_head = index;
+    } else {
+        g_events.requests[g_events.done_tail].next = index;
+    }
+    g_events.done_tail = index;
+}
+
+/*
+ * 呼叫在佇列中結束的排程命令的完成回呼 (不可持有鎖)
+ */
+static void tl_events_deliver(void)
+{
+    TL_ScheduleCallback callback;
+    TL_ERROR_CODE result;
+    TL_TIMER_ID id;
+    void* user_data;
+    int index;
+
+    tl_mutex_lock(g_events.lock);
+    while (g_events.done_head != TL_REQUEST_NIL) {
+        index = g_events.done_head;
+        g_events.done_head = g_events.requests[index].next;
+        if (g_events.done_head == TL_REQUEST_NIL) {
+            g_events.done_tail = TL_REQUEST_NIL;
+        }
+        callback = g_events.requests[index].callback;
+        user_data = g_events.requests[index].user_data;
+        id = g_events.requests[index].timer_id;
+        result = g_events.requests[index].result;
+        tl_events_free_locked(index);
+
+        tl_mutex_unlock(g_events.lock);
+        callback(id, result, user_data);
+        tl_mutex_lock(g_events.lock);
+    }
+    tl_mutex_unlock(g_events.lock);
+}
+
+/*
+ * 從佇列移除請求 (須持有鎖)
+ *
+ * 參數：prev 佇列中的前一個請求，TL_REQUEST_NIL 表示 index 為第一個
+ * 參數：index 要移除的請求
+ */
+static void tl_events_unlink_locked(int prev, int index)
+{
+    int next = g_events.requests[index].next;
+
+    if (prev == TL_REQUEST_NIL) {
+        g_events.queue_head = next;
+    } else {
+        g_events.requests[prev].next = next;
+    }
+    if (g_events.queue_tail == index) {
+        g_events.queue_tail = prev;
+    }
+    g_events.requests[index].next = TL_REQUEST_NIL;
+    g_events.queue_depth--;
+}
+
+/*
+ * 請求的對象是否正由其他工作執行緒處理 (須持有鎖)
+ *
+ * 緊急命令只需等待同一對象的其他緊急命令，與一般命令的先後由裝置的緊急通道處理。
+ */
+static TL_BOOL tl_events_blocked_locked(const TL_EventRequest* request)
+{
+    int i;
+
+    for (i = 0; i < g_events.worker_count; i++) {
+        if (g_events.busy[i] == request->target &&
+            (request->priority < TL_PRIORITY_EMERGENCY || g_events.busy_priority[i] >= TL_PRIORITY_EMERGENCY)) {
+            return TL_TRUE;
+        }
+    }
+    return TL_FALSE;
+}
+
+/*
+ * 從佇列取出第一個可執行的請求 (須持有鎖)
+ *
+ * 同一對象的請求依提交順序執行：對象處理中時其後續請求全部跳過。
+ * 途經已超過期限的命令直接以 TL_ERROR_EXPIRED 完成，不佔用佇列容量。
+ *
+ * 參數：slot 工作執行緒編號
+ * 返回值：請求索引，TL_REQUEST_NIL 表示沒有可執行的請求
+ */
+static int tl_events_take_locked(int slot)
+{
+    const TL_EventRequest* request;
+    unsigned long long now_ms = TL_GetMonotonicTimeMs();
+    int prev = TL_REQUEST_NIL;
+    int index;
+    int next;
+
+    for (index = g_events.queue_head; index != TL_REQUEST_NIL; index = next) {
+        request = &g_events.requests[index];
+        next = request->next;
+
+        /* 移除已超過期限的命令 */
+        if (request->kind == TL_EVENT_COMMAND_COMPLETE && request->command.deadline_ms != 0 &&
+            now_ms > request->command.deadline_ms) {
+            tl_events_unlink_locked(prev, index);
+            g_events.stats.expired++;
+            tl_events_finish_locked(index, TL_ERROR_EXPIRED);
+            continue;
+        }
+
+        /* 佇列依優先權排序，保留的工作執行緒遇到一般命令即可停止 */
+        if (slot == TL_EVENT_EMERGENCY_WORKER && request->priority < TL_PRIORITY_EMERGENCY) {
+            return TL_REQUEST_NIL;
+        }
+        if (!tl_events_blocked_locked(request)) {
+            break;
+        }
+        prev = index;
+    }
+    if (index == TL_REQUEST_NIL) {
+        return TL_REQUEST_NIL;
+    }
+
+    tl_events_unlink_locked(prev, index);
+    tl_events_histogram_add(g_events.stats.wait_us, tl_time_now_us() - g_events.requests[index].submit_us);
+    return index;
+}
+
+/*
+ * 讀取裝置狀態 (不持有鎖)
+ */
+static TL_ERROR_CODE tl_events_read_status(TL_DeviceContext* device, unsigned int target_mask,
+                                           TL_TowerFrame* status)
+{
+    TL_ERROR_CODE result = TL_SUCCESS;
+    int layer;
+
+    memset(status, 0, sizeof(*status));
+    status->target_mask = target_mask;
+    for (layer = 0; layer < 3 && result == TL_SUCCESS; layer++) {
+        if (target_mask & (1u << layer)) {
+            result = TL_DeviceGetLEDStatus(device, (TL_LAYER)layer, &status->layers[layer]);
+        }
+    }
+    if (result == TL_SUCCESS && (target_mask & TL_FRAME_BUZZER)) {
+        result = TL_DeviceGetBuzzerStatus(device, &status->buzzer);
+    }
+    return result;
+}
+
+/*
+ * 檢查系統中的塔燈數量，變化時產生熱插拔事件 (不持有鎖)
+ */
+static void tl_events_check_hotplug(void)
+{
+    TL_Event event;
+    unsigned int count;
+
+    if (tl_usb_count_devices(&count) != TL_SUCCESS) {
+        return;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    if (count != g_events.device_count) {
+        memset(&event, 0, sizeof(event));
+        event.type = (count > g_events.device_count) ? TL_EVENT_DEVICE_ARRIVED : TL_EVENT_DEVICE_REMOVED;
+        event.result = TL_SUCCESS;
+        event.device_count = count;
+        g_events.device_count = count;
+        tl_events_post_locked(&event);
+#ifdef BUILD_TEST_EXE
+        printf("[tl_events] 塔燈數量變為 %u\n", count);
+#endif
+    }
+    tl_mutex_unlock(g_events.lock);
+}
+
+static void tl_events_worker_main(void* arg);
+
+/*
+ * 增加一個工作執行緒 (須持有鎖)
+ *
+ * 返回值：TL_TRUE 表示已建立；已達上限、正在停止或建立失敗時為 TL_FALSE，
+ *         請求留在佇列中由現有的工作執行緒處理
+ */
+static TL_BOOL tl_events_spawn_locked(void)
+{
+    TL_Thread* thread;
+
+    if (g_events.stopping || g_events.worker_count >= TL_EVENT_MAX_WORKERS) {
+        return TL_FALSE;
+    }
+    thread = tl_thread_create(tl_events_worker_main, (void*)(size_t)g_events.worker_count);
+    if (thread == NULL) {
+        return TL_FALSE;
+    }
+    g_events.workers[g_events.worker_count] = thread;
+    g_events.busy[g_events.worker_count] = NULL;
+    g_events.worker_count++;
+    return TL_TRUE;
+}
+
+/*
+ * 佇列中是否有可立即執行的請求 (須持有鎖)
+ */
+static TL_BOOL tl_events_runnable_locked(void)
+{
+    int index;
+
+    for (index = g_events.queue_head; index != TL_REQUEST_NIL; index = g_events.requests[index].next) {
+        if (!tl_events_blocked_locked(&g_events.requests[index])) {
+            return TL_TRUE;
+        }
+    }
+    return TL_FALSE;
+}
+
+/*
+ * 新請求是否需要增加工作執行緒 (須持有鎖)
+ *
+ * 有等待中的工作執行緒、對象正在處理中，或佇列中已有同一對象的其他請求時由現有的
+ * 工作執行緒接手；緊急命令在保留的工作執行緒空閒時也由它接手。其餘情況由取出請求的
+ * 工作執行緒檢查 (見 tl_events_worker_main)。
+ */
+static TL_BOOL tl_events_needs_worker_locked(int index)
+{
+    const TL_EventRequest* request = &g_events.requests[index];
+    int other;
+
+    if (g_events.idle_workers > 0 || tl_events_blocked_locked(request)) {
+        return TL_FALSE;
+    }
+    if (request->priority >= TL_PRIORITY_EMERGENCY && g_events.busy[TL_EVENT_EMERGENCY_WORKER] == NULL) {
+        return TL_FALSE;
+    }
+    for (other = g_events.queue_head; other != TL_REQUEST_NIL; other = g_events.requests[other].next) {
+        if (other != index && g_events.requests[other].target == request->target) {
+            return TL_FALSE;
+        }
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 工作執行緒
+ */
+static void tl_events_worker_main(void* arg)
+{
+    int slot = (int)(size_t)arg;
+    TL_EventRequest request;
+    TL_TowerFrame status;
+    TL_ERROR_CODE result;
+    unsigned long long now_us;
+    unsigned long wait_ms;
+    int index;
+
+    tl_mutex_lock(g_events.lock);
+    while (!g_events.stopping) {
+        /*
+         * 取出請求時移除的過期排程命令，以及被緊急命令取代的排程命令
+         * (提交者可能是排程執行緒，不在提交時呼叫回呼)
+         */
+        if (g_events.done_head != TL_REQUEST_NIL) {
+            tl_mutex_unlock(g_events.lock);
+            tl_events_deliver();
+            tl_mutex_lock(g_events.lock);
+            continue;
+        }
+
+        /* 由空閒的工作執行緒順便負責熱插拔檢查 */
+        now_us = tl_time_now_us();
+        if (now_us >= g_events.next_hotplug_us) {
+            g_events.next_hotplug_us = now_us + TL_HOTPLUG_POLL_INTERVAL_MS * 1000ULL;
+            tl_mutex_unlock(g_events.lock);
+            tl_events_check_hotplug();
+            tl_mutex_lock(g_events.lock);
+            continue;
+        }
+
+        index = tl_events_take_locked(slot);
+        if (index == TL_REQUEST_NIL) {
+            wait_ms = (unsigned long)((g_events.next_hotplug_us - now_us + 999) / 1000);
+            if (slot != TL_EVENT_EMERGENCY_WORKER) {
+                g_events.idle_workers++;
+            }
+            tl_cond_wait(g_events.changed, g_events.lock, wait_ms);
+            if (slot != TL_EVENT_EMERGENCY_WORKER) {
+                g_events.idle_workers--;
+            }
+            continue;
+        }
+
+        request = g_events.requests[index];
+        tl_events_free_locked(index);
+        g_events.busy[slot] = request.target;
+        g_events.busy_priority[slot] = request.priority;
+
+        /* 沒有其他等待中的工作執行緒而佇列中仍有可執行的請求 (其他對象) 時，增加一個工作執行緒 */
+        if (g_events.idle_workers == 0 && tl_events_runnable_locked()) {
+            tl_events_spawn_locked();
+        }
+        tl_mutex_unlock(g_events.lock);
+
+        if (request.kind == TL_EVENT_STATUS) {
+            result = tl_events_read_status(request.device, request.target_mask, &status);
+        } else {
+            result = TL_ExecuteCommand(&request.command);
+        }
+
+        tl_mutex_lock(g_events.lock);
+        g_events.busy[slot] = NULL;
+        if (result == TL_ERROR_EXPIRED) {
+            g_events.stats.expired++;
+        }
+        if (!request.scheduled) {
+            tl_events_complete_locked(&request, result, (request.kind == TL_EVENT_STATUS) ? &status : NULL);
+        }
+        /* 對象空出後，其他工作執行緒可能有可執行的請求 */
+        tl_cond_broadcast(g_events.changed);
+
+        /* 排程命令的回呼不會存取裝置，對象空出後才呼叫，可在其中關閉裝置 */
+        if (request.scheduled && request.callback != NULL) {
+            tl_mutex_unlock(g_events.lock);
+            request.callback(request.timer_id, result, request.user_data);
+            tl_mutex_lock(g_events.lock);
+        }
+    }
+    tl_mutex_unlock(g_events.lock);
+}
+
+/*
+ * 建立通知代碼與工作執行緒 (須持有鎖)
+ */
+static TL_ERROR_CODE tl_events_start_locked(void)
+{
+    int i;
+
+    if (g_events.started) {
+        return TL_SUCCESS;
+    }
+    /* 正在關閉，或另一個執行緒正在結束建立失敗的工作執行緒 */
+    if (g_events.stopping) {
+        return TL_ERROR_GENERAL;
+    }
+
+    g_events.signal = tl_poll_signal_create();
+    if (g_events.signal == NULL) {
+        return TL_ERROR_GENERAL;
+    }
+    if (tl_usb_count_devices(&g_events.device_count) != TL_SUCCESS) {
+        g_events.device_count = 0;
+    }
+    g_events.next_hotplug_us = tl_time_now_us() + TL_HOTPLUG_POLL_INTERVAL_MS * 1000ULL;
+
+    while (g_events.worker_count < TL_EVENT_INITIAL_WORKERS) {
+        if (!tl_events_spawn_locked()) {
+            break;
+        }
+    }
+
+    /*
+     * 保留給緊急命令的工作執行緒不處理一般命令，至少還要有一個其他工作執行緒；
+     * 否則結束已建立的工作執行緒 (須暫時釋放鎖讓它們看到停止旗標)
+     */
+    if (g_events.worker_count < TL_EVENT_INITIAL_WORKERS) {
+        i = g_events.worker_count;
+        g_events.stopping = TL_TRUE;
+        tl_cond_broadcast(g_events.changed);
+        tl_mutex_unlock(g_events.lock);
+        while (i > 0) {
+            i--;
+            tl_thread_join(g_events.workers[i]);
+            g_events.workers[i] = NULL;
+        }
+        tl_mutex_lock(g_events.lock);
+        g_events.worker_count = 0;
+        g_events.stopping = TL_FALSE;
+        tl_poll_signal_destroy(g_events.signal);
+        g_events.signal = NULL;
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    g_events.started = TL_TRUE;
+    return TL_SUCCESS;
+}
+
+/*
+ * 命令涵蓋的目標 (TL_FRAME_*)，群組命令返回 0
+ */
+static unsigned int tl_events_command_mask(const TL_TowerCommand* command)
+{
+    switch (command->type) {
+    case TL_COMMAND_SET_LED:
+        return ((int)command->layer >= 0 && (int)command->layer <= 2) ? (1u << command->layer) : 0;
+    case TL_COMMAND_SET_BUZZER:
+    case TL_COMMAND_STOP_BUZZER:
+        return TL_FRAME_BUZZER;
+    case TL_COMMAND_CLEAR:
+        return TL_FRAME_ALL;
+    case TL_COMMAND_APPLY_FRAME:
+        return command->frame.target_mask & TL_FRAME_ALL;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * 依優先權插入佇列，同優先權依提交順序 (須持有鎖)
+ */
+static void tl_events_insert_locked(int index)
+{
+    TL_PRIORITY priority = g_events.requests[index].priority;
+    int prev = TL_REQUEST_NIL;
+    int next;
+
+    for (next = g_events.queue_head; next != TL_REQUEST_NIL; next = g_events.requests[next].next) {
+        if (g_events.requests[next].priority < priority) {
+            break;
+        }
+        prev = next;
+    }
+
+    g_events.requests[index].next = next;
+    if (prev == TL_REQUEST_NIL) {
+        g_events.queue_head = index;
+    } else {
+        g_events.requests[prev].next = index;
+    }
+    if (next == TL_REQUEST_NIL) {
+        g_events.queue_tail = index;
+    }
+    g_events.queue_depth++;
+}
+
+/*
+ * 取消佇列中被緊急命令涵蓋的一般命令 (須持有鎖)
+ */
+static void tl_events_supersede_locked(const TL_EventRequest* emergency)
+{
+    unsigned int mask = tl_events_command_mask(&emergency->command);
+    unsigned long count = 0;
+    unsigned int covered;
+    int prev = TL_REQUEST_NIL;
+    int index;
+    int next;
+
+    if (emergency->device == NULL || mask == 0) {
+        return;
+    }
+
+    for (index = g_events.queue_head; index != TL_REQUEST_NIL; index = next) {
+        TL_EventRequest* request = &g_events.requests[index];
+
+        next = request->next;
+        covered = tl_events_command_mask(&request->command);
+        if (request->kind != TL_EVENT_COMMAND_COMPLETE || request->priority >= TL_PRIORITY_EMERGENCY ||
+            request->device != emergency->device || covered == 0 || (covered & ~mask) != 0) {
+            prev = index;
+            continue;
+        }
+
+        tl_events_unlink_locked(prev, index);
+        tl_events_finish_locked(index, TL_ERROR_SUPERSEDED);
+        count++;
+    }
+
+    if (count > 0) {
+        tl_cmd_note_superseded(emergency->device, count);
+    }
+}
+
+/*
+ * 將請求放入提交佇列
+ */
+static TL_ERROR_CODE tl_events_submit(const TL_EventRequest* request, TL_REQUEST_ID* request_id)
+{
+    TL_ERROR_CODE result;
+    int index;
+
+    if (g_events.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    result = tl_events_start_locked();
+    if (result != TL_SUCCESS) {
+        tl_mutex_unlock(g_events.lock);
+        tl_set_last_error(result);
+        return result;
+    }
+
+    if (g_events.free_list == TL_REQUEST_NIL) {
+        g_events.stats.rejected++;
+        tl_mutex_unlock(g_events.lock);
+        tl_set_last_error(TL_ERROR_QUEUE_FULL);
+        return TL_ERROR_QUEUE_FULL;
+    }
+    index = g_events.free_list;
+    g_events.free_list = g_events.requests[index].next;
+
+    g_events.requests[index] = *request;
+    g_events.requests[index].id = g_events.next_id++;
+    g_events.requests[index].submit_us = tl_time_now_us();
+    if (request->priority >= TL_PRIORITY_EMERGENCY) {
+        tl_events_supersede_locked(request);
+    }
+    tl_events_insert_locked(index);
+    if (tl_events_needs_worker_locked(index)) {
+        tl_events_spawn_locked();
+    }
+
+    g_events.stats.submitted++;
+    if (g_events.queue_depth > g_events.stats.max_depth) {
+        g_events.stats.max_depth = g_events.queue_depth;
+    }
+    tl_events_histogram_add(g_events.stats.depth, g_events.queue_depth);
+
+    if (request_id != NULL) {
+        *request_id = g_events.requests[index].id;
+    }
+    /* 保留的工作執行緒只接緊急命令，須喚醒全部以免遺失通知 */
+    tl_cond_broadcast(g_events.changed);
+    tl_mutex_unlock(g_events.lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_events_resolve_device(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 初始化事件提交系統
+ */
+TL_ERROR_CODE tl_events_init(void)
+{
+    int i;
+
+    memset(&g_events, 0, sizeof(g_events));
+    g_events.queue_head = TL_REQUEST_NIL;
+    g_events.queue_tail = TL_REQUEST_NIL;
+    g_events.free_list = TL_REQUEST_NIL;
+    g_events.done_head = TL_REQUEST_NIL;
+    g_events.done_tail = TL_REQUEST_NIL;
+    for (i = TL_EVENT_QUEUE_SIZE - 1; i >= 0; i--) {
+        g_events.requests[i].next = g_events.free_list;
+        g_events.free_list = i;
+    }
+    g_events.next_id = 1;
+
+    g_events.lock = tl_mutex_create();
+    g_events.changed = tl_cond_create();
+    if (g_events.lock == NULL || g_events.changed == NULL) {
+        tl_cond_destroy(g_events.changed);
+        tl_mutex_destroy(g_events.lock);
+        g_events.changed = NULL;
+        g_events.lock = NULL;
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉事件提交系統
+ */
+void tl_events_shutdown(void)
+{
+    int count;
+    int i;
+
+    if (g_events.lock == NULL) {
+        return;
+    }
+
+    /* 停止後不再增加工作執行緒 */
+    tl_mutex_lock(g_events.lock);
+    g_events.stopping = TL_TRUE;
+    count = g_events.worker_count;
+    tl_cond_broadcast(g_events.changed);
+    tl_mutex_unlock(g_events.lock);
+
+    for (i = 0; i < count; i++) {
+        tl_thread_join(g_events.workers[i]);
+    }
+    tl_poll_signal_destroy(g_events.signal);
+    tl_cond_destroy(g_events.changed);
+    tl_mutex_destroy(g_events.lock);
+    free(g_events.events);
+    memset(&g_events, 0, sizeof(g_events));
+}
+
+/*
+ * 取消指定裝置或群組的提交請求
+ */
+void tl_events_cancel_target(const void* target)
+{
+    TL_BOOL busy;
+    int prev;
+    int index;
+    int next;
+    int i;
+
+    if (g_events.lock == NULL || target == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    prev = TL_REQUEST_NIL;
+    for (index = g_events.queue_head; index != TL_REQUEST_NIL; index = next) {
+        next = g_events.requests[index].next;
+        if (g_events.requests[index].target != target) {
+            prev = index;
+            continue;
+        }
+        tl_events_unlink_locked(prev, index);
+        tl_events_finish_locked(index, TL_ERROR_DEVICE_NOT_OPEN);
+    }
+
+    /* 等待執行中的請求結束 */
+    do {
+        busy = TL_FALSE;
+        for (i = 0; i < g_events.worker_count; i++) {
+            if (g_events.busy[i] == target) {
+                busy = TL_TRUE;
+            }
+        }
+        if (busy) {
+            tl_cond_wait(g_events.changed, g_events.lock, TL_WAIT_INFINITE);
+        }
+    } while (busy);
+    tl_mutex_unlock(g_events.lock);
+
+    /* 取消的排程命令 */
+    tl_events_deliver();
+}
+
+/*
+ * 取得可輪詢的事件通知代碼
+ */
+TL_ERROR_CODE TL_GetPollFd(TL_POLL_FD* fd)
+{
+    TL_ERROR_CODE result;
+
+    if (fd == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (g_events.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    result = tl_events_start_locked();
+    if (result == TL_SUCCESS) {
+        *fd = tl_poll_signal_fd(g_events.signal);
+    }
+    tl_mutex_unlock(g_events.lock);
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/*
+ * 依命令建立提交請求 (驗證參數並解析目標)
+ */
+static TL_ERROR_CODE tl_events_prepare_command(const TL_TowerCommand* command, TL_EventRequest* request)
+{
+    TL_ERROR_CODE result;
+
+    if (command == NULL || command->type < TL_COMMAND_SET_LED || command->type > TL_COMMAND_GROUP_FRAME) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(request, 0, sizeof(*request));
+    request->kind = TL_EVENT_COMMAND_COMPLETE;
+    request->command = *command;
+    request->priority = command->priority;
+    if (command->type == TL_COMMAND_STOP_BUZZER || command->type == TL_COMMAND_CLEAR) {
+        request->priority = TL_PRIORITY_EMERGENCY;
+    }
+
+    if (command->type == TL_COMMAND_GROUP_FRAME) {
+        if (command->group == NULL) {
+            tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+            return TL_ERROR_INVALID_PARAMETER;
+        }
+        request->target = command->group;
+    } else {
+        result = tl_events_resolve_device(command->device, &request->device);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        request->command.device = request->device;
+        request->target = request->device;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 提交到期的排程命令
+ */
+TL_ERROR_CODE tl_events_submit_scheduled(const TL_TowerCommand* command, TL_TIMER_ID id,
+                                         TL_ScheduleCallback callback, void* user_data)
+{
+    TL_EventRequest request;
+    TL_ERROR_CODE result;
+
+    result = tl_events_prepare_command(command, &request);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    request.scheduled = TL_TRUE;
+    request.callback = callback;
+    request.user_data = user_data;
+    request.timer_id = id;
+
+    return tl_events_submit(&request, NULL);
+}
+
+/*
+ * 提交塔燈命令
+ */
+TL_ERROR_CODE TL_SubmitCommand(const TL_TowerCommand* command, TL_REQUEST_ID* request_id)
+{
+    TL_EventRequest request;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (request_id != NULL) {
+        *request_id = 0;
+    }
+    result = tl_events_prepare_command(command, &request);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    return tl_events_submit(&request, request_id);
+}
+
+/*
+ * 提交狀態讀取
+ */
+TL_ERROR_CODE TL_SubmitStatusRequest(TL_DEVICE_HANDLE device, unsigned int target_mask,
+                                     TL_REQUEST_ID* request_id)
+{
+    TL_EventRequest request;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (request_id != NULL) {
+        *request_id = 0;
+    }
+    if (target_mask == 0 || (target_mask & ~(unsigned int)TL_FRAME_ALL) != 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.kind = TL_EVENT_STATUS;
+    request.target_mask = target_mask;
+    result = tl_events_resolve_device(device, &request.device);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    request.target = request.device;
+
+    return tl_events_submit(&request, request_id);
+}
+
+/*
+ * 處理待處理的事件
+ */
+TL_ERROR_CODE TL_ProcessEvents(TL_EventCallback callback, void* user_data,
+                               unsigned int max_events, unsigned int* processed)
+{
+    TL_Event event;
+    unsigned int count = 0;
+    unsigned int limit;
+
+    if (processed != NULL) {
+        *processed = 0;
+    }
+    if (callback == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (g_events.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    /* 只處理進入時已存在的事件，回呼中產生的事件留待下次 */
+    limit = (unsigned int)g_events.event_count;
+    if (max_events != 0 && max_events < limit) {
+        limit = max_events;
+    }
+
+    while (count < limit && g_events.event_count > 0) {
+        event = g_events.events[g_events.event_head];
+        g_events.event_head = (g_events.event_head + 1) % g_events.event_capacity;
+        g_events.event_count--;
+        count++;
+
+        /* 回呼時不持有鎖，回呼中可再次提交 */
+        tl_mutex_unlock(g_events.lock);
+        callback(&event, user_data);
+        tl_mutex_lock(g_events.lock);
+    }
+
+    /* 事件全部處理完才使代碼回到不可讀 */
+    if (g_events.event_count == 0 && g_events.signaled) {
+        g_events.signaled = TL_FALSE;
+        tl_poll_signal_clear(g_events.signal);
+    }
+    tl_mutex_unlock(g_events.lock);
+
+    if (processed != NULL) {
+        *processed = count;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得提交佇列統計
+ */
+TL_ERROR_CODE TL_GetQueueStats(TL_QueueStats* stats, TL_BOOL reset)
+{
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (g_events.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_events.lock);
+    *stats = g_events.stats;
+    if (reset) {
+        memset(&g_events.stats, 0, sizeof(g_events.stats));
+    }
+    tl_mutex_unlock(g_events.lock);
+    return TL_SUCCESS;
+}
@@ -0,0 +1,450 @@
+﻿/*
+ * tl_filter.c
+ *
+ * 塔燈通訊控制函式庫 - 輸入去彈跳與遲滯濾波實現
+ *
+ * 感測器抖動時，警報狀態可能每秒切換數十次；每次切換都送出設定命令，
+ * 不但佔用裝置頻寬，塔燈也閃爍得無法辨識。濾波器位於命令送出之前，
+ * 每個LED層級與蜂鳴器各自設定：
+ *   - 去彈跳：新的輸入須保持不變 rise_debounce_ms (轉為點亮或改變點亮內容)
+ *     或 fall_debounce_ms (轉為關閉) 才會送出，期間被取代的輸入不送出；
+ *   - 遲滯：輸出點亮後至少保持 min_on_ms，關閉後至少保持 min_off_ms
+ *     才會切換。
+ * 保持不變的輸入最遲在 max(去彈跳時間, 最短保持時間) 後送出，
+ * 因此真正的狀態改變有明確的最大延遲。
+ *
+ * 每台使用濾波器的裝置有一個濾波執行緒，於輸入到期時送出設定命令。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 輸入濾波器 */
+struct TL_Filter {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 輸入或設定改變、停止 */
+    TL_Thread* thread;                /* 濾波執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_FilterConfig config[TL_TARGET_COUNT];        /* 各目標的濾波設定 */
+    TL_TowerState input;              /* 最新的輸入 */
+    unsigned int input_mask;          /* 已有輸入的目標 */
+    TL_TowerState output;             /* 最後送出的輸出 */
+    unsigned int output_mask;         /* 已送出輸出的目標 */
+    unsigned long long input_us[TL_TARGET_COUNT];   /* 輸入最後改變的時間 */
+    unsigned long long output_us[TL_TARGET_COUNT];  /* 輸出最後改變的時間 */
+    unsigned long long retry_us[TL_TARGET_COUNT];   /* 送出失敗後的重試時間 */
+    TL_FilterStats stats[TL_TARGET_COUNT];          /* 各目標的統計 */
+};
+
+/*
+ * 目標是否有尚未送出的輸入 (須持有鎖)
+ */
+static TL_BOOL tl_filter_pending_locked(const TL_Filter* filter, int target)
+{
+    unsigned int bit = 1u << target;
+
+    if (!(filter->input_mask & bit)) {
+        return TL_FALSE;
+    }
+    if (!(filter->output_mask & bit)) {
+        return TL_TRUE;
+    }
+    return (TL_DiffTowerState(filter->input, filter->output) & bit) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 計算目標的輸入可以送出的時間 (須持有鎖)
+ */
+static unsigned long long tl_filter_ready_locked(const TL_Filter* filter, int target)
+{
+    const TL_FilterConfig* config = &filter->config[target];
+    TL_BOOL input_active = tl_tower_state_active(filter->input, target);
+    TL_BOOL output_active;
+    unsigned long long ready_us;
+    unsigned long long hold_us;
+
+    /* 去彈跳：輸入須保持不變 */
+    ready_us = filter->input_us[target] +
+        (unsigned long long)(input_active ? config->rise_debounce_ms : config->fall_debounce_ms) * 1000;
+
+    /* 遲滯：點亮與關閉之間切換時，目前的輸出須保持最短時間 */
+    if (filter->output_mask & (1u << target)) {
+        output_active = tl_tower_state_active(filter->output, target);
+        if (output_active != input_active) {
+            hold_us = filter->output_us[target] +
+                (unsigned long long)(output_active ? config->min_on_ms : config->min_off_ms) * 1000;
+            if (hold_us > ready_us) {
+                ready_us = hold_us;
+            }
+        }
+    }
+
+    if (filter->retry_us[target] > ready_us) {
+        ready_us = filter->retry_us[target];
+    }
+    return ready_us;
+}
+
+/*
+ * 送出到期的輸入 (進入與離開時持有鎖)
+ */
+static void tl_filter_push_locked(TL_Filter* filter, unsigned int due)
+{
+    TL_DeviceContext* device = filter->device;
+    TL_TowerState state = filter->input;
+    TL_TowerState byte_mask;
+    TL_TowerFrame frame;
+    TL_FilterStats* stats;
+    TL_ERROR_CODE result;
+    unsigned long long input_us;
+    unsigned long long now_us;
+    unsigned long long delay_us;
+    int target;
+
+    /* 輸入只經由 TL_PackTowerState 寫入，必定可還原 */
+    TL_UnpackTowerState(state, &frame);
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(due & (1u << target))) {
+            continue;
+        }
+        input_us = filter->input_us[target];
+
+        tl_mutex_unlock(filter->lock);
+        if (target == TL_TARGET_BUZZER) {
+            result = TL_DeviceSetBuzzer(device, &frame.buzzer);
+        } else {
+            result = TL_DeviceSetLED(device, (TL_LAYER)target, &frame.layers[target]);
+        }
+        tl_mutex_lock(filter->lock);
+
+        stats = &filter->stats[target];
+        now_us = tl_time_now_us();
+        if (result != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE
+            printf("[tl_filter] 目標 %d 設定失敗 => %d\n", target, (int)result);
+#endif
+            stats->failures++;
+            filter->retry_us[target] = now_us + TL_FILTER_RETRY_MS * 1000ULL;
+            continue;
+        }
+
+        /* 記錄送出的值；送出期間輸入又改變時，下一輪再依新的輸入判斷 */
+        byte_mask = (TL_TowerState)0xFF << (target * 8);
+        filter->output = (filter->output & ~byte_mask) | (state & byte_mask);
+        filter->output_mask |= 1u << target;
+        filter->output_us[target] = now_us;
+        filter->retry_us[target] = 0;
+
+        delay_us = now_us - input_us;
+        stats->outputs++;
+        stats->last_delay_us = delay_us;
+        if (delay_us > stats->max_delay_us) {
+            stats->max_delay_us = delay_us;
+        }
+    }
+}
+
+/*
+ * 濾波執行緒
+ */
+static void tl_filter_main(void* arg)
+{
+    TL_Filter* filter = (TL_Filter*)arg;
+    unsigned long long now_us;
+    unsigned long long ready_us;
+    unsigned long long wake_us;
+    unsigned int due;
+    int target;
+
+    tl_mutex_lock(filter->lock);
+    while (!filter->stopping) {
+        now_us = tl_time_now_us();
+        due = 0;
+        wake_us = 0;
+
+        for (target = 0; target < TL_TARGET_COUNT; target++) {
+            if (!tl_filter_pending_locked(filter, target)) {
+                continue;
+            }
+            ready_us = tl_filter_ready_locked(filter, target);
+            if (ready_us <= now_us) {
+                due |= 1u << target;
+            } else if (wake_us == 0 || ready_us < wake_us) {
+                wake_us = ready_us;
+            }
+        }
+
+        if (due != 0) {
+            tl_filter_push_locked(filter, due);
+            continue;
+        }
+
+        /* 等到最早到期的輸入，或有新的輸入 */
+        tl_cond_wait(filter->changed, filter->lock,
+            (wake_us == 0) ? TL_WAIT_INFINITE : (unsigned long)((wake_us - now_us + 999) / 1000));
+    }
+    tl_mutex_unlock(filter->lock);
+}
+
+/*
+ * 釋放濾波器
+ */
+static void tl_filter_free(TL_Filter* filter)
+{
+    tl_cond_destroy(filter->changed);
+    tl_mutex_destroy(filter->lock);
+    free(filter);
+}
+
+/*
+ * 取得裝置的濾波器，必要時建立 (須持有 state_lock；濾波器在釋放 state_lock 前不會被釋放)
+ */
+static TL_ERROR_CODE tl_filter_get_locked(TL_DeviceContext* device, TL_BOOL create, TL_Filter** result)
+{
+    TL_Filter* filter;
+
+    filter = device->filter;
+    if (filter == NULL && create) {
+        filter = (TL_Filter*)calloc(1, sizeof(TL_Filter));
+        if (filter != NULL) {
+            filter->device = device;
+            filter->lock = tl_mutex_create();
+            filter->changed = tl_cond_create();
+            if (filter->lock == NULL || filter->changed == NULL) {
+                tl_filter_free(filter);
+                filter = NULL;
+            } else {
+                filter->thread = tl_thread_create(tl_filter_main, filter);
+                if (filter->thread == NULL) {
+                    tl_filter_free(filter);
+                    filter = NULL;
+                }
+            }
+        }
+        if (filter == NULL) {
+            tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+        device->filter = filter;
+    }
+
+    *result = filter;
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止輸入濾波器
+ */
+void tl_filter_stop(TL_DeviceContext* device)
+{
+    TL_Filter* filter;
+
+    tl_mutex_lock(device->state_lock);
+    filter = device->filter;
+    device->filter = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (filter == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(filter->lock);
+    filter->stopping = TL_TRUE;
+    tl_cond_broadcast(filter->changed);
+    tl_mutex_unlock(filter->lock);
+
+    tl_thread_join(filter->thread);
+    tl_filter_free(filter);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_filter_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 將一個目標的輸入交給濾波器
+ */
+static TL_ERROR_CODE tl_filter_input(TL_DEVICE_HANDLE device, int target, const TL_TowerFrame* frame)
+{
+    TL_DeviceContext* context;
+    TL_Filter* filter;
+    TL_TowerState state;
+    TL_TowerState byte_mask;
+    TL_ERROR_CODE result;
+    unsigned int bit = 1u << target;
+
+    /* 壓縮時一併檢查狀態值是否有效 */
+    result = TL_PackTowerState(frame, &state);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    result = tl_filter_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 持有 state_lock 期間濾波器不會被 tl_filter_stop 釋放 (濾波執行緒送出命令前會先釋放濾波器的鎖) */
+    tl_mutex_lock(context->state_lock);
+    result = tl_filter_get_locked(context, TL_TRUE, &filter);
+    if (result != TL_SUCCESS) {
+        tl_mutex_unlock(context->state_lock);
+        return result;
+    }
+
+    byte_mask = (TL_TowerState)0xFF << (target * 8);
+
+    tl_mutex_lock(filter->lock);
+    filter->stats[target].inputs++;
+    if (!(filter->input_mask & bit) || ((filter->input ^ state) & byte_mask) != 0) {
+        /* 尚未送出的輸入被新的輸入取代 */
+        if (tl_filter_pending_locked(filter, target)) {
+            filter->stats[target].suppressed++;
+        }
+        filter->input = (filter->input & ~byte_mask) | (state & byte_mask);
+        filter->input_mask |= bit;
+        filter->input_us[target] = tl_time_now_us();
+        tl_cond_broadcast(filter->changed);
+    }
+    tl_mutex_unlock(filter->lock);
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 設定輸入濾波參數
+ */
+TL_ERROR_CODE TL_SetFilterConfig(TL_DEVICE_HANDLE device, unsigned int target_mask, const TL_FilterConfig* config)
+{
+    TL_DeviceContext* context;
+    TL_Filter* filter;
+    TL_ERROR_CODE result;
+    int target;
+
+    /* 參數驗證 */
+    if (config == NULL || target_mask == 0 || (target_mask & ~(unsigned int)TL_FRAME_ALL) != 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_filter_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_mutex_lock(context->state_lock);
+    result = tl_filter_get_locked(context, TL_TRUE, &filter);
+    if (result != TL_SUCCESS) {
+        tl_mutex_unlock(context->state_lock);
+        return result;
+    }
+
+    /* 喚醒濾波執行緒，以新的設定重新計算到期時間 */
+    tl_mutex_lock(filter->lock);
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (target_mask & (1u << target)) {
+            filter->config[target] = *config;
+        }
+    }
+    tl_cond_broadcast(filter->changed);
+    tl_mutex_unlock(filter->lock);
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 經由濾波器設定LED層級
+ */
+TL_ERROR_CODE TL_FilterLED(TL_DEVICE_HANDLE device, TL_LAYER layer, const TL_LEDStatus* status)
+{
+    TL_TowerFrame frame;
+
+    /* 參數驗證 */
+    if (status == NULL || layer < TL_LAYER_ONE || layer > TL_LAYER_THREE) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.layers[layer] = *status;
+    frame.target_mask = 1u << layer;
+    return tl_filter_input(device, (int)layer, &frame);
+}
+
+/*
+ * 經由濾波器設定蜂鳴器
+ */
+TL_ERROR_CODE TL_FilterBuzzer(TL_DEVICE_HANDLE device, const TL_BuzzerStatus* status)
+{
+    TL_TowerFrame frame;
+
+    /* 參數驗證 */
+    if (status == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.buzzer = *status;
+    frame.target_mask = TL_FRAME_BUZZER;
+    return tl_filter_input(device, TL_TARGET_BUZZER, &frame);
+}
+
+/*
+ * 停止裝置的輸入濾波
+ */
+TL_ERROR_CODE TL_StopFilter(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_filter_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_filter_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得輸入濾波統計
+ */
+TL_ERROR_CODE TL_GetFilterStats(TL_DEVICE_HANDLE device, int target, TL_FilterStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_Filter* filter;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL || target < 0 || target >= TL_TARGET_COUNT) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_filter_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    filter = context->filter;
+    if (filter != NULL) {
+        tl_mutex_lock(filter->lock);
+        *stats = filter->stats[target];
+        stats->pending = tl_filter_pending_locked(filter, target);
+        tl_mutex_unlock(filter->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
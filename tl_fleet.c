@@ -0,0 +1,395 @@
+﻿/*
+ * tl_fleet.c
+ *
+ * 塔燈通訊控制函式庫 - 塔燈狀態集合實現
+ *
+ * 監控節點需要週期性地從數千座塔燈中找出期望狀態與實際狀態不同者。
+ * 集合以兩個連續的 TL_TowerState 陣列 (期望、實際) 存放狀態，掃描時
+ * 每次比較 8 座塔燈：支援 AVX2 的處理器以一個 256 位元比較完成，
+ * 否則以兩個 SSE2 比較或純量迴圈完成；全部一致的區塊只需一次比較即可略過。
+ * 陣列長度補齊為 8 的倍數，補齊部分兩邊皆為 0，永遠視為一致。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* x86 平台使用 SSE2 (x64 必定支援)，並在執行時偵測 AVX2 */
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TL_FLEET_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define TL_FLEET_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TL_FLEET_AVX2_TARGET
+#else
+#define TL_FLEET_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+/* 每次比較的塔燈數與陣列對齊 (位元組) */
+#define TL_FLEET_BLOCK  8
+#define TL_FLEET_ALIGN  32
+
+/*
+ * 尋找第一個含有不一致塔燈的區塊
+ *
+ * 參數：desired, actual 狀態陣列 (已對齊)
+ * 參數：block 開始的區塊
+ * 參數：block_count 區塊總數
+ * 參數：mask 用於存儲該區塊的不一致遮罩 (bit i 為區塊中第 i 座塔燈)
+ * 返回值：區塊索引，沒有不一致的區塊時返回 block_count
+ */
+typedef size_t (*TL_FleetFindFunc)(const TL_TowerState* desired, const TL_TowerState* actual,
+                                   size_t block, size_t block_count, unsigned int* mask);
+
+/* 塔燈狀態集合 */
+struct TL_Fleet {
+    TL_Mutex* lock;                   /* 保護狀態陣列 */
+    size_t count;                     /* 塔燈數量 */
+    size_t block_count;               /* 區塊數量 */
+    TL_TowerState* desired;           /* 期望狀態 (已對齊) */
+    TL_TowerState* actual;            /* 實際狀態 (已對齊) */
+    void* desired_buffer;             /* desired 的配置位址 */
+    void* actual_buffer;              /* actual 的配置位址 */
+    TL_FleetFindFunc find;            /* 掃描函數 */
+};
+
+#ifndef TL_FLEET_SSE2
+/*
+ * 純量掃描 (不支援 SSE2 的平台)
+ */
+static size_t tl_fleet_find_scalar(const TL_TowerState* desired, const TL_TowerState* actual,
+                                   size_t block, size_t block_count, unsigned int* mask)
+{
+    const TL_TowerState* d;
+    const TL_TowerState* a;
+    unsigned int dirty;
+    int i;
+
+    for (; block < block_count; block++) {
+        d = desired + block * TL_FLEET_BLOCK;
+        a = actual + block * TL_FLEET_BLOCK;
+        dirty = 0;
+        for (i = 0; i < TL_FLEET_BLOCK; i++) {
+            if (d[i] != a[i]) {
+                dirty |= 1u << i;
+            }
+        }
+        if (dirty != 0) {
+            *mask = dirty;
+            return block;
+        }
+    }
+    return block_count;
+}
+#endif
+
+#ifdef TL_FLEET_SSE2
+/*
+ * SSE2 掃描 - 每個區塊兩次 4 座的比較
+ */
+static size_t tl_fleet_find_sse2(const TL_TowerState* desired, const TL_TowerState* actual,
+                                 size_t block, size_t block_count, unsigned int* mask)
+{
+    const __m128i* d;
+    const __m128i* a;
+    unsigned int equal;
+
+    for (; block < block_count; block++) {
+        d = (const __m128i*)(desired + block * TL_FLEET_BLOCK);
+        a = (const __m128i*)(actual + block * TL_FLEET_BLOCK);
+        equal = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmpeq_epi32(_mm_load_si128(d), _mm_load_si128(a)))) |
+                ((unsigned int)_mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmpeq_epi32(_mm_load_si128(d + 1), _mm_load_si128(a + 1)))) << 4);
+        if (equal != 0xFF) {
+            *mask = equal ^ 0xFF;
+            return block;
+        }
+    }
+    return block_count;
+}
+#endif
+
+#ifdef TL_FLEET_AVX2
+/*
+ * AVX2 掃描 - 每個區塊一次 8 座的比較
+ */
+TL_FLEET_AVX2_TARGET
+static size_t tl_fleet_find_avx2(const TL_TowerState* desired, const TL_TowerState* actual,
+                                 size_t block, size_t block_count, unsigned int* mask)
+{
+    __m256i equal;
+    unsigned int bits;
+
+    for (; block < block_count; block++) {
+        equal = _mm256_cmpeq_epi32(
+            _mm256_load_si256((const __m256i*)(desired + block * TL_FLEET_BLOCK)),
+            _mm256_load_si256((const __m256i*)(actual + block * TL_FLEET_BLOCK)));
+        bits = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(equal));
+        if (bits != 0xFF) {
+            *mask = bits ^ 0xFF;
+            return block;
+        }
+    }
+    return block_count;
+}
+
+/*
+ * 偵測處理器與作業系統是否支援 AVX2
+ */
+static TL_BOOL tl_fleet_cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return TL_FALSE;
+    }
+    /* 需要 OSXSAVE 與 AVX，且作業系統會保存 YMM 暫存器 */
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+        return TL_FALSE;
+    }
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return TL_FALSE;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) ? TL_TRUE : TL_FALSE;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? TL_TRUE : TL_FALSE;
+#endif
+}
+#endif
+
+/*
+ * 選擇目前處理器可用的掃描函數
+ */
+static TL_FleetFindFunc tl_fleet_select_find(void)
+{
+#ifdef TL_FLEET_AVX2
+    if (tl_fleet_cpu_has_avx2()) {
+        return tl_fleet_find_avx2;
+    }
+#endif
+#ifdef TL_FLEET_SSE2
+    return tl_fleet_find_sse2;
+#else
+    return tl_fleet_find_scalar;
+#endif
+}
+
+/*
+ * 配置對齊且清為 0 的狀態陣列
+ */
+static TL_TowerState* tl_fleet_alloc_states(size_t count, void** buffer)
+{
+    size_t address;
+
+    *buffer = calloc(count * sizeof(TL_TowerState) + TL_FLEET_ALIGN, 1);
+    if (*buffer == NULL) {
+        return NULL;
+    }
+    address = ((size_t)*buffer + TL_FLEET_ALIGN - 1) & ~(size_t)(TL_FLEET_ALIGN - 1);
+    return (TL_TowerState*)address;
+}
+
+/*
+ * 釋放集合
+ */
+static void tl_fleet_free(struct TL_Fleet* fleet)
+{
+    tl_mutex_destroy(fleet->lock);
+    free(fleet->desired_buffer);
+    free(fleet->actual_buffer);
+    free(fleet);
+}
+
+/*
+ * 建立塔燈狀態集合
+ */
+TL_ERROR_CODE TL_CreateFleet(size_t tower_count, TL_FLEET_HANDLE* fleet_handle)
+{
+    struct TL_Fleet* fleet;
+    size_t block_count;
+
+    /* 參數驗證 */
+    if (tower_count == 0 || fleet_handle == NULL ||
+        tower_count > ((size_t)-1 - TL_FLEET_ALIGN) / sizeof(TL_TowerState) - TL_FLEET_BLOCK) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *fleet_handle = NULL;
+
+    block_count = (tower_count + TL_FLEET_BLOCK - 1) / TL_FLEET_BLOCK;
+
+    fleet = (struct TL_Fleet*)calloc(1, sizeof(struct TL_Fleet));
+    if (fleet == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    fleet->lock = tl_mutex_create();
+    fleet->desired = tl_fleet_alloc_states(block_count * TL_FLEET_BLOCK, &fleet->desired_buffer);
+    fleet->actual = tl_fleet_alloc_states(block_count * TL_FLEET_BLOCK, &fleet->actual_buffer);
+    if (fleet->lock == NULL || fleet->desired == NULL || fleet->actual == NULL) {
+        tl_fleet_free(fleet);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    fleet->count = tower_count;
+    fleet->block_count = block_count;
+    fleet->find = tl_fleet_select_find();
+
+    *fleet_handle = fleet;
+    return TL_SUCCESS;
+}
+
+/*
+ * 銷毀塔燈狀態集合
+ */
+TL_ERROR_CODE TL_DestroyFleet(TL_FLEET_HANDLE fleet)
+{
+    if (fleet == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    tl_fleet_free(fleet);
+    return TL_SUCCESS;
+}
+
+/*
+ * 更新連續多座塔燈的狀態
+ */
+static TL_ERROR_CODE tl_fleet_store(struct TL_Fleet* fleet, TL_TowerState* target, size_t first,
+                                    const TL_TowerState* states, size_t count)
+{
+    /* 參數驗證 */
+    if (fleet == NULL || states == NULL || first > fleet->count || count > fleet->count - first) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    tl_mutex_lock(fleet->lock);
+    memcpy(target + first, states, count * sizeof(TL_TowerState));
+    tl_mutex_unlock(fleet->lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 更新連續多座塔燈的期望狀態
+ */
+TL_ERROR_CODE TL_FleetSetDesired(TL_FLEET_HANDLE fleet, size_t first,
+                                 const TL_TowerState* states, size_t count)
+{
+    if (fleet == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    return tl_fleet_store(fleet, fleet->desired, first, states, count);
+}
+
+/*
+ * 更新連續多座塔燈的實際狀態
+ */
+TL_ERROR_CODE TL_FleetSetActual(TL_FLEET_HANDLE fleet, size_t first,
+                                const TL_TowerState* states, size_t count)
+{
+    if (fleet == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    return tl_fleet_store(fleet, fleet->actual, first, states, count);
+}
+
+/*
+ * 取得單一塔燈的期望與實際狀態
+ */
+TL_ERROR_CODE TL_FleetGetState(TL_FLEET_HANDLE fleet, size_t index,
+                               TL_TowerState* desired, TL_TowerState* actual)
+{
+    /* 參數驗證 */
+    if (fleet == NULL || index >= fleet->count) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    tl_mutex_lock(fleet->lock);
+    if (desired != NULL) {
+        *desired = fleet->desired[index];
+    }
+    if (actual != NULL) {
+        *actual = fleet->actual[index];
+    }
+    tl_mutex_unlock(fleet->lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 找出期望狀態與實際狀態不同的塔燈
+ */
+TL_ERROR_CODE TL_FleetScanDirty(TL_FLEET_HANDLE fleet, size_t* cursor, size_t* indices,
+                                unsigned int* masks, size_t max_count, size_t* found)
+{
+    size_t position;
+    size_t block;
+    size_t index;
+    size_t n = 0;
+    unsigned int mask;
+    unsigned int bit;
+
+    /* 參數驗證 */
+    if (fleet == NULL || cursor == NULL || indices == NULL || max_count == 0 || found == NULL ||
+        *cursor > fleet->count) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    position = *cursor;
+    tl_mutex_lock(fleet->lock);
+    while (n < max_count && position < fleet->count) {
+        block = fleet->find(fleet->desired, fleet->actual, position / TL_FLEET_BLOCK,
+                            fleet->block_count, &mask);
+        if (block == fleet->block_count) {
+            position = fleet->count;
+            break;
+        }
+
+        /* 略過區塊中已掃描過的塔燈 */
+        if (block * TL_FLEET_BLOCK < position) {
+            mask &= 0xFFu << (position - block * TL_FLEET_BLOCK);
+        }
+
+        for (bit = 0; mask != 0 && n < max_count; bit++) {
+            if (!(mask & (1u << bit))) {
+                continue;
+            }
+            mask &= ~(1u << bit);
+            index = block * TL_FLEET_BLOCK + bit;
+            indices[n] = index;
+            if (masks != NULL) {
+                masks[n] = TL_DiffTowerState(fleet->desired[index], fleet->actual[index]);
+            }
+            n++;
+            position = index + 1;
+        }
+        if (mask == 0) {
+            position = (block + 1) * TL_FLEET_BLOCK;
+        }
+    }
+    tl_mutex_unlock(fleet->lock);
+
+    *cursor = (position < fleet->count) ? position : fleet->count;
+    *found = n;
+    return TL_SUCCESS;
+}
@@ -0,0 +1,370 @@
+﻿/*
+ * tl_group.c
+ *
+ * 塔燈通訊控制函式庫 - 裝置群組實現
+ *
+ * 將同一個塔燈畫面同時套用到多台塔燈。每台裝置有一個常駐的工作執行緒，
+ * 畫面的設定命令只建構一次，由所有工作執行緒共用；使用屏障時，
+ * 所有工作執行緒都就緒後才一起開始寫入，各塔燈的可見時間差
+ * 約為單一塔燈的命令往返時間，而不是逐台設定時的總和。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+struct TL_DeviceGroup;
+
+/* 群組成員 */
+typedef struct {
+    struct TL_DeviceGroup* group;     /* 所屬群組 */
+    TL_DeviceContext* device;         /* 裝置，NULL 表示裝置已關閉 (受群組鎖保護) */
+    TL_Thread* thread;                /* 工作執行緒 */
+    TL_ERROR_CODE result;             /* 本次套用結果 */
+    unsigned long long complete_us;   /* 本次完成時間 (單調時間) */
+} TL_GroupMember;
+
+/* 裝置群組 */
+struct TL_DeviceGroup {
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 工作或進度改變 */
+    TL_Mutex* apply_lock;             /* 序列化 TL_GroupApplyFrame */
+    TL_GroupMember* members;          /* 成員陣列 */
+    size_t count;                     /* 成員數量 */
+    TL_BOOL stopping;                 /* 正在銷毀 */
+    unsigned long generation;         /* 每次套用遞增，工作執行緒據此得知有新工作 */
+    TL_PreparedFrame prepared;        /* 本次套用的畫面 (所有成員共用) */
+    TL_BOOL released;                 /* 是否已釋放寫入 */
+    size_t ready_count;               /* 已到達屏障的成員數 */
+    size_t done_count;                /* 已完成的成員數 */
+    unsigned long long release_us;    /* 釋放寫入的時間 */
+    struct TL_DeviceGroup* next;      /* 已建立的群組串列 (受 devices_lock 保護) */
+};
+
+/*
+ * 工作執行緒
+ */
+static void tl_group_worker_main(void* arg)
+{
+    TL_GroupMember* member = (TL_GroupMember*)arg;
+    struct TL_DeviceGroup* group = member->group;
+    unsigned long seen = 0;
+    TL_DeviceContext* device;
+    TL_ERROR_CODE result;
+
+    tl_mutex_lock(group->lock);
+    for (;;) {
+        while (!group->stopping && group->generation == seen) {
+            tl_cond_wait(group->changed, group->lock, TL_WAIT_INFINITE);
+        }
+        if (group->stopping) {
+            break;
+        }
+        seen = group->generation;
+
+        /* 屏障：最後一個就緒的成員釋放所有人 */
+        if (!group->released) {
+            group->ready_count++;
+            if (group->ready_count == group->count) {
+                group->released = TL_TRUE;
+                group->release_us = tl_time_now_us();
+                tl_cond_broadcast(group->changed);
+            }
+            while (!group->released) {
+                tl_cond_wait(group->changed, group->lock, TL_WAIT_INFINITE);
+            }
+        }
+        device = member->device;
+        tl_mutex_unlock(group->lock);
+
+        /*
+         * 畫面在套用期間不會改變，可不持有鎖讀取；
+         * 關閉裝置時會等待 apply_lock，套用期間裝置不會被釋放
+         */
+        if (device == NULL) {
+            result = TL_ERROR_DEVICE_NOT_OPEN;
+        } else {
+            result = tl_validate_device(device);
+            if (result == TL_SUCCESS) {
+                result = tl_cmd_apply_frame(device, &group->prepared);
+            }
+        }
+
+        tl_mutex_lock(group->lock);
+        member->result = result;
+        member->complete_us = tl_time_now_us();
+        group->done_count++;
+        tl_cond_broadcast(group->changed);
+    }
+    tl_mutex_unlock(group->lock);
+}
+
+/*
+ * 停止所有工作執行緒並釋放群組
+ */
+static void tl_group_free(struct TL_DeviceGroup* group)
+{
+    size_t i;
+
+    tl_mutex_lock(group->lock);
+    group->stopping = TL_TRUE;
+    tl_cond_broadcast(group->changed);
+    tl_mutex_unlock(group->lock);
+
+    for (i = 0; i < group->count; i++) {
+        tl_thread_join(group->members[i].thread);
+    }
+
+    tl_mutex_destroy(group->apply_lock);
+    tl_cond_destroy(group->changed);
+    tl_mutex_destroy(group->lock);
+    free(group->members);
+    free(group);
+}
+
+/*
+ * 檢查裝置是否仍在開啟的裝置串列中 (呼叫端持有 devices_lock)
+ */
+static TL_BOOL tl_group_device_listed(TL_InternalState* state, const TL_DeviceContext* device)
+{
+    const TL_DeviceContext* entry;
+
+    if (device == &state->device) {
+        return TL_TRUE;
+    }
+    for (entry = state->extra_devices; entry != NULL; entry = entry->next) {
+        if (entry == device) {
+            return TL_TRUE;
+        }
+    }
+    return TL_FALSE;
+}
+
+/*
+ * 將裝置從所有裝置群組中移除
+ */
+void tl_group_detach_device(TL_DeviceContext* device)
+{
+    TL_InternalState* state = tl_get_internal_state();
+    struct TL_DeviceGroup* group;
+    size_t i;
+
+    /* 鎖順序：devices_lock → apply_lock → 群組鎖 */
+    tl_mutex_lock(state->devices_lock);
+    for (group = state->groups; group != NULL; group = group->next) {
+        tl_mutex_lock(group->apply_lock);
+        tl_mutex_lock(group->lock);
+        for (i = 0; i < group->count; i++) {
+            if (group->members[i].device == device) {
+                group->members[i].device = NULL;
+            }
+        }
+        tl_mutex_unlock(group->lock);
+        tl_mutex_unlock(group->apply_lock);
+    }
+    tl_mutex_unlock(state->devices_lock);
+}
+
+/*
+ * 建立裝置群組
+ */
+TL_ERROR_CODE TL_CreateDeviceGroup(const TL_DEVICE_HANDLE* devices, size_t device_count,
+                                   TL_GROUP_HANDLE* group_handle)
+{
+    TL_InternalState* state = tl_get_internal_state();
+    struct TL_DeviceGroup* group;
+    TL_ERROR_CODE result;
+    size_t i;
+    size_t j;
+
+    /* 參數驗證 */
+    if (devices == NULL || device_count == 0 || group_handle == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *group_handle = NULL;
+
+    for (i = 0; i < device_count; i++) {
+        result = tl_validate_device(devices[i]);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        /* 同一台裝置不可重複加入 */
+        for (j = 0; j < i; j++) {
+            if (devices[j] == devices[i]) {
+                tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+                return TL_ERROR_INVALID_PARAMETER;
+            }
+        }
+    }
+
+    group = (struct TL_DeviceGroup*)calloc(1, sizeof(struct TL_DeviceGroup));
+    if (group == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    group->members = (TL_GroupMember*)calloc(device_count, sizeof(TL_GroupMember));
+    group->lock = tl_mutex_create();
+    group->changed = tl_cond_create();
+    group->apply_lock = tl_mutex_create();
+    if (group->members == NULL || group->lock == NULL || group->changed == NULL || group->apply_lock == NULL) {
+        tl_mutex_destroy(group->apply_lock);
+        tl_cond_destroy(group->changed);
+        tl_mutex_destroy(group->lock);
+        free(group->members);
+        free(group);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* 建立工作執行緒；失敗時只釋放已建立的部分 */
+    for (i = 0; i < device_count; i++) {
+        group->members[i].group = group;
+        group->members[i].device = devices[i];
+        group->members[i].thread = tl_thread_create(tl_group_worker_main, &group->members[i]);
+        if (group->members[i].thread == NULL) {
+            group->count = i;
+            tl_group_free(group);
+            tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    group->count = device_count;
+
+    /* 加入群組串列，關閉裝置時才能移除成員；期間已關閉的裝置不可加入 */
+    tl_mutex_lock(state->devices_lock);
+    for (i = 0; i < device_count; i++) {
+        if (!tl_group_device_listed(state, devices[i])) {
+            tl_mutex_unlock(state->devices_lock);
+            tl_group_free(group);
+            tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+            return TL_ERROR_DEVICE_NOT_OPEN;
+        }
+    }
+    group->next = state->groups;
+    state->groups = group;
+    tl_mutex_unlock(state->devices_lock);
+
+    *group_handle = group;
+    return TL_SUCCESS;
+}
+
+/*
+ * 銷毀裝置群組
+ */
+TL_ERROR_CODE TL_DestroyDeviceGroup(TL_GROUP_HANDLE group)
+{
+    TL_InternalState* state = tl_get_internal_state();
+    struct TL_DeviceGroup** link;
+
+    if (group == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 從群組串列中移除 */
+    tl_mutex_lock(state->devices_lock);
+    for (link = &state->groups; *link != NULL; link = &(*link)->next) {
+        if (*link == group) {
+            *link = group->next;
+            break;
+        }
+    }
+    tl_mutex_unlock(state->devices_lock);
+
+    /* 取消尚未執行的群組命令與排程 */
+    tl_scheduler_cancel_target(group);
+    tl_events_cancel_target(group);
+    tl_group_free(group);
+    return TL_SUCCESS;
+}
+
+/*
+ * 將同一個塔燈畫面套用到群組中的所有裝置
+ */
+TL_ERROR_CODE TL_GroupApplyFrame(TL_GROUP_HANDLE group, const TL_TowerFrame* frame,
+                                 TL_BOOL use_barrier, TL_GroupDeviceResult* results,
+                                 TL_GroupStats* stats)
+{
+    TL_ERROR_CODE result;
+    TL_ERROR_CODE first_error = TL_SUCCESS;
+    unsigned long long first_us = 0;
+    unsigned long long last_us = 0;
+    unsigned int success_count = 0;
+    size_t i;
+
+    /* 參數驗證 */
+    if (group == NULL || frame == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    tl_mutex_lock(group->apply_lock);
+
+    /* 命令只建構一次 */
+    result = tl_cmd_prepare_frame(frame, &group->prepared);
+    if (result != TL_SUCCESS) {
+        tl_mutex_unlock(group->apply_lock);
+        return result;
+    }
+
+    /* 發布工作並等待所有成員完成 */
+    tl_mutex_lock(group->lock);
+    group->ready_count = 0;
+    group->done_count = 0;
+    group->released = use_barrier ? TL_FALSE : TL_TRUE;
+    group->release_us = tl_time_now_us();
+    group->generation++;
+    tl_cond_broadcast(group->changed);
+    while (group->done_count < group->count) {
+        tl_cond_wait(group->changed, group->lock, TL_WAIT_INFINITE);
+    }
+
+    /* 統計各裝置的完成時間 */
+    for (i = 0; i < group->count; i++) {
+        TL_GroupMember* member = &group->members[i];
+        unsigned long long elapsed_us = member->complete_us - group->release_us;
+
+        if (results != NULL) {
+            results[i].result = member->result;
+            results[i].complete_us = elapsed_us;
+        }
+
+        if (member->result == TL_SUCCESS) {
+            if (success_count == 0 || member->complete_us < first_us) {
+                first_us = member->complete_us;
+            }
+            if (success_count == 0 || member->complete_us > last_us) {
+                last_us = member->complete_us;
+            }
+            success_count++;
+        } else if (first_error == TL_SUCCESS) {
+            first_error = member->result;
+        }
+
+        if (stats != NULL && (i == 0 || elapsed_us > stats->total_us)) {
+            stats->total_us = elapsed_us;
+        }
+    }
+    tl_mutex_unlock(group->lock);
+    tl_mutex_unlock(group->apply_lock);
+
+    if (stats != NULL) {
+        stats->success_count = success_count;
+        stats->max_skew_us = (success_count > 0) ? last_us - first_us : 0;
+    }
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_GroupApplyFrame] devices=%zu success=%u skew=%lluus\n",
+        group->count, success_count, (success_count > 0) ? last_us - first_us : 0ULL);
+#endif
+
+    if (first_error != TL_SUCCESS) {
+        tl_set_last_error(first_error);
+    }
+    return first_error;
+}
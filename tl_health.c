@@ -0,0 +1,501 @@
+﻿/*
+ * tl_health.c
+ *
+ * 塔燈通訊控制函式庫 - 連線健康監控實現
+ *
+ * 每次命令往返 (同步、非同步、整批與狀態還原) 都記錄於裝置的健康視窗，
+ * 視窗保留最近 TL_HEALTH_WINDOW 次往返的結果與往返時間；成功率、逾時率
+ * 與百分位數在查詢時才計算，命令路徑只需一次短暫的加鎖與寫入。
+ *
+ * 健康狀態：
+ *   - TL_HEALTH_DEAD：連續逾時或USB傳輸失敗達設定次數，收到任何回應即解除；
+ *   - TL_HEALTH_DEGRADED：樣本足夠時，成功率低於下限或百分位數超過上限；
+ *   - TL_HEALTH_HEALTHY：其他情況。
+ *
+ * 啟用監控後，監控執行緒於閒置時讀取蜂鳴器狀態作為探測，使無命令的期間
+ * 也能發現裝置失去回應；並定期評估，狀態或未達服務水準的項目改變時呼叫回呼。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 連線健康監控 */
+struct TL_HealthMonitor {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 設定改變或停止 */
+    TL_Thread* thread;                /* 監控執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_HealthConfig config;           /* 監控設定 */
+    TL_HEALTH_STATE state;            /* 最近一次通知的健康狀態 */
+    unsigned int breaches;            /* 最近一次通知的未達服務水準項目 */
+    unsigned long long probe_us;      /* 最後一次探測的時間 */
+    unsigned long long probes;        /* 探測次數 */
+    unsigned long long probe_failures;  /* 探測失敗次數 */
+    unsigned long long alerts;        /* 通知次數 */
+};
+
+/*
+ * 初始化連線健康視窗
+ */
+void tl_health_init(TL_HealthWindow* health)
+{
+    memset(health, 0, sizeof(*health));
+    health->dead_after_failures = TL_HEALTH_DEFAULT_DEAD_FAILURES;
+    health->min_success_permille = TL_HEALTH_DEFAULT_MIN_SUCCESS;
+}
+
+/*
+ * 清除健康視窗中的往返結果
+ */
+void tl_health_reset(TL_DeviceContext* device)
+{
+    tl_mutex_lock(device->health_lock);
+    device->health.head = 0;
+    device->health.count = 0;
+    device->health.consecutive_failures = 0;
+    device->health.last_activity_us = tl_time_now_us();
+    tl_mutex_unlock(device->health_lock);
+}
+
+/*
+ * 記錄一次命令往返的結果
+ */
+void tl_health_record(TL_DeviceContext* device, TL_ERROR_CODE result, unsigned long long latency_us)
+{
+    TL_HealthWindow* health = &device->health;
+    TL_HealthSample* sample;
+
+    /* 關閉裝置時取消的命令不是往返 */
+    if (result == TL_ERROR_DEVICE_NOT_OPEN) {
+        return;
+    }
+
+    tl_mutex_lock(device->health_lock);
+    sample = &health->samples[health->head];
+    sample->latency_us = (latency_us > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : (unsigned int)latency_us;
+    health->head = (health->head + 1) % TL_HEALTH_WINDOW;
+    if (health->count < TL_HEALTH_WINDOW) {
+        health->count++;
+    }
+    health->round_trips++;
+    health->last_activity_us = tl_time_now_us();
+
+    switch (result) {
+    case TL_SUCCESS:
+        sample->outcome = TL_HEALTH_OUTCOME_SUCCESS;
+        health->consecutive_failures = 0;
+        break;
+    case TL_ERROR_TIMEOUT:
+        sample->outcome = TL_HEALTH_OUTCOME_TIMEOUT;
+        sample->latency_us = 0;
+        health->timeouts++;
+        health->consecutive_failures++;
+        break;
+    case TL_ERROR_WRITE_FAILED:
+    case TL_ERROR_READ_FAILED:
+        sample->outcome = TL_HEALTH_OUTCOME_FAILURE;
+        sample->latency_us = 0;
+        health->failures++;
+        health->consecutive_failures++;
+        break;
+    default:
+        /* NAK或格式錯誤：裝置仍有回應 */
+        sample->outcome = TL_HEALTH_OUTCOME_FAILURE;
+        sample->latency_us = 0;
+        health->failures++;
+        health->consecutive_failures = 0;
+        break;
+    }
+    tl_mutex_unlock(device->health_lock);
+}
+
+/*
+ * 裝置是否已判定為無回應
+ */
+TL_BOOL tl_health_is_dead(TL_DeviceContext* device)
+{
+    TL_BOOL dead;
+
+    tl_mutex_lock(device->health_lock);
+    dead = (device->health.consecutive_failures >= device->health.dead_after_failures) ? TL_TRUE : TL_FALSE;
+    tl_mutex_unlock(device->health_lock);
+    return dead;
+}
+
+/*
+ * 比較兩個往返時間 (qsort 使用)
+ */
+static int tl_health_compare_latency(const void* a, const void* b)
+{
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * 取得排序後往返時間的百分位數 (最近秩法)
+ */
+static unsigned long long tl_health_percentile(const unsigned int* sorted, unsigned int count, unsigned int percent)
+{
+    unsigned int rank;
+
+    if (count == 0) {
+        return 0;
+    }
+    rank = (count * percent + 99) / 100;
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+/*
+ * 依健康視窗計算統計與健康狀態
+ */
+static void tl_health_evaluate(TL_DeviceContext* device, TL_HealthStats* stats)
+{
+    const TL_HealthWindow* health = &device->health;
+    unsigned int latencies[TL_HEALTH_WINDOW];
+    unsigned int latency_count = 0;
+    unsigned int successes = 0;
+    unsigned int timeouts = 0;
+    unsigned int dead_after_failures;
+    unsigned int min_success_permille;
+    unsigned long long p95_slo_us;
+    unsigned long long p99_slo_us;
+    unsigned long long now_us;
+    unsigned int i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    /* 只在鎖內複製，排序在鎖外進行 */
+    tl_mutex_lock(device->health_lock);
+    now_us = tl_time_now_us();
+    for (i = 0; i < health->count; i++) {
+        const TL_HealthSample* sample = &health->samples[i];
+        if (sample->outcome == TL_HEALTH_OUTCOME_SUCCESS) {
+            successes++;
+            if (sample->latency_us != 0) {
+                latencies[latency_count++] = sample->latency_us;
+            }
+        } else if (sample->outcome == TL_HEALTH_OUTCOME_TIMEOUT) {
+            timeouts++;
+        }
+    }
+    stats->samples = health->count;
+    stats->consecutive_failures = health->consecutive_failures;
+    stats->idle_us = (now_us > health->last_activity_us) ? now_us - health->last_activity_us : 0;
+    stats->round_trips = health->round_trips;
+    stats->timeouts = health->timeouts;
+    stats->failures = health->failures;
+    dead_after_failures = health->dead_after_failures;
+    min_success_permille = health->min_success_permille;
+    p95_slo_us = health->p95_slo_us;
+    p99_slo_us = health->p99_slo_us;
+    tl_mutex_unlock(device->health_lock);
+
+    if (stats->samples > 0) {
+        stats->success_permille = successes * 1000 / stats->samples;
+        stats->timeout_permille = timeouts * 1000 / stats->samples;
+    }
+    if (latency_count > 0) {
+        qsort(latencies, latency_count, sizeof(latencies[0]), tl_health_compare_latency);
+        stats->p50_us = tl_health_percentile(latencies, latency_count, 50);
+        stats->p95_us = tl_health_percentile(latencies, latency_count, 95);
+        stats->p99_us = tl_health_percentile(latencies, latency_count, 99);
+        stats->max_us = latencies[latency_count - 1];
+    }
+
+    /* 樣本太少時百分位數與成功率沒有代表性 */
+    if (stats->samples >= TL_HEALTH_MIN_SAMPLES) {
+        if (min_success_permille != 0 && stats->success_permille < min_success_permille) {
+            stats->breaches |= TL_HEALTH_BREACH_SUCCESS;
+        }
+    }
+    if (latency_count >= TL_HEALTH_MIN_SAMPLES) {
+        if (p95_slo_us != 0 && stats->p95_us > p95_slo_us) {
+            stats->breaches |= TL_HEALTH_BREACH_P95;
+        }
+        if (p99_slo_us != 0 && stats->p99_us > p99_slo_us) {
+            stats->breaches |= TL_HEALTH_BREACH_P99;
+        }
+    }
+
+    if (stats->consecutive_failures >= dead_after_failures) {
+        stats->state = TL_HEALTH_DEAD;
+    } else if (stats->breaches != 0) {
+        stats->state = TL_HEALTH_DEGRADED;
+    } else {
+        stats->state = TL_HEALTH_HEALTHY;
+    }
+}
+
+/*
+ * 閒置時送出探測 (進入與離開時持有鎖)
+ */
+static void tl_health_probe_locked(TL_HealthMonitor* monitor)
+{
+    TL_BuzzerStatus buzzer;
+    TL_ERROR_CODE result;
+
+    tl_mutex_unlock(monitor->lock);
+    /* 狀態讀取經由一般命令路徑，結果自動記錄於健康視窗 */
+    result = TL_DeviceGetBuzzerStatus(monitor->device, &buzzer);
+    tl_mutex_lock(monitor->lock);
+
+    monitor->probe_us = tl_time_now_us();
+    monitor->probes++;
+    if (result != TL_SUCCESS) {
+        monitor->probe_failures++;
+    }
+}
+
+/*
+ * 監控執行緒
+ */
+static void tl_health_main(void* arg)
+{
+    TL_HealthMonitor* monitor = (TL_HealthMonitor*)arg;
+    TL_DeviceContext* device = monitor->device;
+    TL_HealthEvent event;
+    TL_HealthCallback callback;
+    void* user_data;
+    unsigned long wait_ms;
+    unsigned long long interval_us;
+    unsigned long long now_us;
+
+    tl_mutex_lock(monitor->lock);
+    while (!monitor->stopping) {
+        /* 閒置達設定時間時探測；探測未完成往返 (例如速率限制) 時也不連續探測 */
+        interval_us = (unsigned long long)monitor->config.probe_interval_ms * 1000;
+        now_us = tl_time_now_us();
+        if (interval_us != 0 && now_us - monitor->probe_us >= interval_us) {
+            tl_mutex_lock(device->health_lock);
+            if (now_us - device->health.last_activity_us >= interval_us) {
+                tl_mutex_unlock(device->health_lock);
+                tl_health_probe_locked(monitor);
+                if (monitor->stopping) {
+                    break;
+                }
+            } else {
+                tl_mutex_unlock(device->health_lock);
+            }
+        }
+
+        tl_health_evaluate(device, &event.stats);
+        event.stats.probes = monitor->probes;
+        event.stats.probe_failures = monitor->probe_failures;
+
+        /* 狀態或項目改變時通知，持續未達服務水準不重複通知 */
+        if (event.stats.state != monitor->state || event.stats.breaches != monitor->breaches) {
+#ifdef BUILD_TEST_EXE
+            printf("[tl_health] 健康狀態 %d => %d，項目 0x%x => 0x%x，p99 %lluus，成功率 %u/1000\n",
+                   (int)monitor->state, (int)event.stats.state, monitor->breaches, event.stats.breaches,
+                   event.stats.p99_us, event.stats.success_permille);
+#endif
+            event.device = device;
+            event.previous_state = monitor->state;
+            event.previous_breaches = monitor->breaches;
+            monitor->state = event.stats.state;
+            monitor->breaches = event.stats.breaches;
+            monitor->alerts++;
+            event.stats.alerts = monitor->alerts;
+
+            callback = monitor->config.callback;
+            user_data = monitor->config.user_data;
+            if (callback != NULL) {
+                tl_mutex_unlock(monitor->lock);
+                callback(&event, user_data);
+                tl_mutex_lock(monitor->lock);
+                continue;
+            }
+        }
+
+        wait_ms = monitor->config.evaluate_interval_ms;
+        if (interval_us != 0 && monitor->config.probe_interval_ms < wait_ms) {
+            wait_ms = monitor->config.probe_interval_ms;
+        }
+        tl_cond_wait(monitor->changed, monitor->lock, wait_ms);
+    }
+    tl_mutex_unlock(monitor->lock);
+}
+
+/*
+ * 釋放監控
+ */
+static void tl_health_free(TL_HealthMonitor* monitor)
+{
+    tl_cond_destroy(monitor->changed);
+    tl_mutex_destroy(monitor->lock);
+    free(monitor);
+}
+
+/*
+ * 停止連線健康監控
+ */
+void tl_health_stop(TL_DeviceContext* device)
+{
+    TL_HealthMonitor* monitor;
+
+    tl_mutex_lock(device->state_lock);
+    monitor = device->health_monitor;
+    device->health_monitor = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (monitor == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(monitor->lock);
+    monitor->stopping = TL_TRUE;
+    tl_cond_broadcast(monitor->changed);
+    tl_mutex_unlock(monitor->lock);
+
+    tl_thread_join(monitor->thread);
+    tl_health_free(monitor);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_health_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 啟用連線健康監控
+ */
+TL_ERROR_CODE TL_StartHealthMonitor(TL_DEVICE_HANDLE device, const TL_HealthConfig* config)
+{
+    TL_DeviceContext* context;
+    TL_HealthMonitor* monitor;
+    TL_HealthConfig resolved;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (config == NULL || config->min_success_permille > 1000) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_health_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    resolved = *config;
+    if (resolved.evaluate_interval_ms == 0) {
+        resolved.evaluate_interval_ms = TL_HEALTH_DEFAULT_EVALUATE_MS;
+    }
+    if (resolved.dead_after_failures == 0) {
+        resolved.dead_after_failures = TL_HEALTH_DEFAULT_DEAD_FAILURES;
+    }
+
+    /* 判定門檻存於健康視窗，TL_GetHealthStats 與 TL_IsConnected 一併適用 */
+    tl_mutex_lock(context->health_lock);
+    context->health.dead_after_failures = resolved.dead_after_failures;
+    context->health.min_success_permille = resolved.min_success_permille;
+    context->health.p95_slo_us = resolved.p95_slo_us;
+    context->health.p99_slo_us = resolved.p99_slo_us;
+    tl_mutex_unlock(context->health_lock);
+
+    tl_mutex_lock(context->state_lock);
+    monitor = context->health_monitor;
+    if (monitor != NULL) {
+        /* 已啟用：更新設定並立即重新評估 */
+        tl_mutex_lock(monitor->lock);
+        monitor->config = resolved;
+        tl_cond_broadcast(monitor->changed);
+        tl_mutex_unlock(monitor->lock);
+        tl_mutex_unlock(context->state_lock);
+        return TL_SUCCESS;
+    }
+
+    monitor = (TL_HealthMonitor*)calloc(1, sizeof(TL_HealthMonitor));
+    if (monitor != NULL) {
+        monitor->device = context;
+        monitor->config = resolved;
+        monitor->state = TL_HEALTH_HEALTHY;
+        monitor->lock = tl_mutex_create();
+        monitor->changed = tl_cond_create();
+        if (monitor->lock == NULL || monitor->changed == NULL) {
+            tl_health_free(monitor);
+            monitor = NULL;
+        } else {
+            monitor->thread = tl_thread_create(tl_health_main, monitor);
+            if (monitor->thread == NULL) {
+                tl_health_free(monitor);
+                monitor = NULL;
+            }
+        }
+    }
+    if (monitor == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    context->health_monitor = monitor;
+    tl_mutex_unlock(context->state_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_StartHealthMonitor] 探測 %lums，評估 %lums，p95 %lluus，p99 %lluus\n",
+           resolved.probe_interval_ms, resolved.evaluate_interval_ms, resolved.p95_slo_us, resolved.p99_slo_us);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 停用連線健康監控
+ */
+TL_ERROR_CODE TL_StopHealthMonitor(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_health_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_health_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得連線健康統計
+ */
+TL_ERROR_CODE TL_GetHealthStats(TL_DEVICE_HANDLE device, TL_HealthStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_HealthMonitor* monitor;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_health_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_health_evaluate(context, stats);
+
+    tl_mutex_lock(context->state_lock);
+    monitor = context->health_monitor;
+    if (monitor != NULL) {
+        tl_mutex_lock(monitor->lock);
+        stats->probes = monitor->probes;
+        stats->probe_failures = monitor->probe_failures;
+        stats->alerts = monitor->alerts;
+        tl_mutex_unlock(monitor->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
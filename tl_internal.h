@@ -51,24 +51,296 @@ extern "C" {
 #define TL_RSP_ACK        6   /* 回應確認碼 ACK (0x06) */
 #define TL_RSP_NAK        21  /* 回應否認碼 NAK (0x15) */
 
-/* 讀取超時時間 (毫秒) */
+/* 讀取超時時間 (毫秒) - 自適應逾時的初始值與預設上限 */
 #define TL_READ_TIMEOUT   1000  /* 1秒 */
 
+/* 自適應逾時的預設下限 (毫秒) */
+#define TL_RTO_DEFAULT_MIN_MS  20
+
+/* 逾時重試時的最大退避倍數 (2的次方) */
+#define TL_RTO_MAX_BACKOFF_SHIFT  4
+
 /* 裝置準備狀態檢查的最大重試次數 */
 #define TL_MAX_DEVICE_READY_ATTEMPTS  5
 
 /* 每次重試的等待時間 (毫秒) */
 #define TL_DEVICE_READY_WAIT_MS  10
 
+/* 無限等待 */
+#define TL_WAIT_INFINITE  0xFFFFFFFFUL
+
+/* 同步物件與執行緒 (實作於 tl_platform.c) */
+typedef struct TL_Mutex TL_Mutex;
+typedef struct TL_Cond TL_Cond;
+typedef struct TL_Thread TL_Thread;
+typedef void (*TL_ThreadFunc)(void* arg);
+typedef struct TL_PollSignal TL_PollSignal;
+
+/* 網路通訊端 (實作於 tl_platform.c) */
+typedef struct TL_Socket TL_Socket;
+
+/* 通訊端輪詢事件 */
+#define TL_SOCKET_READABLE  0x01
+#define TL_SOCKET_WRITABLE  0x02
+#define TL_SOCKET_CLOSED    0x04   /* 錯誤或對方已關閉 (只出現在 revents) */
+
+/* 通訊端輪詢項目 */
+typedef struct {
+    TL_Socket* socket;        /* 通訊端 */
+    unsigned int events;      /* 要等待的事件 (TL_SOCKET_*) */
+    unsigned int revents;     /* 發生的事件 */
+} TL_SocketPoll;
+
+/*
+ * 往返時間估計器 (RFC 6298)
+ *
+ * 以 EWMA 追蹤平滑往返時間 (SRTT) 與其變異 (RTTVAR)，
+ * 讀取逾時取 SRTT + 4 * RTTVAR，並限制在設定的上下限之間。
+ */
+typedef struct {
+    TL_BOOL has_sample;                 /* 是否已有樣本 */
+    long long srtt_us;                  /* 平滑往返時間 (微秒) */
+    long long rttvar_us;                /* 往返時間變異 (微秒) */
+    unsigned long min_timeout_ms;       /* 逾時下限 */
+    unsigned long max_timeout_ms;       /* 逾時上限 */
+    TL_BOOL retry_on_timeout;           /* 逾時後重新同步並重試一次 */
+    unsigned int backoff_shift;         /* 連續逾時的退避次數 */
+    unsigned long long sample_count;    /* 樣本數 */
+    unsigned long long timeout_count;   /* 逾時次數 */
+    unsigned long long retry_count;     /* 重試次數 */
+    unsigned long long recovered_count; /* 重試成功次數 */
+} TL_RttEstimator;
+
+/* 健康監控滑動視窗的往返次數 */
+#define TL_HEALTH_WINDOW  128
+
+/* 健康監控的往返結果 */
+#define TL_HEALTH_OUTCOME_SUCCESS  0  /* 收到回應 */
+#define TL_HEALTH_OUTCOME_TIMEOUT  1  /* 逾時 */
+#define TL_HEALTH_OUTCOME_FAILURE  2  /* USB傳輸失敗或回應錯誤 */
+
+/* 健康監控的單次往返 */
+typedef struct {
+    unsigned int latency_us;      /* 往返時間 (微秒)，0 表示不是往返時間樣本 */
+    TL_BYTE outcome;              /* 往返結果 (TL_HEALTH_OUTCOME_*) */
+} TL_HealthSample;
+
+/*
+ * 連線健康視窗
+ *
+ * 記錄最近 TL_HEALTH_WINDOW 次往返的結果與往返時間，由命令往返更新，
+ * 查詢時才計算成功率與百分位數。
+ */
+typedef struct {
+    TL_HealthSample samples[TL_HEALTH_WINDOW];  /* 環狀緩衝區 */
+    unsigned int head;                          /* 下一個寫入位置 */
+    unsigned int count;                         /* 樣本數 */
+    unsigned int consecutive_failures;          /* 連續逾時或USB傳輸失敗的次數 */
+    unsigned int dead_after_failures;           /* 連續失敗幾次判定為無回應 */
+    unsigned int min_success_permille;          /* 成功率下限 (千分比)，0 表示不檢查 */
+    unsigned long long p95_slo_us;              /* 第95百分位數的上限，0 表示不檢查 */
+    unsigned long long p99_slo_us;              /* 第99百分位數的上限，0 表示不檢查 */
+    unsigned long long last_activity_us;        /* 最後一次往返完成的時間 */
+    unsigned long long round_trips;             /* 累計往返次數 */
+    unsigned long long timeouts;                /* 累計逾時次數 */
+    unsigned long long failures;                /* 累計其他失敗次數 */
+} TL_HealthWindow;
+
+/* 預設連續失敗幾次判定為無回應 */
+#define TL_HEALTH_DEFAULT_DEAD_FAILURES  3
+
+/* 預設成功率下限 (千分比) */
+#define TL_HEALTH_DEFAULT_MIN_SUCCESS  950
+
+/* 監控執行緒評估健康狀態的預設週期 (毫秒) */
+#define TL_HEALTH_DEFAULT_EVALUATE_MS  250
+
+/* 視窗中至少有此數量的樣本才檢查成功率與百分位數 */
+#define TL_HEALTH_MIN_SAMPLES  10
+
+/* 連線健康監控執行緒 (實作於 tl_health.c) */
+typedef struct TL_HealthMonitor TL_HealthMonitor;
+
+/* 追蹤的命令階段 (實作於 tl_trace.c) */
+typedef enum {
+    TL_TRACE_SET_LED = 0,       /* TL_SetLED / TL_DeviceSetLED，參數為層級 */
+    TL_TRACE_GET_LED,           /* TL_GetLEDStatus / TL_DeviceGetLEDStatus，參數為層級 */
+    TL_TRACE_SET_BUZZER,        /* TL_SetBuzzer / TL_DeviceSetBuzzer */
+    TL_TRACE_GET_BUZZER,        /* TL_GetBuzzerStatus / TL_DeviceGetBuzzerStatus */
+    TL_TRACE_BUILD,             /* 構建命令封包，參數為封包長度 */
+    TL_TRACE_QUEUE,             /* 等待速率限制與通道 */
+    TL_TRACE_TRANSACT,          /* 命令往返 (含重試)，參數為結果 */
+    TL_TRACE_ASYNC_SUBMIT,      /* 交給非同步寫入引擎，參數為結果 */
+    TL_TRACE_USB_WRITE,         /* WinUsb_WritePipe，參數為位元組數 */
+    TL_TRACE_READ_HEADER,       /* 讀取回應頭部，參數為位元組數 */
+    TL_TRACE_READ_BODY,         /* 讀取回應數據，參數為位元組數 */
+    TL_TRACE_STAGE_COUNT
+} TL_TRACE_STAGE;
+
+/* 每個執行緒預設保留的追蹤事件數 */
+#define TL_TRACE_DEFAULT_EVENTS  16384
+
+/* 非同步寫入時允許的最大在途命令數 */
+#define TL_ASYNC_MAX_IN_FLIGHT  32
+
+/*
+ * 同一命令類型最多同時在途的命令數
+ * 同類型的回應無法區分，其中一個遺失時要等到這一串的最後一個命令逾時才會發現，
+ * 在此之前最多 TL_ASYNC_MAX_SAME_TYPE-1 個命令可能配對到後一個命令的回應。
+ */
+#define TL_ASYNC_MAX_SAME_TYPE  8
+
+/* 背景狀態驗證的預設週期 (毫秒) */
+#define TL_VERIFY_DEFAULT_INTERVAL_MS  1000
+
+/* 設定目標 - 0~2 為LED層級，3 為蜂鳴器 (與狀態讀取命令的類型相同) */
+#define TL_TARGET_BUZZER  3
+#define TL_TARGET_COUNT   4
+
+/*
+ * 影子狀態
+ *
+ * 記錄最後一次要求的設定，供背景驗證比對。每次設定都會遞增該目標的序號，
+ * 驗證時若序號已改變表示期間有新的設定，該次比對作廢。
+ */
+typedef struct {
+    TL_LEDStatus led[3];                       /* 各層LED */
+    TL_BuzzerStatus buzzer;                    /* 蜂鳴器 */
+    unsigned int valid_mask;                   /* bit n 表示目標 n 已設定過 */
+    unsigned long sequence[TL_TARGET_COUNT];   /* 各目標的設定序號 */
+} TL_ShadowState;
+
+/* 單一設定命令的最大長度 (LED設定為11位元組，蜂鳴器設定為9位元組) */
+#define TL_SET_COMMAND_SIZE  16
+
+/* 狀態讀取回應的最大長度 (LED為12位元組，蜂鳴器為11位元組) */
+#define TL_STATUS_RESPONSE_SIZE  32
+
+/* 一次連續送出的最大命令數 */
+#define TL_BATCH_MAX_COMMANDS  8
+
+/*
+ * 預先建構的塔燈畫面
+ *
+ * 各目標的設定命令只建構一次，可重複寫入多台裝置。
+ */
+typedef struct {
+    TL_TowerFrame frame;                                       /* 原始畫面 */
+    TL_BYTE commands[TL_TARGET_COUNT][TL_SET_COMMAND_SIZE];    /* 各目標的設定命令 */
+    size_t lengths[TL_TARGET_COUNT];                           /* 命令長度，0 表示不套用 */
+} TL_PreparedFrame;
+
+/* 非同步寫入引擎 (實作於 tl_async.c) */
+typedef struct TL_AsyncEngine TL_AsyncEngine;
+
+/* 期望狀態收斂器 (實作於 tl_reconcile.c) */
+typedef struct TL_Reconciler TL_Reconciler;
+
+/* 收斂器定期讀取裝置狀態的週期 (毫秒) */
+#define TL_RECONCILE_VERIFY_INTERVAL_MS  1000
+
+/* 收斂器錯誤退避的下限與上限 (毫秒) */
+#define TL_RECONCILE_BACKOFF_MIN_MS  50
+#define TL_RECONCILE_BACKOFF_MAX_MS  5000
+
+/* 輸入濾波器 (實作於 tl_filter.c) */
+typedef struct TL_Filter TL_Filter;
+
+/* 輸入濾波器送出失敗後的重試間隔 (毫秒) */
+#define TL_FILTER_RETRY_MS  100
+
+/* 失效安全看門狗 (實作於 tl_watchdog.c) */
+typedef struct TL_Watchdog TL_Watchdog;
+
+/* 安全畫面送出失敗後的重試間隔 (毫秒) */
+#define TL_WATCHDOG_RETRY_MS  100
+
+/* 動畫播放器 (實作於 tl_sequence.c) */
+typedef struct TL_SequencePlayer TL_SequencePlayer;
+
+/* Modbus TCP 伺服器 (實作於 tl_modbus.c) */
+typedef struct TL_ModbusServer TL_ModbusServer;
+
+/* 狀態推播伺服器 (實作於 tl_push.c) */
+typedef struct TL_PushServer TL_PushServer;
+
+/* 狀態日誌可記錄的裝置數 (以裝置路徑區分) */
+#define TL_JOURNAL_DEVICES  16
+
+/* 裝置介面路徑的最大長度 (含結尾的 NUL) */
+#define TL_DEVICE_PATH_MAX  256
+
+/* 單一塔燈裝置的狀態 (公開標頭中以 TL_DEVICE_HANDLE 表示) */
+typedef struct TL_DeviceContext {
+    unsigned int device_index; /* 系統列舉時的裝置索引 (重新列舉後可能改變) */
+    char device_path[TL_DEVICE_PATH_MAX]; /* 開啟時的裝置介面路徑，空字串表示平台不提供 */
+    void*   device_handle;     /* 裝置控制代碼 */
+    void*   interface_handle;  /* 介面控制代碼 */
+    void*   write_event;       /* 重疊寫入使用的事件 (僅Windows) */
+    void*   read_event;        /* 重疊讀取使用的事件 (僅Windows) */
+    TL_RttEstimator rtt;       /* 往返時間估計 (受 state_lock 保護) */
+    TL_Mutex* health_lock;     /* 保護健康視窗 (不在持有時取得其他鎖) */
+    TL_HealthWindow health;    /* 連線健康視窗 */
+    TL_Mutex* io_lock;         /* 序列化同步模式下的命令往返 */
+    TL_Mutex* state_lock;      /* 保護影子狀態與不一致回呼 */
+    TL_ShadowState shadow;     /* 影子狀態 */
+    TL_WRITE_MODE write_mode;  /* 寫入模式 */
+    unsigned long verify_interval_ms;          /* 背景狀態驗證週期，0 表示不驗證 */
+    TL_MismatchCallback mismatch_callback;     /* 不一致回呼 */
+    void* mismatch_user_data;                  /* 回呼的使用者資料 */
+    TL_AsyncStats async_stats;                 /* 非同步寫入統計 (受引擎鎖保護) */
+    unsigned int pipeline_depth;               /* 非同步與管線模式下的最多在途命令數 (受引擎鎖保護) */
+    TL_AsyncEngine* async;     /* 非同步寫入引擎，NULL 表示同步模式 */
+    TL_Mutex* lane_lock;       /* 保護緊急通道欄位 */
+    TL_Cond* lane_changed;     /* 緊急命令結束 */
+    unsigned int emergency_waiting;            /* 尚未完成的緊急命令數，期間一般命令暫停 */
+    unsigned long supersede_seq[TL_TARGET_COUNT];  /* 各目標被緊急命令涵蓋的次數 */
+    TL_PriorityStats priority_stats;           /* 緊急通道統計 (受 lane_lock 保護) */
+    TL_Reconciler* reconciler;                 /* 期望狀態收斂器，NULL 表示未使用 (受 state_lock 保護) */
+    TL_Filter* filter;                         /* 輸入濾波器，NULL 表示未使用 (受 state_lock 保護) */
+    TL_Watchdog* watchdog;                     /* 失效安全看門狗，NULL 表示未啟用 (受 state_lock 保護) */
+    TL_HealthMonitor* health_monitor;          /* 連線健康監控，NULL 表示未啟用 (受 state_lock 保護) */
+    TL_SequencePlayer* player;                 /* 動畫播放器，NULL 表示未使用 (受 state_lock 保護) */
+    TL_ModbusServer* modbus_server;            /* Modbus TCP 伺服器，NULL 表示未啟動 (受 state_lock 保護) */
+    TL_PushServer* push_server;                /* 狀態推播伺服器，NULL 表示未啟動 (受 state_lock 保護，設定時以原子操作) */
+    TL_BOOL closing;                           /* 正在關閉或已關閉，不再啟動伺服器 (受 state_lock 保護) */
+    volatile TL_TowerState current_state;      /* 最後一次送出的設定或讀回的狀態 (原子操作) */
+    volatile TL_TowerState desired_state;      /* TL_SetDesiredState 設定的期望狀態 (原子操作) */
+    TL_ResetStats reset_stats;                 /* 重置偵測統計 (受 state_lock 保護) */
+    TL_JournalStats journal_stats;             /* 狀態日誌統計 (受日誌鎖保護) */
+    TL_RateLimitStats rate_stats;              /* 速率限制設定與統計 (受 lane_lock 保護) */
+    unsigned long long rate_tokens;            /* 權杖數 (以百萬分之一個權杖為單位，受 lane_lock 保護) */
+    unsigned long long rate_refill_us;         /* 上次補充權杖的時間 (受 lane_lock 保護) */
+    struct TL_DeviceContext* next;  /* TL_OpenDevice 開啟的裝置串列 */
+} TL_DeviceContext;
+
 /* 全局狀態資訊 */
 typedef struct {
     TL_BOOL is_initialized;    /* 函式庫是否已初始化 */
     TL_BOOL is_device_open;    /* 裝置是否已開啟 */
-    void*   device_handle;     /* 裝置控制代碼 */
-    void*   interface_handle;  /* 介面控制代碼 */
-    TL_ERROR_CODE last_error;  /* 最後一次錯誤碼 */
+    TL_DeviceContext device;   /* 預設裝置 (由 TL_OpenConnection 開啟) */
+    TL_Mutex* devices_lock;    /* 保護 extra_devices 與 groups */
+    TL_DeviceContext* extra_devices;  /* 由 TL_OpenDevice 開啟的其他裝置 */
+    struct TL_DeviceGroup* groups;    /* 已建立的裝置群組 (關閉裝置時據此移除成員) */
+    volatile unsigned int last_error;  /* 最後一次錯誤碼 (TL_ERROR_CODE)，各執行緒都可能設定，以原子操作存取 */
 } TL_InternalState;
 
+/* 執行緒區域儲存 */
+#if defined(_MSC_VER)
+#define TL_THREAD_LOCAL __declspec(thread)
+#else
+#define TL_THREAD_LOCAL _Thread_local
+#endif
+
+/* 檔案映射 */
+typedef struct {
+    const TL_BYTE* data;  /* 映射起始位址 */
+    TL_BYTE* writable;    /* 可寫入的映射起始位址，唯讀映射時為 NULL */
+    size_t size;          /* 映射大小 */
+    void* file_handle;    /* 檔案控制代碼 (僅Windows) */
+    void* map_handle;     /* 映射物件控制代碼 (僅Windows) */
+} TL_FileMapping;
+
 /* 命令封包結構 */
 typedef struct {
     TL_BYTE cmd_type;    /* 命令類型 */
@@ -92,57 +364,183 @@ typedef struct {
  */
 void tl_set_last_error(TL_ERROR_CODE error_code);
 
+/*
+ * 取得內部狀態
+ *
+ * 返回值：全局狀態結構指標
+ */
+TL_InternalState* tl_get_internal_state(void);
+
+/*
+ * 取得預設裝置
+ *
+ * 返回值：由 TL_OpenConnection 管理的裝置狀態
+ */
+TL_DeviceContext* tl_get_default_device(void);
+
+/*
+ * 檢查裝置是否可用
+ *
+ * 檢查函式庫已初始化、裝置控制代碼有效且裝置已開啟，失敗時設定最後錯誤碼。
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_SUCCESS 表示可用，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_validate_device(TL_DeviceContext* device);
+
+/*
+ * 初始化裝置狀態
+ *
+ * 清除裝置狀態並建立所需的同步物件。
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_device_init(TL_DeviceContext* device);
+
+/*
+ * 釋放裝置狀態
+ *
+ * 釋放 tl_device_init 建立的同步物件，裝置須已關閉。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_device_cleanup(TL_DeviceContext* device);
+
 /*
  * 開啟USB裝置
  * 
- * 嘗試開啟USB裝置。
+ * 嘗試開啟第 device->device_index 台USB裝置，並記錄其裝置介面路徑。
  * 
+ * 參數：device 裝置狀態
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_usb_open_device(TL_DeviceContext* device);
+
+/*
+ * 取得已連接的USB裝置數量
+ *
+ * 參數：count 用於存儲裝置數量的指標
  * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
  */
-TL_ERROR_CODE tl_usb_open_device(void);
+TL_ERROR_CODE tl_usb_count_devices(unsigned int* count);
+
+/*
+ * 依裝置介面路徑尋找USB裝置目前的列舉索引
+ *
+ * 參數：device_path 開啟時記錄的裝置介面路徑
+ * 參數：index 用於存儲列舉索引的指標
+ * 返回值：TL_SUCCESS 表示成功，TL_ERROR_DEVICE_NOT_FOUND 表示裝置目前不存在
+ */
+TL_ERROR_CODE tl_usb_find_device(const char* device_path, unsigned int* index);
 
 /*
  * 關閉USB裝置
  * 
  * 關閉已開啟的USB裝置。
  * 
+ * 參數：device 裝置狀態
  * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
  */
-TL_ERROR_CODE tl_usb_close_device(void);
+TL_ERROR_CODE tl_usb_close_device(TL_DeviceContext* device);
 
 /*
  * 檢查USB裝置是否準備就緒
  * 
  * 檢查裝置是否已初始化且準備接收命令。
  * 
+ * 參數：device 裝置狀態
  * 返回值：TL_TRUE 表示準備就緒，TL_FALSE 表示未準備就緒
  */
-TL_BOOL tl_usb_is_device_ready(void);
+TL_BOOL tl_usb_is_device_ready(TL_DeviceContext* device);
 
 /*
  * 寫入資料到USB裝置
  * 
  * 將數據寫入USB裝置。
  * 
+ * 參數：device 裝置狀態
  * 參數：pipe_id 管道ID
  * 參數：buffer 要寫入的數據緩衝區
  * 參數：buffer_size 緩衝區大小
+ * 參數：timeout_ms 逾時時間 (毫秒)
  * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
  */
-TL_ERROR_CODE tl_usb_write_data(TL_BYTE pipe_id, const TL_BYTE* buffer, size_t buffer_size);
+TL_ERROR_CODE tl_usb_write_data(TL_DeviceContext* device, TL_BYTE pipe_id, const TL_BYTE* buffer,
+                                size_t buffer_size, unsigned long timeout_ms);
 
 /*
  * 從USB裝置讀取資料
  * 
- * 從USB裝置讀取數據。
+ * 從USB裝置讀取數據，超過 timeout_ms 仍未收到資料時取消傳輸。
  * 
+ * 參數：device 裝置狀態
  * 參數：pipe_id 管道ID
  * 參數：buffer 用於存儲讀取數據的緩衝區
  * 參數：buffer_size 緩衝區大小
  * 參數：bytes_read 實際讀取的字節數
+ * 參數：timeout_ms 逾時時間 (毫秒)
+ * 返回值：TL_SUCCESS 表示成功，TL_ERROR_TIMEOUT 表示逾時，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_usb_read_data(TL_DeviceContext* device, TL_BYTE pipe_id, TL_BYTE* buffer,
+                               size_t buffer_size, size_t* bytes_read, unsigned long timeout_ms);
+
+/*
+ * 重新同步USB管道
+ *
+ * 逾時後取消尚未完成的傳輸並清除回應管道中殘留的資料，
+ * 避免下一個命令讀到過期的回應。
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_usb_resync(TL_DeviceContext* device);
+
+/*
+ * 重新開啟USB裝置
+ *
+ * 裝置重新列舉後舊的控制代碼已失效，列舉索引也可能改變；依開啟時的裝置介面路徑
+ * 找回同一台裝置並開啟新的控制代碼，成功後才替換並關閉舊的控制代碼，
+ * 不會開啟到其他塔燈。須在持有 io_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
  * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
  */
-TL_ERROR_CODE tl_usb_read_data(TL_BYTE pipe_id, TL_BYTE* buffer, size_t buffer_size, size_t* bytes_read);
+TL_ERROR_CODE tl_usb_reopen_device(TL_DeviceContext* device);
+
+#ifdef BUILD_TEST_EXE
+/*
+ * 模擬塔燈 (tl_usb_sim.c，僅測試程式)
+ *
+ * tl_usb_sim_enable 之後 tl_usb_* 改由模擬塔燈處理，須在開啟任何裝置前啟用、
+ * 關閉所有裝置後停用。index 為塔燈編號 (啟用時的列舉索引，重新插上後不變)；
+ * service_us 為每個命令的處理時間、link_us 為傳輸延遲 (微秒)；
+ * tl_usb_sim_take_max_pending 取得並歸零同時尚未讀取的回應數的最大值。
+ * tl_usb_sim_replug 模擬USB重新列舉：之前開啟的控制代碼失效，塔燈改列於
+ * 列舉索引 new_index；斷電則另以 tl_usb_sim_power_cycle 模擬。
+ * tl_usb_sim_set_rate_limit 模擬韌體的速率上限：超過時以 NAK 拒絕命令，rate_per_sec 為 0 表示不限制。
+ */
+TL_ERROR_CODE tl_usb_sim_enable(unsigned int count, unsigned long service_us);
+void tl_usb_sim_disable(void);
+TL_BOOL tl_usb_sim_active(void);
+void tl_usb_sim_set_latency(unsigned int index, unsigned long service_us);
+void tl_usb_sim_set_link_delay(unsigned int index, unsigned long link_us);
+void tl_usb_sim_set_rate_limit(unsigned int index, unsigned long rate_per_sec, unsigned long burst);
+size_t tl_usb_sim_take_max_pending(unsigned int index);
+void tl_usb_sim_drop_responses(unsigned int index, unsigned int count);
+void tl_usb_sim_power_cycle(unsigned int index);
+void tl_usb_sim_replug(unsigned int index, unsigned int new_index);
+unsigned long tl_usb_sim_write_count(unsigned int index);
+void tl_usb_sim_get_layer(unsigned int index, TL_LAYER layer, TL_BYTE state[4]);
+TL_ERROR_CODE tl_usb_sim_count_devices(unsigned int* count);
+TL_ERROR_CODE tl_usb_sim_find_device(const char* device_path, unsigned int* index);
+TL_ERROR_CODE tl_usb_sim_open_device(TL_DeviceContext* device);
+TL_ERROR_CODE tl_usb_sim_close_device(TL_DeviceContext* device);
+TL_ERROR_CODE tl_usb_sim_write_data(TL_DeviceContext* device, const TL_BYTE* buffer, size_t buffer_size);
+TL_ERROR_CODE tl_usb_sim_read_data(TL_DeviceContext* device, TL_BYTE* buffer, size_t buffer_size,
+                                   size_t* bytes_read, unsigned long timeout_ms);
+TL_ERROR_CODE tl_usb_sim_resync(TL_DeviceContext* device);
+#endif
 
 /*
  * 延遲指定的毫秒數
@@ -153,6 +551,95 @@ TL_ERROR_CODE tl_usb_read_data(TL_BYTE pipe_id, TL_BYTE* buffer, size_t buffer_s
  */
 void tl_delay_ms(unsigned long ms);
 
+/*
+ * 取得單調時間
+ *
+ * 返回值：自任意起點起算的微秒數，不受系統時間調整影響
+ */
+unsigned long long tl_time_now_us(void);
+
+/*
+ * 初始化往返時間估計器
+ *
+ * 參數：rtt 估計器
+ */
+void tl_rtt_init(TL_RttEstimator* rtt);
+
+/*
+ * 加入一筆往返時間樣本
+ *
+ * 以下 tl_rtt_* 函式在 state_lock 保護下存取 device->rtt，不可在持有 state_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
+ * 參數：sample_us 量測到的往返時間 (微秒)
+ */
+void tl_rtt_add_sample(TL_DeviceContext* device, unsigned long long sample_us);
+
+/*
+ * 記錄一次逾時並加倍下一次的逾時時間
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_rtt_on_timeout(TL_DeviceContext* device);
+
+/*
+ * 判斷逾時後是否重試，重試時計入重試次數
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_TRUE 表示應重新同步並重試一次
+ */
+TL_BOOL tl_rtt_begin_retry(TL_DeviceContext* device);
+
+/*
+ * 記錄一次重試後成功
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_rtt_on_recovered(TL_DeviceContext* device);
+
+/*
+ * 取得目前的讀取逾時時間
+ *
+ * 參數：device 裝置狀態
+ * 返回值：逾時時間 (毫秒)
+ */
+unsigned long tl_rtt_timeout_ms(TL_DeviceContext* device);
+
+/*
+ * 初始化連線健康視窗
+ *
+ * 參數：health 健康視窗
+ */
+void tl_health_init(TL_HealthWindow* health);
+
+/*
+ * 清除健康視窗中的往返結果
+ *
+ * 保留設定與累計統計，重新開啟裝置時呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_health_reset(TL_DeviceContext* device);
+
+/*
+ * 記錄一次命令往返的結果
+ *
+ * 只取得 health_lock，可在持有 io_lock 或非同步引擎的鎖時呼叫。
+ *
+ * 參數：device 裝置狀態
+ * 參數：result 往返結果
+ * 參數：latency_us 往返時間 (微秒)，0 表示不是往返時間樣本 (例如整批命令)
+ */
+void tl_health_record(TL_DeviceContext* device, TL_ERROR_CODE result, unsigned long long latency_us);
+
+/*
+ * 裝置是否已判定為無回應
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_TRUE 表示連續失敗次數已達設定值
+ */
+TL_BOOL tl_health_is_dead(TL_DeviceContext* device);
+
 /*
  * 構建LED設定命令
  * 
@@ -241,8 +728,10 @@ TL_ERROR_CODE tl_cmd_check_response_format(const TL_BYTE* response, size_t respo
 /*
  * 發送命令並接收回應
  * 
- * 發送命令給塔燈裝置並等待回應。
+ * 發送命令給塔燈裝置並等待回應。讀取逾時依量測的往返時間調整，
+ * 逾時後重新同步管道並重試一次。
  * 
+ * 參數：device 裝置狀態
  * 參數：command 命令緩衝區
  * 參數：command_length 命令長度
  * 參數：response 回應緩衝區
@@ -250,10 +739,775 @@ TL_ERROR_CODE tl_cmd_check_response_format(const TL_BYTE* response, size_t respo
  * 參數：response_length 實際接收到的回應長度
  * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
  */
-TL_ERROR_CODE tl_cmd_send_and_receive(const TL_BYTE* command, size_t command_length,
+TL_ERROR_CODE tl_cmd_send_and_receive(TL_DeviceContext* device,
+                                     const TL_BYTE* command, size_t command_length,
                                      TL_BYTE* response, size_t response_size,
                                      size_t* response_length);
 
+/*
+ * 連續送出多個命令並接收各自的回應
+ *
+ * 先寫出所有命令再依序接收回應，總耗時約為一次往返。命令之間不會穿插
+ * 其他命令；任一回應失敗時重新同步管道，逾時則重試整批一次。
+ *
+ * 參數：device 裝置狀態
+ * 參數：count 命令數 (1~TL_BATCH_MAX_COMMANDS)
+ * 參數：commands 各命令的緩衝區
+ * 參數：command_lengths 各命令的長度
+ * 參數：responses 各回應的緩衝區
+ * 參數：response_size 每個回應緩衝區的大小
+ * 參數：response_lengths 各回應的實際長度
+ * 返回值：TL_SUCCESS 表示全部成功，否則為第一個錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_send_and_receive_batch(TL_DeviceContext* device, size_t count,
+                                           const TL_BYTE* const* commands, const size_t* command_lengths,
+                                           TL_BYTE* const* responses, size_t response_size,
+                                           size_t* response_lengths);
+
+/*
+ * 接收一個完整回應
+ *
+ * 先讀取4位元組頭部，再依頭部的長度讀取其餘部分，整個過程共用同一個期限。
+ *
+ * 參數：device 裝置狀態
+ * 參數：response 回應緩衝區
+ * 參數：response_size 回應緩衝區大小
+ * 參數：response_length 實際接收到的回應長度
+ * 參數：timeout_ms 逾時時間 (毫秒)
+ * 返回值：TL_SUCCESS 表示成功，TL_ERROR_TIMEOUT 表示逾時，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_receive_response(TL_DeviceContext* device,
+                                     TL_BYTE* response, size_t response_size,
+                                     size_t* response_length, unsigned long timeout_ms);
+
+/*
+ * 執行設定命令
+ *
+ * 同步模式下等待並檢查回應；非同步模式下命令寫出後即返回，
+ * 回應由背景執行緒驗證。
+ *
+ * 參數：device 裝置狀態
+ * 參數：target 設定目標 (0~2: LED層級, 3: 蜂鳴器)
+ * 參數：command 命令緩衝區
+ * 參數：command_length 命令長度
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_execute_set(TL_DeviceContext* device, int target,
+                                const TL_BYTE* command, size_t command_length);
+
+/*
+ * 預先建構塔燈畫面的設定命令
+ *
+ * 參數：frame 塔燈畫面
+ * 參數：prepared 用於存儲命令的結構
+ * 返回值：TL_SUCCESS 表示成功，TL_ERROR_INVALID_PARAMETER 表示畫面內容無效
+ */
+TL_ERROR_CODE tl_cmd_prepare_frame(const TL_TowerFrame* frame, TL_PreparedFrame* prepared);
+
+/*
+ * 將預先建構的塔燈畫面套用到裝置
+ *
+ * 依層級一至三、蜂鳴器的順序送出命令，遇到錯誤即停止。
+ *
+ * 參數：device 裝置狀態
+ * 參數：prepared 預先建構的塔燈畫面
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_apply_frame(TL_DeviceContext* device, const TL_PreparedFrame* prepared);
+
+/*
+ * 設定呼叫執行緒的命令送出期限
+ *
+ * 之後由此執行緒送出的一般設定命令，若在等待裝置期間超過期限則不送出，
+ * 並返回 TL_ERROR_EXPIRED。
+ *
+ * 參數：deadline_us 期限 (tl_time_now_us 的時間基準)，0 表示不限
+ * 返回值：先前的期限，供呼叫端還原
+ */
+unsigned long long tl_cmd_set_thread_deadline(unsigned long long deadline_us);
+
+/*
+ * 建構緊急命令使用的預先建構畫面
+ *
+ * 清除塔燈與停止蜂鳴器的命令內容固定，於初始化時建構一次。
+ *
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_init_emergency_frames(void);
+
+/*
+ * 取得預先建構的緊急畫面
+ *
+ * 參數：type TL_COMMAND_CLEAR 或 TL_COMMAND_STOP_BUZZER
+ * 返回值：預先建構的畫面，其他命令類型返回 NULL
+ */
+const TL_PreparedFrame* tl_cmd_get_emergency_frame(TL_COMMAND_TYPE type);
+
+/*
+ * 以緊急優先權套用塔燈畫面
+ *
+ * 一般命令在緊急命令完成前暫停，緊急命令只等待目前進行中的往返結束；
+ * 尚未送出且目標被此畫面涵蓋的一般設定命令以 TL_ERROR_SUPERSEDED 結束。
+ *
+ * 參數：device 裝置狀態
+ * 參數：prepared 預先建構的塔燈畫面
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_apply_emergency(TL_DeviceContext* device, const TL_PreparedFrame* prepared);
+
+/*
+ * 記錄被取代的一般命令數
+ *
+ * 參數：device 裝置狀態
+ * 參數：count 被取代的命令數
+ */
+void tl_cmd_note_superseded(TL_DeviceContext* device, unsigned long count);
+
+/*
+ * 更新影子狀態
+ *
+ * 記錄目標最後一次要求的設定並遞增其序號。
+ *
+ * 參數：device 裝置狀態
+ * 參數：target 設定目標 (0~2: LED層級, 3: 蜂鳴器)
+ * 參數：led LED狀態 (target 為層級時使用)
+ * 參數：buzzer 蜂鳴器狀態 (target 為 3 時使用)
+ */
+void tl_shadow_update(TL_DeviceContext* device, int target,
+                      const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer);
+
+/*
+ * 初始化排程器
+ *
+ * 建立排程器的同步物件，排程執行緒在第一次排程時才建立。
+ *
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_scheduler_init(void);
+
+/*
+ * 關閉排程器
+ *
+ * 停止排程執行緒並捨棄尚未執行的排程 (不呼叫完成回呼)。
+ */
+void tl_scheduler_shutdown(void);
+
+/*
+ * 初始化事件提交系統
+ *
+ * 建立同步物件；通知代碼與工作執行緒在第一次使用時才建立。
+ *
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_events_init(void);
+
+/*
+ * 關閉事件提交系統
+ *
+ * 等待執行中的請求完成後停止工作執行緒，捨棄佇列中的請求與未處理的事件。
+ */
+void tl_events_shutdown(void);
+
+/*
+ * 提交到期的排程命令
+ *
+ * 與 TL_SubmitCommand 使用同一個佇列 (依優先權與 deadline_ms 處理、同一裝置依序)，
+ * 但完成時不產生事件，而是在函式庫的執行緒、不持有內部鎖時呼叫 callback；
+ * 在佇列中被取消、取代或過期時同樣呼叫。
+ *
+ * 參數：command 要執行的命令 (會被複製)，device 為 NULL 時使用預設裝置
+ * 參數：id 傳給回呼的排程識別碼
+ * 參數：callback 完成回呼，可為 NULL
+ * 參數：user_data 傳給回呼的使用者資料
+ * 返回值：TL_SUCCESS 表示已提交 (之後必定呼叫回呼)，其他值表示錯誤碼 (不會呼叫回呼)
+ */
+TL_ERROR_CODE tl_events_submit_scheduled(const TL_TowerCommand* command, TL_TIMER_ID id,
+                                         TL_ScheduleCallback callback, void* user_data);
+
+/*
+ * 取消指定裝置或群組的提交請求
+ *
+ * 佇列中的請求以 TL_ERROR_DEVICE_NOT_OPEN 完成，並等待執行中的請求結束。
+ * 關閉裝置或銷毀群組前呼叫。
+ *
+ * 參數：target 裝置 (TL_DeviceContext*) 或群組 (TL_GROUP_HANDLE)
+ */
+void tl_events_cancel_target(const void* target);
+
+/*
+ * 取消指定裝置或群組的排程
+ *
+ * 尚未執行的排程以 TL_ERROR_DEVICE_NOT_OPEN 呼叫完成回呼，並等待執行中的排程結束。
+ * 關閉裝置或銷毀群組前呼叫。
+ *
+ * 參數：target 裝置 (TL_DeviceContext*) 或群組 (TL_GROUP_HANDLE)
+ */
+void tl_scheduler_cancel_target(const void* target);
+
+/*
+ * 將裝置從所有裝置群組中移除
+ *
+ * 等待進行中的群組套用結束後清除成員的裝置指標，之後的套用對該成員
+ * 回報 TL_ERROR_DEVICE_NOT_OPEN。釋放由 TL_OpenDevice 開啟的裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_group_detach_device(TL_DeviceContext* device);
+
+/*
+ * 停止期望狀態收斂器
+ *
+ * 等待進行中的命令結束後結束收斂執行緒並釋放收斂器，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_reconcile_stop(TL_DeviceContext* device);
+
+/*
+ * 停止輸入濾波器
+ *
+ * 等待進行中的命令結束後結束濾波執行緒並釋放濾波器，尚未送出的輸入即捨棄。
+ * 關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_filter_stop(TL_DeviceContext* device);
+
+/*
+ * 停止動畫播放器
+ *
+ * 等待進行中的步驟送出結束後結束播放執行緒並釋放播放器，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_sequence_stop(TL_DeviceContext* device);
+
+/*
+ * 停止 Modbus TCP 伺服器
+ *
+ * 關閉所有連線與監聽通訊端後結束伺服器執行緒，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_modbus_stop(TL_DeviceContext* device);
+
+/*
+ * 停止狀態推播伺服器
+ *
+ * 關閉所有訂閱者與監聽通訊端後結束推播執行緒，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_push_stop(TL_DeviceContext* device);
+
+/*
+ * 通知狀態推播伺服器裝置的目前狀態已改變
+ *
+ * 未啟動推播伺服器時只做一次原子讀取；啟動時短暫取得 state_lock 喚醒推播執行緒，
+ * 不可在持有 state_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_push_note(TL_DeviceContext* device);
+
+/*
+ * 停止失效安全看門狗
+ *
+ * 等待進行中的安全畫面送出結束後結束看門狗執行緒，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_watchdog_stop(TL_DeviceContext* device);
+
+/*
+ * 開始一個追蹤區段
+ *
+ * 未啟用追蹤時只讀取一次旗標。
+ *
+ * 返回值：開始時間 (微秒)，0 表示未啟用
+ */
+unsigned long long tl_trace_begin(void);
+
+/*
+ * 結束追蹤區段並記錄於呼叫執行緒的事件緩衝區
+ *
+ * 寫入不加鎖；執行緒第一次記錄時才配置緩衝區。
+ *
+ * 參數：stage 階段
+ * 參數：start_us tl_trace_begin 的返回值，0 表示不記錄
+ * 參數：arg 階段的參數 (見 TL_TRACE_STAGE)
+ */
+void tl_trace_end(TL_TRACE_STAGE stage, unsigned long long start_us, unsigned int arg);
+
+/*
+ * 初始化狀態日誌
+ *
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_journal_init(void);
+
+/*
+ * 關閉狀態日誌並釋放同步物件
+ */
+void tl_journal_shutdown(void);
+
+/*
+ * 將裝置目前或期望的狀態寫入日誌
+ *
+ * 未開啟日誌時只做一次原子讀取；狀態未改變時不寫入。
+ *
+ * 參數：device 裝置狀態
+ * 參數：desired TL_TRUE 表示記錄期望狀態，TL_FALSE 表示記錄目前狀態
+ * 參數：target_mask 改變的目標 (TL_FRAME_*)
+ */
+void tl_journal_note(TL_DeviceContext* device, TL_BOOL desired, unsigned int target_mask);
+
+/*
+ * 以日誌中的記錄還原剛開啟的裝置
+ *
+ * 記錄以 device_path 尋找，只還原記錄中有狀態的目標。
+ *
+ * 參數：device 裝置狀態
+ * 參數：start_us 開始開啟裝置的時間，用於統計還原時間
+ * 返回值：已還原的目標 (TL_FRAME_*)，0 表示沒有記錄或還原失敗
+ */
+unsigned int tl_journal_restore(TL_DeviceContext* device, unsigned long long start_us);
+
+/*
+ * 初始化命令追蹤
+ *
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_trace_init(void);
+
+/*
+ * 關閉命令追蹤並釋放所有執行緒的事件緩衝區
+ *
+ * 其他執行緒須已停止呼叫塔燈控制函式。
+ */
+void tl_trace_shutdown(void);
+
+/*
+ * 停止連線健康監控
+ *
+ * 等待進行中的探測與回呼結束後結束監控執行緒，關閉裝置前呼叫。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_health_stop(TL_DeviceContext* device);
+
+/*
+ * 壓縮單一LED層級的狀態
+ *
+ * 參數：status LED狀態
+ * 返回值：TL_TowerState 中該層級的位元組 (位於最低位元組)
+ */
+TL_TowerState tl_tower_state_encode_led(const TL_LEDStatus* status);
+
+/*
+ * 壓縮蜂鳴器的狀態
+ *
+ * 參數：status 蜂鳴器狀態
+ * 返回值：TL_TowerState 中蜂鳴器的位元組 (位於最低位元組)
+ */
+TL_TowerState tl_tower_state_encode_buzzer(const TL_BuzzerStatus* status);
+
+/*
+ * 以比較並交換更新狀態字組中的部分目標
+ *
+ * 參數：word 狀態字組位址
+ * 參數：state 新的狀態，只使用 target_mask 指定的目標
+ * 參數：target_mask 要更新的目標 (TL_FRAME_*)
+ * 返回值：更新後的狀態字組
+ */
+TL_TowerState tl_tower_state_merge(volatile TL_TowerState* word, TL_TowerState state, unsigned int target_mask);
+
+/*
+ * 記錄單一目標目前的狀態
+ *
+ * 參數：device 裝置狀態
+ * 參數：target 設定目標 (0~2: LED層級, 3: 蜂鳴器)
+ * 參數：led LED狀態 (target 為層級時使用)
+ * 參數：buzzer 蜂鳴器狀態 (target 為 3 時使用)
+ */
+void tl_tower_state_note(TL_DeviceContext* device, int target,
+                         const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer);
+
+/*
+ * 判斷狀態字組中的目標是否點亮 (或鳴響)
+ *
+ * 參數：state 塔燈狀態字組
+ * 參數：target 目標 (0~2: LED層級, 3: 蜂鳴器)
+ * 返回值：TL_TRUE 表示點亮 (LED有任一顏色且模式不為關閉，或蜂鳴器模式不為關閉)
+ */
+TL_BOOL tl_tower_state_active(TL_TowerState state, int target);
+
+/*
+ * 取得下一個以空白分隔的字詞 (文字定義檔用)
+ *
+ * 就地在字詞結尾加上 NUL 並移動游標。
+ *
+ * 參數：cursor 游標，指向以 NUL 結尾的可寫入字串
+ * 返回值：字詞，沒有時為 NULL
+ */
+char* tl_text_next_token(char** cursor);
+
+/*
+ * 解析十進位整數 (0 ~ 0xFFFFFFFF)
+ *
+ * 參數：token 字詞，可為 NULL
+ * 參數：value 用於存儲結果的指標
+ * 返回值：TL_TRUE 表示成功
+ */
+TL_BOOL tl_text_parse_u32(const char* token, unsigned int* value);
+
+/*
+ * 解析文字定義中的四個目標字詞 (第一層、第二層、第三層、蜂鳴器)
+ *
+ * LED 寫成 RGB/P，蜂鳴器寫成 TV/P，- 表示不包含該目標 (不設定 target_mask 的位元)。
+ *
+ * 參數：cursor 游標 (同 tl_text_next_token)
+ * 參數：frame 用於存儲結果的塔燈畫面
+ * 返回值：TL_TRUE 表示成功
+ */
+TL_BOOL tl_tower_state_parse(char** cursor, TL_TowerFrame* frame);
+
+/*
+ * 在持有 io_lock 時讀取單一目標的狀態 (僅同步模式)
+ *
+ * 只做一次往返，不重試、不重新開啟裝置，也不做重置檢查；
+ * 供重新開啟裝置後確認塔燈是否已失去狀態。
+ *
+ * 參數：device 裝置狀態
+ * 參數：target 目標 (TL_TARGET_*)
+ * 參數：led 目標為LED層級時用於存儲狀態的指標
+ * 參數：buzzer 目標為蜂鳴器時用於存儲狀態的指標
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_read_status_locked(TL_DeviceContext* device, int target,
+                                        TL_LEDStatus* led, TL_BuzzerStatus* buzzer);
+
+/*
+ * 以一次連續寫出重新送出塔燈畫面
+ *
+ * 同步模式下先寫出所有設定命令再依序接收回應，只需等待約一次往返時間；
+ * 非同步模式下經由寫入引擎送出。不更新影子狀態。
+ *
+ * 參數：device 裝置狀態
+ * 參數：prepared 預先建構的畫面
+ * 參數：io_locked 呼叫端是否已持有 io_lock (僅同步模式)
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_cmd_restore_frame(TL_DeviceContext* device, const TL_PreparedFrame* prepared,
+                                   TL_BOOL io_locked);
+
+/*
+ * 依讀回的狀態檢查裝置是否曾經重置
+ *
+ * 讀回的目標為關閉而影子狀態為點亮時，讀取其他點亮的目標確認；全部為關閉時
+ * 判定為重置並重新送出影子狀態。不可在持有 io_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
+ * 參數：target 讀取的目標 (0~2: LED層級, 3: 蜂鳴器)
+ * 參數：led 讀回的LED狀態 (target 為層級時使用)
+ * 參數：buzzer 讀回的蜂鳴器狀態 (target 為 3 時使用)
+ */
+void tl_reset_note_read(TL_DeviceContext* device, int target,
+                        const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer);
+
+/*
+ * 依整座塔燈的快照檢查裝置是否曾經重置
+ *
+ * 影子狀態中點亮的目標在快照中全部為關閉時判定為重置並重新送出影子狀態，
+ * 不再另外讀取。不可在持有 io_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
+ * 參數：status 快照讀回的各目標狀態
+ */
+void tl_reset_note_snapshot(TL_DeviceContext* device, const TL_TowerFrame* status);
+
+/*
+ * 命令往返的USB寫入或讀取失敗時嘗試恢復
+ *
+ * 重新開啟裝置；成功表示裝置曾重新列舉，記錄一次重置並重新送出影子狀態。
+ * 須在同步模式下持有 io_lock 時呼叫。
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_TRUE 表示已重新開啟裝置，呼叫端可重試命令
+ */
+TL_BOOL tl_reset_on_io_failure(TL_DeviceContext* device);
+
+/*
+ * 取得送出一個一般命令的權杖
+ *
+ * 未設定速率上限時立即返回；否則等待到權杖桶中有權杖為止。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_rate_acquire(TL_DeviceContext* device);
+
+/*
+ * 啟動非同步寫入引擎
+ *
+ * 建立接收執行緒與驗證執行緒，裝置須已開啟。
+ *
+ * 參數：device 裝置狀態
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_async_start(TL_DeviceContext* device);
+
+/*
+ * 停止非同步寫入引擎
+ *
+ * 等待在途命令的回應 (或逾時) 後結束背景執行緒並釋放引擎。
+ *
+ * 參數：device 裝置狀態
+ */
+void tl_async_stop(TL_DeviceContext* device);
+
+/*
+ * 不等待回應送出設定命令
+ *
+ * 參數：engine 非同步寫入引擎
+ * 參數：target 設定目標
+ * 參數：command 命令緩衝區
+ * 參數：command_length 命令長度
+ * 返回值：TL_SUCCESS 表示命令已寫出，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_async_send(TL_AsyncEngine* engine, int target,
+                           const TL_BYTE* command, size_t command_length);
+
+/*
+ * 經由非同步寫入引擎發送命令並等待回應
+ *
+ * 命令與不等待回應的設定命令共用同一佇列，以保持回應順序。
+ *
+ * 參數：engine 非同步寫入引擎
+ * 參數：command 命令緩衝區
+ * 參數：command_length 命令長度
+ * 參數：response 回應緩衝區
+ * 參數：response_size 回應緩衝區大小
+ * 參數：response_length 實際接收到的回應長度
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_async_transact(TL_AsyncEngine* engine,
+                               const TL_BYTE* command, size_t command_length,
+                               TL_BYTE* response, size_t response_size,
+                               size_t* response_length);
+
+/*
+ * 經由非同步寫入引擎連續送出多個命令並等待全部的回應
+ *
+ * 參數：engine 非同步寫入引擎
+ * 參數：count 命令數 (1~TL_BATCH_MAX_COMMANDS)
+ * 參數：commands 各命令的緩衝區
+ * 參數：command_lengths 各命令的長度
+ * 參數：responses 各回應的緩衝區
+ * 參數：response_size 每個回應緩衝區的大小
+ * 參數：response_lengths 各回應的實際長度
+ * 返回值：TL_SUCCESS 表示全部成功，否則為第一個錯誤碼
+ */
+TL_ERROR_CODE tl_async_transact_batch(TL_AsyncEngine* engine, size_t count,
+                                     const TL_BYTE* const* commands, const size_t* command_lengths,
+                                     TL_BYTE* const* responses, size_t response_size,
+                                     size_t* response_lengths);
+
+/*
+ * 以唯讀方式映射檔案
+ *
+ * 將整個檔案映射到記憶體，映射期間可直接存取檔案內容。
+ *
+ * 參數：path 檔案路徑
+ * 參數：mapping 用於存儲映射資訊的結構
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_file_map_open_read(const char* path, TL_FileMapping* mapping);
+
+/*
+ * 以可寫入方式映射檔案
+ *
+ * 檔案不存在時建立，小於 size 時以 0 延長，只映射前 size 個位元組。
+ * 寫入映射的內容由作業系統寫回檔案，程式結束 (包括當機) 也不會遺失。
+ *
+ * 參數：path 檔案路徑
+ * 參數：size 映射大小
+ * 參數：mapping 用於存儲映射資訊的結構
+ * 返回值：TL_SUCCESS 表示成功，其他值表示錯誤碼
+ */
+TL_ERROR_CODE tl_file_map_open_write(const char* path, size_t size, TL_FileMapping* mapping);
+
+/*
+ * 將可寫入映射的內容同步寫入磁碟
+ *
+ * 參數：mapping 由 tl_file_map_open_write 建立的映射
+ */
+void tl_file_map_flush(TL_FileMapping* mapping);
+
+/*
+ * 解除檔案映射
+ *
+ * 參數：mapping 由 tl_file_map_open_read 或 tl_file_map_open_write 建立的映射
+ */
+void tl_file_map_close(TL_FileMapping* mapping);
+
+/*
+ * 原子讀取指標 (acquire語意)
+ *
+ * 參數：target 指標變數位址
+ * 返回值：目前的指標值
+ */
+void* tl_atomic_load_ptr(void* volatile* target);
+
+/*
+ * 原子交換指標
+ *
+ * 參數：target 指標變數位址
+ * 參數：value 新的指標值
+ * 返回值：交換前的指標值
+ */
+void* tl_atomic_exchange_ptr(void* volatile* target, void* value);
+
+/*
+ * 原子比較並交換指標
+ *
+ * 參數：target 指標變數位址
+ * 參數：expected 預期的目前值
+ * 參數：desired 要寫入的新值
+ * 返回值：TL_TRUE 表示交換成功
+ */
+TL_BOOL tl_atomic_cas_ptr(void* volatile* target, void* expected, void* desired);
+
+/*
+ * 原子讀取 32 位元整數 (acquire語意)
+ *
+ * 參數：target 變數位址
+ * 返回值：目前的值
+ */
+unsigned int tl_atomic_load_u32(volatile unsigned int* target);
+
+/*
+ * 原子寫入 32 位元整數 (release語意)
+ *
+ * 參數：target 變數位址
+ * 參數：value 要寫入的值
+ */
+void tl_atomic_store_u32(volatile unsigned int* target, unsigned int value);
+
+/*
+ * 原子比較並交換 32 位元整數
+ *
+ * 參數：target 變數位址
+ * 參數：expected 預期的目前值
+ * 參數：desired 要寫入的新值
+ * 返回值：TL_TRUE 表示交換成功
+ */
+TL_BOOL tl_atomic_cas_u32(volatile unsigned int* target, unsigned int expected, unsigned int desired);
+
+/*
+ * 讀取屏障 (acquire語意)，確保先前的讀取早於之後的原子讀取
+ */
+void tl_atomic_fence_acquire(void);
+
+/*
+ * 寫入屏障 (release語意)，確保先前的原子寫入早於之後的寫入
+ */
+void tl_atomic_fence_release(void);
+
+/*
+ * 互斥鎖
+ *
+ * tl_mutex_create 失敗時返回 NULL，tl_mutex_destroy 可接受 NULL。
+ */
+TL_Mutex* tl_mutex_create(void);
+void tl_mutex_destroy(TL_Mutex* mutex);
+void tl_mutex_lock(TL_Mutex* mutex);
+void tl_mutex_unlock(TL_Mutex* mutex);
+
+/*
+ * 條件變數
+ *
+ * tl_cond_wait 需在持有 mutex 時呼叫，timeout_ms 可為 TL_WAIT_INFINITE。
+ * 返回值：TL_FALSE 表示逾時，TL_TRUE 表示被喚醒 (呼叫端仍須重新檢查條件)
+ */
+TL_Cond* tl_cond_create(void);
+void tl_cond_destroy(TL_Cond* cond);
+TL_BOOL tl_cond_wait(TL_Cond* cond, TL_Mutex* mutex, unsigned long timeout_ms);
+void tl_cond_signal(TL_Cond* cond);
+void tl_cond_broadcast(TL_Cond* cond);
+
+/*
+ * 執行緒
+ *
+ * tl_thread_create 失敗時返回 NULL；tl_thread_join 等待結束並釋放資源。
+ */
+TL_Thread* tl_thread_create(TL_ThreadFunc func, void* arg);
+void tl_thread_join(TL_Thread* thread);
+
+/*
+ * 可輪詢的通知訊號
+ *
+ * Linux 使用 eventfd，其他 POSIX 平台使用非阻塞管道，Windows 使用手動重設事件。
+ * tl_poll_signal_set 後代碼保持可讀，直到 tl_poll_signal_clear；兩者皆不會阻塞。
+ * tl_poll_signal_create 失敗時返回 NULL，tl_poll_signal_destroy 可接受 NULL。
+ */
+TL_PollSignal* tl_poll_signal_create(void);
+void tl_poll_signal_destroy(TL_PollSignal* signal);
+void tl_poll_signal_set(TL_PollSignal* signal);
+void tl_poll_signal_clear(TL_PollSignal* signal);
+TL_POLL_FD tl_poll_signal_fd(const TL_PollSignal* signal);
+
+/*
+ * TCP 監聽通訊端
+ *
+ * 只支援 IPv4；address 為 NULL 時監聽所有介面，port 為 0 時由系統指定，
+ * 以 tl_socket_local_port 取得實際的連接埠。所有通訊端皆為非阻塞。
+ * tl_socket_accept 沒有等待中的連線時返回 NULL；接受的連線停用 Nagle 演算法。
+ */
+TL_ERROR_CODE tl_socket_listen(const char* address, unsigned short port, TL_Socket** listener);
+TL_Socket* tl_socket_accept(TL_Socket* listener);
+unsigned short tl_socket_local_port(const TL_Socket* socket);
+
+/*
+ * 連接到 TCP 伺服器 (IPv4)
+ *
+ * 連接完成後才返回，之後的通訊端與 tl_socket_accept 的相同 (非阻塞、停用 Nagle 演算法)。
+ * 返回值：TL_SUCCESS 表示成功，TL_ERROR_DEVICE_OPEN_FAILED 表示無法連接
+ */
+TL_ERROR_CODE tl_socket_connect(const char* address, unsigned short port, TL_Socket** socket);
+
+/*
+ * 非阻塞收送
+ *
+ * 返回值：大於 0 為收送的位元組數，0 表示目前無法收送 (稍後再試)，
+ *         -1 表示對方已關閉或發生錯誤
+ */
+long tl_socket_recv(TL_Socket* socket, void* buffer, size_t length);
+long tl_socket_send(TL_Socket* socket, const void* buffer, size_t length);
+
+/*
+ * 關閉通訊端，可接受 NULL
+ */
+void tl_socket_close(TL_Socket* socket);
+
+/*
+ * 喚醒用的通訊端
+ *
+ * 連接到自己的本機 UDP 通訊端，可與其他通訊端一起輪詢 (Windows 的 WSAPoll
+ * 無法等待事件物件)。tl_socket_wake 使其變為可讀，tl_socket_wake_clear 取出所有資料。
+ */
+TL_Socket* tl_socket_wake_create(void);
+void tl_socket_wake(TL_Socket* wake);
+void tl_socket_wake_clear(TL_Socket* wake);
+
+/*
+ * 等待通訊端事件
+ *
+ * 參數：items 輪詢項目，socket 為 NULL 的項目略過
+ * 參數：count 項目數
+ * 參數：timeout_ms 最長等待時間，可為 TL_WAIT_INFINITE
+ * 返回值：有事件的項目數，0 表示逾時，-1 表示錯誤
+ */
+int tl_socket_poll(TL_SocketPoll* items, size_t count, unsigned long timeout_ms);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,444 @@
+﻿/*
+ * tl_journal.c
+ *
+ * 塔燈通訊控制函式庫 - 狀態日誌實現
+ *
+ * 以記憶體映射檔案記錄每台裝置最後的期望狀態與已確認狀態 (最後一次送出的設定
+ * 或讀回的狀態)。服務重新啟動後 TL_OpenConnection / TL_OpenDevice 以一次連續寫出
+ * 還原，塔燈不必等應用程式重新計算狀態而暫時全暗。
+ *
+ * 檔案由標頭與每台裝置一筆記錄組成。記錄以裝置路徑識別，塔燈重新插拔或列舉順序改變
+ * 後仍對應到同一台；路徑未出現過的裝置在第一次寫入時取用空的記錄。每筆記錄有兩個槽
+ * 輪流寫入：
+ *   - 更新時覆寫較舊的槽，序號為較新槽的序號加一，並附上校驗和；
+ *   - 讀取時採用校驗和正確且序號較新的槽。
+ * 寫到一半中斷時只有正在寫入的槽損毀，另一個槽仍是上一次完整的狀態。
+ * 映射的頁面由作業系統寫回，程式當機不會遺失；需承受斷電時以 TL_JOURNAL_FLUSH
+ * 開啟，每次更新後同步寫入磁碟。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "tl_internal.h"
+
+/* 檔案標頭的識別碼 ("JRNL") 與格式版本 */
+#define TL_JOURNAL_MAGIC    0x4C4E524Au
+#define TL_JOURNAL_VERSION  2
+
+/* 檔案標頭 */
+typedef struct {
+    unsigned int magic;          /* TL_JOURNAL_MAGIC */
+    unsigned int version;        /* TL_JOURNAL_VERSION */
+    unsigned int record_count;   /* 裝置記錄數 (TL_JOURNAL_DEVICES) */
+    unsigned int slot_size;      /* 每個槽的大小 */
+    unsigned int reserved[12];   /* 保留 (補足 64 位元組) */
+} TL_JournalHeader;
+
+/* 記錄槽 */
+typedef struct {
+    unsigned int sequence;       /* 寫入序號，0 表示未使用 */
+    TL_TowerState desired;       /* 期望狀態 */
+    unsigned int desired_mask;   /* 有期望狀態的目標 */
+    TL_TowerState confirmed;     /* 已確認狀態 */
+    unsigned int confirmed_mask; /* 有已確認狀態的目標 */
+    unsigned int checksum;       /* 以上欄位的校驗和 */
+    unsigned int reserved[2];    /* 保留 (補足 32 位元組) */
+} TL_JournalSlot;
+
+/* 單一裝置的記錄 */
+typedef struct {
+    char path[TL_DEVICE_PATH_MAX]; /* 裝置路徑，空字串表示未使用 */
+    TL_JournalSlot slots[2];       /* 輪流寫入的兩個槽 */
+} TL_JournalRecord;
+
+/* 日誌檔案大小 */
+#define TL_JOURNAL_FILE_SIZE  (sizeof(TL_JournalHeader) + TL_JOURNAL_DEVICES * sizeof(TL_JournalRecord))
+
+/* 日誌狀態 */
+static struct {
+    TL_Mutex* lock;              /* 保護以下欄位、檔案內容與各裝置的 journal_stats */
+    TL_FileMapping mapping;      /* 日誌檔案的映射 */
+    unsigned int flags;          /* TL_JOURNAL_* */
+    volatile unsigned int open;  /* 是否已開啟 (原子操作，未開啟時不需取得鎖) */
+} g_journal;
+
+/*
+ * 計算記錄槽的校驗和 (FNV-1a)
+ */
+static unsigned int tl_journal_checksum(const TL_JournalSlot* slot)
+{
+    const TL_BYTE* bytes = (const TL_BYTE*)slot;
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < offsetof(TL_JournalSlot, checksum); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * 將目標遮罩展開為狀態字組中的位元遮罩
+ */
+static TL_TowerState tl_journal_bytes(unsigned int target_mask)
+{
+    TL_TowerState bytes = 0;
+    int target;
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (target_mask & (1u << target)) {
+            bytes |= (TL_TowerState)0xFF << (target * 8);
+        }
+    }
+    return bytes;
+}
+
+/*
+ * 取得記錄中最新的有效槽，沒有時為 -1
+ */
+static int tl_journal_latest(const TL_JournalRecord* record)
+{
+    const TL_JournalSlot* slot;
+    int latest = -1;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        slot = &record->slots[i];
+        if (slot->sequence == 0 || slot->checksum != tl_journal_checksum(slot)) {
+            continue;
+        }
+        /* 序號以差值比較，繞回後仍然正確 */
+        if (latest < 0 || (int)(slot->sequence - record->slots[latest].sequence) > 0) {
+            latest = i;
+        }
+    }
+    return latest;
+}
+
+/*
+ * 取得裝置的記錄 (須持有鎖)
+ *
+ * 以裝置路徑尋找記錄；create 為 TL_TRUE 且找不到時，取用路徑為空或沒有有效槽的記錄。
+ * 未開啟日誌、裝置沒有路徑或記錄已滿時為 NULL。
+ */
+static TL_JournalRecord* tl_journal_record_locked(const TL_DeviceContext* device, TL_BOOL create)
+{
+    TL_JournalRecord* records;
+    TL_JournalRecord* unused = NULL;
+    size_t length;
+    unsigned int i;
+
+    if (!g_journal.open || device->device_path[0] == '\0') {
+        return NULL;
+    }
+
+    records = (TL_JournalRecord*)(g_journal.mapping.writable + sizeof(TL_JournalHeader));
+    for (i = 0; i < TL_JOURNAL_DEVICES; i++) {
+        if (strncmp(records[i].path, device->device_path, TL_DEVICE_PATH_MAX) == 0) {
+            return &records[i];
+        }
+        /* 取用記錄時中斷而只寫入部分路徑的記錄沒有有效槽，可以再次取用 */
+        if (unused == NULL && (records[i].path[0] == '\0' || tl_journal_latest(&records[i]) < 0)) {
+            unused = &records[i];
+        }
+    }
+    if (!create || unused == NULL) {
+        return NULL;
+    }
+
+    /* 先使舊的槽失效再寫入路徑，中斷時不會把其他裝置的狀態當成此裝置的 */
+    memset(unused->slots, 0, sizeof(unused->slots));
+    memset(unused->path, 0, sizeof(unused->path));
+    length = strlen(device->device_path);
+    if (length > sizeof(unused->path) - 1) {
+        length = sizeof(unused->path) - 1;
+    }
+    memcpy(unused->path, device->device_path, length);
+    unused->path[length] = '\0';
+    return unused;
+}
+
+/*
+ * 關閉日誌檔案 (須持有鎖)
+ */
+static void tl_journal_close_locked(void)
+{
+    if (!g_journal.open) {
+        return;
+    }
+    tl_atomic_store_u32(&g_journal.open, 0);
+    tl_file_map_flush(&g_journal.mapping);
+    tl_file_map_close(&g_journal.mapping);
+}
+
+/*
+ * 初始化狀態日誌
+ */
+TL_ERROR_CODE tl_journal_init(void)
+{
+    memset(&g_journal.mapping, 0, sizeof(g_journal.mapping));
+    g_journal.flags = 0;
+    g_journal.open = 0;
+
+    g_journal.lock = tl_mutex_create();
+    if (g_journal.lock == NULL) {
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉狀態日誌
+ */
+void tl_journal_shutdown(void)
+{
+    if (g_journal.lock == NULL) {
+        return;
+    }
+    tl_mutex_lock(g_journal.lock);
+    tl_journal_close_locked();
+    tl_mutex_unlock(g_journal.lock);
+    tl_mutex_destroy(g_journal.lock);
+    g_journal.lock = NULL;
+}
+
+/*
+ * 將裝置目前或期望的狀態寫入日誌
+ */
+void tl_journal_note(TL_DeviceContext* device, TL_BOOL desired, unsigned int target_mask)
+{
+    TL_JournalRecord* record;
+    TL_JournalSlot slot;
+    TL_TowerState bytes = tl_journal_bytes(target_mask);
+    int latest;
+
+    if (!tl_atomic_load_u32(&g_journal.open)) {
+        return;
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    record = tl_journal_record_locked(device, TL_TRUE);
+    if (record == NULL) {
+        tl_mutex_unlock(g_journal.lock);
+        return;
+    }
+
+    latest = tl_journal_latest(record);
+    if (latest >= 0) {
+        slot = record->slots[latest];
+    } else {
+        memset(&slot, 0, sizeof(slot));
+    }
+
+    /* 在鎖內讀取狀態字組，最後取得鎖的執行緒寫入的一定是最新的值 */
+    if (desired) {
+        slot.desired = (slot.desired & ~bytes) | (tl_atomic_load_u32(&device->desired_state) & bytes);
+        slot.desired_mask |= target_mask;
+    } else {
+        slot.confirmed = (slot.confirmed & ~bytes) | (tl_atomic_load_u32(&device->current_state) & bytes);
+        slot.confirmed_mask |= target_mask;
+    }
+
+    if (latest >= 0 && slot.desired == record->slots[latest].desired &&
+        slot.desired_mask == record->slots[latest].desired_mask &&
+        slot.confirmed == record->slots[latest].confirmed &&
+        slot.confirmed_mask == record->slots[latest].confirmed_mask) {
+        device->journal_stats.skipped++;
+        tl_mutex_unlock(g_journal.lock);
+        return;
+    }
+
+    /* 覆寫較舊的槽，較新的槽在寫入完成前仍然有效 */
+    slot.sequence = (latest >= 0) ? record->slots[latest].sequence + 1 : 1;
+    if (slot.sequence == 0) {
+        slot.sequence = 1;
+    }
+    slot.checksum = tl_journal_checksum(&slot);
+    record->slots[(latest >= 0) ? (latest ^ 1) : 0] = slot;
+
+    if (g_journal.flags & TL_JOURNAL_FLUSH) {
+        tl_file_map_flush(&g_journal.mapping);
+    }
+    device->journal_stats.writes++;
+    tl_mutex_unlock(g_journal.lock);
+}
+
+/*
+ * 以日誌中的記錄還原剛開啟的裝置
+ */
+unsigned int tl_journal_restore(TL_DeviceContext* device, unsigned long long start_us)
+{
+    TL_JournalRecord* record;
+    TL_JournalSlot slot;
+    TL_TowerFrame frame;
+    TL_PreparedFrame prepared;
+    TL_TowerState state;
+    TL_TowerState desired_bytes;
+    TL_ERROR_CODE result;
+    unsigned long long burst_start_us = 0;
+    unsigned long long now_us;
+    unsigned int mask = 0;
+    int latest = -1;
+    int target;
+
+    if (!tl_atomic_load_u32(&g_journal.open)) {
+        return 0;
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    device->journal_stats.restored = TL_FALSE;
+    device->journal_stats.restored_mask = 0;
+    record = tl_journal_record_locked(device, TL_FALSE);
+    if (record != NULL) {
+        latest = tl_journal_latest(record);
+    }
+    if (latest >= 0) {
+        slot = record->slots[latest];
+        mask = (slot.desired_mask | slot.confirmed_mask) & TL_FRAME_ALL;
+    }
+    tl_mutex_unlock(g_journal.lock);
+
+    if (mask == 0) {
+        return 0;
+    }
+
+    /* 有期望狀態的目標以期望狀態為準，其餘使用最後確認的狀態 */
+    desired_bytes = tl_journal_bytes(slot.desired_mask);
+    state = (slot.confirmed & ~desired_bytes) | (slot.desired & desired_bytes);
+    result = TL_UnpackTowerState(state, &frame);
+    if (result == TL_SUCCESS) {
+        frame.target_mask = mask;
+        result = tl_cmd_prepare_frame(&frame, &prepared);
+    }
+    if (result == TL_SUCCESS) {
+        burst_start_us = tl_time_now_us();
+        result = tl_cmd_restore_frame(device, &prepared, TL_FALSE);
+    }
+    now_us = tl_time_now_us();
+
+    /* 還原的狀態即為最後要求的設定 */
+    if (result == TL_SUCCESS) {
+        for (target = 0; target < TL_TARGET_COUNT; target++) {
+            if (mask & (1u << target)) {
+                tl_shadow_update(device, target, &frame.layers[target < TL_TARGET_BUZZER ? target : 0],
+                                 &frame.buzzer);
+            }
+        }
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    if (result == TL_SUCCESS) {
+        device->journal_stats.restored = TL_TRUE;
+        device->journal_stats.restored_mask = mask;
+        device->journal_stats.restore_us = now_us - start_us;
+        device->journal_stats.burst_us = now_us - burst_start_us;
+    } else {
+        device->journal_stats.restore_failures++;
+    }
+    tl_mutex_unlock(g_journal.lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[tl_journal_restore] path=%s mask=0x%X result=%d 耗時=%llu us\n",
+           device->device_path, mask, result, now_us - start_us);
+#endif
+    return (result == TL_SUCCESS) ? mask : 0;
+}
+
+/*
+ * 開啟狀態日誌
+ */
+TL_ERROR_CODE TL_OpenJournal(const char* path, unsigned int flags)
+{
+    TL_FileMapping mapping;
+    TL_JournalHeader* header;
+    TL_ERROR_CODE result;
+
+    if (path == NULL || (flags & ~(unsigned int)TL_JOURNAL_FLUSH) != 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (!tl_get_internal_state()->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    result = tl_file_map_open_write(path, TL_JOURNAL_FILE_SIZE, &mapping);
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+        return result;
+    }
+
+    /* 新建立的檔案內容全為 0 (識別碼最後寫入)；其他內容的檔案不覆寫 */
+    header = (TL_JournalHeader*)mapping.writable;
+    if (header->magic == 0) {
+        header->version = TL_JOURNAL_VERSION;
+        header->record_count = TL_JOURNAL_DEVICES;
+        header->slot_size = (unsigned int)sizeof(TL_JournalSlot);
+        header->magic = TL_JOURNAL_MAGIC;
+        tl_file_map_flush(&mapping);
+    } else if (header->magic != TL_JOURNAL_MAGIC || header->version != TL_JOURNAL_VERSION ||
+               header->record_count != TL_JOURNAL_DEVICES || header->slot_size != sizeof(TL_JournalSlot)) {
+        tl_file_map_close(&mapping);
+        tl_set_last_error(TL_ERROR_FILE_FORMAT);
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    tl_journal_close_locked();
+    g_journal.mapping = mapping;
+    g_journal.flags = flags;
+    tl_atomic_store_u32(&g_journal.open, 1);
+    tl_mutex_unlock(g_journal.lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_OpenJournal] %s flags=0x%X\n", path, flags);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉狀態日誌
+ */
+TL_ERROR_CODE TL_CloseJournal(void)
+{
+    if (!tl_get_internal_state()->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    tl_journal_close_locked();
+    tl_mutex_unlock(g_journal.lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得狀態日誌統計
+ */
+TL_ERROR_CODE TL_GetJournalStats(TL_DEVICE_HANDLE device, TL_JournalStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    context = (device != NULL) ? device : tl_get_default_device();
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(g_journal.lock);
+    *stats = context->journal_stats;
+    tl_mutex_unlock(g_journal.lock);
+    return TL_SUCCESS;
+}
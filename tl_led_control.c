@@ -19,14 +19,12 @@
 extern TL_InternalState* tl_get_internal_state(void);
 
 /*
- * 設定特定層LED的狀態
+ * 設定特定層LED的狀態 (指定裝置)
  */
-TL_ERROR_CODE TL_SetLED(TL_LAYER layer, const TL_LEDStatus* status) {
-    TL_InternalState* state;
+static TL_ERROR_CODE tl_led_set(TL_DeviceContext* device, TL_LAYER layer, const TL_LEDStatus* status) {
     TL_BYTE command[TL_MAX_BUFFER_SIZE];
     size_t command_length;
-    TL_BYTE response[TL_MAX_BUFFER_SIZE];
-    size_t response_length;
+    unsigned long long start_us;
     TL_ERROR_CODE result;
     
     /* 參數驗證 */
@@ -41,52 +39,38 @@ TL_ERROR_CODE TL_SetLED(TL_LAYER layer, const TL_LEDStatus* status) {
         return TL_ERROR_INVALID_PARAMETER;
     }
     
-    /* 獲取內部狀態 */
-    state = tl_get_internal_state();
-    
-    /* 檢查函式庫是否已初始化 */
-    if (!state->is_initialized) {
-        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
-        return TL_ERROR_NOT_INITIALIZED;
-    }
-    
-    /* 檢查裝置是否已開啟 */
-    if (!state->is_device_open) {
-        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
-        return TL_ERROR_DEVICE_NOT_OPEN;
-    }
-    
     /* 構建設定命令 */
+    start_us = tl_trace_begin();
     command_length = tl_cmd_build_led_command(layer, status, command, TL_MAX_BUFFER_SIZE);
+    tl_trace_end(TL_TRACE_BUILD, start_us, (unsigned int)command_length);
     if (command_length == 0) {
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
     
-    /* 發送命令並接收回應 */
-    result = tl_cmd_send_and_receive(command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
-    if (result != TL_SUCCESS) {
-        return result;
+    /* 非同步模式先記錄影子狀態，背景驗證才不會把尚未確認的設定誤判為不一致 */
+    if (device->async != NULL) {
+        tl_shadow_update(device, (int)layer, status, NULL);
     }
     
-    /* 檢查回應格式 */
-    result = tl_cmd_check_response_format(response, response_length);
-    if (result != TL_SUCCESS) {
-        return result;
+    /* 發送命令 (同步模式下並檢查回應，成功後才記錄影子狀態) */
+    result = tl_cmd_execute_set(device, (int)layer, command, command_length);
+    if (result == TL_SUCCESS && device->async == NULL) {
+        tl_shadow_update(device, (int)layer, status, NULL);
     }
-    
-    return TL_SUCCESS;
+    tl_trace_end(TL_TRACE_SET_LED, start_us, (unsigned int)layer);
+    return result;
 }
 
 /*
- * 獲取特定層LED的狀態
+ * 獲取特定層LED的狀態 (指定裝置)
  */
-TL_ERROR_CODE TL_GetLEDStatus(TL_LAYER layer, TL_LEDStatus* status) {
-    TL_InternalState* state;
+static TL_ERROR_CODE tl_led_get(TL_DeviceContext* device, TL_LAYER layer, TL_LEDStatus* status) {
     TL_BYTE command[TL_MAX_BUFFER_SIZE];
     size_t command_length;
     TL_BYTE response[TL_MAX_BUFFER_SIZE];
     size_t response_length;
+    unsigned long long start_us;
     TL_ERROR_CODE result;
     
     /* 參數驗證 */
@@ -101,6 +85,47 @@ TL_ERROR_CODE TL_GetLEDStatus(TL_LAYER layer, TL_LEDStatus* status) {
         return TL_ERROR_INVALID_PARAMETER;
     }
     
+    /* 構建狀態讀取命令 */
+    start_us = tl_trace_begin();
+    command_length = tl_cmd_build_status_read_command((TL_BYTE)layer, command, TL_MAX_BUFFER_SIZE);
+    tl_trace_end(TL_TRACE_BUILD, start_us, (unsigned int)command_length);
+    if (command_length == 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    
+    /* 發送命令並接收回應 */
+    result = tl_cmd_send_and_receive(device, command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
+    tl_trace_end(TL_TRACE_GET_LED, start_us, (unsigned int)layer);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 檢查回應格式 */
+    result = tl_cmd_check_response_format(response, response_length);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 解析回應並填充狀態結構 */
+    result = tl_cmd_parse_led_status(response, response_length, status);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    
+    /* 讀回的狀態即為裝置目前的狀態，並檢查裝置是否曾經重置 */
+    tl_tower_state_note(device, (int)layer, status, NULL);
+    tl_reset_note_read(device, (int)layer, status, NULL);
+    
+    return TL_SUCCESS;
+}
+
+/*
+ * 設定特定層LED的狀態
+ */
+TL_ERROR_CODE TL_SetLED(TL_LAYER layer, const TL_LEDStatus* status) {
+    TL_InternalState* state;
+    
     /* 獲取內部狀態 */
     state = tl_get_internal_state();
     
@@ -116,32 +141,61 @@ TL_ERROR_CODE TL_GetLEDStatus(TL_LAYER layer, TL_LEDStatus* status) {
         return TL_ERROR_DEVICE_NOT_OPEN;
     }
     
-    /* 構建狀態讀取命令 */
-    command_length = tl_cmd_build_status_read_command((TL_BYTE)layer, command, TL_MAX_BUFFER_SIZE);
-    if (command_length == 0) {
-        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
-        return TL_ERROR_INVALID_PARAMETER;
+    return tl_led_set(&state->device, layer, status);
+}
+
+/*
+ * 獲取特定層LED的狀態
+ */
+TL_ERROR_CODE TL_GetLEDStatus(TL_LAYER layer, TL_LEDStatus* status) {
+    TL_InternalState* state;
+    
+    /* 獲取內部狀態 */
+    state = tl_get_internal_state();
+    
+    /* 檢查函式庫是否已初始化 */
+    if (!state->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
     }
     
-    /* 發送命令並接收回應 */
-    result = tl_cmd_send_and_receive(command, command_length, response, TL_MAX_BUFFER_SIZE, &response_length);
-    if (result != TL_SUCCESS) {
-        return result;
+    /* 檢查裝置是否已開啟 */
+    if (!state->is_device_open) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
     }
     
-    /* 檢查回應格式 */
-    result = tl_cmd_check_response_format(response, response_length);
+    return tl_led_get(&state->device, layer, status);
+}
+
+/*
+ * 設定指定塔燈特定層LED的狀態
+ */
+TL_ERROR_CODE TL_DeviceSetLED(TL_DEVICE_HANDLE device, TL_LAYER layer, const TL_LEDStatus* status) {
+    TL_ERROR_CODE result;
+    
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    result = tl_validate_device(device);
     if (result != TL_SUCCESS) {
         return result;
     }
     
-    /* 解析回應並填充狀態結構 */
-    result = tl_cmd_parse_led_status(response, response_length, status);
+    return tl_led_set(device, layer, status);
+}
+
+/*
+ * 獲取指定塔燈特定層LED的狀態
+ */
+TL_ERROR_CODE TL_DeviceGetLEDStatus(TL_DEVICE_HANDLE device, TL_LAYER layer, TL_LEDStatus* status) {
+    TL_ERROR_CODE result;
+    
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    result = tl_validate_device(device);
     if (result != TL_SUCCESS) {
         return result;
     }
     
-    return TL_SUCCESS;
+    return tl_led_get(device, layer, status);
 }
 
 /*
@@ -4,158 +4,728 @@
  * 塔燈通訊控制函式庫 - 訊息資源實現
  *
  * 本檔案實現了函式庫使用的文字訊息資源管理。
+ * 內建英文、日文、繁體中文、簡體中文四種語言，並可載入預先編譯的
+ * 二進位訊息目錄 (以記憶體映射方式存取，查詢為 O(1) 且不配置記憶體)。
  *
- * 版本: 1.0.0
- * 日期: 2025-03-25
+ * 版本: 1.1.0
+ * 日期: 2026-10-18
  */
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include "tl_internal.h"
 #include "tl_messages.h"
 
- /* 預設的繁體中文訊息 - 單一來源 */
-static const char* g_default_messages[TL_MSG_ID_COUNT] = {
-    "操作成功",                     /* TL_MSG_ID_SUCCESS */
-    "一般錯誤",                     /* TL_MSG_ID_GENERAL_ERROR */
-    "函式庫未初始化",               /* TL_MSG_ID_NOT_INITIALIZED */
-    "函式庫已初始化",               /* TL_MSG_ID_ALREADY_INITIALIZED */
-    "找不到塔燈裝置",               /* TL_MSG_ID_DEVICE_NOT_FOUND */
-    "無法開啟塔燈裝置",             /* TL_MSG_ID_DEVICE_OPEN_FAILED */
-    "塔燈裝置未開啟",               /* TL_MSG_ID_DEVICE_NOT_OPEN */
-    "寫入操作失敗",                 /* TL_MSG_ID_WRITE_FAILED */
-    "讀取操作失敗",                 /* TL_MSG_ID_READ_FAILED */
-    "操作逾時",                     /* TL_MSG_ID_TIMEOUT */
-    "無效的參數",                   /* TL_MSG_ID_INVALID_PARAMETER */
-    "記憶體配置錯誤",               /* TL_MSG_ID_MEMORY_ALLOCATION */
-    "回應格式錯誤",                 /* TL_MSG_ID_RESPONSE_FORMAT */
-    "回應校驗和錯誤",               /* TL_MSG_ID_RESPONSE_CHECKSUM */
-    "裝置拒絕命令",                 /* TL_MSG_ID_RESPONSE_NACK */
-    "參數超出範圍",                 /* TL_MSG_ID_OUT_OF_RANGE */
-    "未知錯誤"                      /* TL_MSG_ID_UNKNOWN_ERROR */
+/* 內建訊息項目 (長度於編譯期計算) */
+typedef struct {
+    const char* text;
+    size_t length;
+} TL_BuiltinMessage;
+
+#define TL_MSG(s) { s, sizeof(s) - 1 }
+
+/* 內建訊息表 - 依 TL_LANGUAGE 排列 */
+static const TL_BuiltinMessage g_builtin_messages[TL_MSG_LANG_COUNT][TL_MSG_ID_COUNT] = {
+    /* TL_LANG_EN */
+    {
+        TL_MSG("Success"),
+        TL_MSG("General error"),
+        TL_MSG("Library not initialized"),
+        TL_MSG("Library already initialized"),
+        TL_MSG("Tower light device not found"),
+        TL_MSG("Failed to open tower light device"),
+        TL_MSG("Tower light device not open"),
+        TL_MSG("Write operation failed"),
+        TL_MSG("Read operation failed"),
+        TL_MSG("Operation timed out"),
+        TL_MSG("Invalid parameter"),
+        TL_MSG("Memory allocation error"),
+        TL_MSG("Invalid response format"),
+        TL_MSG("Response checksum error"),
+        TL_MSG("Command rejected by device"),
+        TL_MSG("Parameter out of range"),
+        TL_MSG("Unknown error"),
+        TL_MSG("File access failed"),
+        TL_MSG("Invalid file format"),
+        TL_MSG("Submission queue is full"),
+        TL_MSG("Command superseded by an emergency command"),
+        TL_MSG("Command expired before it was sent"),
+        TL_MSG("Setting cannot be changed while the device is open")
+    },
+    /* TL_LANG_JA */
+    {
+        TL_MSG("操作成功"),
+        TL_MSG("一般エラー"),
+        TL_MSG("ライブラリが初期化されていません"),
+        TL_MSG("ライブラリは既に初期化されています"),
+        TL_MSG("タワーライト装置が見つかりません"),
+        TL_MSG("タワーライト装置を開けません"),
+        TL_MSG("タワーライト装置が開かれていません"),
+        TL_MSG("書き込み操作に失敗しました"),
+        TL_MSG("読み取り操作に失敗しました"),
+        TL_MSG("操作がタイムアウトしました"),
+        TL_MSG("無効なパラメータ"),
+        TL_MSG("メモリ割り当てエラー"),
+        TL_MSG("応答フォーマットエラー"),
+        TL_MSG("応答チェックサムエラー"),
+        TL_MSG("装置がコマンドを拒否しました"),
+        TL_MSG("パラメータが範囲外です"),
+        TL_MSG("不明なエラー"),
+        TL_MSG("ファイルアクセスに失敗しました"),
+        TL_MSG("ファイル形式が無効です"),
+        TL_MSG("送信キューが満杯です"),
+        TL_MSG("コマンドは緊急コマンドにより置き換えられました"),
+        TL_MSG("コマンドは送信前に期限切れになりました"),
+        TL_MSG("装置が開いている間はこの設定を変更できません")
+    },
+    /* TL_LANG_ZH_TW */
+    {
+        TL_MSG("操作成功"),
+        TL_MSG("一般錯誤"),
+        TL_MSG("函式庫未初始化"),
+        TL_MSG("函式庫已初始化"),
+        TL_MSG("找不到塔燈裝置"),
+        TL_MSG("無法開啟塔燈裝置"),
+        TL_MSG("塔燈裝置未開啟"),
+        TL_MSG("寫入操作失敗"),
+        TL_MSG("讀取操作失敗"),
+        TL_MSG("操作逾時"),
+        TL_MSG("無效的參數"),
+        TL_MSG("記憶體配置錯誤"),
+        TL_MSG("回應格式錯誤"),
+        TL_MSG("回應校驗和錯誤"),
+        TL_MSG("裝置拒絕命令"),
+        TL_MSG("參數超出範圍"),
+        TL_MSG("未知錯誤"),
+        TL_MSG("檔案存取失敗"),
+        TL_MSG("檔案格式錯誤"),
+        TL_MSG("提交佇列已滿"),
+        TL_MSG("命令已被緊急命令取代"),
+        TL_MSG("命令在送出前已逾期"),
+        TL_MSG("裝置開啟中無法變更此設定")
+    },
+    /* TL_LANG_ZH_CN */
+    {
+        TL_MSG("操作成功"),
+        TL_MSG("一般错误"),
+        TL_MSG("函数库未初始化"),
+        TL_MSG("函数库已初始化"),
+        TL_MSG("找不到塔灯设备"),
+        TL_MSG("无法打开塔灯设备"),
+        TL_MSG("塔灯设备未打开"),
+        TL_MSG("写入操作失败"),
+        TL_MSG("读取操作失败"),
+        TL_MSG("操作超时"),
+        TL_MSG("无效的参数"),
+        TL_MSG("内存分配错误"),
+        TL_MSG("响应格式错误"),
+        TL_MSG("响应校验和错误"),
+        TL_MSG("设备拒绝命令"),
+        TL_MSG("参数超出范围"),
+        TL_MSG("未知错误"),
+        TL_MSG("文件访问失败"),
+        TL_MSG("文件格式错误"),
+        TL_MSG("提交队列已满"),
+        TL_MSG("命令已被紧急命令取代"),
+        TL_MSG("命令在发送前已过期"),
+        TL_MSG("设备打开期间无法更改此设置")
+    }
 };
 
-/* 目前使用的訊息 */
-static const char* g_active_messages[TL_MSG_ID_COUNT];
+/* 目錄格式常數 */
+#define TL_CATALOG_MAGIC        "TLMC"
+#define TL_CATALOG_VERSION      1
+#define TL_CATALOG_HEADER_SIZE  32
+#define TL_CATALOG_ENTRY_SIZE   8
+#define TL_CATALOG_MISSING      0xFFFFFFFFu
 
-/* 訊息系統是否已初始化 */
-static int g_is_initialized = 0;
+/* 已載入的訊息目錄 */
+typedef struct TL_MessageCatalog {
+    const TL_BYTE* index;              /* 索引表 */
+    const char* strings;               /* 字串區 */
+    uint32_t strings_size;             /* 字串區大小 */
+    uint16_t language_count;           /* 目錄內的語言數量 */
+    uint16_t message_count;            /* 每種語言的訊息數量 */
+    TL_FileMapping mapping;            /* 來源為檔案映射時使用 */
+    TL_BYTE* image;                    /* 來源為記憶體時使用 */
+    struct TL_MessageCatalog* next;    /* 已退役目錄串列 */
+} TL_MessageCatalog;
+
+/* 目前使用的目錄 (NULL 表示僅使用內建訊息) */
+static void* volatile g_active_catalog = NULL;
 
 /*
- * 初始化訊息系統
+ * 已被取代的目錄
+ * 先前交出的訊息指標可能仍被使用，因此延後到 tl_messages_release 才釋放。
  */
-void tl_messages_init(void) {
-    int i;
+static void* volatile g_retired_catalogs = NULL;
+
+/* 執行緒語言，-1 表示未設定 */
+static TL_THREAD_LOCAL int g_thread_language = -1;
+
+/* 小端序讀寫 */
+static uint16_t tl_rd_u16(const TL_BYTE* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t tl_rd_u32(const TL_BYTE* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void tl_wr_u16(TL_BYTE* p, uint16_t v)
+{
+    p[0] = (TL_BYTE)(v & 0xFF);
+    p[1] = (TL_BYTE)((v >> 8) & 0xFF);
+}
+
+static void tl_wr_u32(TL_BYTE* p, uint32_t v)
+{
+    p[0] = (TL_BYTE)(v & 0xFF);
+    p[1] = (TL_BYTE)((v >> 8) & 0xFF);
+    p[2] = (TL_BYTE)((v >> 16) & 0xFF);
+    p[3] = (TL_BYTE)((v >> 24) & 0xFF);
+}
+
+/* FNV-1a 雜湊 */
+static uint32_t tl_fnv1a(const TL_BYTE* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * 驗證目錄映像並填入目錄結構
+ *
+ * 所有索引項目都在載入時檢查一次，之後的查詢不需再做邊界檢查。
+ */
+static TL_ERROR_CODE tl_catalog_attach(const TL_BYTE* data, size_t size, TL_MessageCatalog* catalog)
+{
+    uint32_t index_offset;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    size_t entry_count;
+    size_t i;
 
-    /* 複製預設訊息 */
-    for (i = 0; i < TL_MSG_ID_COUNT; i++) {
-        g_active_messages[i] = g_default_messages[i];
+    if (size < TL_CATALOG_HEADER_SIZE || memcmp(data, TL_CATALOG_MAGIC, 4) != 0) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    if (tl_rd_u16(data + 4) != TL_CATALOG_VERSION ||
+        tl_rd_u16(data + 6) != TL_CATALOG_HEADER_SIZE) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    catalog->language_count = tl_rd_u16(data + 8);
+    catalog->message_count = tl_rd_u16(data + 10);
+    index_offset = tl_rd_u32(data + 12);
+    strings_offset = tl_rd_u32(data + 16);
+    strings_size = tl_rd_u32(data + 20);
+
+    /* 以 64 位元計算邊界，32 位元平台上位移與大小相加不會溢位 */
+    entry_count = (size_t)catalog->language_count * catalog->message_count;
+    if (entry_count == 0 ||
+        index_offset < TL_CATALOG_HEADER_SIZE ||
+        (uint64_t)index_offset + (uint64_t)entry_count * TL_CATALOG_ENTRY_SIZE > strings_offset ||
+        (uint64_t)strings_offset + strings_size > size) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    /* 檢查雜湊 */
+    if (tl_fnv1a(data + index_offset, (size_t)strings_offset + strings_size - index_offset) !=
+        tl_rd_u32(data + 24)) {
+        return TL_ERROR_FILE_FORMAT;
     }
 
-    g_is_initialized = 1;
+    /* 檢查每個索引項目都落在字串區內且以 NUL 結尾 */
+    for (i = 0; i < entry_count; i++) {
+        const TL_BYTE* entry = data + index_offset + i * TL_CATALOG_ENTRY_SIZE;
+        uint32_t offset = tl_rd_u32(entry);
+        uint32_t length = tl_rd_u32(entry + 4);
+
+        if (offset == TL_CATALOG_MISSING) {
+            continue;
+        }
+        if ((uint64_t)offset + length >= strings_size ||
+            data[strings_offset + offset + length] != '\0') {
+            return TL_ERROR_FILE_FORMAT;
+        }
+    }
+
+    catalog->index = data + index_offset;
+    catalog->strings = (const char*)(data + strings_offset);
+    catalog->strings_size = strings_size;
+    return TL_SUCCESS;
 }
 
 /*
- * 載入自訂訊息文件
+ * 發布新的目錄，被取代的目錄移到退役串列
+ */
+static void tl_catalog_publish(TL_MessageCatalog* catalog)
+{
+    TL_MessageCatalog* old;
+    void* head;
+
+    old = (TL_MessageCatalog*)tl_atomic_exchange_ptr(&g_active_catalog, catalog);
+    if (old == NULL) {
+        return;
+    }
+
+    do {
+        head = tl_atomic_load_ptr(&g_retired_catalogs);
+        old->next = (TL_MessageCatalog*)head;
+    } while (!tl_atomic_cas_ptr(&g_retired_catalogs, head, old));
+}
+
+static void tl_catalog_free(TL_MessageCatalog* catalog)
+{
+    if (catalog->image != NULL) {
+        free(catalog->image);
+    }
+    tl_file_map_close(&catalog->mapping);
+    free(catalog);
+}
+
+/* 單一語言的訊息來源 (text 為 NULL 表示未提供) */
+typedef struct {
+    const char* text[TL_MSG_ID_COUNT];
+    size_t length[TL_MSG_ID_COUNT];
+} TL_MessageSource;
+
+/*
+ * 讀取純文字訊息文件
  *
- * 文件格式為純文本，每行一個訊息，按順序對應訊息ID
+ * 每行一個訊息，依訊息ID排序。整個檔案讀入單一緩衝區後就地切割，
+ * 呼叫端以一次 free 釋放 *storage。
  *
- * 返回值：成功載入的訊息數量，如果為0表示失敗
+ * 返回值：讀取的訊息數量，-1 表示檔案無法讀取
  */
-int tl_messages_load_from_file(const char* filename) {
+static int tl_read_text_source(const char* filename, TL_MessageSource* source, char** storage)
+{
     FILE* file;
-    char buffer[256];
-    char** new_messages;
+    long file_size;
+    char* buffer;
+    char* line;
+    size_t read_size;
     int count = 0;
-    int i;
 
-    /* 確保訊息系統已初始化 */
-    if (!g_is_initialized) {
-        tl_messages_init();
-    }
+    *storage = NULL;
+    memset(source, 0, sizeof(*source));
 
-    /* 參數檢查 */
-    if (filename == NULL) {
-        return 0;
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return -1;
     }
 
-    /* 開啟文件 */
-    file = fopen(filename, "r");
-    if (file == NULL) {
-        return 0;
+    if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return -1;
     }
 
-    /* 分配臨時訊息陣列 */
-    new_messages = (char**)malloc(sizeof(char*) * TL_MSG_ID_COUNT);
-    if (new_messages == NULL) {
+    buffer = (char*)malloc((size_t)file_size + 1);
+    if (buffer == NULL) {
         fclose(file);
-        return 0;
+        return -1;
     }
+    read_size = fread(buffer, 1, (size_t)file_size, file);
+    fclose(file);
+    buffer[read_size] = '\0';
 
-    /* 初始化為NULL */
-    memset(new_messages, 0, sizeof(char*) * TL_MSG_ID_COUNT);
+    /* 略過 UTF-8 BOM */
+    line = buffer;
+    if (read_size >= 3 && (TL_BYTE)line[0] == 0xEF && (TL_BYTE)line[1] == 0xBB && (TL_BYTE)line[2] == 0xBF) {
+        line += 3;
+    }
+
+    while (*line != '\0' && count < TL_MSG_ID_COUNT) {
+        char* end = strchr(line, '\n');
+        char* next = (end != NULL) ? end + 1 : line + strlen(line);
+        size_t len = (end != NULL) ? (size_t)(end - line) : strlen(line);
+
+        /* 移除行尾的換行符 (含CR+LF) */
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        line[len] = '\0';
 
-    /* 讀取每一行 */
-    while (fgets(buffer, sizeof(buffer), file) && count < TL_MSG_ID_COUNT) {
-        int len;
+        source->text[count] = line;
+        source->length[count] = len;
+        count++;
+        line = next;
+    }
 
-        /* 移除行尾的換行符 */
-        len = strlen(buffer);
-        if (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r')) {
-            buffer[len - 1] = '\0';
+    *storage = buffer;
+    return count;
+}
 
-            /* 處理可能的CR+LF */
-            if (len > 1 && buffer[len - 2] == '\r') {
-                buffer[len - 2] = '\0';
+/*
+ * 由各語言來源建立目錄映像
+ */
+static TL_ERROR_CODE tl_build_catalog_image(const TL_MessageSource* sources, int language_count,
+                                            TL_BYTE** image, size_t* image_size)
+{
+    size_t strings_size = 0;
+    size_t index_size = (size_t)language_count * TL_MSG_ID_COUNT * TL_CATALOG_ENTRY_SIZE;
+    size_t total;
+    size_t cursor = 0;
+    TL_BYTE* data;
+    TL_BYTE* index;
+    TL_BYTE* strings;
+    int lang;
+    int id;
+
+    for (lang = 0; lang < language_count; lang++) {
+        for (id = 0; id < TL_MSG_ID_COUNT; id++) {
+            if (sources[lang].text[id] != NULL) {
+                strings_size += sources[lang].length[id] + 1;
             }
         }
+    }
 
-        /* 分配並複製字符串 */
-        new_messages[count] = (char*)malloc(strlen(buffer) + 1);
-        if (new_messages[count] != NULL) {
-            strcpy(new_messages[count], buffer);
-            count++;
+    total = TL_CATALOG_HEADER_SIZE + index_size + strings_size;
+    if (total > 0xFFFFFFFFu) {
+        return TL_ERROR_OUT_OF_RANGE;
+    }
+
+    data = (TL_BYTE*)calloc(1, total);
+    if (data == NULL) {
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    index = data + TL_CATALOG_HEADER_SIZE;
+    strings = index + index_size;
+
+    for (lang = 0; lang < language_count; lang++) {
+        for (id = 0; id < TL_MSG_ID_COUNT; id++) {
+            TL_BYTE* entry = index + ((size_t)lang * TL_MSG_ID_COUNT + id) * TL_CATALOG_ENTRY_SIZE;
+            const char* text = sources[lang].text[id];
+            size_t length = sources[lang].length[id];
+
+            if (text == NULL) {
+                tl_wr_u32(entry, TL_CATALOG_MISSING);
+                tl_wr_u32(entry + 4, 0);
+                continue;
+            }
+            tl_wr_u32(entry, (uint32_t)cursor);
+            tl_wr_u32(entry + 4, (uint32_t)length);
+            memcpy(strings + cursor, text, length);
+            strings[cursor + length] = '\0';
+            cursor += length + 1;
         }
     }
 
-    /* 關閉文件 */
-    fclose(file);
+    memcpy(data, TL_CATALOG_MAGIC, 4);
+    tl_wr_u16(data + 4, TL_CATALOG_VERSION);
+    tl_wr_u16(data + 6, TL_CATALOG_HEADER_SIZE);
+    tl_wr_u16(data + 8, (uint16_t)language_count);
+    tl_wr_u16(data + 10, (uint16_t)TL_MSG_ID_COUNT);
+    tl_wr_u32(data + 12, TL_CATALOG_HEADER_SIZE);
+    tl_wr_u32(data + 16, (uint32_t)(TL_CATALOG_HEADER_SIZE + index_size));
+    tl_wr_u32(data + 20, (uint32_t)strings_size);
+    tl_wr_u32(data + 24, tl_fnv1a(index, index_size + strings_size));
+    tl_wr_u32(data + 28, 0);
+
+    *image = data;
+    *image_size = total;
+    return TL_SUCCESS;
+}
+
+/*
+ * 初始化訊息系統
+ *
+ * 捨棄已載入的目錄，還原為內建訊息。
+ */
+void tl_messages_init(void) {
+    tl_catalog_publish(NULL);
+}
+
+/*
+ * 載入自訂訊息文件
+ *
+ * 文件格式為純文本，每行一個訊息，按順序對應訊息ID。
+ * 文件內容套用於呼叫執行緒目前的語言，其餘語言沿用目前的訊息。
+ *
+ * 返回值：成功載入的訊息數量，如果為0表示失敗
+ */
+int tl_messages_load_from_file(const char* filename) {
+    TL_MessageSource sources[TL_MSG_LANG_COUNT];
+    TL_MessageSource file_source;
+    TL_MessageCatalog* catalog;
+    TL_BYTE* image;
+    size_t image_size;
+    char* storage;
+    int language;
+    int count;
+    int lang;
+    int id;
+
+    /* 參數檢查 */
+    if (filename == NULL) {
+        return 0;
+    }
 
-    /* 如果讀取了足夠的訊息，則更新全域訊息陣列 */
-    if (count == TL_MSG_ID_COUNT) {
-        for (i = 0; i < TL_MSG_ID_COUNT; i++) {
-            g_active_messages[i] = new_messages[i];
+    count = tl_read_text_source(filename, &file_source, &storage);
+    if (count < TL_MSG_LEGACY_COUNT) {
+        free(storage);
+        return 0;
+    }
+
+    /* 目前語言使用文件內容，文件未涵蓋的ID與其他語言沿用現有訊息 */
+    language = tl_messages_current_language();
+    for (lang = 0; lang < TL_MSG_LANG_COUNT; lang++) {
+        for (id = 0; id < TL_MSG_ID_COUNT; id++) {
+            if (lang == language && file_source.text[id] != NULL) {
+                sources[lang].text[id] = file_source.text[id];
+                sources[lang].length[id] = file_source.length[id];
+            } else {
+                sources[lang].text[id] = tl_messages_get_view(lang, id, &sources[lang].length[id]);
+            }
         }
-        return count;
     }
 
-    /* 清理臨時分配的內存 */
-    for (i = 0; i < count; i++) {
-        if (new_messages[i] != NULL) {
-            free(new_messages[i]);
+    if (tl_build_catalog_image(sources, TL_MSG_LANG_COUNT, &image, &image_size) != TL_SUCCESS) {
+        free(storage);
+        return 0;
+    }
+    free(storage);
+
+    catalog = (TL_MessageCatalog*)calloc(1, sizeof(TL_MessageCatalog));
+    if (catalog == NULL) {
+        free(image);
+        return 0;
+    }
+    catalog->image = image;
+    if (tl_catalog_attach(image, image_size, catalog) != TL_SUCCESS) {
+        tl_catalog_free(catalog);
+        return 0;
+    }
+
+    tl_catalog_publish(catalog);
+    return count;
+}
+
+/*
+ * 獲取指定語言與ID的訊息
+ */
+const char* tl_messages_get_view(int language, int msg_id, size_t* length) {
+    const TL_MessageCatalog* catalog;
+
+    if (language < 0 || language >= TL_MSG_LANG_COUNT) {
+        language = TL_MSG_DEFAULT_LANG;
+    }
+    if (msg_id < 0 || msg_id >= TL_MSG_ID_COUNT) {
+        msg_id = TL_MSG_ID_UNKNOWN_ERROR;
+    }
+
+    /* 優先使用已載入的目錄 */
+    catalog = (const TL_MessageCatalog*)tl_atomic_load_ptr(&g_active_catalog);
+    if (catalog != NULL && language < catalog->language_count && msg_id < catalog->message_count) {
+        const TL_BYTE* entry = catalog->index +
+            ((size_t)language * catalog->message_count + msg_id) * TL_CATALOG_ENTRY_SIZE;
+        uint32_t offset = tl_rd_u32(entry);
+
+        if (offset != TL_CATALOG_MISSING) {
+            if (length != NULL) {
+                *length = tl_rd_u32(entry + 4);
+            }
+            return catalog->strings + offset;
         }
     }
-    free(new_messages);
 
-    return 0;
+    /* 目錄未提供則使用內建訊息 */
+    if (length != NULL) {
+        *length = g_builtin_messages[language][msg_id].length;
+    }
+    return g_builtin_messages[language][msg_id].text;
 }
 
 /*
  * 獲取訊息文本
  */
 const char* tl_messages_get(int msg_id) {
-    /* 確保訊息系統已初始化 */
-    if (!g_is_initialized) {
-        tl_messages_init();
+    return tl_messages_get_view(tl_messages_current_language(), msg_id, NULL);
+}
+
+/*
+ * 取得呼叫執行緒目前使用的語言
+ */
+int tl_messages_current_language(void) {
+    return (g_thread_language >= 0) ? g_thread_language : TL_MSG_DEFAULT_LANG;
+}
+
+/*
+ * 將錯誤碼轉換為訊息ID
+ */
+int tl_messages_id_for_error(TL_ERROR_CODE error_code) {
+    switch (error_code) {
+    case TL_ERROR_FILE_ACCESS:
+        return TL_MSG_ID_FILE_ACCESS;
+    case TL_ERROR_FILE_FORMAT:
+        return TL_MSG_ID_FILE_FORMAT;
+    case TL_ERROR_QUEUE_FULL:
+        return TL_MSG_ID_QUEUE_FULL;
+    case TL_ERROR_SUPERSEDED:
+        return TL_MSG_ID_SUPERSEDED;
+    case TL_ERROR_EXPIRED:
+        return TL_MSG_ID_EXPIRED;
+    case TL_ERROR_DEVICE_BUSY:
+        return TL_MSG_ID_DEVICE_BUSY;
+    default:
+        break;
     }
 
-    /* 檢查ID是否有效 */
-    if (msg_id >= 0 && msg_id < TL_MSG_ID_COUNT) {
-        return g_active_messages[msg_id];
+    /* 原有錯誤碼與訊息ID一一對應 */
+    if ((int)error_code >= 0 && (int)error_code <= (int)TL_ERROR_OUT_OF_RANGE) {
+        return (int)error_code;
     }
+    return TL_MSG_ID_UNKNOWN_ERROR;
+}
+
+/*
+ * 釋放已載入的訊息目錄
+ */
+void tl_messages_release(void) {
+    TL_MessageCatalog* catalog;
 
-    /* 無效ID返回未知錯誤訊息 */
-    return g_active_messages[TL_MSG_ID_UNKNOWN_ERROR];
+    catalog = (TL_MessageCatalog*)tl_atomic_exchange_ptr(&g_active_catalog, NULL);
+    if (catalog != NULL) {
+        tl_catalog_free(catalog);
+    }
+
+    catalog = (TL_MessageCatalog*)tl_atomic_exchange_ptr(&g_retired_catalogs, NULL);
+    while (catalog != NULL) {
+        TL_MessageCatalog* next = catalog->next;
+        tl_catalog_free(catalog);
+        catalog = next;
+    }
 }
 
+/*
+ * 設定呼叫執行緒的訊息語言
+ */
+TL_ERROR_CODE TL_SetThreadLanguage(TL_LANGUAGE language) {
+    if ((int)language < 0 || (int)language >= TL_MSG_LANG_COUNT) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    g_thread_language = (int)language;
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得呼叫執行緒的訊息語言
+ */
+TL_LANGUAGE TL_GetThreadLanguage(void) {
+    return (TL_LANGUAGE)tl_messages_current_language();
+}
+
+/*
+ * 載入預先編譯的訊息目錄
+ */
+TL_ERROR_CODE TL_LoadMessageCatalog(const char* filename) {
+    TL_MessageCatalog* catalog;
+    TL_ERROR_CODE result;
+
+    if (filename == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    catalog = (TL_MessageCatalog*)calloc(1, sizeof(TL_MessageCatalog));
+    if (catalog == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* 單次映射整個檔案，之後的查詢直接讀取映射區 */
+    result = tl_file_map_open_read(filename, &catalog->mapping);
+    if (result == TL_SUCCESS) {
+        result = tl_catalog_attach(catalog->mapping.data, catalog->mapping.size, catalog);
+    }
+    if (result != TL_SUCCESS) {
+        tl_catalog_free(catalog);
+        tl_set_last_error(result);
+        return result;
+    }
+
+    tl_catalog_publish(catalog);
+    return TL_SUCCESS;
+}
+
+/*
+ * 編譯訊息目錄
+ */
+TL_ERROR_CODE TL_CompileMessageCatalog(const char* const* source_files, size_t language_count,
+                                       const char* output_file) {
+    TL_MessageSource sources[TL_MSG_LANG_COUNT];
+    char* storage[TL_MSG_LANG_COUNT] = { NULL };
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_BYTE* image = NULL;
+    size_t image_size = 0;
+    FILE* file;
+    int lang;
+    int id;
+
+    if (output_file == NULL || language_count > TL_MSG_LANG_COUNT ||
+        (source_files == NULL && language_count != 0)) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 未指定文字檔的語言使用內建訊息，文字檔不足的行也以內建訊息補齊 */
+    for (lang = 0; lang < TL_MSG_LANG_COUNT; lang++) {
+        const char* path = ((size_t)lang < language_count) ? source_files[lang] : NULL;
+
+        if (path != NULL && tl_read_text_source(path, &sources[lang], &storage[lang]) < 0) {
+            result = TL_ERROR_FILE_ACCESS;
+            break;
+        }
+        if (path == NULL) {
+            memset(&sources[lang], 0, sizeof(sources[lang]));
+        }
+        for (id = 0; id < TL_MSG_ID_COUNT; id++) {
+            if (sources[lang].text[id] == NULL) {
+                sources[lang].text[id] = g_builtin_messages[lang][id].text;
+                sources[lang].length[id] = g_builtin_messages[lang][id].length;
+            }
+        }
+    }
+
+    if (result == TL_SUCCESS) {
+        result = tl_build_catalog_image(sources, TL_MSG_LANG_COUNT, &image, &image_size);
+    }
+
+    if (result == TL_SUCCESS) {
+        file = fopen(output_file, "wb");
+        if (file == NULL) {
+            result = TL_ERROR_FILE_ACCESS;
+        } else {
+            if (fwrite(image, 1, image_size, file) != image_size) {
+                result = TL_ERROR_FILE_ACCESS;
+            }
+            if (fclose(file) != 0) {
+                result = TL_ERROR_FILE_ACCESS;
+            }
+        }
+    }
+
+    free(image);
+    for (lang = 0; lang < TL_MSG_LANG_COUNT; lang++) {
+        free(storage[lang]);
+    }
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
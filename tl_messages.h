@@ -4,16 +4,19 @@
  * 塔燈通訊控制函式庫 - 訊息資源定義
  *
  * 本檔案定義了函式庫使用的文字訊息ID，以及獲取訊息的函數。
- * 使用者可以通過自訂訊息文件來支援不同語言。
+ * 使用者可以通過自訂訊息文件或預先編譯的訊息目錄來支援不同語言。
  *
- * 版本: 1.0.0
- * 日期: 2025-03-25
+ * 版本: 1.1.0
+ * 日期: 2026-10-18
  */
 
 #ifndef TL_MESSAGES_H
 #define TL_MESSAGES_H
 
- /* 訊息ID定義 - 與錯誤碼一一對應 */
+#include <stddef.h>
+#include "tl_tower_light.h"
+
+ /* 訊息ID定義 - 前段與錯誤碼一一對應，新增的錯誤碼接在 TL_MSG_ID_UNKNOWN_ERROR 之後 */
 enum {
     TL_MSG_ID_SUCCESS = 0,
     TL_MSG_ID_GENERAL_ERROR,
@@ -32,18 +35,68 @@ enum {
     TL_MSG_ID_RESPONSE_NACK,
     TL_MSG_ID_OUT_OF_RANGE,
     TL_MSG_ID_UNKNOWN_ERROR,
+    TL_MSG_ID_FILE_ACCESS,
+    TL_MSG_ID_FILE_FORMAT,
+    TL_MSG_ID_QUEUE_FULL,
+    TL_MSG_ID_SUPERSEDED,
+    TL_MSG_ID_EXPIRED,
+    TL_MSG_ID_DEVICE_BUSY,
 
     /* 最後一個ID，用於確定訊息數量 */
     TL_MSG_ID_COUNT
 };
 
-/* 初始化訊息系統 */
+/* 舊版純文字訊息文件的行數 (至 TL_MSG_ID_UNKNOWN_ERROR 為止) */
+#define TL_MSG_LEGACY_COUNT (TL_MSG_ID_UNKNOWN_ERROR + 1)
+
+/* 支援的語言數量 */
+#define TL_MSG_LANG_COUNT 4
+
+/* 未設定執行緒語言時使用的預設語言 */
+#define TL_MSG_DEFAULT_LANG TL_LANG_ZH_TW
+
+/*
+ * 二進位訊息目錄格式 (所有整數皆為小端序)
+ *
+ *   標頭 (32 位元組)
+ *     magic[4]         "TLMC"
+ *     version          uint16，目前為 1
+ *     header_size      uint16，固定為 32
+ *     language_count   uint16
+ *     message_count    uint16
+ *     index_offset     uint32，索引表起始位移
+ *     strings_offset   uint32，字串區起始位移
+ *     strings_size     uint32，字串區大小
+ *     checksum         uint32，索引表與字串區的 FNV-1a 雜湊
+ *     reserved         uint32
+ *   索引表 (language_count * message_count 項，每項 8 位元組)
+ *     offset           uint32，相對字串區的位移，0xFFFFFFFF 表示未提供
+ *     length           uint32，字串長度 (不含 NUL)
+ *   字串區
+ *     以 NUL 結尾的字串
+ *
+ * 訊息 (language, msg_id) 位於 index[language * message_count + msg_id]。
+ */
+
+/* 初始化訊息系統 (還原為內建訊息) */
 void tl_messages_init(void);
 
-/* 載入自訂訊息文件 */
+/* 載入自訂訊息文件 (純文字，套用於呼叫執行緒的語言) */
 int tl_messages_load_from_file(const char* filename);
 
-/* 獲取指定ID的訊息 */
+/* 獲取指定ID的訊息 (呼叫執行緒的語言) */
 const char* tl_messages_get(int msg_id);
 
+/* 獲取指定語言與ID的訊息，不複製字串；length 可為 NULL */
+const char* tl_messages_get_view(int language, int msg_id, size_t* length);
+
+/* 取得呼叫執行緒目前使用的語言 */
+int tl_messages_current_language(void);
+
+/* 將錯誤碼轉換為訊息ID，未知錯誤碼返回 TL_MSG_ID_UNKNOWN_ERROR */
+int tl_messages_id_for_error(TL_ERROR_CODE error_code);
+
+/* 釋放已載入的訊息目錄 */
+void tl_messages_release(void);
+
 #endif /* TL_MESSAGES_H */
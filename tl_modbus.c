@@ -0,0 +1,570 @@
+﻿/*
+ * tl_modbus.c
+ *
+ * 塔燈通訊控制函式庫 - Modbus TCP 伺服器實現
+ *
+ * 讓 PLC 以 Modbus TCP 直接讀寫塔燈狀態。每台裝置最多一個伺服器執行緒，
+ * 以非阻塞通訊端輪詢所有連線：
+ *   - 讀取 (功能碼 03、04) 直接取自裝置的壓縮狀態字組，不經過USB；
+ *   - 寫入 (功能碼 06、16) 轉為 TL_SetDesiredState，由收斂執行緒只送出與
+ *     已確認狀態不同的目標，連續的寫入自然合併為最少的設定命令。
+ * 因此每秒數百次的輪詢不會產生任何USB傳輸。
+ *
+ * 暫存器配置 (每個暫存器為一個目標在 TL_TowerState 中的位元組)：
+ *   保持暫存器 0~3：第一層、第二層、第三層、蜂鳴器的期望狀態 (可讀寫)
+ *   輸入暫存器 0~3：各目標的已確認狀態
+ *   輸入暫存器 4  ：期望狀態與已確認狀態不同的目標遮罩 (TL_FRAME_*)
+ * 單元識別碼不檢查，回應時原樣傳回。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* Modbus 應用協定標頭 (MBAP) 與訊框大小 */
+#define TL_MODBUS_MBAP_SIZE      7
+#define TL_MODBUS_FRAME_MAX      260
+
+/* 每個連線的輸出緩衝區：不足以放入一個完整回應時暫停讀取該連線的請求 */
+#define TL_MODBUS_OUTPUT_SIZE    (TL_MODBUS_FRAME_MAX * 4)
+
+/* 同時連線數上限，超過時拒絕新的連線 */
+#define TL_MODBUS_MAX_CLIENTS    32
+
+/* 暫存器數量 */
+#define TL_MODBUS_HOLDING_COUNT  TL_TARGET_COUNT
+#define TL_MODBUS_INPUT_COUNT    (TL_TARGET_COUNT + 1)
+
+/* 功能碼 */
+#define TL_MODBUS_READ_HOLDING   0x03
+#define TL_MODBUS_READ_INPUT     0x04
+#define TL_MODBUS_WRITE_SINGLE   0x06
+#define TL_MODBUS_WRITE_MULTIPLE 0x10
+
+/* 例外碼 */
+#define TL_MODBUS_ILLEGAL_FUNCTION  0x01
+#define TL_MODBUS_ILLEGAL_ADDRESS   0x02
+#define TL_MODBUS_ILLEGAL_VALUE     0x03
+#define TL_MODBUS_DEVICE_FAILURE    0x04
+
+/* 單一連線 */
+typedef struct {
+    TL_Socket* socket;                         /* 通訊端，NULL 表示未使用 */
+    TL_BYTE input[TL_MODBUS_FRAME_MAX];        /* 尚未處理的請求位元組 */
+    size_t input_length;
+    TL_BYTE output[TL_MODBUS_OUTPUT_SIZE];     /* 尚未送出的回應位元組 */
+    size_t output_length;
+} TL_ModbusClient;
+
+/* Modbus TCP 伺服器 */
+struct TL_ModbusServer {
+    TL_DeviceContext* device;         /* 所屬裝置 (關閉裝置時先停止伺服器，之後不再啟動) */
+    TL_Mutex* lock;                   /* 保護 stopping 與 stats */
+    TL_Thread* thread;                /* 伺服器執行緒 */
+    TL_Socket* listener;              /* 監聽通訊端 */
+    TL_Socket* wake;                  /* 停止時喚醒伺服器執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_ModbusStats stats;             /* 統計 */
+    TL_ModbusClient clients[TL_MODBUS_MAX_CLIENTS];  /* 連線 (只由伺服器執行緒存取) */
+};
+
+/* 大端序讀寫 (Modbus 使用大端序) */
+static unsigned int tl_modbus_rd_u16(const TL_BYTE* p)
+{
+    return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static void tl_modbus_wr_u16(TL_BYTE* p, unsigned int v)
+{
+    p[0] = (TL_BYTE)((v >> 8) & 0xFF);
+    p[1] = (TL_BYTE)(v & 0xFF);
+}
+
+/*
+ * 讀取暫存器的值
+ */
+static unsigned int tl_modbus_register(TL_DeviceContext* device, TL_BYTE function, unsigned int address)
+{
+    TL_TowerState current = tl_atomic_load_u32(&device->current_state);
+    TL_TowerState desired = tl_atomic_load_u32(&device->desired_state);
+
+    if (function == TL_MODBUS_READ_HOLDING) {
+        return (desired >> (address * 8)) & 0xFF;
+    }
+    if (address < TL_TARGET_COUNT) {
+        return (current >> (address * 8)) & 0xFF;
+    }
+    return TL_DiffTowerState(current, desired);
+}
+
+/*
+ * 將保持暫存器的值寫入期望狀態
+ *
+ * 參數：values 自 address 起連續的暫存器值 (大端序)
+ * 返回值：0 表示成功，其他值為例外碼
+ */
+static TL_BYTE tl_modbus_write(TL_ModbusServer* server, unsigned int address, unsigned int count, const TL_BYTE* values)
+{
+    TL_TowerFrame frame;
+    TL_TowerState state = 0;
+    unsigned int value;
+    unsigned int i;
+
+    if (address + count > TL_MODBUS_HOLDING_COUNT) {
+        return TL_MODBUS_ILLEGAL_ADDRESS;
+    }
+    for (i = 0; i < count; i++) {
+        value = tl_modbus_rd_u16(values + i * 2);
+        if (value > 0xFF) {
+            return TL_MODBUS_ILLEGAL_VALUE;
+        }
+        state |= (TL_TowerState)value << ((address + i) * 8);
+    }
+
+    /* 還原時一併檢查各欄位是否有效 */
+    if (TL_UnpackTowerState(state, &frame) != TL_SUCCESS) {
+        return TL_MODBUS_ILLEGAL_VALUE;
+    }
+    frame.target_mask = ((1u << count) - 1) << address;
+    if (TL_SetDesiredState(server->device, &frame) != TL_SUCCESS) {
+        return TL_MODBUS_DEVICE_FAILURE;
+    }
+    return 0;
+}
+
+/*
+ * 處理一個請求並將回應附加到輸出緩衝區
+ *
+ * 參數：frame 完整的請求訊框 (MBAP 標頭 + PDU)
+ * 參數：length 訊框長度
+ */
+static void tl_modbus_handle(TL_ModbusServer* server, TL_ModbusClient* client, const TL_BYTE* frame, size_t length)
+{
+    TL_BYTE* response = client->output + client->output_length;
+    const TL_BYTE* pdu = frame + TL_MODBUS_MBAP_SIZE;
+    size_t pdu_length = length - TL_MODBUS_MBAP_SIZE;
+    size_t response_length = 0;
+    TL_BYTE function = pdu[0];
+    TL_BYTE exception = 0;
+    unsigned int address = 0;
+    unsigned int count = 0;
+    unsigned int i;
+
+    if (pdu_length >= 5) {
+        address = tl_modbus_rd_u16(pdu + 1);
+        count = tl_modbus_rd_u16(pdu + 3);
+    }
+
+    switch (function) {
+    case TL_MODBUS_READ_HOLDING:
+    case TL_MODBUS_READ_INPUT:
+        if (pdu_length != 5 || count == 0 || count > 125) {
+            exception = TL_MODBUS_ILLEGAL_VALUE;
+        } else if (address + count > ((function == TL_MODBUS_READ_HOLDING) ? TL_MODBUS_HOLDING_COUNT : TL_MODBUS_INPUT_COUNT)) {
+            exception = TL_MODBUS_ILLEGAL_ADDRESS;
+        } else {
+            response[TL_MODBUS_MBAP_SIZE + 1] = (TL_BYTE)(count * 2);
+            for (i = 0; i < count; i++) {
+                tl_modbus_wr_u16(response + TL_MODBUS_MBAP_SIZE + 2 + i * 2,
+                                 tl_modbus_register(server->device, function, address + i));
+            }
+            response_length = 2 + count * 2;
+        }
+        break;
+
+    case TL_MODBUS_WRITE_SINGLE:
+        /* 請求的位址與值即為回應內容 */
+        exception = (pdu_length != 5) ? TL_MODBUS_ILLEGAL_VALUE : tl_modbus_write(server, address, 1, pdu + 3);
+        if (exception == 0) {
+            memcpy(response + TL_MODBUS_MBAP_SIZE + 1, pdu + 1, 4);
+            response_length = 5;
+        }
+        break;
+
+    case TL_MODBUS_WRITE_MULTIPLE:
+        if (pdu_length < 6 || count == 0 || count > 123 || pdu[5] != count * 2 || pdu_length != 6 + count * 2) {
+            exception = TL_MODBUS_ILLEGAL_VALUE;
+        } else {
+            exception = tl_modbus_write(server, address, count, pdu + 6);
+        }
+        if (exception == 0) {
+            memcpy(response + TL_MODBUS_MBAP_SIZE + 1, pdu + 1, 4);
+            response_length = 5;
+        }
+        break;
+
+    default:
+        exception = TL_MODBUS_ILLEGAL_FUNCTION;
+        break;
+    }
+
+    if (exception != 0) {
+        response[TL_MODBUS_MBAP_SIZE] = (TL_BYTE)(function | 0x80);
+        response[TL_MODBUS_MBAP_SIZE + 1] = exception;
+        response_length = 2;
+    } else {
+        response[TL_MODBUS_MBAP_SIZE] = function;
+    }
+
+    /* MBAP：交易識別碼與單元識別碼原樣傳回，長度包含單元識別碼 */
+    memcpy(response, frame, 4);
+    tl_modbus_wr_u16(response + 4, (unsigned int)(response_length + 1));
+    response[6] = frame[6];
+    client->output_length += TL_MODBUS_MBAP_SIZE + response_length;
+
+    tl_mutex_lock(server->lock);
+    server->stats.requests++;
+    if (exception != 0) {
+        server->stats.exceptions++;
+    } else if (function == TL_MODBUS_WRITE_SINGLE || function == TL_MODBUS_WRITE_MULTIPLE) {
+        server->stats.writes++;
+    } else {
+        server->stats.reads++;
+    }
+    tl_mutex_unlock(server->lock);
+}
+
+/*
+ * 處理輸入緩衝區中完整的請求
+ *
+ * 返回值：TL_FALSE 表示訊框格式錯誤，應關閉連線
+ */
+static TL_BOOL tl_modbus_process(TL_ModbusServer* server, TL_ModbusClient* client)
+{
+    size_t consumed = 0;
+    size_t length;
+
+    while (client->input_length - consumed >= TL_MODBUS_MBAP_SIZE &&
+           client->output_length + TL_MODBUS_FRAME_MAX <= TL_MODBUS_OUTPUT_SIZE) {
+        const TL_BYTE* frame = client->input + consumed;
+        unsigned int field = tl_modbus_rd_u16(frame + 4);
+
+        /* 協定識別碼必須為 0，長度欄位包含單元識別碼與至少一個位元組的 PDU */
+        if (tl_modbus_rd_u16(frame + 2) != 0 || field < 2 || field > TL_MODBUS_FRAME_MAX - 6) {
+            return TL_FALSE;
+        }
+        length = 6 + field;
+        if (client->input_length - consumed < length) {
+            break;
+        }
+        tl_modbus_handle(server, client, frame, length);
+        consumed += length;
+    }
+
+    if (consumed != 0) {
+        memmove(client->input, client->input + consumed, client->input_length - consumed);
+        client->input_length -= consumed;
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 送出輸出緩衝區
+ *
+ * 返回值：TL_FALSE 表示連線已中斷
+ */
+static TL_BOOL tl_modbus_flush(TL_ModbusClient* client)
+{
+    long sent;
+
+    if (client->output_length == 0) {
+        return TL_TRUE;
+    }
+    sent = tl_socket_send(client->socket, client->output, client->output_length);
+    if (sent < 0) {
+        return TL_FALSE;
+    }
+    memmove(client->output, client->output + sent, client->output_length - (size_t)sent);
+    client->output_length -= (size_t)sent;
+    return TL_TRUE;
+}
+
+/*
+ * 關閉連線
+ */
+static void tl_modbus_drop(TL_ModbusServer* server, TL_ModbusClient* client)
+{
+    tl_socket_close(client->socket);
+    client->socket = NULL;
+    client->input_length = 0;
+    client->output_length = 0;
+
+    tl_mutex_lock(server->lock);
+    server->stats.client_count--;
+    tl_mutex_unlock(server->lock);
+}
+
+/*
+ * 接受等待中的連線
+ */
+static void tl_modbus_accept(TL_ModbusServer* server)
+{
+    TL_Socket* socket;
+    int i;
+
+    while ((socket = tl_socket_accept(server->listener)) != NULL) {
+        for (i = 0; i < TL_MODBUS_MAX_CLIENTS; i++) {
+            if (server->clients[i].socket == NULL) {
+                break;
+            }
+        }
+
+        tl_mutex_lock(server->lock);
+        if (i == TL_MODBUS_MAX_CLIENTS) {
+            server->stats.rejected_clients++;
+        } else {
+            server->stats.client_count++;
+            server->stats.accepted_clients++;
+        }
+        tl_mutex_unlock(server->lock);
+
+        if (i == TL_MODBUS_MAX_CLIENTS) {
+            tl_socket_close(socket);
+            continue;
+        }
+        server->clients[i].socket = socket;
+    }
+}
+
+/*
+ * 伺服器執行緒
+ */
+static void tl_modbus_main(void* arg)
+{
+    TL_ModbusServer* server = (TL_ModbusServer*)arg;
+    TL_SocketPoll items[TL_MODBUS_MAX_CLIENTS + 2];
+    TL_ModbusClient* client;
+    TL_BOOL stopping;
+    long received;
+    int i;
+
+    for (;;) {
+        tl_mutex_lock(server->lock);
+        stopping = server->stopping;
+        tl_mutex_unlock(server->lock);
+        if (stopping) {
+            break;
+        }
+
+        items[0].socket = server->wake;
+        items[0].events = TL_SOCKET_READABLE;
+        items[1].socket = server->listener;
+        items[1].events = TL_SOCKET_READABLE;
+        for (i = 0; i < TL_MODBUS_MAX_CLIENTS; i++) {
+            client = &server->clients[i];
+            items[i + 2].socket = client->socket;
+            /* 輸出緩衝區放不下一個回應時暫停讀取，由TCP的流量控制讓客戶端等待 */
+            items[i + 2].events = (client->output_length + TL_MODBUS_FRAME_MAX <= TL_MODBUS_OUTPUT_SIZE) ?
+                                  TL_SOCKET_READABLE : 0;
+            if (client->output_length != 0) {
+                items[i + 2].events |= TL_SOCKET_WRITABLE;
+            }
+        }
+
+        if (tl_socket_poll(items, TL_MODBUS_MAX_CLIENTS + 2, TL_WAIT_INFINITE) <= 0) {
+            continue;
+        }
+        if (items[0].revents != 0) {
+            tl_socket_wake_clear(server->wake);
+        }
+        if (items[1].revents != 0) {
+            tl_modbus_accept(server);
+        }
+
+        for (i = 0; i < TL_MODBUS_MAX_CLIENTS; i++) {
+            client = &server->clients[i];
+            if (client->socket == NULL || items[i + 2].socket != client->socket || items[i + 2].revents == 0) {
+                continue;
+            }
+
+            /* 先送出回應騰出空間，再處理先前因輸出緩衝區已滿而暫緩的請求 */
+            received = tl_modbus_flush(client) ? 0 : -1;
+            if (received == 0 && (items[i + 2].revents & (TL_SOCKET_READABLE | TL_SOCKET_CLOSED)) &&
+                client->input_length < sizeof(client->input)) {
+                received = tl_socket_recv(client->socket, client->input + client->input_length,
+                                          sizeof(client->input) - client->input_length);
+                if (received > 0) {
+                    client->input_length += (size_t)received;
+                }
+            }
+            if (received < 0 || !tl_modbus_process(server, client) || !tl_modbus_flush(client)) {
+                tl_modbus_drop(server, client);
+            }
+        }
+    }
+
+    for (i = 0; i < TL_MODBUS_MAX_CLIENTS; i++) {
+        if (server->clients[i].socket != NULL) {
+            tl_modbus_drop(server, &server->clients[i]);
+        }
+    }
+}
+
+/*
+ * 釋放伺服器
+ */
+static void tl_modbus_free(TL_ModbusServer* server)
+{
+    tl_socket_close(server->listener);
+    tl_socket_close(server->wake);
+    tl_mutex_destroy(server->lock);
+    free(server);
+}
+
+/*
+ * 停止 Modbus TCP 伺服器
+ */
+void tl_modbus_stop(TL_DeviceContext* device)
+{
+    TL_ModbusServer* server;
+
+    tl_mutex_lock(device->state_lock);
+    server = device->modbus_server;
+    device->modbus_server = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (server == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(server->lock);
+    server->stopping = TL_TRUE;
+    tl_mutex_unlock(server->lock);
+    tl_socket_wake(server->wake);
+
+    tl_thread_join(server->thread);
+    tl_modbus_free(server);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_modbus_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 啟動 Modbus TCP 伺服器
+ */
+TL_ERROR_CODE TL_StartModbusServer(TL_DEVICE_HANDLE device, const char* address, unsigned short port)
+{
+    TL_DeviceContext* context;
+    TL_ModbusServer* server;
+    TL_ERROR_CODE result;
+    unsigned short local_port;
+
+    result = tl_modbus_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 已啟動時先停止，以新的位址重新監聽 */
+    tl_modbus_stop(context);
+
+    server = (TL_ModbusServer*)calloc(1, sizeof(TL_ModbusServer));
+    if (server == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    server->device = context;
+    server->lock = tl_mutex_create();
+    server->wake = tl_socket_wake_create();
+    if (server->lock == NULL || server->wake == NULL) {
+        tl_modbus_free(server);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    result = tl_socket_listen(address, port, &server->listener);
+    if (result != TL_SUCCESS) {
+        tl_modbus_free(server);
+        tl_set_last_error(result);
+        return result;
+    }
+    local_port = tl_socket_local_port(server->listener);
+    server->stats.port = local_port;
+
+    tl_mutex_lock(context->state_lock);
+    if (context->closing) {
+        /* 裝置同時被關閉，關閉時的停止已經執行過，伺服器不可再使用此裝置 */
+        tl_mutex_unlock(context->state_lock);
+        tl_modbus_free(server);
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    if (context->modbus_server != NULL) {
+        /* 其他執行緒同時啟動了伺服器 */
+        tl_mutex_unlock(context->state_lock);
+        tl_modbus_free(server);
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+    server->thread = tl_thread_create(tl_modbus_main, server);
+    if (server->thread == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        tl_modbus_free(server);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    context->modbus_server = server;
+    tl_mutex_unlock(context->state_lock);
+
+    /* 釋放 state_lock 後伺服器可能已被停止，不再存取 */
+#ifdef BUILD_TEST_EXE
+    printf("[TL_StartModbusServer] 監聽 %s:%u\n", (address != NULL) ? address : "*", local_port);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止 Modbus TCP 伺服器
+ */
+TL_ERROR_CODE TL_StopModbusServer(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_modbus_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_modbus_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得 Modbus TCP 伺服器統計
+ */
+TL_ERROR_CODE TL_GetModbusStats(TL_DEVICE_HANDLE device, TL_ModbusStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_ModbusServer* server;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_modbus_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    server = context->modbus_server;
+    if (server != NULL) {
+        tl_mutex_lock(server->lock);
+        *stats = server->stats;
+        tl_mutex_unlock(server->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
@@ -0,0 +1,1144 @@
+﻿/*
+ * tl_platform.c
+ *
+ * 塔燈通訊控制函式庫 - 平台抽象層實現
+ *
+ * 本檔案集中處理與作業系統相關的細節，包括檔案映射 (mmap)、
+ * 單調時間、原子操作、執行緒與同步物件、網路通訊端等，讓其他模組不需直接呼叫
+ * Win32 / POSIX API。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <process.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+/* -------------------------------------------------------------------------
+ * 檔案映射
+ */
+
+/*
+ * 以唯讀方式映射整個檔案
+ */
+TL_ERROR_CODE tl_file_map_open_read(const char* path, TL_FileMapping* mapping)
+{
+    if (path == NULL || mapping == NULL) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    memset(mapping, 0, sizeof(*mapping));
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+    LARGE_INTEGER file_size;
+    void* view;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+        (unsigned long long)file_size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map == NULL) {
+        CloseHandle(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(map);
+        CloseHandle(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    mapping->data = (const TL_BYTE*)view;
+    mapping->size = (size_t)file_size.QuadPart;
+    mapping->file_handle = file;
+    mapping->map_handle = map;
+    return TL_SUCCESS;
+#else
+    int fd;
+    struct stat st;
+    void* view;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* 映射建立後即可關閉檔案描述符，映射仍然有效 */
+    close(fd);
+    if (view == MAP_FAILED) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    mapping->data = (const TL_BYTE*)view;
+    mapping->size = (size_t)st.st_size;
+    return TL_SUCCESS;
+#endif
+}
+
+/*
+ * 以可寫入方式映射檔案
+ */
+TL_ERROR_CODE tl_file_map_open_write(const char* path, size_t size, TL_FileMapping* mapping)
+{
+    if (path == NULL || size == 0 || mapping == NULL) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    memset(mapping, 0, sizeof(*mapping));
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+    LARGE_INTEGER file_size;
+    void* view;
+
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    /* 映射物件的大小大於檔案時，系統會先將檔案延長 */
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+    if ((unsigned long long)file_size.QuadPart < (unsigned long long)size) {
+        file_size.QuadPart = (LONGLONG)size;
+    }
+
+    map = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+        (DWORD)((unsigned long long)file_size.QuadPart >> 32), (DWORD)file_size.QuadPart, NULL);
+    if (map == NULL) {
+        CloseHandle(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    view = MapViewOfFile(map, FILE_MAP_WRITE, 0, 0, size);
+    if (view == NULL) {
+        CloseHandle(map);
+        CloseHandle(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    mapping->data = (const TL_BYTE*)view;
+    mapping->writable = (TL_BYTE*)view;
+    mapping->size = size;
+    mapping->file_handle = file;
+    mapping->map_handle = map;
+    return TL_SUCCESS;
+#else
+    int fd;
+    struct stat st;
+    void* view;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    /* 延長的部分讀取時為 0 */
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+        close(fd);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    mapping->data = (const TL_BYTE*)view;
+    mapping->writable = (TL_BYTE*)view;
+    mapping->size = size;
+    return TL_SUCCESS;
+#endif
+}
+
+/*
+ * 將可寫入映射的內容同步寫入磁碟
+ */
+void tl_file_map_flush(TL_FileMapping* mapping)
+{
+    if (mapping == NULL || mapping->writable == NULL) {
+        return;
+    }
+
+#ifdef _WIN32
+    /* FlushViewOfFile 只送出寫入要求，FlushFileBuffers 等待資料實際寫入 */
+    FlushViewOfFile(mapping->writable, mapping->size);
+    FlushFileBuffers((HANDLE)mapping->file_handle);
+#else
+    msync(mapping->writable, mapping->size, MS_SYNC);
+#endif
+}
+
+/*
+ * 解除檔案映射
+ */
+void tl_file_map_close(TL_FileMapping* mapping)
+{
+    if (mapping == NULL || mapping->data == NULL) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)mapping->data);
+    if (mapping->map_handle) {
+        CloseHandle((HANDLE)mapping->map_handle);
+    }
+    if (mapping->file_handle) {
+        CloseHandle((HANDLE)mapping->file_handle);
+    }
+#else
+    munmap((void*)mapping->data, mapping->size);
+#endif
+
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+/* -------------------------------------------------------------------------
+ * 時間
+ */
+
+/*
+ * 取得單調時間 (微秒)
+ */
+unsigned long long tl_time_now_us(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000ULL +
+        (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000ULL /
+        (unsigned long long)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+#endif
+}
+
+/* -------------------------------------------------------------------------
+ * 原子操作
+ */
+
+/*
+ * 原子讀取指標
+ */
+void* tl_atomic_load_ptr(void* volatile* target)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchangePointer((PVOID volatile*)target, NULL, NULL);
+#else
+    return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/*
+ * 原子交換指標，返回舊值
+ */
+void* tl_atomic_exchange_ptr(void* volatile* target, void* value)
+{
+#ifdef _WIN32
+    return InterlockedExchangePointer((PVOID volatile*)target, value);
+#else
+    return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/*
+ * 原子比較並交換指標
+ */
+TL_BOOL tl_atomic_cas_ptr(void* volatile* target, void* expected, void* desired)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchangePointer((PVOID volatile*)target, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(target, &expected, desired, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? TL_TRUE : TL_FALSE;
+#endif
+}
+
+/*
+ * 原子讀取 32 位元整數
+ */
+unsigned int tl_atomic_load_u32(volatile unsigned int* target)
+{
+#ifdef _WIN32
+    return (unsigned int)InterlockedCompareExchange((LONG volatile*)target, 0, 0);
+#else
+    return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/*
+ * 原子寫入 32 位元整數
+ */
+void tl_atomic_store_u32(volatile unsigned int* target, unsigned int value)
+{
+#ifdef _WIN32
+    InterlockedExchange((LONG volatile*)target, (LONG)value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/*
+ * 原子比較並交換 32 位元整數
+ */
+TL_BOOL tl_atomic_cas_u32(volatile unsigned int* target, unsigned int expected, unsigned int desired)
+{
+#ifdef _WIN32
+    return (unsigned int)InterlockedCompareExchange((LONG volatile*)target, (LONG)desired, (LONG)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(target, &expected, desired, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? TL_TRUE : TL_FALSE;
+#endif
+}
+
+/*
+ * 讀取屏障：之前的讀取不會被移到之後的讀寫之後
+ */
+void tl_atomic_fence_acquire(void)
+{
+#ifdef _WIN32
+#if defined(_M_IX86) || defined(_M_X64)
+    _ReadWriteBarrier();
+#else
+    MemoryBarrier();
+#endif
+#else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+/*
+ * 寫入屏障：之前的讀寫不會被移到之後的寫入之後
+ */
+void tl_atomic_fence_release(void)
+{
+#ifdef _WIN32
+#if defined(_M_IX86) || defined(_M_X64)
+    _ReadWriteBarrier();
+#else
+    MemoryBarrier();
+#endif
+#else
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+/* -------------------------------------------------------------------------
+ * 互斥鎖、條件變數與執行緒
+ */
+
+#ifdef _WIN32
+struct TL_Mutex {
+    CRITICAL_SECTION cs;
+};
+
+struct TL_Cond {
+    CONDITION_VARIABLE cv;
+};
+
+struct TL_Thread {
+    HANDLE handle;
+    TL_ThreadFunc func;
+    void* arg;
+};
+#else
+struct TL_Mutex {
+    pthread_mutex_t mutex;
+};
+
+struct TL_Cond {
+    pthread_cond_t cond;
+};
+
+struct TL_Thread {
+    pthread_t thread;
+    TL_ThreadFunc func;
+    void* arg;
+};
+#endif
+
+/*
+ * 建立互斥鎖
+ */
+TL_Mutex* tl_mutex_create(void)
+{
+    TL_Mutex* mutex = (TL_Mutex*)malloc(sizeof(TL_Mutex));
+
+    if (mutex == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->cs);
+#else
+    if (pthread_mutex_init(&mutex->mutex, NULL) != 0) {
+        free(mutex);
+        return NULL;
+    }
+#endif
+    return mutex;
+}
+
+/*
+ * 銷毀互斥鎖
+ */
+void tl_mutex_destroy(TL_Mutex* mutex)
+{
+    if (mutex == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    free(mutex);
+}
+
+void tl_mutex_lock(TL_Mutex* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void tl_mutex_unlock(TL_Mutex* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+/*
+ * 建立條件變數
+ */
+TL_Cond* tl_cond_create(void)
+{
+    TL_Cond* cond = (TL_Cond*)malloc(sizeof(TL_Cond));
+
+    if (cond == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    InitializeConditionVariable(&cond->cv);
+#else
+    {
+        pthread_condattr_t attr;
+
+        /* 使用單調時鐘計算等待期限 */
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        if (pthread_cond_init(&cond->cond, &attr) != 0) {
+            pthread_condattr_destroy(&attr);
+            free(cond);
+            return NULL;
+        }
+        pthread_condattr_destroy(&attr);
+    }
+#endif
+    return cond;
+}
+
+/*
+ * 銷毀條件變數
+ */
+void tl_cond_destroy(TL_Cond* cond)
+{
+    if (cond == NULL) {
+        return;
+    }
+#ifndef _WIN32
+    pthread_cond_destroy(&cond->cond);
+#endif
+    free(cond);
+}
+
+/*
+ * 等待條件變數
+ */
+TL_BOOL tl_cond_wait(TL_Cond* cond, TL_Mutex* mutex, unsigned long timeout_ms)
+{
+#ifdef _WIN32
+    DWORD wait_ms = (timeout_ms == TL_WAIT_INFINITE) ? INFINITE : (DWORD)timeout_ms;
+
+    return SleepConditionVariableCS(&cond->cv, &mutex->cs, wait_ms) ? TL_TRUE : TL_FALSE;
+#else
+    struct timespec deadline;
+
+    if (timeout_ms == TL_WAIT_INFINITE) {
+        pthread_cond_wait(&cond->cond, &mutex->mutex);
+        return TL_TRUE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t)(timeout_ms / 1000);
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return (pthread_cond_timedwait(&cond->cond, &mutex->mutex, &deadline) == ETIMEDOUT)
+        ? TL_FALSE : TL_TRUE;
+#endif
+}
+
+void tl_cond_signal(TL_Cond* cond)
+{
+#ifdef _WIN32
+    WakeConditionVariable(&cond->cv);
+#else
+    pthread_cond_signal(&cond->cond);
+#endif
+}
+
+void tl_cond_broadcast(TL_Cond* cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&cond->cv);
+#else
+    pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+#ifdef _WIN32
+static unsigned __stdcall tl_thread_entry(void* arg)
+{
+    TL_Thread* thread = (TL_Thread*)arg;
+
+    thread->func(thread->arg);
+    return 0;
+}
+#else
+static void* tl_thread_entry(void* arg)
+{
+    TL_Thread* thread = (TL_Thread*)arg;
+
+    thread->func(thread->arg);
+    return NULL;
+}
+#endif
+
+/*
+ * 建立執行緒
+ */
+TL_Thread* tl_thread_create(TL_ThreadFunc func, void* arg)
+{
+    TL_Thread* thread;
+
+    if (func == NULL) {
+        return NULL;
+    }
+    thread = (TL_Thread*)malloc(sizeof(TL_Thread));
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->func = func;
+    thread->arg = arg;
+
+#ifdef _WIN32
+    /* 使用 _beginthreadex 以確保 CRT 的執行緒資料正確初始化 */
+    thread->handle = (HANDLE)_beginthreadex(NULL, 0, tl_thread_entry, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->thread, NULL, tl_thread_entry, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+/*
+ * 等待執行緒結束並釋放
+ */
+void tl_thread_join(TL_Thread* thread)
+{
+    if (thread == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->thread, NULL);
+#endif
+    free(thread);
+}
+
+/* -------------------------------------------------------------------------
+ * 可輪詢的通知訊號
+ */
+
+struct TL_PollSignal {
+#ifdef _WIN32
+    HANDLE event;
+#else
+    int read_fd;     /* 供呼叫端輪詢 (eventfd 時與 write_fd 相同) */
+    int write_fd;
+#endif
+};
+
+/*
+ * 建立通知訊號
+ */
+TL_PollSignal* tl_poll_signal_create(void)
+{
+    TL_PollSignal* signal = (TL_PollSignal*)malloc(sizeof(TL_PollSignal));
+
+    if (signal == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    /* 手動重設：觸發後保持觸發，直到事件全部處理完 */
+    signal->event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (signal->event == NULL) {
+        free(signal);
+        return NULL;
+    }
+#elif defined(__linux__)
+    signal->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signal->read_fd < 0) {
+        free(signal);
+        return NULL;
+    }
+    signal->write_fd = signal->read_fd;
+#else
+    {
+        int fds[2];
+
+        if (pipe(fds) != 0) {
+            free(signal);
+            return NULL;
+        }
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        signal->read_fd = fds[0];
+        signal->write_fd = fds[1];
+    }
+#endif
+    return signal;
+}
+
+/*
+ * 銷毀通知訊號
+ */
+void tl_poll_signal_destroy(TL_PollSignal* signal)
+{
+    if (signal == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle(signal->event);
+#else
+    if (signal->write_fd != signal->read_fd) {
+        close(signal->write_fd);
+    }
+    close(signal->read_fd);
+#endif
+    free(signal);
+}
+
+/*
+ * 使代碼變為可讀
+ */
+void tl_poll_signal_set(TL_PollSignal* signal)
+{
+#ifdef _WIN32
+    SetEvent(signal->event);
+#elif defined(__linux__)
+    eventfd_t value = 1;
+
+    /* 計數器溢位 (EAGAIN) 時代碼本來就是可讀的 */
+    (void)!write(signal->write_fd, &value, sizeof(value));
+#else
+    TL_BYTE value = 1;
+
+    /* 管道已滿 (EAGAIN) 時代碼本來就是可讀的 */
+    (void)!write(signal->write_fd, &value, sizeof(value));
+#endif
+}
+
+/*
+ * 使代碼回到不可讀狀態
+ */
+void tl_poll_signal_clear(TL_PollSignal* signal)
+{
+#ifdef _WIN32
+    ResetEvent(signal->event);
+#else
+    TL_BYTE buffer[64];
+
+    /* 非阻塞讀取直到沒有資料 */
+    while (read(signal->read_fd, buffer, sizeof(buffer)) > 0) {
+    }
+#endif
+}
+
+/*
+ * 取得供呼叫端輪詢的代碼
+ */
+TL_POLL_FD tl_poll_signal_fd(const TL_PollSignal* signal)
+{
+#ifdef _WIN32
+    return (TL_POLL_FD)signal->event;
+#else
+    return signal->read_fd;
+#endif
+}
+
+/* -------------------------------------------------------------------------
+ * 網路通訊端
+ */
+
+#ifdef _WIN32
+typedef SOCKET TL_SOCKET_FD;
+#define TL_SOCKET_INVALID  INVALID_SOCKET
+#define tl_socket_close_fd closesocket
+typedef WSAPOLLFD TL_POLLFD;
+#else
+typedef int TL_SOCKET_FD;
+#define TL_SOCKET_INVALID  (-1)
+#define tl_socket_close_fd close
+typedef struct pollfd TL_POLLFD;
+#endif
+
+/* 不需配置記憶體即可輪詢的項目數 */
+#define TL_SOCKET_POLL_STACK  64
+
+struct TL_Socket {
+    TL_SOCKET_FD fd;
+};
+
+/*
+ * 初始化與釋放 Winsock (每個通訊端各一次，Winsock 自行計數)
+ */
+static TL_BOOL tl_socket_startup(void)
+{
+#ifdef _WIN32
+    WSADATA data;
+
+    return (WSAStartup(MAKEWORD(2, 2), &data) == 0) ? TL_TRUE : TL_FALSE;
+#else
+    return TL_TRUE;
+#endif
+}
+
+static void tl_socket_cleanup(void)
+{
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+/*
+ * 設為非阻塞
+ */
+static TL_BOOL tl_socket_set_nonblocking(TL_SOCKET_FD fd)
+{
+#ifdef _WIN32
+    u_long enable = 1;
+
+    return (ioctlsocket(fd, FIONBIO, &enable) == 0) ? TL_TRUE : TL_FALSE;
+#else
+    int flags = fcntl(fd, F_GETFL);
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return (flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0) ? TL_TRUE : TL_FALSE;
+#endif
+}
+
+/*
+ * 最近一次的錯誤是否只是目前無法收送
+ */
+static TL_BOOL tl_socket_would_block(void)
+{
+#ifdef _WIN32
+    return (WSAGetLastError() == WSAEWOULDBLOCK) ? TL_TRUE : TL_FALSE;
+#else
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? TL_TRUE : TL_FALSE;
+#endif
+}
+
+/*
+ * 包裝已開啟的代碼，失敗時關閉代碼
+ */
+static TL_Socket* tl_socket_wrap(TL_SOCKET_FD fd)
+{
+    TL_Socket* socket;
+
+    if (!tl_socket_set_nonblocking(fd)) {
+        tl_socket_close_fd(fd);
+        tl_socket_cleanup();
+        return NULL;
+    }
+    socket = (TL_Socket*)malloc(sizeof(TL_Socket));
+    if (socket == NULL) {
+        tl_socket_close_fd(fd);
+        tl_socket_cleanup();
+        return NULL;
+    }
+    socket->fd = fd;
+    return socket;
+}
+
+/*
+ * 建立監聽通訊端
+ */
+TL_ERROR_CODE tl_socket_listen(const char* address, unsigned short port, TL_Socket** listener)
+{
+    struct sockaddr_in bind_address;
+    TL_SOCKET_FD fd;
+    int enable = 1;
+
+    memset(&bind_address, 0, sizeof(bind_address));
+    bind_address.sin_family = AF_INET;
+    bind_address.sin_port = htons(port);
+    if (address == NULL) {
+        bind_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, address, &bind_address.sin_addr) != 1) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!tl_socket_startup()) {
+        return TL_ERROR_GENERAL;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == TL_SOCKET_INVALID) {
+        tl_socket_cleanup();
+        return TL_ERROR_GENERAL;
+    }
+#ifndef _WIN32
+    /* 重新啟動時不需等待前一次的連線離開 TIME_WAIT (Windows 的同名選項語意不同) */
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&enable, sizeof(enable));
+#else
+    (void)enable;
+#endif
+    if (bind(fd, (const struct sockaddr*)&bind_address, sizeof(bind_address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        tl_socket_close_fd(fd);
+        tl_socket_cleanup();
+        return TL_ERROR_DEVICE_OPEN_FAILED;
+    }
+
+    *listener = tl_socket_wrap(fd);
+    return (*listener != NULL) ? TL_SUCCESS : TL_ERROR_MEMORY_ALLOCATION;
+}
+
+/*
+ * 接受一個等待中的連線
+ */
+TL_Socket* tl_socket_accept(TL_Socket* listener)
+{
+    TL_SOCKET_FD fd;
+    int enable = 1;
+
+    if (!tl_socket_startup()) {
+        return NULL;
+    }
+    fd = accept(listener->fd, NULL, NULL);
+    if (fd == TL_SOCKET_INVALID) {
+        tl_socket_cleanup();
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&enable, sizeof(enable));
+#endif
+    return tl_socket_wrap(fd);
+}
+
+/*
+ * 連接到 TCP 伺服器
+ */
+TL_ERROR_CODE tl_socket_connect(const char* address, unsigned short port, TL_Socket** socket_out)
+{
+    struct sockaddr_in remote;
+    TL_SOCKET_FD fd;
+    int enable = 1;
+
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(port);
+    if (address == NULL || inet_pton(AF_INET, address, &remote.sin_addr) != 1) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    if (!tl_socket_startup()) {
+        return TL_ERROR_GENERAL;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == TL_SOCKET_INVALID) {
+        tl_socket_cleanup();
+        return TL_ERROR_GENERAL;
+    }
+    if (connect(fd, (const struct sockaddr*)&remote, sizeof(remote)) != 0) {
+        tl_socket_close_fd(fd);
+        tl_socket_cleanup();
+        return TL_ERROR_DEVICE_OPEN_FAILED;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&enable, sizeof(enable));
+#endif
+
+    *socket_out = tl_socket_wrap(fd);
+    return (*socket_out != NULL) ? TL_SUCCESS : TL_ERROR_MEMORY_ALLOCATION;
+}
+
+/*
+ * 取得通訊端的本機連接埠
+ */
+unsigned short tl_socket_local_port(const TL_Socket* socket)
+{
+    struct sockaddr_in local;
+#ifdef _WIN32
+    int length = sizeof(local);
+#else
+    socklen_t length = sizeof(local);
+#endif
+
+    if (getsockname(socket->fd, (struct sockaddr*)&local, &length) != 0) {
+        return 0;
+    }
+    return ntohs(local.sin_port);
+}
+
+/*
+ * 非阻塞接收
+ */
+long tl_socket_recv(TL_Socket* socket, void* buffer, size_t length)
+{
+#ifdef _WIN32
+    int received = recv(socket->fd, (char*)buffer, (int)((length > 0x7FFFFFFF) ? 0x7FFFFFFF : length), 0);
+#else
+    ssize_t received = recv(socket->fd, buffer, length, 0);
+#endif
+
+    if (received > 0) {
+        return (long)received;
+    }
+    if (received < 0 && tl_socket_would_block()) {
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * 非阻塞傳送
+ */
+long tl_socket_send(TL_Socket* socket, const void* buffer, size_t length)
+{
+#ifdef _WIN32
+    int sent = send(socket->fd, (const char*)buffer, (int)((length > 0x7FFFFFFF) ? 0x7FFFFFFF : length), 0);
+#elif defined(MSG_NOSIGNAL)
+    ssize_t sent = send(socket->fd, buffer, length, MSG_NOSIGNAL);
+#else
+    ssize_t sent = send(socket->fd, buffer, length, 0);
+#endif
+
+    if (sent >= 0) {
+        return (long)sent;
+    }
+    return tl_socket_would_block() ? 0 : -1;
+}
+
+/*
+ * 關閉通訊端
+ */
+void tl_socket_close(TL_Socket* socket)
+{
+    if (socket == NULL) {
+        return;
+    }
+    tl_socket_close_fd(socket->fd);
+    tl_socket_cleanup();
+    free(socket);
+}
+
+/*
+ * 建立喚醒用的通訊端
+ */
+TL_Socket* tl_socket_wake_create(void)
+{
+    struct sockaddr_in local;
+    TL_SOCKET_FD fd;
+#ifdef _WIN32
+    int length = sizeof(local);
+#else
+    socklen_t length = sizeof(local);
+#endif
+
+    if (!tl_socket_startup()) {
+        return NULL;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == TL_SOCKET_INVALID) {
+        tl_socket_cleanup();
+        return NULL;
+    }
+
+    /* 綁定本機位址後連接到自己，只會收到自己送出的資料 */
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (const struct sockaddr*)&local, sizeof(local)) != 0 ||
+        getsockname(fd, (struct sockaddr*)&local, &length) != 0 ||
+        connect(fd, (const struct sockaddr*)&local, sizeof(local)) != 0) {
+        tl_socket_close_fd(fd);
+        tl_socket_cleanup();
+        return NULL;
+    }
+    return tl_socket_wrap(fd);
+}
+
+/*
+ * 使喚醒通訊端變為可讀
+ */
+void tl_socket_wake(TL_Socket* wake)
+{
+    TL_BYTE value = 1;
+
+    /* 緩衝區已滿時通訊端本來就是可讀的 */
+    tl_socket_send(wake, &value, sizeof(value));
+}
+
+/*
+ * 取出喚醒通訊端中的所有資料
+ */
+void tl_socket_wake_clear(TL_Socket* wake)
+{
+    TL_BYTE buffer[64];
+
+    while (tl_socket_recv(wake, buffer, sizeof(buffer)) > 0) {
+    }
+}
+
+/*
+ * 等待通訊端事件
+ */
+int tl_socket_poll(TL_SocketPoll* items, size_t count, unsigned long timeout_ms)
+{
+    TL_POLLFD stack[TL_SOCKET_POLL_STACK];
+    TL_POLLFD* fds = stack;
+    size_t used = 0;
+    size_t i;
+    int timeout = (timeout_ms == TL_WAIT_INFINITE || timeout_ms > 0x7FFFFFFFUL) ? -1 : (int)timeout_ms;
+    int ready;
+
+    if (count > TL_SOCKET_POLL_STACK) {
+        fds = (TL_POLLFD*)malloc(count * sizeof(TL_POLLFD));
+        if (fds == NULL) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        items[i].revents = 0;
+        if (items[i].socket == NULL) {
+            continue;
+        }
+        fds[used].fd = items[i].socket->fd;
+        fds[used].events = (short)(((items[i].events & TL_SOCKET_READABLE) ? POLLIN : 0) |
+                                   ((items[i].events & TL_SOCKET_WRITABLE) ? POLLOUT : 0));
+        fds[used].revents = 0;
+        used++;
+    }
+
+#ifdef _WIN32
+    ready = (used != 0) ? WSAPoll(fds, (ULONG)used, timeout) : (Sleep((DWORD)timeout_ms), 0);
+#else
+    ready = poll(fds, (nfds_t)used, timeout);
+    if (ready < 0 && errno == EINTR) {
+        ready = 0;
+    }
+#endif
+
+    if (ready > 0) {
+        used = 0;
+        for (i = 0; i < count; i++) {
+            if (items[i].socket == NULL) {
+                continue;
+            }
+            if (fds[used].revents & POLLIN) {
+                items[i].revents |= TL_SOCKET_READABLE;
+            }
+            if (fds[used].revents & POLLOUT) {
+                items[i].revents |= TL_SOCKET_WRITABLE;
+            }
+            if (fds[used].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                items[i].revents |= TL_SOCKET_CLOSED;
+            }
+            used++;
+        }
+    }
+
+    if (fds != stack) {
+        free(fds);
+    }
+    return ready;
+}
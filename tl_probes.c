@@ -0,0 +1,82 @@
+﻿/*
+ * tl_probes.c
+ *
+ * 塔燈通訊控制函式庫 - 靜態追蹤點的ETW提供者
+ *
+ * 追蹤點本身定義於 tl_probes.h；本檔案定義 Windows 的 TraceLogging 提供者，
+ * 並在函式庫初始化與釋放時註冊與取消註冊。未註冊時 TraceLoggingWrite 不做任何事。
+ * 其他平台的 USDT 追蹤點不需要註冊。測試程式另外在此計算各追蹤點觸發的次數。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include "tl_probes.h"
+
+#if !defined(TL_NO_PROBES) && defined(_WIN32)
+
+/* TowerLight-TL_CLibrary {c5241612-c833-54d8-b4d4-46d3ddee0d8d} */
+TRACELOGGING_DEFINE_PROVIDER(g_tl_probe_provider, "TowerLight-TL_CLibrary",
+    (0xc5241612, 0xc833, 0x54d8, 0xb4, 0xd4, 0x46, 0xd3, 0xdd, 0xee, 0x0d, 0x8d));
+
+/*
+ * 註冊ETW提供者
+ */
+void tl_probes_register(void)
+{
+    /* 註冊失敗時追蹤點維持停用，不影響函式庫運作 */
+    TraceLoggingRegister(g_tl_probe_provider);
+}
+
+/*
+ * 取消註冊ETW提供者
+ */
+void tl_probes_unregister(void)
+{
+    TraceLoggingUnregister(g_tl_probe_provider);
+}
+
+#else
+
+/*
+ * 註冊ETW提供者 (其他平台不需要)
+ */
+void tl_probes_register(void)
+{
+}
+
+/*
+ * 取消註冊ETW提供者 (其他平台不需要)
+ */
+void tl_probes_unregister(void)
+{
+}
+
+#endif
+
+#ifdef BUILD_TEST_EXE
+
+/* 各追蹤點觸發的次數 (原子操作) */
+static volatile unsigned int g_tl_probe_hits[TL_PROBE_ID_COUNT];
+
+/*
+ * 記錄追蹤點觸發一次
+ */
+void tl_probes_hit(TL_PROBE_ID id)
+{
+    unsigned int count;
+
+    do {
+        count = tl_atomic_load_u32(&g_tl_probe_hits[id]);
+    } while (!tl_atomic_cas_u32(&g_tl_probe_hits[id], count, count + 1));
+}
+
+/*
+ * 取得追蹤點觸發的次數
+ */
+unsigned int tl_probes_hit_count(TL_PROBE_ID id)
+{
+    return tl_atomic_load_u32(&g_tl_probe_hits[id]);
+}
+
+#endif
@@ -0,0 +1,215 @@
+﻿/*
+ * tl_probes.h
+ *
+ * 塔燈通訊控制函式庫 - 靜態追蹤點定義
+ *
+ * 在命令構建、USB寫入與讀取的開始與結束、回應解析、逾時與錯誤處設置
+ * 靜態追蹤點，讓系統層級的分析工具可以將塔燈的延遲與系統其他活動對照：
+ *   - Windows：ETW TraceLogging，提供者名稱 "TowerLight-TL_CLibrary"，
+ *     GUID {c5241612-c833-54d8-b4d4-46d3ddee0d8d} (由名稱依 EventSource 規則產生)，
+ *     可用 WPR/tracelog 以 *TowerLight-TL_CLibrary 啟用；
+ *   - Linux：USDT (SystemTap SDT) 註記，提供者 tl_tower_light，
+ *     例如 bpftrace 的 usdt:libtl.so:tl_tower_light:write_start；
+ *     需要 <sys/sdt.h> (systemtap-sdt-dev)，沒有時追蹤點為空。
+ *
+ * 沒有工具連接時：TraceLogging 只檢查一次提供者的啟用旗標，USDT 追蹤點
+ * 只是一個 nop 指令。定義 TL_NO_PROBES 可完全移除追蹤點。
+ *
+ * 測試程式 (BUILD_TEST_EXE) 另外計算每個追蹤點觸發的次數，不需要外部工具
+ * 即可確認追蹤點位於命令路徑上。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#ifndef TL_PROBES_H
+#define TL_PROBES_H
+
+#include "tl_internal.h"
+
+/* 追蹤點編號 (測試程式計數用) */
+typedef enum {
+    TL_PROBE_ID_BUILD = 0,
+    TL_PROBE_ID_WRITE_START,
+    TL_PROBE_ID_WRITE_END,
+    TL_PROBE_ID_READ_START,
+    TL_PROBE_ID_READ_END,
+    TL_PROBE_ID_PARSE,
+    TL_PROBE_ID_TIMEOUT,
+    TL_PROBE_ID_ERROR,
+    TL_PROBE_ID_COUNT
+} TL_PROBE_ID;
+
+#ifdef BUILD_TEST_EXE
+/*
+ * 記錄追蹤點觸發一次 (僅測試程式)
+ *
+ * 參數：id 追蹤點編號
+ */
+void tl_probes_hit(TL_PROBE_ID id);
+
+/*
+ * 取得追蹤點觸發的次數 (僅測試程式)
+ *
+ * 參數：id 追蹤點編號
+ * 返回值：程式啟動以來的觸發次數
+ */
+unsigned int tl_probes_hit_count(TL_PROBE_ID id);
+
+#define TL_PROBE_HIT(id) tl_probes_hit(id)
+#else
+#define TL_PROBE_HIT(id) ((void)0)
+#endif
+
+#if !defined(TL_NO_PROBES) && defined(_WIN32)
+
+#include <windows.h>
+#include <TraceLoggingProvider.h>
+
+TRACELOGGING_DECLARE_PROVIDER(g_tl_probe_provider);
+
+#define TL_PROBE_BUILD(cmd_type, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_BUILD); \
+        TraceLoggingWrite(g_tl_probe_provider, "Build", \
+                          TraceLoggingUInt8((UINT8)(cmd_type), "Command"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes")); \
+    } while (0)
+
+#define TL_PROBE_WRITE_START(device, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_WRITE_START); \
+        TraceLoggingWrite(g_tl_probe_provider, "WriteStart", \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes")); \
+    } while (0)
+
+#define TL_PROBE_WRITE_END(device, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_WRITE_END); \
+        TraceLoggingWrite(g_tl_probe_provider, "WriteEnd", \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes"), \
+                          TraceLoggingInt32((INT32)(result), "Result")); \
+    } while (0)
+
+#define TL_PROBE_READ_START(device, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_READ_START); \
+        TraceLoggingWrite(g_tl_probe_provider, "ReadStart", \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes")); \
+    } while (0)
+
+#define TL_PROBE_READ_END(device, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_READ_END); \
+        TraceLoggingWrite(g_tl_probe_provider, "ReadEnd", \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes"), \
+                          TraceLoggingInt32((INT32)(result), "Result")); \
+    } while (0)
+
+#define TL_PROBE_PARSE(cmd_type, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_PARSE); \
+        TraceLoggingWrite(g_tl_probe_provider, "Parse", \
+                          TraceLoggingUInt8((UINT8)(cmd_type), "Command"), \
+                          TraceLoggingUInt32((UINT32)(length), "Bytes"), \
+                          TraceLoggingInt32((INT32)(result), "Result")); \
+    } while (0)
+
+#define TL_PROBE_TIMEOUT(device, timeout_ms) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_TIMEOUT); \
+        TraceLoggingWrite(g_tl_probe_provider, "Timeout", \
+                          TraceLoggingLevel(TRACE_LEVEL_WARNING), \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingUInt32((UINT32)(timeout_ms), "TimeoutMs")); \
+    } while (0)
+
+#define TL_PROBE_ERROR(device, error) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_ERROR); \
+        TraceLoggingWrite(g_tl_probe_provider, "Error", \
+                          TraceLoggingLevel(TRACE_LEVEL_ERROR), \
+                          TraceLoggingUInt32((device)->device_index, "Device"), \
+                          TraceLoggingInt32((INT32)(error), "Result")); \
+    } while (0)
+
+#elif !defined(TL_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define TL_PROBES_USDT
+#endif
+#endif
+
+#if defined(TL_PROBES_USDT)
+
+#include <sys/sdt.h>
+
+#define TL_PROBE_BUILD(cmd_type, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_BUILD); \
+        DTRACE_PROBE2(tl_tower_light, build, (unsigned int)(cmd_type), (unsigned int)(length)); \
+    } while (0)
+#define TL_PROBE_WRITE_START(device, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_WRITE_START); \
+        DTRACE_PROBE2(tl_tower_light, write_start, (device)->device_index, (unsigned int)(length)); \
+    } while (0)
+#define TL_PROBE_WRITE_END(device, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_WRITE_END); \
+        DTRACE_PROBE3(tl_tower_light, write_end, (device)->device_index, (unsigned int)(length), (int)(result)); \
+    } while (0)
+#define TL_PROBE_READ_START(device, length) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_READ_START); \
+        DTRACE_PROBE2(tl_tower_light, read_start, (device)->device_index, (unsigned int)(length)); \
+    } while (0)
+#define TL_PROBE_READ_END(device, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_READ_END); \
+        DTRACE_PROBE3(tl_tower_light, read_end, (device)->device_index, (unsigned int)(length), (int)(result)); \
+    } while (0)
+#define TL_PROBE_PARSE(cmd_type, length, result) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_PARSE); \
+        DTRACE_PROBE3(tl_tower_light, parse, (unsigned int)(cmd_type), (unsigned int)(length), (int)(result)); \
+    } while (0)
+#define TL_PROBE_TIMEOUT(device, timeout_ms) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_TIMEOUT); \
+        DTRACE_PROBE2(tl_tower_light, timeout, (device)->device_index, (unsigned long)(timeout_ms)); \
+    } while (0)
+#define TL_PROBE_ERROR(device, error) \
+    do { \
+        TL_PROBE_HIT(TL_PROBE_ID_ERROR); \
+        DTRACE_PROBE2(tl_tower_light, error, (device)->device_index, (int)(error)); \
+    } while (0)
+
+#elif !defined(TL_PROBE_BUILD)
+
+/* 沒有可用的追蹤機制：追蹤點為空 */
+#define TL_PROBE_BUILD(cmd_type, length)              TL_PROBE_HIT(TL_PROBE_ID_BUILD)
+#define TL_PROBE_WRITE_START(device, length)          TL_PROBE_HIT(TL_PROBE_ID_WRITE_START)
+#define TL_PROBE_WRITE_END(device, length, result)    TL_PROBE_HIT(TL_PROBE_ID_WRITE_END)
+#define TL_PROBE_READ_START(device, length)           TL_PROBE_HIT(TL_PROBE_ID_READ_START)
+#define TL_PROBE_READ_END(device, length, result)     TL_PROBE_HIT(TL_PROBE_ID_READ_END)
+#define TL_PROBE_PARSE(cmd_type, length, result)      TL_PROBE_HIT(TL_PROBE_ID_PARSE)
+#define TL_PROBE_TIMEOUT(device, timeout_ms)          TL_PROBE_HIT(TL_PROBE_ID_TIMEOUT)
+#define TL_PROBE_ERROR(device, error)                 TL_PROBE_HIT(TL_PROBE_ID_ERROR)
+
+#endif
+
+/*
+ * 註冊ETW提供者 (TL_Initialize 時呼叫，其他平台不做任何事)
+ */
+void tl_probes_register(void);
+
+/*
+ * 取消註冊ETW提供者 (TL_Finalize 時呼叫)
+ */
+void tl_probes_unregister(void);
+
+#endif /* TL_PROBES_H */
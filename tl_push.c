@@ -0,0 +1,874 @@
+﻿/*
+ * tl_push.c
+ *
+ * 塔燈通訊控制函式庫 - 狀態推播伺服器實現 (WebSocket)
+ *
+ * HMI 畫面以 WebSocket 訂閱塔燈狀態，不需輪詢。每台裝置最多一個推播執行緒，
+ * 以非阻塞通訊端輪詢所有訂閱者；裝置的目前狀態改變時 (tl_tower_state_note)
+ * 喚醒推播執行緒，將新的狀態編碼為一個訊息後推送給所有訂閱者。
+ *
+ * 訊息為二進位訊框，內容 9 位元組 (小端序)：
+ *   [0]    訊息類型，1 表示塔燈狀態
+ *   [1~4]  序號，每次廣播加 1 (序號不連續表示中間的狀態已被合併)
+ *   [5~8]  目前的塔燈狀態 (TL_TowerState)
+ * 連線完成時先送出目前的狀態。
+ *
+ * 同一次廣播的訊框只編碼一次，由所有訂閱者以參考計數共用，不為每個訂閱者複製。
+ * 每個訂閱者最多持有兩個訊息：正在送出的一個與最新的一個；尚未開始送出的訊息
+ * 被更新的狀態取代 (快照合併)，因此讀取緩慢的訂閱者只會跳過中間狀態，不會累積佇列。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tl_internal.h"
+
+/* 同時訂閱者數上限，超過時拒絕新的連線 */
+#define TL_PUSH_MAX_CLIENTS      1024
+
+/* 握手請求的最大長度 */
+#define TL_PUSH_REQUEST_MAX      2048
+
+/* 握手必須在此時間內完成 (毫秒) */
+#define TL_PUSH_HANDSHAKE_MS     5000
+
+/* 沒有事件時的輪詢間隔，用於檢查握手逾時 (毫秒) */
+#define TL_PUSH_POLL_MS          1000
+
+/* 監聽通訊端可讀取卻無法接受連線時 (例如已達開啟檔案數上限)，暫停接受的時間 (毫秒) */
+#define TL_PUSH_ACCEPT_RETRY_MS  100
+
+/* 訂閱者送來的訊框 (只處理控制訊框) 的最大長度 */
+#define TL_PUSH_FRAME_MAX        256
+
+/* 狀態訊息的訊框長度：2 位元組標頭 + 9 位元組內容 */
+#define TL_PUSH_STATE_FRAME      11
+
+/* WebSocket 握手使用的 GUID (RFC 6455) */
+#define TL_PUSH_WS_GUID          "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/* 共用的訊息 (只由推播執行緒存取) */
+typedef struct {
+    unsigned int references;          /* 參考數 */
+    size_t length;                    /* 訊框長度 */
+    TL_BYTE data[TL_PUSH_STATE_FRAME];  /* 已編碼的訊框 */
+} TL_PushMessage;
+
+/* 單一訂閱者 */
+typedef struct {
+    TL_Socket* socket;                /* 通訊端 */
+    TL_BOOL subscribed;               /* 已完成握手 */
+    unsigned long long accept_us;     /* 接受連線的時間 */
+    TL_BYTE input[TL_PUSH_REQUEST_MAX];  /* 握手請求或訂閱者送來的訊框 */
+    size_t input_length;
+    TL_BYTE control[TL_PUSH_REQUEST_MAX];  /* 握手回應或控制訊框 (優先於狀態訊息送出) */
+    size_t control_length;
+    TL_BOOL closing;                  /* 控制訊框送完後關閉連線 */
+    TL_PushMessage* sending;          /* 正在送出的訊息 */
+    size_t sent;                      /* 已送出的位元組數 */
+    TL_PushMessage* latest;           /* 下一個要送出的訊息 (最新的狀態) */
+} TL_PushClient;
+
+/* 推播伺服器 */
+struct TL_PushServer {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護 stopping 與 stats */
+    TL_Thread* thread;                /* 推播執行緒 */
+    TL_Socket* listener;              /* 監聽通訊端 */
+    TL_Socket* wake;                  /* 狀態改變或停止時喚醒推播執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_PushStats stats;               /* 統計 */
+    TL_PushClient** clients;          /* 訂閱者 (只由推播執行緒存取)，共 TL_PUSH_MAX_CLIENTS 個位置 */
+    TL_SocketPoll* items;             /* 輪詢項目 */
+    unsigned long long accept_resume_us;  /* 暫停接受連線直到此時間 (只由推播執行緒存取) */
+    TL_PushMessage* current;          /* 最近一次廣播的訊息 */
+    TL_TowerState state;              /* 最近一次廣播的狀態 */
+    unsigned int sequence;            /* 最近一次廣播的序號 */
+};
+
+/* -------------------------------------------------------------------------
+ * WebSocket 握手 (SHA-1 與 Base64)
+ */
+
+/* SHA-1 的狀態 */
+typedef struct {
+    uint32_t h[5];
+    TL_BYTE block[64];
+    size_t block_length;
+    uint64_t total_length;
+} TL_PushSha1;
+
+static uint32_t tl_push_rotl(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void tl_push_sha1_block(TL_PushSha1* sha, const TL_BYTE* block)
+{
+    uint32_t w[80];
+    uint32_t a = sha->h[0], b = sha->h[1], c = sha->h[2], d = sha->h[3], e = sha->h[4];
+    uint32_t f, k, t;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (i = 16; i < 80; i++) {
+        w[i] = tl_push_rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999u;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1u;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCu;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6u;
+        }
+        t = tl_push_rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = tl_push_rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    sha->h[0] += a;
+    sha->h[1] += b;
+    sha->h[2] += c;
+    sha->h[3] += d;
+    sha->h[4] += e;
+}
+
+static void tl_push_sha1_update(TL_PushSha1* sha, const TL_BYTE* data, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        sha->block[sha->block_length++] = data[i];
+        if (sha->block_length == 64) {
+            tl_push_sha1_block(sha, sha->block);
+            sha->block_length = 0;
+        }
+    }
+    sha->total_length += length;
+}
+
+/*
+ * 計算 SHA-1 摘要
+ */
+static void tl_push_sha1(const TL_BYTE* data, size_t length, TL_BYTE digest[20])
+{
+    static const TL_BYTE padding = 0x80;
+    static const TL_BYTE zero = 0;
+    TL_PushSha1 sha;
+    TL_BYTE bits[8];
+    uint64_t total;
+    int i;
+
+    sha.h[0] = 0x67452301u;
+    sha.h[1] = 0xEFCDAB89u;
+    sha.h[2] = 0x98BADCFEu;
+    sha.h[3] = 0x10325476u;
+    sha.h[4] = 0xC3D2E1F0u;
+    sha.block_length = 0;
+    sha.total_length = 0;
+
+    tl_push_sha1_update(&sha, data, length);
+    total = sha.total_length * 8;
+    tl_push_sha1_update(&sha, &padding, 1);
+    while (sha.block_length != 56) {
+        tl_push_sha1_update(&sha, &zero, 1);
+    }
+    for (i = 0; i < 8; i++) {
+        bits[i] = (TL_BYTE)(total >> (56 - i * 8));
+    }
+    tl_push_sha1_update(&sha, bits, 8);
+
+    for (i = 0; i < 20; i++) {
+        digest[i] = (TL_BYTE)(sha.h[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+/*
+ * Base64 編碼 (輸出以 NUL 結尾，需 4 * ((length + 2) / 3) + 1 位元組)
+ */
+static void tl_push_base64(const TL_BYTE* data, size_t length, char* output)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t value;
+    size_t i;
+
+    for (i = 0; i + 2 < length; i += 3) {
+        value = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        *output++ = table[(value >> 18) & 0x3F];
+        *output++ = table[(value >> 12) & 0x3F];
+        *output++ = table[(value >> 6) & 0x3F];
+        *output++ = table[value & 0x3F];
+    }
+    if (i < length) {
+        value = (uint32_t)data[i] << 16;
+        if (i + 1 < length) {
+            value |= (uint32_t)data[i + 1] << 8;
+        }
+        *output++ = table[(value >> 18) & 0x3F];
+        *output++ = table[(value >> 12) & 0x3F];
+        *output++ = (i + 1 < length) ? table[(value >> 6) & 0x3F] : '=';
+        *output++ = '=';
+    }
+    *output = '\0';
+}
+
+/*
+ * 在握手請求中尋找標頭 (不分大小寫)，返回去除前後空白的值
+ */
+static TL_BOOL tl_push_find_header(const char* request, const char* name, const char** value, size_t* length)
+{
+    size_t name_length = strlen(name);
+    const char* line = strstr(request, "\r\n");
+    const char* end;
+    size_t i;
+
+    while (line != NULL && line[2] != '\0') {
+        line += 2;
+        for (i = 0; i < name_length; i++) {
+            char a = line[i];
+            char b = name[i];
+
+            if (a >= 'A' && a <= 'Z') {
+                a = (char)(a - 'A' + 'a');
+            }
+            if (b >= 'A' && b <= 'Z') {
+                b = (char)(b - 'A' + 'a');
+            }
+            if (a != b) {
+                break;
+            }
+        }
+        if (i == name_length && line[i] == ':') {
+            line += name_length + 1;
+            while (*line == ' ' || *line == '\t') {
+                line++;
+            }
+            end = strstr(line, "\r\n");
+            if (end == NULL) {
+                return TL_FALSE;
+            }
+            while (end > line && (end[-1] == ' ' || end[-1] == '\t')) {
+                end--;
+            }
+            *value = line;
+            *length = (size_t)(end - line);
+            return TL_TRUE;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return TL_FALSE;
+}
+
+/*
+ * 處理握手請求
+ *
+ * 返回值：TL_TRUE 表示已取得完整的請求 (成功或失敗都已放入 control)，TL_FALSE 表示需要更多資料
+ */
+static TL_BOOL tl_push_handshake(TL_PushServer* server, TL_PushClient* client)
+{
+    static const char rejected[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    char accept_key[64 + sizeof(TL_PUSH_WS_GUID)];
+    char encoded[32];
+    TL_BYTE digest[20];
+    const char* key;
+    size_t key_length;
+    char* request = (char*)client->input;
+    char* end;
+
+    /* 請求填滿緩衝區仍未結束時視為無效 */
+    client->input[client->input_length] = '\0';
+    end = strstr(request, "\r\n\r\n");
+    if (end == NULL && client->input_length < sizeof(client->input) - 1) {
+        return TL_FALSE;
+    }
+
+    if (end == NULL || strncmp(request, "GET ", 4) != 0 ||
+        !tl_push_find_header(request, "Sec-WebSocket-Key", &key, &key_length) ||
+        key_length == 0 || key_length > 64) {
+        memcpy(client->control, rejected, sizeof(rejected) - 1);
+        client->control_length = sizeof(rejected) - 1;
+        client->closing = TL_TRUE;
+
+        tl_mutex_lock(server->lock);
+        server->stats.handshake_failures++;
+        tl_mutex_unlock(server->lock);
+        return TL_TRUE;
+    }
+
+    memcpy(accept_key, key, key_length);
+    memcpy(accept_key + key_length, TL_PUSH_WS_GUID, sizeof(TL_PUSH_WS_GUID) - 1);
+    tl_push_sha1((const TL_BYTE*)accept_key, key_length + sizeof(TL_PUSH_WS_GUID) - 1, digest);
+    tl_push_base64(digest, sizeof(digest), encoded);
+
+    client->control_length = (size_t)snprintf((char*)client->control, sizeof(client->control),
+                                              "HTTP/1.1 101 Switching Protocols\r\n"
+                                              "Upgrade: websocket\r\n"
+                                              "Connection: Upgrade\r\n"
+                                              "Sec-WebSocket-Accept: %s\r\n\r\n", encoded);
+    /* 保留請求之後已收到的訊框 */
+    end += 4;
+    client->input_length -= (size_t)(end - request);
+    memmove(client->input, end, client->input_length);
+    client->subscribed = TL_TRUE;
+
+    /* 握手回應之後立即送出目前的狀態 */
+    client->latest = server->current;
+    server->current->references++;
+
+    tl_mutex_lock(server->lock);
+    server->stats.subscriber_count++;
+    tl_mutex_unlock(server->lock);
+    return TL_TRUE;
+}
+
+/* -------------------------------------------------------------------------
+ * 訂閱者
+ */
+
+/*
+ * 釋放訊息的參考
+ */
+static void tl_push_release(TL_PushMessage* message)
+{
+    if (message != NULL && --message->references == 0) {
+        free(message);
+    }
+}
+
+/*
+ * 處理訂閱者送來的訊框：回應 ping 與 close，其他訊框略過
+ *
+ * 返回值：TL_FALSE 表示訊框格式錯誤，應關閉連線
+ */
+static TL_BOOL tl_push_read_frames(TL_PushClient* client)
+{
+    size_t consumed = 0;
+
+    while (!client->closing && client->input_length - consumed >= 2) {
+        TL_BYTE* frame = client->input + consumed;
+        TL_BYTE opcode = frame[0] & 0x0F;
+        size_t payload_length = frame[1] & 0x7F;
+        size_t header_length = 6;
+        size_t i;
+
+        /* 訂閱者送來的訊框必須遮罩；只接受單一訊框且不超過上限的訊息 */
+        if (!(frame[1] & 0x80) || !(frame[0] & 0x80) || payload_length > 125) {
+            return TL_FALSE;
+        }
+        if (client->input_length - consumed < header_length + payload_length) {
+            break;
+        }
+        for (i = 0; i < payload_length; i++) {
+            frame[header_length + i] ^= frame[2 + (i % 4)];
+        }
+
+        /* 控制訊框只在沒有正在送出的控制訊框時處理，否則等下一輪 */
+        if ((opcode == 0x8 || opcode == 0x9) && client->control_length != 0) {
+            break;
+        }
+        if (opcode == 0x8 || opcode == 0x9) {
+            client->control[0] = (TL_BYTE)(0x80 | ((opcode == 0x8) ? 0x8 : 0xA));
+            client->control[1] = (TL_BYTE)payload_length;
+            memcpy(client->control + 2, frame + header_length, payload_length);
+            client->control_length = 2 + payload_length;
+            client->closing = (opcode == 0x8) ? TL_TRUE : TL_FALSE;
+        }
+        consumed += header_length + payload_length;
+    }
+
+    if (consumed != 0) {
+        memmove(client->input, client->input + consumed, client->input_length - consumed);
+        client->input_length -= consumed;
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 送出訂閱者待送的資料
+ *
+ * 控制訊框與握手回應優先，狀態訊息只在訊框邊界之間插入。
+ *
+ * 返回值：TL_FALSE 表示連線已中斷或已送完關閉訊框
+ */
+static TL_BOOL tl_push_flush(TL_PushServer* server, TL_PushClient* client)
+{
+    long sent;
+
+    for (;;) {
+        if (client->sending == NULL && client->control_length != 0) {
+            sent = tl_socket_send(client->socket, client->control, client->control_length);
+            if (sent < 0) {
+                return TL_FALSE;
+            }
+            memmove(client->control, client->control + sent, client->control_length - (size_t)sent);
+            client->control_length -= (size_t)sent;
+            if (client->control_length != 0) {
+                return TL_TRUE;
+            }
+            if (client->closing) {
+                return TL_FALSE;
+            }
+            continue;
+        }
+
+        if (client->sending == NULL) {
+            if (client->latest == NULL || !client->subscribed) {
+                return TL_TRUE;
+            }
+            client->sending = client->latest;
+            client->latest = NULL;
+            client->sent = 0;
+        }
+
+        sent = tl_socket_send(client->socket, client->sending->data + client->sent,
+                              client->sending->length - client->sent);
+        if (sent < 0) {
+            return TL_FALSE;
+        }
+        client->sent += (size_t)sent;
+        if (client->sent != client->sending->length) {
+            return TL_TRUE;
+        }
+
+        tl_push_release(client->sending);
+        client->sending = NULL;
+
+        tl_mutex_lock(server->lock);
+        server->stats.messages_sent++;
+        tl_mutex_unlock(server->lock);
+    }
+}
+
+/*
+ * 關閉訂閱者
+ */
+static void tl_push_drop(TL_PushServer* server, int index)
+{
+    TL_PushClient* client = server->clients[index];
+
+    tl_socket_close(client->socket);
+    tl_push_release(client->sending);
+    tl_push_release(client->latest);
+
+    tl_mutex_lock(server->lock);
+    server->stats.client_count--;
+    if (client->subscribed) {
+        server->stats.subscriber_count--;
+    }
+    tl_mutex_unlock(server->lock);
+
+    free(client);
+    server->clients[index] = NULL;
+}
+
+/*
+ * 接受等待中的連線
+ *
+ * 返回值：接受 (包含超過上限而立即關閉) 的連線數
+ */
+static int tl_push_accept(TL_PushServer* server)
+{
+    TL_PushClient* client;
+    TL_Socket* socket;
+    int accepted = 0;
+    int i;
+
+    while ((socket = tl_socket_accept(server->listener)) != NULL) {
+        accepted++;
+        for (i = 0; i < TL_PUSH_MAX_CLIENTS; i++) {
+            if (server->clients[i] == NULL) {
+                break;
+            }
+        }
+        client = (i < TL_PUSH_MAX_CLIENTS) ? (TL_PushClient*)calloc(1, sizeof(TL_PushClient)) : NULL;
+
+        tl_mutex_lock(server->lock);
+        if (client == NULL) {
+            server->stats.rejected_clients++;
+        } else {
+            server->stats.client_count++;
+            server->stats.accepted_clients++;
+        }
+        tl_mutex_unlock(server->lock);
+
+        if (client == NULL) {
+            tl_socket_close(socket);
+            continue;
+        }
+        client->socket = socket;
+        client->accept_us = tl_time_now_us();
+        server->clients[i] = client;
+    }
+    return accepted;
+}
+
+/*
+ * 狀態改變時建立新的訊息並交給所有訂閱者
+ *
+ * 返回值：TL_FALSE 表示記憶體不足
+ */
+static TL_BOOL tl_push_broadcast(TL_PushServer* server, TL_TowerState state)
+{
+    TL_PushMessage* message;
+    TL_PushClient* client;
+    unsigned long long compacted = 0;
+    unsigned int sequence = server->sequence + 1;
+    int i;
+
+    message = (TL_PushMessage*)malloc(sizeof(TL_PushMessage));
+    if (message == NULL) {
+        return TL_FALSE;
+    }
+
+    /* 二進位訊框 (FIN)，伺服器送出的訊框不遮罩 */
+    message->data[0] = 0x82;
+    message->data[1] = 9;
+    message->data[2] = 1;
+    message->data[3] = (TL_BYTE)(sequence & 0xFF);
+    message->data[4] = (TL_BYTE)((sequence >> 8) & 0xFF);
+    message->data[5] = (TL_BYTE)((sequence >> 16) & 0xFF);
+    message->data[6] = (TL_BYTE)((sequence >> 24) & 0xFF);
+    message->data[7] = (TL_BYTE)(state & 0xFF);
+    message->data[8] = (TL_BYTE)((state >> 8) & 0xFF);
+    message->data[9] = (TL_BYTE)((state >> 16) & 0xFF);
+    message->data[10] = (TL_BYTE)((state >> 24) & 0xFF);
+    message->length = TL_PUSH_STATE_FRAME;
+    message->references = 1;  /* server->current 持有的參考 */
+
+    tl_push_release(server->current);
+    server->current = message;
+    server->state = state;
+    server->sequence = sequence;
+
+    for (i = 0; i < TL_PUSH_MAX_CLIENTS; i++) {
+        client = server->clients[i];
+        if (client == NULL || !client->subscribed) {
+            continue;
+        }
+        /* 尚未開始送出的舊狀態直接被取代 */
+        if (client->latest != NULL) {
+            tl_push_release(client->latest);
+            compacted++;
+        }
+        client->latest = message;
+        message->references++;
+    }
+
+    tl_mutex_lock(server->lock);
+    server->stats.broadcasts++;
+    server->stats.compacted += compacted;
+    tl_mutex_unlock(server->lock);
+    return TL_TRUE;
+}
+
+/*
+ * 推播執行緒
+ */
+static void tl_push_main(void* arg)
+{
+    TL_PushServer* server = (TL_PushServer*)arg;
+    TL_SocketPoll* items = server->items;
+    TL_PushClient* client;
+    TL_TowerState state;
+    TL_BOOL stopping;
+    TL_BOOL accepting;
+    unsigned long long now_us;
+    long received;
+    int i;
+
+    for (;;) {
+        tl_mutex_lock(server->lock);
+        stopping = server->stopping;
+        tl_mutex_unlock(server->lock);
+        if (stopping) {
+            break;
+        }
+
+        /* 先取出喚醒資料再讀取狀態，之後的改變一定會再次喚醒 */
+        tl_socket_wake_clear(server->wake);
+        state = tl_atomic_load_u32(&server->device->current_state);
+        if (state != server->state) {
+            tl_push_broadcast(server, state);
+        }
+
+        items[0].socket = server->wake;
+        items[0].events = TL_SOCKET_READABLE;
+        now_us = tl_time_now_us();
+        /* 無法接受的連線留在佇列中，監聽通訊端一直可讀取，暫停期間不輪詢以免空轉 */
+        accepting = (now_us >= server->accept_resume_us) ? TL_TRUE : TL_FALSE;
+        items[1].socket = accepting ? server->listener : NULL;
+        items[1].events = TL_SOCKET_READABLE;
+        for (i = 0; i < TL_PUSH_MAX_CLIENTS; i++) {
+            client = server->clients[i];
+            items[i + 2].socket = NULL;
+            if (client == NULL) {
+                continue;
+            }
+            if (!client->subscribed && client->control_length == 0 &&
+                now_us - client->accept_us > TL_PUSH_HANDSHAKE_MS * 1000ULL) {
+                tl_push_drop(server, i);
+                continue;
+            }
+            /* 有新的狀態時先嘗試直接送出，送不完才等待可寫入 */
+            if (!tl_push_flush(server, client)) {
+                tl_push_drop(server, i);
+                continue;
+            }
+            /* 輸入緩衝區已滿 (控制訊框的回應尚未送出) 時暫停讀取 */
+            items[i + 2].socket = client->socket;
+            items[i + 2].events = (client->input_length < sizeof(client->input) - 1) ? TL_SOCKET_READABLE : 0;
+            if (client->control_length != 0 || client->sending != NULL ||
+                (client->subscribed && client->latest != NULL)) {
+                items[i + 2].events |= TL_SOCKET_WRITABLE;
+            }
+        }
+
+        if (tl_socket_poll(items, TL_PUSH_MAX_CLIENTS + 2,
+                           accepting ? TL_PUSH_POLL_MS : TL_PUSH_ACCEPT_RETRY_MS) <= 0) {
+            continue;
+        }
+        if (items[1].revents != 0 && tl_push_accept(server) == 0) {
+            server->accept_resume_us = tl_time_now_us() + TL_PUSH_ACCEPT_RETRY_MS * 1000ULL;
+        }
+
+        for (i = 0; i < TL_PUSH_MAX_CLIENTS; i++) {
+            client = server->clients[i];
+            if (client == NULL || items[i + 2].socket != client->socket || items[i + 2].revents == 0) {
+                continue;
+            }
+
+            received = 0;
+            if ((items[i + 2].revents & (TL_SOCKET_READABLE | TL_SOCKET_CLOSED)) &&
+                client->input_length < sizeof(client->input) - 1) {
+                received = tl_socket_recv(client->socket, client->input + client->input_length,
+                                          sizeof(client->input) - 1 - client->input_length);
+                if (received > 0) {
+                    client->input_length += (size_t)received;
+                }
+            }
+            if (received >= 0 && !client->subscribed && client->control_length == 0) {
+                tl_push_handshake(server, client);
+            }
+            if (received >= 0 && client->subscribed && !tl_push_read_frames(client)) {
+                received = -1;
+            }
+            if (received < 0 || !tl_push_flush(server, client)) {
+                tl_push_drop(server, i);
+            }
+        }
+    }
+
+    for (i = 0; i < TL_PUSH_MAX_CLIENTS; i++) {
+        if (server->clients[i] != NULL) {
+            tl_push_drop(server, i);
+        }
+    }
+}
+
+/*
+ * 釋放推播伺服器
+ */
+static void tl_push_free(TL_PushServer* server)
+{
+    tl_push_release(server->current);
+    tl_socket_close(server->listener);
+    tl_socket_close(server->wake);
+    tl_mutex_destroy(server->lock);
+    free(server->clients);
+    free(server->items);
+    free(server);
+}
+
+/*
+ * 通知推播伺服器裝置的狀態已改變
+ */
+void tl_push_note(TL_DeviceContext* device)
+{
+    TL_PushServer* server;
+
+    /* 沒有推播伺服器時不需加鎖 */
+    if (tl_atomic_load_ptr((void* volatile*)&device->push_server) == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(device->state_lock);
+    server = device->push_server;
+    if (server != NULL) {
+        tl_socket_wake(server->wake);
+    }
+    tl_mutex_unlock(device->state_lock);
+}
+
+/*
+ * 停止狀態推播伺服器
+ */
+void tl_push_stop(TL_DeviceContext* device)
+{
+    TL_PushServer* server;
+
+    tl_mutex_lock(device->state_lock);
+    server = device->push_server;
+    tl_atomic_exchange_ptr((void* volatile*)&device->push_server, NULL);
+    tl_mutex_unlock(device->state_lock);
+
+    if (server == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(server->lock);
+    server->stopping = TL_TRUE;
+    tl_mutex_unlock(server->lock);
+    tl_socket_wake(server->wake);
+
+    tl_thread_join(server->thread);
+    tl_push_free(server);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_push_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 啟動狀態推播伺服器
+ */
+TL_ERROR_CODE TL_StartPushServer(TL_DEVICE_HANDLE device, const char* address, unsigned short port)
+{
+    TL_DeviceContext* context;
+    TL_PushServer* server;
+    TL_ERROR_CODE result;
+    unsigned short local_port;
+
+    result = tl_push_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 已啟動時先停止，以新的位址重新監聽 */
+    tl_push_stop(context);
+
+    server = (TL_PushServer*)calloc(1, sizeof(TL_PushServer));
+    if (server == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    server->device = context;
+    server->lock = tl_mutex_create();
+    server->wake = tl_socket_wake_create();
+    server->clients = (TL_PushClient**)calloc(TL_PUSH_MAX_CLIENTS, sizeof(TL_PushClient*));
+    server->items = (TL_SocketPoll*)calloc(TL_PUSH_MAX_CLIENTS + 2, sizeof(TL_SocketPoll));
+    if (server->lock == NULL || server->wake == NULL || server->clients == NULL || server->items == NULL ||
+        !tl_push_broadcast(server, tl_atomic_load_u32(&context->current_state))) {
+        tl_push_free(server);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    memset(&server->stats, 0, sizeof(server->stats));
+
+    result = tl_socket_listen(address, port, &server->listener);
+    if (result != TL_SUCCESS) {
+        tl_push_free(server);
+        tl_set_last_error(result);
+        return result;
+    }
+    local_port = tl_socket_local_port(server->listener);
+    server->stats.port = local_port;
+
+    tl_mutex_lock(context->state_lock);
+    if (context->closing) {
+        /* 裝置同時被關閉，關閉時的停止已經執行過，伺服器不可再使用此裝置 */
+        tl_mutex_unlock(context->state_lock);
+        tl_push_free(server);
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+    if (context->push_server != NULL) {
+        /* 其他執行緒同時啟動了伺服器 */
+        tl_mutex_unlock(context->state_lock);
+        tl_push_free(server);
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+    server->thread = tl_thread_create(tl_push_main, server);
+    if (server->thread == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        tl_push_free(server);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    tl_atomic_exchange_ptr((void* volatile*)&context->push_server, server);
+    tl_mutex_unlock(context->state_lock);
+
+    /* 釋放 state_lock 後伺服器可能已被停止，不再存取 */
+#ifdef BUILD_TEST_EXE
+    printf("[TL_StartPushServer] 監聽 %s:%u\n", (address != NULL) ? address : "*", local_port);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止狀態推播伺服器
+ */
+TL_ERROR_CODE TL_StopPushServer(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_push_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_push_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得狀態推播伺服器統計
+ */
+TL_ERROR_CODE TL_GetPushStats(TL_DEVICE_HANDLE device, TL_PushStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_PushServer* server;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_push_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    server = context->push_server;
+    if (server != NULL) {
+        tl_mutex_lock(server->lock);
+        *stats = server->stats;
+        tl_mutex_unlock(server->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
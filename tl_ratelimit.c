@@ -0,0 +1,617 @@
+﻿/*
+ * tl_ratelimit.c
+ *
+ * 塔燈通訊控制函式庫 - 命令速率限制與吞吐量校準實現
+ *
+ * 塔燈韌體能持續處理的命令速率未知，送得太快會被拒絕 (NACK) 或逾時。
+ * 每台裝置可設定一個權杖桶，一般命令送出前須取得權杖；權杖以整數計算，
+ * 單位為百萬分之一個權杖，補充量即為經過的微秒數乘以每秒速率。
+ * 校準以狀態讀取命令量測裝置的往返時間、各管線深度的吞吐量與延遲拐點，
+ * 並可直接以結果設定權杖桶。拐點以開環負載量測：依固定間隔寫出命令而不等待回應，
+ * 由另一個執行緒同時接收，因此送出速率可超過往返時間允許的速率，
+ * 裝置跟不上時延遲上升或開始拒絕命令。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 一個權杖的單位數 */
+#define TL_RATE_TOKEN  1000000ULL
+
+/* 校準參數 */
+#define TL_CALIBRATE_DEFAULT_DEPTH   16     /* 預設的最大管線深度 */
+#define TL_CALIBRATE_BASE_ROUNDS     16     /* 量測往返時間的輪數 */
+#define TL_CALIBRATE_STEP_COMMANDS   64     /* 每個量測步驟至少送出的命令數 */
+#define TL_CALIBRATE_MIN_GAIN_PCT    5      /* 加深管線後吞吐量至少增加的百分比 */
+#define TL_CALIBRATE_KNEE_PCT        150    /* 延遲超過低負載時的此百分比即視為拐點 */
+#define TL_CALIBRATE_LOAD_MS         40     /* 開環負載每個速率步驟的時間 (毫秒) */
+#define TL_CALIBRATE_LOAD_MIN        32     /* 每個速率步驟至少送出的命令數 */
+#define TL_CALIBRATE_LOAD_MAX        256    /* 每個速率步驟最多送出的命令數 */
+#define TL_CALIBRATE_RAMP_PCT        125    /* 每個速率步驟為前一步的此百分比 */
+#define TL_CALIBRATE_RAMP_STEPS      24     /* 速率爬升的最多步驟數 */
+#define TL_CALIBRATE_REFINE_STEPS    3      /* 爬升停止後二分拐點的步驟數 */
+#define TL_CALIBRATE_RATE_TRIES      3      /* 每個速率未通過時的嘗試次數 */
+
+/* 開環負載的一個速率步驟，由送出命令的執行緒與接收執行緒共用 */
+typedef struct {
+    TL_DeviceContext* device;
+    TL_Mutex* lock;                           /* 保護以下欄位 */
+    TL_Cond* changed;                         /* 寫出新的命令或停止寫出 */
+    unsigned long long sent_us[TL_CALIBRATE_LOAD_MAX];      /* 各命令的寫出時間 */
+    unsigned long long latency_us[TL_CALIBRATE_LOAD_MAX];   /* 確認命令的往返時間 */
+    unsigned int written;                     /* 已寫出的命令數 */
+    TL_BOOL writing;                          /* 仍在寫出 */
+    TL_BOOL failed;                           /* 接收逾時或讀取失敗，停止寫出 */
+    unsigned int acked;                       /* 確認的命令數 */
+    unsigned int nacked;                      /* 被拒絕的命令數 */
+    unsigned long long last_us;               /* 最後一個回應的到達時間 */
+} TL_CalibrateLoad;
+
+/*
+ * 補充權杖 (須持有 lane_lock)
+ */
+static void tl_rate_refill_locked(TL_DeviceContext* device, unsigned long long now_us)
+{
+    unsigned long long capacity = (unsigned long long)device->rate_stats.burst * TL_RATE_TOKEN;
+
+    if (now_us > device->rate_refill_us) {
+        device->rate_tokens += (now_us - device->rate_refill_us) * device->rate_stats.rate_per_sec;
+        if (device->rate_tokens > capacity) {
+            device->rate_tokens = capacity;
+        }
+    }
+    device->rate_refill_us = now_us;
+}
+
+/*
+ * 取得送出一個一般命令的權杖
+ */
+void tl_rate_acquire(TL_DeviceContext* device)
+{
+    unsigned long long start_us = 0;
+    unsigned long long now_us;
+    unsigned long long wait_us;
+
+    tl_mutex_lock(device->lane_lock);
+    for (;;) {
+        if (device->rate_stats.rate_per_sec == 0) {
+            break;
+        }
+
+        now_us = tl_time_now_us();
+        tl_rate_refill_locked(device, now_us);
+        if (device->rate_tokens >= TL_RATE_TOKEN) {
+            device->rate_tokens -= TL_RATE_TOKEN;
+            break;
+        }
+
+        /* 等到補足一個權杖；設定改變或緊急命令結束時也會被喚醒，重新計算即可 */
+        if (start_us == 0) {
+            start_us = now_us;
+            device->rate_stats.throttled_count++;
+        }
+        wait_us = (TL_RATE_TOKEN - device->rate_tokens + device->rate_stats.rate_per_sec - 1) /
+                  device->rate_stats.rate_per_sec;
+        tl_cond_wait(device->lane_changed, device->lane_lock, (unsigned long)((wait_us + 999) / 1000));
+    }
+
+    if (start_us != 0) {
+        wait_us = tl_time_now_us() - start_us;
+        device->rate_stats.total_wait_us += wait_us;
+        if (wait_us > device->rate_stats.max_wait_us) {
+            device->rate_stats.max_wait_us = wait_us;
+        }
+    }
+    tl_mutex_unlock(device->lane_lock);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_rate_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 設定裝置的命令速率上限
+ */
+TL_ERROR_CODE TL_SetRateLimit(TL_DEVICE_HANDLE device, unsigned long rate_per_sec, unsigned long burst)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_rate_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    if (burst == 0) {
+        burst = 1;
+    }
+
+    /* 新的設定以滿桶開始 */
+    tl_mutex_lock(context->lane_lock);
+    context->rate_stats.rate_per_sec = rate_per_sec;
+    context->rate_stats.burst = burst;
+    context->rate_tokens = (unsigned long long)burst * TL_RATE_TOKEN;
+    context->rate_refill_us = tl_time_now_us();
+    tl_cond_broadcast(context->lane_changed);
+    tl_mutex_unlock(context->lane_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_SetRateLimit] %lu 命令/秒, 連續 %lu 個\n", rate_per_sec, burst);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得命令速率限制統計
+ */
+TL_ERROR_CODE TL_GetRateLimitStats(TL_DEVICE_HANDLE device, TL_RateLimitStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_rate_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->lane_lock);
+    *stats = context->rate_stats;
+    tl_mutex_unlock(context->lane_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 校準的一輪：連續寫出 depth 個狀態讀取命令，再依序接收回應
+ *
+ * 各輪之間釋放 io_lock，讓其他命令可以穿插執行。
+ */
+static TL_ERROR_CODE tl_calibrate_round(TL_DeviceContext* device, const TL_BYTE* command, size_t command_length,
+                                        unsigned int depth, unsigned long long* latency_us,
+                                        TL_CalibrationResult* result)
+{
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE error = TL_SUCCESS;
+    unsigned long long start_us;
+    unsigned long timeout_ms;
+    unsigned int written = 0;
+    unsigned int i;
+
+    tl_mutex_lock(device->io_lock);
+    timeout_ms = tl_rtt_timeout_ms(device);
+    start_us = tl_time_now_us();
+
+    for (i = 0; i < depth && error == TL_SUCCESS; i++) {
+        error = tl_usb_write_data(device, TL_PIPE_ID, command, command_length, timeout_ms);
+        if (error == TL_SUCCESS) {
+            written++;
+        }
+    }
+    for (i = 0; i < written; i++) {
+        error = tl_cmd_receive_response(device, response, TL_MAX_BUFFER_SIZE, &response_length, timeout_ms);
+        if (error == TL_SUCCESS) {
+            error = tl_cmd_check_response_format(response, response_length);
+        }
+        if (error != TL_SUCCESS) {
+            /* 丟棄其餘的回應，避免下一個命令讀到過期的回應 */
+            tl_usb_resync(device);
+            break;
+        }
+    }
+
+    *latency_us = tl_time_now_us() - start_us;
+    tl_mutex_unlock(device->io_lock);
+
+    result->commands += written;
+    if (error != TL_SUCCESS) {
+        result->errors++;
+#ifdef BUILD_TEST_EXE
+        printf("[TL_CalibrateDevice] 深度 %u 發生錯誤 => %d\n", depth, (int)error);
+#endif
+    }
+    return error;
+}
+
+/*
+ * 以指定的深度連續量測多輪
+ *
+ * 返回每輪的平均往返時間與實際吞吐量。
+ */
+static TL_ERROR_CODE tl_calibrate_step(TL_DeviceContext* device, const TL_BYTE* command, size_t command_length,
+                                       unsigned int depth, unsigned long long* mean_latency_us,
+                                       unsigned long* throughput, TL_CalibrationResult* result)
+{
+    unsigned int rounds = (TL_CALIBRATE_STEP_COMMANDS + depth - 1) / depth;
+    unsigned long long total_latency_us = 0;
+    unsigned long long latency_us;
+    unsigned long long start_us;
+    unsigned long long elapsed_us;
+    TL_ERROR_CODE error;
+    unsigned int i;
+
+    start_us = tl_time_now_us();
+    for (i = 0; i < rounds; i++) {
+        error = tl_calibrate_round(device, command, command_length, depth, &latency_us, result);
+        if (error != TL_SUCCESS) {
+            return error;
+        }
+        total_latency_us += latency_us;
+    }
+
+    elapsed_us = tl_time_now_us() - start_us;
+    *mean_latency_us = total_latency_us / rounds;
+    *throughput = (unsigned long)((unsigned long long)rounds * depth * 1000000ULL / (elapsed_us ? elapsed_us : 1));
+    return TL_SUCCESS;
+}
+
+/*
+ * 比較兩個往返時間 (qsort 用)
+ */
+static int tl_calibrate_compare_latency(const void* a, const void* b)
+{
+    unsigned long long left = *(const unsigned long long*)a;
+    unsigned long long right = *(const unsigned long long*)b;
+
+    return (left > right) - (left < right);
+}
+
+/*
+ * 開環負載的接收執行緒
+ *
+ * 塔燈依序回應，第 n 個回應屬於第 n 個寫出的命令。期限從寫出時間或
+ * 前一個回應到達時間 (取較晚者) 起算；逾時或讀取失敗時停止。
+ */
+static void tl_calibrate_load_reader(void* arg)
+{
+    TL_CalibrateLoad* load = (TL_CalibrateLoad*)arg;
+    TL_BYTE response[TL_MAX_BUFFER_SIZE];
+    size_t response_length;
+    TL_ERROR_CODE error;
+    unsigned long long sent_us;
+    unsigned long long start_us;
+    unsigned long long now_us;
+    unsigned long long timeout_us;
+    unsigned long long elapsed_us;
+    unsigned int received = 0;
+
+    tl_mutex_lock(load->lock);
+    for (;;) {
+        while (received == load->written && load->writing) {
+            tl_cond_wait(load->changed, load->lock, TL_WAIT_INFINITE);
+        }
+        if (received == load->written) {
+            break;
+        }
+        sent_us = load->sent_us[received];
+        start_us = (sent_us > load->last_us) ? sent_us : load->last_us;
+        tl_mutex_unlock(load->lock);
+
+        timeout_us = (unsigned long long)tl_rtt_timeout_ms(load->device) * 1000;
+        elapsed_us = tl_time_now_us() - start_us;
+        error = tl_cmd_receive_response(load->device, response, sizeof(response), &response_length,
+                                        (elapsed_us >= timeout_us) ? 1 : (unsigned long)((timeout_us - elapsed_us + 999) / 1000));
+        if (error == TL_SUCCESS) {
+            error = tl_cmd_check_response_format(response, response_length);
+        }
+        now_us = tl_time_now_us();
+
+        tl_mutex_lock(load->lock);
+        if (error == TL_SUCCESS) {
+            load->latency_us[load->acked++] = now_us - sent_us;
+        } else if (error == TL_ERROR_RESPONSE_NACK) {
+            load->nacked++;
+        } else {
+            load->failed = TL_TRUE;
+            break;
+        }
+        load->last_us = now_us;
+        received++;
+    }
+    tl_mutex_unlock(load->lock);
+}
+
+/*
+ * 以固定的送出速率開環量測一個步驟
+ *
+ * 依固定間隔寫出狀態讀取命令而不等待回應，回應由接收執行緒同時讀取。
+ * 整個步驟持有 io_lock。返回實際的送出速率、確認命令往返時間的中位數
+ * (不受個別執行緒排程延誤影響)、被拒絕或遺失的命令數與實際吞吐量；
+ * 回應逾時返回 TL_ERROR_TIMEOUT。
+ */
+static TL_ERROR_CODE tl_calibrate_load(TL_DeviceContext* device, const TL_BYTE* command, size_t command_length,
+                                       unsigned long rate_per_sec, unsigned long* offered,
+                                       unsigned long long* median_latency_us, unsigned int* rejected,
+                                       unsigned long* throughput, TL_CalibrationResult* result)
+{
+    TL_CalibrateLoad load;
+    TL_Thread* reader;
+    TL_ERROR_CODE error = TL_SUCCESS;
+    unsigned long long interval_us = 1000000ULL / rate_per_sec;
+    unsigned long long start_us;
+    unsigned long long next_us;
+    unsigned long long now_us;
+    unsigned long long count;
+    unsigned long timeout_ms;
+    TL_BOOL failed = TL_FALSE;
+    unsigned int i;
+
+    /* 每個步驟約 TL_CALIBRATE_LOAD_MS，命令數限制在上下限之間 */
+    count = (unsigned long long)rate_per_sec * TL_CALIBRATE_LOAD_MS / 1000;
+    if (count < TL_CALIBRATE_LOAD_MIN) {
+        count = TL_CALIBRATE_LOAD_MIN;
+    } else if (count > TL_CALIBRATE_LOAD_MAX) {
+        count = TL_CALIBRATE_LOAD_MAX;
+    }
+
+    memset(&load, 0, sizeof(load));
+    load.device = device;
+    load.writing = TL_TRUE;
+    load.lock = tl_mutex_create();
+    load.changed = tl_cond_create();
+    if (load.lock == NULL || load.changed == NULL) {
+        tl_cond_destroy(load.changed);
+        tl_mutex_destroy(load.lock);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    tl_mutex_lock(device->io_lock);
+    reader = tl_thread_create(tl_calibrate_load_reader, &load);
+    if (reader == NULL) {
+        tl_mutex_unlock(device->io_lock);
+        tl_cond_destroy(load.changed);
+        tl_mutex_destroy(load.lock);
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+
+    timeout_ms = tl_rtt_timeout_ms(device);
+    start_us = tl_time_now_us();
+    next_us = start_us;
+    for (i = 0; i < count && !failed; i++) {
+        /* 較長的等待以睡眠，不足 2ms 時讓出處理器，以保持間隔的精度 */
+        now_us = tl_time_now_us();
+        while (now_us < next_us) {
+            tl_delay_ms((next_us - now_us >= 2000) ? (unsigned long)((next_us - now_us) / 1000 - 1) : 0);
+            now_us = tl_time_now_us();
+        }
+        /* 落後超過一個間隔時不補送，避免排程延誤造成一陣連續寫出 */
+        if (now_us > next_us + interval_us) {
+            next_us = now_us;
+        }
+        next_us += interval_us;
+
+        error = tl_usb_write_data(device, TL_PIPE_ID, command, command_length, timeout_ms);
+        if (error != TL_SUCCESS) {
+            break;
+        }
+        tl_mutex_lock(load.lock);
+        load.sent_us[load.written++] = now_us;
+        failed = load.failed;
+        tl_cond_broadcast(load.changed);
+        tl_mutex_unlock(load.lock);
+    }
+
+    tl_mutex_lock(load.lock);
+    load.writing = TL_FALSE;
+    tl_cond_broadcast(load.changed);
+    tl_mutex_unlock(load.lock);
+    tl_thread_join(reader);
+
+    if (load.failed) {
+        /* 丟棄其餘的回應，避免下一個命令讀到過期的回應 */
+        tl_usb_resync(device);
+        if (error == TL_SUCCESS) {
+            error = TL_ERROR_TIMEOUT;
+        }
+    }
+    tl_mutex_unlock(device->io_lock);
+    tl_cond_destroy(load.changed);
+    tl_mutex_destroy(load.lock);
+
+    *offered = (load.written > 1 && load.sent_us[load.written - 1] > load.sent_us[0]) ?
+               (unsigned long)((unsigned long long)(load.written - 1) * 1000000ULL /
+                               (load.sent_us[load.written - 1] - load.sent_us[0])) : rate_per_sec;
+    *rejected = load.written - load.acked;
+    qsort(load.latency_us, load.acked, sizeof(load.latency_us[0]), tl_calibrate_compare_latency);
+    *median_latency_us = (load.acked > 0) ? load.latency_us[load.acked / 2] : 0;
+    *throughput = (load.last_us > start_us) ?
+                  (unsigned long)((unsigned long long)load.acked * 1000000ULL / (load.last_us - start_us)) : 0;
+    result->commands += load.written;
+    result->errors += *rejected;
+    return error;
+}
+
+/*
+ * 以開環負載試一個送出速率
+ *
+ * 未出現拒絕、逾時，實際送出速率達到目標的 75%，且延遲的中位數未超過第一個
+ * 通過步驟的 1.5 倍時，該速率仍在拐點之下，以實際的送出速率更新拐點。
+ * 本機明顯無法以該速率送出時也視為未通過，以免低估延遲。單一處理器或負載重
+ * 的主機上一次排程延誤就可能造成逾時或延遲突增，未通過時以相同速率再試，
+ * 每次都未通過才視為超過拐點。
+ * load_latency_us 為第一個通過步驟的延遲中位數，0 表示尚未量測。
+ */
+static TL_ERROR_CODE tl_calibrate_try_rate(TL_DeviceContext* device, const TL_BYTE* command, size_t command_length,
+                                           unsigned long rate, unsigned long long* load_latency_us,
+                                           TL_BOOL* below_knee, TL_CalibrationResult* result)
+{
+    TL_ERROR_CODE error = TL_SUCCESS;
+    unsigned long long latency_us = 0;
+    unsigned long throughput = 0;
+    unsigned long offered = 0;
+    unsigned int rejected;
+    unsigned int attempt;
+
+    *below_knee = TL_FALSE;
+    for (attempt = 0; attempt < TL_CALIBRATE_RATE_TRIES && !*below_knee; attempt++) {
+        error = tl_calibrate_load(device, command, command_length, rate, &offered, &latency_us, &rejected,
+                                  &throughput, result);
+        if (error != TL_SUCCESS || rejected > 0 ||
+            (unsigned long long)offered * 100 < (unsigned long long)rate * 75) {
+            continue;
+        }
+        if (*load_latency_us != 0 && latency_us * 100 > *load_latency_us * TL_CALIBRATE_KNEE_PCT) {
+            continue;
+        }
+        *below_knee = TL_TRUE;
+    }
+    if (!*below_knee) {
+        return error;
+    }
+
+    if (*load_latency_us == 0) {
+        *load_latency_us = latency_us;
+    }
+    if (offered > result->knee_rate) {
+        result->knee_rate = offered;
+        result->knee_latency_us = (unsigned long)latency_us;
+    }
+    if (throughput > result->max_rate) {
+        result->max_rate = throughput;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 校準裝置的命令吞吐量
+ */
+TL_ERROR_CODE TL_CalibrateDevice(TL_DEVICE_HANDLE device, unsigned int max_depth, TL_BOOL apply,
+                                 TL_CalibrationResult* result)
+{
+    TL_DeviceContext* context;
+    TL_BYTE command[TL_MAX_BUFFER_SIZE];
+    size_t command_length;
+    TL_ERROR_CODE error;
+    unsigned long long latency_us;
+    unsigned long long load_latency_us = 0;
+    unsigned long long total_us = 0;
+    unsigned long throughput;
+    unsigned long rate;
+    unsigned long good_rate = 0;
+    unsigned long bad_rate = 0;
+    TL_BOOL below_knee = TL_FALSE;
+    unsigned int depth;
+    unsigned int i;
+
+    /* 參數驗證 */
+    if (result == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    memset(result, 0, sizeof(*result));
+
+    error = tl_rate_resolve(device, &context);
+    if (error != TL_SUCCESS) {
+        return error;
+    }
+
+    /* 非同步模式下回應管道由寫入引擎讀取，無法直接量測 */
+    if (context->async != NULL) {
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+
+    if (max_depth == 0) {
+        max_depth = TL_CALIBRATE_DEFAULT_DEPTH;
+    }
+    if (max_depth > TL_ASYNC_MAX_IN_FLIGHT) {
+        max_depth = TL_ASYNC_MAX_IN_FLIGHT;
+    }
+
+    command_length = tl_cmd_build_status_read_command(0, command, TL_MAX_BUFFER_SIZE);
+    if (command_length == 0) {
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+
+    /* 1. 單一命令的往返時間 */
+    for (i = 0; i < TL_CALIBRATE_BASE_ROUNDS; i++) {
+        error = tl_calibrate_round(context, command, command_length, 1, &latency_us, result);
+        if (error != TL_SUCCESS) {
+            return error;
+        }
+        total_us += latency_us;
+    }
+    result->base_latency_us = (unsigned long)(total_us / TL_CALIBRATE_BASE_ROUNDS);
+
+    /* 2. 加深管線直到吞吐量不再明顯增加或出現錯誤 */
+    for (depth = 1; depth <= max_depth; depth *= 2) {
+        if (tl_calibrate_step(context, command, command_length, depth,
+                              &latency_us, &throughput, result) != TL_SUCCESS) {
+            break;
+        }
+        if (result->best_depth != 0 &&
+            (unsigned long long)throughput * 100 < (unsigned long long)result->max_rate * (100 + TL_CALIBRATE_MIN_GAIN_PCT)) {
+            break;
+        }
+        result->max_rate = throughput;
+        result->best_depth = depth;
+    }
+    if (result->best_depth == 0) {
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+
+    /* 3. 從最高吞吐量的一半開始以開環負載逐步提高送出速率 (可超過上一步的最高吞吐量)，
+     *    直到某一步未通過 */
+    rate = (result->max_rate / 2 > 0) ? result->max_rate / 2 : 1;
+    for (i = 0; i < TL_CALIBRATE_RAMP_STEPS; i++) {
+        error = tl_calibrate_try_rate(context, command, command_length, rate, &load_latency_us, &below_knee, result);
+        if (error != TL_SUCCESS || !below_knee) {
+            bad_rate = rate;
+            break;
+        }
+        good_rate = rate;
+        rate = (unsigned long)((unsigned long long)rate * TL_CALIBRATE_RAMP_PCT / 100) + 1;
+    }
+
+    /* 4. 在最後通過與第一個未通過的速率之間二分，拐點的解析度由 25% 縮小到約 3%，
+     *    單一步驟因排程延誤被拒絕時也不會少估整個爬升步驟 */
+    for (i = 0; i < TL_CALIBRATE_REFINE_STEPS && error == TL_SUCCESS &&
+                good_rate != 0 && bad_rate > good_rate + 1; i++) {
+        rate = good_rate + (bad_rate - good_rate) / 2;
+        error = tl_calibrate_try_rate(context, command, command_length, rate, &load_latency_us, &below_knee, result);
+        if (below_knee) {
+            good_rate = rate;
+        } else {
+            bad_rate = rate;
+        }
+    }
+    if (result->knee_rate == 0) {
+        result->knee_rate = (result->max_rate / 4 > 0) ? result->max_rate / 4 : 1;
+    }
+
+    result->recommended_rate = result->knee_rate * 9 / 10;
+    if (result->recommended_rate == 0) {
+        result->recommended_rate = 1;
+    }
+    result->recommended_burst = result->best_depth;
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_CalibrateDevice] 往返 %luus, 最高 %lu 命令/秒 (深度 %u), 拐點 %lu 命令/秒 (%luus) => 建議 %lu\n",
+           result->base_latency_us, result->max_rate, result->best_depth, result->knee_rate,
+           result->knee_latency_us, result->recommended_rate);
+#endif
+
+    if (apply) {
+        return TL_SetRateLimit(context, result->recommended_rate, result->recommended_burst);
+    }
+    return TL_SUCCESS;
+}
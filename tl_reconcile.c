@@ -0,0 +1,480 @@
+﻿/*
+ * tl_reconcile.c
+ *
+ * 塔燈通訊控制函式庫 - 期望狀態收斂實現
+ *
+ * 每台使用期望狀態的裝置有一個收斂執行緒，持續比對期望狀態與已確認狀態：
+ *   - 設定命令收到正確回應後，該目標視為已確認；
+ *   - 定期讀取裝置狀態，讀回的狀態與已確認狀態不同 (例如裝置重置、
+ *     被其他程式修改) 時以讀回的狀態為準，差異會再次送出設定；
+ *   - 只對不一致的目標送出設定命令；失敗時以指數退避重試。
+ * 收斂時間自出現差異起算，到所有目標一致為止。
+ *
+ * 期望狀態以壓縮字組存放於裝置的 desired_state，以比較並交換更新，
+ * 與已確認狀態的差異只需一次 XOR。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 期望狀態收斂器 */
+struct TL_Reconciler {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 期望狀態改變、收斂或停止 */
+    TL_Thread* thread;                /* 收斂執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    unsigned int waiters;             /* TL_WaitForConvergence 中的執行緒數，歸零後才可釋放 */
+    unsigned int desired_mask;        /* 已指定期望狀態的目標 */
+    TL_TowerState confirmed;          /* 已確認狀態 */
+    unsigned int confirmed_mask;      /* 已確認的目標 */
+    unsigned long long gap_start_us;  /* 開始出現差異的時間，0 表示已收斂 */
+    unsigned long long backoff_until_us;      /* 退避結束時間 */
+    unsigned long long next_verify_us;        /* 下次讀取狀態的時間 */
+    TL_ReconcileStats stats;          /* 統計 */
+};
+
+/*
+ * 記錄單一目標已確認的狀態 (須持有鎖)
+ */
+static void tl_reconcile_confirm_locked(TL_Reconciler* reconciler, int target, TL_TowerState state)
+{
+    TL_TowerState byte_mask = (TL_TowerState)0xFF << (target * 8);
+
+    reconciler->confirmed = (reconciler->confirmed & ~byte_mask) | (state & byte_mask);
+    reconciler->confirmed_mask |= 1u << target;
+}
+
+/*
+ * 計算尚未一致的目標 (須持有鎖)
+ */
+static unsigned int tl_reconcile_gap_locked(const TL_Reconciler* reconciler)
+{
+    TL_TowerState desired = tl_atomic_load_u32(&reconciler->device->desired_state);
+
+    return (TL_DiffTowerState(desired, reconciler->confirmed) | ~reconciler->confirmed_mask) &
+           reconciler->desired_mask;
+}
+
+/*
+ * 依目前差異更新收斂狀態與收斂時間 (須持有鎖)
+ */
+static void tl_reconcile_track_locked(TL_Reconciler* reconciler)
+{
+    unsigned int gap = tl_reconcile_gap_locked(reconciler);
+    unsigned long long elapsed_us;
+
+    reconciler->stats.pending_mask = gap;
+    reconciler->stats.converged = (gap == 0) ? TL_TRUE : TL_FALSE;
+
+    if (gap != 0 && reconciler->gap_start_us == 0) {
+        reconciler->gap_start_us = tl_time_now_us();
+    } else if (gap == 0 && reconciler->gap_start_us != 0) {
+        elapsed_us = tl_time_now_us() - reconciler->gap_start_us;
+        reconciler->gap_start_us = 0;
+        reconciler->stats.convergence_count++;
+        reconciler->stats.last_convergence_us = elapsed_us;
+        reconciler->stats.total_convergence_us += elapsed_us;
+        if (elapsed_us > reconciler->stats.max_convergence_us) {
+            reconciler->stats.max_convergence_us = elapsed_us;
+        }
+        tl_cond_broadcast(reconciler->changed);
+    }
+}
+
+/*
+ * 記錄一次錯誤並加倍退避時間 (須持有鎖)
+ */
+static void tl_reconcile_backoff_locked(TL_Reconciler* reconciler)
+{
+    unsigned long backoff_ms = reconciler->stats.backoff_ms;
+
+    backoff_ms = (backoff_ms == 0) ? TL_RECONCILE_BACKOFF_MIN_MS : backoff_ms * 2;
+    if (backoff_ms > TL_RECONCILE_BACKOFF_MAX_MS) {
+        backoff_ms = TL_RECONCILE_BACKOFF_MAX_MS;
+    }
+    reconciler->stats.command_failures++;
+    reconciler->stats.backoff_ms = backoff_ms;
+    reconciler->backoff_until_us = tl_time_now_us() + backoff_ms * 1000ULL;
+}
+
+/*
+ * 送出不一致目標的設定命令 (進入與離開時持有鎖)
+ */
+static void tl_reconcile_push_locked(TL_Reconciler* reconciler, unsigned int gap)
+{
+    TL_DeviceContext* device = reconciler->device;
+    TL_TowerState state = tl_atomic_load_u32(&device->desired_state);
+    TL_TowerFrame snapshot;
+    TL_ERROR_CODE result;
+    int target;
+
+    /* 期望狀態只經由 TL_PackTowerState 寫入，必定可還原 */
+    TL_UnpackTowerState(state, &snapshot);
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(gap & (1u << target))) {
+            continue;
+        }
+
+        tl_mutex_unlock(reconciler->lock);
+        if (target == TL_TARGET_BUZZER) {
+            result = TL_DeviceSetBuzzer(device, &snapshot.buzzer);
+        } else {
+            result = TL_DeviceSetLED(device, (TL_LAYER)target, &snapshot.layers[target]);
+        }
+        tl_mutex_lock(reconciler->lock);
+
+        if (result != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE
+            printf("[tl_reconcile] 目標 %d 設定失敗 => %d\n", target, (int)result);
+#endif
+            tl_reconcile_backoff_locked(reconciler);
+            return;
+        }
+
+        reconciler->stats.commands_sent++;
+        /* 回應正確即視為已確認；送出期間期望狀態改變時，確認的是送出的值 */
+        tl_reconcile_confirm_locked(reconciler, target, state);
+    }
+
+    reconciler->stats.backoff_ms = 0;
+    reconciler->backoff_until_us = 0;
+}
+
+/*
+ * 讀取期望狀態中各目標的實際狀態 (進入與離開時持有鎖)
+ */
+static void tl_reconcile_verify_locked(TL_Reconciler* reconciler)
+{
+    TL_DeviceContext* device = reconciler->device;
+    unsigned int mask = reconciler->desired_mask;
+    TL_TowerFrame actual;
+    TL_TowerState state;
+    TL_ERROR_CODE result;
+    int target;
+
+    memset(&actual, 0, sizeof(actual));
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(mask & (1u << target))) {
+            continue;
+        }
+
+        tl_mutex_unlock(reconciler->lock);
+        if (target == TL_TARGET_BUZZER) {
+            result = TL_DeviceGetBuzzerStatus(device, &actual.buzzer);
+        } else {
+            result = TL_DeviceGetLEDStatus(device, (TL_LAYER)target, &actual.layers[target]);
+        }
+        tl_mutex_lock(reconciler->lock);
+
+        if (result != TL_SUCCESS) {
+            tl_reconcile_backoff_locked(reconciler);
+            return;
+        }
+        reconciler->stats.verify_reads++;
+
+        if (target == TL_TARGET_BUZZER) {
+            state = tl_tower_state_encode_buzzer(&actual.buzzer);
+        } else {
+            state = tl_tower_state_encode_led(&actual.layers[target]);
+        }
+        state <<= target * 8;
+
+        /* 以讀回的狀態為準，與期望不同時會再次送出 */
+        if ((reconciler->confirmed_mask & (1u << target)) &&
+            (TL_DiffTowerState(state, reconciler->confirmed) & (1u << target))) {
+            reconciler->stats.drift_count++;
+#ifdef BUILD_TEST_EXE
+            printf("[tl_reconcile] 目標 %d 的狀態偏離已確認狀態\n", target);
+#endif
+        }
+        tl_reconcile_confirm_locked(reconciler, target, state);
+    }
+}
+
+/*
+ * 收斂執行緒
+ */
+static void tl_reconcile_main(void* arg)
+{
+    TL_Reconciler* reconciler = (TL_Reconciler*)arg;
+    unsigned long long now_us;
+    unsigned long long wake_us;
+    unsigned int gap;
+
+    tl_mutex_lock(reconciler->lock);
+    while (!reconciler->stopping) {
+        now_us = tl_time_now_us();
+        gap = tl_reconcile_gap_locked(reconciler);
+
+        if (gap != 0 && now_us >= reconciler->backoff_until_us) {
+            tl_reconcile_push_locked(reconciler, gap);
+            tl_reconcile_track_locked(reconciler);
+            continue;
+        }
+
+        if (reconciler->desired_mask != 0 && now_us >= reconciler->next_verify_us &&
+            now_us >= reconciler->backoff_until_us) {
+            reconciler->next_verify_us = now_us + TL_RECONCILE_VERIFY_INTERVAL_MS * 1000ULL;
+            tl_reconcile_verify_locked(reconciler);
+            tl_reconcile_track_locked(reconciler);
+            continue;
+        }
+
+        /* 等到退避結束 (有差異時) 或下次讀取狀態 */
+        if (reconciler->desired_mask == 0) {
+            tl_cond_wait(reconciler->changed, reconciler->lock, TL_WAIT_INFINITE);
+            continue;
+        }
+        wake_us = reconciler->next_verify_us;
+        if (gap != 0 && reconciler->backoff_until_us < wake_us) {
+            wake_us = reconciler->backoff_until_us;
+        }
+        tl_cond_wait(reconciler->changed, reconciler->lock,
+            (wake_us > now_us) ? (unsigned long)((wake_us - now_us + 999) / 1000) : 0);
+    }
+    tl_mutex_unlock(reconciler->lock);
+}
+
+/*
+ * 釋放收斂器
+ */
+static void tl_reconcile_free(TL_Reconciler* reconciler)
+{
+    tl_cond_destroy(reconciler->changed);
+    tl_mutex_destroy(reconciler->lock);
+    free(reconciler);
+}
+
+/*
+ * 取得裝置的收斂器，必要時建立 (須持有 state_lock；收斂器在釋放 state_lock 前不會被釋放)
+ */
+static TL_ERROR_CODE tl_reconcile_get_locked(TL_DeviceContext* device, TL_BOOL create, TL_Reconciler** result)
+{
+    TL_Reconciler* reconciler;
+
+    reconciler = device->reconciler;
+    if (reconciler == NULL && create) {
+        reconciler = (TL_Reconciler*)calloc(1, sizeof(TL_Reconciler));
+        if (reconciler != NULL) {
+            reconciler->device = device;
+            reconciler->lock = tl_mutex_create();
+            reconciler->changed = tl_cond_create();
+            if (reconciler->lock == NULL || reconciler->changed == NULL) {
+                tl_reconcile_free(reconciler);
+                reconciler = NULL;
+            } else {
+                reconciler->thread = tl_thread_create(tl_reconcile_main, reconciler);
+                if (reconciler->thread == NULL) {
+                    tl_reconcile_free(reconciler);
+                    reconciler = NULL;
+                }
+            }
+        }
+        if (reconciler == NULL) {
+            tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+        device->reconciler = reconciler;
+    }
+
+    *result = reconciler;
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止期望狀態收斂器
+ */
+void tl_reconcile_stop(TL_DeviceContext* device)
+{
+    TL_Reconciler* reconciler;
+
+    tl_mutex_lock(device->state_lock);
+    reconciler = device->reconciler;
+    device->reconciler = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (reconciler == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(reconciler->lock);
+    reconciler->stopping = TL_TRUE;
+    tl_cond_broadcast(reconciler->changed);
+    tl_mutex_unlock(reconciler->lock);
+
+    tl_thread_join(reconciler->thread);
+
+    /* 等待 TL_WaitForConvergence 中的執行緒離開 */
+    tl_mutex_lock(reconciler->lock);
+    while (reconciler->waiters > 0) {
+        tl_cond_wait(reconciler->changed, reconciler->lock, TL_WAIT_INFINITE);
+    }
+    tl_mutex_unlock(reconciler->lock);
+    tl_reconcile_free(reconciler);
+
+    /* 清除期望狀態 */
+    tl_tower_state_merge(&device->desired_state, 0, TL_FRAME_ALL);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_reconcile_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 設定裝置的期望狀態
+ */
+TL_ERROR_CODE TL_SetDesiredState(TL_DEVICE_HANDLE device, const TL_TowerFrame* desired)
+{
+    TL_DeviceContext* context;
+    TL_Reconciler* reconciler;
+    TL_TowerState state;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 (壓縮時一併檢查狀態值是否有效) */
+    if (desired == NULL || (desired->target_mask & ~(unsigned int)TL_FRAME_ALL) != 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    result = TL_PackTowerState(desired, &state);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    result = tl_reconcile_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 持有 state_lock 期間收斂器不會被 tl_reconcile_stop 釋放 */
+    tl_mutex_lock(context->state_lock);
+    result = tl_reconcile_get_locked(context, TL_TRUE, &reconciler);
+    if (result != TL_SUCCESS) {
+        tl_mutex_unlock(context->state_lock);
+        return result;
+    }
+
+    /* 期望狀態不需加鎖即可更新，收斂器的鎖只用於喚醒收斂執行緒 */
+    tl_tower_state_merge(&context->desired_state, state, desired->target_mask);
+
+    tl_mutex_lock(reconciler->lock);
+    reconciler->desired_mask |= desired->target_mask;
+    tl_reconcile_track_locked(reconciler);
+    tl_cond_broadcast(reconciler->changed);
+    tl_mutex_unlock(reconciler->lock);
+    tl_mutex_unlock(context->state_lock);
+
+    tl_journal_note(context, TL_TRUE, desired->target_mask);
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止裝置的期望狀態收斂
+ */
+TL_ERROR_CODE TL_StopReconcile(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_reconcile_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_reconcile_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 等待裝置收斂到期望狀態
+ */
+TL_ERROR_CODE TL_WaitForConvergence(TL_DEVICE_HANDLE device, unsigned long timeout_ms)
+{
+    TL_DeviceContext* context;
+    TL_Reconciler* reconciler;
+    TL_ERROR_CODE result;
+    unsigned long long deadline_us;
+    unsigned long long now_us;
+
+    result = tl_reconcile_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    /* 登記為等待者後才釋放 state_lock，tl_reconcile_stop 會等到等待者離開才釋放收斂器 */
+    tl_mutex_lock(context->state_lock);
+    reconciler = context->reconciler;
+    /* 未設定期望狀態時視為已收斂 */
+    if (reconciler == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        return TL_SUCCESS;
+    }
+    tl_mutex_lock(reconciler->lock);
+    reconciler->waiters++;
+    tl_mutex_unlock(context->state_lock);
+
+    deadline_us = tl_time_now_us() + (unsigned long long)timeout_ms * 1000;
+    result = TL_SUCCESS;
+    while (!reconciler->stopping && tl_reconcile_gap_locked(reconciler) != 0) {
+        now_us = tl_time_now_us();
+        if (now_us >= deadline_us) {
+            result = TL_ERROR_TIMEOUT;
+            break;
+        }
+        tl_cond_wait(reconciler->changed, reconciler->lock, (unsigned long)((deadline_us - now_us + 999) / 1000));
+    }
+    reconciler->waiters--;
+    if (reconciler->waiters == 0 && reconciler->stopping) {
+        tl_cond_broadcast(reconciler->changed);
+    }
+    tl_mutex_unlock(reconciler->lock);
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/*
+ * 取得期望狀態收斂統計
+ */
+TL_ERROR_CODE TL_GetReconcileStats(TL_DEVICE_HANDLE device, TL_ReconcileStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_Reconciler* reconciler;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_reconcile_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    reconciler = context->reconciler;
+    if (reconciler == NULL) {
+        stats->converged = TL_TRUE;
+    } else {
+        tl_mutex_lock(reconciler->lock);
+        *stats = reconciler->stats;
+        tl_mutex_unlock(reconciler->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
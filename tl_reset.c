@@ -0,0 +1,338 @@
+﻿/*
+ * tl_reset.c
+ *
+ * 塔燈通訊控制函式庫 - 裝置重置偵測與狀態還原實現
+ *
+ * 塔燈短暫斷電後會以全部關閉的狀態重新啟動，影子狀態卻仍記錄著最後的設定。
+ * 偵測方式：
+ *   - 狀態讀取：讀回的目標為關閉而影子狀態為點亮 (或鳴響) 時，讀取其他
+ *     點亮的目標；全部都讀回關閉才判定為重置，避免單一目標被其他程式
+ *     修改時誤判。整座塔燈的快照已包含所有目標，直接判定，不再讀取；
+ *   - USB重新列舉：同步模式下命令的寫入或讀取失敗時，依裝置介面路徑重新開啟
+ *     同一台裝置；通訊恢復後同樣讀取點亮的目標，全部讀回關閉才判定為重置
+ *     (短暫的傳輸錯誤不會失去狀態，不計為重置)。
+ * 判定為重置後，以一次連續寫出重新送出影子狀態中的所有目標。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 目前執行緒是否正在確認重置 (確認時的讀取不再觸發檢查) */
+static TL_THREAD_LOCAL int g_reset_probing = 0;
+
+/*
+ * LED是否點亮
+ */
+static TL_BOOL tl_reset_led_lit(const TL_LEDStatus* status)
+{
+    if (status->pattern == TL_LED_PATTERN_OFF) {
+        return TL_FALSE;
+    }
+    return (status->red_status != TL_LED_OFF || status->green_status != TL_LED_OFF ||
+            status->blue_status != TL_LED_OFF) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 讀回的目標是否為關閉 (或停止鳴響)
+ */
+static TL_BOOL tl_reset_target_dark(int target, const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer)
+{
+    if (target == TL_TARGET_BUZZER) {
+        return (buzzer != NULL && buzzer->pattern == TL_BUZZER_PATTERN_OFF) ? TL_TRUE : TL_FALSE;
+    }
+    return (led != NULL && !tl_reset_led_lit(led)) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 影子狀態中點亮 (或鳴響) 的目標 (須持有 state_lock)
+ */
+static unsigned int tl_reset_active_targets_locked(const TL_DeviceContext* device)
+{
+    unsigned int mask = 0;
+    int target;
+
+    for (target = 0; target < TL_TARGET_BUZZER; target++) {
+        if ((device->shadow.valid_mask & (1u << target)) && tl_reset_led_lit(&device->shadow.led[target])) {
+            mask |= 1u << target;
+        }
+    }
+    if ((device->shadow.valid_mask & (1u << TL_TARGET_BUZZER)) &&
+        device->shadow.buzzer.pattern != TL_BUZZER_PATTERN_OFF) {
+        mask |= 1u << TL_TARGET_BUZZER;
+    }
+    return mask;
+}
+
+/*
+ * 讀取目標並判斷是否為關閉 (io_locked 表示呼叫端已持有 io_lock)
+ */
+static TL_ERROR_CODE tl_reset_read_dark(TL_DeviceContext* device, int target, TL_BOOL io_locked, TL_BOOL* dark)
+{
+    TL_LEDStatus led;
+    TL_BuzzerStatus buzzer;
+    TL_ERROR_CODE result;
+
+    g_reset_probing++;
+    if (io_locked) {
+        result = tl_cmd_read_status_locked(device, target, &led, &buzzer);
+    } else if (target == TL_TARGET_BUZZER) {
+        result = TL_DeviceGetBuzzerStatus(device, &buzzer);
+    } else {
+        result = TL_DeviceGetLEDStatus(device, (TL_LAYER)target, &led);
+    }
+    g_reset_probing--;
+
+    *dark = (result == TL_SUCCESS && tl_reset_target_dark(target, &led, &buzzer)) ? TL_TRUE : TL_FALSE;
+    return result;
+}
+
+/*
+ * 以影子狀態建構要重新送出的畫面
+ */
+static TL_ERROR_CODE tl_reset_prepare_restore(TL_DeviceContext* device, TL_PreparedFrame* prepared)
+{
+    TL_TowerFrame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    tl_mutex_lock(device->state_lock);
+    memcpy(frame.layers, device->shadow.led, sizeof(frame.layers));
+    frame.buzzer = device->shadow.buzzer;
+    frame.target_mask = device->shadow.valid_mask;
+    tl_mutex_unlock(device->state_lock);
+
+    return tl_cmd_prepare_frame(&frame, prepared);
+}
+
+/*
+ * 記錄重置並重新送出影子狀態
+ */
+static TL_ERROR_CODE tl_reset_restore(TL_DeviceContext* device, unsigned long long detect_us,
+                                      TL_BOOL reenumerated, TL_BOOL io_locked)
+{
+    TL_PreparedFrame prepared;
+    TL_ERROR_CODE result;
+    unsigned long long elapsed_us;
+    int target;
+
+    result = tl_reset_prepare_restore(device, &prepared);
+    if (result == TL_SUCCESS) {
+        result = tl_cmd_restore_frame(device, &prepared, io_locked);
+    }
+    elapsed_us = tl_time_now_us() - detect_us;
+
+    /* 重新送出的狀態即為裝置目前的狀態 */
+    if (result == TL_SUCCESS) {
+        for (target = 0; target < TL_TARGET_COUNT; target++) {
+            if (prepared.lengths[target] != 0) {
+                tl_tower_state_note(device, target, &prepared.frame.layers[target < TL_TARGET_BUZZER ? target : 0],
+                                    &prepared.frame.buzzer);
+            }
+        }
+    }
+
+    tl_mutex_lock(device->state_lock);
+    device->reset_stats.reset_count++;
+    if (reenumerated) {
+        device->reset_stats.reenumeration_count++;
+    }
+    if (result == TL_SUCCESS) {
+        device->reset_stats.restore_count++;
+        device->reset_stats.last_restore_us = elapsed_us;
+        device->reset_stats.total_restore_us += elapsed_us;
+        if (elapsed_us > device->reset_stats.max_restore_us) {
+            device->reset_stats.max_restore_us = elapsed_us;
+        }
+    } else {
+        device->reset_stats.restore_failures++;
+    }
+    tl_mutex_unlock(device->state_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[tl_reset_restore] 偵測到裝置重置 (%s)，還原 %lluus => %d\n",
+           reenumerated ? "重新列舉" : "狀態讀取", elapsed_us, (int)result);
+#endif
+    return result;
+}
+
+/*
+ * 確認點亮的目標是否全部讀回關閉
+ */
+static TL_ERROR_CODE tl_reset_probe(TL_DeviceContext* device, unsigned int targets, TL_BOOL io_locked,
+                                    TL_BOOL* all_dark)
+{
+    TL_ERROR_CODE result;
+    TL_BOOL dark;
+    int target;
+
+    *all_dark = TL_FALSE;
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(targets & (1u << target))) {
+            continue;
+        }
+        result = tl_reset_read_dark(device, target, io_locked, &dark);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        if (!dark) {
+            return TL_SUCCESS;
+        }
+    }
+    *all_dark = TL_TRUE;
+    return TL_SUCCESS;
+}
+
+/*
+ * 依讀回的狀態檢查裝置是否曾經重置
+ */
+void tl_reset_note_read(TL_DeviceContext* device, int target,
+                        const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer)
+{
+    unsigned long long detect_us;
+    unsigned int active;
+    TL_BOOL all_dark;
+
+    /* 讀回點亮的狀態不可能是重置造成的 */
+    if (g_reset_probing || !tl_reset_target_dark(target, led, buzzer)) {
+        return;
+    }
+
+    detect_us = tl_time_now_us();
+    tl_mutex_lock(device->state_lock);
+    active = tl_reset_active_targets_locked(device);
+    tl_mutex_unlock(device->state_lock);
+    if (!(active & (1u << target))) {
+        return;
+    }
+
+    /* 確認其他點亮的目標也都已關閉 */
+    if (tl_reset_probe(device, active & ~(1u << target), TL_FALSE, &all_dark) != TL_SUCCESS || !all_dark) {
+        return;
+    }
+
+    tl_reset_restore(device, detect_us, TL_FALSE, TL_FALSE);
+}
+
+/*
+ * 依整座塔燈的快照檢查裝置是否曾經重置
+ */
+void tl_reset_note_snapshot(TL_DeviceContext* device, const TL_TowerFrame* status)
+{
+    unsigned long long detect_us = tl_time_now_us();
+    unsigned int active;
+    int target;
+
+    if (g_reset_probing) {
+        return;
+    }
+
+    tl_mutex_lock(device->state_lock);
+    active = tl_reset_active_targets_locked(device);
+    tl_mutex_unlock(device->state_lock);
+    if (active == 0) {
+        return;
+    }
+
+    /* 快照已包含所有目標：任一點亮的目標讀回仍點亮即不是重置 */
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if ((active & (1u << target)) &&
+            !tl_reset_target_dark(target, &status->layers[target < TL_TARGET_BUZZER ? target : 0], &status->buzzer)) {
+            return;
+        }
+    }
+
+    tl_reset_restore(device, detect_us, TL_FALSE, TL_FALSE);
+}
+
+/*
+ * 命令往返的USB寫入或讀取失敗時嘗試恢復 (呼叫端持有 io_lock)
+ */
+TL_BOOL tl_reset_on_io_failure(TL_DeviceContext* device)
+{
+    unsigned long long detect_us = tl_time_now_us();
+    unsigned int active;
+    TL_BOOL all_dark;
+
+    if (tl_usb_reopen_device(device) != TL_SUCCESS) {
+        return TL_FALSE;
+    }
+
+    /* 重新開啟成功只表示通訊恢復；點亮的目標全部讀回關閉才是塔燈失去了狀態 */
+    tl_mutex_lock(device->state_lock);
+    active = tl_reset_active_targets_locked(device);
+    tl_mutex_unlock(device->state_lock);
+    if (active != 0 && tl_reset_probe(device, active, TL_TRUE, &all_dark) == TL_SUCCESS && all_dark) {
+        tl_reset_restore(device, detect_us, TL_TRUE, TL_TRUE);
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 檢查裝置是否曾經重置
+ */
+TL_ERROR_CODE TL_CheckDeviceReset(TL_DEVICE_HANDLE device, TL_BOOL* reset_detected)
+{
+    TL_DeviceContext* context = (device != NULL) ? device : tl_get_default_device();
+    unsigned long long detect_us;
+    unsigned int active;
+    TL_ERROR_CODE result;
+    TL_BOOL all_dark;
+
+    if (reset_detected != NULL) {
+        *reset_detected = TL_FALSE;
+    }
+
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    detect_us = tl_time_now_us();
+    tl_mutex_lock(context->state_lock);
+    active = tl_reset_active_targets_locked(context);
+    tl_mutex_unlock(context->state_lock);
+
+    /* 沒有點亮的目標時無從判斷，也不需要還原 */
+    if (active == 0) {
+        return TL_SUCCESS;
+    }
+
+    result = tl_reset_probe(context, active, TL_FALSE, &all_dark);
+    if (result != TL_SUCCESS || !all_dark) {
+        return result;
+    }
+
+    if (reset_detected != NULL) {
+        *reset_detected = TL_TRUE;
+    }
+    return tl_reset_restore(context, detect_us, TL_FALSE, TL_FALSE);
+}
+
+/*
+ * 取得裝置重置偵測統計
+ */
+TL_ERROR_CODE TL_GetResetStats(TL_DEVICE_HANDLE device, TL_ResetStats* stats)
+{
+    TL_DeviceContext* context = (device != NULL) ? device : tl_get_default_device();
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    *stats = context->reset_stats;
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
@@ -0,0 +1,251 @@
+﻿/*
+ * tl_rtt.c
+ *
+ * 塔燈通訊控制函式庫 - 自適應逾時實現
+ *
+ * 本檔案依量測的命令往返時間估計讀取逾時 (RFC 6298 演算法)：
+ *   RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|
+ *   SRTT   = 7/8 * SRTT   + 1/8 * R
+ *   RTO    = SRTT + max(G, 4 * RTTVAR)，並限制在下限與上限之間
+ * 健康的塔燈約 1~2 毫秒即回應，無回應的裝置可在數十毫秒內判定逾時，
+ * 不必每次等待固定的 TL_READ_TIMEOUT。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 計時粒度 G (微秒) */
+#define TL_RTO_GRANULARITY_US  1000
+
+/*
+ * 初始化往返時間估計器
+ */
+void tl_rtt_init(TL_RttEstimator* rtt)
+{
+    memset(rtt, 0, sizeof(*rtt));
+    rtt->min_timeout_ms = TL_RTO_DEFAULT_MIN_MS;
+    rtt->max_timeout_ms = TL_READ_TIMEOUT;
+    rtt->retry_on_timeout = TL_TRUE;
+}
+
+/*
+ * 取得目前的讀取逾時時間 (須持有 state_lock)
+ */
+static unsigned long tl_rtt_timeout_locked(const TL_RttEstimator* rtt)
+{
+    unsigned long long rto_us;
+    long long variance;
+
+    if (!rtt->has_sample) {
+        /* 尚無樣本時使用初始值 */
+        rto_us = (unsigned long long)TL_READ_TIMEOUT * 1000;
+    } else {
+        variance = 4 * rtt->rttvar_us;
+        if (variance < TL_RTO_GRANULARITY_US) {
+            variance = TL_RTO_GRANULARITY_US;
+        }
+        rto_us = (unsigned long long)(rtt->srtt_us + variance);
+    }
+
+    rto_us <<= rtt->backoff_shift;
+
+    /* 無條件進位至毫秒並限制範圍 */
+    rto_us = (rto_us + 999) / 1000;
+    if (rto_us < rtt->min_timeout_ms) {
+        rto_us = rtt->min_timeout_ms;
+    }
+    if (rto_us > rtt->max_timeout_ms) {
+        rto_us = rtt->max_timeout_ms;
+    }
+    return (unsigned long)rto_us;
+}
+
+/*
+ * 加入一筆往返時間樣本
+ */
+void tl_rtt_add_sample(TL_DeviceContext* device, unsigned long long sample_us)
+{
+    TL_RttEstimator* rtt = &device->rtt;
+    long long r = (long long)sample_us;
+    long long delta;
+
+    tl_mutex_lock(device->state_lock);
+    if (!rtt->has_sample) {
+        /* 第一個樣本 */
+        rtt->srtt_us = r;
+        rtt->rttvar_us = r / 2;
+        rtt->has_sample = TL_TRUE;
+    } else {
+        delta = r - rtt->srtt_us;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        rtt->rttvar_us += (delta - rtt->rttvar_us) / 4;
+        rtt->srtt_us += (r - rtt->srtt_us) / 8;
+    }
+
+    /* 收到有效回應即解除退避 */
+    rtt->backoff_shift = 0;
+    rtt->sample_count++;
+    tl_mutex_unlock(device->state_lock);
+}
+
+/*
+ * 記錄一次逾時並加倍下一次的逾時時間
+ */
+void tl_rtt_on_timeout(TL_DeviceContext* device)
+{
+    tl_mutex_lock(device->state_lock);
+    device->rtt.timeout_count++;
+    if (device->rtt.backoff_shift < TL_RTO_MAX_BACKOFF_SHIFT) {
+        device->rtt.backoff_shift++;
+    }
+    tl_mutex_unlock(device->state_lock);
+}
+
+/*
+ * 判斷逾時後是否重試
+ */
+TL_BOOL tl_rtt_begin_retry(TL_DeviceContext* device)
+{
+    TL_BOOL retry;
+
+    tl_mutex_lock(device->state_lock);
+    retry = device->rtt.retry_on_timeout;
+    if (retry) {
+        device->rtt.retry_count++;
+    }
+    tl_mutex_unlock(device->state_lock);
+    return retry;
+}
+
+/*
+ * 記錄一次重試後成功
+ */
+void tl_rtt_on_recovered(TL_DeviceContext* device)
+{
+    tl_mutex_lock(device->state_lock);
+    device->rtt.recovered_count++;
+    tl_mutex_unlock(device->state_lock);
+}
+
+/*
+ * 取得目前的讀取逾時時間
+ */
+unsigned long tl_rtt_timeout_ms(TL_DeviceContext* device)
+{
+    unsigned long timeout_ms;
+
+    tl_mutex_lock(device->state_lock);
+    timeout_ms = tl_rtt_timeout_locked(&device->rtt);
+    tl_mutex_unlock(device->state_lock);
+    return timeout_ms;
+}
+
+/*
+ * 解析目標裝置
+ *
+ * NULL 表示預設裝置，其設定在開啟前即可修改，之後由 TL_OpenDevice 開啟的裝置沿用。
+ */
+static TL_ERROR_CODE tl_rtt_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    if (device == NULL) {
+        if (!tl_get_internal_state()->is_initialized) {
+            tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+            return TL_ERROR_NOT_INITIALIZED;
+        }
+        *resolved = tl_get_default_device();
+        return TL_SUCCESS;
+    }
+    *resolved = device;
+    return tl_validate_device(device);
+}
+
+/*
+ * 設定逾時參數
+ */
+TL_ERROR_CODE TL_SetTimeoutConfig(TL_DEVICE_HANDLE device, const TL_TimeoutConfig* config)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (config == NULL || config->min_timeout_ms == 0 ||
+        config->min_timeout_ms > config->max_timeout_ms) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_rtt_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    context->rtt.min_timeout_ms = config->min_timeout_ms;
+    context->rtt.max_timeout_ms = config->max_timeout_ms;
+    context->rtt.retry_on_timeout = config->retry_on_timeout ? TL_TRUE : TL_FALSE;
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得逾時參數
+ */
+TL_ERROR_CODE TL_GetTimeoutConfig(TL_DEVICE_HANDLE device, TL_TimeoutConfig* config)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    if (config == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_rtt_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    config->min_timeout_ms = context->rtt.min_timeout_ms;
+    config->max_timeout_ms = context->rtt.max_timeout_ms;
+    config->retry_on_timeout = context->rtt.retry_on_timeout;
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得往返時間統計
+ */
+TL_ERROR_CODE TL_GetRttStats(TL_DEVICE_HANDLE device, TL_RttStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_rtt_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    stats->srtt_us = (unsigned long)context->rtt.srtt_us;
+    stats->rttvar_us = (unsigned long)context->rtt.rttvar_us;
+    stats->timeout_ms = tl_rtt_timeout_locked(&context->rtt);
+    stats->sample_count = context->rtt.sample_count;
+    stats->timeout_count = context->rtt.timeout_count;
+    stats->retry_count = context->rtt.retry_count;
+    stats->recovered_count = context->rtt.recovered_count;
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
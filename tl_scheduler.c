@@ -0,0 +1,638 @@
+﻿/*
+ * tl_scheduler.c
+ *
+ * 塔燈通訊控制函式庫 - 排程命令實現
+ *
+ * 以階層式時間輪 (hierarchical timing wheel) 管理排程命令，時間刻度為1毫秒：
+ *   第0層 256 格，每格1刻度      (涵蓋 256 毫秒)
+ *   第1層  64 格，每格 2^8 刻度   (涵蓋約 16 秒)
+ *   第2層  64 格，每格 2^14 刻度  (涵蓋約 17 分鐘)
+ *   第3層  64 格，每格 2^20 刻度  (涵蓋約 18 小時，更遠的排程到期前會再重新放置)
+ * 第0層每轉一圈時，把上一層對應格子裡的排程重新放入較低的層級。
+ * 新增與取消都只是雙向串列的插入與移除，為 O(1)；每格的串列頭節點的 prev
+ * 指向尾端節點，附加到尾端不需走訪串列。排程節點放在以索引相連的陣列中，
+ * 排程識別碼由索引與世代數組成，可直接找到節點。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 時間輪參數 */
+#define TL_WHEEL_ROOT_BITS   8
+#define TL_WHEEL_LEVEL_BITS  6
+#define TL_WHEEL_ROOT_SIZE   (1 << TL_WHEEL_ROOT_BITS)
+#define TL_WHEEL_LEVEL_SIZE  (1 << TL_WHEEL_LEVEL_BITS)
+#define TL_WHEEL_UPPER_LEVELS 3
+#define TL_WHEEL_MAX_DELTA   ((1ULL << (TL_WHEEL_ROOT_BITS + TL_WHEEL_UPPER_LEVELS * TL_WHEEL_LEVEL_BITS)) - 1)
+
+/* 節點陣列的初始大小 */
+#define TL_TIMER_INITIAL_CAPACITY  64
+
+/* 空串列 */
+#define TL_TIMER_NIL  (-1)
+
+/* 排程節點狀態 */
+typedef enum {
+    TL_TIMER_FREE = 0,   /* 未使用 */
+    TL_TIMER_PENDING,    /* 在時間輪中等待 */
+    TL_TIMER_FIRING      /* 已到期，等待執行 */
+} TL_TIMER_STATE;
+
+/* 排程節點 */
+typedef struct {
+    TL_TIMER_STATE state;             /* 狀態 */
+    unsigned int generation;          /* 世代數，節點重複使用時遞增 */
+    int prev;                         /* 同一格中的前一個節點 (串列頭指向尾端節點) */
+    int next;                         /* 同一格中的下一個節點 (或閒置串列) */
+    int* slot;                        /* 所在格子的串列頭 */
+    unsigned long long expires;       /* 到期刻度 */
+    TL_TowerCommand command;          /* 要執行的命令 */
+    TL_ScheduleCallback callback;     /* 完成回呼 */
+    void* user_data;                  /* 回呼的使用者資料 */
+} TL_TimerNode;
+
+/* 排程器狀態 */
+typedef struct {
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 新增排程或停止 */
+    TL_Cond* idle;                    /* 執行中的排程結束 */
+    TL_Thread* thread;                /* 排程執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_TimerNode* nodes;              /* 節點陣列 */
+    int capacity;                     /* 節點陣列大小 */
+    int free_list;                    /* 閒置節點串列 */
+    size_t pending_count;             /* 等待中的排程數 */
+    int firing_head;                  /* 已到期、等待執行的排程串列 */
+    const void* running_target;       /* 執行中的排程的裝置或群組，NULL 表示沒有 */
+    unsigned long long current_tick;  /* 下一個要處理的刻度 */
+    int root[TL_WHEEL_ROOT_SIZE];                             /* 第0層 */
+    int upper[TL_WHEEL_UPPER_LEVELS][TL_WHEEL_LEVEL_SIZE];    /* 第1~3層 */
+} TL_Scheduler;
+
+static TL_Scheduler g_scheduler;
+
+/*
+ * 取得目前的刻度 (毫秒)
+ */
+static unsigned long long tl_sched_now_tick(void)
+{
+    return tl_time_now_us() / 1000;
+}
+
+/*
+ * 組合與拆解排程識別碼
+ */
+static TL_TIMER_ID tl_sched_make_id(int index, unsigned int generation)
+{
+    return ((TL_TIMER_ID)generation << 32) | (TL_TIMER_ID)(unsigned int)(index + 1);
+}
+
+static int tl_sched_id_index(TL_TIMER_ID id)
+{
+    return (int)(id & 0xFFFFFFFFULL) - 1;
+}
+
+/*
+ * 從所在格子移除節點
+ */
+static void tl_sched_unlink(int index)
+{
+    TL_TimerNode* node = &g_scheduler.nodes[index];
+    int head = *node->slot;
+
+    if (index == head) {
+        *node->slot = node->next;
+        if (node->next != TL_TIMER_NIL) {
+            g_scheduler.nodes[node->next].prev = node->prev;
+        }
+    } else {
+        g_scheduler.nodes[node->prev].next = node->next;
+        if (node->next != TL_TIMER_NIL) {
+            g_scheduler.nodes[node->next].prev = node->prev;
+        } else {
+            g_scheduler.nodes[head].prev = node->prev;
+        }
+    }
+    node->prev = TL_TIMER_NIL;
+    node->next = TL_TIMER_NIL;
+    node->slot = NULL;
+}
+
+/*
+ * 依到期刻度把節點放入對應的格子 (附加在串列尾端以維持相同刻度的先後順序)
+ */
+static void tl_sched_place(int index)
+{
+    TL_TimerNode* node = &g_scheduler.nodes[index];
+    unsigned long long expires = node->expires;
+    unsigned long long delta;
+    unsigned int shift;
+    int level;
+    int* slot;
+    int tail;
+
+    /* 已過期的排程放在下一個要處理的刻度 */
+    if (expires < g_scheduler.current_tick) {
+        expires = g_scheduler.current_tick;
+    }
+    delta = expires - g_scheduler.current_tick;
+
+    /* 超出時間輪範圍時先放在最遠的位置，屆時再重新放置 */
+    if (delta > TL_WHEEL_MAX_DELTA) {
+        delta = TL_WHEEL_MAX_DELTA;
+        expires = g_scheduler.current_tick + delta;
+    }
+
+    if (delta < TL_WHEEL_ROOT_SIZE) {
+        slot = &g_scheduler.root[expires & (TL_WHEEL_ROOT_SIZE - 1)];
+    } else {
+        slot = NULL;
+        for (level = 0; level < TL_WHEEL_UPPER_LEVELS; level++) {
+            shift = TL_WHEEL_ROOT_BITS + (unsigned int)level * TL_WHEEL_LEVEL_BITS;
+            if (delta < (1ULL << (shift + TL_WHEEL_LEVEL_BITS))) {
+                slot = &g_scheduler.upper[level][(expires >> shift) & (TL_WHEEL_LEVEL_SIZE - 1)];
+                break;
+            }
+        }
+    }
+
+    /* 附加到串列尾端 (串列頭的 prev 即尾端) */
+    node->slot = slot;
+    node->next = TL_TIMER_NIL;
+    if (*slot == TL_TIMER_NIL) {
+        node->prev = index;
+        *slot = index;
+    } else {
+        tail = g_scheduler.nodes[*slot].prev;
+        g_scheduler.nodes[tail].next = index;
+        node->prev = tail;
+        g_scheduler.nodes[*slot].prev = index;
+    }
+}
+
+/*
+ * 將上層格子中的排程重新放入較低的層級
+ */
+static void tl_sched_cascade(int* slot)
+{
+    int index = *slot;
+    int next;
+
+    *slot = TL_TIMER_NIL;
+    while (index != TL_TIMER_NIL) {
+        next = g_scheduler.nodes[index].next;
+        g_scheduler.nodes[index].prev = TL_TIMER_NIL;
+        g_scheduler.nodes[index].next = TL_TIMER_NIL;
+        tl_sched_place(index);
+        index = next;
+    }
+}
+
+/*
+ * 取得一個閒置節點，必要時擴充節點陣列
+ *
+ * 返回值：節點索引，TL_TIMER_NIL 表示記憶體不足
+ */
+static int tl_sched_alloc_node(void)
+{
+    TL_TimerNode* nodes;
+    int capacity;
+    int index;
+    int i;
+
+    if (g_scheduler.free_list == TL_TIMER_NIL) {
+        capacity = (g_scheduler.capacity == 0) ? TL_TIMER_INITIAL_CAPACITY : g_scheduler.capacity * 2;
+        nodes = (TL_TimerNode*)realloc(g_scheduler.nodes, (size_t)capacity * sizeof(TL_TimerNode));
+        if (nodes == NULL) {
+            return TL_TIMER_NIL;
+        }
+        memset(&nodes[g_scheduler.capacity], 0,
+            (size_t)(capacity - g_scheduler.capacity) * sizeof(TL_TimerNode));
+        for (i = capacity - 1; i >= g_scheduler.capacity; i--) {
+            nodes[i].next = g_scheduler.free_list;
+            g_scheduler.free_list = i;
+        }
+        g_scheduler.nodes = nodes;
+        g_scheduler.capacity = capacity;
+    }
+
+    index = g_scheduler.free_list;
+    g_scheduler.free_list = g_scheduler.nodes[index].next;
+    return index;
+}
+
+/*
+ * 歸還節點
+ */
+static void tl_sched_free_node(int index)
+{
+    TL_TimerNode* node = &g_scheduler.nodes[index];
+
+    node->state = TL_TIMER_FREE;
+    node->generation++;
+    node->next = g_scheduler.free_list;
+    g_scheduler.free_list = index;
+}
+
+/*
+ * 推進時間輪至 now_tick，把到期的排程移到 firing 串列
+ */
+static void tl_sched_advance(unsigned long long now_tick, int* firing_head, int* firing_tail)
+{
+    unsigned long long tick;
+    unsigned int shift;
+    int level;
+    int* slot;
+    int index;
+    int next;
+
+    while (g_scheduler.current_tick <= now_tick) {
+        tick = g_scheduler.current_tick;
+
+        /* 第0層轉完一圈時，依序從上層重新放置 */
+        if ((tick & (TL_WHEEL_ROOT_SIZE - 1)) == 0) {
+            for (level = 0; level < TL_WHEEL_UPPER_LEVELS; level++) {
+                shift = TL_WHEEL_ROOT_BITS + (unsigned int)level * TL_WHEEL_LEVEL_BITS;
+                tl_sched_cascade(&g_scheduler.upper[level][(tick >> shift) & (TL_WHEEL_LEVEL_SIZE - 1)]);
+                if (((tick >> shift) & (TL_WHEEL_LEVEL_SIZE - 1)) != 0) {
+                    break;
+                }
+            }
+        }
+
+        /* 取出本刻度的排程；尚未真正到期的 (超出範圍時被截短) 重新放置 */
+        slot = &g_scheduler.root[tick & (TL_WHEEL_ROOT_SIZE - 1)];
+        index = *slot;
+        *slot = TL_TIMER_NIL;
+        g_scheduler.current_tick = tick + 1;
+        while (index != TL_TIMER_NIL) {
+            TL_TimerNode* node = &g_scheduler.nodes[index];
+
+            next = node->next;
+            node->prev = TL_TIMER_NIL;
+            node->next = TL_TIMER_NIL;
+            if (node->expires > tick) {
+                tl_sched_place(index);
+            } else {
+                node->state = TL_TIMER_FIRING;
+                node->slot = NULL;
+                g_scheduler.pending_count--;
+                if (*firing_tail == TL_TIMER_NIL) {
+                    *firing_head = index;
+                } else {
+                    g_scheduler.nodes[*firing_tail].next = index;
+                }
+                *firing_tail = index;
+            }
+            index = next;
+        }
+    }
+}
+
+/*
+ * 計算距離下一個可能到期的刻度的等待時間 (毫秒)
+ */
+static unsigned long tl_sched_next_wait_ms(void)
+{
+    unsigned long long tick = g_scheduler.current_tick;
+    unsigned long long now_tick = tl_sched_now_tick();
+    unsigned long offset;
+
+    if (g_scheduler.pending_count == 0) {
+        return TL_WAIT_INFINITE;
+    }
+
+    /* 在第0層尋找下一個非空的格子；都空時等到下一次重新放置 */
+    for (offset = 0; offset < TL_WHEEL_ROOT_SIZE; offset++) {
+        if (g_scheduler.root[(tick + offset) & (TL_WHEEL_ROOT_SIZE - 1)] != TL_TIMER_NIL) {
+            break;
+        }
+        if (((tick + offset + 1) & (TL_WHEEL_ROOT_SIZE - 1)) == 0) {
+            offset++;
+            break;
+        }
+    }
+
+    if (tick + offset <= now_tick) {
+        return 0;
+    }
+    return (unsigned long)(tick + offset - now_tick);
+}
+
+/*
+ * 取得命令的目標 (裝置或群組)，NULL 的裝置表示預設裝置
+ */
+static const void* tl_sched_command_target(const TL_TowerCommand* command)
+{
+    if (command->type == TL_COMMAND_GROUP_FRAME) {
+        return command->group;
+    }
+    return (command->device != NULL) ? (const void*)command->device : (const void*)tl_get_default_device();
+}
+
+/*
+ * 排程執行緒
+ */
+static void tl_sched_thread_main(void* arg)
+{
+    TL_TowerCommand command;
+    TL_ScheduleCallback callback;
+    void* user_data;
+    TL_TIMER_ID id;
+    TL_ERROR_CODE result;
+    unsigned long wait_ms;
+    int firing_tail;
+    int index;
+
+    (void)arg;
+
+    tl_mutex_lock(g_scheduler.lock);
+    while (!g_scheduler.stopping) {
+        g_scheduler.firing_head = TL_TIMER_NIL;
+        firing_tail = TL_TIMER_NIL;
+        tl_sched_advance(tl_sched_now_tick(), &g_scheduler.firing_head, &firing_tail);
+
+        /*
+         * 依到期順序交給事件提交系統的工作執行緒執行，排程執行緒不等待往返，
+         * 無回應的塔燈不會延遲其他排程；到期串列放在排程器中，關閉裝置時可移除
+         * 尚未提交的排程，提交期間以 running_target 讓關閉裝置等待
+         */
+        while (g_scheduler.firing_head != TL_TIMER_NIL && !g_scheduler.stopping) {
+            index = g_scheduler.firing_head;
+            g_scheduler.firing_head = g_scheduler.nodes[index].next;
+
+            command = g_scheduler.nodes[index].command;
+            callback = g_scheduler.nodes[index].callback;
+            user_data = g_scheduler.nodes[index].user_data;
+            id = tl_sched_make_id(index, g_scheduler.nodes[index].generation);
+            tl_sched_free_node(index);
+            g_scheduler.running_target = tl_sched_command_target(&command);
+
+            tl_mutex_unlock(g_scheduler.lock);
+            result = tl_events_submit_scheduled(&command, id, callback, user_data);
+            tl_mutex_lock(g_scheduler.lock);
+            g_scheduler.running_target = NULL;
+            tl_cond_broadcast(g_scheduler.idle);
+
+            /* 無法提交時在此通知；回呼不會存取裝置，可在其中關閉裝置 */
+            if (result != TL_SUCCESS && callback != NULL) {
+                tl_mutex_unlock(g_scheduler.lock);
+                callback(id, result, user_data);
+                tl_mutex_lock(g_scheduler.lock);
+            }
+        }
+
+        /* 停止時尚未執行的到期排程直接捨棄 */
+        while (g_scheduler.firing_head != TL_TIMER_NIL) {
+            index = g_scheduler.firing_head;
+            g_scheduler.firing_head = g_scheduler.nodes[index].next;
+            tl_sched_free_node(index);
+        }
+        if (g_scheduler.stopping) {
+            break;
+        }
+
+        wait_ms = tl_sched_next_wait_ms();
+        if (wait_ms > 0) {
+            tl_cond_wait(g_scheduler.changed, g_scheduler.lock, wait_ms);
+        }
+    }
+    tl_mutex_unlock(g_scheduler.lock);
+}
+
+/*
+ * 初始化排程器
+ */
+TL_ERROR_CODE tl_scheduler_init(void)
+{
+    int i;
+
+    memset(&g_scheduler, 0, sizeof(g_scheduler));
+    g_scheduler.free_list = TL_TIMER_NIL;
+    g_scheduler.firing_head = TL_TIMER_NIL;
+    for (i = 0; i < TL_WHEEL_ROOT_SIZE; i++) {
+        g_scheduler.root[i] = TL_TIMER_NIL;
+    }
+    for (i = 0; i < TL_WHEEL_UPPER_LEVELS * TL_WHEEL_LEVEL_SIZE; i++) {
+        g_scheduler.upper[i / TL_WHEEL_LEVEL_SIZE][i % TL_WHEEL_LEVEL_SIZE] = TL_TIMER_NIL;
+    }
+
+    g_scheduler.lock = tl_mutex_create();
+    g_scheduler.changed = tl_cond_create();
+    g_scheduler.idle = tl_cond_create();
+    if (g_scheduler.lock == NULL || g_scheduler.changed == NULL || g_scheduler.idle == NULL) {
+        tl_cond_destroy(g_scheduler.idle);
+        tl_cond_destroy(g_scheduler.changed);
+        tl_mutex_destroy(g_scheduler.lock);
+        g_scheduler.idle = NULL;
+        g_scheduler.changed = NULL;
+        g_scheduler.lock = NULL;
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉排程器
+ */
+void tl_scheduler_shutdown(void)
+{
+    if (g_scheduler.lock == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(g_scheduler.lock);
+    g_scheduler.stopping = TL_TRUE;
+    tl_cond_broadcast(g_scheduler.changed);
+    tl_mutex_unlock(g_scheduler.lock);
+
+    tl_thread_join(g_scheduler.thread);
+    tl_cond_destroy(g_scheduler.idle);
+    tl_cond_destroy(g_scheduler.changed);
+    tl_mutex_destroy(g_scheduler.lock);
+    free(g_scheduler.nodes);
+    memset(&g_scheduler, 0, sizeof(g_scheduler));
+}
+
+/*
+ * 在指定時間執行塔燈命令
+ */
+TL_ERROR_CODE TL_ScheduleAt(unsigned long long time_ms, const TL_TowerCommand* command,
+                            TL_ScheduleCallback callback, void* user_data, TL_TIMER_ID* id)
+{
+    TL_TimerNode* node;
+    int index;
+
+    /* 參數驗證 */
+    if (command == NULL || command->type < TL_COMMAND_SET_LED || command->type > TL_COMMAND_GROUP_FRAME) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (id != NULL) {
+        *id = 0;
+    }
+
+    if (g_scheduler.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_scheduler.lock);
+
+    /* 時間輪為空時直接對齊目前時間，避免執行緒閒置後逐刻度追趕 */
+    if (g_scheduler.pending_count == 0) {
+        g_scheduler.current_tick = tl_sched_now_tick();
+    }
+
+    /* 第一次排程時建立排程執行緒 */
+    if (g_scheduler.thread == NULL) {
+        g_scheduler.thread = tl_thread_create(tl_sched_thread_main, NULL);
+        if (g_scheduler.thread == NULL) {
+            tl_mutex_unlock(g_scheduler.lock);
+            tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    index = tl_sched_alloc_node();
+    if (index == TL_TIMER_NIL) {
+        tl_mutex_unlock(g_scheduler.lock);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    node = &g_scheduler.nodes[index];
+    node->state = TL_TIMER_PENDING;
+    node->expires = time_ms;
+    node->command = *command;
+    node->callback = callback;
+    node->user_data = user_data;
+    tl_sched_place(index);
+    g_scheduler.pending_count++;
+
+    if (id != NULL) {
+        *id = tl_sched_make_id(index, node->generation);
+    }
+
+    /* 喚醒排程執行緒重新計算等待時間 */
+    tl_cond_signal(g_scheduler.changed);
+    tl_mutex_unlock(g_scheduler.lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 在指定延遲後執行塔燈命令
+ */
+TL_ERROR_CODE TL_ScheduleAfter(unsigned long delay_ms, const TL_TowerCommand* command,
+                               TL_ScheduleCallback callback, void* user_data, TL_TIMER_ID* id)
+{
+    return TL_ScheduleAt(tl_sched_now_tick() + delay_ms, command, callback, user_data, id);
+}
+
+/*
+ * 取消尚未執行的排程
+ */
+TL_ERROR_CODE TL_CancelScheduled(TL_TIMER_ID id)
+{
+    TL_TimerNode* node;
+    int index = tl_sched_id_index(id);
+
+    if (g_scheduler.lock == NULL) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    tl_mutex_lock(g_scheduler.lock);
+    if (id == 0 || index < 0 || index >= g_scheduler.capacity) {
+        tl_mutex_unlock(g_scheduler.lock);
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 世代數不同表示節點已重複使用 */
+    node = &g_scheduler.nodes[index];
+    if (node->state != TL_TIMER_PENDING || node->generation != (unsigned int)(id >> 32)) {
+        tl_mutex_unlock(g_scheduler.lock);
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    tl_sched_unlink(index);
+    tl_sched_free_node(index);
+    g_scheduler.pending_count--;
+    tl_mutex_unlock(g_scheduler.lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取消指定裝置或群組的排程
+ */
+void tl_scheduler_cancel_target(const void* target)
+{
+    TL_TimerNode* node;
+    TL_ScheduleCallback callback;
+    void* user_data;
+    TL_TIMER_ID id;
+    int cancelled = TL_TIMER_NIL;
+    int* link;
+    int index;
+
+    if (g_scheduler.lock == NULL || target == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(g_scheduler.lock);
+
+    /* 時間輪中等待的排程 */
+    for (index = 0; index < g_scheduler.capacity; index++) {
+        node = &g_scheduler.nodes[index];
+        if (node->state == TL_TIMER_PENDING && tl_sched_command_target(&node->command) == target) {
+            tl_sched_unlink(index);
+            g_scheduler.pending_count--;
+            node->state = TL_TIMER_FIRING;
+            node->next = cancelled;
+            cancelled = index;
+        }
+    }
+
+    /* 已到期、尚未執行的排程 */
+    link = &g_scheduler.firing_head;
+    while (*link != TL_TIMER_NIL) {
+        index = *link;
+        node = &g_scheduler.nodes[index];
+        if (tl_sched_command_target(&node->command) == target) {
+            *link = node->next;
+            node->next = cancelled;
+            cancelled = index;
+        } else {
+            link = &node->next;
+        }
+    }
+
+    /* 等待執行中的排程結束 */
+    while (g_scheduler.running_target == target) {
+        tl_cond_wait(g_scheduler.idle, g_scheduler.lock, TL_WAIT_INFINITE);
+    }
+
+    /* 以 TL_ERROR_DEVICE_NOT_OPEN 通知取消的排程，回呼期間不持有鎖 (節點尚未歸還，不會被重複使用；陣列可能被擴充，不保留節點指標) */
+    while (cancelled != TL_TIMER_NIL) {
+        index = cancelled;
+        node = &g_scheduler.nodes[index];
+        cancelled = node->next;
+        callback = node->callback;
+        user_data = node->user_data;
+        if (callback != NULL) {
+            id = tl_sched_make_id(index, node->generation);
+            tl_mutex_unlock(g_scheduler.lock);
+            callback(id, TL_ERROR_DEVICE_NOT_OPEN, user_data);
+            tl_mutex_lock(g_scheduler.lock);
+        }
+        tl_sched_free_node(index);
+    }
+    tl_mutex_unlock(g_scheduler.lock);
+}
@@ -0,0 +1,979 @@
+﻿/*
+ * tl_sequence.c
+ *
+ * 塔燈通訊控制函式庫 - 動畫序列庫實現
+ *
+ * 動畫以文字定義，由 TL_CompileSequenceLibrary 編譯為二進位序列庫；應用程式啟動時
+ * 以記憶體映射載入，只檢查一次格式，不再逐一解析為 TL_LEDStatus。播放時由每台裝置的
+ * 播放執行緒依步驟的持續時間，直接把映射區中預先建構的設定命令交給一般的命令路徑
+ * (速率限制、緊急通道與寫入模式都照常適用)，不複製也不重新建構命令。
+ *
+ * 二進位序列庫格式 (所有整數皆為小端序)
+ *
+ *   標頭 (32 位元組)
+ *     magic[4]         "TLSQ"
+ *     version          uint16，目前為 1
+ *     header_size      uint16，固定為 32
+ *     sequence_count   uint32
+ *     step_count       uint32，所有序列的步驟總數
+ *     index_offset     uint32，索引表起始位移
+ *     steps_offset     uint32，步驟區起始位移
+ *     names_offset     uint32，名稱區起始位移 (名稱區到檔案結尾為止)
+ *     checksum         uint32，自索引表到檔案結尾的 FNV-1a 雜湊
+ *   索引表 (sequence_count 項，每項 16 位元組，依名稱的位元組順序排列)
+ *     name_offset      uint32，相對名稱區的位移
+ *     first_step       uint32，第一個步驟的編號
+ *     step_count       uint32
+ *     repeat           uint32，播放輪數，0 表示不斷重複
+ *   步驟區 (step_count 項，每項 64 位元組)
+ *     state            uint32，壓縮的塔燈狀態 (TL_TowerState)
+ *     duration_ms      uint32，送出後維持的時間
+ *     lengths[4]       uint8，各目標的設定命令長度，0 表示不變
+ *     reserved         uint32
+ *     commands[4][12]  各目標預先建構的設定命令
+ *   名稱區
+ *     以 NUL 結尾的字串
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tl_internal.h"
+
+/* 序列庫格式常數 */
+#define TL_SEQ_MAGIC          "TLSQ"
+#define TL_SEQ_VERSION        1
+#define TL_SEQ_HEADER_SIZE    32
+#define TL_SEQ_ENTRY_SIZE     16
+#define TL_SEQ_STEP_SIZE      64
+#define TL_SEQ_COMMAND_SIZE   12
+#define TL_SEQ_LENGTHS        8    /* 步驟中 lengths 的位移 */
+#define TL_SEQ_COMMANDS       16   /* 步驟中 commands 的位移 */
+
+/* 序列名稱的最大長度 (含 NUL) */
+#define TL_SEQ_NAME_MAX       64
+
+/* 已載入的序列庫 (即 TL_SEQUENCE_LIBRARY) */
+typedef struct TL_SequenceLibrary TL_SequenceLibrary;
+
+struct TL_SequenceLibrary {
+    TL_FileMapping mapping;           /* 檔案映射 */
+    const TL_BYTE* index;             /* 索引表 */
+    const TL_BYTE* steps;             /* 步驟區 */
+    const char* names;                /* 名稱區 */
+    uint32_t sequence_count;          /* 序列數 */
+    volatile unsigned int references; /* 參考數：載入時為 1，每個播放中的序列加 1 (原子操作) */
+};
+
+/* 動畫播放器 */
+struct TL_SequencePlayer {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 開始播放、停止播放或結束 */
+    TL_Thread* thread;                /* 播放執行緒 */
+    TL_BOOL stopping;                 /* 正在結束 */
+    TL_SequenceLibrary* library;      /* 播放中序列所屬的序列庫 (持有參考)，NULL 表示閒置 */
+    const TL_BYTE* steps;             /* 序列的第一個步驟 (位於映射區) */
+    uint32_t step_count;              /* 序列的步驟數 */
+    uint32_t repeat;                  /* 播放輪數，0 表示不斷重複 */
+    unsigned long long due_us;        /* 下一個步驟的預定時間 */
+    unsigned int generation;          /* 每次開始或停止播放時遞增，送出期間改變時捨棄該步驟的結果 */
+    TL_SequenceStats stats;           /* 統計 */
+};
+
+/* 小端序讀寫 */
+static uint32_t tl_seq_rd_u32(const TL_BYTE* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void tl_seq_wr_u16(TL_BYTE* p, uint16_t v)
+{
+    p[0] = (TL_BYTE)(v & 0xFF);
+    p[1] = (TL_BYTE)((v >> 8) & 0xFF);
+}
+
+static void tl_seq_wr_u32(TL_BYTE* p, uint32_t v)
+{
+    p[0] = (TL_BYTE)(v & 0xFF);
+    p[1] = (TL_BYTE)((v >> 8) & 0xFF);
+    p[2] = (TL_BYTE)((v >> 16) & 0xFF);
+    p[3] = (TL_BYTE)((v >> 24) & 0xFF);
+}
+
+/* FNV-1a 雜湊 */
+static uint32_t tl_seq_fnv1a(const TL_BYTE* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* -------------------------------------------------------------------------
+ * 編譯
+ */
+
+/* 編譯中的序列 */
+typedef struct {
+    char name[TL_SEQ_NAME_MAX];       /* 名稱 */
+    uint32_t first_step;              /* 第一個步驟的編號 */
+    uint32_t step_count;              /* 步驟數 */
+    uint32_t repeat;                  /* 播放輪數 */
+    unsigned long long total_ms;      /* 一輪的總時間 */
+} TL_SequenceSource;
+
+/* 編譯狀態 */
+typedef struct {
+    TL_SequenceSource* sequences;     /* 序列 */
+    size_t sequence_count;
+    size_t sequence_capacity;
+    TL_BYTE* steps;                   /* 已編碼的步驟 */
+    size_t step_count;
+    size_t step_capacity;
+} TL_SequenceBuilder;
+
+/*
+ * 解析 sequence 行
+ */
+static TL_ERROR_CODE tl_seq_add_sequence(TL_SequenceBuilder* builder, char* cursor)
+{
+    TL_SequenceSource* sequence;
+    TL_SequenceSource* grown;
+    const char* name = tl_text_next_token(&cursor);
+    const char* keyword = tl_text_next_token(&cursor);
+    unsigned int repeat = 1;
+    size_t i;
+
+    if (name == NULL || strlen(name) >= TL_SEQ_NAME_MAX) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    if (keyword != NULL && (strcmp(keyword, "repeat") != 0 ||
+        !tl_text_parse_u32(tl_text_next_token(&cursor), &repeat))) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    if (tl_text_next_token(&cursor) != NULL) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    for (i = 0; i < builder->sequence_count; i++) {
+        if (strcmp(builder->sequences[i].name, name) == 0) {
+            return TL_ERROR_FILE_FORMAT;
+        }
+    }
+
+    if (builder->sequence_count == builder->sequence_capacity) {
+        size_t capacity = (builder->sequence_capacity != 0) ? builder->sequence_capacity * 2 : 16;
+
+        grown = (TL_SequenceSource*)realloc(builder->sequences, capacity * sizeof(TL_SequenceSource));
+        if (grown == NULL) {
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+        builder->sequences = grown;
+        builder->sequence_capacity = capacity;
+    }
+
+    sequence = &builder->sequences[builder->sequence_count++];
+    memset(sequence, 0, sizeof(*sequence));
+    strcpy(sequence->name, name);
+    sequence->first_step = (uint32_t)builder->step_count;
+    sequence->repeat = repeat;
+    return TL_SUCCESS;
+}
+
+/*
+ * 解析步驟行並編碼為步驟
+ */
+static TL_ERROR_CODE tl_seq_add_step(TL_SequenceBuilder* builder, char* cursor)
+{
+    TL_SequenceSource* sequence;
+    TL_TowerFrame frame;
+    TL_PreparedFrame prepared;
+    TL_TowerState state;
+    TL_BYTE* step;
+    TL_BYTE* grown;
+    unsigned int duration_ms;
+    int target;
+
+    if (builder->sequence_count == 0) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    sequence = &builder->sequences[builder->sequence_count - 1];
+
+    if (!tl_text_parse_u32(tl_text_next_token(&cursor), &duration_ms)) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    if (!tl_tower_state_parse(&cursor, &frame) || tl_text_next_token(&cursor) != NULL) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    /* 壓縮的狀態與設定命令都在編譯時建構 */
+    if (TL_PackTowerState(&frame, &state) != TL_SUCCESS || tl_cmd_prepare_frame(&frame, &prepared) != TL_SUCCESS) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    if (builder->step_count == builder->step_capacity) {
+        size_t capacity = (builder->step_capacity != 0) ? builder->step_capacity * 2 : 64;
+
+        grown = (TL_BYTE*)realloc(builder->steps, capacity * TL_SEQ_STEP_SIZE);
+        if (grown == NULL) {
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+        builder->steps = grown;
+        builder->step_capacity = capacity;
+    }
+
+    step = builder->steps + builder->step_count * TL_SEQ_STEP_SIZE;
+    memset(step, 0, TL_SEQ_STEP_SIZE);
+    tl_seq_wr_u32(step, state);
+    tl_seq_wr_u32(step + 4, duration_ms);
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (prepared.lengths[target] == 0) {
+            continue;
+        }
+        step[TL_SEQ_LENGTHS + target] = (TL_BYTE)prepared.lengths[target];
+        memcpy(step + TL_SEQ_COMMANDS + target * TL_SEQ_COMMAND_SIZE, prepared.commands[target],
+               prepared.lengths[target]);
+    }
+
+    builder->step_count++;
+    sequence->step_count++;
+    sequence->total_ms += duration_ms;
+    return TL_SUCCESS;
+}
+
+/*
+ * 讀取整個文字定義檔 (略過 UTF-8 BOM)
+ */
+static TL_ERROR_CODE tl_seq_read_source(const char* filename, char** storage, char** text)
+{
+    FILE* file;
+    long file_size;
+    size_t read_size;
+    char* buffer;
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return TL_ERROR_FILE_ACCESS;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    buffer = (char*)malloc((size_t)file_size + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    read_size = fread(buffer, 1, (size_t)file_size, file);
+    fclose(file);
+    buffer[read_size] = '\0';
+
+    *storage = buffer;
+    *text = buffer;
+    if (read_size >= 3 && (TL_BYTE)buffer[0] == 0xEF && (TL_BYTE)buffer[1] == 0xBB && (TL_BYTE)buffer[2] == 0xBF) {
+        *text = buffer + 3;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 依名稱排序序列
+ */
+static int tl_seq_compare_source(const void* a, const void* b)
+{
+    return strcmp(((const TL_SequenceSource*)a)->name, ((const TL_SequenceSource*)b)->name);
+}
+
+/*
+ * 由編譯結果建立序列庫映像
+ */
+static TL_ERROR_CODE tl_seq_build_image(TL_SequenceBuilder* builder, TL_BYTE** image, size_t* image_size)
+{
+    size_t index_size = builder->sequence_count * TL_SEQ_ENTRY_SIZE;
+    size_t steps_size = builder->step_count * TL_SEQ_STEP_SIZE;
+    size_t names_size = 0;
+    size_t steps_offset = TL_SEQ_HEADER_SIZE + index_size;
+    size_t names_offset = steps_offset + steps_size;
+    size_t cursor = 0;
+    size_t total;
+    size_t length;
+    size_t i;
+    TL_BYTE* data;
+
+    for (i = 0; i < builder->sequence_count; i++) {
+        names_size += strlen(builder->sequences[i].name) + 1;
+    }
+    total = names_offset + names_size;
+    if (total > 0xFFFFFFFFu) {
+        return TL_ERROR_OUT_OF_RANGE;
+    }
+
+    data = (TL_BYTE*)calloc(1, total);
+    if (data == NULL) {
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    qsort(builder->sequences, builder->sequence_count, sizeof(TL_SequenceSource), tl_seq_compare_source);
+    for (i = 0; i < builder->sequence_count; i++) {
+        TL_BYTE* entry = data + TL_SEQ_HEADER_SIZE + i * TL_SEQ_ENTRY_SIZE;
+        const TL_SequenceSource* sequence = &builder->sequences[i];
+
+        length = strlen(sequence->name);
+        tl_seq_wr_u32(entry, (uint32_t)cursor);
+        tl_seq_wr_u32(entry + 4, sequence->first_step);
+        tl_seq_wr_u32(entry + 8, sequence->step_count);
+        tl_seq_wr_u32(entry + 12, sequence->repeat);
+        memcpy(data + names_offset + cursor, sequence->name, length + 1);
+        cursor += length + 1;
+    }
+    if (steps_size != 0) {
+        memcpy(data + steps_offset, builder->steps, steps_size);
+    }
+
+    memcpy(data, TL_SEQ_MAGIC, 4);
+    tl_seq_wr_u16(data + 4, TL_SEQ_VERSION);
+    tl_seq_wr_u16(data + 6, TL_SEQ_HEADER_SIZE);
+    tl_seq_wr_u32(data + 8, (uint32_t)builder->sequence_count);
+    tl_seq_wr_u32(data + 12, (uint32_t)builder->step_count);
+    tl_seq_wr_u32(data + 16, TL_SEQ_HEADER_SIZE);
+    tl_seq_wr_u32(data + 20, (uint32_t)steps_offset);
+    tl_seq_wr_u32(data + 24, (uint32_t)names_offset);
+    tl_seq_wr_u32(data + 28, tl_seq_fnv1a(data + TL_SEQ_HEADER_SIZE, total - TL_SEQ_HEADER_SIZE));
+
+    *image = data;
+    *image_size = total;
+    return TL_SUCCESS;
+}
+
+/*
+ * 編譯動畫序列庫
+ */
+TL_ERROR_CODE TL_CompileSequenceLibrary(const char* source_file, const char* output_file)
+{
+    TL_SequenceBuilder builder;
+    TL_ERROR_CODE result;
+    TL_BYTE* image = NULL;
+    size_t image_size = 0;
+    char* storage = NULL;
+    char* line;
+    char* next;
+    char* keyword;
+    size_t length;
+    size_t i;
+    int line_number = 0;
+    FILE* file;
+
+    if (source_file == NULL || output_file == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&builder, 0, sizeof(builder));
+    result = tl_seq_read_source(source_file, &storage, &line);
+
+    while (result == TL_SUCCESS && *line != '\0') {
+        next = strchr(line, '\n');
+        length = (next != NULL) ? (size_t)(next - line) : strlen(line);
+        next = (next != NULL) ? next + 1 : line + length;
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+        line[length] = '\0';
+        line_number++;
+
+        /* 空行與註解 */
+        keyword = line;
+        while (*keyword == ' ' || *keyword == '\t') {
+            keyword++;
+        }
+        if (*keyword != '\0' && *keyword != '#') {
+            if (strncmp(keyword, "sequence", 8) == 0 && (keyword[8] == ' ' || keyword[8] == '\t')) {
+                result = tl_seq_add_sequence(&builder, keyword + 8);
+            } else {
+                result = tl_seq_add_step(&builder, keyword);
+            }
+#ifdef BUILD_TEST_EXE
+            if (result != TL_SUCCESS) {
+                printf("[TL_CompileSequenceLibrary] %s 第 %d 行無法解析\n", source_file, line_number);
+            }
+#endif
+        }
+        line = next;
+    }
+
+    /* 每個序列至少一個步驟，不斷重複的序列一輪不可為 0 毫秒 */
+    for (i = 0; result == TL_SUCCESS && i < builder.sequence_count; i++) {
+        if (builder.sequences[i].step_count == 0 ||
+            (builder.sequences[i].repeat == 0 && builder.sequences[i].total_ms == 0)) {
+            result = TL_ERROR_FILE_FORMAT;
+        }
+    }
+
+    if (result == TL_SUCCESS) {
+        result = tl_seq_build_image(&builder, &image, &image_size);
+    }
+
+    if (result == TL_SUCCESS) {
+        file = fopen(output_file, "wb");
+        if (file == NULL) {
+            result = TL_ERROR_FILE_ACCESS;
+        } else {
+            if (fwrite(image, 1, image_size, file) != image_size) {
+                result = TL_ERROR_FILE_ACCESS;
+            }
+            if (fclose(file) != 0) {
+                result = TL_ERROR_FILE_ACCESS;
+            }
+        }
+    }
+
+    free(image);
+    free(builder.steps);
+    free(builder.sequences);
+    free(storage);
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
+
+/* -------------------------------------------------------------------------
+ * 載入
+ */
+
+/*
+ * 檢查單一步驟：狀態可還原，命令為該目標的設定命令
+ */
+static TL_BOOL tl_seq_step_valid(const TL_BYTE* step)
+{
+    const TL_BYTE* command;
+    TL_TowerFrame frame;
+    size_t length;
+    int target;
+
+    if (TL_UnpackTowerState(tl_seq_rd_u32(step), &frame) != TL_SUCCESS) {
+        return TL_FALSE;
+    }
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        length = step[TL_SEQ_LENGTHS + target];
+        command = step + TL_SEQ_COMMANDS + target * TL_SEQ_COMMAND_SIZE;
+        if (length == 0) {
+            continue;
+        }
+        if (length < 3 || length > TL_SEQ_COMMAND_SIZE || command[0] != TL_PKT_START ||
+            command[1] != ((target == TL_TARGET_BUZZER) ? TL_CMD_BUZZER_SET : TL_CMD_LED_SET) ||
+            command[length - 1] != TL_PKT_END) {
+            return TL_FALSE;
+        }
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 驗證序列庫映像並填入序列庫結構
+ *
+ * 所有索引項目與步驟都在載入時檢查一次，播放時不需再做邊界檢查。
+ */
+static TL_ERROR_CODE tl_seq_attach(const TL_BYTE* data, size_t size, TL_SequenceLibrary* library)
+{
+    uint32_t step_count;
+    uint32_t index_offset;
+    uint32_t steps_offset;
+    uint32_t names_offset;
+    size_t names_size;
+    const char* previous = NULL;
+    uint32_t i;
+    uint32_t s;
+
+    if (size < TL_SEQ_HEADER_SIZE || memcmp(data, TL_SEQ_MAGIC, 4) != 0 ||
+        data[4] != TL_SEQ_VERSION || data[5] != 0 || data[6] != TL_SEQ_HEADER_SIZE || data[7] != 0) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    library->sequence_count = tl_seq_rd_u32(data + 8);
+    step_count = tl_seq_rd_u32(data + 12);
+    index_offset = tl_seq_rd_u32(data + 16);
+    steps_offset = tl_seq_rd_u32(data + 20);
+    names_offset = tl_seq_rd_u32(data + 24);
+
+    if (index_offset < TL_SEQ_HEADER_SIZE ||
+        (uint64_t)index_offset + (uint64_t)library->sequence_count * TL_SEQ_ENTRY_SIZE > steps_offset ||
+        (uint64_t)steps_offset + (uint64_t)step_count * TL_SEQ_STEP_SIZE > names_offset ||
+        names_offset > size) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+    names_size = size - names_offset;
+    if (library->sequence_count != 0 && (names_size == 0 || data[size - 1] != '\0')) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    /* 檢查雜湊 */
+    if (tl_seq_fnv1a(data + index_offset, size - index_offset) != tl_seq_rd_u32(data + 28)) {
+        return TL_ERROR_FILE_FORMAT;
+    }
+
+    library->index = data + index_offset;
+    library->steps = data + steps_offset;
+    library->names = (const char*)(data + names_offset);
+
+    for (s = 0; s < step_count; s++) {
+        if (!tl_seq_step_valid(library->steps + (size_t)s * TL_SEQ_STEP_SIZE)) {
+            return TL_ERROR_FILE_FORMAT;
+        }
+    }
+
+    /* 每個序列的步驟都在步驟區內，名稱依序遞增以便二分搜尋 */
+    for (i = 0; i < library->sequence_count; i++) {
+        const TL_BYTE* entry = library->index + (size_t)i * TL_SEQ_ENTRY_SIZE;
+        uint32_t name_offset = tl_seq_rd_u32(entry);
+        uint32_t first_step = tl_seq_rd_u32(entry + 4);
+        uint32_t count = tl_seq_rd_u32(entry + 8);
+        uint32_t repeat = tl_seq_rd_u32(entry + 12);
+        unsigned long long total_ms = 0;
+
+        if (name_offset >= names_size || count == 0 || (uint64_t)first_step + count > step_count) {
+            return TL_ERROR_FILE_FORMAT;
+        }
+        if (previous != NULL && strcmp(previous, library->names + name_offset) >= 0) {
+            return TL_ERROR_FILE_FORMAT;
+        }
+        previous = library->names + name_offset;
+
+        if (repeat == 0) {
+            for (s = 0; s < count; s++) {
+                total_ms += tl_seq_rd_u32(library->steps + (size_t)(first_step + s) * TL_SEQ_STEP_SIZE + 4);
+            }
+            if (total_ms == 0) {
+                return TL_ERROR_FILE_FORMAT;
+            }
+        }
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 依名稱尋找序列，找不到時為 NULL
+ */
+static const TL_BYTE* tl_seq_find(const TL_SequenceLibrary* library, const char* name)
+{
+    uint32_t low = 0;
+    uint32_t high = library->sequence_count;
+    uint32_t middle;
+    const TL_BYTE* entry;
+    int order;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        entry = library->index + (size_t)middle * TL_SEQ_ENTRY_SIZE;
+        order = strcmp(name, library->names + tl_seq_rd_u32(entry));
+        if (order == 0) {
+            return entry;
+        }
+        if (order < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * 增加與釋放序列庫的參考，最後一個參考釋放時解除映射
+ */
+static void tl_seq_retain(TL_SequenceLibrary* library)
+{
+    unsigned int references;
+
+    do {
+        references = tl_atomic_load_u32(&library->references);
+    } while (!tl_atomic_cas_u32(&library->references, references, references + 1));
+}
+
+static void tl_seq_release(TL_SequenceLibrary* library)
+{
+    unsigned int references;
+
+    do {
+        references = tl_atomic_load_u32(&library->references);
+    } while (!tl_atomic_cas_u32(&library->references, references, references - 1));
+
+    if (references == 1) {
+        tl_file_map_close(&library->mapping);
+        free(library);
+    }
+}
+
+/*
+ * 載入動畫序列庫
+ */
+TL_ERROR_CODE TL_LoadSequenceLibrary(const char* filename, TL_SEQUENCE_LIBRARY* library)
+{
+    TL_SequenceLibrary* loaded;
+    TL_ERROR_CODE result;
+
+    if (filename == NULL || library == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    *library = NULL;
+
+    loaded = (TL_SequenceLibrary*)calloc(1, sizeof(TL_SequenceLibrary));
+    if (loaded == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* 單次映射整個檔案，播放時直接讀取映射區 */
+    result = tl_file_map_open_read(filename, &loaded->mapping);
+    if (result == TL_SUCCESS) {
+        result = tl_seq_attach(loaded->mapping.data, loaded->mapping.size, loaded);
+    }
+    if (result != TL_SUCCESS) {
+        tl_file_map_close(&loaded->mapping);
+        free(loaded);
+        tl_set_last_error(result);
+        return result;
+    }
+
+    loaded->references = 1;
+    *library = loaded;
+    return TL_SUCCESS;
+}
+
+/*
+ * 釋放動畫序列庫
+ */
+TL_ERROR_CODE TL_UnloadSequenceLibrary(TL_SEQUENCE_LIBRARY library)
+{
+    if (library == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    tl_seq_release(library);
+    return TL_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------
+ * 播放
+ */
+
+/*
+ * 記錄步驟中單一目標的影子狀態
+ */
+static void tl_seq_note_target(TL_DeviceContext* device, const TL_TowerFrame* frame, int target)
+{
+    if (target == TL_TARGET_BUZZER) {
+        tl_shadow_update(device, target, NULL, &frame->buzzer);
+    } else {
+        tl_shadow_update(device, target, &frame->layers[target], NULL);
+    }
+}
+
+/*
+ * 送出單一步驟 (與 tl_cmd_apply_frame 相同，命令直接取自映射區；
+ * 同步模式下送出成功後才更新影子狀態)
+ */
+static TL_ERROR_CODE tl_seq_send_step(TL_DeviceContext* device, const TL_BYTE* step)
+{
+    TL_TowerFrame frame;
+    TL_ERROR_CODE result;
+    TL_BOOL note_first = (device->async != NULL) ? TL_TRUE : TL_FALSE;
+    size_t length;
+    int target;
+
+    /* 載入時已檢查過狀態可還原 */
+    TL_UnpackTowerState(tl_seq_rd_u32(step), &frame);
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        length = step[TL_SEQ_LENGTHS + target];
+        if (length == 0) {
+            continue;
+        }
+
+        if (note_first) {
+            tl_seq_note_target(device, &frame, target);
+        }
+        result = tl_cmd_execute_set(device, target, step + TL_SEQ_COMMANDS + target * TL_SEQ_COMMAND_SIZE, length);
+        if (result != TL_SUCCESS) {
+            return result;
+        }
+        if (!note_first) {
+            tl_seq_note_target(device, &frame, target);
+        }
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 結束目前的播放 (須持有鎖)
+ */
+static void tl_seq_finish_locked(TL_SequencePlayer* player)
+{
+    if (player->library != NULL) {
+        tl_seq_release(player->library);
+        player->library = NULL;
+    }
+    player->steps = NULL;
+    player->stats.playing = TL_FALSE;
+    player->generation++;
+    tl_cond_broadcast(player->changed);
+}
+
+/*
+ * 播放執行緒
+ */
+static void tl_seq_main(void* arg)
+{
+    TL_SequencePlayer* player = (TL_SequencePlayer*)arg;
+    TL_SequenceLibrary* library;
+    const TL_BYTE* step;
+    unsigned long duration_ms;
+    unsigned long long now_us;
+    unsigned long long lag_us;
+    unsigned int generation;
+    TL_ERROR_CODE result;
+
+    tl_mutex_lock(player->lock);
+    while (!player->stopping) {
+        if (player->library == NULL) {
+            tl_cond_wait(player->changed, player->lock, TL_WAIT_INFINITE);
+            continue;
+        }
+
+        now_us = tl_time_now_us();
+        if (now_us < player->due_us) {
+            tl_cond_wait(player->changed, player->lock, (unsigned long)((player->due_us - now_us + 999) / 1000));
+            continue;
+        }
+
+        step = player->steps + (size_t)player->stats.step_index * TL_SEQ_STEP_SIZE;
+        duration_ms = tl_seq_rd_u32(step + 4);
+        generation = player->generation;
+        lag_us = now_us - player->due_us;
+
+        /*
+         * 送出期間不持有鎖，停止或改播其他序列時不必等待；
+         * 步驟直接取自映射區，送出期間自行持有序列庫的參考，改播與卸載不會解除映射
+         */
+        library = player->library;
+        tl_seq_retain(library);
+        tl_mutex_unlock(player->lock);
+        result = tl_seq_send_step(player->device, step);
+        tl_seq_release(library);
+        tl_mutex_lock(player->lock);
+
+        if (generation != player->generation) {
+            continue;
+        }
+
+        if (result == TL_SUCCESS) {
+            player->stats.steps_played++;
+        } else {
+            player->stats.step_failures++;
+        }
+        if (lag_us >= 1000) {
+            player->stats.late_steps++;
+        }
+        if (lag_us > player->stats.max_lag_us) {
+            player->stats.max_lag_us = lag_us;
+        }
+
+        /* 以預定時間累加，避免誤差累積；落後超過一個步驟時自目前時間重新起算，不連續補送 */
+        player->due_us += (unsigned long long)duration_ms * 1000;
+        now_us = tl_time_now_us();
+        if (player->due_us < now_us) {
+            player->due_us = now_us;
+        }
+
+        if (++player->stats.step_index == player->step_count) {
+            player->stats.step_index = 0;
+            player->stats.loops_completed++;
+            if (player->repeat != 0 && player->stats.loops_completed >= player->repeat) {
+                tl_seq_finish_locked(player);
+            }
+        }
+    }
+    tl_mutex_unlock(player->lock);
+}
+
+/*
+ * 釋放播放器
+ */
+static void tl_seq_free(TL_SequencePlayer* player)
+{
+    if (player->library != NULL) {
+        tl_seq_release(player->library);
+    }
+    tl_cond_destroy(player->changed);
+    tl_mutex_destroy(player->lock);
+    free(player);
+}
+
+/*
+ * 停止動畫播放器
+ */
+void tl_sequence_stop(TL_DeviceContext* device)
+{
+    TL_SequencePlayer* player;
+
+    tl_mutex_lock(device->state_lock);
+    player = device->player;
+    device->player = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (player == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(player->lock);
+    player->stopping = TL_TRUE;
+    tl_cond_broadcast(player->changed);
+    tl_mutex_unlock(player->lock);
+
+    tl_thread_join(player->thread);
+    tl_seq_free(player);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_seq_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 播放動畫序列
+ */
+TL_ERROR_CODE TL_PlaySequence(TL_DEVICE_HANDLE device, TL_SEQUENCE_LIBRARY library, const char* name)
+{
+    TL_DeviceContext* context;
+    TL_SequencePlayer* player;
+    const TL_BYTE* entry;
+    TL_ERROR_CODE result;
+
+    if (library == NULL || name == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    entry = tl_seq_find(library, name);
+    if (entry == NULL) {
+        tl_set_last_error(TL_ERROR_OUT_OF_RANGE);
+        return TL_ERROR_OUT_OF_RANGE;
+    }
+
+    result = tl_seq_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    player = context->player;
+    if (player == NULL) {
+        player = (TL_SequencePlayer*)calloc(1, sizeof(TL_SequencePlayer));
+        if (player != NULL) {
+            player->device = context;
+            player->lock = tl_mutex_create();
+            player->changed = tl_cond_create();
+            if (player->lock == NULL || player->changed == NULL) {
+                tl_seq_free(player);
+                player = NULL;
+            } else {
+                player->thread = tl_thread_create(tl_seq_main, player);
+                if (player->thread == NULL) {
+                    tl_seq_free(player);
+                    player = NULL;
+                }
+            }
+        }
+        if (player == NULL) {
+            tl_mutex_unlock(context->state_lock);
+            tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+            return TL_ERROR_MEMORY_ALLOCATION;
+        }
+        context->player = player;
+    }
+
+    /* 改播新的序列：統計自新的序列起算 */
+    tl_mutex_lock(player->lock);
+    tl_seq_finish_locked(player);
+    tl_seq_retain(library);
+    player->library = library;
+    player->steps = library->steps + (size_t)tl_seq_rd_u32(entry + 4) * TL_SEQ_STEP_SIZE;
+    player->step_count = tl_seq_rd_u32(entry + 8);
+    player->repeat = tl_seq_rd_u32(entry + 12);
+    player->due_us = tl_time_now_us();
+    memset(&player->stats, 0, sizeof(player->stats));
+    player->stats.playing = TL_TRUE;
+    tl_cond_broadcast(player->changed);
+    tl_mutex_unlock(player->lock);
+    tl_mutex_unlock(context->state_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_PlaySequence] %s 步驟數=%u\n", name, (unsigned int)tl_seq_rd_u32(entry + 8));
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止播放動畫序列
+ */
+TL_ERROR_CODE TL_StopSequence(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_seq_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_sequence_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得動畫播放統計
+ */
+TL_ERROR_CODE TL_GetSequenceStats(TL_DEVICE_HANDLE device, TL_SequenceStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_SequencePlayer* player;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_seq_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    player = context->player;
+    if (player != NULL) {
+        tl_mutex_lock(player->lock);
+        *stats = player->stats;
+        tl_mutex_unlock(player->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
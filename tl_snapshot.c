@@ -0,0 +1,134 @@
+﻿/*
+ * tl_snapshot.c
+ *
+ * 塔燈通訊控制函式庫 - 整座塔燈狀態快照實現
+ *
+ * 逐一以 TL_GetLEDStatus / TL_GetBuzzerStatus 讀取整座塔燈需要四次往返。
+ * 快照將四個狀態讀取命令連續寫出，再依序接收並解析四個回應，
+ * 總耗時約為一次往返；四個讀取之間不會穿插其他命令，各目標的狀態
+ * 取自同一時刻附近。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/*
+ * 讀取整座塔燈的狀態 (指定裝置)
+ */
+static TL_ERROR_CODE tl_snapshot_read(TL_DeviceContext* device, TL_TowerSnapshot* snapshot)
+{
+    TL_BYTE commands[TL_TARGET_COUNT][TL_SET_COMMAND_SIZE];
+    TL_BYTE responses[TL_TARGET_COUNT][TL_STATUS_RESPONSE_SIZE];
+    const TL_BYTE* command_list[TL_TARGET_COUNT];
+    TL_BYTE* response_list[TL_TARGET_COUNT];
+    size_t command_lengths[TL_TARGET_COUNT];
+    size_t response_lengths[TL_TARGET_COUNT];
+    TL_TowerSnapshot result;
+    unsigned long long start_us;
+    TL_ERROR_CODE error;
+    int target;
+
+    /* 參數驗證 */
+    if (snapshot == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 構建各目標的狀態讀取命令 (0~2: LED層級, 3: 蜂鳴器) */
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        command_lengths[target] = tl_cmd_build_status_read_command((TL_BYTE)target,
+            commands[target], TL_SET_COMMAND_SIZE);
+        if (command_lengths[target] == 0) {
+            tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+            return TL_ERROR_INVALID_PARAMETER;
+        }
+        command_list[target] = commands[target];
+        response_list[target] = responses[target];
+    }
+
+    /* 連續寫出四個讀取命令並接收回應 */
+    start_us = tl_time_now_us();
+    error = tl_cmd_send_and_receive_batch(device, TL_TARGET_COUNT, command_list, command_lengths,
+                                          response_list, TL_STATUS_RESPONSE_SIZE, response_lengths);
+    if (error != TL_SUCCESS) {
+        return error;
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.round_trip_us = tl_time_now_us() - start_us;
+    result.capture_us = start_us + result.round_trip_us / 2;
+
+    /* 解析所有回應 */
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        error = tl_cmd_check_response_format(responses[target], response_lengths[target]);
+        if (error != TL_SUCCESS) {
+            return error;
+        }
+        if (target == TL_TARGET_BUZZER) {
+            error = tl_cmd_parse_buzzer_status(responses[target], response_lengths[target], &result.status.buzzer);
+        } else {
+            error = tl_cmd_parse_led_status(responses[target], response_lengths[target], &result.status.layers[target]);
+        }
+        if (error != TL_SUCCESS) {
+            return error;
+        }
+    }
+    result.status.target_mask = TL_FRAME_ALL;
+
+#ifdef BUILD_TEST_EXE
+    printf("[tl_snapshot_read] 讀取整座塔燈 %lluus\n", result.round_trip_us);
+#endif
+
+    /* 讀回的狀態即為裝置目前的狀態；四個目標一次檢查裝置是否曾經重置，不需再讀取 */
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        tl_tower_state_note(device, target, &result.status.layers[target < TL_TARGET_BUZZER ? target : 0],
+                            &result.status.buzzer);
+    }
+    tl_reset_note_snapshot(device, &result.status);
+
+    *snapshot = result;
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得整座塔燈的狀態快照
+ */
+TL_ERROR_CODE TL_GetTowerSnapshot(TL_TowerSnapshot* snapshot)
+{
+    TL_InternalState* state = tl_get_internal_state();
+
+    /* 檢查函式庫是否已初始化 */
+    if (!state->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    /* 檢查裝置是否已開啟 */
+    if (!state->is_device_open) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+
+    return tl_snapshot_read(&state->device, snapshot);
+}
+
+/*
+ * 取得指定塔燈的狀態快照
+ */
+TL_ERROR_CODE TL_DeviceGetTowerSnapshot(TL_DEVICE_HANDLE device, TL_TowerSnapshot* snapshot)
+{
+    TL_ERROR_CODE result;
+
+    /* 檢查函式庫狀態與裝置是否已開啟 */
+    result = tl_validate_device(device);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    return tl_snapshot_read(device, snapshot);
+}
@@ -0,0 +1,63 @@
+﻿/*
+ * tl_text.c
+ *
+ * 塔燈通訊控制函式庫 - 文字定義檔解析輔助函式實現
+ *
+ * 序列定義 (tl_sequence.c)、警報對應表 (tl_alarm.c) 與塔燈畫面字詞
+ * (tl_tower_state.c) 共用的字詞切分與十進位整數解析。字詞以空白或 Tab 分隔，
+ * 就地切分呼叫端的可寫入字串，不配置記憶體。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include "tl_internal.h"
+
+/*
+ * 取得下一個以空白分隔的字詞
+ */
+char* tl_text_next_token(char** cursor)
+{
+    char* p = *cursor;
+    char* token;
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p == '\0') {
+        *cursor = p;
+        return NULL;
+    }
+    token = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') {
+        p++;
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return token;
+}
+
+/*
+ * 解析十進位整數
+ */
+TL_BOOL tl_text_parse_u32(const char* token, unsigned int* value)
+{
+    unsigned long long result = 0;
+
+    if (token == NULL || *token == '\0') {
+        return TL_FALSE;
+    }
+    for (; *token != '\0'; token++) {
+        if (*token < '0' || *token > '9') {
+            return TL_FALSE;
+        }
+        result = result * 10 + (unsigned long long)(*token - '0');
+        if (result > 0xFFFFFFFFull) {
+            return TL_FALSE;
+        }
+    }
+    *value = (unsigned int)result;
+    return TL_TRUE;
+}
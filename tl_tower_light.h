@@ -60,9 +60,23 @@ extern "C" {
         TL_ERROR_RESPONSE_FORMAT = 12,    /* 回應格式錯誤 */
         TL_ERROR_RESPONSE_CHECKSUM = 13,    /* 回應校驗和錯誤 */
         TL_ERROR_RESPONSE_NACK = 14,    /* 裝置拒絕命令 */
-        TL_ERROR_OUT_OF_RANGE = 15     /* 參數超出範圍 */
+        TL_ERROR_OUT_OF_RANGE = 15,    /* 參數超出範圍 */
+        TL_ERROR_FILE_ACCESS = 16,    /* 檔案存取失敗 */
+        TL_ERROR_FILE_FORMAT = 17,    /* 檔案格式錯誤 */
+        TL_ERROR_QUEUE_FULL = 18,     /* 提交佇列已滿 */
+        TL_ERROR_SUPERSEDED = 19,     /* 命令已被緊急命令取代而未送出 */
+        TL_ERROR_EXPIRED = 20,        /* 命令在送出前已超過期限 */
+        TL_ERROR_DEVICE_BUSY = 21     /* 裝置開啟中無法變更此設定 */
     } TL_ERROR_CODE;
 
+    /* 訊息語言定義 */
+    typedef enum {
+        TL_LANG_EN = 0,   /* 英文 */
+        TL_LANG_JA = 1,   /* 日文 */
+        TL_LANG_ZH_TW = 2,   /* 繁體中文 */
+        TL_LANG_ZH_CN = 3    /* 簡體中文 */
+    } TL_LANGUAGE;
+
     /* LED 狀態定義 */
     typedef enum {
         TL_LED_OFF = 0,    /* LED 關閉 */
@@ -122,6 +136,400 @@ extern "C" {
         TL_BUZZER_PATTERN pattern;   /* 模式 */
     } TL_BuzzerStatus;
 
+    /* 寫入模式定義 */
+    typedef enum {
+        TL_WRITE_MODE_SYNC = 0,               /* 每個設定命令都等待並驗證回應 */
+        TL_WRITE_MODE_FIRE_AND_FORGET = 1,    /* 寫入完成即返回，回應於背景驗證 */
+        TL_WRITE_MODE_PIPELINED = 2           /* 等待並驗證回應，多個命令可同時在途 */
+    } TL_WRITE_MODE;
+
+    /* 寫入不一致類型定義 */
+    typedef enum {
+        TL_MISMATCH_ACK_ERROR = 0,   /* 背景收到的回應為NAK、格式錯誤或逾時 */
+        TL_MISMATCH_STATE = 1        /* 週期性狀態讀取與影子狀態不符 */
+    } TL_MISMATCH_KIND;
+
+    /* 寫入不一致通知結構 */
+    typedef struct {
+        TL_MISMATCH_KIND kind;            /* 不一致類型 */
+        int target;                       /* 0~2: LED層級, 3: 蜂鳴器 */
+        TL_ERROR_CODE error;              /* TL_MISMATCH_ACK_ERROR 時的錯誤碼 */
+        TL_LEDStatus expected_led;        /* 預期的LED狀態 (target 為層級時) */
+        TL_LEDStatus actual_led;          /* 實際的LED狀態 (TL_MISMATCH_STATE 時) */
+        TL_BuzzerStatus expected_buzzer;  /* 預期的蜂鳴器狀態 (target 為 3 時) */
+        TL_BuzzerStatus actual_buzzer;    /* 實際的蜂鳴器狀態 (TL_MISMATCH_STATE 時) */
+    } TL_WriteMismatch;
+
+    /* 寫入不一致回呼，於函式庫內部執行緒呼叫，回呼中不可呼叫塔燈控制函式 */
+    typedef void (*TL_MismatchCallback)(const TL_WriteMismatch* mismatch, void* user_data);
+
+    /* 非同步寫入統計結構 */
+    typedef struct {
+        unsigned long long commands_sent;       /* 不等待回應送出的設定命令數 */
+        unsigned long long acks_ok;             /* 背景驗證成功的回應數 */
+        unsigned long long acks_failed;         /* 背景收到NAK或格式錯誤的回應數 */
+        unsigned long long acks_lost;           /* 逾時未收到的回應數 */
+        unsigned long long verify_reads;        /* 週期性狀態讀取次數 */
+        unsigned long long verify_mismatches;   /* 狀態不符次數 */
+        unsigned long long responses_skipped;   /* 由後續回應發現回應遺失的命令數 */
+        unsigned long long responses_discarded; /* 無法配對在途命令而丟棄的回應數 */
+        unsigned int in_flight;                 /* 目前尚未收到回應的命令數 */
+    } TL_AsyncStats;
+
+    /* 逾時設定結構 */
+    typedef struct {
+        unsigned long min_timeout_ms;   /* 讀取逾時下限 (毫秒) */
+        unsigned long max_timeout_ms;   /* 讀取逾時上限 (毫秒) */
+        TL_BOOL retry_on_timeout;       /* 逾時後重新同步並重試一次 */
+    } TL_TimeoutConfig;
+
+    /* 往返時間統計結構 */
+    typedef struct {
+        unsigned long srtt_us;                /* 平滑往返時間 (微秒) */
+        unsigned long rttvar_us;              /* 往返時間變異 (微秒) */
+        unsigned long timeout_ms;             /* 目前的讀取逾時 (毫秒) */
+        unsigned long long sample_count;      /* 往返時間樣本數 */
+        unsigned long long timeout_count;     /* 逾時次數 */
+        unsigned long long retry_count;       /* 逾時後重試次數 */
+        unsigned long long recovered_count;   /* 重試後成功的次數 */
+    } TL_RttStats;
+
+    /* 裝置控制代碼 (由 TL_OpenDevice 取得) */
+    typedef struct TL_DeviceContext* TL_DEVICE_HANDLE;
+
+    /* 裝置群組控制代碼 (由 TL_CreateDeviceGroup 取得) */
+    typedef struct TL_DeviceGroup* TL_GROUP_HANDLE;
+
+    /* 動畫序列庫控制代碼 (由 TL_LoadSequenceLibrary 取得) */
+    typedef struct TL_SequenceLibrary* TL_SEQUENCE_LIBRARY;
+
+    /* 警報代碼對照表控制代碼 (由 TL_LoadAlarmMap 取得) */
+    typedef struct TL_AlarmMap* TL_ALARM_MAP;
+
+    /* 塔燈畫面的目標遮罩 - bit 0~2 為LED層級，bit 3 為蜂鳴器 */
+#define TL_FRAME_LAYER_ONE    0x01
+#define TL_FRAME_LAYER_TWO    0x02
+#define TL_FRAME_LAYER_THREE  0x04
+#define TL_FRAME_BUZZER       0x08
+#define TL_FRAME_ALL          0x0F
+
+    /* 塔燈畫面結構 - 一次套用到整座塔燈的狀態 */
+    typedef struct {
+        TL_LEDStatus layers[3];     /* 各層LED狀態 */
+        TL_BuzzerStatus buzzer;     /* 蜂鳴器狀態 */
+        unsigned int target_mask;   /* 要套用的目標 (TL_FRAME_*) */
+    } TL_TowerFrame;
+
+    /* 整座塔燈的狀態快照 */
+    typedef struct {
+        TL_TowerFrame status;              /* 各目標的狀態，target_mask 為 TL_FRAME_ALL */
+        unsigned long long capture_us;     /* 擷取時間：寫出讀取命令與收到最後回應的中點 (微秒，單調時鐘) */
+        unsigned long long round_trip_us;  /* 自寫出讀取命令到收到最後回應的時間 (微秒) */
+    } TL_TowerSnapshot;
+
+    /*
+     * 壓縮的塔燈狀態 - 整座塔燈的狀態以一個 32 位元字組表示，可原子讀寫
+     *
+     * 第 n 個位元組為目標 n (與 TL_FRAME_* 的位元順序相同)：
+     *   LED層級: bit 0~1 紅、bit 2~3 綠、bit 4~5 藍 (TL_LED_STATE)，bit 6~7 閃爍模式
+     *   蜂鳴器:  bit 0 音調、bit 1~2 音量、bit 3~5 模式
+     * 兩個狀態的差異只需一次 XOR，見 TL_DiffTowerState。
+     */
+    typedef unsigned int TL_TowerState;
+
+    /* 塔燈狀態集合控制代碼 (由 TL_CreateFleet 取得) */
+    typedef struct TL_Fleet* TL_FLEET_HANDLE;
+
+    /* 群組中單一裝置的結果 */
+    typedef struct {
+        TL_ERROR_CODE result;             /* 套用結果 */
+        unsigned long long complete_us;   /* 自釋放寫入起到該裝置完成的時間 (微秒) */
+    } TL_GroupDeviceResult;
+
+    /* 群組套用統計 */
+    typedef struct {
+        unsigned int success_count;       /* 成功的裝置數 */
+        unsigned long long max_skew_us;   /* 成功裝置之間完成時間的最大差 (微秒) */
+        unsigned long long total_us;      /* 自釋放寫入起到全部完成的時間 (微秒) */
+    } TL_GroupStats;
+
+    /* 塔燈命令類型定義 */
+    typedef enum {
+        TL_COMMAND_SET_LED = 0,       /* 設定一層LED (layer, led) */
+        TL_COMMAND_SET_BUZZER = 1,    /* 設定蜂鳴器 (buzzer) */
+        TL_COMMAND_STOP_BUZZER = 2,   /* 停止蜂鳴器 */
+        TL_COMMAND_CLEAR = 3,         /* 清除塔燈 (LED全部關、蜂鳴器停止) */
+        TL_COMMAND_APPLY_FRAME = 4,   /* 套用塔燈畫面 (frame) */
+        TL_COMMAND_GROUP_FRAME = 5    /* 將塔燈畫面套用到裝置群組 (group, frame) */
+    } TL_COMMAND_TYPE;
+
+    /* 命令優先權定義 - 數值越大越優先 */
+    typedef enum {
+        TL_PRIORITY_NORMAL = 0,       /* 一般命令 */
+        TL_PRIORITY_EMERGENCY = 1     /* 緊急命令：插隊到所有一般命令之前，並取代被涵蓋的一般命令 */
+    } TL_PRIORITY;
+
+    /* 塔燈命令結構 - 可排程或稍後執行的單一操作 */
+    typedef struct {
+        TL_COMMAND_TYPE type;         /* 命令類型 */
+        TL_DEVICE_HANDLE device;      /* 目標裝置，NULL 表示預設裝置 */
+        TL_GROUP_HANDLE group;        /* TL_COMMAND_GROUP_FRAME 的目標群組 */
+        TL_LAYER layer;               /* TL_COMMAND_SET_LED 的層級 */
+        TL_LEDStatus led;             /* TL_COMMAND_SET_LED 的LED狀態 */
+        TL_BuzzerStatus buzzer;       /* TL_COMMAND_SET_BUZZER 的蜂鳴器狀態 */
+        TL_TowerFrame frame;          /* TL_COMMAND_APPLY_FRAME / TL_COMMAND_GROUP_FRAME 的畫面 */
+        TL_PRIORITY priority;         /* 優先權，TL_COMMAND_STOP_BUZZER / TL_COMMAND_CLEAR 一律視為緊急 */
+        unsigned long long deadline_ms;  /* 送出期限 (TL_GetMonotonicTimeMs 的時間基準)，0 表示不限 */
+    } TL_TowerCommand;
+
+    /* 緊急通道統計 (單一裝置) */
+    typedef struct {
+        unsigned long long emergency_count;   /* 緊急命令數 */
+        unsigned long long superseded_count;  /* 被緊急命令取代而未送出的一般命令數 */
+        unsigned long long last_wire_us;      /* 最近一次緊急命令自呼叫到全部寫出的時間 (微秒) */
+        unsigned long long max_wire_us;       /* 自呼叫到全部寫出的最長時間 (微秒) */
+        unsigned long long total_wire_us;     /* 自呼叫到全部寫出的時間總和 (微秒) */
+    } TL_PriorityStats;
+
+    /* 裝置重置偵測統計 (單一裝置) */
+    typedef struct {
+        unsigned long long reset_count;           /* 偵測到的重置次數 */
+        unsigned long long reenumeration_count;   /* 其中在USB重新列舉 (重新開啟裝置後恢復通訊) 時偵測到的次數 */
+        unsigned long long restore_count;         /* 成功重新送出完整狀態的次數 */
+        unsigned long long restore_failures;      /* 重新送出失敗的次數 */
+        unsigned long long last_restore_us;       /* 最近一次自偵測到重置至還原完成的時間 (微秒) */
+        unsigned long long max_restore_us;        /* 最長還原時間 (微秒) */
+        unsigned long long total_restore_us;      /* 還原時間總和 (微秒) */
+    } TL_ResetStats;
+
+    /* 命令速率限制統計 (單一裝置) */
+    typedef struct {
+        unsigned long rate_per_sec;               /* 目前的速率上限 (命令/秒)，0 表示不限制 */
+        unsigned long burst;                      /* 可連續送出的命令數 */
+        unsigned long long throttled_count;       /* 需要等待的命令數 */
+        unsigned long long total_wait_us;         /* 等待時間總和 (微秒) */
+        unsigned long long max_wait_us;           /* 最長等待時間 (微秒) */
+    } TL_RateLimitStats;
+
+    /* 裝置吞吐量校準結果 */
+    typedef struct {
+        unsigned long base_latency_us;            /* 低負載時單一命令的往返時間 (微秒) */
+        unsigned long max_rate;                   /* 無錯誤時的最高吞吐量 (命令/秒) */
+        unsigned int best_depth;                  /* 達到最高吞吐量的管線深度 (連續寫出的命令數) */
+        unsigned long knee_rate;                  /* 延遲明顯上升或裝置開始拒絕命令前的最高送出速率 (命令/秒) */
+        unsigned long knee_latency_us;            /* 以 knee_rate 送出時命令往返時間的中位數 (微秒) */
+        unsigned long recommended_rate;           /* 建議的速率上限 (命令/秒) */
+        unsigned long recommended_burst;          /* 建議的連續命令數 */
+        unsigned long long commands;              /* 校準期間送出的命令數 */
+        unsigned long long errors;                /* 校準期間的錯誤數 (拒絕、逾時等) */
+    } TL_CalibrationResult;
+
+    /* 排程識別碼，0 表示無效 */
+    typedef unsigned long long TL_TIMER_ID;
+
+    /* 排程命令執行完成回呼，於函式庫的工作執行緒 (或關閉裝置的執行緒) 呼叫 */
+    typedef void (*TL_ScheduleCallback)(TL_TIMER_ID id, TL_ERROR_CODE result, void* user_data);
+
+    /* 可輪詢的事件通知代碼 - Windows 為可等待的事件 HANDLE，其他平台為檔案描述符 */
+#ifdef _WIN32
+    typedef void* TL_POLL_FD;
+#else
+    typedef int TL_POLL_FD;
+#endif
+
+    /* 提交請求識別碼，0 表示無效 */
+    typedef unsigned long long TL_REQUEST_ID;
+
+    /* 事件類型定義 */
+    typedef enum {
+        TL_EVENT_COMMAND_COMPLETE = 0,   /* TL_SubmitCommand 提交的命令已完成 */
+        TL_EVENT_STATUS = 1,             /* TL_SubmitStatusRequest 的狀態讀取結果 */
+        TL_EVENT_DEVICE_ARRIVED = 2,     /* 系統中的塔燈數量增加 */
+        TL_EVENT_DEVICE_REMOVED = 3      /* 系統中的塔燈數量減少 */
+    } TL_EVENT_TYPE;
+
+    /* 事件結構 */
+    typedef struct {
+        TL_EVENT_TYPE type;               /* 事件類型 */
+        TL_REQUEST_ID request_id;         /* 對應的提交請求，熱插拔事件為 0 */
+        TL_DEVICE_HANDLE device;          /* 目標裝置，群組命令與熱插拔事件為 NULL */
+        TL_ERROR_CODE result;             /* 執行結果 */
+        TL_COMMAND_TYPE command_type;     /* TL_EVENT_COMMAND_COMPLETE 的命令類型 */
+        TL_TowerFrame status;             /* TL_EVENT_STATUS 讀取到的狀態，target_mask 為要求的目標 */
+        unsigned int device_count;        /* 熱插拔事件發生後系統中的塔燈數量 */
+    } TL_Event;
+
+    /* 期望狀態收斂統計 (單一裝置) */
+    typedef struct {
+        TL_BOOL converged;                        /* 已確認的狀態是否與期望狀態一致 */
+        unsigned int pending_mask;                /* 尚未一致的目標 (TL_FRAME_*) */
+        unsigned long long commands_sent;         /* 已送出的設定命令數 */
+        unsigned long long command_failures;      /* 失敗的設定或讀取數 */
+        unsigned long long verify_reads;          /* 狀態讀取次數 */
+        unsigned long long drift_count;           /* 讀回的狀態偏離已確認狀態 (例如裝置重置) 的次數 */
+        unsigned long backoff_ms;                 /* 目前的錯誤退避時間 (毫秒) */
+        unsigned long long convergence_count;     /* 收斂次數 */
+        unsigned long long last_convergence_us;   /* 最近一次自出現差異到收斂的時間 (微秒) */
+        unsigned long long max_convergence_us;    /* 最長收斂時間 (微秒) */
+        unsigned long long total_convergence_us;  /* 收斂時間總和 (微秒) */
+    } TL_ReconcileStats;
+
+    /* 輸入濾波設定 (單一目標)，全部為 0 表示不濾波 */
+    typedef struct {
+        unsigned long rise_debounce_ms;   /* 轉為點亮或改變點亮內容前，輸入須保持不變的時間 (毫秒) */
+        unsigned long fall_debounce_ms;   /* 轉為關閉前，輸入須保持不變的時間 (毫秒) */
+        unsigned long min_on_ms;          /* 點亮後至少保持的時間 (毫秒) */
+        unsigned long min_off_ms;         /* 關閉後至少保持的時間 (毫秒) */
+    } TL_FilterConfig;
+
+    /* 輸入濾波統計 (單一目標) */
+    typedef struct {
+        unsigned long long inputs;         /* 輸入次數 */
+        unsigned long long outputs;        /* 實際送出的設定命令數 */
+        unsigned long long suppressed;     /* 送出前即被新的輸入取代的輸入數 */
+        unsigned long long failures;       /* 送出失敗次數 */
+        unsigned long long last_delay_us;  /* 最近一次自輸入到送出的時間 (微秒) */
+        unsigned long long max_delay_us;   /* 自輸入到送出的最長時間 (微秒) */
+        TL_BOOL pending;                   /* 是否有尚未送出的輸入 */
+    } TL_FilterStats;
+
+    /* 失效安全看門狗統計 (單一裝置) */
+    typedef struct {
+        TL_BOOL armed;                             /* 是否已啟用 */
+        TL_BOOL tripped;                           /* 目前是否顯示安全畫面 (尚未收到新的心跳) */
+        unsigned long interval_ms;                 /* 心跳週期 (毫秒) */
+        unsigned long long heartbeats;             /* 心跳次數 */
+        unsigned long long min_margin_us;          /* 心跳距離期限的最小餘裕 (微秒) */
+        unsigned long long trip_count;             /* 送出安全畫面的次數 */
+        unsigned long long recoveries;             /* 觸發後再次收到心跳的次數 */
+        unsigned long long failsafe_failures;      /* 安全畫面送出失敗次數 */
+        unsigned long long last_trip_latency_us;   /* 最近一次自心跳期限到安全畫面送出完成的時間 (微秒) */
+        unsigned long long max_trip_latency_us;    /* 最長觸發延遲 (微秒) */
+        unsigned long long total_trip_latency_us;  /* 觸發延遲總和 (微秒) */
+    } TL_WatchdogStats;
+
+    /* 連線健康狀態定義 */
+    typedef enum {
+        TL_HEALTH_HEALTHY = 0,    /* 正常 */
+        TL_HEALTH_DEGRADED = 1,   /* 成功率或往返時間未達服務水準 */
+        TL_HEALTH_DEAD = 2        /* 連續多次逾時或USB傳輸失敗 */
+    } TL_HEALTH_STATE;
+
+    /* 未達服務水準的項目 (TL_HealthEvent 的 breaches) */
+#define TL_HEALTH_BREACH_P95      0x01  /* 往返時間第95百分位數超過上限 */
+#define TL_HEALTH_BREACH_P99      0x02  /* 往返時間第99百分位數超過上限 */
+#define TL_HEALTH_BREACH_SUCCESS  0x04  /* 成功率低於下限 */
+
+    /* 連線健康統計 (單一裝置) */
+    typedef struct {
+        TL_HEALTH_STATE state;                 /* 健康狀態 */
+        unsigned int breaches;                 /* 目前未達服務水準的項目 (TL_HEALTH_BREACH_*) */
+        unsigned int samples;                  /* 滑動視窗中的往返次數 */
+        unsigned int success_permille;         /* 視窗中的成功率 (千分比) */
+        unsigned int timeout_permille;         /* 視窗中的逾時率 (千分比) */
+        unsigned int consecutive_failures;     /* 連續逾時或USB傳輸失敗的次數 */
+        unsigned long long p50_us;             /* 視窗中往返時間的第50百分位數 (微秒) */
+        unsigned long long p95_us;             /* 第95百分位數 (微秒) */
+        unsigned long long p99_us;             /* 第99百分位數 (微秒) */
+        unsigned long long max_us;             /* 視窗中最長的往返時間 (微秒) */
+        unsigned long long idle_us;            /* 距離最後一次往返的時間 (微秒) */
+        unsigned long long round_trips;        /* 累計往返次數 */
+        unsigned long long timeouts;           /* 累計逾時次數 */
+        unsigned long long failures;           /* 累計其他失敗次數 */
+        unsigned long long probes;             /* 閒置時送出的探測次數 */
+        unsigned long long probe_failures;     /* 探測失敗次數 */
+        unsigned long long alerts;             /* 健康狀態或未達服務水準項目改變的通知次數 */
+    } TL_HealthStats;
+
+    /* 健康狀態通知結構 */
+    typedef struct {
+        TL_DEVICE_HANDLE device;               /* 裝置 */
+        TL_HEALTH_STATE previous_state;        /* 改變前的健康狀態 */
+        unsigned int previous_breaches;        /* 改變前未達服務水準的項目 */
+        TL_HealthStats stats;                  /* 目前的統計，包含新的狀態與項目 */
+    } TL_HealthEvent;
+
+    /* 健康狀態回呼，於函式庫內部執行緒呼叫，回呼中不可呼叫塔燈控制函式 */
+    typedef void (*TL_HealthCallback)(const TL_HealthEvent* event, void* user_data);
+
+    /* 連線健康監控設定 */
+    typedef struct {
+        unsigned long probe_interval_ms;       /* 閒置多久後送出探測 (讀取蜂鳴器狀態)，0 表示不探測 */
+        unsigned long evaluate_interval_ms;    /* 評估健康狀態的週期 (毫秒)，0 表示使用預設值 */
+        unsigned long long p95_slo_us;         /* 往返時間第95百分位數的上限 (微秒)，0 表示不檢查 */
+        unsigned long long p99_slo_us;         /* 往返時間第99百分位數的上限 (微秒)，0 表示不檢查 */
+        unsigned int min_success_permille;     /* 成功率下限 (千分比)，0 表示不檢查 */
+        unsigned int dead_after_failures;      /* 連續失敗幾次判定為無回應，0 表示使用預設值 */
+        TL_HealthCallback callback;            /* 狀態改變時的回呼，NULL 表示不通知 */
+        void* user_data;                       /* 回呼的使用者資料 */
+    } TL_HealthConfig;
+
+    /* 狀態日誌選項 (TL_OpenJournal 的 flags) */
+#define TL_JOURNAL_FLUSH  0x01  /* 每次更新後同步寫入磁碟，可承受斷電，但每次設定都需等待磁碟 */
+
+    /* 狀態日誌統計 (單一裝置) */
+    typedef struct {
+        TL_BOOL restored;                      /* 開啟裝置時是否已由日誌還原 */
+        unsigned int restored_mask;            /* 還原的目標 (TL_FRAME_*) */
+        unsigned long long restore_us;         /* 自呼叫開啟函式至還原完成的時間 (微秒) */
+        unsigned long long burst_us;           /* 其中連續寫出還原命令的時間 (微秒) */
+        unsigned long long restore_failures;   /* 還原失敗的次數 */
+        unsigned long long writes;             /* 寫入日誌的次數 */
+        unsigned long long skipped;            /* 狀態未改變而不需寫入的次數 */
+    } TL_JournalStats;
+
+    /* 動畫播放統計 (單一裝置) */
+    typedef struct {
+        TL_BOOL playing;                       /* 是否正在播放 */
+        unsigned int step_index;               /* 下一個要送出的步驟 */
+        unsigned long long steps_played;       /* 已送出的步驟數 */
+        unsigned long long loops_completed;    /* 已播放完的輪數 */
+        unsigned long long step_failures;      /* 送出失敗的步驟數 */
+        unsigned long long late_steps;         /* 晚於預定時間1毫秒以上才送出的步驟數 */
+        unsigned long long max_lag_us;         /* 步驟送出與預定時間的最大差距 (微秒) */
+    } TL_SequenceStats;
+
+    /* Modbus TCP 伺服器統計 (單一裝置) */
+    typedef struct {
+        unsigned short port;                   /* 監聽的連接埠 */
+        unsigned int client_count;             /* 目前的連線數 */
+        unsigned long long accepted_clients;   /* 接受的連線數 */
+        unsigned long long rejected_clients;   /* 超過連線數上限而拒絕的連線數 */
+        unsigned long long requests;           /* 處理的請求數 */
+        unsigned long long reads;              /* 成功的讀取請求數 */
+        unsigned long long writes;             /* 成功的寫入請求數 */
+        unsigned long long exceptions;         /* 以例外回應的請求數 */
+    } TL_ModbusStats;
+
+    /* 狀態推播伺服器統計 (單一裝置) */
+    typedef struct {
+        unsigned short port;                   /* 監聽的連接埠 */
+        unsigned int client_count;             /* 目前的連線數 (包含尚未完成握手的連線) */
+        unsigned int subscriber_count;         /* 目前已完成握手的訂閱者數 */
+        unsigned long long accepted_clients;   /* 接受的連線數 */
+        unsigned long long rejected_clients;   /* 超過連線數上限而拒絕的連線數 */
+        unsigned long long handshake_failures; /* 握手請求無效的連線數 */
+        unsigned long long broadcasts;         /* 廣播的狀態改變次數 */
+        unsigned long long messages_sent;      /* 送出的訊息總數 (所有訂閱者合計) */
+        unsigned long long compacted;          /* 尚未送出即被較新狀態取代的訊息數 */
+    } TL_PushStats;
+
+    /* 直方圖的區間數 - 區間 i 統計 [2^i, 2^(i+1)) 的數值，區間 0 包含 0，最後一個區間包含所有更大的值 */
+#define TL_HISTOGRAM_BUCKETS  24
+
+    /* 提交佇列統計 */
+    typedef struct {
+        unsigned long long submitted;                      /* 已接受的請求數 */
+        unsigned long long rejected;                       /* 佇列已滿而拒絕的請求數 */
+        unsigned long long expired;                        /* 超過期限而未送出的請求數 */
+        unsigned int max_depth;                            /* 最大佇列深度 */
+        unsigned long long depth[TL_HISTOGRAM_BUCKETS];    /* 每次提交後的佇列深度 */
+        unsigned long long wait_us[TL_HISTOGRAM_BUCKETS];  /* 請求在佇列中的等待時間 (微秒) */
+    } TL_QueueStats;
+
+    /* 事件處理回呼，於呼叫 TL_ProcessEvents 的執行緒呼叫 */
+    typedef void (*TL_EventCallback)(const TL_Event* event, void* user_data);
+
     /**
      * 初始化塔燈函式庫
      *
@@ -135,6 +543,7 @@ extern "C" {
      * 釋放塔燈函式庫資源
      *
      * 釋放函式庫分配的所有資源，應用程式結束前調用。
+     * 尚未銷毀的裝置群組與尚未關閉的裝置一併釋放，之後不可再使用其控制代碼。
      *
      * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
      */
@@ -162,7 +571,7 @@ extern "C" {
     /**
      * 檢查塔燈連接狀態
      *
-     * 檢查塔燈是否已連接。
+     * 檢查塔燈是否已連接。裝置已開啟但健康狀態為 TL_HEALTH_DEAD 時視為未連接。
      *
      * @return TL_TRUE 表示已連接，TL_FALSE 表示未連接
      */
@@ -219,6 +628,17 @@ extern "C" {
      */
     TL_API TL_ERROR_CODE TL_GetBuzzerStatus(TL_BuzzerStatus* status);
 
+    /**
+     * 取得整座塔燈的狀態快照
+     *
+     * 連續寫出三個LED層級與蜂鳴器的狀態讀取命令後一次接收所有回應，
+     * 耗時約為一次往返，而非逐一讀取的四次。讀取之間不會穿插其他命令。
+     *
+     * @param snapshot 用於儲存快照的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetTowerSnapshot(TL_TowerSnapshot* snapshot);
+
     /**
      * 停止蜂鳴器
      *
@@ -238,25 +658,1047 @@ extern "C" {
     TL_API TL_ERROR_CODE TL_ClearTowerLight(void);
 
     /**
-     * 取得最後一次發生的錯誤碼
+     * 取得已連接的塔燈數量
      *
-     * 返回最後一次操作產生的錯誤碼。
+     * @param count 用於儲存裝置數量的指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetDeviceCount(unsigned int* count);
+
+    /**
+     * 開啟指定的塔燈
      *
-     * @return 錯誤碼
+     * 開啟第 index 台塔燈 (依系統列舉順序)，可與 TL_OpenConnection 開啟的預設裝置並用。
+     * 新裝置沿用預設裝置目前的寫入模式、驗證週期與不一致回呼。
+     *
+     * @param index 裝置索引 (0 起算)
+     * @param clear_state 開啟後是否清除塔燈狀態
+     * @param device 用於儲存裝置控制代碼的指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
      */
-    TL_API TL_ERROR_CODE TL_GetLastError(void);
+    TL_API TL_ERROR_CODE TL_OpenDevice(unsigned int index, TL_BOOL clear_state, TL_DEVICE_HANDLE* device);
 
     /**
-     * 取得錯誤碼對應的錯誤訊息
+     * 關閉由 TL_OpenDevice 開啟的塔燈
      *
-     * 返回指定錯誤碼的說明文字。
+     * 傳入預設裝置時等同 TL_CloseConnection。裝置會先從所有裝置群組中移除，
+     * 進行中的群組套用結束後才關閉。
      *
-     * @param error_code 要查詢的錯誤碼
-     * @param buffer 用於儲存錯誤訊息的緩衝區
-     * @param buffer_size 緩衝區大小
+     * @param device 裝置控制代碼
      * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
      */
-    TL_API TL_ERROR_CODE TL_GetErrorMessage(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size);
+    TL_API TL_ERROR_CODE TL_CloseDevice(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得預設裝置的控制代碼
+     *
+     * @return 由 TL_OpenConnection 開啟的裝置，尚未開啟時為 NULL
+     */
+    TL_API TL_DEVICE_HANDLE TL_GetDefaultDevice(void);
+
+    /**
+     * 設定指定塔燈特定層LED的狀態
+     *
+     * @param device 裝置控制代碼
+     * @param layer 要設定的層級
+     * @param status LED狀態結構
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DeviceSetLED(TL_DEVICE_HANDLE device, TL_LAYER layer, const TL_LEDStatus* status);
+
+    /**
+     * 取得指定塔燈特定層LED的狀態
+     *
+     * @param device 裝置控制代碼
+     * @param layer 要讀取的層級
+     * @param status 用於儲存LED狀態的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DeviceGetLEDStatus(TL_DEVICE_HANDLE device, TL_LAYER layer, TL_LEDStatus* status);
+
+    /**
+     * 設定指定塔燈的蜂鳴器狀態
+     *
+     * @param device 裝置控制代碼
+     * @param status 蜂鳴器狀態結構
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DeviceSetBuzzer(TL_DEVICE_HANDLE device, const TL_BuzzerStatus* status);
+
+    /**
+     * 取得指定塔燈的蜂鳴器狀態
+     *
+     * @param device 裝置控制代碼
+     * @param status 用於儲存蜂鳴器狀態的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DeviceGetBuzzerStatus(TL_DEVICE_HANDLE device, TL_BuzzerStatus* status);
+
+    /**
+     * 取得指定塔燈的狀態快照
+     *
+     * @param device 裝置控制代碼
+     * @param snapshot 用於儲存快照的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DeviceGetTowerSnapshot(TL_DEVICE_HANDLE device, TL_TowerSnapshot* snapshot);
+
+    /**
+     * 建立裝置群組
+     *
+     * 為每台裝置建立一個常駐的工作執行緒，之後的 TL_GroupApplyFrame 可同時寫入所有裝置。
+     * 群組不擁有裝置；其中的裝置被關閉後，之後的套用對該裝置回報 TL_ERROR_DEVICE_NOT_OPEN。
+     *
+     * @param devices 裝置控制代碼陣列
+     * @param device_count 裝置數量
+     * @param group 用於儲存群組控制代碼的指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CreateDeviceGroup(const TL_DEVICE_HANDLE* devices, size_t device_count,
+                                              TL_GROUP_HANDLE* group);
+
+    /**
+     * 銷毀裝置群組
+     *
+     * @param group 群組控制代碼
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DestroyDeviceGroup(TL_GROUP_HANDLE group);
+
+    /**
+     * 將同一個塔燈畫面套用到群組中的所有裝置
+     *
+     * 命令只建構一次，由各裝置的工作執行緒平行寫入。use_barrier 為 TL_TRUE 時，
+     * 所有工作執行緒都就緒後才同時開始寫入，以縮小各塔燈之間的可見時間差。
+     *
+     * @param group 群組控制代碼
+     * @param frame 要套用的塔燈畫面
+     * @param use_barrier 是否等待所有裝置就緒後同時寫入
+     * @param results 各裝置的結果陣列 (依建立群組時的順序)，可為 NULL
+     * @param stats 群組統計，可為 NULL
+     * @return TL_SUCCESS 表示全部成功，否則為第一個失敗裝置的錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GroupApplyFrame(TL_GROUP_HANDLE group, const TL_TowerFrame* frame,
+                                            TL_BOOL use_barrier, TL_GroupDeviceResult* results,
+                                            TL_GroupStats* stats);
+
+    /**
+     * 取得函式庫使用的單調時間
+     *
+     * 不受系統時間調整影響，作為 TL_ScheduleAt 的時間基準。
+     *
+     * @return 自任意起點起算的毫秒數
+     */
+    TL_API unsigned long long TL_GetMonotonicTimeMs(void);
+
+    /**
+     * 在指定時間執行塔燈命令
+     *
+     * 所有排程由單一排程執行緒以階層式時間輪管理，新增與取消皆為 O(1)，
+     * 時間解析度為1毫秒。已過期的時間會在下一個時間刻度執行。
+     * 到期的命令交給 TL_SubmitCommand 的提交佇列執行 (依 priority 與 deadline_ms
+     * 處理，計入 TL_GetQueueStats，但不產生事件)，無回應的塔燈不會延遲其他排程。
+     * 關閉命令指定的裝置或銷毀群組時，尚未執行的排程即被取消，
+     * 完成回呼收到 TL_ERROR_DEVICE_NOT_OPEN；執行中的排程會先等待結束。
+     *
+     * @param time_ms 執行時間 (TL_GetMonotonicTimeMs 的時間基準)
+     * @param command 要執行的命令 (會被複製)
+     * @param callback 執行完成回呼，可為 NULL；回呼中可再次排程
+     * @param user_data 傳給回呼的使用者資料
+     * @param id 用於儲存排程識別碼的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_ScheduleAt(unsigned long long time_ms, const TL_TowerCommand* command,
+                                       TL_ScheduleCallback callback, void* user_data, TL_TIMER_ID* id);
+
+    /**
+     * 在指定延遲後執行塔燈命令
+     *
+     * @param delay_ms 延遲時間 (毫秒)
+     * @param command 要執行的命令 (會被複製)
+     * @param callback 執行完成回呼，可為 NULL
+     * @param user_data 傳給回呼的使用者資料
+     * @param id 用於儲存排程識別碼的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_ScheduleAfter(unsigned long delay_ms, const TL_TowerCommand* command,
+                                          TL_ScheduleCallback callback, void* user_data, TL_TIMER_ID* id);
+
+    /**
+     * 取消尚未執行的排程
+     *
+     * 取消後不會呼叫完成回呼。
+     *
+     * @param id 排程識別碼
+     * @return TL_SUCCESS 表示已取消，TL_ERROR_INVALID_PARAMETER 表示排程不存在或已執行
+     */
+    TL_API TL_ERROR_CODE TL_CancelScheduled(TL_TIMER_ID id);
+
+    /**
+     * 立即執行塔燈命令
+     *
+     * 命令設有 deadline_ms 時，若執行前或等待裝置期間超過期限，
+     * 命令不會送出並返回 TL_ERROR_EXPIRED。
+     *
+     * @param command 要執行的命令
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_ExecuteCommand(const TL_TowerCommand* command);
+
+    /**
+     * 設定裝置的期望狀態
+     *
+     * 以宣告方式指定塔燈應呈現的狀態，由該裝置的背景收斂執行緒比對期望狀態與
+     * 已確認狀態 (來自設定命令的回應與定期的狀態讀取)，只對不一致的目標送出設定命令。
+     * 裝置重置或寫入失敗後會重新送出，連續錯誤時以指數退避重試。
+     * 期望狀態中的目標應只由收斂執行緒設定，不應再以 TL_SetLED 等函數直接設定。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param desired 期望狀態，只更新 target_mask 指定的目標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetDesiredState(TL_DEVICE_HANDLE device, const TL_TowerFrame* desired);
+
+    /**
+     * 停止裝置的期望狀態收斂
+     *
+     * 結束收斂執行緒並清除期望狀態，塔燈維持目前的狀態。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopReconcile(TL_DEVICE_HANDLE device);
+
+    /**
+     * 等待裝置收斂到期望狀態
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param timeout_ms 最長等待時間 (毫秒)
+     * @return TL_SUCCESS 表示已收斂，TL_ERROR_TIMEOUT 表示逾時，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_WaitForConvergence(TL_DEVICE_HANDLE device, unsigned long timeout_ms);
+
+    /**
+     * 取得期望狀態收斂統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetReconcileStats(TL_DEVICE_HANDLE device, TL_ReconcileStats* stats);
+
+    /**
+     * 設定輸入濾波參數
+     *
+     * 經由 TL_FilterLED / TL_FilterBuzzer 送入的狀態先經過去彈跳與遲滯濾波，
+     * 抖動期間被取代的輸入不會送出。保持不變的輸入最遲在
+     * max(去彈跳時間, 目前輸出剩餘的最短保持時間) 後送出。
+     * 同一目標不應同時使用 TL_SetDesiredState。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param target_mask 要套用設定的目標 (TL_FRAME_*)
+     * @param config 濾波設定
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetFilterConfig(TL_DEVICE_HANDLE device, unsigned int target_mask,
+                                            const TL_FilterConfig* config);
+
+    /**
+     * 經由輸入濾波器設定LED層級
+     *
+     * 立即返回，設定命令由背景執行緒在輸入通過濾波後送出。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param layer 要設定的層級
+     * @param status LED狀態結構
+     * @return TL_SUCCESS 表示已接受輸入，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FilterLED(TL_DEVICE_HANDLE device, TL_LAYER layer, const TL_LEDStatus* status);
+
+    /**
+     * 經由輸入濾波器設定蜂鳴器
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param status 蜂鳴器狀態結構
+     * @return TL_SUCCESS 表示已接受輸入，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FilterBuzzer(TL_DEVICE_HANDLE device, const TL_BuzzerStatus* status);
+
+    /**
+     * 停止裝置的輸入濾波
+     *
+     * 尚未送出的輸入即捨棄，濾波設定與統計一併清除。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopFilter(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得輸入濾波統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param target 目標 (0~2: LED層級, 3: 蜂鳴器)
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetFilterStats(TL_DEVICE_HANDLE device, int target, TL_FilterStats* stats);
+
+    /**
+     * 啟用失效安全看門狗
+     *
+     * 啟用後須在 interval_ms 內呼叫 TL_Heartbeat，逾期時函式庫的看門狗執行緒
+     * 以緊急優先權送出 failsafe 畫面，並停止該裝置的動畫、期望狀態收斂與輸入濾波；
+     * 該裝置尚未執行的排程 (TL_ScheduleCallback 等) 與提交的命令 (TL_SubmitCommand)
+     * 以 TL_ERROR_DEVICE_NOT_OPEN 完成。
+     * 已啟用時呼叫會更新設定並重新起算期限。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param interval_ms 心跳週期 (毫秒)
+     * @param failsafe 安全畫面，於啟用時預先建構
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StartWatchdog(TL_DEVICE_HANDLE device, unsigned long interval_ms,
+                                          const TL_TowerFrame* failsafe);
+
+    /**
+     * 送出心跳
+     *
+     * 重新起算看門狗期限。已送出安全畫面時即恢復監控，塔燈的狀態須由應用程式重新設定。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，未啟用看門狗時返回 TL_ERROR_GENERAL
+     */
+    TL_API TL_ERROR_CODE TL_Heartbeat(TL_DEVICE_HANDLE device);
+
+    /**
+     * 停用失效安全看門狗
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopWatchdog(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得失效安全看門狗統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標，未啟用時全部為 0
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetWatchdogStats(TL_DEVICE_HANDLE device, TL_WatchdogStats* stats);
+
+    /**
+     * 啟用連線健康監控
+     *
+     * 健康統計一律由命令往返記錄於滑動視窗中；啟用監控後，函式庫的監控執行緒
+     * 於閒置時送出探測，並定期評估健康狀態，狀態或未達服務水準的項目改變時
+     * 呼叫回呼。已啟用時呼叫會更新設定。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param config 監控設定
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StartHealthMonitor(TL_DEVICE_HANDLE device, const TL_HealthConfig* config);
+
+    /**
+     * 停用連線健康監控
+     *
+     * 停止探測與通知，健康統計仍持續記錄。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopHealthMonitor(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得連線健康統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetHealthStats(TL_DEVICE_HANDLE device, TL_HealthStats* stats);
+
+    /**
+     * 開始記錄命令追蹤
+     *
+     * 記錄 API 呼叫、命令構建、等待、往返、USB寫入與回應讀取各階段的時間，
+     * 每個執行緒保留最近的 events_per_thread 個事件。已在記錄時重新開始並捨棄先前的事件。
+     *
+     * @param events_per_thread 每個執行緒保留的事件數，0 表示使用預設值 (16384)
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StartTrace(unsigned int events_per_thread);
+
+    /**
+     * 停止記錄命令追蹤
+     *
+     * 已記錄的事件保留至下一次 TL_StartTrace 或 TL_Finalize。
+     *
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopTrace(void);
+
+    /**
+     * 將命令追蹤寫出為 Chrome/Perfetto 追蹤檔 (JSON)
+     *
+     * 記錄中也可呼叫，寫出期間被覆寫的事件會略過。
+     *
+     * @param path 輸出檔案路徑
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_WriteTrace(const char* path);
+
+    /**
+     * 開啟狀態日誌
+     *
+     * 以記憶體映射檔案記錄每台裝置 (以裝置路徑區分，重新插拔或列舉順序改變後仍對應
+     * 同一台，最多 16 台) 最後的期望狀態與已確認狀態，每次改變都以不會半途損毀的方式
+     * 寫入。開啟日誌後，TL_OpenConnection 與 TL_OpenDevice 若找到該裝置的記錄，會以
+     * 一次連續寫出還原記錄中的目標，其餘目標在 clear_state 為 TL_TRUE 時照常清除；
+     * 有期望狀態的目標以期望狀態為準。應於開啟裝置前呼叫，已開啟日誌時會換成新的檔案。
+     * 舊版格式的日誌檔案返回 TL_ERROR_FILE_FORMAT。
+     *
+     * @param path 日誌檔案路徑，不存在時建立
+     * @param flags 選項 (TL_JOURNAL_*)，0 表示由作業系統寫回 (程式當機不會遺失)
+     * @return TL_SUCCESS 表示成功，TL_ERROR_FILE_FORMAT 表示檔案不是狀態日誌
+     */
+    TL_API TL_ERROR_CODE TL_OpenJournal(const char* path, unsigned int flags);
+
+    /**
+     * 關閉狀態日誌
+     *
+     * 檔案保留最後的記錄，供下一次開啟日誌時還原。
+     *
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CloseJournal(void);
+
+    /**
+     * 取得狀態日誌統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetJournalStats(TL_DEVICE_HANDLE device, TL_JournalStats* stats);
+
+    /**
+     * 編譯動畫序列庫
+     *
+     * 將文字定義編譯為二進位序列庫：每個步驟存放壓縮的塔燈狀態、持續時間與
+     * 預先建構的設定命令，並依名稱建立索引。文字定義每行一項，# 開頭為註解：
+     *   sequence <名稱> [repeat <次數>]     開始一個序列，次數 0 表示不斷重複，預設為 1
+     *   <毫秒> <第一層> <第二層> <第三層> <蜂鳴器>
+     * LED 寫成 RGB/P (紅綠藍各為 TL_LED_STATE 的數值，P 為 TL_LED_PATTERN)，例如 100/1；
+     * 蜂鳴器寫成 TV/P (音調、音量與模式的數值)，例如 01/2；- 表示該目標不變。
+     *
+     * @param source_file 文字定義檔案路徑
+     * @param output_file 輸出的序列庫檔案路徑
+     * @return TL_SUCCESS 表示成功，TL_ERROR_FILE_FORMAT 表示文字定義有誤
+     */
+    TL_API TL_ERROR_CODE TL_CompileSequenceLibrary(const char* source_file, const char* output_file);
+
+    /**
+     * 載入動畫序列庫
+     *
+     * 以記憶體映射方式載入由 TL_CompileSequenceLibrary 產生的序列庫，只檢查一次格式，
+     * 播放時直接由映射區送出預先建構的命令。
+     *
+     * @param filename 序列庫檔案路徑
+     * @param library 用於存儲序列庫控制代碼
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_LoadSequenceLibrary(const char* filename, TL_SEQUENCE_LIBRARY* library);
+
+    /**
+     * 釋放動畫序列庫
+     *
+     * 正在播放的序列會播放到停止為止，之後才解除映射。
+     *
+     * @param library 序列庫控制代碼
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_UnloadSequenceLibrary(TL_SEQUENCE_LIBRARY library);
+
+    /**
+     * 播放動畫序列
+     *
+     * 由函式庫的播放執行緒依各步驟的持續時間送出設定命令；已在播放時改為播放新的序列。
+     * 失效安全看門狗觸發時停止播放。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param library 序列庫控制代碼
+     * @param name 序列名稱
+     * @return TL_SUCCESS 表示成功，TL_ERROR_OUT_OF_RANGE 表示找不到序列
+     */
+    TL_API TL_ERROR_CODE TL_PlaySequence(TL_DEVICE_HANDLE device, TL_SEQUENCE_LIBRARY library, const char* name);
+
+    /**
+     * 停止播放動畫序列
+     *
+     * 塔燈維持最後送出的步驟。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopSequence(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得動畫播放統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetSequenceStats(TL_DEVICE_HANDLE device, TL_SequenceStats* stats);
+
+    /**
+     * 載入警報代碼對照表
+     *
+     * 由文字定義建立警報代碼到塔燈畫面與優先權的對照表，每行一項，# 開頭為註解：
+     *   <代碼> <第一層> <第二層> <第三層> <蜂鳴器> [normal|emergency]
+     * 代碼為十進位整數，目標的寫法與 TL_CompileSequenceLibrary 相同，- 表示不包含該目標；
+     * 優先權預設為 normal。載入時建立最小完美雜湊，重複的代碼視為格式錯誤。
+     *
+     * @param filename 文字定義檔案路徑
+     * @param map 用於存儲對照表控制代碼
+     * @return TL_SUCCESS 表示成功，TL_ERROR_FILE_FORMAT 表示文字定義有誤
+     */
+    TL_API TL_ERROR_CODE TL_LoadAlarmMap(const char* filename, TL_ALARM_MAP* map);
+
+    /**
+     * 釋放警報代碼對照表
+     *
+     * 呼叫端須確保沒有其他執行緒仍在查詢。
+     *
+     * @param map 對照表控制代碼
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_UnloadAlarmMap(TL_ALARM_MAP map);
+
+    /**
+     * 查詢警報代碼
+     *
+     * 固定時間查詢，不配置記憶體，可由多個執行緒同時呼叫。找到時將命令設為
+     * TL_COMMAND_APPLY_FRAME，並填入 frame 與 priority；其他欄位 (device、deadline_ms 等)
+     * 維持呼叫端的設定，可直接交給 TL_SubmitCommand 或 TL_ExecuteCommand。
+     *
+     * @param map 對照表控制代碼
+     * @param code 警報代碼
+     * @param command 用於存儲命令的結構指標
+     * @return TL_SUCCESS 表示成功，TL_ERROR_OUT_OF_RANGE 表示代碼不在對照表中 (命令不變)
+     */
+    TL_API TL_ERROR_CODE TL_LookupAlarm(TL_ALARM_MAP map, unsigned int code, TL_TowerCommand* command);
+
+    /**
+     * 啟動 Modbus TCP 伺服器
+     *
+     * 讓 PLC 以 Modbus TCP 讀寫裝置的狀態 (功能碼 03、04、06、16)，每個暫存器為一個目標
+     * 在 TL_TowerState 中的位元組：
+     *   保持暫存器 0~3：第一層、第二層、第三層、蜂鳴器的期望狀態，寫入時等同 TL_SetDesiredState
+     *   輸入暫存器 0~3：各目標的已確認狀態
+     *   輸入暫存器 4  ：尚未收斂的目標遮罩 (TL_FRAME_*)
+     * 讀取由函式庫保存的狀態直接回應，不經過USB；寫入由收斂執行緒合併後送出。
+     * 已啟動時先停止原本的伺服器。關閉裝置時自動停止，與關閉同時呼叫時不會啟動。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param address 監聽的IPv4位址，NULL 表示所有介面
+     * @param port 監聽的連接埠 (Modbus 標準為 502)，0 表示由系統指定 (見 TL_GetModbusStats)
+     * @return TL_SUCCESS 表示成功，TL_ERROR_DEVICE_OPEN_FAILED 表示無法監聽該位址，
+     *         TL_ERROR_DEVICE_NOT_OPEN 表示裝置未開啟或正在關閉
+     */
+    TL_API TL_ERROR_CODE TL_StartModbusServer(TL_DEVICE_HANDLE device, const char* address, unsigned short port);
+
+    /**
+     * 停止 Modbus TCP 伺服器
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopModbusServer(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得 Modbus TCP 伺服器統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標 (未啟動時全部為 0)
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetModbusStats(TL_DEVICE_HANDLE device, TL_ModbusStats* stats);
+
+    /**
+     * 啟動狀態推播伺服器
+     *
+     * 以 WebSocket 將裝置目前狀態的改變推送給所有訂閱者 (最多 1024 個)。每則訊息為 9 位元組的
+     * 二進位訊框：類型 (1)、序號 (4)、TL_TowerState (4)，皆為小端序；連線完成時先送出目前的狀態。
+     * 讀取緩慢的訂閱者不會累積佇列，尚未送出的舊狀態直接被最新狀態取代，序號因此不連續。
+     * 已啟動時先停止原本的伺服器。關閉裝置時自動停止，與關閉同時呼叫時不會啟動。
+     * 每個訂閱者占用一個通訊端，行程的開啟檔案數上限須容納所有訂閱者。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param address 監聽的IPv4位址，NULL 表示所有介面
+     * @param port 監聽的連接埠，0 表示由系統指定 (見 TL_GetPushStats)
+     * @return TL_SUCCESS 表示成功，TL_ERROR_DEVICE_OPEN_FAILED 表示無法監聽該位址，
+     *         TL_ERROR_DEVICE_NOT_OPEN 表示裝置未開啟或正在關閉
+     */
+    TL_API TL_ERROR_CODE TL_StartPushServer(TL_DEVICE_HANDLE device, const char* address, unsigned short port);
+
+    /**
+     * 停止狀態推播伺服器
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_StopPushServer(TL_DEVICE_HANDLE device);
+
+    /**
+     * 取得狀態推播伺服器統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標 (未啟動時全部為 0)
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetPushStats(TL_DEVICE_HANDLE device, TL_PushStats* stats);
+
+    /**
+     * 將塔燈畫面壓縮為塔燈狀態字組
+     *
+     * @param frame 塔燈畫面，未在 target_mask 中的目標以 0 (全部關閉) 表示
+     * @param state 用於存儲壓縮狀態的指標
+     * @return TL_SUCCESS 表示成功，狀態值超出範圍時返回 TL_ERROR_INVALID_PARAMETER
+     */
+    TL_API TL_ERROR_CODE TL_PackTowerState(const TL_TowerFrame* frame, TL_TowerState* state);
+
+    /**
+     * 將塔燈狀態字組還原為塔燈畫面
+     *
+     * @param state 壓縮狀態
+     * @param frame 用於存儲畫面的結構指標，target_mask 設為 TL_FRAME_ALL
+     * @return TL_SUCCESS 表示成功，字組含有無效的狀態值時返回 TL_ERROR_INVALID_PARAMETER
+     */
+    TL_API TL_ERROR_CODE TL_UnpackTowerState(TL_TowerState state, TL_TowerFrame* frame);
+
+    /**
+     * 比較兩個塔燈狀態
+     *
+     * @param a 狀態一
+     * @param b 狀態二
+     * @return 狀態不同的目標 (TL_FRAME_*)，0 表示相同
+     */
+    TL_API unsigned int TL_DiffTowerState(TL_TowerState a, TL_TowerState b);
+
+    /**
+     * 取得裝置目前與期望的塔燈狀態
+     *
+     * 目前狀態為各目標最後一次送出的設定或讀回的狀態；期望狀態由 TL_SetDesiredState 設定，
+     * 尚未指定的目標為 0。兩者皆以原子操作更新，可在任何執行緒讀取而不需加鎖。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param current 用於存儲目前狀態的指標，可為 NULL
+     * @param desired 用於存儲期望狀態的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetTowerState(TL_DEVICE_HANDLE device, TL_TowerState* current, TL_TowerState* desired);
+
+    /**
+     * 建立塔燈狀態集合
+     *
+     * 以連續陣列存放大量塔燈的期望與實際壓縮狀態，供監控節點快速找出需要送出命令的塔燈。
+     * 塔燈以 0 ~ tower_count-1 的索引表示，初始狀態皆為 0，集合不與任何裝置綁定。
+     *
+     * @param tower_count 塔燈數量
+     * @param fleet 用於存儲集合控制代碼的指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CreateFleet(size_t tower_count, TL_FLEET_HANDLE* fleet);
+
+    /**
+     * 銷毀塔燈狀態集合
+     *
+     * @param fleet 集合控制代碼
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_DestroyFleet(TL_FLEET_HANDLE fleet);
+
+    /**
+     * 更新連續多座塔燈的期望狀態
+     *
+     * @param fleet 集合控制代碼
+     * @param first 第一座塔燈的索引
+     * @param states 期望狀態陣列
+     * @param count 塔燈數量
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FleetSetDesired(TL_FLEET_HANDLE fleet, size_t first,
+                                            const TL_TowerState* states, size_t count);
+
+    /**
+     * 更新連續多座塔燈的實際狀態
+     *
+     * @param fleet 集合控制代碼
+     * @param first 第一座塔燈的索引
+     * @param states 實際狀態陣列
+     * @param count 塔燈數量
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FleetSetActual(TL_FLEET_HANDLE fleet, size_t first,
+                                           const TL_TowerState* states, size_t count);
+
+    /**
+     * 取得單一塔燈的期望與實際狀態
+     *
+     * @param fleet 集合控制代碼
+     * @param index 塔燈索引
+     * @param desired 用於存儲期望狀態的指標，可為 NULL
+     * @param actual 用於存儲實際狀態的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FleetGetState(TL_FLEET_HANDLE fleet, size_t index,
+                                          TL_TowerState* desired, TL_TowerState* actual);
+
+    /**
+     * 找出期望狀態與實際狀態不同的塔燈
+     *
+     * 自 *cursor 開始掃描，找到 max_count 座或掃描到結尾為止，*cursor 更新為下次
+     * 應繼續掃描的位置；等於塔燈數量時表示本輪已掃描完畢，呼叫端將其設回 0 開始下一輪。
+     * 支援時以 AVX2 或 SSE2 一次比較多座塔燈，其他平台使用純量比較。
+     *
+     * @param fleet 集合控制代碼
+     * @param cursor 掃描位置，輸入為開始位置，輸出為下次的開始位置
+     * @param indices 用於存儲不一致塔燈索引的陣列
+     * @param masks 用於存儲各塔燈不一致目標 (TL_FRAME_*) 的陣列，可為 NULL
+     * @param max_count 陣列大小
+     * @param found 用於存儲找到的塔燈數量
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_FleetScanDirty(TL_FLEET_HANDLE fleet, size_t* cursor, size_t* indices,
+                                           unsigned int* masks, size_t max_count, size_t* found);
+
+    /**
+     * 取得緊急通道統計
+     *
+     * TL_ClearTowerLight、TL_StopBuzzer 與緊急優先權的命令使用預先建構的命令，
+     * 並在目前進行中的命令往返結束後立即連續寫出 (蜂鳴器最先)，全部寫出後才接收回應；
+     * 之前尚未送出、且目標被緊急命令
+     * 涵蓋的一般命令以 TL_ERROR_SUPERSEDED 結束。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetPriorityStats(TL_DEVICE_HANDLE device, TL_PriorityStats* stats);
+
+    /**
+     * 檢查裝置是否曾經重置
+     *
+     * 讀取所有最後設定為點亮 (或鳴響) 的目標，全部讀回為關閉時判定裝置曾斷電重置，
+     * 立即以一次連續寫出重新送出所有目標最後的設定。一般的狀態讀取讀到上述情形時
+     * 也會自動做相同的檢查；同步模式下寫入或讀取失敗時，會依裝置介面路徑重新開啟
+     * 同一台裝置 (USB重新列舉後索引可能改變) 並重試該命令，重新開啟後同樣讀回
+     * 點亮的目標全部為關閉時才判定為重置並還原狀態。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param reset_detected 用於存儲是否偵測到重置的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CheckDeviceReset(TL_DEVICE_HANDLE device, TL_BOOL* reset_detected);
+
+    /**
+     * 取得裝置重置偵測統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetResetStats(TL_DEVICE_HANDLE device, TL_ResetStats* stats);
+
+    /**
+     * 設定裝置的命令速率上限
+     *
+     * 以權杖桶限制一般命令 (設定與狀態讀取) 送出的速率：桶中最多存放 burst 個權杖，
+     * 每秒補充 rate_per_sec 個，沒有權杖的命令會等待。緊急命令與重置後的狀態還原不受限制。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param rate_per_sec 每秒最多送出的命令數，0 表示不限制
+     * @param burst 可連續送出的命令數，0 視為 1
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetRateLimit(TL_DEVICE_HANDLE device, unsigned long rate_per_sec, unsigned long burst);
+
+    /**
+     * 取得命令速率限制統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於存儲統計的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetRateLimitStats(TL_DEVICE_HANDLE device, TL_RateLimitStats* stats);
+
+    /**
+     * 校準裝置的命令吞吐量
+     *
+     * 以不改變塔燈狀態的狀態讀取命令量測：先量測單一命令的往返時間，再逐步加大
+     * 連續寫出的命令數 (管線深度) 找出最高吞吐量，最後以開環負載找出延遲拐點：
+     * 依固定間隔寫出命令而不等待回應 (回應由另一個執行緒同時接收)，從最高吞吐量的
+     * 一半開始每步提高 25%，直到裝置拒絕命令、回應逾時或往返時間的中位數超過第一步的
+     * 1.5 倍 (同一速率連續三次)，再於最後通過與未通過的速率之間二分三次，通過的
+     * 最高實際送出速率即為拐點。
+     * 建議的速率上限為拐點速率的九成。
+     * 校準期間其他命令會穿插在各步驟之間執行。只能在同步寫入模式下使用。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param max_depth 嘗試的最大管線深度，0 表示使用預設值 (16)
+     * @param apply 是否以建議值呼叫 TL_SetRateLimit
+     * @param result 用於存儲校準結果的結構指標
+     * @return TL_SUCCESS 表示成功，非同步模式下返回 TL_ERROR_GENERAL，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CalibrateDevice(TL_DEVICE_HANDLE device, unsigned int max_depth, TL_BOOL apply,
+                                            TL_CalibrationResult* result);
+
+    /**
+     * 取得可輪詢的事件通知代碼
+     *
+     * 有尚未處理的事件時代碼處於可讀 (Windows 為已觸發) 狀態，可加入
+     * epoll / poll / libuv 或 WaitForMultipleObjects；可讀時呼叫 TL_ProcessEvents。
+     * 代碼由函式庫擁有，呼叫端不可關閉，TL_Finalize 後失效。
+     *
+     * @param fd 用於存儲代碼的指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetPollFd(TL_POLL_FD* fd);
+
+    /**
+     * 提交塔燈命令，不等待執行
+     *
+     * 命令放入提交佇列後立即返回，由函式庫的工作執行緒執行；同一裝置
+     * (或群組) 的命令依優先權、再依提交順序執行，不同裝置之間平行執行。
+     * 每台處理中的裝置 (或群組) 佔用一個工作執行緒，依需要增加到最多 64 個，
+     * 無回應的塔燈不會延遲其他塔燈；同時處理中的對象超過 64 個時其餘在佇列中等待。
+     * 緊急命令會取消佇列中同一裝置、目標被其涵蓋的一般命令 (以 TL_ERROR_SUPERSEDED 完成)。
+     * 超過 deadline_ms 仍未送出的命令從佇列中移除，以 TL_ERROR_EXPIRED 完成。
+     * 完成時產生 TL_EVENT_COMMAND_COMPLETE 事件。
+     *
+     * @param command 要執行的命令 (會被複製)，device 為 NULL 時使用預設裝置
+     * @param request_id 用於儲存請求識別碼的指標，可為 NULL
+     * @return TL_SUCCESS 表示已提交，TL_ERROR_QUEUE_FULL 表示佇列已滿，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SubmitCommand(const TL_TowerCommand* command, TL_REQUEST_ID* request_id);
+
+    /**
+     * 提交狀態讀取，不等待執行
+     *
+     * 讀取完成時產生 TL_EVENT_STATUS 事件，讀取結果放在事件的 status 欄位。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param target_mask 要讀取的目標 (TL_FRAME_*)
+     * @param request_id 用於儲存請求識別碼的指標，可為 NULL
+     * @return TL_SUCCESS 表示已提交，TL_ERROR_QUEUE_FULL 表示佇列已滿，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SubmitStatusRequest(TL_DEVICE_HANDLE device, unsigned int target_mask,
+                                                TL_REQUEST_ID* request_id);
+
+    /**
+     * 處理待處理的事件
+     *
+     * 依發生順序對每個事件呼叫 callback，不會等待新事件。事件全部處理完後
+     * 通知代碼回到不可讀狀態。回呼中可再次提交命令。
+     *
+     * @param callback 事件處理回呼
+     * @param user_data 傳給回呼的使用者資料
+     * @param max_events 本次最多處理的事件數，0 表示處理目前所有事件
+     * @param processed 用於儲存已處理事件數的指標，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_ProcessEvents(TL_EventCallback callback, void* user_data,
+                                          unsigned int max_events, unsigned int* processed);
+
+    /**
+     * 取得提交佇列統計
+     *
+     * 可依佇列深度與等待時間的直方圖調整佇列容量與命令期限。
+     *
+     * @param stats 用於存儲統計的結構指標
+     * @param reset 是否在讀取後歸零
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetQueueStats(TL_QueueStats* stats, TL_BOOL reset);
+
+    /**
+     * 設定寫入模式
+     *
+     * TL_WRITE_MODE_FIRE_AND_FORGET 模式下，TL_SetLED / TL_SetBuzzer 在
+     * 命令寫出後即返回，回應由背景執行緒依序接收並驗證；另外每隔
+     * verify_interval_ms 讀取一次裝置狀態並與影子狀態比對，不一致時
+     * 透過 TL_SetMismatchCallback 設定的回呼通知。
+     * TL_WRITE_MODE_PIPELINED 模式下，設定命令仍等待並驗證各自的回應，
+     * 但多個執行緒的命令可同時在途，數量由 TL_SetPipelineDepth 限制。
+     * 寫入模式在裝置開啟時套用：預設裝置於 TL_OpenConnection，TL_OpenDevice 開啟的
+     * 裝置沿用預設裝置當時的設定。裝置開啟期間只能修改驗證週期，切換模式須先關閉裝置。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置 (未開啟時也可設定)
+     * @param mode 寫入模式
+     * @param verify_interval_ms 狀態驗證週期 (毫秒)，0 表示不做週期驗證
+     * @return TL_SUCCESS 表示成功，TL_ERROR_DEVICE_BUSY 表示裝置開啟中無法切換模式
+     */
+    TL_API TL_ERROR_CODE TL_SetWriteMode(TL_DEVICE_HANDLE device, TL_WRITE_MODE mode,
+                                         unsigned long verify_interval_ms);
+
+    /**
+     * 設定寫入不一致回呼
+     *
+     * 預設裝置的回呼由之後以 TL_OpenDevice 開啟的裝置沿用。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置 (未開啟時也可設定)
+     * @param callback 回呼函式，NULL 表示取消
+     * @param user_data 傳給回呼的使用者資料
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetMismatchCallback(TL_DEVICE_HANDLE device, TL_MismatchCallback callback,
+                                                void* user_data);
+
+    /**
+     * 等待裝置所有已送出命令的回應
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param timeout_ms 最長等待時間 (毫秒)
+     * @return TL_SUCCESS 表示全部回應皆正確 (同步模式下沒有在途命令)，
+     *         否則為上次呼叫以來第一個背景錯誤或 TL_ERROR_TIMEOUT
+     */
+    TL_API TL_ERROR_CODE TL_FlushWrites(TL_DEVICE_HANDLE device, unsigned long timeout_ms);
+
+    /**
+     * 取得裝置的非同步寫入統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於儲存統計資料的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetAsyncStats(TL_DEVICE_HANDLE device, TL_AsyncStats* stats);
+
+    /**
+     * 設定管線深度
+     *
+     * 非同步與管線寫入模式下，最多允許 depth 個命令同時等待回應，
+     * 超過時送出命令的呼叫端等待前面的回應。1 等同於逐一等待回應。
+     * 協定沒有序號，同類型的回應無法區分：同類型命令 (例如LED設定) 最多 8 個同時在途，
+     * 其中一個回應遺失時，最後一個命令逾時前可能有其餘命令被確認為另一個命令的回應。
+     * 塔燈可容納的命令數有限，可參考 TL_CalibrateDevice 的 best_depth。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param depth 管線深度 (1~32，預設 32)
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetPipelineDepth(TL_DEVICE_HANDLE device, unsigned int depth);
+
+    /**
+     * 設定逾時參數
+     *
+     * 讀取逾時依量測的往返時間自動調整 (SRTT + 4 * RTTVAR)，
+     * 並限制在此處設定的下限與上限之間。每台裝置各自估計往返時間；
+     * 預設裝置的設定可在開啟前修改，之後由 TL_OpenDevice 開啟的裝置沿用。
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param config 逾時設定結構
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetTimeoutConfig(TL_DEVICE_HANDLE device, const TL_TimeoutConfig* config);
+
+    /**
+     * 取得逾時參數
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param config 用於儲存逾時設定的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetTimeoutConfig(TL_DEVICE_HANDLE device, TL_TimeoutConfig* config);
+
+    /**
+     * 取得往返時間統計
+     *
+     * @param device 目標裝置，NULL 表示預設裝置
+     * @param stats 用於儲存統計資料的結構指標
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetRttStats(TL_DEVICE_HANDLE device, TL_RttStats* stats);
+
+    /**
+     * 取得最後一次發生的錯誤碼
+     *
+     * 返回最後一次操作產生的錯誤碼。
+     *
+     * @return 錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetLastError(void);
+
+    /**
+     * 取得錯誤碼對應的錯誤訊息
+     *
+     * 返回指定錯誤碼的說明文字。
+     *
+     * @param error_code 要查詢的錯誤碼
+     * @param buffer 用於儲存錯誤訊息的緩衝區
+     * @param buffer_size 緩衝區大小
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetErrorMessage(TL_ERROR_CODE error_code, char* buffer, size_t buffer_size);
+
+    /**
+     * 取得錯誤碼對應的錯誤訊息 (零複製)
+     *
+     * 直接返回訊息目錄內的字串指標，不配置記憶體也不存取檔案，
+     * 適合在錯誤處理路徑中使用。語言依呼叫執行緒的設定決定。
+     * 返回的指標在下一次 TL_Finalize 之前保持有效。
+     *
+     * @param error_code 要查詢的錯誤碼
+     * @param message 用於儲存訊息指標 (以 NUL 結尾)
+     * @param length 用於儲存訊息長度 (位元組數，不含 NUL)，可為 NULL
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_GetErrorMessageView(TL_ERROR_CODE error_code, const char** message, size_t* length);
+
+    /**
+     * 設定呼叫執行緒的訊息語言
+     *
+     * 僅影響目前執行緒，其他執行緒維持各自的設定。
+     *
+     * @param language 語言 (TL_LANG_EN, TL_LANG_JA, TL_LANG_ZH_TW, TL_LANG_ZH_CN)
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_SetThreadLanguage(TL_LANGUAGE language);
+
+    /**
+     * 取得呼叫執行緒的訊息語言
+     *
+     * @return 目前執行緒使用的語言，未設定時為預設語言 (TL_LANG_ZH_TW)
+     */
+    TL_API TL_LANGUAGE TL_GetThreadLanguage(void);
+
+    /**
+     * 載入預先編譯的訊息目錄
+     *
+     * 以記憶體映射方式載入由 TL_CompileMessageCatalog 產生的二進位目錄，
+     * 目錄內未提供的訊息會自動使用內建文字。TL_Initialize 時還原為內建訊息，
+     * TL_Finalize 時釋放，因此須在初始化之後載入。
+     *
+     * @param filename 目錄檔案路徑
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_LoadMessageCatalog(const char* filename);
+
+    /**
+     * 編譯訊息目錄
+     *
+     * 將各語言的文字訊息檔 (每行一個訊息，依訊息ID排序) 編譯為二進位目錄。
+     *
+     * @param source_files 依 TL_LANGUAGE 排列的文字檔路徑陣列，NULL 項目使用內建文字
+     * @param language_count 陣列元素數量
+     * @param output_file 輸出的目錄檔案路徑
+     * @return TL_SUCCESS 表示成功，其他值表示錯誤碼
+     */
+    TL_API TL_ERROR_CODE TL_CompileMessageCatalog(const char* const* source_files, size_t language_count,
+                                                  const char* output_file);
 
 #ifdef __cplusplus
 }
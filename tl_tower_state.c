@@ -0,0 +1,323 @@
+﻿/*
+ * tl_tower_state.c
+ *
+ * 塔燈通訊控制函式庫 - 壓縮塔燈狀態實現
+ *
+ * 整座塔燈的狀態約 30 位元，以一個 32 位元字組表示，每個目標占一個位元組。
+ * 裝置的目前狀態與期望狀態以比較並交換更新，多個執行緒同時設定不同目標時
+ * 不需加鎖；比較兩個狀態只需一次 XOR 再將各位元組折疊為目標遮罩。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 目標 n 在字組中的位移 */
+#define TL_STATE_SHIFT(target)  ((target) * 8)
+
+/* LED層級位元組中各欄位的位移 */
+#define TL_STATE_LED_RED      0
+#define TL_STATE_LED_GREEN    2
+#define TL_STATE_LED_BLUE     4
+#define TL_STATE_LED_PATTERN  6
+
+/* 蜂鳴器位元組中各欄位的位移 */
+#define TL_STATE_BUZZER_TONE     0
+#define TL_STATE_BUZZER_VOLUME   1
+#define TL_STATE_BUZZER_PATTERN  3
+
+/*
+ * 將目標遮罩展開為字組中的位元遮罩
+ */
+static TL_TowerState tl_tower_state_bytes(unsigned int target_mask)
+{
+    TL_TowerState bytes = 0;
+    int target;
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (target_mask & (1u << target)) {
+            bytes |= (TL_TowerState)0xFF << TL_STATE_SHIFT(target);
+        }
+    }
+    return bytes;
+}
+
+/*
+ * 檢查LED狀態是否可壓縮
+ */
+static TL_BOOL tl_tower_state_led_valid(const TL_LEDStatus* status)
+{
+    return ((unsigned int)status->red_status <= TL_LED_DUTY &&
+            (unsigned int)status->green_status <= TL_LED_DUTY &&
+            (unsigned int)status->blue_status <= TL_LED_DUTY &&
+            (unsigned int)status->pattern <= TL_LED_PATTERN_BLINK2) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 檢查蜂鳴器狀態是否可壓縮
+ */
+static TL_BOOL tl_tower_state_buzzer_valid(const TL_BuzzerStatus* status)
+{
+    return ((unsigned int)status->tone <= TL_BUZZER_TONE_LOW &&
+            (unsigned int)status->volume <= TL_BUZZER_VOLUME_SMALL &&
+            (unsigned int)status->pattern <= TL_BUZZER_PATTERN_4) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 壓縮單一LED層級的狀態
+ */
+TL_TowerState tl_tower_state_encode_led(const TL_LEDStatus* status)
+{
+    return (((TL_TowerState)status->red_status & 0x3) << TL_STATE_LED_RED) |
+           (((TL_TowerState)status->green_status & 0x3) << TL_STATE_LED_GREEN) |
+           (((TL_TowerState)status->blue_status & 0x3) << TL_STATE_LED_BLUE) |
+           (((TL_TowerState)status->pattern & 0x3) << TL_STATE_LED_PATTERN);
+}
+
+/*
+ * 壓縮蜂鳴器的狀態
+ */
+TL_TowerState tl_tower_state_encode_buzzer(const TL_BuzzerStatus* status)
+{
+    return (((TL_TowerState)status->tone & 0x1) << TL_STATE_BUZZER_TONE) |
+           (((TL_TowerState)status->volume & 0x3) << TL_STATE_BUZZER_VOLUME) |
+           (((TL_TowerState)status->pattern & 0x7) << TL_STATE_BUZZER_PATTERN);
+}
+
+/*
+ * 以比較並交換更新狀態字組中的部分目標
+ */
+TL_TowerState tl_tower_state_merge(volatile TL_TowerState* word, TL_TowerState state, unsigned int target_mask)
+{
+    TL_TowerState bytes = tl_tower_state_bytes(target_mask);
+    TL_TowerState old_state;
+    TL_TowerState new_state;
+
+    do {
+        old_state = tl_atomic_load_u32(word);
+        new_state = (old_state & ~bytes) | (state & bytes);
+    } while (!tl_atomic_cas_u32(word, old_state, new_state));
+
+    return new_state;
+}
+
+/*
+ * 記錄單一目標目前的狀態
+ */
+void tl_tower_state_note(TL_DeviceContext* device, int target,
+                         const TL_LEDStatus* led, const TL_BuzzerStatus* buzzer)
+{
+    TL_TowerState value;
+    TL_TowerState previous;
+
+    if (target == TL_TARGET_BUZZER && buzzer != NULL) {
+        value = tl_tower_state_encode_buzzer(buzzer);
+    } else if (target >= 0 && target < TL_TARGET_BUZZER && led != NULL) {
+        value = tl_tower_state_encode_led(led);
+    } else {
+        return;
+    }
+
+    previous = tl_atomic_load_u32(&device->current_state);
+    if (tl_tower_state_merge(&device->current_state, value << TL_STATE_SHIFT(target), 1u << target) != previous) {
+        tl_push_note(device);
+    }
+    tl_journal_note(device, TL_FALSE, 1u << target);
+}
+
+/*
+ * 判斷狀態字組中的目標是否點亮 (或鳴響)
+ */
+TL_BOOL tl_tower_state_active(TL_TowerState state, int target)
+{
+    TL_TowerState bits = (state >> TL_STATE_SHIFT(target)) & 0xFF;
+
+    if (target == TL_TARGET_BUZZER) {
+        return (((bits >> TL_STATE_BUZZER_PATTERN) & 0x7) != TL_BUZZER_PATTERN_OFF) ? TL_TRUE : TL_FALSE;
+    }
+    /* 三種顏色皆為 TL_LED_OFF (0) 時不論模式都不亮 */
+    return (((bits >> TL_STATE_LED_PATTERN) & 0x3) != TL_LED_PATTERN_OFF &&
+            (bits & 0x3F) != 0) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 解析LED字詞 (RGB/P)
+ */
+static TL_BOOL tl_tower_state_parse_led(const char* token, TL_LEDStatus* status)
+{
+    if (strlen(token) != 5 || token[3] != '/' ||
+        token[0] < '0' || token[0] > '0' + TL_LED_DUTY ||
+        token[1] < '0' || token[1] > '0' + TL_LED_DUTY ||
+        token[2] < '0' || token[2] > '0' + TL_LED_DUTY ||
+        token[4] < '0' || token[4] > '0' + TL_LED_PATTERN_BLINK2) {
+        return TL_FALSE;
+    }
+    status->red_status = (TL_LED_STATE)(token[0] - '0');
+    status->green_status = (TL_LED_STATE)(token[1] - '0');
+    status->blue_status = (TL_LED_STATE)(token[2] - '0');
+    status->pattern = (TL_LED_PATTERN)(token[4] - '0');
+    return TL_TRUE;
+}
+
+/*
+ * 解析蜂鳴器字詞 (TV/P)
+ */
+static TL_BOOL tl_tower_state_parse_buzzer(const char* token, TL_BuzzerStatus* status)
+{
+    if (strlen(token) != 4 || token[2] != '/' ||
+        token[0] < '0' || token[0] > '0' + TL_BUZZER_TONE_LOW ||
+        token[1] < '0' || token[1] > '0' + TL_BUZZER_VOLUME_SMALL ||
+        token[3] < '0' || token[3] > '0' + TL_BUZZER_PATTERN_4) {
+        return TL_FALSE;
+    }
+    status->tone = (TL_BUZZER_TONE)(token[0] - '0');
+    status->volume = (TL_BUZZER_VOLUME)(token[1] - '0');
+    status->pattern = (TL_BUZZER_PATTERN)(token[3] - '0');
+    return TL_TRUE;
+}
+
+/*
+ * 解析文字定義中的四個目標字詞
+ */
+TL_BOOL tl_tower_state_parse(char** cursor, TL_TowerFrame* frame)
+{
+    const char* token;
+    int target;
+
+    memset(frame, 0, sizeof(*frame));
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        token = tl_text_next_token(cursor);
+        if (token == NULL) {
+            return TL_FALSE;
+        }
+        if (strcmp(token, "-") == 0) {
+            continue;
+        }
+        if ((target == TL_TARGET_BUZZER) ? !tl_tower_state_parse_buzzer(token, &frame->buzzer) :
+                                           !tl_tower_state_parse_led(token, &frame->layers[target])) {
+            return TL_FALSE;
+        }
+        frame->target_mask |= 1u << target;
+    }
+    return TL_TRUE;
+}
+
+/*
+ * 將塔燈畫面壓縮為塔燈狀態字組
+ */
+TL_ERROR_CODE TL_PackTowerState(const TL_TowerFrame* frame, TL_TowerState* state)
+{
+    TL_TowerState packed = 0;
+    int target;
+
+    if (frame == NULL || state == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    for (target = 0; target < TL_TARGET_COUNT; target++) {
+        if (!(frame->target_mask & (1u << target))) {
+            continue;
+        }
+        if (target == TL_TARGET_BUZZER) {
+            if (!tl_tower_state_buzzer_valid(&frame->buzzer)) {
+                tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+                return TL_ERROR_INVALID_PARAMETER;
+            }
+            packed |= tl_tower_state_encode_buzzer(&frame->buzzer) << TL_STATE_SHIFT(target);
+        } else {
+            if (!tl_tower_state_led_valid(&frame->layers[target])) {
+                tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+                return TL_ERROR_INVALID_PARAMETER;
+            }
+            packed |= tl_tower_state_encode_led(&frame->layers[target]) << TL_STATE_SHIFT(target);
+        }
+    }
+
+    *state = packed;
+    return TL_SUCCESS;
+}
+
+/*
+ * 將塔燈狀態字組還原為塔燈畫面
+ */
+TL_ERROR_CODE TL_UnpackTowerState(TL_TowerState state, TL_TowerFrame* frame)
+{
+    TL_TowerFrame result;
+    TL_TowerState bits;
+    int target;
+
+    if (frame == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&result, 0, sizeof(result));
+    for (target = 0; target < TL_TARGET_BUZZER; target++) {
+        bits = (state >> TL_STATE_SHIFT(target)) & 0xFF;
+        result.layers[target].red_status = (TL_LED_STATE)((bits >> TL_STATE_LED_RED) & 0x3);
+        result.layers[target].green_status = (TL_LED_STATE)((bits >> TL_STATE_LED_GREEN) & 0x3);
+        result.layers[target].blue_status = (TL_LED_STATE)((bits >> TL_STATE_LED_BLUE) & 0x3);
+        result.layers[target].pattern = (TL_LED_PATTERN)((bits >> TL_STATE_LED_PATTERN) & 0x3);
+        if (!tl_tower_state_led_valid(&result.layers[target])) {
+            tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+            return TL_ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    /* 蜂鳴器位元組的最高兩個位元未使用，必須為 0 */
+    bits = (state >> TL_STATE_SHIFT(TL_TARGET_BUZZER)) & 0xFF;
+    result.buzzer.tone = (TL_BUZZER_TONE)((bits >> TL_STATE_BUZZER_TONE) & 0x1);
+    result.buzzer.volume = (TL_BUZZER_VOLUME)((bits >> TL_STATE_BUZZER_VOLUME) & 0x3);
+    result.buzzer.pattern = (TL_BUZZER_PATTERN)((bits >> TL_STATE_BUZZER_PATTERN) & 0x7);
+    if ((bits & 0xC0) != 0 || !tl_tower_state_buzzer_valid(&result.buzzer)) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result.target_mask = TL_FRAME_ALL;
+    *frame = result;
+    return TL_SUCCESS;
+}
+
+/*
+ * 比較兩個塔燈狀態
+ */
+unsigned int TL_DiffTowerState(TL_TowerState a, TL_TowerState b)
+{
+    TL_TowerState diff = a ^ b;
+
+    /* 將每個位元組折疊到其最低位元，再以乘法把 bit 0/8/16/24 收集到 bit 21~24 */
+    diff |= diff >> 4;
+    diff |= diff >> 2;
+    diff |= diff >> 1;
+    diff &= 0x01010101u;
+    return (unsigned int)(((diff * 0x00204081u) >> 21) & TL_FRAME_ALL);
+}
+
+/*
+ * 取得裝置目前與期望的塔燈狀態
+ */
+TL_ERROR_CODE TL_GetTowerState(TL_DEVICE_HANDLE device, TL_TowerState* current, TL_TowerState* desired)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    context = (device != NULL) ? device : tl_get_default_device();
+    result = tl_validate_device(context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    if (current != NULL) {
+        *current = tl_atomic_load_u32(&context->current_state);
+    }
+    if (desired != NULL) {
+        *desired = tl_atomic_load_u32(&context->desired_state);
+    }
+    return TL_SUCCESS;
+}
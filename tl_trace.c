@@ -0,0 +1,336 @@
+﻿/*
+ * tl_trace.c
+ *
+ * 塔燈通訊控制函式庫 - 命令追蹤實現
+ *
+ * 記錄命令各階段 (API 呼叫、命令構建、等待速率限制與通道、往返、
+ * USB寫入、回應頭部與數據讀取) 的開始時間與持續時間，寫出為
+ * Chrome/Perfetto 的追蹤事件格式 (JSON)，可在 chrome://tracing 或
+ * ui.perfetto.dev 開啟。
+ *
+ * 每個執行緒擁有自己的環狀事件緩衝區，只有該執行緒寫入，記錄時不加鎖：
+ * 先更新開始寫入的事件數，寫入事件內容後再以 release 語意更新事件計數。
+ * 寫出時讀取計數，複製事件後讀取開始寫入的事件數，複製期間可能被覆寫
+ * 的事件即略過；未在寫入時最舊的事件仍完整，環繞後保留容量個事件。
+ * 緩衝區在執行緒第一次記錄時配置，於 TL_Finalize 時釋放。
+ *
+ * 未啟用時每個區段只讀取一次旗標；啟用時每個區段多兩次時間讀取與一次
+ * 事件寫入，可長時間在正式環境中執行。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 每個執行緒的事件數上限 */
+#define TL_TRACE_MAX_EVENTS  (1u << 22)
+
+/* 追蹤事件 */
+typedef struct {
+    unsigned long long start_us;  /* 開始時間 (微秒) */
+    unsigned int duration_us;     /* 持續時間 (微秒) */
+    unsigned int arg;             /* 階段的參數 */
+    unsigned int stage;           /* 階段 (TL_TRACE_STAGE) */
+} TL_TraceEvent;
+
+/* 單一執行緒的事件緩衝區 */
+typedef struct TL_TraceBuffer {
+    struct TL_TraceBuffer* next;  /* 緩衝區串列 */
+    unsigned int thread_index;    /* 輸出時使用的執行緒編號 */
+    unsigned int generation;      /* 內容所屬的 TL_StartTrace 世代 */
+    unsigned int capacity;        /* 事件數 (2的次方) */
+    volatile unsigned int count;  /* 已寫入的事件總數 (原子操作) */
+    volatile unsigned int started;  /* 已開始寫入的事件總數 (原子操作) */
+    TL_TraceEvent events[1];      /* 環狀緩衝區 */
+} TL_TraceBuffer;
+
+/* 追蹤狀態 */
+static struct {
+    TL_Mutex* lock;               /* 保護緩衝區串列、容量與世代 */
+    TL_TraceBuffer* buffers;      /* 所有執行緒的緩衝區 */
+    volatile int enabled;         /* 是否正在記錄 */
+    volatile unsigned int generation;  /* TL_StartTrace 的世代 */
+    unsigned int capacity;        /* 新緩衝區的事件數 */
+    unsigned int thread_count;    /* 已配置編號的執行緒數 */
+    unsigned int epoch;           /* tl_trace_init 的次數，區分已釋放的緩衝區 */
+} g_trace;
+
+/* 呼叫執行緒的緩衝區及其所屬的初始化次數 */
+static TL_THREAD_LOCAL TL_TraceBuffer* g_trace_buffer = NULL;
+static TL_THREAD_LOCAL unsigned int g_trace_buffer_epoch = 0;
+
+/* 各階段的名稱、類別與參數名稱 */
+static const struct {
+    const char* name;
+    const char* category;
+    const char* arg_name;  /* NULL 表示不輸出參數 */
+} g_trace_stages[TL_TRACE_STAGE_COUNT] = {
+    { "TL_SetLED",          "api",  "layer"  },
+    { "TL_GetLEDStatus",    "api",  "layer"  },
+    { "TL_SetBuzzer",       "api",  NULL     },
+    { "TL_GetBuzzerStatus", "api",  NULL     },
+    { "build",              "cmd",  "bytes"  },
+    { "queue",              "cmd",  NULL     },
+    { "send_and_receive",   "cmd",  "result" },
+    { "async_submit",       "cmd",  "result" },
+    { "WinUsb_WritePipe",   "usb",  "bytes"  },
+    { "read_header",        "usb",  "bytes"  },
+    { "read_body",          "usb",  "bytes"  }
+};
+
+/*
+ * 取得呼叫執行緒目前世代的緩衝區
+ *
+ * 同一執行緒在新的世代沿用容量相同的緩衝區，只清除計數；容量不同時
+ * 配置新的緩衝區，舊的留在串列中直到 tl_trace_shutdown。
+ */
+static TL_TraceBuffer* tl_trace_thread_buffer(unsigned int generation)
+{
+    TL_TraceBuffer* buffer = (g_trace_buffer_epoch == g_trace.epoch) ? g_trace_buffer : NULL;
+    TL_TraceBuffer* created;
+
+    if (buffer != NULL && buffer->generation == generation) {
+        return buffer;
+    }
+
+    tl_mutex_lock(g_trace.lock);
+    if (buffer != NULL && buffer->capacity == g_trace.capacity) {
+        tl_atomic_store_u32(&buffer->count, 0);
+        tl_atomic_store_u32(&buffer->started, 0);
+        buffer->generation = generation;
+        tl_mutex_unlock(g_trace.lock);
+        return buffer;
+    }
+
+    created = (TL_TraceBuffer*)malloc(sizeof(TL_TraceBuffer) + (g_trace.capacity - 1) * sizeof(TL_TraceEvent));
+    if (created != NULL) {
+        created->thread_index = (buffer != NULL) ? buffer->thread_index : ++g_trace.thread_count;
+        created->generation = generation;
+        created->capacity = g_trace.capacity;
+        created->count = 0;
+        created->started = 0;
+        created->next = g_trace.buffers;
+        g_trace.buffers = created;
+        g_trace_buffer = created;
+        g_trace_buffer_epoch = g_trace.epoch;
+    }
+    tl_mutex_unlock(g_trace.lock);
+    return created;
+}
+
+/*
+ * 開始一個追蹤區段
+ */
+unsigned long long tl_trace_begin(void)
+{
+    return g_trace.enabled ? tl_time_now_us() : 0;
+}
+
+/*
+ * 結束追蹤區段並記錄
+ */
+void tl_trace_end(TL_TRACE_STAGE stage, unsigned long long start_us, unsigned int arg)
+{
+    TL_TraceBuffer* buffer;
+    TL_TraceEvent* event;
+    unsigned long long duration_us;
+    unsigned int count;
+
+    if (start_us == 0 || !g_trace.enabled) {
+        return;
+    }
+    duration_us = tl_time_now_us() - start_us;
+
+    buffer = tl_trace_thread_buffer(g_trace.generation);
+    if (buffer == NULL) {
+        return;
+    }
+
+    /* 只有本執行緒寫入計數，先標示開始寫入，覆寫的事件即視為過期，寫入事件後再公開 */
+    count = buffer->count;
+    tl_atomic_store_u32(&buffer->started, count + 1);
+    tl_atomic_fence_release();
+    event = &buffer->events[count & (buffer->capacity - 1)];
+    event->start_us = start_us;
+    event->duration_us = (duration_us > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : (unsigned int)duration_us;
+    event->arg = arg;
+    event->stage = (unsigned int)stage;
+    tl_atomic_store_u32(&buffer->count, count + 1);
+}
+
+/*
+ * 初始化命令追蹤
+ */
+TL_ERROR_CODE tl_trace_init(void)
+{
+    g_trace.buffers = NULL;
+    g_trace.enabled = 0;
+    g_trace.generation = 0;
+    g_trace.capacity = TL_TRACE_DEFAULT_EVENTS;
+    g_trace.thread_count = 0;
+    /* 前一次初始化的緩衝區已釋放，各執行緒須重新配置 */
+    g_trace.epoch++;
+
+    g_trace.lock = tl_mutex_create();
+    if (g_trace.lock == NULL) {
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉命令追蹤
+ */
+void tl_trace_shutdown(void)
+{
+    TL_TraceBuffer* buffer;
+
+    g_trace.enabled = 0;
+    while (g_trace.buffers != NULL) {
+        buffer = g_trace.buffers;
+        g_trace.buffers = buffer->next;
+        free(buffer);
+    }
+    tl_mutex_destroy(g_trace.lock);
+    g_trace.lock = NULL;
+}
+
+/*
+ * 開始記錄命令追蹤
+ */
+TL_ERROR_CODE TL_StartTrace(unsigned int events_per_thread)
+{
+    unsigned int capacity = 1;
+
+    if (!tl_get_internal_state()->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    if (events_per_thread == 0) {
+        events_per_thread = TL_TRACE_DEFAULT_EVENTS;
+    }
+    if (events_per_thread > TL_TRACE_MAX_EVENTS) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 以2的次方為容量，計數溢位時位置仍連續 */
+    while (capacity < events_per_thread) {
+        capacity <<= 1;
+    }
+
+    tl_mutex_lock(g_trace.lock);
+    g_trace.capacity = capacity;
+    g_trace.generation++;
+    g_trace.enabled = 1;
+    tl_mutex_unlock(g_trace.lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_StartTrace] 每個執行緒 %u 個事件\n", capacity);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 停止記錄命令追蹤
+ */
+TL_ERROR_CODE TL_StopTrace(void)
+{
+    if (!tl_get_internal_state()->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    g_trace.enabled = 0;
+    return TL_SUCCESS;
+}
+
+/*
+ * 寫出單一執行緒的事件 (呼叫端須持有鎖)
+ */
+static void tl_trace_write_buffer(FILE* file, TL_TraceBuffer* buffer, TL_BOOL* first)
+{
+    TL_TraceEvent event;
+    unsigned int end = tl_atomic_load_u32(&buffer->count);
+    unsigned int available = (end < buffer->capacity) ? end : buffer->capacity;
+    unsigned int index;
+
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"tl-thread-%u\"}}",
+            *first ? "" : ",", buffer->thread_index, buffer->thread_index);
+    *first = TL_FALSE;
+
+    for (index = end - available; index != end; index++) {
+        event = buffer->events[index & (buffer->capacity - 1)];
+
+        /*
+         * 複製完成後再讀取開始寫入的事件數：超過 index + capacity 時，
+         * 同一位置已開始寫入下一輪的事件，複製的內容可能不完整，略過
+         */
+        tl_atomic_fence_acquire();
+        if (tl_atomic_load_u32(&buffer->started) - index > buffer->capacity || event.stage >= TL_TRACE_STAGE_COUNT) {
+            continue;
+        }
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":1,\"tid\":%u",
+                g_trace_stages[event.stage].name, g_trace_stages[event.stage].category,
+                event.start_us, event.duration_us, buffer->thread_index);
+        if (g_trace_stages[event.stage].arg_name != NULL) {
+            fprintf(file, ",\"args\":{\"%s\":%u}", g_trace_stages[event.stage].arg_name, event.arg);
+        }
+        fputc('}', file);
+    }
+}
+
+/*
+ * 將命令追蹤寫出為 Chrome/Perfetto 追蹤檔
+ */
+TL_ERROR_CODE TL_WriteTrace(const char* path)
+{
+    TL_TraceBuffer* buffer;
+    TL_ERROR_CODE result = TL_SUCCESS;
+    TL_BOOL first = TL_TRUE;
+    FILE* file;
+
+    if (path == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    if (!tl_get_internal_state()->is_initialized) {
+        tl_set_last_error(TL_ERROR_NOT_INITIALIZED);
+        return TL_ERROR_NOT_INITIALIZED;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        tl_set_last_error(TL_ERROR_FILE_ACCESS);
+        return TL_ERROR_FILE_ACCESS;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    tl_mutex_lock(g_trace.lock);
+    for (buffer = g_trace.buffers; buffer != NULL; buffer = buffer->next) {
+        /* 先前世代的內容已由 TL_StartTrace 捨棄 */
+        if (buffer->generation == g_trace.generation && tl_atomic_load_u32(&buffer->count) != 0) {
+            tl_trace_write_buffer(file, buffer, &first);
+        }
+    }
+    tl_mutex_unlock(g_trace.lock);
+    fputs("\n]}\n", file);
+
+    if (ferror(file)) {
+        result = TL_ERROR_FILE_ACCESS;
+    }
+    if (fclose(file) != 0) {
+        result = TL_ERROR_FILE_ACCESS;
+    }
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+}
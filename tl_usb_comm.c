@@ -4,20 +4,26 @@
  * 塔燈通訊控制函式庫 - USB通訊實現 (含更嚴謹的先初始化 + 再檢查)
  *
  * 功能:
+ *  - tl_usb_count_devices()    : 取得已連接的裝置數量
+ *  - tl_usb_find_device()      : 依裝置介面路徑尋找目前的列舉索引
  *  - tl_usb_open_device()      : 先完成 WinUsb_Initialize & GetAssociatedInterface, 再做 tl_usb_is_device_ready()
  *  - tl_usb_close_device()     : 關閉裝置
  *  - tl_usb_is_device_ready()  : 檢查 handle 是否都非NULL, 可再執行 ephemeral WinUsb_Initialize測試
- *  - tl_usb_write_data()       : 寫入
- *  - tl_usb_read_data()        : 讀取
+ *  - tl_usb_write_data()       : 寫入 (重疊I/O，可設定逾時)
+ *  - tl_usb_read_data()        : 讀取 (重疊I/O，可設定逾時)
+ *  - tl_usb_resync()           : 逾時後取消傳輸並清除殘留回應
  *
- * 版本: 1.0.5
- * 日期: 2025-04-02
+ * 測試程式 (BUILD_TEST_EXE) 啟用模擬塔燈後，以上函式改由 tl_usb_sim.c 處理。
+ *
+ * 版本: 1.1.0
+ * 日期: 2026-10-18
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "tl_internal.h"
+#include "tl_probes.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -33,14 +39,22 @@ typedef BOOLEAN(__stdcall* WinUsb_Free_t)(WINUSB_INTERFACE_HANDLE);
 typedef BOOLEAN(__stdcall* WinUsb_GetAssociatedInterface_t)(WINUSB_INTERFACE_HANDLE, UCHAR, WINUSB_INTERFACE_HANDLE*);
 typedef BOOLEAN(__stdcall* WinUsb_WritePipe_t)(WINUSB_INTERFACE_HANDLE, UCHAR, PUCHAR, ULONG, PULONG, LPOVERLAPPED);
 typedef BOOLEAN(__stdcall* WinUsb_ReadPipe_t)(WINUSB_INTERFACE_HANDLE, UCHAR, PUCHAR, ULONG, PULONG, LPOVERLAPPED);
+typedef BOOLEAN(__stdcall* WinUsb_AbortPipe_t)(WINUSB_INTERFACE_HANDLE, UCHAR);
+typedef BOOLEAN(__stdcall* WinUsb_FlushPipe_t)(WINUSB_INTERFACE_HANDLE, UCHAR);
+typedef BOOLEAN(__stdcall* WinUsb_GetOverlappedResult_t)(WINUSB_INTERFACE_HANDLE, LPOVERLAPPED, LPDWORD, BOOL);
 
-/* 動態載入 */
+/* 動態載入 (每個已開啟的裝置持有一次參考；多台裝置可在不同執行緒開啟或關閉，以 g_winusb_lock 保護) */
+static SRWLOCK g_winusb_lock = SRWLOCK_INIT;
 static HMODULE hWinUSBLib = NULL;
+static unsigned int g_winusb_refcount = 0;
 static WinUsb_Initialize_t            pWinUsb_Initialize = NULL;
 static WinUsb_Free_t                  pWinUsb_Free = NULL;
 static WinUsb_GetAssociatedInterface_t pWinUsb_GetAssociatedInterface = NULL;
 static WinUsb_WritePipe_t             pWinUsb_WritePipe = NULL;
 static WinUsb_ReadPipe_t              pWinUsb_ReadPipe = NULL;
+static WinUsb_AbortPipe_t             pWinUsb_AbortPipe = NULL;
+static WinUsb_FlushPipe_t             pWinUsb_FlushPipe = NULL;
+static WinUsb_GetOverlappedResult_t   pWinUsb_GetOverlappedResult = NULL;
 
 static TL_ERROR_CODE load_winusb_library(void);
 static void unload_winusb_library(void);
@@ -51,16 +65,16 @@ static void unload_winusb_library(void);
 #endif
 
  /* extern 由其他檔案提供 */
-extern TL_InternalState* tl_get_internal_state(void);
 extern void tl_delay_ms(unsigned long ms);
 
 /* -------------------------------------------------------------------------
  * 動態載入/卸載winusb.dll
  */
 #ifdef _WIN32
-static TL_ERROR_CODE load_winusb_library(void)
+static TL_ERROR_CODE load_winusb_library_locked(void)
 {
     if (hWinUSBLib) {
+        g_winusb_refcount++;
         return TL_SUCCESS; /* 已載入 */
     }
     hWinUSBLib = LoadLibraryA("winusb.dll");
@@ -77,9 +91,13 @@ static TL_ERROR_CODE load_winusb_library(void)
     pWinUsb_GetAssociatedInterface = (WinUsb_GetAssociatedInterface_t)GetProcAddress(hWinUSBLib, "WinUsb_GetAssociatedInterface");
     pWinUsb_WritePipe = (WinUsb_WritePipe_t)GetProcAddress(hWinUSBLib, "WinUsb_WritePipe");
     pWinUsb_ReadPipe = (WinUsb_ReadPipe_t)GetProcAddress(hWinUSBLib, "WinUsb_ReadPipe");
+    pWinUsb_AbortPipe = (WinUsb_AbortPipe_t)GetProcAddress(hWinUSBLib, "WinUsb_AbortPipe");
+    pWinUsb_FlushPipe = (WinUsb_FlushPipe_t)GetProcAddress(hWinUSBLib, "WinUsb_FlushPipe");
+    pWinUsb_GetOverlappedResult = (WinUsb_GetOverlappedResult_t)GetProcAddress(hWinUSBLib, "WinUsb_GetOverlappedResult");
 
     if (!pWinUsb_Initialize || !pWinUsb_Free ||
-        !pWinUsb_GetAssociatedInterface || !pWinUsb_WritePipe || !pWinUsb_ReadPipe) {
+        !pWinUsb_GetAssociatedInterface || !pWinUsb_WritePipe || !pWinUsb_ReadPipe ||
+        !pWinUsb_AbortPipe || !pWinUsb_FlushPipe || !pWinUsb_GetOverlappedResult) {
 #ifdef BUILD_TEST_EXE 
         printf("[load_winusb_library] GetProcAddress - 部分函式為NULL\n");
 #endif
@@ -87,11 +105,30 @@ static TL_ERROR_CODE load_winusb_library(void)
         hWinUSBLib = NULL;
         return TL_ERROR_GENERAL;
     }
+    g_winusb_refcount = 1;
     return TL_SUCCESS;
 }
 
+static TL_ERROR_CODE load_winusb_library(void)
+{
+    TL_ERROR_CODE result;
+
+    AcquireSRWLockExclusive(&g_winusb_lock);
+    result = load_winusb_library_locked();
+    ReleaseSRWLockExclusive(&g_winusb_lock);
+    return result;
+}
+
 static void unload_winusb_library(void)
 {
+    AcquireSRWLockExclusive(&g_winusb_lock);
+    /* 仍有其他裝置使用時不卸載 */
+    if (g_winusb_refcount > 1) {
+        g_winusb_refcount--;
+        ReleaseSRWLockExclusive(&g_winusb_lock);
+        return;
+    }
+    g_winusb_refcount = 0;
     if (hWinUSBLib) {
         FreeLibrary(hWinUSBLib);
         hWinUSBLib = NULL;
@@ -101,6 +138,10 @@ static void unload_winusb_library(void)
     pWinUsb_GetAssociatedInterface = NULL;
     pWinUsb_WritePipe = NULL;
     pWinUsb_ReadPipe = NULL;
+    pWinUsb_AbortPipe = NULL;
+    pWinUsb_FlushPipe = NULL;
+    pWinUsb_GetOverlappedResult = NULL;
+    ReleaseSRWLockExclusive(&g_winusb_lock);
 }
 #endif /* _WIN32 */
 
@@ -108,13 +149,16 @@ static void unload_winusb_library(void)
  * 檢查裝置是否就緒
  * 可在此恢復檢查 if (!device_handle || !interface_handle) ...
  */
-TL_BOOL tl_usb_is_device_ready(void)
+TL_BOOL tl_usb_is_device_ready(TL_DeviceContext* device)
 {
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return (device->device_handle != NULL) ? TL_TRUE : TL_FALSE;
+    }
+#endif
 #ifdef _WIN32
-    TL_InternalState* state = tl_get_internal_state();
-
     /* 檢查 */
-    if (!state->device_handle || !state->interface_handle) {
+    if (!device->device_handle || !device->interface_handle) {
 #ifdef BUILD_TEST_EXE 
         printf("[tl_usb_is_device_ready] device_handle 或 interface_handle 為NULL => 不就緒\n");
 #endif
@@ -127,7 +171,7 @@ TL_BOOL tl_usb_is_device_ready(void)
      */
     WINUSB_INTERFACE_HANDLE temp_handle;
     for (int attempt = 0; attempt < TL_MAX_DEVICE_READY_ATTEMPTS; attempt++) {
-        if (pWinUsb_Initialize(state->device_handle, &temp_handle)) {
+        if (pWinUsb_Initialize(device->device_handle, &temp_handle)) {
             pWinUsb_Free(temp_handle);
 #ifdef BUILD_TEST_EXE 
             printf("[tl_usb_is_device_ready] 第 %d 次 WinUsb_Initialize 成功 => 就緒\n", attempt + 1);
@@ -157,10 +201,148 @@ TL_BOOL tl_usb_is_device_ready(void)
 
 #else
     /* 非Windows平台 => 假設已就緒 */
+    (void)device;
     return TL_TRUE;
 #endif
 }
 
+#ifdef _WIN32
+/* -------------------------------------------------------------------------
+ * 組合塔燈裝置介面的GUID
+ */
+static void tl_usb_make_guid(GUID* guid)
+{
+    guid->Data1 = TL_GUID_DATA1;
+    guid->Data2 = TL_GUID_DATA2;
+    guid->Data3 = TL_GUID_DATA3;
+    guid->Data4[0] = TL_GUID_DATA4_0;
+    guid->Data4[1] = TL_GUID_DATA4_1;
+    guid->Data4[2] = TL_GUID_DATA4_2;
+    guid->Data4[3] = TL_GUID_DATA4_3;
+    guid->Data4[4] = TL_GUID_DATA4_4;
+    guid->Data4[5] = TL_GUID_DATA4_5;
+    guid->Data4[6] = TL_GUID_DATA4_6;
+    guid->Data4[7] = TL_GUID_DATA4_7;
+}
+#endif
+
+/* -------------------------------------------------------------------------
+ * 取得已連接的裝置數量
+ */
+TL_ERROR_CODE tl_usb_count_devices(unsigned int* count)
+{
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return tl_usb_sim_count_devices(count);
+    }
+#endif
+#ifdef _WIN32
+    HDEVINFO deviceInfoSet;
+    SP_DEVICE_INTERFACE_DATA interfaceData;
+    GUID deviceGuidStruct;
+    DWORD index = 0;
+
+    tl_usb_make_guid(&deviceGuidStruct);
+    deviceInfoSet = SetupDiGetClassDevs(&deviceGuidStruct, NULL, NULL,
+        DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (deviceInfoSet == INVALID_HANDLE_VALUE) {
+        *count = 0;
+        return TL_SUCCESS;
+    }
+
+    interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+    while (SetupDiEnumDeviceInterfaces(deviceInfoSet, NULL, &deviceGuidStruct, index, &interfaceData)) {
+        index++;
+    }
+    SetupDiDestroyDeviceInfoList(deviceInfoSet);
+
+    *count = (unsigned int)index;
+    return TL_SUCCESS;
+#else
+    /* 非Windows平台 => 模擬一台裝置 */
+    *count = 1;
+    return TL_SUCCESS;
+#endif
+}
+
+#ifdef _WIN32
+/*
+ * 複製裝置介面路徑 (路徑只含 ASCII 字元，UNICODE 與否皆可直接轉換)
+ */
+static void tl_usb_copy_path(char* dest, const TCHAR* path)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < TL_DEVICE_PATH_MAX && path[i] != 0; i++) {
+        dest[i] = (char)path[i];
+    }
+    dest[i] = '\0';
+}
+#endif
+
+/* -------------------------------------------------------------------------
+ * 依裝置介面路徑尋找目前的列舉索引
+ * 重新列舉後索引可能改變，介面路徑 (含USB連接埠位置或序號) 則固定指向同一台裝置
+ */
+TL_ERROR_CODE tl_usb_find_device(const char* device_path, unsigned int* index)
+{
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return tl_usb_sim_find_device(device_path, index);
+    }
+#endif
+#ifdef _WIN32
+    HDEVINFO deviceInfoSet;
+    SP_DEVICE_INTERFACE_DATA interfaceData;
+    PSP_DEVICE_INTERFACE_DETAIL_DATA detailData;
+    GUID deviceGuidStruct;
+    DWORD detailSize;
+    DWORD i;
+    char path[TL_DEVICE_PATH_MAX];
+    TL_ERROR_CODE result = TL_ERROR_DEVICE_NOT_FOUND;
+
+    tl_usb_make_guid(&deviceGuidStruct);
+    deviceInfoSet = SetupDiGetClassDevs(&deviceGuidStruct, NULL, NULL,
+        DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (deviceInfoSet == INVALID_HANDLE_VALUE) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_FOUND);
+        return TL_ERROR_DEVICE_NOT_FOUND;
+    }
+
+    interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+    for (i = 0; result != TL_SUCCESS &&
+                SetupDiEnumDeviceInterfaces(deviceInfoSet, NULL, &deviceGuidStruct, i, &interfaceData); i++) {
+        detailSize = 0;
+        SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceData, NULL, 0, &detailSize, NULL);
+        detailData = (PSP_DEVICE_INTERFACE_DETAIL_DATA)malloc(detailSize);
+        if (detailData == NULL) {
+            continue;
+        }
+        detailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+        if (SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceData, detailData, detailSize, NULL, NULL)) {
+            tl_usb_copy_path(path, detailData->DevicePath);
+            if (strcmp(path, device_path) == 0) {
+                *index = (unsigned int)i;
+                result = TL_SUCCESS;
+            }
+        }
+        free(detailData);
+    }
+    SetupDiDestroyDeviceInfoList(deviceInfoSet);
+
+    if (result != TL_SUCCESS) {
+        tl_set_last_error(result);
+    }
+    return result;
+#else
+    /* 非Windows平台 => 不提供裝置介面路徑 */
+    (void)device_path;
+    (void)index;
+    tl_set_last_error(TL_ERROR_DEVICE_NOT_FOUND);
+    return TL_ERROR_DEVICE_NOT_FOUND;
+#endif
+}
+
 /* -------------------------------------------------------------------------
  * 開啟 USB 裝置
  *  - 步驟:
@@ -169,10 +351,14 @@ TL_BOOL tl_usb_is_device_ready(void)
  *      3. GetAssociatedInterface -> secondaryInterface
  *      4. tl_usb_is_device_ready() => 檢查
  */
-TL_ERROR_CODE tl_usb_open_device(void)
+TL_ERROR_CODE tl_usb_open_device(TL_DeviceContext* device)
 {
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return tl_usb_sim_open_device(device);
+    }
+#endif
 #ifdef _WIN32
-    TL_InternalState* state = tl_get_internal_state();
     TL_ERROR_CODE result;
     HDEVINFO deviceInfoSet = INVALID_HANDLE_VALUE;
     SP_DEVICE_INTERFACE_DATA interfaceData;
@@ -189,17 +375,7 @@ TL_ERROR_CODE tl_usb_open_device(void)
     }
 
     /* 2. 組合GUID */
-    deviceGuidStruct.Data1 = TL_GUID_DATA1;
-    deviceGuidStruct.Data2 = TL_GUID_DATA2;
-    deviceGuidStruct.Data3 = TL_GUID_DATA3;
-    deviceGuidStruct.Data4[0] = TL_GUID_DATA4_0;
-    deviceGuidStruct.Data4[1] = TL_GUID_DATA4_1;
-    deviceGuidStruct.Data4[2] = TL_GUID_DATA4_2;
-    deviceGuidStruct.Data4[3] = TL_GUID_DATA4_3;
-    deviceGuidStruct.Data4[4] = TL_GUID_DATA4_4;
-    deviceGuidStruct.Data4[5] = TL_GUID_DATA4_5;
-    deviceGuidStruct.Data4[6] = TL_GUID_DATA4_6;
-    deviceGuidStruct.Data4[7] = TL_GUID_DATA4_7;
+    tl_usb_make_guid(&deviceGuidStruct);
 
     /* 3. SetupDiGetClassDevs */
     deviceInfoSet = SetupDiGetClassDevs(&deviceGuidStruct, NULL, NULL,
@@ -218,7 +394,7 @@ TL_ERROR_CODE tl_usb_open_device(void)
     interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
     if (!SetupDiEnumDeviceInterfaces(deviceInfoSet, NULL,
         &deviceGuidStruct,
-        0, &interfaceData)) {
+        device->device_index, &interfaceData)) {
         DWORD dwErr = GetLastError();
 #ifdef BUILD_TEST_EXE 
         printf("[tl_usb_open_device] SetupDiEnumDeviceInterfaces失敗, error=%lu\n", dwErr);
@@ -260,7 +436,7 @@ TL_ERROR_CODE tl_usb_open_device(void)
     SetupDiDestroyDeviceInfoList(deviceInfoSet);
 
     /* 5. CreateFile */
-    state->device_handle = CreateFile(detailData->DevicePath,
+    device->device_handle = CreateFile(detailData->DevicePath,
         GENERIC_READ | GENERIC_WRITE,
         FILE_SHARE_READ | FILE_SHARE_WRITE,
         NULL, OPEN_EXISTING,
@@ -269,10 +445,11 @@ TL_ERROR_CODE tl_usb_open_device(void)
 #ifdef BUILD_TEST_EXE 
     printf("[tl_usb_open_device] DevicePath=%s\n", detailData->DevicePath);
 #endif
+    tl_usb_copy_path(device->device_path, detailData->DevicePath);
     free(detailData);
 
-    if (state->device_handle == INVALID_HANDLE_VALUE) {
-        state->device_handle = NULL;
+    if (device->device_handle == INVALID_HANDLE_VALUE) {
+        device->device_handle = NULL;
 #ifdef BUILD_TEST_EXE 
         DWORD dwErr = GetLastError();
         printf("[tl_usb_open_device] CreateFile失敗, error=%lu => TL_ERROR_DEVICE_OPEN_FAILED\n", dwErr);
@@ -284,13 +461,13 @@ TL_ERROR_CODE tl_usb_open_device(void)
 
     /* 6. WinUsb_Initialize -> primary interface */
     WINUSB_INTERFACE_HANDLE primaryInterface = NULL;
-    if (!pWinUsb_Initialize(state->device_handle, &primaryInterface)) {
+    if (!pWinUsb_Initialize(device->device_handle, &primaryInterface)) {
 #ifdef BUILD_TEST_EXE 
         DWORD dwErr = GetLastError();
         printf("[tl_usb_open_device] WinUsb_Initialize失敗, error=%lu => TL_ERROR_DEVICE_OPEN_FAILED\n", dwErr);
 #endif
-        CloseHandle(state->device_handle);
-        state->device_handle = NULL;
+        CloseHandle(device->device_handle);
+        device->device_handle = NULL;
         tl_set_last_error(TL_ERROR_DEVICE_OPEN_FAILED);
         unload_winusb_library();
         return TL_ERROR_DEVICE_OPEN_FAILED;
@@ -304,29 +481,38 @@ TL_ERROR_CODE tl_usb_open_device(void)
         printf("[tl_usb_open_device] WinUsb_GetAssociatedInterface失敗, error=%lu => TL_ERROR_DEVICE_OPEN_FAILED\n", dwErr);
 #endif
         pWinUsb_Free(primaryInterface);
-        CloseHandle(state->device_handle);
-        state->device_handle = NULL;
+        CloseHandle(device->device_handle);
+        device->device_handle = NULL;
         tl_set_last_error(TL_ERROR_DEVICE_OPEN_FAILED);
         unload_winusb_library();
         return TL_ERROR_DEVICE_OPEN_FAILED;
     }
 
-    /* 存到 state */
-    state->interface_handle = secondaryInterface;
+    /* 存到裝置狀態 */
+    device->interface_handle = secondaryInterface;
 
     /* 8. 檢查裝置是否就緒 (已擁有 interface_handle, 可嚴謹檢查) */
-    if (!tl_usb_is_device_ready()) {
+    if (!tl_usb_is_device_ready(device)) {
 #ifdef BUILD_TEST_EXE 
         printf("[tl_usb_open_device] 裝置未就緒 => 關閉 handle.\n");
 #endif
-        pWinUsb_Free(state->interface_handle);
-        state->interface_handle = NULL;
-        CloseHandle(state->device_handle);
-        state->device_handle = NULL;
+        pWinUsb_Free(device->interface_handle);
+        device->interface_handle = NULL;
+        CloseHandle(device->device_handle);
+        device->device_handle = NULL;
         unload_winusb_library();
         tl_set_last_error(TL_ERROR_DEVICE_OPEN_FAILED);
         return TL_ERROR_DEVICE_OPEN_FAILED;
     }
+
+    /* 9. 建立重疊I/O事件 (手動重設) */
+    device->write_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    device->read_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!device->write_event || !device->read_event) {
+        tl_usb_close_device(device);
+        tl_set_last_error(TL_ERROR_DEVICE_OPEN_FAILED);
+        return TL_ERROR_DEVICE_OPEN_FAILED;
+    }
 #ifdef BUILD_TEST_EXE 
     printf("[tl_usb_open_device] 開啟裝置成功. (secondary interface 已取得)\n");
 #endif
@@ -334,9 +520,8 @@ TL_ERROR_CODE tl_usb_open_device(void)
 
 #else
     /* 非Windows平台 => 模擬成功 */
-    TL_InternalState* state = tl_get_internal_state();
-    state->device_handle = (void*)1;
-    state->interface_handle = (void*)1;
+    device->device_handle = (void*)1;
+    device->interface_handle = (void*)1;
     return TL_SUCCESS;
 #endif
 }
@@ -344,66 +529,143 @@ TL_ERROR_CODE tl_usb_open_device(void)
 /* -------------------------------------------------------------------------
  * 關閉裝置
  */
-TL_ERROR_CODE tl_usb_close_device(void)
+TL_ERROR_CODE tl_usb_close_device(TL_DeviceContext* device)
 {
-    TL_InternalState* state = tl_get_internal_state();
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return tl_usb_sim_close_device(device);
+    }
+#endif
 #ifdef _WIN32
-    if (state->device_handle) {
-        if (state->interface_handle) {
+    if (device->write_event) {
+        CloseHandle((HANDLE)device->write_event);
+        device->write_event = NULL;
+    }
+    if (device->read_event) {
+        CloseHandle((HANDLE)device->read_event);
+        device->read_event = NULL;
+    }
+    if (device->device_handle) {
+        if (device->interface_handle) {
 #ifdef BUILD_TEST_EXE 
             printf("[tl_usb_close_device] WinUsb_Free interface.\n");
 #endif
-            pWinUsb_Free((WINUSB_INTERFACE_HANDLE)state->interface_handle);
-            state->interface_handle = NULL;
+            pWinUsb_Free((WINUSB_INTERFACE_HANDLE)device->interface_handle);
+            device->interface_handle = NULL;
         }
 #ifdef BUILD_TEST_EXE 
         printf("[tl_usb_close_device] CloseHandle device.\n");
 #endif
-        CloseHandle(state->device_handle);
-        state->device_handle = NULL;
+        CloseHandle(device->device_handle);
+        device->device_handle = NULL;
         unload_winusb_library();
     }
+#else
+    device->device_handle = NULL;
+    device->interface_handle = NULL;
 #endif
     return TL_SUCCESS;
 }
 
+#ifdef _WIN32
 /* -------------------------------------------------------------------------
- * 寫入資料
+ * 等待重疊I/O完成
+ * 逾時則取消該管道上的傳輸，並等待取消完成後才返回 (OVERLAPPED 位於呼叫端堆疊)
  */
-TL_ERROR_CODE tl_usb_write_data(TL_BYTE pipe_id, const TL_BYTE* buffer, size_t buffer_size)
+static TL_ERROR_CODE tl_usb_wait_overlapped(TL_DeviceContext* device, TL_BYTE pipe_id,
+                                            OVERLAPPED* overlapped, DWORD* transferred,
+                                            unsigned long timeout_ms)
 {
-    TL_InternalState* state = tl_get_internal_state();
+    WINUSB_INTERFACE_HANDLE iface = (WINUSB_INTERFACE_HANDLE)device->interface_handle;
+    DWORD wait;
+
+    wait = WaitForSingleObject(overlapped->hEvent, timeout_ms);
+    if (wait == WAIT_OBJECT_0) {
+        return pWinUsb_GetOverlappedResult(iface, overlapped, transferred, FALSE)
+            ? TL_SUCCESS : TL_ERROR_GENERAL;
+    }
 
+    pWinUsb_AbortPipe(iface, pipe_id);
+    if (pWinUsb_GetOverlappedResult(iface, overlapped, transferred, TRUE) && *transferred > 0) {
+        /* 取消前剛好完成 */
+        return TL_SUCCESS;
+    }
+    *transferred = 0;
+    return (wait == WAIT_TIMEOUT) ? TL_ERROR_TIMEOUT : TL_ERROR_GENERAL;
+}
+#endif
+
+/* -------------------------------------------------------------------------
+ * 寫入資料
+ */
+TL_ERROR_CODE tl_usb_write_data(TL_DeviceContext* device, TL_BYTE pipe_id, const TL_BYTE* buffer,
+                                size_t buffer_size, unsigned long timeout_ms)
+{
     if (!buffer || buffer_size == 0) {
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
-    if (!state->device_handle || !state->interface_handle) {
+    if (!device->device_handle || !device->interface_handle) {
         tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
         return TL_ERROR_DEVICE_NOT_OPEN;
     }
+#ifdef BUILD_TEST_EXE
+    /* 模擬塔燈與 WinUSB 觸發相同的追蹤點 */
+    if (tl_usb_sim_active()) {
+        TL_ERROR_CODE sim_result;
+
+        TL_PROBE_WRITE_START(device, buffer_size);
+        sim_result = tl_usb_sim_write_data(device, buffer, buffer_size);
+        TL_PROBE_WRITE_END(device, (sim_result == TL_SUCCESS) ? buffer_size : 0, sim_result);
+        if (sim_result != TL_SUCCESS) {
+            TL_PROBE_ERROR(device, sim_result);
+        }
+        return sim_result;
+    }
+#endif
 
 #ifdef _WIN32
-    ULONG bytesTransferred = 0;
-    BOOL success = pWinUsb_WritePipe(
-        (WINUSB_INTERFACE_HANDLE)state->interface_handle,
+    OVERLAPPED overlapped;
+    DWORD bytesTransferred = 0;
+    TL_ERROR_CODE result = TL_SUCCESS;
+    unsigned long long start_us = tl_trace_begin();
+
+    TL_PROBE_WRITE_START(device, buffer_size);
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = (HANDLE)device->write_event;
+    ResetEvent(overlapped.hEvent);
+
+    if (!pWinUsb_WritePipe(
+        (WINUSB_INTERFACE_HANDLE)device->interface_handle,
         pipe_id,
         (PUCHAR)buffer,
         (ULONG)buffer_size,
-        &bytesTransferred,
-        NULL
-    );
+        NULL,
+        &overlapped)) {
+        if (GetLastError() != ERROR_IO_PENDING) {
+            result = TL_ERROR_WRITE_FAILED;
+        }
+    }
+    if (result == TL_SUCCESS) {
+        result = tl_usb_wait_overlapped(device, pipe_id, &overlapped, &bytesTransferred, timeout_ms);
+    }
+    tl_trace_end(TL_TRACE_USB_WRITE, start_us, (unsigned int)bytesTransferred);
+    TL_PROBE_WRITE_END(device, bytesTransferred, result);
 
-    if (!success || bytesTransferred == 0) {
+    if (result != TL_SUCCESS || bytesTransferred == 0) {
 #ifdef BUILD_TEST_EXE 
         DWORD err = GetLastError();
         printf("[tl_usb_write_data] WritePipe失敗, error=%lu\n", err);
 #endif
-        tl_set_last_error(TL_ERROR_WRITE_FAILED);
-        return TL_ERROR_WRITE_FAILED;
+        result = (result == TL_ERROR_TIMEOUT) ? TL_ERROR_TIMEOUT : TL_ERROR_WRITE_FAILED;
+        TL_PROBE_ERROR(device, result);
+        tl_set_last_error(result);
+        return result;
     }
     return TL_SUCCESS;
 #else
+    (void)pipe_id;
+    (void)timeout_ms;
     return TL_SUCCESS;
 #endif
 }
@@ -411,42 +673,169 @@ TL_ERROR_CODE tl_usb_write_data(TL_BYTE pipe_id, const TL_BYTE* buffer, size_t b
 /* -------------------------------------------------------------------------
  * 讀取資料
  */
-TL_ERROR_CODE tl_usb_read_data(TL_BYTE pipe_id, TL_BYTE* buffer, size_t buffer_size, size_t* bytes_read)
+TL_ERROR_CODE tl_usb_read_data(TL_DeviceContext* device, TL_BYTE pipe_id, TL_BYTE* buffer,
+                               size_t buffer_size, size_t* bytes_read, unsigned long timeout_ms)
 {
-    TL_InternalState* state = tl_get_internal_state();
-
     if (!buffer || buffer_size == 0 || !bytes_read) {
         tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
         return TL_ERROR_INVALID_PARAMETER;
     }
     *bytes_read = 0;
 
-    if (!state->device_handle || !state->interface_handle) {
+    if (!device->device_handle || !device->interface_handle) {
         tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
         return TL_ERROR_DEVICE_NOT_OPEN;
     }
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        TL_ERROR_CODE sim_result;
+
+        TL_PROBE_READ_START(device, buffer_size);
+        sim_result = tl_usb_sim_read_data(device, buffer, buffer_size, bytes_read, timeout_ms);
+        TL_PROBE_READ_END(device, *bytes_read, sim_result);
+        if (sim_result != TL_SUCCESS && sim_result != TL_ERROR_TIMEOUT) {
+            TL_PROBE_ERROR(device, sim_result);
+        }
+        return sim_result;
+    }
+#endif
 
 #ifdef _WIN32
-    ULONG bytesReceived = 0;
-    BOOL success = pWinUsb_ReadPipe(
-        (WINUSB_INTERFACE_HANDLE)state->interface_handle,
+    OVERLAPPED overlapped;
+    DWORD bytesReceived = 0;
+    TL_ERROR_CODE result = TL_SUCCESS;
+
+    TL_PROBE_READ_START(device, buffer_size);
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = (HANDLE)device->read_event;
+    ResetEvent(overlapped.hEvent);
+
+    if (!pWinUsb_ReadPipe(
+        (WINUSB_INTERFACE_HANDLE)device->interface_handle,
         pipe_id,
         (PUCHAR)buffer,
         (ULONG)buffer_size,
-        &bytesReceived,
-        NULL
-    );
-    if (!success) {
+        NULL,
+        &overlapped)) {
+        if (GetLastError() != ERROR_IO_PENDING) {
+            result = TL_ERROR_READ_FAILED;
+        }
+    }
+    if (result == TL_SUCCESS) {
+        result = tl_usb_wait_overlapped(device, pipe_id, &overlapped, &bytesReceived, timeout_ms);
+    }
+    TL_PROBE_READ_END(device, bytesReceived, result);
+
+    if (result != TL_SUCCESS) {
 #ifdef BUILD_TEST_EXE
         DWORD err = GetLastError();
         printf("[tl_usb_read_data] ReadPipe失敗, error=%lu\n", err);
 #endif
-        tl_set_last_error(TL_ERROR_READ_FAILED);
-        return TL_ERROR_READ_FAILED;
+        result = (result == TL_ERROR_TIMEOUT) ? TL_ERROR_TIMEOUT : TL_ERROR_READ_FAILED;
+        if (result != TL_ERROR_TIMEOUT) {
+            TL_PROBE_ERROR(device, result);
+        }
+        tl_set_last_error(result);
+        return result;
     }
     *bytes_read = (size_t)bytesReceived;
     return TL_SUCCESS;
 #else
+    (void)pipe_id;
+    (void)timeout_ms;
+    return TL_SUCCESS;
+#endif
+}
+
+/* -------------------------------------------------------------------------
+ * 重新同步管道
+ */
+TL_ERROR_CODE tl_usb_resync(TL_DeviceContext* device)
+{
+    if (!device->device_handle || !device->interface_handle) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_OPEN);
+        return TL_ERROR_DEVICE_NOT_OPEN;
+    }
+#ifdef BUILD_TEST_EXE
+    if (tl_usb_sim_active()) {
+        return tl_usb_sim_resync(device);
+    }
+#endif
+
+#ifdef _WIN32
+    WINUSB_INTERFACE_HANDLE iface = (WINUSB_INTERFACE_HANDLE)device->interface_handle;
+
+    /* 取消兩個方向上未完成的傳輸，並丟棄回應管道中殘留的資料 */
+    pWinUsb_AbortPipe(iface, TL_PIPE_ID);
+    pWinUsb_AbortPipe(iface, TL_RESPONSE_PIPE);
+    if (!pWinUsb_FlushPipe(iface, TL_RESPONSE_PIPE)) {
+#ifdef BUILD_TEST_EXE
+        DWORD err = GetLastError();
+        printf("[tl_usb_resync] FlushPipe失敗, error=%lu\n", err);
+#endif
+        tl_set_last_error(TL_ERROR_READ_FAILED);
+        return TL_ERROR_READ_FAILED;
+    }
+#endif
     return TL_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------
+ * 重新開啟裝置
+ * 依開啟時的裝置介面路徑找回同一台裝置 (重新列舉後索引可能改變)，
+ * 先開啟新的控制代碼，成功後才替換並關閉舊的控制代碼，
+ * 其他執行緒不會看到裝置短暫處於未開啟的狀態
+ */
+TL_ERROR_CODE tl_usb_reopen_device(TL_DeviceContext* device)
+{
+    TL_DeviceContext fresh;
+    TL_DeviceContext stale;
+    TL_ERROR_CODE result;
+    unsigned int index = device->device_index;
+
+    /* 平台不提供介面路徑時只能沿用原索引 */
+    if (device->device_path[0] != '\0') {
+        result = tl_usb_find_device(device->device_path, &index);
+        if (result != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE
+            printf("[tl_usb_reopen_device] 找不到原裝置 => %d\n", (int)result);
+#endif
+            return result;
+        }
+    }
+
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.device_index = index;
+    result = tl_usb_open_device(&fresh);
+    if (result != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE
+        printf("[tl_usb_reopen_device] 重新開啟失敗 => %d\n", (int)result);
 #endif
+        return result;
+    }
+
+    /* 尋找與開啟之間列舉順序又改變時，開到的是另一台裝置 */
+    if (strcmp(fresh.device_path, device->device_path) != 0) {
+        tl_usb_close_device(&fresh);
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_FOUND);
+        return TL_ERROR_DEVICE_NOT_FOUND;
+    }
+
+    memset(&stale, 0, sizeof(stale));
+    stale.device_handle = device->device_handle;
+    stale.interface_handle = device->interface_handle;
+    stale.write_event = device->write_event;
+    stale.read_event = device->read_event;
+
+    device->device_handle = fresh.device_handle;
+    device->interface_handle = fresh.interface_handle;
+    device->write_event = fresh.write_event;
+    device->read_event = fresh.read_event;
+    device->device_index = index;
+
+    tl_usb_close_device(&stale);
+#ifdef BUILD_TEST_EXE
+    printf("[tl_usb_reopen_device] 已重新開啟裝置 %u\n", device->device_index);
+#endif
+    return TL_SUCCESS;
 }
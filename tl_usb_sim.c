@@ -0,0 +1,529 @@
+﻿/*
+ * tl_usb_sim.c
+ *
+ * 塔燈通訊控制函式庫 - 模擬塔燈 (僅測試程式)
+ *
+ * 讓 main.c 的測試與效能量測不需要實體塔燈。啟用後 tl_usb_comm.c 的 USB 函式
+ * 改由此檔案處理：每座模擬塔燈依序處理收到的命令，經過設定的處理時間
+ * 與傳輸延遲後才能讀到回應 (一次讀取不跨越兩個回應，與 USB 批次傳輸相同)；可注入遺失回應與斷電重置，
+ * 也可設定韌體的速率上限 (權杖桶)，送得太快的命令不執行並回應 NAK。
+ * 斷電後重新列舉時塔燈可能改列於其他索引，之前開啟的控制代碼失效，
+ * 裝置介面路徑 (SIM#TOWER#塔燈編號) 則不變。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+#ifdef BUILD_TEST_EXE
+
+/* 每座塔燈最多暫存的回應數，超過時捨棄新的回應 (與裝置端緩衝區溢位相同) */
+#define TL_USB_SIM_QUEUE      256
+#define TL_USB_SIM_RESPONSE   16
+
+/* 尚未讀取的回應 */
+typedef struct {
+    TL_BYTE data[TL_USB_SIM_RESPONSE];
+    size_t length;
+    unsigned long long ready_us;      /* 可讀取的時間 (單調時間) */
+} TL_UsbSimResponse;
+
+/* 模擬塔燈 */
+typedef struct {
+    TL_BYTE layers[TL_LAYER_THREE + 1][4];    /* 各層的紅、綠、藍、閃爍模式 */
+    TL_BYTE buzzer[3];                        /* 音調、音量、模式 */
+    unsigned long service_us;                 /* 每個命令的處理時間 */
+    unsigned long link_us;                    /* 傳輸延遲 (不佔用塔燈的處理時間) */
+    size_t max_pending;                       /* 同時尚未讀取的回應數的最大值 */
+    unsigned long long busy_until_us;         /* 前一個命令處理完成的時間 */
+    unsigned int drop_responses;              /* 接下來不回應的命令數 */
+    unsigned long rate_per_sec;               /* 韌體的速率上限 (命令/秒)，0 表示不限制 */
+    unsigned long rate_burst;                 /* 可連續接受的命令數 */
+    unsigned long long rate_tokens;           /* 目前的權杖 (單位為百萬分之一個) */
+    unsigned long long rate_refill_us;        /* 上次補充權杖的時間 */
+    unsigned long write_count;                /* 收到的命令數 */
+    unsigned int generation;                  /* 重新插上的次數，之前開啟的控制代碼隨之失效 */
+    TL_UsbSimResponse queue[TL_USB_SIM_QUEUE];
+    size_t head;
+    size_t count;
+    size_t offset;                            /* 第一個回應已讀取的位元組數 */
+} TL_UsbSimTower;
+
+/* 開啟的控制代碼 */
+typedef struct {
+    TL_UsbSimTower* tower;
+    unsigned int generation;                  /* 開啟時塔燈的 generation */
+} TL_UsbSimHandle;
+
+/* 模擬器狀態 */
+static struct {
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 有新的回應 */
+    TL_UsbSimTower* towers;           /* 塔燈陣列，NULL 表示未啟用 */
+    unsigned int* order;              /* 各列舉索引上的塔燈編號 */
+    unsigned int count;               /* 塔燈數量 */
+} g_sim = { NULL, NULL, NULL, NULL, 0 };
+
+/*
+ * 啟用模擬塔燈
+ */
+TL_ERROR_CODE tl_usb_sim_enable(unsigned int count, unsigned long service_us)
+{
+    unsigned int i;
+
+    if (count == 0 || g_sim.towers != NULL) {
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+    g_sim.lock = tl_mutex_create();
+    g_sim.changed = tl_cond_create();
+    g_sim.towers = (TL_UsbSimTower*)calloc(count, sizeof(TL_UsbSimTower));
+    g_sim.order = (unsigned int*)calloc(count, sizeof(unsigned int));
+    if (g_sim.lock == NULL || g_sim.changed == NULL || g_sim.towers == NULL || g_sim.order == NULL) {
+        tl_usb_sim_disable();
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    for (i = 0; i < count; i++) {
+        g_sim.towers[i].service_us = service_us;
+        g_sim.order[i] = i;
+    }
+    g_sim.count = count;
+    return TL_SUCCESS;
+}
+
+/*
+ * 停用模擬塔燈 (所有模擬裝置關閉後呼叫)
+ */
+void tl_usb_sim_disable(void)
+{
+    free(g_sim.towers);
+    free(g_sim.order);
+    tl_cond_destroy(g_sim.changed);
+    tl_mutex_destroy(g_sim.lock);
+    g_sim.towers = NULL;
+    g_sim.order = NULL;
+    g_sim.changed = NULL;
+    g_sim.lock = NULL;
+    g_sim.count = 0;
+}
+
+/*
+ * 是否已啟用模擬塔燈
+ */
+TL_BOOL tl_usb_sim_active(void)
+{
+    return (g_sim.towers != NULL) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 設定塔燈的命令處理時間
+ */
+void tl_usb_sim_set_latency(unsigned int index, unsigned long service_us)
+{
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        g_sim.towers[index].service_us = service_us;
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 設定塔燈的傳輸延遲 (往返時間中不佔用塔燈處理時間的部分)
+ */
+void tl_usb_sim_set_link_delay(unsigned int index, unsigned long link_us)
+{
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        g_sim.towers[index].link_us = link_us;
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 設定韌體的速率上限，以滿桶開始
+ */
+void tl_usb_sim_set_rate_limit(unsigned int index, unsigned long rate_per_sec, unsigned long burst)
+{
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        g_sim.towers[index].rate_per_sec = rate_per_sec;
+        g_sim.towers[index].rate_burst = (burst > 0) ? burst : 1;
+        g_sim.towers[index].rate_tokens = (unsigned long long)g_sim.towers[index].rate_burst * 1000000ULL;
+        g_sim.towers[index].rate_refill_us = tl_time_now_us();
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 取得並歸零同時尚未讀取的回應數的最大值
+ */
+size_t tl_usb_sim_take_max_pending(unsigned int index)
+{
+    size_t max_pending = 0;
+
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        max_pending = g_sim.towers[index].max_pending;
+        g_sim.towers[index].max_pending = 0;
+        tl_mutex_unlock(g_sim.lock);
+    }
+    return max_pending;
+}
+
+/*
+ * 讓塔燈接下來的 count 個命令照常執行但不回應
+ */
+void tl_usb_sim_drop_responses(unsigned int index, unsigned int count)
+{
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        g_sim.towers[index].drop_responses = count;
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 模擬斷電重啟：塔燈回到全滅狀態，尚未讀取的回應一併遺失
+ */
+void tl_usb_sim_power_cycle(unsigned int index)
+{
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        memset(g_sim.towers[index].layers, 0, sizeof(g_sim.towers[index].layers));
+        memset(g_sim.towers[index].buzzer, 0, sizeof(g_sim.towers[index].buzzer));
+        g_sim.towers[index].count = 0;
+        g_sim.towers[index].offset = 0;
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 模擬USB重新列舉：之前開啟的控制代碼失效，尚未讀取的回應遺失，
+ * 並與原本位於 new_index 的塔燈交換列舉索引 (塔燈狀態保留，斷電時先呼叫 tl_usb_sim_power_cycle)
+ */
+void tl_usb_sim_replug(unsigned int index, unsigned int new_index)
+{
+    TL_UsbSimTower* tower;
+    unsigned int position;
+
+    if (index >= g_sim.count || new_index >= g_sim.count) {
+        return;
+    }
+    tl_mutex_lock(g_sim.lock);
+    tower = &g_sim.towers[index];
+    tower->count = 0;
+    tower->offset = 0;
+    tower->generation++;
+    for (position = 0; g_sim.order[position] != index; position++) {
+    }
+    g_sim.order[position] = g_sim.order[new_index];
+    g_sim.order[new_index] = index;
+    tl_mutex_unlock(g_sim.lock);
+}
+
+/*
+ * 取得塔燈收到的命令數
+ */
+unsigned long tl_usb_sim_write_count(unsigned int index)
+{
+    unsigned long count = 0;
+
+    if (index < g_sim.count) {
+        tl_mutex_lock(g_sim.lock);
+        count = g_sim.towers[index].write_count;
+        tl_mutex_unlock(g_sim.lock);
+    }
+    return count;
+}
+
+/*
+ * 取得塔燈目前的層狀態 (紅、綠、藍、閃爍模式)
+ */
+void tl_usb_sim_get_layer(unsigned int index, TL_LAYER layer, TL_BYTE state[4])
+{
+    if (index < g_sim.count && layer >= TL_LAYER_ONE && layer <= TL_LAYER_THREE) {
+        tl_mutex_lock(g_sim.lock);
+        memcpy(state, g_sim.towers[index].layers[layer], 4);
+        tl_mutex_unlock(g_sim.lock);
+    }
+}
+
+/*
+ * 依韌體的速率上限決定是否接受命令 (呼叫端持有模擬器鎖)
+ */
+static TL_BOOL tl_usb_sim_admit_locked(TL_UsbSimTower* tower)
+{
+    unsigned long long capacity = (unsigned long long)tower->rate_burst * 1000000ULL;
+    unsigned long long now = tl_time_now_us();
+
+    if (tower->rate_per_sec == 0) {
+        return TL_TRUE;
+    }
+    if (now > tower->rate_refill_us) {
+        tower->rate_tokens += (now - tower->rate_refill_us) * tower->rate_per_sec;
+        if (tower->rate_tokens > capacity) {
+            tower->rate_tokens = capacity;
+        }
+        tower->rate_refill_us = now;
+    }
+    if (tower->rate_tokens < 1000000ULL) {
+        return TL_FALSE;
+    }
+    tower->rate_tokens -= 1000000ULL;
+    return TL_TRUE;
+}
+
+/*
+ * 將回應加入佇列 (呼叫端持有模擬器鎖)，code 為 TL_RSP_ACK 或 TL_RSP_NAK
+ */
+static void tl_usb_sim_respond_locked(TL_UsbSimTower* tower, TL_BYTE command, TL_BYTE code,
+                                      const TL_BYTE* data, size_t data_length)
+{
+    TL_UsbSimResponse* response;
+    unsigned long long now = tl_time_now_us();
+
+    /* 命令依序處理 */
+    tower->busy_until_us = ((tower->busy_until_us > now) ? tower->busy_until_us : now) + tower->service_us;
+    if (tower->drop_responses > 0) {
+        tower->drop_responses--;
+        return;
+    }
+    if (tower->count >= TL_USB_SIM_QUEUE) {
+        return;
+    }
+
+    response = &tower->queue[(tower->head + tower->count) % TL_USB_SIM_QUEUE];
+    response->data[0] = TL_PKT_START;
+    response->data[1] = command;
+    response->data[2] = 0;
+    response->data[3] = (TL_BYTE)(data_length + 1);
+    response->data[4] = code;
+    if (data_length > 0) {
+        memcpy(&response->data[5], data, data_length);
+    }
+    response->data[5 + data_length] = tl_cmd_calculate_checksum(&response->data[1], 4 + data_length);
+    response->data[6 + data_length] = TL_PKT_END;
+    response->length = 7 + data_length;
+    response->ready_us = tower->busy_until_us + tower->link_us;
+    tower->count++;
+    if (tower->count > tower->max_pending) {
+        tower->max_pending = tower->count;
+    }
+    tl_cond_broadcast(g_sim.changed);
+}
+
+/*
+ * 取得已連接的模擬塔燈數量
+ */
+TL_ERROR_CODE tl_usb_sim_count_devices(unsigned int* count)
+{
+    *count = g_sim.count;
+    return TL_SUCCESS;
+}
+
+/*
+ * 依裝置介面路徑尋找塔燈目前的列舉索引
+ */
+TL_ERROR_CODE tl_usb_sim_find_device(const char* device_path, unsigned int* index)
+{
+    char path[TL_DEVICE_PATH_MAX];
+    unsigned int i;
+
+    tl_mutex_lock(g_sim.lock);
+    for (i = 0; i < g_sim.count; i++) {
+        snprintf(path, sizeof(path), "SIM#TOWER#%u", g_sim.order[i]);
+        if (strcmp(path, device_path) == 0) {
+            *index = i;
+            tl_mutex_unlock(g_sim.lock);
+            return TL_SUCCESS;
+        }
+    }
+    tl_mutex_unlock(g_sim.lock);
+    tl_set_last_error(TL_ERROR_DEVICE_NOT_FOUND);
+    return TL_ERROR_DEVICE_NOT_FOUND;
+}
+
+/*
+ * 開啟模擬塔燈 (控制代碼指向位於該列舉索引的塔燈)
+ */
+TL_ERROR_CODE tl_usb_sim_open_device(TL_DeviceContext* device)
+{
+    TL_UsbSimHandle* handle;
+
+    if (device->device_index >= g_sim.count) {
+        tl_set_last_error(TL_ERROR_DEVICE_NOT_FOUND);
+        return TL_ERROR_DEVICE_NOT_FOUND;
+    }
+    handle = (TL_UsbSimHandle*)malloc(sizeof(TL_UsbSimHandle));
+    if (handle == NULL) {
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+
+    tl_mutex_lock(g_sim.lock);
+    handle->tower = &g_sim.towers[g_sim.order[device->device_index]];
+    handle->generation = handle->tower->generation;
+    snprintf(device->device_path, TL_DEVICE_PATH_MAX, "SIM#TOWER#%u", g_sim.order[device->device_index]);
+    tl_mutex_unlock(g_sim.lock);
+
+    device->device_handle = handle;
+    device->interface_handle = handle;
+    return TL_SUCCESS;
+}
+
+/*
+ * 關閉模擬塔燈
+ */
+TL_ERROR_CODE tl_usb_sim_close_device(TL_DeviceContext* device)
+{
+    free(device->device_handle);
+    device->device_handle = NULL;
+    device->interface_handle = NULL;
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得控制代碼的塔燈，塔燈已重新插上時返回 NULL (呼叫端持有模擬器鎖)
+ */
+static TL_UsbSimTower* tl_usb_sim_tower_locked(TL_DeviceContext* device)
+{
+    TL_UsbSimHandle* handle = (TL_UsbSimHandle*)device->device_handle;
+
+    return (handle->generation == handle->tower->generation) ? handle->tower : NULL;
+}
+
+/*
+ * 寫入一個命令，回應於處理時間後才能讀取
+ */
+TL_ERROR_CODE tl_usb_sim_write_data(TL_DeviceContext* device, const TL_BYTE* buffer, size_t buffer_size)
+{
+    TL_UsbSimTower* tower;
+    unsigned long long start_us = tl_trace_begin();
+    TL_BYTE data[5];
+
+    if (buffer_size < 7 || buffer[0] != TL_PKT_START) {
+        tl_set_last_error(TL_ERROR_WRITE_FAILED);
+        return TL_ERROR_WRITE_FAILED;
+    }
+
+    tl_mutex_lock(g_sim.lock);
+    tower = tl_usb_sim_tower_locked(device);
+    if (tower == NULL) {
+        tl_mutex_unlock(g_sim.lock);
+        tl_set_last_error(TL_ERROR_WRITE_FAILED);
+        return TL_ERROR_WRITE_FAILED;
+    }
+    tower->write_count++;
+    if (!tl_usb_sim_admit_locked(tower)) {
+        tl_usb_sim_respond_locked(tower, buffer[1], TL_RSP_NAK, NULL, 0);
+        tl_mutex_unlock(g_sim.lock);
+        tl_trace_end(TL_TRACE_USB_WRITE, start_us, (unsigned int)buffer_size);
+        return TL_SUCCESS;
+    }
+    switch (buffer[1]) {
+    case TL_CMD_LED_SET:
+        if (buffer[4] <= TL_LAYER_THREE) {
+            memcpy(tower->layers[buffer[4]], &buffer[5], 4);
+        }
+        tl_usb_sim_respond_locked(tower, TL_CMD_LED_SET, TL_RSP_ACK, NULL, 0);
+        break;
+    case TL_CMD_BUZZER_SET:
+        memcpy(tower->buzzer, &buffer[4], 3);
+        tl_usb_sim_respond_locked(tower, TL_CMD_BUZZER_SET, TL_RSP_ACK, NULL, 0);
+        break;
+    case TL_CMD_STATUS_READ:
+        if (buffer[4] == TL_TARGET_BUZZER) {
+            memcpy(data, tower->buzzer, 3);
+            data[3] = 0;
+            tl_usb_sim_respond_locked(tower, TL_CMD_STATUS_READ, TL_RSP_ACK, data, 4);
+        } else if (buffer[4] <= TL_LAYER_THREE) {
+            data[0] = buffer[4];
+            memcpy(&data[1], tower->layers[buffer[4]], 4);
+            tl_usb_sim_respond_locked(tower, TL_CMD_STATUS_READ, TL_RSP_ACK, data, 5);
+        }
+        break;
+    default:
+        break;
+    }
+    tl_mutex_unlock(g_sim.lock);
+
+    tl_trace_end(TL_TRACE_USB_WRITE, start_us, (unsigned int)buffer_size);
+    return TL_SUCCESS;
+}
+
+/*
+ * 讀取第一個回應的剩餘部分 (最多 buffer_size 位元組)，尚未處理完成時等待至逾時
+ */
+TL_ERROR_CODE tl_usb_sim_read_data(TL_DeviceContext* device, TL_BYTE* buffer, size_t buffer_size,
+                                   size_t* bytes_read, unsigned long timeout_ms)
+{
+    TL_UsbSimTower* tower;
+    unsigned long long deadline_us = tl_time_now_us() + (unsigned long long)timeout_ms * 1000ULL;
+    unsigned long long now;
+    unsigned long long wake_us;
+    TL_UsbSimResponse* response;
+
+    tl_mutex_lock(g_sim.lock);
+    for (;;) {
+        tower = tl_usb_sim_tower_locked(device);
+        if (tower == NULL) {
+            tl_mutex_unlock(g_sim.lock);
+            tl_set_last_error(TL_ERROR_READ_FAILED);
+            return TL_ERROR_READ_FAILED;
+        }
+        now = tl_time_now_us();
+        response = (tower->count > 0) ? &tower->queue[tower->head] : NULL;
+        if (response != NULL && response->ready_us <= now) {
+            *bytes_read = response->length - tower->offset;
+            if (*bytes_read > buffer_size) {
+                *bytes_read = buffer_size;
+            }
+            memcpy(buffer, &response->data[tower->offset], *bytes_read);
+            tower->offset += *bytes_read;
+            if (tower->offset == response->length) {
+                tower->head = (tower->head + 1) % TL_USB_SIM_QUEUE;
+                tower->count--;
+                tower->offset = 0;
+            }
+            tl_mutex_unlock(g_sim.lock);
+            return TL_SUCCESS;
+        }
+        if (now >= deadline_us) {
+            tl_mutex_unlock(g_sim.lock);
+            tl_set_last_error(TL_ERROR_TIMEOUT);
+            return TL_ERROR_TIMEOUT;
+        }
+
+        /* 等待較長時以條件變數睡眠，不足 2ms 時讓出處理器以保持微秒級精度 */
+        wake_us = (response != NULL && response->ready_us < deadline_us) ? response->ready_us : deadline_us;
+        if (wake_us - now >= 2000) {
+            tl_cond_wait(g_sim.changed, g_sim.lock, (unsigned long)((wake_us - now) / 1000 - 1));
+        } else {
+            tl_mutex_unlock(g_sim.lock);
+            tl_delay_ms(0);
+            tl_mutex_lock(g_sim.lock);
+        }
+    }
+}
+
+/*
+ * 捨棄尚未讀取的回應
+ */
+TL_ERROR_CODE tl_usb_sim_resync(TL_DeviceContext* device)
+{
+    TL_UsbSimTower* tower;
+
+    tl_mutex_lock(g_sim.lock);
+    tower = tl_usb_sim_tower_locked(device);
+    if (tower != NULL) {
+        tower->count = 0;
+        tower->offset = 0;
+    }
+    tl_mutex_unlock(g_sim.lock);
+    return TL_SUCCESS;
+}
+
+#endif /* BUILD_TEST_EXE */
@@ -0,0 +1,365 @@
+﻿/*
+ * tl_watchdog.c
+ *
+ * 塔燈通訊控制函式庫 - 失效安全看門狗實現
+ *
+ * 監控程式停止回應時，塔燈會一直顯示最後的設定 (例如綠燈「運轉中」)。
+ * 啟用看門狗後，應用程式須在設定的週期內呼叫 TL_Heartbeat；逾期時由
+ * 函式庫的看門狗執行緒以緊急優先權送出預先建構的安全畫面 (例如閃爍的
+ * 黃燈與蜂鳴器)，尚未送出的一般設定命令一併作廢。
+ *
+ * 動畫、排程、已提交的命令、期望狀態收斂與輸入濾波代表的是已停止回應的
+ * 應用程式的意圖，觸發時一併停止或取消，避免它們把安全畫面改回原本的狀態。
+ *
+ * 觸發延遲自心跳期限起算，到安全畫面送出完成為止，記錄於統計中。
+ *
+ * 版本: 1.0.0
+ * 日期: 2026-10-18
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tl_internal.h"
+
+/* 失效安全看門狗 */
+struct TL_Watchdog {
+    TL_DeviceContext* device;         /* 所屬裝置 */
+    TL_Mutex* lock;                   /* 保護以下欄位 */
+    TL_Cond* changed;                 /* 設定改變、自觸發狀態恢復或停止 */
+    TL_Thread* thread;                /* 看門狗執行緒 */
+    TL_BOOL stopping;                 /* 正在停止 */
+    TL_PreparedFrame failsafe;        /* 預先建構的安全畫面 */
+    unsigned long long heartbeat_us;  /* 最後一次心跳的時間 */
+    unsigned long long retry_us;      /* 安全畫面送出失敗後的重試時間，0 表示不重試 */
+    TL_WatchdogStats stats;           /* 統計 */
+};
+
+/*
+ * 裝置目前的狀態是否已不同於安全畫面
+ */
+static TL_BOOL tl_watchdog_overwritten(TL_DeviceContext* device, const TL_PreparedFrame* failsafe)
+{
+    TL_TowerState state;
+
+    if (TL_PackTowerState(&failsafe->frame, &state) != TL_SUCCESS) {
+        return TL_FALSE;
+    }
+    return (TL_DiffTowerState(tl_atomic_load_u32(&device->current_state), state) &
+            failsafe->frame.target_mask) ? TL_TRUE : TL_FALSE;
+}
+
+/*
+ * 送出安全畫面 (進入與離開時持有鎖)
+ */
+static void tl_watchdog_trip_locked(TL_Watchdog* watchdog, unsigned long long deadline_us)
+{
+    TL_DeviceContext* device = watchdog->device;
+    unsigned long long heartbeat_us = watchdog->heartbeat_us;
+    unsigned long long latency_us;
+    TL_PreparedFrame failsafe;
+    TL_ERROR_CODE result;
+
+    /* 送出期間 TL_StartWatchdog 可能更新安全畫面，先在鎖內複製 */
+    failsafe = watchdog->failsafe;
+    tl_mutex_unlock(watchdog->lock);
+
+    /* 緊急優先權：只等待進行中的往返，排隊中的一般設定命令作廢 */
+    result = tl_cmd_apply_emergency(device, &failsafe);
+    latency_us = tl_time_now_us() - deadline_us;
+
+    /* 應用程式已無回應，其動畫、排程、提交的命令、期望狀態與濾波輸入不應覆蓋安全畫面；
+     * 尚未執行的排程與提交請求以 TL_ERROR_DEVICE_NOT_OPEN 完成 */
+    tl_sequence_stop(device);
+    tl_scheduler_cancel_target(device);
+    tl_events_cancel_target(device);
+    tl_reconcile_stop(device);
+    tl_filter_stop(device);
+
+    /* 取消前已在執行的請求可能在安全畫面之後才寫出，此時重新送出 */
+    if (result == TL_SUCCESS && tl_watchdog_overwritten(device, &failsafe)) {
+        result = tl_cmd_apply_emergency(device, &failsafe);
+    }
+
+    tl_mutex_lock(watchdog->lock);
+
+    if (result != TL_SUCCESS) {
+#ifdef BUILD_TEST_EXE
+        printf("[tl_watchdog] 安全畫面送出失敗 => %d\n", (int)result);
+#endif
+        watchdog->stats.failsafe_failures++;
+        watchdog->retry_us = tl_time_now_us() + TL_WATCHDOG_RETRY_MS * 1000ULL;
+        return;
+    }
+
+    watchdog->retry_us = 0;
+    watchdog->stats.trip_count++;
+    watchdog->stats.last_trip_latency_us = latency_us;
+    watchdog->stats.total_trip_latency_us += latency_us;
+    if (latency_us > watchdog->stats.max_trip_latency_us) {
+        watchdog->stats.max_trip_latency_us = latency_us;
+    }
+    /* 送出期間已收到心跳時，應用程式已恢復，會自行重新設定 */
+    watchdog->stats.tripped = (watchdog->heartbeat_us == heartbeat_us) ? TL_TRUE : TL_FALSE;
+
+#ifdef BUILD_TEST_EXE
+    printf("[tl_watchdog] 心跳逾期，已送出安全畫面，延遲 %lluus\n", latency_us);
+#endif
+}
+
+/*
+ * 看門狗執行緒
+ */
+static void tl_watchdog_main(void* arg)
+{
+    TL_Watchdog* watchdog = (TL_Watchdog*)arg;
+    unsigned long long now_us;
+    unsigned long long deadline_us;
+    unsigned long long wake_us;
+
+    tl_mutex_lock(watchdog->lock);
+    while (!watchdog->stopping) {
+        now_us = tl_time_now_us();
+        deadline_us = watchdog->heartbeat_us + (unsigned long long)watchdog->stats.interval_ms * 1000;
+
+        /* 已觸發：等待心跳恢復，送出失敗時定期重試 */
+        if (watchdog->stats.tripped) {
+            tl_cond_wait(watchdog->changed, watchdog->lock, TL_WAIT_INFINITE);
+            continue;
+        }
+        if (watchdog->retry_us != 0) {
+            if (now_us >= watchdog->retry_us) {
+                tl_watchdog_trip_locked(watchdog, deadline_us);
+                continue;
+            }
+            wake_us = watchdog->retry_us;
+        } else if (now_us >= deadline_us) {
+            tl_watchdog_trip_locked(watchdog, deadline_us);
+            continue;
+        } else {
+            wake_us = deadline_us;
+        }
+
+        tl_cond_wait(watchdog->changed, watchdog->lock, (unsigned long)((wake_us - now_us + 999) / 1000));
+    }
+    tl_mutex_unlock(watchdog->lock);
+}
+
+/*
+ * 釋放看門狗
+ */
+static void tl_watchdog_free(TL_Watchdog* watchdog)
+{
+    tl_cond_destroy(watchdog->changed);
+    tl_mutex_destroy(watchdog->lock);
+    free(watchdog);
+}
+
+/*
+ * 停止失效安全看門狗
+ */
+void tl_watchdog_stop(TL_DeviceContext* device)
+{
+    TL_Watchdog* watchdog;
+
+    tl_mutex_lock(device->state_lock);
+    watchdog = device->watchdog;
+    device->watchdog = NULL;
+    tl_mutex_unlock(device->state_lock);
+
+    if (watchdog == NULL) {
+        return;
+    }
+
+    tl_mutex_lock(watchdog->lock);
+    watchdog->stopping = TL_TRUE;
+    tl_cond_broadcast(watchdog->changed);
+    tl_mutex_unlock(watchdog->lock);
+
+    tl_thread_join(watchdog->thread);
+    tl_watchdog_free(watchdog);
+}
+
+/*
+ * 解析目標裝置，NULL 表示預設裝置
+ */
+static TL_ERROR_CODE tl_watchdog_resolve(TL_DEVICE_HANDLE device, TL_DeviceContext** resolved)
+{
+    *resolved = (device != NULL) ? device : tl_get_default_device();
+    return tl_validate_device(*resolved);
+}
+
+/*
+ * 啟用失效安全看門狗
+ */
+TL_ERROR_CODE TL_StartWatchdog(TL_DEVICE_HANDLE device, unsigned long interval_ms, const TL_TowerFrame* failsafe)
+{
+    TL_DeviceContext* context;
+    TL_Watchdog* watchdog;
+    TL_PreparedFrame prepared;
+    TL_ERROR_CODE result;
+
+    /* 參數驗證 */
+    if (interval_ms == 0 || failsafe == NULL || failsafe->target_mask == 0) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    /* 安全畫面在啟用時建構一次，觸發時不需再建構命令 */
+    result = tl_cmd_prepare_frame(failsafe, &prepared);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    result = tl_watchdog_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    watchdog = context->watchdog;
+    if (watchdog != NULL) {
+        /* 已啟用：更新設定並重新起算期限 */
+        tl_mutex_lock(watchdog->lock);
+        watchdog->failsafe = prepared;
+        watchdog->stats.interval_ms = interval_ms;
+        watchdog->heartbeat_us = tl_time_now_us();
+        watchdog->retry_us = 0;
+        watchdog->stats.tripped = TL_FALSE;
+        tl_cond_broadcast(watchdog->changed);
+        tl_mutex_unlock(watchdog->lock);
+        tl_mutex_unlock(context->state_lock);
+        return TL_SUCCESS;
+    }
+
+    watchdog = (TL_Watchdog*)calloc(1, sizeof(TL_Watchdog));
+    if (watchdog != NULL) {
+        watchdog->device = context;
+        watchdog->failsafe = prepared;
+        watchdog->stats.armed = TL_TRUE;
+        watchdog->stats.interval_ms = interval_ms;
+        watchdog->heartbeat_us = tl_time_now_us();
+        watchdog->lock = tl_mutex_create();
+        watchdog->changed = tl_cond_create();
+        if (watchdog->lock == NULL || watchdog->changed == NULL) {
+            tl_watchdog_free(watchdog);
+            watchdog = NULL;
+        } else {
+            watchdog->thread = tl_thread_create(tl_watchdog_main, watchdog);
+            if (watchdog->thread == NULL) {
+                tl_watchdog_free(watchdog);
+                watchdog = NULL;
+            }
+        }
+    }
+    if (watchdog == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        tl_set_last_error(TL_ERROR_MEMORY_ALLOCATION);
+        return TL_ERROR_MEMORY_ALLOCATION;
+    }
+    context->watchdog = watchdog;
+    tl_mutex_unlock(context->state_lock);
+
+#ifdef BUILD_TEST_EXE
+    printf("[TL_StartWatchdog] 心跳週期 %lums\n", interval_ms);
+#endif
+    return TL_SUCCESS;
+}
+
+/*
+ * 送出心跳
+ */
+TL_ERROR_CODE TL_Heartbeat(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_Watchdog* watchdog;
+    TL_ERROR_CODE result;
+    unsigned long long now_us;
+    unsigned long long deadline_us;
+    unsigned long long margin_us;
+
+    result = tl_watchdog_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    tl_mutex_lock(context->state_lock);
+    watchdog = context->watchdog;
+    if (watchdog == NULL) {
+        tl_mutex_unlock(context->state_lock);
+        tl_set_last_error(TL_ERROR_GENERAL);
+        return TL_ERROR_GENERAL;
+    }
+
+    tl_mutex_lock(watchdog->lock);
+    now_us = tl_time_now_us();
+    deadline_us = watchdog->heartbeat_us + (unsigned long long)watchdog->stats.interval_ms * 1000;
+    watchdog->heartbeat_us = now_us;
+    watchdog->stats.heartbeats++;
+
+    /* 記錄心跳距離期限最近的一次，評估應用程式的餘裕 */
+    if (!watchdog->stats.tripped && watchdog->retry_us == 0) {
+        margin_us = (deadline_us > now_us) ? deadline_us - now_us : 0;
+        if (watchdog->stats.heartbeats == 1 || margin_us < watchdog->stats.min_margin_us) {
+            watchdog->stats.min_margin_us = margin_us;
+        }
+    }
+
+    /* 自觸發狀態恢復；應用程式須自行重新設定塔燈 */
+    if (watchdog->stats.tripped || watchdog->retry_us != 0) {
+        watchdog->stats.tripped = TL_FALSE;
+        watchdog->retry_us = 0;
+        watchdog->stats.recoveries++;
+        tl_cond_broadcast(watchdog->changed);
+    }
+    tl_mutex_unlock(watchdog->lock);
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}
+
+/*
+ * 停用失效安全看門狗
+ */
+TL_ERROR_CODE TL_StopWatchdog(TL_DEVICE_HANDLE device)
+{
+    TL_DeviceContext* context;
+    TL_ERROR_CODE result;
+
+    result = tl_watchdog_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+    tl_watchdog_stop(context);
+    return TL_SUCCESS;
+}
+
+/*
+ * 取得看門狗統計
+ */
+TL_ERROR_CODE TL_GetWatchdogStats(TL_DEVICE_HANDLE device, TL_WatchdogStats* stats)
+{
+    TL_DeviceContext* context;
+    TL_Watchdog* watchdog;
+    TL_ERROR_CODE result;
+
+    if (stats == NULL) {
+        tl_set_last_error(TL_ERROR_INVALID_PARAMETER);
+        return TL_ERROR_INVALID_PARAMETER;
+    }
+
+    result = tl_watchdog_resolve(device, &context);
+    if (result != TL_SUCCESS) {
+        return result;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    tl_mutex_lock(context->state_lock);
+    watchdog = context->watchdog;
+    if (watchdog != NULL) {
+        tl_mutex_lock(watchdog->lock);
+        *stats = watchdog->stats;
+        tl_mutex_unlock(watchdog->lock);
+    }
+    tl_mutex_unlock(context->state_lock);
+    return TL_SUCCESS;
+}